@@ -36,12 +36,15 @@ typedef struct {
 } MPI_Status;
 
 typedef MPI_Handle MPI_Aint;
+typedef MPI_Handle MPI_File;
+typedef MPI_Handle MPI_Info;
+typedef long int MPI_Offset;
 
 /* Defined constants (see Annex A.2) */
 
 /* Return codes */
 
-enum return_codes {MPI_SUCCESS};
+enum return_codes {MPI_SUCCESS, MPI_ERR_FILE};
 
 /* Assorted constants */
 
@@ -99,6 +102,22 @@ enum reserved_communicators{MPI_COMM_WORLD, MPI_COMM_SELF};
 #define MPI_REQUEST_NULL    -4
 #define MPI_OP_NULL         -5
 #define MPI_ERRHANDLER_NULL -6
+#define MPI_INFO_NULL       -7
+#define MPI_FILE_NULL       -8
+
+/* File access modes (bit flags) and array orders */
+
+enum file_access_modes {MPI_MODE_RDONLY = 2,
+			MPI_MODE_RDWR = 8,
+			MPI_MODE_WRONLY = 4,
+			MPI_MODE_CREATE = 1,
+			MPI_MODE_EXCL = 64,
+			MPI_MODE_DELETE_ON_CLOSE = 16,
+			MPI_MODE_UNIQUE_OPEN = 32,
+			MPI_MODE_APPEND = 128,
+			MPI_MODE_SEQUENTIAL = 256};
+
+enum array_orders {MPI_ORDER_C, MPI_ORDER_FORTRAN};
 
 /* Special values */
 
@@ -165,6 +184,9 @@ int MPI_Gatherv(const void * sendbuf, int sendcount, MPI_Datatype sendtype,
 int MPI_Allgather(void * sendbuf, int sendcount, MPI_Datatype sendtype,
 		  void * recvbuf, int recvcount, MPI_Datatype recvtype,
 		  MPI_Comm comm);
+int MPI_Alltoall(void * sendbuf, int sendcount, MPI_Datatype sendtype,
+		 void * recvbuf, int recvcount, MPI_Datatype recvtype,
+		 MPI_Comm comm);
 int MPI_Allreduce(void * send, void * recv, int count, MPI_Datatype type,
 		  MPI_Op op, MPI_Comm comm);
 
@@ -215,6 +237,28 @@ int MPI_Type_create_struct(int count, int * arry_of_blocklens,
 			   MPI_Datatype * newtype);
 int MPI_Type_create_resized(MPI_Datatype oldtype, MPI_Aint ub, MPI_Aint extent,
 			    MPI_Datatype * newtype);
+int MPI_Type_create_subarray(int ndims, const int * array_of_sizes,
+			     const int * array_of_subsizes,
+			     const int * array_of_starts, int order,
+			     MPI_Datatype oldtype, MPI_Datatype * newtype);
+
+/* MPI-IO. A file is a single stream of bytes; the only file view
+ * available is the whole file (as it must be for one process). */
+
+int MPI_File_open(MPI_Comm comm, const char * filename, int amode,
+		  MPI_Info info, MPI_File * fh);
+int MPI_File_close(MPI_File * fh);
+int MPI_File_delete(const char * filename, MPI_Info info);
+int MPI_File_set_size(MPI_File fh, MPI_Offset size);
+int MPI_File_set_view(MPI_File fh, MPI_Offset disp, MPI_Datatype etype,
+		      MPI_Datatype filetype, const char * datarep,
+		      MPI_Info info);
+int MPI_File_read_at_all(MPI_File fh, MPI_Offset offset, void * buf,
+			 int count, MPI_Datatype datatype,
+			 MPI_Status * status);
+int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, const void * buf,
+			  int count, MPI_Datatype datatype,
+			  MPI_Status * status);
 
 #ifdef __cplusplus
 }
@@ -15,7 +15,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2018 The University of Edinburgh
+ *  (c) 2018-2019 The University of Edinburgh
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
  *
  *****************************************************************************/
@@ -43,6 +43,21 @@ static int mpi_sizeof(MPI_Datatype type);
 static int mpi_initialised_flag_ = 0;
 static int periods_[3];
 
+/* MPI-IO file handles are an index into a small table of streams */
+
+#define MPI_MAX_FILES 16
+
+typedef struct mpi_file_s mpi_file_t;
+
+struct mpi_file_s {
+  FILE * fp;              /* Open stream (NULL if slot free) */
+  char filename[FILENAME_MAX];
+  MPI_Offset disp;        /* Displacement of current view (bytes) */
+  int etypesz;            /* Size of elementary type of view (bytes) */
+};
+
+static mpi_file_t mpi_file_[MPI_MAX_FILES];
+
 /*****************************************************************************
  *
  *  MPI_Barrier
@@ -364,6 +379,24 @@ int MPI_Allgather(void * sendbuf, int sendcount, MPI_Datatype sendtype,
   return MPI_SUCCESS;
 }
 
+/****************************************************************************
+ *
+ *  MPI_Alltoall
+ *
+ ****************************************************************************/
+
+int MPI_Alltoall(void * sendbuf, int sendcount, MPI_Datatype sendtype,
+		 void * recvbuf, int recvcount, MPI_Datatype recvtype,
+		 MPI_Comm comm) {
+
+  assert(mpi_initialised_flag_);
+  assert(sendcount == recvcount);
+  assert(sendtype == recvtype);
+  mpi_copy(sendbuf, recvbuf, sendcount, sendtype);
+
+  return MPI_SUCCESS;
+}
+
 /*****************************************************************************
  *
  *  MPI_Gather
@@ -922,4 +955,224 @@ int MPI_Type_get_extent(MPI_Datatype dataype, MPI_Aint * lb,
   return MPI_SUCCESS;
 }
 
+/*****************************************************************************
+ *
+ *  MPI_Type_create_subarray
+ *
+ *  In serial, the subarray must be the whole array.
+ *
+ *****************************************************************************/
+
+int MPI_Type_create_subarray(int ndims, const int * array_of_sizes,
+			     const int * array_of_subsizes,
+			     const int * array_of_starts, int order,
+			     MPI_Datatype oldtype, MPI_Datatype * newtype) {
+  int n;
+
+  assert(array_of_sizes);
+  assert(array_of_subsizes);
+  assert(array_of_starts);
+  assert(order == MPI_ORDER_C || order == MPI_ORDER_FORTRAN);
+  assert(newtype);
+
+  for (n = 0; n < ndims; n++) {
+    assert(array_of_subsizes[n] == array_of_sizes[n]);
+    assert(array_of_starts[n] == 0);
+  }
+
+  *newtype = MPI_UNDEFINED;
+
+  return MPI_SUCCESS;
+}
+
+/*****************************************************************************
+ *
+ *  MPI_File_open
+ *
+ *  An existing file is opened for update; a new file is created
+ *  only if MPI_MODE_CREATE is present.
+ *
+ *****************************************************************************/
+
+int MPI_File_open(MPI_Comm comm, const char * filename, int amode,
+		  MPI_Info info, MPI_File * fh) {
+
+  int n;
+  FILE * fp = NULL;
+
+  assert(mpi_initialised_flag_);
+  assert(filename);
+  assert(strlen(filename) < FILENAME_MAX);
+  assert(fh);
+
+  *fh = MPI_FILE_NULL;
+
+  for (n = 0; n < MPI_MAX_FILES; n++) {
+    if (mpi_file_[n].fp == NULL) break;
+  }
+  if (n == MPI_MAX_FILES) return MPI_ERR_FILE;
+
+  if (amode & MPI_MODE_RDONLY) {
+    fp = fopen(filename, "rb");
+  }
+  else {
+    fp = fopen(filename, "r+b");
+    if (fp && (amode & MPI_MODE_EXCL)) {
+      fclose(fp);
+      return MPI_ERR_FILE;
+    }
+    if (fp == NULL && (amode & MPI_MODE_CREATE)) fp = fopen(filename, "w+b");
+  }
+
+  if (fp == NULL) return MPI_ERR_FILE;
+
+  mpi_file_[n].fp = fp;
+  strncpy(mpi_file_[n].filename, filename, FILENAME_MAX - 1);
+  mpi_file_[n].disp = 0;
+  mpi_file_[n].etypesz = mpi_sizeof(MPI_BYTE);
+  *fh = n;
+
+  return MPI_SUCCESS;
+}
+
+/*****************************************************************************
+ *
+ *  MPI_File_close
+ *
+ *****************************************************************************/
+
+int MPI_File_close(MPI_File * fh) {
+
+  int ifail;
+
+  assert(fh);
+  assert(*fh >= 0 && *fh < MPI_MAX_FILES);
+  assert(mpi_file_[*fh].fp);
+
+  ifail = fclose(mpi_file_[*fh].fp);
+  mpi_file_[*fh].fp = NULL;
+  *fh = MPI_FILE_NULL;
+
+  return (ifail == 0) ? MPI_SUCCESS : MPI_ERR_FILE;
+}
+
+/*****************************************************************************
+ *
+ *  MPI_File_delete
+ *
+ *****************************************************************************/
+
+int MPI_File_delete(const char * filename, MPI_Info info) {
+
+  assert(filename);
+
+  return (remove(filename) == 0) ? MPI_SUCCESS : MPI_ERR_FILE;
+}
+
+/*****************************************************************************
+ *
+ *  MPI_File_set_size
+ *
+ *  Only truncation to zero length is supported.
+ *
+ *****************************************************************************/
+
+int MPI_File_set_size(MPI_File fh, MPI_Offset size) {
+
+  mpi_file_t * file = NULL;
+
+  assert(fh >= 0 && fh < MPI_MAX_FILES);
+  assert(mpi_file_[fh].fp);
+  assert(size == 0);
+
+  file = mpi_file_ + fh;
+  file->fp = freopen(file->filename, "w+b", file->fp);
+
+  return (file->fp == NULL) ? MPI_ERR_FILE : MPI_SUCCESS;
+}
+
+/*****************************************************************************
+ *
+ *  MPI_File_set_view
+ *
+ *  The filetype is ignored: any view of the file is the whole file.
+ *
+ *****************************************************************************/
+
+int MPI_File_set_view(MPI_File fh, MPI_Offset disp, MPI_Datatype etype,
+		      MPI_Datatype filetype, const char * datarep,
+		      MPI_Info info) {
+
+  assert(fh >= 0 && fh < MPI_MAX_FILES);
+  assert(mpi_file_[fh].fp);
+  assert(disp >= 0);
+  assert(datarep);
+  assert(strcmp(datarep, "native") == 0);
+
+  mpi_file_[fh].disp = disp;
+  mpi_file_[fh].etypesz = mpi_sizeof(etype);
+
+  return MPI_SUCCESS;
+}
+
+/*****************************************************************************
+ *
+ *  MPI_File_read_at_all
+ *
+ *  The offset is in units of the etype of the current view.
+ *
+ *****************************************************************************/
+
+int MPI_File_read_at_all(MPI_File fh, MPI_Offset offset, void * buf,
+			 int count, MPI_Datatype datatype,
+			 MPI_Status * status) {
+  int nr;
+  mpi_file_t * file = NULL;
+
+  assert(fh >= 0 && fh < MPI_MAX_FILES);
+  assert(mpi_file_[fh].fp);
+  assert(buf);
+  assert(status);
+
+  file = mpi_file_ + fh;
+
+  fseek(file->fp, file->disp + offset*file->etypesz, SEEK_SET);
+  nr = fread(buf, mpi_sizeof(datatype), count, file->fp);
+
+  status->MPI_SOURCE = 0;
+  status->MPI_TAG = MPI_ANY_TAG;
+
+  return (nr == count) ? MPI_SUCCESS : MPI_ERR_FILE;
+}
+
+/*****************************************************************************
+ *
+ *  MPI_File_write_at_all
+ *
+ *  The offset is in units of the etype of the current view.
+ *
+ *****************************************************************************/
+
+int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, const void * buf,
+			  int count, MPI_Datatype datatype,
+			  MPI_Status * status) {
+  int nw;
+  mpi_file_t * file = NULL;
+
+  assert(fh >= 0 && fh < MPI_MAX_FILES);
+  assert(mpi_file_[fh].fp);
+  assert(buf);
+  assert(status);
+
+  file = mpi_file_ + fh;
+
+  fseek(file->fp, file->disp + offset*file->etypesz, SEEK_SET);
+  nw = fwrite(buf, mpi_sizeof(datatype), count, file->fp);
+
+  status->MPI_SOURCE = 0;
+  status->MPI_TAG = MPI_ANY_TAG;
+
+  return (nw == count) ? MPI_SUCCESS : MPI_ERR_FILE;
+}
+
 #endif /* _DO_NOT_INCLUDE_MPI2_INTERFACE */
@@ -15,6 +15,7 @@ static int test_mpi_comm_size(void);
 static int test_mpi_allreduce(void);
 static int test_mpi_reduce(void);
 static int test_mpi_allgather(void);
+static int test_mpi_file_write_read(void);
 
 int main (int argc, char ** argv) {
 
@@ -30,6 +31,7 @@ int main (int argc, char ** argv) {
   ireturn = test_mpi_allreduce();
   ireturn = test_mpi_reduce();
   ireturn = test_mpi_allgather();
+  ireturn = test_mpi_file_write_read();
 
   ireturn = MPI_Finalize();
   assert(ireturn == MPI_SUCCESS);
@@ -183,3 +185,60 @@ int test_mpi_allgather(void) {
 
   return MPI_SUCCESS;
 }
+
+/*****************************************************************************
+ *
+ *  test_mpi_file_write_read
+ *
+ *****************************************************************************/
+
+static int test_mpi_file_write_read(void) {
+
+  int ireturn;
+  int sizes[2] = {2, 3};
+  int starts[2] = {0, 0};
+  double send[6] = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0};
+  double recv[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  const char * filename = "mpi-test-file.dat";
+
+  MPI_Datatype filetype;
+  MPI_File fh = MPI_FILE_NULL;
+  MPI_Status status;
+
+  ireturn = MPI_Type_create_subarray(2, sizes, sizes, starts, MPI_ORDER_C,
+				     MPI_DOUBLE, &filetype);
+  assert(ireturn == MPI_SUCCESS);
+  MPI_Type_commit(&filetype);
+
+  ireturn = MPI_File_open(comm_, filename, MPI_MODE_WRONLY | MPI_MODE_CREATE,
+			  MPI_INFO_NULL, &fh);
+  assert(ireturn == MPI_SUCCESS);
+  MPI_File_set_size(fh, 0);
+  MPI_File_set_view(fh, 0, MPI_DOUBLE, filetype, "native", MPI_INFO_NULL);
+
+  ireturn = MPI_File_write_at_all(fh, 0, send, 6, MPI_DOUBLE, &status);
+  assert(ireturn == MPI_SUCCESS);
+  ireturn = MPI_File_close(&fh);
+  assert(ireturn == MPI_SUCCESS);
+  assert(fh == MPI_FILE_NULL);
+
+  /* Read back the second row only */
+
+  ireturn = MPI_File_open(comm_, filename, MPI_MODE_RDONLY, MPI_INFO_NULL,
+			  &fh);
+  assert(ireturn == MPI_SUCCESS);
+  MPI_File_set_view(fh, 0, MPI_DOUBLE, filetype, "native", MPI_INFO_NULL);
+
+  ireturn = MPI_File_read_at_all(fh, 3, recv, 3, MPI_DOUBLE, &status);
+  assert(ireturn == MPI_SUCCESS);
+  assert(recv[0] == send[3]);
+  assert(recv[2] == send[5]);
+
+  MPI_File_close(&fh);
+  MPI_Type_free(&filetype);
+
+  ireturn = MPI_File_delete(filename, MPI_INFO_NULL);
+  assert(ireturn == MPI_SUCCESS);
+
+  return MPI_SUCCESS;
+}
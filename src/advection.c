@@ -21,7 +21,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2018  The University of Edinburgh
+ *  (c) 2010-2019  The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -34,7 +34,6 @@
 
 #include "field_s.h"
 #include "advection_s.h"
-#include "psi_gradients.h"
 #include "hydro_s.h"
 #include "timer.h"
 
@@ -1487,88 +1486,3 @@ static int advection_le_5th(advflux_t * flux, hydro_t * hydro, int nf,
 
   return 0;
 }
-
-/*****************************************************************************
- *
- *  advective_fluxes_d3qx
- *
- *  General routine for nf fields at starting address f.
- *  No Lees Edwards boundaries.
- *
- *  The storage of the field(s) for all the related routines is
- *  assumed to be f[index][nf], where index is the spatial index.
- *
- *****************************************************************************/
-
-int advective_fluxes_d3qx(hydro_t * hydro, int nf, double * f, 
-					double ** flx) {
-
-  assert(hydro);
-  assert(nf > 0);
-  assert(f);
-  assert(flx);
-
-  advective_fluxes_2nd_d3qx(hydro, nf, f, flx);
-
-  return 0;
-}
-
-/*****************************************************************************
- *
- *  advective_fluxes_2nd_d3qx
- *
- *  'Centred difference' advective fluxes. No LE planes.
- *  TODO: belongs to Nernst Planck.
- *
- *  Symmetric two-point stencil.
- *
- *****************************************************************************/
-
-int advective_fluxes_2nd_d3qx(hydro_t * hydro, int nf, double * f, 
-					double ** flx) {
-
-  int nlocal[3];
-  int ic, jc, kc, c;
-  int n;
-  int index0, index1;
-  int nsites;
-  double u0[3], u1[3], u;
-
-  assert(hydro);
-  assert(hydro->cs);
-  assert(nf > 0);
-  assert(f);
-  assert(flx);
-
-  cs_nlocal(hydro->cs, nlocal);
-  cs_nsites(hydro->cs, &nsites);
-  /* assert(nhalo >= 1); */
-
-  for (ic = 1; ic <= nlocal[X]; ic++) {
-    for (jc = 1; jc <= nlocal[Y]; jc++) {
-      for (kc = 1; kc <= nlocal[Z]; kc++) {
-
-	index0 = cs_index(hydro->cs, ic, jc, kc);
-	hydro_u(hydro, index0, u0);
-
-        for (c = 1; c < PSI_NGRAD; c++) {
-
-	  index1 = cs_index(hydro->cs, ic + psi_gr_cv[c][X], jc + psi_gr_cv[c][Y], kc + psi_gr_cv[c][Z]);
-	  hydro_u(hydro, index1, u1);
-
-	  u = 0.5*((u0[X] + u1[X])*psi_gr_cv[c][X] + (u0[Y] + u1[Y])*psi_gr_cv[c][Y] + (u0[Z] + u1[Z])*psi_gr_cv[c][Z]);
-
-	  for (n = 0; n < nf; n++) {
-	    flx[addr_rank1(nsites, nf, index0, n)][c - 1]
-	      = u*0.5*(f[addr_rank1(nsites, nf, index1, n)]
-		       + f[addr_rank1(nsites, nf, index0, n)]);
-	  }
-	}
-
-	/* Next site */
-      }
-    }
-  }
-
-  return 0;
-}
@@ -8,7 +8,7 @@
  *  Edinburgh Parallel Computing Centre
  *
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
- *  (c) 2010-2017 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *****************************************************************************/
 
@@ -31,10 +31,6 @@ __host__ int advflux_free(advflux_t * obj);
 __host__ int advflux_memcpy(advflux_t * obj);
 
 __host__ int advection_x(advflux_t * obj, hydro_t * hydro, field_t * field);
-__host__ int advective_fluxes_d3qx(hydro_t * hydro, int nf, double * f, 
-			double ** flx);
-__host__ int advective_fluxes_2nd_d3qx(hydro_t * hydro, int nf, double * f, 
-			double ** flx);
 
 __host__ int advection_order_set(const int order);
 __host__ int advection_order(int * order);
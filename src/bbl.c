@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2018 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing Authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -50,8 +50,13 @@ static int bbl_wall_lubrication_account(bbl_t * bbl, wall_t * wall,
 
 __global__ void bbl_pass0_kernel(kernel_ctxt_t * ktxt, cs_t * cs, lb_t * lb,
 				 colloids_info_t * cinfo);
+__global__ void bbl_pass1_kernel(colloid_link_table_t * table, lb_t * lb,
+				 double rho0);
+__global__ void bbl_pass2_kernel(colloid_link_table_t * table, lb_t * lb,
+				 double rho0, double * stress);
 
 static __constant__ lb_collide_param_t lbp;
+static __device__ double bbl_stress[9];
 
 /*****************************************************************************
  *
@@ -164,10 +169,6 @@ int bounce_back_on_links(bbl_t * bbl, lb_t * lb, wall_t * wall,
   colloid_sums_halo(cinfo, COLLOID_SUM_STRUCTURE);
 
   bbl_pass0(bbl, lb, cinfo);
-
-  /* __NVCC__ TODO: remove */
-  lb_memcpy(lb, tdpMemcpyDeviceToHost);
-
   bbl_pass1(bbl, lb, cinfo);
 
   colloid_sums_halo(cinfo, COLLOID_SUM_DYNAMICS);
@@ -181,9 +182,6 @@ int bounce_back_on_links(bbl_t * bbl, lb_t * lb, wall_t * wall,
 
   bbl_pass2(bbl, lb, cinfo);
 
-  /* __NVCC__ TODO: remove */
-  lb_memcpy(lb, tdpMemcpyHostToDevice);
-
   return 0;
 }
 
@@ -351,8 +349,8 @@ __global__ void bbl_pass0_kernel(kernel_ctxt_t * ktxt, cs_t * cs, lb_t * lb,
 	  }
 	}
 
-	lb->f[ LB_ADDR(lb->nsite, lb->ndist, NVEL, index, LB_RHO, p) ]
-	  = lbp.wv[p]*(1.0 + rcs2*udotc + 0.5*rcs2*rcs2*sdotq);
+	lb_fpost_set(lb, index, p, LB_RHO,
+		     lbp.wv[p]*(1.0 + rcs2*udotc + 0.5*rcs2*rcs2*sdotq));
       }
     }
   }
@@ -365,27 +363,21 @@ __global__ void bbl_pass0_kernel(kernel_ctxt_t * ktxt, cs_t * cs, lb_t * lb,
  *  bbl_pass1
  *
  *  Work out the velocity independent terms before actual BBL takes place.
+ *  The per-colloid normalisation is on the host; the sums over links
+ *  are a kernel over the link table.
  *
  *****************************************************************************/
 
 static int bbl_pass1(bbl_t * bbl, lb_t * lb, colloids_info_t * cinfo) {
 
-  int ia;
-  int i, j, ij, ji;
-
-  double dm;
-  double delta;
+  int n, ia;
   double rsumw;
-  double c[3];
-  double rbxc[3];
   double rho0;
-  double mod, rmod, dm_a, cost, plegendre, sint;
-  double tans[3], vector1[3];
-  double fdist;
+  dim3 nblk, ntpb;
 
   physics_t * phys = NULL;
-  colloid_t * pc;
-  colloid_link_t * p_link;
+  colloid_t * pc = NULL;
+  colloid_link_table_t * table = NULL;
 
   assert(bbl);
   assert(lb);
@@ -394,16 +386,17 @@ static int bbl_pass1(bbl_t * bbl, lb_t * lb, colloids_info_t * cinfo) {
   physics_ref(&phys);
   physics_rho0(phys, &rho0);
 
+  colloids_info_link_table(cinfo, &table);
+  assert(table);
+
   /* All colloids, including halo */
 
-  colloids_info_all_head(cinfo, &pc);
+  for (n = 0; n < table->ncolloid; n++) {
 
-  for ( ; pc; pc = pc->nextall) {
+    pc = table->colloid[n];
 
-    p_link = pc->lnk;
-
-    for (i = 0; i < 21; i++) {
-      pc->zeta[i] = 0.0;
+    for (ia = 0; ia < 21; ia++) {
+      pc->zeta[ia] = 0.0;
     }
 
     /* We need to normalise link quantities by the sum of weights
@@ -417,130 +410,178 @@ static int bbl_pass1(bbl_t * bbl, lb_t * lb, colloids_info_t * cinfo) {
     }
     pc->deltam   *= rsumw;
     pc->s.deltaphi *= rsumw;
+  }
 
-    /* Sum over the links */ 
+  if (table->nlink == 0) return 0;
 
-    for (; p_link; p_link = p_link->next) {
+  kernel_launch_param(table->nlink, &nblk, &ntpb);
 
-      if (p_link->status == LINK_UNUSED) continue;
+  tdpLaunchKernel(bbl_pass1_kernel, nblk, ntpb, 0, 0,
+		  table->target, lb->target, rho0);
 
-      i = p_link->i;        /* index site i (outside) */
-      j = p_link->j;        /* index site j (inside) */
-      ij = p_link->p;       /* link velocity index i->j */
-      ji = NVEL - ij;       /* link velocity index j->i */
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  bbl_pass1_kernel
+ *
+ *  One thread per link; contributions to the owning colloid are
+ *  accumulated atomically.
+ *
+ *****************************************************************************/
 
-      assert(ij > 0 && ij < NVEL);
+__global__ void bbl_pass1_kernel(colloid_link_table_t * table, lb_t * lb,
+				 double rho0) {
+  int n;
+  const double rcs2 = 3.0;
 
-      /* For stationary link, the momentum transfer from the
-       * fluid to the colloid is "dm" */
+  assert(table);
+  assert(lb);
 
-      if (p_link->status == LINK_FLUID) {
-	/* Bounce back of fluid on outside plus correction
-	 * arising from changes in shape at previous step.
-	 * Note minus sign. */
+  for_simt_parallel(n, table->nlink, 1) {
 
-	lb_f(lb, i, ij, 0, &fdist);
-	dm =  2.0*fdist - wv[ij]*pc->deltam;
-	delta = 2.0*rcs2*wv[ij]*rho0;
+    int ia;
+    int i, j, ij, ji;
 
-	/* Squirmer section */
-	if (pc->s.type == COLLOID_TYPE_ACTIVE) {
+    double dm;
+    double delta;
+    double c[3];
+    double rb[3];
+    double rbxc[3];
+    double mod, rmod, dm_a, cost, plegendre, sint;
+    double tans[3], vector1[3];
+    double fdist;
+    double zeta[21];
 
-	  /* We expect s.m to be a unit vector, but for floating
-	   * point purposes, we must make sure here. */
+    colloid_t * pc = table->colloid[table->ic[n]];
 
-	  mod = modulus(p_link->rb)*modulus(pc->s.m);
-	  rmod = 0.0;
-	  if (mod != 0.0) rmod = 1.0/mod;
-	  cost = rmod*dot_product(p_link->rb, pc->s.m);
-	  if (cost*cost > 1.0) cost = 1.0;
-	  assert(cost*cost <= 1.0);
-	  sint = sqrt(1.0 - cost*cost);
+    i = table->i[n];        /* index site i (outside) */
+    j = table->j[n];        /* index site j (inside) */
+    ij = table->p[n];       /* link velocity index i->j */
+    ji = NVEL - ij;         /* link velocity index j->i */
 
-	  cross_product(p_link->rb, pc->s.m, vector1);
-	  cross_product(vector1, p_link->rb, tans);
+    assert(ij > 0 && ij < NVEL);
 
-	  mod = modulus(tans);
-	  rmod = 0.0;
-	  if (mod != 0.0) rmod = 1.0/mod;
-	  plegendre = -sint*(pc->s.b2*cost + pc->s.b1);
+    for (ia = 0; ia < 3; ia++) {
+      rb[ia] = table->rb[addr_rank1(table->nlinkmax, 3, n, ia)];
+    }
 
-	  dm_a = 0.0;
-	  for (ia = 0; ia < 3; ia++) {
-	    dm_a += -delta*plegendre*rmod*tans[ia]*cv[ij][ia];
-	  }
+    /* For stationary link, the momentum transfer from the
+     * fluid to the colloid is "dm" */
+
+    if (table->status[n] == LINK_FLUID) {
+      /* Bounce back of fluid on outside plus correction
+       * arising from changes in shape at previous step.
+       * Note minus sign. */
+
+      lb_fpost(lb, i, ij, 0, &fdist);
+      dm =  2.0*fdist - lbp.wv[ij]*pc->deltam;
+      delta = 2.0*rcs2*lbp.wv[ij]*rho0;
 
-	  lb_f(lb, i, ij, 0, &fdist);
-	  fdist += dm_a;
-	  lb_f_set(lb, i, ij, 0, fdist);
+      /* Squirmer section */
+      if (pc->s.type == COLLOID_TYPE_ACTIVE) {
 
-	  dm += dm_a;
+	/* We expect s.m to be a unit vector, but for floating
+	 * point purposes, we must make sure here. */
 
-	  /* needed for mass conservation   */
-	  pc->sump += dm_a;
+	mod = modulus(rb)*modulus(pc->s.m);
+	rmod = 0.0;
+	if (mod != 0.0) rmod = 1.0/mod;
+	cost = rmod*dot_product(rb, pc->s.m);
+	if (cost*cost > 1.0) cost = 1.0;
+	assert(cost*cost <= 1.0);
+	sint = sqrt(1.0 - cost*cost);
+
+	cross_product(rb, pc->s.m, vector1);
+	cross_product(vector1, rb, tans);
+
+	mod = modulus(tans);
+	rmod = 0.0;
+	if (mod != 0.0) rmod = 1.0/mod;
+	plegendre = -sint*(pc->s.b2*cost + pc->s.b1);
+
+	dm_a = 0.0;
+	for (ia = 0; ia < 3; ia++) {
+	  dm_a += -delta*plegendre*rmod*tans[ia]*lbp.cv[ij][ia];
 	}
-      }
-      else {
-	/* Virtual momentum transfer for solid->solid links,
-	 * but no contribution to drag maxtrix */
-
-	lb_f(lb, i, ij, 0, &fdist);
-	dm = fdist;
-	lb_f(lb, j, ji, 0, &fdist);
-	dm += fdist;
-	delta = 0.0;
-      }
 
-      for (ia = 0; ia < 3; ia++) {
-	c[ia] = 1.0*cv[ij][ia];
+	lb_fpost(lb, i, ij, 0, &fdist);
+	fdist += dm_a;
+	lb_fpost_set(lb, i, ij, 0, fdist);
+
+	dm += dm_a;
+
+	/* needed for mass conservation   */
+	tdpAtomicAddDouble(&pc->sump, dm_a);
       }
+    }
+    else {
+      /* Virtual momentum transfer for solid->solid links,
+       * but no contribution to drag maxtrix */
+
+      lb_fpost(lb, i, ij, 0, &fdist);
+      dm = fdist;
+      lb_fpost(lb, j, ji, 0, &fdist);
+      dm += fdist;
+      delta = 0.0;
+    }
 
-      cross_product(p_link->rb, c, rbxc);
+    for (ia = 0; ia < 3; ia++) {
+      c[ia] = 1.0*lbp.cv[ij][ia];
+    }
 
-      /* Now add contribution to the sums required for 
-       * self-consistent evaluation of new velocities. */
+    cross_product(rb, c, rbxc);
 
-      for (ia = 0; ia < 3; ia++) {
-	pc->f0[ia] += dm*c[ia];
-	pc->t0[ia] += dm*rbxc[ia];
-	/* Corrections when links are missing (close to contact) */
-	c[ia] -= pc->cbar[ia];
-	rbxc[ia] -= pc->rxcbar[ia];
-      }
+    /* Now add contribution to the sums required for 
+     * self-consistent evaluation of new velocities. */
+
+    for (ia = 0; ia < 3; ia++) {
+      tdpAtomicAddDouble(&pc->f0[ia], dm*c[ia]);
+      tdpAtomicAddDouble(&pc->t0[ia], dm*rbxc[ia]);
+      /* Corrections when links are missing (close to contact) */
+      c[ia] -= pc->cbar[ia];
+      rbxc[ia] -= pc->rxcbar[ia];
+    }
 
-      /* Drag matrix elements */
+    /* Drag matrix elements */
 
-      pc->zeta[ 0] += delta*c[X]*c[X];
-      pc->zeta[ 1] += delta*c[X]*c[Y];
-      pc->zeta[ 2] += delta*c[X]*c[Z];
-      pc->zeta[ 3] += delta*c[X]*rbxc[X];
-      pc->zeta[ 4] += delta*c[X]*rbxc[Y];
-      pc->zeta[ 5] += delta*c[X]*rbxc[Z];
+    zeta[ 0] = delta*c[X]*c[X];
+    zeta[ 1] = delta*c[X]*c[Y];
+    zeta[ 2] = delta*c[X]*c[Z];
+    zeta[ 3] = delta*c[X]*rbxc[X];
+    zeta[ 4] = delta*c[X]*rbxc[Y];
+    zeta[ 5] = delta*c[X]*rbxc[Z];
 
-      pc->zeta[ 6] += delta*c[Y]*c[Y];
-      pc->zeta[ 7] += delta*c[Y]*c[Z];
-      pc->zeta[ 8] += delta*c[Y]*rbxc[X];
-      pc->zeta[ 9] += delta*c[Y]*rbxc[Y];
-      pc->zeta[10] += delta*c[Y]*rbxc[Z];
+    zeta[ 6] = delta*c[Y]*c[Y];
+    zeta[ 7] = delta*c[Y]*c[Z];
+    zeta[ 8] = delta*c[Y]*rbxc[X];
+    zeta[ 9] = delta*c[Y]*rbxc[Y];
+    zeta[10] = delta*c[Y]*rbxc[Z];
 
-      pc->zeta[11] += delta*c[Z]*c[Z];
-      pc->zeta[12] += delta*c[Z]*rbxc[X];
-      pc->zeta[13] += delta*c[Z]*rbxc[Y];
-      pc->zeta[14] += delta*c[Z]*rbxc[Z];
+    zeta[11] = delta*c[Z]*c[Z];
+    zeta[12] = delta*c[Z]*rbxc[X];
+    zeta[13] = delta*c[Z]*rbxc[Y];
+    zeta[14] = delta*c[Z]*rbxc[Z];
 
-      pc->zeta[15] += delta*rbxc[X]*rbxc[X];
-      pc->zeta[16] += delta*rbxc[X]*rbxc[Y];
-      pc->zeta[17] += delta*rbxc[X]*rbxc[Z];
+    zeta[15] = delta*rbxc[X]*rbxc[X];
+    zeta[16] = delta*rbxc[X]*rbxc[Y];
+    zeta[17] = delta*rbxc[X]*rbxc[Z];
 
-      pc->zeta[18] += delta*rbxc[Y]*rbxc[Y];
-      pc->zeta[19] += delta*rbxc[Y]*rbxc[Z];
+    zeta[18] = delta*rbxc[Y]*rbxc[Y];
+    zeta[19] = delta*rbxc[Y]*rbxc[Z];
 
-      pc->zeta[20] += delta*rbxc[Z]*rbxc[Z];
+    zeta[20] = delta*rbxc[Z]*rbxc[Z];
 
+    for (ia = 0; ia < 21; ia++) {
+      tdpAtomicAddDouble(&pc->zeta[ia], zeta[ia]);
     }
   }
 
-  return 0;
+  return;
 }
 
 /*****************************************************************************
@@ -558,24 +599,15 @@ static int bbl_pass1(bbl_t * bbl, lb_t * lb, colloids_info_t * cinfo) {
 
 static int bbl_pass2(bbl_t * bbl, lb_t * lb, colloids_info_t * cinfo) {
 
-  int i, j, ij, ji;
-  int ia;
-  int ndist;
-
-  double dm;
-  double vdotc;
-  double dms;
-  double df, dg;
-  double fdist;
-  double wxrb[3];
-
-  double dgtm1;
+  int n, ia, ib;
   double rho0;
+  double slocal[9] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  double * sd = NULL;
+  dim3 nblk, ntpb;
 
   physics_t * phys = NULL;
   colloid_t * pc = NULL;
-  colloid_link_t * p_link;
-
+  colloid_link_table_t * table = NULL;
 
   assert(bbl);
   assert(lb);
@@ -584,139 +616,228 @@ static int bbl_pass2(bbl_t * bbl, lb_t * lb, colloids_info_t * cinfo) {
   physics_ref(&phys);
   physics_rho0(phys, &rho0);
 
-  ndist=lb->ndist;
+  colloids_info_link_table(cinfo, &table);
+  assert(table);
 
-  /* Account the current phi deficit */
-  bbl->deltag = 0.0;
+  /* The correction for phi from the previous step (pc->s.deltaphi)
+   * is read by the kernel; the new value accumulates in the table. */
+
+  colloid_link_table_deltaphi_zero(table);
+
+  tdpGetSymbolAddress((void **) &sd, tdpSymbol(bbl_stress));
+  tdpAssert(tdpMemcpy(sd, slocal, 9*sizeof(double), tdpMemcpyHostToDevice));
+
+  if (table->nlink > 0) {
+
+    kernel_launch_param(table->nlink, &nblk, &ntpb);
+
+    tdpLaunchKernel(bbl_pass2_kernel, nblk, ntpb, 0, 0,
+		    table->target, lb->target, rho0, sd);
+
+    tdpAssert(tdpPeekAtLastError());
+    tdpAssert(tdpDeviceSynchronize());
+  }
 
-  /* Zero the surface stress */
+  colloid_link_table_memcpy(table, tdpMemcpyDeviceToHost);
+  tdpAssert(tdpMemcpy(slocal, sd, 9*sizeof(double), tdpMemcpyDeviceToHost));
 
-  for (i = 0; i < 3; i++) {
-    for (j = 0; j < 3; j++) {
-      bbl->stress[i][j] = 0.0;
+  /* Surface stress */
+
+  for (ia = 0; ia < 3; ia++) {
+    for (ib = 0; ib < 3; ib++) {
+      bbl->stress[ia][ib] = slocal[3*ia + ib];
     }
   }
 
-  /* All colloids, including halo */
+  /* Account the current phi deficit */
 
-  colloids_info_all_head(cinfo, &pc);
+  bbl->deltag = 0.0;
 
-  for ( ; pc; pc = pc->nextall) {
+  /* All colloids, including halo */
 
-    /* Set correction for phi arising from previous step */
+  for (n = 0; n < table->ncolloid; n++) {
 
-    dgtm1 = pc->s.deltaphi;
-    pc->s.deltaphi = 0.0;
+    pc = table->colloid[n];
+    pc->s.deltaphi = table->deltaphi[n];
 
-    /* Correction to the bounce-back for this particle if it is
-     * without full complement of links */
+    /* Reset factors required for change of shape, etc */
 
-    dms = 0.0;
+    pc->deltam = 0.0;
+    pc->sump = 0.0;
 
     for (ia = 0; ia < 3; ia++) {
-      dms += pc->s.v[ia]*pc->cbar[ia];
-      dms += pc->s.w[ia]*pc->rxcbar[ia];
+      pc->f0[ia] = 0.0;
+      pc->t0[ia] = 0.0;
+      pc->fc0[ia] = 0.0;
+      pc->tc0[ia] = 0.0;
     }
 
-    dms = 2.0*rcs2*rho0*dms;
+    bbl->deltag += pc->s.deltaphi;
+  }
 
-    /* Run through the links */
+  return 0;
+}
 
-    p_link = pc->lnk;
+/*****************************************************************************
+ *
+ *  bbl_pass2_kernel
+ *
+ *  One thread per link. The surface stress is a block reduction
+ *  into stress[9] (row major).
+ *
+ *****************************************************************************/
 
-    for ( ; p_link; p_link = p_link->next) {
+__global__ void bbl_pass2_kernel(colloid_link_table_t * table, lb_t * lb,
+				 double rho0, double * stress) {
+  int n;
+  int ia, ib;
+  int tid;
+  const double rcs2 = 3.0;
 
-      i = p_link->i;       /* index site i (outside) */
-      j = p_link->j;       /* index site j (inside) */
-      ij = p_link->p;      /* link velocity index i->j */
-      ji = NVEL - ij;      /* link velocity index j->i */
+  __shared__ double sxx[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double sxy[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double sxz[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double syx[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double syy[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double syz[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double szx[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double szy[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double szz[TARGET_MAX_THREADS_PER_BLOCK];
 
-      if (p_link->status == LINK_FLUID) {
+  double * s[9] = {sxx, sxy, sxz, syx, syy, syz, szx, szy, szz};
 
-	lb_f(lb, i, ij, 0, &fdist);
-	dm =  2.0*fdist - wv[ij]*pc->deltam;
+  assert(table);
+  assert(lb);
+  assert(stress);
 
-	/* Compute the self-consistent boundary velocity,
-	 * and add the correction term for changes in shape. */
+  tid = threadIdx.x;
 
-	cross_product(pc->s.w, p_link->rb, wxrb);
+  for (ia = 0; ia < 9; ia++) {
+    s[ia][tid] = 0.0;
+  }
 
-	vdotc = 0.0;
-	for (ia = 0; ia < 3; ia++) {
-	  vdotc += (pc->s.v[ia] + wxrb[ia])*cv[ij][ia];
-	}
-	vdotc = 2.0*rcs2*wv[ij]*vdotc;
-	df = rho0*vdotc + wv[ij]*pc->deltam;
+  for_simt_parallel(n, table->nlink, 1) {
 
-	/* Contribution to mass conservation from squirmer */
+    int i, j, ij, ji;
+    int ic;
 
-	df += wv[ij]*pc->sump; 
+    double dm;
+    double vdotc;
+    double dms;
+    double df, dg;
+    double fdist;
+    double rb[3];
+    double wxrb[3];
+    double dgtm1;
 
-	/* Correction owing to missing links "squeeze term" */
+    colloid_t * pc = NULL;
 
-	df -= wv[ij]*dms;
+    ic = table->ic[n];
+    pc = table->colloid[ic];
 
-	/* The outside site actually undergoes BBL. */
+    i = table->i[n];       /* index site i (outside) */
+    j = table->j[n];       /* index site j (inside) */
+    ij = table->p[n];      /* link velocity index i->j */
+    ji = NVEL - ij;        /* link velocity index j->i */
 
-	lb_f(lb, i, ij, LB_RHO, &fdist);
-	fdist = fdist - df;
-	lb_f_set(lb, j, ji, LB_RHO, fdist);
+    for (ia = 0; ia < 3; ia++) {
+      rb[ia] = table->rb[addr_rank1(table->nlinkmax, 3, n, ia)];
+    }
 
-	/* This is slightly clunky. If the order parameter is
-	 * via LB, bounce back with correction. */
+    if (table->status[n] == LINK_FLUID) {
 
-	if (ndist > 1) {
-	  lb_0th_moment(lb, i, LB_PHI, &dg);
-	  dg *= vdotc;
-	  pc->s.deltaphi += dg;
-	  dg -= wv[ij]*dgtm1;
+      /* Correction for phi arising from previous step */
 
-	  lb_f(lb, i, ij, LB_PHI, &fdist);
-	  fdist = fdist - dg;
-	  lb_f_set(lb, j, ji, LB_PHI, fdist);
-	}
+      dgtm1 = pc->s.deltaphi;
 
-	/* The stress is r_b f_b */
-	for (ia = 0; ia < 3; ia++) {
-	  bbl->stress[ia][X] += p_link->rb[X]*(dm - df)*cv[ij][ia];
-	  bbl->stress[ia][Y] += p_link->rb[Y]*(dm - df)*cv[ij][ia];
-	  bbl->stress[ia][Z] += p_link->rb[Z]*(dm - df)*cv[ij][ia];
-	}
+      /* Correction to the bounce-back for this particle if it is
+       * without full complement of links */
+
+      dms = 0.0;
+
+      for (ia = 0; ia < 3; ia++) {
+	dms += pc->s.v[ia]*pc->cbar[ia];
+	dms += pc->s.w[ia]*pc->rxcbar[ia];
       }
-      else if (p_link->status == LINK_COLLOID) {
 
-	/* The stress should include the solid->solid term */
+      dms = 2.0*rcs2*rho0*dms;
 
-	lb_f(lb, i, ij, 0, &fdist);
-	dm = fdist;
-	lb_f(lb, j, ji, 0, &fdist);
-	dm += fdist;
+      lb_fpost(lb, i, ij, 0, &fdist);
+      dm =  2.0*fdist - lbp.wv[ij]*pc->deltam;
 
-	for (ia = 0; ia < 3; ia++) {
-	  bbl->stress[ia][X] += p_link->rb[X]*dm*cv[ij][ia];
-	  bbl->stress[ia][Y] += p_link->rb[Y]*dm*cv[ij][ia];
-	  bbl->stress[ia][Z] += p_link->rb[Z]*dm*cv[ij][ia];
+      /* Compute the self-consistent boundary velocity,
+       * and add the correction term for changes in shape. */
+
+      cross_product(pc->s.w, rb, wxrb);
+
+      vdotc = 0.0;
+      for (ia = 0; ia < 3; ia++) {
+	vdotc += (pc->s.v[ia] + wxrb[ia])*lbp.cv[ij][ia];
+      }
+      vdotc = 2.0*rcs2*lbp.wv[ij]*vdotc;
+      df = rho0*vdotc + lbp.wv[ij]*pc->deltam;
+
+      /* Contribution to mass conservation from squirmer */
+
+      df += lbp.wv[ij]*pc->sump; 
+
+      /* Correction owing to missing links "squeeze term" */
+
+      df -= lbp.wv[ij]*dms;
+
+      /* The outside site actually undergoes BBL. */
+
+      lb_fpost(lb, i, ij, LB_RHO, &fdist);
+      fdist = fdist - df;
+      lb_fpost_set(lb, j, ji, LB_RHO, fdist);
+
+      /* This is slightly clunky. If the order parameter is
+       * via LB, bounce back with correction. */
+
+      if (lbp.ndist > 1) {
+	lb_0th_moment(lb, i, LB_PHI, &dg);
+	dg *= vdotc;
+	tdpAtomicAddDouble(&table->deltaphi[ic], dg);
+	dg -= lbp.wv[ij]*dgtm1;
+
+	lb_fpost(lb, i, ij, LB_PHI, &fdist);
+	fdist = fdist - dg;
+	lb_fpost_set(lb, j, ji, LB_PHI, fdist);
+      }
+
+      /* The stress is r_b f_b */
+      for (ia = 0; ia < 3; ia++) {
+	for (ib = 0; ib < 3; ib++) {
+	  s[3*ia + ib][tid] += rb[ib]*(dm - df)*lbp.cv[ij][ia];
 	}
       }
-      /* Next link */
     }
+    else if (table->status[n] == LINK_COLLOID) {
 
-    /* Reset factors required for change of shape, etc */
+      /* The stress should include the solid->solid term */
 
-    pc->deltam = 0.0;
-    pc->sump = 0.0;
+      lb_fpost(lb, i, ij, 0, &fdist);
+      dm = fdist;
+      lb_fpost(lb, j, ji, 0, &fdist);
+      dm += fdist;
 
-    for (ia = 0; ia < 3; ia++) {
-      pc->f0[ia] = 0.0;
-      pc->t0[ia] = 0.0;
-      pc->fc0[ia] = 0.0;
-      pc->tc0[ia] = 0.0;
+      for (ia = 0; ia < 3; ia++) {
+	for (ib = 0; ib < 3; ib++) {
+	  s[3*ia + ib][tid] += rb[ib]*dm*lbp.cv[ij][ia];
+	}
+      }
     }
+    /* Next link */
+  }
 
-    bbl->deltag += pc->s.deltaphi;
+  /* Reduction for the stress */
+
+  for (ia = 0; ia < 9; ia++) {
+    double sb = tdpAtomicBlockAddDouble(s[ia]);
+    if (tid == 0) tdpAtomicAddDouble(&stress[ia], sb);
   }
 
-  return 0;
+  return;
 }
 
 /*****************************************************************************
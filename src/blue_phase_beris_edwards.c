@@ -21,6 +21,20 @@
  *  the final term renders the whole thing traceless.
  *  xi is defined with the free energy.
  *
+ *  The molecular field is computed as required in the update kernel
+ *  (from q and its gradients, which must be available), and is not
+ *  stored.
+ *
+ *  For relaxational dynamics (no hydrodynamics) with the 7-point
+ *  gradient and the blue phase free energy, nothing else requires
+ *  the gradients in the time step. A fused update may then be
+ *  selected via beris_edw_fused_set(): the gradients, the molecular
+ *  field, and the update are all computed in one pass over the
+ *  tiles of the lattice, reading the neighbouring q directly, so the
+ *  field_grad_t grad and delsq arrays are neither written nor read.
+ *  As neighbouring tiles read the old q, the new q is written to
+ *  a separate buffer and copied back.
+ *
  *  The noise term xi_ab is treated following Bhattacharjee et al.
  *  J. Chem. Phys. 133 044112 (2010). We need to define five constant
  *  matrices T_ab; these are used in association with five random
@@ -31,7 +45,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2009-2018 The University of Edinburgh
+ *  (c) 2009-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -60,21 +74,22 @@
 #include "map_s.h"
 #include "timer.h"
 
-__host__ int beris_edw_update_driver(beris_edw_t * be, field_t * fq,
+__host__ int beris_edw_update_driver(beris_edw_t * be, fe_t * fe,
+				     field_t * fq,
 				     field_grad_t * fq_grad,
 				     hydro_t * hydro,
-				     map_t * map, noise_t * noise); 
+				     map_t * map, noise_t * noise);
 __host__ int beris_edw_fix_swd(beris_edw_t * be, colloids_info_t * cinfo,
 			       hydro_t * hydro, map_t * map);
 __host__ int beris_edw_update_host(beris_edw_t * be, fe_t * fe, field_t * fq,
 				   hydro_t * hydro, advflux_t * flux,
 				   map_t * map, noise_t * noise);
-__host__ int beris_edw_h_driver(beris_edw_t * be, fe_t * fe);
+__host__ int beris_edw_fused_driver(beris_edw_t * be, fe_lc_t * fe,
+				    field_t * fq, map_t * map,
+				    noise_t * noise);
 
 __global__
-void beris_edw_h_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be, fe_t * fe);
-__global__
-void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
+void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be, fe_t * fe,
 			field_t * fq, field_grad_t * fqgrad,
 			hydro_t * hydro, advflux_t * flux,
 			map_t * map, noise_t * noise);
@@ -82,6 +97,13 @@ __global__
 void beris_edw_fix_swd_kernel(kernel_ctxt_t * ktx, colloids_info_t * cinfo,
 			      hydro_t * hydro, map_t * map, int noffsetx,
 			      int noffsety, int noffsetz);
+__global__
+void beris_edw_fused_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
+			      fe_lc_t * fe, field_t * fq, int ys,
+			      map_t * map, noise_t * noise);
+__global__
+void beris_edw_fused_copy_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
+				   field_t * fq);
 
 struct beris_edw_s {
   beris_edw_param_t * param;       /* Parameters */ 
@@ -89,7 +111,8 @@ struct beris_edw_s {
   lees_edw_t * le;                 /* Lees Edwards */
   advflux_t * flux;                /* Advective fluxes */
   int nall;                        /* Allocated sites */
-  double * h;                      /* Molecular Field */
+  int fused;                       /* Fused relaxational update */
+  double * qnew;                   /* Updated q (fused update only) */
 
   beris_edw_t * target;            /* Target memory */
 };
@@ -128,8 +151,6 @@ __host__ int beris_edw_create(pe_t * pe, cs_t * cs, lees_edw_t * le,
   assert(flx);
 
   lees_edw_nsites(le, &obj->nall);
-  obj->h = (double *) calloc(obj->nall*NQAB, sizeof(double));
-  assert(obj->h);
 
   obj->cs = cs;
   obj->le = le;
@@ -145,7 +166,6 @@ __host__ int beris_edw_create(pe_t * pe, cs_t * cs, lees_edw_t * le,
     obj->target = obj;
   }
   else {
-    double * htmp = NULL;
     beris_edw_param_t * tmp;
     lees_edw_t * letarget = NULL;
 
@@ -163,9 +183,6 @@ __host__ int beris_edw_create(pe_t * pe, cs_t * cs, lees_edw_t * le,
 
     tdpAssert(tdpMemcpy(&obj->target->nall, &obj->nall, sizeof(int),
 			tdpMemcpyHostToDevice));
-    tdpAssert(tdpMalloc((void **) &htmp, obj->nall*NQAB*sizeof(double)));
-    tdpAssert(tdpMemcpy(&obj->target->h, &htmp, sizeof(double *),
-			tdpMemcpyHostToDevice));
   }
 
   *pobj = obj;
@@ -188,16 +205,16 @@ __host__ int beris_edw_free(beris_edw_t * be) {
   tdpGetDeviceCount(&ndevice);
 
   if (ndevice > 0) {
-    double * htmp;
+    double * qtmp = NULL;
 
-    tdpAssert(tdpMemcpy(&htmp, &be->target->h, sizeof(double *),
+    tdpAssert(tdpMemcpy(&qtmp, &be->target->qnew, sizeof(double *),
 			tdpMemcpyDeviceToHost));
-    tdpAssert(tdpFree(htmp));
+    if (qtmp) tdpAssert(tdpFree(qtmp));
     tdpAssert(tdpFree(be->target));
   }
 
   advflux_free(be->flux);
-  free(be->h);
+  free(be->qnew);
   free(be->param);
   free(be);
 
@@ -243,6 +260,59 @@ __host__ int beris_edw_param_set(beris_edw_t * be, beris_edw_param_t vals) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  beris_edw_fused_set
+ *
+ *  Select (or deselect) the fused relaxational update. The caller is
+ *  responsible for the conditions: no hydrodynamics, free energy
+ *  FE_LC, and the 3d_7pt_fluid gradient without Lees Edwards planes.
+ *  The gradients of q are then not computed by the update.
+ *
+ *****************************************************************************/
+
+__host__ int beris_edw_fused_set(beris_edw_t * be, int fused) {
+
+  int ndevice;
+
+  assert(be);
+
+  be->fused = fused;
+
+  if (fused && be->qnew == NULL) {
+
+    be->qnew = (double *) calloc(be->nall*NQAB, sizeof(double));
+    assert(be->qnew);
+
+    tdpGetDeviceCount(&ndevice);
+
+    if (ndevice > 0) {
+      double * qtmp = NULL;
+      tdpAssert(tdpMalloc((void **) &qtmp, be->nall*NQAB*sizeof(double)));
+      tdpAssert(tdpMemcpy(&be->target->qnew, &qtmp, sizeof(double *),
+			  tdpMemcpyHostToDevice));
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  beris_edw_fused
+ *
+ *****************************************************************************/
+
+__host__ int beris_edw_fused(beris_edw_t * be, int * fused) {
+
+  assert(be);
+  assert(fused);
+
+  *fused = be->fused;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  beris_edw_update
@@ -274,6 +344,13 @@ __host__ int beris_edw_update(beris_edw_t * be,
   field_nf(fq, &nf);
   assert(nf == NQAB);
 
+  if (be->fused) {
+    assert(hydro == NULL);
+    assert(fe->id == FE_LC);
+    beris_edw_fused_driver(be, (fe_lc_t *) fe, fq, map, noise);
+    return 0;
+  }
+
   if (hydro) {
     beris_edw_fix_swd(be, cinfo, hydro, map);
     hydro_lees_edwards(hydro);
@@ -281,8 +358,7 @@ __host__ int beris_edw_update(beris_edw_t * be,
     advection_bcs_no_normal_flux(nf, be->flux, map);
   }
 
-  beris_edw_h_driver(be, fe);
-  beris_edw_update_driver(be, fq, fq_grad, hydro, map, noise);
+  beris_edw_update_driver(be, fe, fq, fq_grad, hydro, map, noise);
 
   return 0;
 }
@@ -404,7 +480,7 @@ __host__ int beris_edw_update_host(beris_edw_t * be, fe_t * fe, field_t * fq,
 	/* Fluctuating tensor order parameter */
 
 	if (noise_on) {
-	  noise_reap_n(noise, index, NQAB, chi);
+	  noise_reap_stream_n(noise, NOISE_QAB, index, 0, NQAB, chi);
 	  for (id = 0; id < NQAB; id++) {
 	    chi[id] = var*chi[id];
 	  }
@@ -487,6 +563,7 @@ __host__ int beris_edw_update_host(beris_edw_t * be, fe_t * fe, field_t * fq,
  *****************************************************************************/
 
 __host__ int beris_edw_update_driver(beris_edw_t * be,
+				     fe_t * fe,
 				     field_t * fq,
 				     field_grad_t * fq_grad,
 				     hydro_t * hydro,
@@ -498,10 +575,12 @@ __host__ int beris_edw_update_driver(beris_edw_t * be,
   kernel_info_t limits;
   kernel_ctxt_t * ctxt = NULL;
 
+  fe_t * fe_target = NULL;
   hydro_t * hydrotarget = NULL;
   noise_t * noisetarget = NULL;
 
   assert(be);
+  assert(fe);
   assert(fq);
   assert(map);
 
@@ -511,20 +590,21 @@ __host__ int beris_edw_update_driver(beris_edw_t * be,
   limits.jmin = 1; limits.jmax = nlocal[Y];
   limits.kmin = 1; limits.kmax = nlocal[Z];
 
-  kernel_ctxt_create(be->cs, NSIMDVL, limits, &ctxt);
+  kernel_ctxt_create_tiled(be->cs, NSIMDVL, limits, &ctxt);
   kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
 
   beris_edw_param_commit(be);
+  fe->func->target(fe, &fe_target);
   if (hydro) hydrotarget = hydro->target;
 
   ison = 0;
   if (noise) noise_present(noise, NOISE_QAB, &ison);
-  if (ison) noisetarget = noise;
+  if (ison) noisetarget = noise->target;
 
   TIMER_start(BP_BE_UPDATE_KERNEL);
 
   tdpLaunchKernel(beris_edw_kernel_v, nblk, ntpb, 0, 0,
-		  ctxt->target, be->target, fq->target, fq_grad->target,
+		  ctxt->target, be->target, fe_target, fq->target, fq_grad->target,
 		  hydrotarget, be->flux->target, map->target, noisetarget);
 
   tdpAssert(tdpPeekAtLastError());
@@ -532,6 +612,8 @@ __host__ int beris_edw_update_driver(beris_edw_t * be,
 
   TIMER_stop(BP_BE_UPDATE_KERNEL);
 
+  if (ison) noise_advance(noise, NOISE_QAB);
+
   kernel_ctxt_free(ctxt);
 
   return 0;
@@ -539,12 +621,15 @@ __host__ int beris_edw_update_driver(beris_edw_t * be,
 
 /*****************************************************************************
  *
- *  beris_edw_kernel
+ *  beris_edw_kernel_v
+ *
+ *  The molecular field is computed for each SIMD block before the
+ *  update (it depends only on q and gradients at the same site).
  *
  *****************************************************************************/
 
 __global__
-void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
+void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be, fe_t * fe,
 			field_t * fq, field_grad_t * fqgrad,
 			hydro_t * hydro, advflux_t * flux,
 			map_t * map, noise_t * noise) {
@@ -558,6 +643,8 @@ void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
 
   assert(ktx);
   assert(be);
+  assert(fe);
+  assert(fe->func->htensor_v);
   assert(fq);
   assert(fqgrad);
   assert(flux);
@@ -577,13 +664,14 @@ void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
     int status;
 
     double q[3][3][NSIMDVL];
+    double h[3][3][NSIMDVL];
     double w[3][3][NSIMDVL];
     double d[3][3][NSIMDVL];
     double s[3][3][NSIMDVL];
 
     double omega[3][3][NSIMDVL];
     double trace_qw[NSIMDVL];
-    double chi[NQAB], chi_qab[3][3][NSIMDVL];
+    double chi[NQAB*NSIMDVL], chi_qab[3][3][NSIMDVL];
     double tr[NSIMDVL];
 
     index = kernel_baseindex(ktx, kindex);
@@ -605,6 +693,10 @@ void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
       if (maskv[iv] && status != MAP_FLUID) maskv[iv] = 0;
     }
 
+    /* Molecular field (before q is updated) */
+
+    fe->func->htensor_v(fe, index, h);
+
     /* Expand q tensor */
 
     for_simd_v(iv, NSIMDVL) q[X][X][iv] = fq->data[addr_rank1(fq->nsites,NQAB,index+iv,XX)];
@@ -738,19 +830,21 @@ void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
 
     if (noise) {
 
-      for_simd_v(iv, NSIMDVL) {
-	
-	noise_reap_n(noise, index+iv, NQAB, chi);
-	
-	for (id = 0; id < NQAB; id++) {
-	  chi[id] = be->param->var*chi[id];
+      noise_reap_stream_nv(noise, NOISE_QAB, index, 0, NQAB, chi);
+
+      for (id = 0; id < NQAB; id++) {
+	for_simd_v(iv, NSIMDVL) {
+	  chi[id*NSIMDVL + iv] *= be->param->var;
 	}
-	
-	for (ia = 0; ia < 3; ia++) {
-	  for (ib = 0; ib < 3; ib++) {
-	    chi_qab[ia][ib][iv] = 0.0;
-	    for (id = 0; id < NQAB; id++) {
-	      chi_qab[ia][ib][iv] += chi[id]*be->param->tmatrix[ia][ib][id];
+      }
+
+      for (ia = 0; ia < 3; ia++) {
+	for (ib = 0; ib < 3; ib++) {
+	  for_simd_v(iv, NSIMDVL) chi_qab[ia][ib][iv] = 0.0;
+	  for (id = 0; id < NQAB; id++) {
+	    for_simd_v(iv, NSIMDVL) {
+	      chi_qab[ia][ib][iv]
+		+= chi[id*NSIMDVL + iv]*be->param->tmatrix[ia][ib][id];
 	    }
 	  }
 	}
@@ -773,7 +867,7 @@ void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
       q[X][X][iv] += dt*
 	(s[X][X][iv]
 	 + chi_qab[X][X][iv]
-	 + be->param->gamma*be->h[addr_rank1(be->nall, NQAB, index+iv, XX)]
+	 + be->param->gamma*h[X][X][iv]
 	 - flux->fe[addr_rank1(flux->nsite,NQAB,index + iv,XX)]
 	 + flux->fw[addr_rank1(flux->nsite,NQAB,index + iv,XX)]
 	 - flux->fy[addr_rank1(flux->nsite,NQAB,index + iv,XX)]
@@ -788,7 +882,7 @@ void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
       q[X][Y][iv] += dt*
 	(s[X][Y][iv]
 	 + chi_qab[X][Y][iv]
-	 + be->param->gamma*be->h[addr_rank1(be->nall, NQAB, index+iv, XY)]
+	 + be->param->gamma*h[X][Y][iv]
 	 - flux->fe[addr_rank1(flux->nsite,NQAB,index + iv,XY)]
 	 + flux->fw[addr_rank1(flux->nsite,NQAB,index + iv,XY)]
 	 - flux->fy[addr_rank1(flux->nsite,NQAB,index + iv,XY)]
@@ -803,7 +897,7 @@ void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
       q[X][Z][iv] += dt*
 	(s[X][Z][iv]
 	 + chi_qab[X][Z][iv]
-	 + be->param->gamma*be->h[addr_rank1(be->nall, NQAB, index+iv, XZ)]
+	 + be->param->gamma*h[X][Z][iv]
 	 - flux->fe[addr_rank1(flux->nsite,NQAB,index + iv,XZ)]
 	 + flux->fw[addr_rank1(flux->nsite,NQAB,index + iv,XZ)]
 	 - flux->fy[addr_rank1(flux->nsite,NQAB,index + iv,XZ)]
@@ -818,7 +912,7 @@ void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
       q[Y][Y][iv] += dt*
 	(s[Y][Y][iv]
 	 + chi_qab[Y][Y][iv]
-	 + be->param->gamma*be->h[addr_rank1(be->nall, NQAB, index+iv, YY)]
+	 + be->param->gamma*h[Y][Y][iv]
 	 - flux->fe[addr_rank1(flux->nsite,NQAB,index + iv,YY)]
 	 + flux->fw[addr_rank1(flux->nsite,NQAB,index + iv,YY)]
 	 - flux->fy[addr_rank1(flux->nsite,NQAB,index + iv,YY)]
@@ -833,7 +927,7 @@ void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
       q[Y][Z][iv] += dt*
 	(s[Y][Z][iv]
 	 + chi_qab[Y][Z][iv]
-	 + be->param->gamma*be->h[addr_rank1(be->nall, NQAB, index+iv, YZ)]
+	 + be->param->gamma*h[Y][Z][iv]
 	 - flux->fe[addr_rank1(flux->nsite,NQAB,index + iv,YZ)]
 	 + flux->fw[addr_rank1(flux->nsite,NQAB,index + iv,YZ)]
 	 - flux->fy[addr_rank1(flux->nsite,NQAB,index + iv,YZ)]
@@ -857,93 +951,67 @@ void beris_edw_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
 
 /*****************************************************************************
  *
- *  beris_edw_tmatrix
- *
- *  Sets the elements of the traceless, symmetric base matrices
- *  following Bhattacharjee et al. There are five:
- *
- *  T^0_ab = sqrt(3/2) [ z_a z_b ]
- *  T^1_ab = sqrt(1/2) ( x_a x_b - y_a y_b ) a simple dyadic product
- *  T^2_ab = sqrt(2)   [ x_a y_b ]
- *  T^3_ab = sqrt(2)   [ x_a z_b ]
- *  T^4_ab = sqrt(2)   [ y_a z_b ]
- *
- *  Where x, y, z, are unit vectors, and the square brackets should
- *  be interpreted as
- *     [t_ab] = (1/2) (t_ab + t_ba) - (1/3) Tr (t_ab) d_ab.
- *
- *  Note the contraction T^i_ab T^j_ab = d_ij.
- *
- *****************************************************************************/
-
-__host__ __device__ int beris_edw_tmatrix(double t[3][3][NQAB]) {
-
-  int ia, ib, id;
-  const double r3 = (1.0/3.0);
-
-  for (ia = 0; ia < 3; ia++) {
-    for (ib = 0; ib < 3; ib++) {
-      for (id = 0; id < NQAB; id++) {
-      	t[ia][ib][id] = 0.0;
-      }
-    }
-  }
-
-  t[X][X][XX] = sqrt(3.0/2.0)*(0.0 - r3);
-  t[Y][Y][XX] = sqrt(3.0/2.0)*(0.0 - r3);
-  t[Z][Z][XX] = sqrt(3.0/2.0)*(1.0 - r3);
-
-  t[X][X][XY] = sqrt(1.0/2.0)*(1.0 - 0.0);
-  t[Y][Y][XY] = sqrt(1.0/2.0)*(0.0 - 1.0);
-
-  t[X][Y][XZ] = sqrt(2.0)*(1.0/2.0);
-  t[Y][X][XZ] = t[X][Y][XZ];
-
-  t[X][Z][YY] = sqrt(2.0)*(1.0/2.0); 
-  t[Z][X][YY] = t[X][Z][YY];
-
-  t[Y][Z][YZ] = sqrt(2.0)*(1.0/2.0);
-  t[Z][Y][YZ] = t[Y][Z][YZ];
-
-  return 0;
-}
-
-/*****************************************************************************
+ *  beris_edw_fused_driver
  *
- *  beris_edw_h_driver
+ *  Relaxational update with gradients computed in the update kernel.
+ *  The new q is written to be->qnew and then copied back to fq.
  *
  *****************************************************************************/
 
-__host__ int beris_edw_h_driver(beris_edw_t * be, fe_t * fe) {
-
+__host__ int beris_edw_fused_driver(beris_edw_t * be, fe_lc_t * fe,
+				    field_t * fq, map_t * map,
+				    noise_t * noise) {
+  int ison;
   int nlocal[3];
+  int xs, ys, zs;
   dim3 nblk, ntpb;
   kernel_info_t limits;
   kernel_ctxt_t * ctxt = NULL;
+
   fe_t * fe_target = NULL;
+  noise_t * noisetarget = NULL;
 
   assert(be);
   assert(fe);
+  assert(fq);
+  assert(map);
+  assert(be->qnew);
 
   cs_nlocal(be->cs, nlocal);
+  lees_edw_strides(be->le, &xs, &ys, &zs);
 
   limits.imin = 1; limits.imax = nlocal[X];
   limits.jmin = 1; limits.jmax = nlocal[Y];
   limits.kmin = 1; limits.kmax = nlocal[Z];
 
-  TIMER_start(TIMER_BE_MOL_FIELD);
-
-  kernel_ctxt_create(be->cs, NSIMDVL, limits, &ctxt);
+  kernel_ctxt_create_tiled(be->cs, NSIMDVL, limits, &ctxt);
   kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
 
-  fe->func->target(fe, &fe_target);
+  beris_edw_param_commit(be);
+  fe_lc_target(fe, &fe_target);
+
+  ison = 0;
+  if (noise) noise_present(noise, NOISE_QAB, &ison);
+  if (ison) noisetarget = noise->target;
+
+  TIMER_start(BP_BE_UPDATE_KERNEL);
+
+  tdpLaunchKernel(beris_edw_fused_kernel_v, nblk, ntpb, 0, 0,
+		  ctxt->target, be->target, (fe_lc_t *) fe_target, fq->target,
+		  ys, map->target, noisetarget);
 
-  tdpLaunchKernel(beris_edw_h_kernel_v, nblk, ntpb, 0, 0,
-		  ctxt->target, be->target, fe_target);
   tdpAssert(tdpPeekAtLastError());
   tdpAssert(tdpDeviceSynchronize());
 
-  TIMER_stop(TIMER_BE_MOL_FIELD);
+  tdpLaunchKernel(beris_edw_fused_copy_kernel_v, nblk, ntpb, 0, 0,
+		  ctxt->target, be->target, fq->target);
+
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  TIMER_stop(BP_BE_UPDATE_KERNEL);
+
+  if (ison) noise_advance(noise, NOISE_QAB);
 
   kernel_ctxt_free(ctxt);
 
@@ -952,56 +1020,291 @@ __host__ int beris_edw_h_driver(beris_edw_t * be, fe_t * fe) {
 
 /*****************************************************************************
  *
- *  beris_edw_h_kernel_v
+ *  beris_edw_fused_kernel_v
  *
- *  Compute and store the relevant molecular field
+ *  The gradient and Laplacian of q are those of the 3d_7pt_fluid
+ *  scheme, computed from the neighbouring q (which includes the
+ *  halo for sites at the edge of a tile or of the local domain).
+ *  Non-fluid sites retain the old q.
  *
  *****************************************************************************/
 
-__global__ void beris_edw_h_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
-				     fe_t * fe) {
+__global__
+void beris_edw_fused_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
+			      fe_lc_t * fe, field_t * fq, int ys,
+			      map_t * map, noise_t * noise) {
 
   int kindex;
-  __shared__ int kiter;
+  __shared__ int kiterations;
+
+  const double dt = 1.0;
 
   assert(ktx);
   assert(be);
   assert(fe);
-  assert(fe->func->htensor_v);
+  assert(fq);
+  assert(map);
 
-  kiter = kernel_vector_iterations(ktx);
+  kiterations = kernel_vector_iterations(ktx);
 
-  for_simt_parallel(kindex, kiter, NSIMDVL) {
+  for_simt_parallel(kindex, kiterations, NSIMDVL) {
 
-    int index;
     int iv;
+    int ia, ib, id, n;
+    int index;
+    int ic[NSIMDVL], jc[NSIMDVL], kc[NSIMDVL];
+    int im1[NSIMDVL], ip1[NSIMDVL];
+    int indexm1[NSIMDVL], indexp1[NSIMDVL];
+    int maskv[NSIMDVL];
+    int status;
 
+    double qs[NQAB][NSIMDVL];
+    double dqs[NQAB][NVECTOR][NSIMDVL];
+    double dsqs[NQAB][NSIMDVL];
+
+    double q[3][3][NSIMDVL];
+    double dq[3][3][3][NSIMDVL];
+    double dsq[3][3][NSIMDVL];
     double h[3][3][NSIMDVL];
+    double chi[NQAB*NSIMDVL], chi_qab[3][3][NSIMDVL];
 
-    index  = kernel_baseindex(ktx, kindex);
+    double * __restrict__ data = fq->data;
 
-    fe->func->htensor_v(fe, index, h);
+    index = kernel_baseindex(ktx, kindex);
+    kernel_coords_v(ktx, kindex, ic, jc, kc);
+    kernel_mask_v(ktx, ic, jc, kc, maskv);
 
-    for_simd_v(iv, NSIMDVL) {
-      be->h[addr_rank1(be->nall, NQAB, index + iv, XX)] = h[X][X][iv];
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      if (maskv[iv]) map_status(map, index+iv, &status);
+      if (maskv[iv] && status != MAP_FLUID) maskv[iv] = 0;
     }
-    for_simd_v(iv, NSIMDVL) {
-      be->h[addr_rank1(be->nall, NQAB, index + iv, XY)] = h[X][Y][iv];
+
+    for_simd_v(iv, NSIMDVL) im1[iv] = lees_edw_ic_to_buff(be->le, ic[iv], -1);
+    for_simd_v(iv, NSIMDVL) ip1[iv] = lees_edw_ic_to_buff(be->le, ic[iv], +1);
+
+    kernel_coords_index_v(ktx, im1, jc, kc, indexm1);
+    kernel_coords_index_v(ktx, ip1, jc, kc, indexp1);
+
+    /* Gradients (as grad_3d_7pt_fluid_kernel_v) */
+
+    for (n = 0; n < NQAB; n++) {
+      for_simd_v(iv, NSIMDVL) {
+	qs[n][iv] = data[addr_rank1(fq->nsites,NQAB,index+iv,n)];
+      }
+      for_simd_v(iv, NSIMDVL) {
+	dqs[n][X][iv] = 0.5*
+	  (data[addr_rank1(fq->nsites,NQAB,indexp1[iv],n)] -
+	   data[addr_rank1(fq->nsites,NQAB,indexm1[iv],n)]);
+      }
+      for_simd_v(iv, NSIMDVL) {
+	dqs[n][Y][iv] = 0.5*
+	  (data[addr_rank1(fq->nsites,NQAB,index+iv+ys,n)] -
+	   data[addr_rank1(fq->nsites,NQAB,index+iv-ys,n)]);
+      }
+      for_simd_v(iv, NSIMDVL) {
+	dqs[n][Z][iv] = 0.5*
+	  (data[addr_rank1(fq->nsites,NQAB,index+iv+1,n)] -
+	   data[addr_rank1(fq->nsites,NQAB,index+iv-1,n)]);
+      }
+      for_simd_v(iv, NSIMDVL) {
+	dsqs[n][iv]
+	  = data[addr_rank1(fq->nsites,NQAB,indexp1[iv],n)]
+	  + data[addr_rank1(fq->nsites,NQAB,indexm1[iv],n)]
+	  + data[addr_rank1(fq->nsites,NQAB,index+iv+ys,n)]
+	  + data[addr_rank1(fq->nsites,NQAB,index+iv-ys,n)]
+	  + data[addr_rank1(fq->nsites,NQAB,index+iv+1,n)]
+	  + data[addr_rank1(fq->nsites,NQAB,index+iv-1,n)]
+	  - 6.0*qs[n][iv];
+      }
     }
-    for_simd_v(iv, NSIMDVL) {
-      be->h[addr_rank1(be->nall, NQAB, index + iv, XZ)] = h[X][Z][iv];
+
+    /* Expand tensors */
+
+    for_simd_v(iv, NSIMDVL) q[X][X][iv] = qs[XX][iv];
+    for_simd_v(iv, NSIMDVL) q[X][Y][iv] = qs[XY][iv];
+    for_simd_v(iv, NSIMDVL) q[X][Z][iv] = qs[XZ][iv];
+    for_simd_v(iv, NSIMDVL) q[Y][X][iv] = q[X][Y][iv];
+    for_simd_v(iv, NSIMDVL) q[Y][Y][iv] = qs[YY][iv];
+    for_simd_v(iv, NSIMDVL) q[Y][Z][iv] = qs[YZ][iv];
+    for_simd_v(iv, NSIMDVL) q[Z][X][iv] = q[X][Z][iv];
+    for_simd_v(iv, NSIMDVL) q[Z][Y][iv] = q[Y][Z][iv];
+    for_simd_v(iv, NSIMDVL) q[Z][Z][iv] = 0.0 - q[X][X][iv] - q[Y][Y][iv];
+
+    for (ia = 0; ia < NVECTOR; ia++) {
+      for_simd_v(iv, NSIMDVL) dq[ia][X][X][iv] = dqs[XX][ia][iv];
+      for_simd_v(iv, NSIMDVL) dq[ia][X][Y][iv] = dqs[XY][ia][iv];
+      for_simd_v(iv, NSIMDVL) dq[ia][X][Z][iv] = dqs[XZ][ia][iv];
+      for_simd_v(iv, NSIMDVL) dq[ia][Y][X][iv] = dq[ia][X][Y][iv];
+      for_simd_v(iv, NSIMDVL) dq[ia][Y][Y][iv] = dqs[YY][ia][iv];
+      for_simd_v(iv, NSIMDVL) dq[ia][Y][Z][iv] = dqs[YZ][ia][iv];
+      for_simd_v(iv, NSIMDVL) dq[ia][Z][X][iv] = dq[ia][X][Z][iv];
+      for_simd_v(iv, NSIMDVL) dq[ia][Z][Y][iv] = dq[ia][Y][Z][iv];
+      for_simd_v(iv, NSIMDVL) dq[ia][Z][Z][iv] = 0.0 - dq[ia][X][X][iv] - dq[ia][Y][Y][iv];
     }
-    for_simd_v(iv, NSIMDVL) {
-      be->h[addr_rank1(be->nall, NQAB, index + iv, YY)] = h[Y][Y][iv];
+
+    for_simd_v(iv, NSIMDVL) dsq[X][X][iv] = dsqs[XX][iv];
+    for_simd_v(iv, NSIMDVL) dsq[X][Y][iv] = dsqs[XY][iv];
+    for_simd_v(iv, NSIMDVL) dsq[X][Z][iv] = dsqs[XZ][iv];
+    for_simd_v(iv, NSIMDVL) dsq[Y][X][iv] = dsq[X][Y][iv];
+    for_simd_v(iv, NSIMDVL) dsq[Y][Y][iv] = dsqs[YY][iv];
+    for_simd_v(iv, NSIMDVL) dsq[Y][Z][iv] = dsqs[YZ][iv];
+    for_simd_v(iv, NSIMDVL) dsq[Z][X][iv] = dsq[X][Z][iv];
+    for_simd_v(iv, NSIMDVL) dsq[Z][Y][iv] = dsq[Y][Z][iv];
+    for_simd_v(iv, NSIMDVL) dsq[Z][Z][iv] = 0.0 - dsq[X][X][iv] - dsq[Y][Y][iv];
+
+    fe_lc_compute_h_v(fe, q, dq, dsq, h);
+
+    /* Fluctuating tensor order parameter */
+
+    for (ia = 0; ia < 3; ia++) {
+      for (ib = 0; ib < 3; ib++) {
+	for_simd_v(iv, NSIMDVL) chi_qab[ia][ib][iv] = 0.0;
+      }
+    }
+
+    if (noise) {
+
+      noise_reap_stream_nv(noise, NOISE_QAB, index, 0, NQAB, chi);
+
+      for (id = 0; id < NQAB; id++) {
+	for_simd_v(iv, NSIMDVL) {
+	  chi[id*NSIMDVL + iv] *= be->param->var;
+	}
+      }
+
+      for (ia = 0; ia < 3; ia++) {
+	for (ib = 0; ib < 3; ib++) {
+	  for (id = 0; id < NQAB; id++) {
+	    for_simd_v(iv, NSIMDVL) {
+	      chi_qab[ia][ib][iv]
+		+= chi[id*NSIMDVL + iv]*be->param->tmatrix[ia][ib][id];
+	    }
+	  }
+	}
+      }
     }
+
     for_simd_v(iv, NSIMDVL) {
-      be->h[addr_rank1(be->nall, NQAB, index + iv, YZ)] = h[Y][Z][iv];
+      if (maskv[iv]) {
+	q[X][X][iv] += dt*(chi_qab[X][X][iv] + be->param->gamma*h[X][X][iv]);
+	q[X][Y][iv] += dt*(chi_qab[X][Y][iv] + be->param->gamma*h[X][Y][iv]);
+	q[X][Z][iv] += dt*(chi_qab[X][Z][iv] + be->param->gamma*h[X][Z][iv]);
+	q[Y][Y][iv] += dt*(chi_qab[Y][Y][iv] + be->param->gamma*h[Y][Y][iv]);
+	q[Y][Z][iv] += dt*(chi_qab[Y][Z][iv] + be->param->gamma*h[Y][Z][iv]);
+      }
     }
+
+    for_simd_v(iv, NSIMDVL) be->qnew[addr_rank1(be->nall,NQAB,index+iv,XX)] = q[X][X][iv];
+    for_simd_v(iv, NSIMDVL) be->qnew[addr_rank1(be->nall,NQAB,index+iv,XY)] = q[X][Y][iv];
+    for_simd_v(iv, NSIMDVL) be->qnew[addr_rank1(be->nall,NQAB,index+iv,XZ)] = q[X][Z][iv];
+    for_simd_v(iv, NSIMDVL) be->qnew[addr_rank1(be->nall,NQAB,index+iv,YY)] = q[Y][Y][iv];
+    for_simd_v(iv, NSIMDVL) be->qnew[addr_rank1(be->nall,NQAB,index+iv,YZ)] = q[Y][Z][iv];
+
+    /* Next sites. */
   }
 
   return;
 }
 
+/*****************************************************************************
+ *
+ *  beris_edw_fused_copy_kernel_v
+ *
+ *  Copy the updated q back to the field.
+ *
+ *****************************************************************************/
+
+__global__
+void beris_edw_fused_copy_kernel_v(kernel_ctxt_t * ktx, beris_edw_t * be,
+				   field_t * fq) {
+
+  int kindex;
+  __shared__ int kiterations;
+
+  assert(ktx);
+  assert(be);
+  assert(fq);
+
+  kiterations = kernel_vector_iterations(ktx);
+
+  for_simt_parallel(kindex, kiterations, NSIMDVL) {
+
+    int iv;
+    int n;
+    int index;
+    int ic[NSIMDVL], jc[NSIMDVL], kc[NSIMDVL];
+    int maskv[NSIMDVL];
+
+    index = kernel_baseindex(ktx, kindex);
+    kernel_coords_v(ktx, kindex, ic, jc, kc);
+    kernel_mask_v(ktx, ic, jc, kc, maskv);
+
+    for (n = 0; n < NQAB; n++) {
+      for_simd_v(iv, NSIMDVL) {
+	if (maskv[iv]) {
+	  fq->data[addr_rank1(fq->nsites,NQAB,index+iv,n)]
+	    = be->qnew[addr_rank1(be->nall,NQAB,index+iv,n)];
+	}
+      }
+    }
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  beris_edw_tmatrix
+ *
+ *  Sets the elements of the traceless, symmetric base matrices
+ *  following Bhattacharjee et al. There are five:
+ *
+ *  T^0_ab = sqrt(3/2) [ z_a z_b ]
+ *  T^1_ab = sqrt(1/2) ( x_a x_b - y_a y_b ) a simple dyadic product
+ *  T^2_ab = sqrt(2)   [ x_a y_b ]
+ *  T^3_ab = sqrt(2)   [ x_a z_b ]
+ *  T^4_ab = sqrt(2)   [ y_a z_b ]
+ *
+ *  Where x, y, z, are unit vectors, and the square brackets should
+ *  be interpreted as
+ *     [t_ab] = (1/2) (t_ab + t_ba) - (1/3) Tr (t_ab) d_ab.
+ *
+ *  Note the contraction T^i_ab T^j_ab = d_ij.
+ *
+ *****************************************************************************/
+
+__host__ __device__ int beris_edw_tmatrix(double t[3][3][NQAB]) {
+
+  int ia, ib, id;
+  const double r3 = (1.0/3.0);
+
+  for (ia = 0; ia < 3; ia++) {
+    for (ib = 0; ib < 3; ib++) {
+      for (id = 0; id < NQAB; id++) {
+      	t[ia][ib][id] = 0.0;
+      }
+    }
+  }
+
+  t[X][X][XX] = sqrt(3.0/2.0)*(0.0 - r3);
+  t[Y][Y][XX] = sqrt(3.0/2.0)*(0.0 - r3);
+  t[Z][Z][XX] = sqrt(3.0/2.0)*(1.0 - r3);
+
+  t[X][X][XY] = sqrt(1.0/2.0)*(1.0 - 0.0);
+  t[Y][Y][XY] = sqrt(1.0/2.0)*(0.0 - 1.0);
+
+  t[X][Y][XZ] = sqrt(2.0)*(1.0/2.0);
+  t[Y][X][XZ] = t[X][Y][XZ];
+
+  t[X][Z][YY] = sqrt(2.0)*(1.0/2.0); 
+  t[Z][X][YY] = t[X][Z][YY];
+
+  t[Y][Z][YZ] = sqrt(2.0)*(1.0/2.0);
+  t[Z][Y][YZ] = t[Y][Z][YZ];
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  beris_fix_swd
@@ -9,7 +9,7 @@
  *
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
  *
- *  (c) 2009-2017 The University of Edinburgh
+ *  (c) 2009-2019 The University of Edinburgh
  *
  *****************************************************************************/
 
@@ -42,6 +42,8 @@ __host__ int beris_edw_free(beris_edw_t * be);
 __host__ int beris_edw_memcpy(beris_edw_t * be, int flag);
 __host__ int beris_edw_param_set(beris_edw_t * be, beris_edw_param_t values);
 __host__ int beris_edw_param_commit(beris_edw_t * be);
+__host__ int beris_edw_fused_set(beris_edw_t * be, int fused);
+__host__ int beris_edw_fused(beris_edw_t * be, int * fused);
 
 __host__ int beris_edw_update(beris_edw_t * be, fe_t * fe, field_t * fq,
 			      field_grad_t * fq_grad, hydro_t * hydro,
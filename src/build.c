@@ -9,7 +9,7 @@
  *  Edinburgh Soft Matter and Statisitical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2017 The University of Edinburgh
+ *  (c) 2017-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -23,8 +23,12 @@
 
 #include "pe.h"
 #include "coords.h"
+#include "kernel.h"
+#include "memory.h"
 #include "physics.h"
 #include "lb_model_s.h"
+#include "map_s.h"
+#include "colloids_s.h"
 #include "colloid_sums.h"
 #include "psi_colloid.h"
 #include "util.h"
@@ -40,9 +44,7 @@ int build_replace_q_local(fe_t * fe, colloids_info_t * info, colloid_t * pc, int
 			  field_t * q);
 
 static int build_remove_fluid(lb_t * lb, int index, colloid_t * pc);
-static int build_replace_fluid(lb_t * lb, colloids_info_t * info, int index,
-			       colloid_t * pc, map_t * map);
-static int build_remove_order_parameter(lb_t * lb, field_t * f, int index,
+static int build_remove_order_parameter(field_t * f, int index,
 					colloid_t * pc);
 static int build_replace_order_parameter(fe_t * fe, lb_t * lb, colloids_info_t * cinfo,
 					 field_t * f, int index,
@@ -54,6 +56,19 @@ static void build_link_mean(colloid_t * pc, int p, const double rb[3]);
 static int build_colloid_wall_links(cs_t * cs, colloids_info_t * cinfo,
 				    colloid_t * pc,
 				    map_t * map);
+static int build_link_table(colloids_info_t * cinfo);
+static int build_site_table(cs_t * cs, colloids_info_t * cinfo, map_t * map);
+static int build_site_compare(const void * a, const void * b);
+static int build_fluid_target(colloids_info_t * cinfo, lb_t * lb, int nphi);
+static int build_map_target(colloids_info_t * cinfo, map_t * map);
+
+__global__ void build_fluid_kernel(colloid_site_table_t * table, cs_t * cs,
+				   lb_t * lb, double rho0, double phi0,
+				   int nphi);
+__global__ void build_map_kernel(colloid_site_table_t * table, map_t * map,
+				 colloids_info_t * cinfo);
+
+static __constant__ lb_collide_param_t lbp;
 
 /*****************************************************************************
  *
@@ -63,6 +78,10 @@ static int build_colloid_wall_links(cs_t * cs, colloids_info_t * cinfo,
  *  of all nodes in the presence on colloids. This must be complete
  *  before attempting to build the colloid links.
  *
+ *  Only sites inside the bounding box of each colloid are visited;
+ *  the sites set at the previous update are recorded by the colloid
+ *  map (see colloids_info_map_set()).
+ *
  ****************************************************************************/
 
 int build_update_map(cs_t * cs, colloids_info_t * cinfo, map_t * map) {
@@ -77,6 +96,9 @@ int build_update_map(cs_t * cs, colloids_info_t * cinfo, map_t * map) {
   int index;
   int nhalo;
   int status;
+  int n, nold, nnew;
+  int * sold = NULL;
+  int * snew = NULL;
 
   colloid_t * p_colloid;
 
@@ -104,29 +126,25 @@ int build_update_map(cs_t * cs, colloids_info_t * cinfo, map_t * map) {
 
   colloids_info_ncell(cinfo, ncell);
 
-  /* First, set any existing colloid sites to fluid */
-
-  for (ic = 1 - nhalo; ic <= nlocal[X] + nhalo; ic++) {
-    for (jc = 1 - nhalo; jc <= nlocal[Y] + nhalo; jc++) {
-      for (kc = 1 - nhalo; kc <= nlocal[Z] + nhalo; kc++) {
-
-	/* This avoids setting BOUNDARY to FLUID */
-	index = cs_index(cs, ic, jc, kc);
-	map_status(map, index, &status);
-	if (status == MAP_COLLOID) {
-	  /* Set wetting properties to zero. */
-	  map_status_set(map, index, MAP_FLUID);
-	  wet[0] = 0.0;
-	  wet[1] = 0.0;
-	  map_data_set(map, index, wet);
-	}
+  /* The previous map becomes the old map. Sites set previously are
+   * returned to fluid: there is no need to examine the whole lattice. */
 
-      }
+  colloids_info_map_update(cinfo);
+  colloids_info_map_sites(cinfo, &nold, &sold, &nnew, &snew);
+
+  for (n = 0; n < nold; n++) {
+    /* This avoids setting BOUNDARY to FLUID */
+    index = sold[n];
+    map_status(map, index, &status);
+    if (status == MAP_COLLOID) {
+      /* Set wetting properties to zero. */
+      map_status_set(map, index, MAP_FLUID);
+      wet[0] = 0.0;
+      wet[1] = 0.0;
+      map_data_set(map, index, wet);
     }
   }
 
-  colloids_info_map_update(cinfo);
-
   /* Loop through all cells (including the halo cells) */
 
   for (ic = 0; ic <= ncell[X] + 1; ic++) {
@@ -281,6 +299,98 @@ int build_update_links(cs_t * cs, colloids_info_t * cinfo, wall_t * wall,
     }
   }
 
+  build_link_table(cinfo);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  build_link_table
+ *
+ *  Refill the flat link table from the per-colloid link lists, and
+ *  copy to the target. Colloids appear in the order of the 'all' list
+ *  (cell list order) and links in list order; unused links are omitted.
+ *
+ *****************************************************************************/
+
+static int build_link_table(colloids_info_t * cinfo) {
+
+  int ia;
+  int ic, jc, kc;
+  int ncell[3];
+  int nhalo;
+  int nlink = 0;
+  int ncolloid = 0;
+  colloid_t * pc = NULL;
+  colloid_link_t * p_link = NULL;
+  colloid_link_table_t * table = NULL;
+
+  assert(cinfo);
+
+  colloids_info_link_table(cinfo, &table);
+  assert(table);
+
+  colloids_info_ncell(cinfo, ncell);
+  colloids_info_nhalo(cinfo, &nhalo);
+
+  for (ic = 1 - nhalo; ic <= ncell[X] + nhalo; ic++) {
+    for (jc = 1 - nhalo; jc <= ncell[Y] + nhalo; jc++) {
+      for (kc = 1 - nhalo; kc <= ncell[Z] + nhalo; kc++) {
+	colloids_info_cell_list_head(cinfo, ic, jc, kc, &pc);
+	for ( ; pc; pc = pc->next) {
+	  ncolloid += 1;
+	  for (p_link = pc->lnk; p_link; p_link = p_link->next) {
+	    if (p_link->status == LINK_UNUSED) continue;
+	    nlink += 1;
+	  }
+	}
+      }
+    }
+  }
+
+  colloid_link_table_reserve(table, nlink, ncolloid);
+
+  nlink = 0;
+  ncolloid = 0;
+
+  for (ic = 1 - nhalo; ic <= ncell[X] + nhalo; ic++) {
+    for (jc = 1 - nhalo; jc <= ncell[Y] + nhalo; jc++) {
+      for (kc = 1 - nhalo; kc <= ncell[Z] + nhalo; kc++) {
+
+	colloids_info_cell_list_head(cinfo, ic, jc, kc, &pc);
+
+	for ( ; pc; pc = pc->next) {
+
+	  for (p_link = pc->lnk; p_link; p_link = p_link->next) {
+
+	    if (p_link->status == LINK_UNUSED) continue;
+
+	    table->i[nlink] = p_link->i;
+	    table->j[nlink] = p_link->j;
+	    table->p[nlink] = p_link->p;
+	    table->status[nlink] = p_link->status;
+	    table->ic[nlink] = ncolloid;
+	    for (ia = 0; ia < 3; ia++) {
+	      table->rb[addr_rank1(table->nlinkmax, 3, nlink, ia)]
+		= p_link->rb[ia];
+	    }
+	    nlink += 1;
+	  }
+
+	  table->colloid[ncolloid] = pc;
+	  table->deltaphi[ncolloid] = 0.0;
+	  ncolloid += 1;
+	}
+      }
+    }
+  }
+
+  table->nlink = nlink;
+  table->ncolloid = ncolloid;
+
+  colloid_link_table_memcpy(table, tdpMemcpyHostToDevice);
+
   return 0;
 }
 
@@ -552,6 +662,11 @@ int build_reset_links(cs_t * cs, colloid_t * p_colloid, map_t * map) {
  *  Correction terms are added for the appropriate colloids to be
  *  implemented at the next step.
  *
+ *  The sites concerned are collected in the site table, which is the
+ *  only lattice-related data copied to the target. The distributions
+ *  are updated there, as is the target copy of the map. The remaining
+ *  order parameters and charge are host quantities.
+ *
  *  The 'abstract' free energy fe may be NULL for single fluid.
  *
  *****************************************************************************/
@@ -560,62 +675,548 @@ int build_remove_replace(fe_t * fe, colloids_info_t * cinfo, lb_t * lb,
 			 field_t * phi,
 			 field_t * p, field_t * q, psi_t * psi, map_t * map) {
 
-  int ic, jc, kc, index;
+  int n, index;
+  int ndist;
+  int ndevice;
+  colloid_t * pc;
+  colloid_site_table_t * table = NULL;
+
+  assert(lb);
+  assert(cinfo);
+
+  lb_ndist(lb, &ndist);
+  tdpGetDeviceCount(&ndevice);
+
+  build_site_table(lb->cs, cinfo, map);
+  build_fluid_target(cinfo, lb, (phi && ndist == 2));
+
+  colloids_info_site_table(cinfo, &table);
+
+  for (n = 0; n < table->nsite; n++) {
+
+    index = table->index[n];
+    pc = table->colloid[n];
+
+    if (table->type[n] == COLLOID_SITE_REMOVE) {
+      if (phi && ndist == 1) build_remove_order_parameter(phi, index, pc);
+      if (psi)  psi_colloid_remove_charge(psi, pc, index);
+    }
+
+    if (table->type[n] == COLLOID_SITE_REPLACE ||
+	table->type[n] == COLLOID_SITE_REPLACE_LOCAL) {
+      if (phi && ndist == 1) {
+	build_replace_order_parameter(fe, lb, cinfo, phi, index, pc, map);
+      }
+      if (p) build_replace_order_parameter(fe, lb, cinfo, p, index, pc, map);
+      if (q) build_replace_order_parameter(fe, lb, cinfo, q, index, pc, map);
+      if (psi) psi_colloid_replace_charge(psi, cinfo, pc, index);
+    }
+  }
+
+  /* The host map is the target map in the absence of a device */
+
+  if (ndevice > 0) build_map_target(cinfo, map);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  build_site_table
+ *
+ *  Fill the site table with the sites (including halo) at which the
+ *  colloid map has changed since the previous update, in lattice
+ *  order. Only the sites set in either the old or the new map are
+ *  examined. A site has changed if the colloid there differs (which
+ *  includes the symmetric difference of the two sets), or if the
+ *  colloid requires its map data to be refreshed: new copies (which
+ *  have the rebuild flag set) and Janus particles, whose wetting
+ *  data depend on position and orientation.
+ *
+ *  Sites to be removed or replaced (local sites only) are flagged,
+ *  and the rebuild flag is set for the colloids concerned.
+ *
+ *  Replacement interpolates from neighbours which were fluid (not
+ *  colloid, not boundary) before the update; these are recorded as
+ *  a bit mask. The site table is copied to the target.
+ *
+ *****************************************************************************/
+
+static int build_site_table(cs_t * cs, colloids_info_t * cinfo, map_t * map) {
+
+  int ic, jc, kc, index, indexn;
+  int ia, n, p;
   int is_halo;
   int nlocal[3];
-  int nhalo;
+  int noffset[3];
+  int ri[3];
+  int ns, nsite;
+  int nold, nnew;
+  int status;
+  int * sold = NULL;
+  int * snew = NULL;
+  int * sites = NULL;
+  double r0[3];
+  double rsite[3];
+  double rb[3];
+  double data[COLLOID_SITE_NDATA];
   colloid_t * pcold;
   colloid_t * pcnew;
+  colloid_t * pcmap;
+  colloid_site_table_t * table = NULL;
 
-  assert(lb);
+  assert(cs);
   assert(cinfo);
+  assert(map);
+  assert(map->ndata <= COLLOID_SITE_NDATA);
 
-  cs_nlocal(lb->cs, nlocal);
-  cs_nhalo(lb->cs, &nhalo);
+  colloids_info_site_table(cinfo, &table);
+  assert(table);
 
-  for (ic = 1 - nhalo; ic <= nlocal[X] + nhalo; ic++) {
-    for (jc = 1 - nhalo; jc <= nlocal[Y] + nhalo; jc++) {
-      for (kc = 1 - nhalo; kc <= nlocal[Z] + nhalo; kc++) {
+  cs_nlocal(cs, nlocal);
+  cs_nlocal_offset(cs, noffset);
 
-	index = cs_index(lb->cs, ic, jc, kc);
+  /* Candidate sites, sorted into lattice order */
 
-	colloids_info_map_old(cinfo, index, &pcold);
-	colloids_info_map(cinfo, index, &pcnew);
+  colloids_info_map_sites(cinfo, &nold, &sold, &nnew, &snew);
 
-	is_halo = (ic < 1 || jc < 1 || kc < 1 ||
-		   ic > nlocal[X] || jc > nlocal[Y] || kc > nlocal[Z]);
+  sites = (int *) malloc((nold + nnew + 1)*sizeof(int));
+  assert(sites);
+  if (sites == NULL) pe_fatal(cinfo->pe, "malloc(sites) failed\n");
 
-	if (pcold == NULL && pcnew != NULL) {
+  ns = 0;
+  for (n = 0; n < nold; n++) {
+    sites[ns++] = sold[n];
+  }
+  for (n = 0; n < nnew; n++) {
+    sites[ns++] = snew[n];
+  }
+
+  qsort(sites, ns, sizeof(int), build_site_compare);
+
+  /* Remove duplicates and unchanged sites (in place) */
+
+  nsite = 0;
+
+  for (n = 0; n < ns; n++) {
+    if (n > 0 && sites[n] == sites[n-1]) continue;
+    colloids_info_map_old(cinfo, sites[n], &pcold);
+    colloids_info_map(cinfo, sites[n], &pcnew);
+    if (pcold == pcnew) {
+      assert(pcnew);
+      if (pcnew->s.rebuild == 0 && pcnew->s.type != COLLOID_TYPE_JANUS) {
+	continue;
+      }
+    }
+    sites[nsite++] = sites[n];
+  }
+
+  colloid_site_table_reserve(table, nsite);
+
+  for (n = 0; n < nsite; n++) {
+
+    index = sites[n];
+    cs_index_to_ijk(cs, index, ri);
+    ic = ri[X];
+    jc = ri[Y];
+    kc = ri[Z];
+
+    colloids_info_map_old(cinfo, index, &pcold);
+    colloids_info_map(cinfo, index, &pcnew);
+
+    is_halo = (ic < 1 || jc < 1 || kc < 1 ||
+	       ic > nlocal[X] || jc > nlocal[Y] || kc > nlocal[Z]);
+
+    table->index[n] = index;
+    table->type[n] = COLLOID_SITE_MAP;
+    table->mask[n] = 0;
+    table->colloid[n] = NULL;
+    table->map_new[n] = pcnew;
+
+    if (pcold == NULL && pcnew != NULL) {
+      pcnew->s.rebuild = 1;
+      if (!is_halo) {
+	table->type[n] = COLLOID_SITE_REMOVE;
+	table->colloid[n] = pcnew;
+      }
+    }
+
+    if (pcold != NULL && pcnew == NULL) {
+      pcold->s.rebuild = 1;
+      if (!is_halo) {
+	table->type[n] = COLLOID_SITE_REPLACE;
+	table->colloid[n] = pcold;
+	for (p = 1; p < NVEL; p++) {
+	  indexn = cs_index(cs, ic + cv[p][X], jc + cv[p][Y], kc + cv[p][Z]);
+	  colloids_info_map_old(cinfo, indexn, &pcmap);
+	  if (pcmap) continue;
+	  map_status(map, indexn, &status);
+	  if (status == MAP_BOUNDARY) continue;
+	  table->mask[n] |= (1 << p);
+	}
+	if (table->mask[n] == 0) table->type[n] = COLLOID_SITE_REPLACE_LOCAL;
+      }
+    }
+
+    /* Boundary vector for the torque */
+
+    for (ia = 0; ia < 3; ia++) {
+      rb[ia] = 0.0;
+    }
+
+    if (table->type[n] == COLLOID_SITE_REPLACE_LOCAL) {
+      colloid_rb(cinfo, table->colloid[n], index, rb);
+    }
+    else if (table->colloid[n]) {
+      pcmap = table->colloid[n];
+      rsite[X] = 1.0*ic;
+      rsite[Y] = 1.0*jc;
+      rsite[Z] = 1.0*kc;
+      for (ia = 0; ia < 3; ia++) {
+	r0[ia] = pcmap->s.r[ia] - 1.0*noffset[ia];
+      }
+      cs_minimum_distance(cs, r0, rsite, rb);
+    }
+
+    for (ia = 0; ia < 3; ia++) {
+      table->rb[addr_rank1(table->nsitemax, 3, n, ia)] = rb[ia];
+    }
+
+    /* New map values */
+
+    map_status(map, index, &status);
+    map_data(map, index, data);
+
+    table->status[n] = status;
+    for (ia = 0; ia < map->ndata; ia++) {
+      table->data[addr_rank1(table->nsitemax, COLLOID_SITE_NDATA, n, ia)]
+	= data[ia];
+    }
+  }
+
+  table->nsite = nsite;
+  free(sites);
+
+  colloid_site_table_memcpy(table, tdpMemcpyHostToDevice);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  build_site_compare
+ *
+ *  For qsort() of site indices.
+ *
+ *****************************************************************************/
+
+static int build_site_compare(const void * a, const void * b) {
+
+  int ia = *((const int *) a);
+  int ib = *((const int *) b);
+
+  return (ia > ib) - (ia < ib);
+}
+
+/*****************************************************************************
+ *
+ *  build_fluid_target
+ *
+ *  Driver for the removal and replacement of fluid at the sites in
+ *  the table. If nphi is set, the order parameter distribution of
+ *  the binary LB is treated likewise.
+ *
+ *****************************************************************************/
+
+static int build_fluid_target(colloids_info_t * cinfo, lb_t * lb, int nphi) {
+
+  double rho0;
+  double phi0;
+  dim3 nblk, ntpb;
+  cs_t * cstarget = NULL;
+  physics_t * phys = NULL;
+  colloid_site_table_t * table = NULL;
+
+  assert(cinfo);
+  assert(lb);
+
+  colloids_info_site_table(cinfo, &table);
+  if (table->nsite == 0) return 0;
+
+  physics_ref(&phys);
+  physics_rho0(phys, &rho0);
+  physics_phi0(phys, &phi0);
+
+  cs_target(lb->cs, &cstarget);
+
+  tdpMemcpyToSymbol(tdpSymbol(lbp), lb->param, sizeof(lb_collide_param_t), 0,
+		    tdpMemcpyHostToDevice);
+
+  kernel_launch_param(table->nsite, &nblk, &ntpb);
+
+  tdpLaunchKernel(build_fluid_kernel, nblk, ntpb, 0, 0,
+		  table->target, cstarget, lb->target, rho0, phi0, nphi);
+
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  build_fluid_kernel
+ *
+ *  One thread per table site. Sites written (those removed or
+ *  replaced) are never read by another thread, as interpolation uses
+ *  only neighbours which were fluid before the update. Contributions
+ *  to the colloids are accumulated atomically.
+ *
+ *****************************************************************************/
+
+__global__ void build_fluid_kernel(colloid_site_table_t * table, cs_t * cs,
+				   lb_t * lb, double rho0, double phi0,
+				   int nphi) {
+  int n;
+  const double rcs2 = 3.0;
+
+  assert(table);
+  assert(cs);
+  assert(lb);
+
+  for_simt_parallel(n, table->nsite, 1) {
 
-	  pcnew->s.rebuild = 1;
+    int ia, ib, p, pdash;
+    int index, indexn;
+    int mask;
+    int ri[3];
 
-	  if (!is_halo) {
-	    build_remove_fluid(lb, index, pcnew);
-	    if (phi) build_remove_order_parameter(lb, phi, index, pcnew);
-	    if (psi)  psi_colloid_remove_charge(psi, pcnew, index);
+    double f;
+    double rho;
+    double phi;
+    double weight;
+    double udotc, sdotq;
+    double g[3];
+    double rb[3], ub[3];
+    double torque[3];
+    double newf[NVEL];
+
+    colloid_t * pc = table->colloid[n];
+
+    index = table->index[n];
+    mask = table->mask[n];
+
+    for (ia = 0; ia < 3; ia++) {
+      g[ia] = 0.0;
+      rb[ia] = table->rb[addr_rank1(table->nsitemax, 3, n, ia)];
+    }
+
+    if (table->type[n] == COLLOID_SITE_REMOVE) {
+
+      /* Mass and momentum of the fluid removed */
+
+      lb_0th_moment(lb, index, LB_RHO, &rho);
+
+      for (p = 0; p < NVEL; p++) {
+	lb_f(lb, index, p, LB_RHO, &f);
+	for (ia = 0; ia < NDIM; ia++) {
+	  g[ia] += lbp.cv[p][ia]*f;
+	}
+      }
+
+      cross_product(rb, g, torque);
+
+      tdpAtomicAddDouble(&pc->deltam, -(rho - rho0));
+      for (ia = 0; ia < 3; ia++) {
+	tdpAtomicAddDouble(&pc->f0[ia], g[ia]);
+	tdpAtomicAddDouble(&pc->t0[ia], torque[ia]);
+      }
+
+      if (nphi) {
+	lb_0th_moment(lb, index, LB_PHI, &phi);
+	tdpAtomicAddDouble(&pc->s.deltaphi, phi - phi0);
+      }
+    }
+
+    if (table->type[n] == COLLOID_SITE_REPLACE) {
+
+      /* Weighted average of the distributions at the fluid neighbours */
+
+      cs_index_to_ijk(cs, index, ri);
+
+      for (p = 0; p < NVEL; p++) {
+	newf[p] = 0.0;
+      }
+
+      weight = 0.0;
+
+      for (p = 1; p < NVEL; p++) {
+	if ((mask & (1 << p)) == 0) continue;
+	indexn = cs_index(cs, ri[X] + lbp.cv[p][X], ri[Y] + lbp.cv[p][Y],
+			  ri[Z] + lbp.cv[p][Z]);
+	for (pdash = 0; pdash < NVEL; pdash++) {
+	  lb_f(lb, indexn, pdash, LB_RHO, &f);
+	  newf[pdash] += lbp.wv[p]*f;
+	}
+	weight += lbp.wv[p];
+      }
+
+      weight = 1.0/weight;
+      rho = 0.0;
+
+      for (p = 0; p < NVEL; p++) {
+	newf[p] *= weight;
+	lb_f_set(lb, index, p, LB_RHO, newf[p]);
+	rho += newf[p];
+	for (ia = 0; ia < 3; ia++) {
+	  g[ia] -= newf[p]*lbp.cv[p][ia];
+	}
+      }
+
+      cross_product(rb, g, torque);
+
+      tdpAtomicAddDouble(&pc->deltam, rho - rho0);
+      for (ia = 0; ia < 3; ia++) {
+	tdpAtomicAddDouble(&pc->f0[ia], g[ia]);
+	tdpAtomicAddDouble(&pc->t0[ia], torque[ia]);
+      }
+
+      if (nphi) {
+
+	for (p = 0; p < NVEL; p++) {
+	  newf[p] = 0.0;
+	}
+
+	weight = 0.0;
+
+	for (p = 1; p < NVEL; p++) {
+	  if ((mask & (1 << p)) == 0) continue;
+	  indexn = cs_index(cs, ri[X] + lbp.cv[p][X], ri[Y] + lbp.cv[p][Y],
+			    ri[Z] + lbp.cv[p][Z]);
+	  for (pdash = 0; pdash < NVEL; pdash++) {
+	    lb_f(lb, indexn, pdash, LB_PHI, &f);
+	    newf[pdash] += lbp.wv[p]*f;
 	  }
+	  weight += lbp.wv[p];
 	}
 
-	if (pcold != NULL && pcnew == NULL) {
+	weight = 1.0/weight;
+	phi = 0.0;
+
+	for (p = 0; p < NVEL; p++) {
+	  newf[p] *= weight;
+	  lb_f_set(lb, index, p, LB_PHI, newf[p]);
+	  phi += newf[p];
+	}
+
+	tdpAtomicAddDouble(&pc->s.deltaphi, -(phi - phi0));
+      }
+    }
 
-	  pcold->s.rebuild = 1;
+    if (table->type[n] == COLLOID_SITE_REPLACE_LOCAL) {
 
-	  if (!is_halo) {
-	    build_replace_fluid(lb, cinfo, index, pcold, map);
-	    if (phi) build_replace_order_parameter(fe, lb, cinfo, phi, index, pcold, map);
-	    if (p) build_replace_order_parameter(fe, lb, cinfo, p, index, pcold, map);
-	    if (q) build_replace_order_parameter(fe, lb, cinfo, q, index, pcold, map);
-	    if (psi) psi_colloid_replace_charge(psi, cinfo, pcold, index);
+      /* Reprojection based on the local solid body velocity
+       * (cf. build_replace_fluid_local()) */
+
+      assert(nphi == 0);
+
+      ub[X] = pc->s.v[X] + pc->s.w[Y]*rb[Z] - pc->s.w[Z]*rb[Y];
+      ub[Y] = pc->s.v[Y] + pc->s.w[Z]*rb[X] - pc->s.w[X]*rb[Z];
+      ub[Z] = pc->s.v[Z] + pc->s.w[X]*rb[Y] - pc->s.w[Y]*rb[X];
+
+      for (p = 0; p < NVEL; p++) {
+	udotc = lbp.cv[p][X]*ub[X] + lbp.cv[p][Y]*ub[Y] + lbp.cv[p][Z]*ub[Z];
+	sdotq = 0.0;
+	for (ia = 0; ia < 3; ia++) {
+	  for (ib = 0; ib < 3; ib++) {
+	    sdotq += lbp.q[p][ia][ib]*ub[ia]*ub[ib];
 	  }
 	}
 
+	f = lbp.wv[p]*(lbp.rho0 + rcs2*udotc + 0.5*rcs2*rcs2*sdotq);
+	lb_f_set(lb, index, p, LB_RHO, f);
+
+	for (ia = 0; ia < 3; ia++) {
+	  g[ia] -= f*lbp.cv[p][ia];
+	}
+      }
+
+      cross_product(rb, g, torque);
+
+      for (ia = 0; ia < 3; ia++) {
+	tdpAtomicAddDouble(&pc->f0[ia], g[ia]);
+	tdpAtomicAddDouble(&pc->t0[ia], torque[ia]);
       }
     }
   }
 
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  build_map_target
+ *
+ *  Bring the target map (status, data, and colloid map) up-to-date at
+ *  the sites in the table. These are the only sites which can have
+ *  changed since the last update.
+ *
+ *****************************************************************************/
+
+static int build_map_target(colloids_info_t * cinfo, map_t * map) {
+
+  dim3 nblk, ntpb;
+  colloid_site_table_t * table = NULL;
+
+  assert(cinfo);
+  assert(map);
+
+  colloids_info_site_table(cinfo, &table);
+  if (table->nsite == 0) return 0;
+
+  kernel_launch_param(table->nsite, &nblk, &ntpb);
+
+  tdpLaunchKernel(build_map_kernel, nblk, ntpb, 0, 0,
+		  table->target, map->target, cinfo->target);
+
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  build_map_kernel
+ *
+ *****************************************************************************/
+
+__global__ void build_map_kernel(colloid_site_table_t * table, map_t * map,
+				 colloids_info_t * cinfo) {
+  int n;
+
+  assert(table);
+  assert(map);
+  assert(cinfo);
+
+  for_simt_parallel(n, table->nsite, 1) {
+
+    int nd;
+    int index = table->index[n];
+
+    map->status[addr_rank0(map->nsite, index)] = table->status[n];
+
+    for (nd = 0; nd < map->ndata; nd++) {
+      map->data[addr_rank1(map->nsite, map->ndata, index, nd)]
+	= table->data[addr_rank1(table->nsitemax, COLLOID_SITE_NDATA, n, nd)];
+    }
+
+    cinfo->map_new[index] = table->map_new[n];
+  }
+
+  return;
+}
+
 /*****************************************************************************
  *
  *  build_bbl_rebuild_flag
@@ -773,161 +1374,30 @@ static int build_remove_fluid(lb_t * lb, int index, colloid_t * p_colloid) {
  *  Remove order parameter(s) at the site inode. The old site information
  *  can be lost inside the particle, but we must record the correction.
  *
- *  A rather cross-cutting routine.
+ *  A rather cross-cutting routine. The binary LB distribution case
+ *  is handled by build_fluid_kernel().
  *
  *****************************************************************************/
 
-static int build_remove_order_parameter(lb_t * lb, field_t * f, int index,
+static int build_remove_order_parameter(field_t * f, int index,
 					colloid_t * pc) {
-  int ndist;
   double phi;
   double phi0;
   physics_t * phys = NULL;
 
   assert(f);
-  assert(lb);
   assert(pc);
 
   physics_ref(&phys);
   physics_phi0(phys, &phi0);
-  lb_ndist(lb, &ndist);
 
-  if (ndist == 2) {
-    lb_0th_moment(lb, index, LB_PHI, &phi);
-  }
-  else {
-    field_scalar(f, index, &phi);
-  }
+  field_scalar(f, index, &phi);
 
   pc->s.deltaphi += (phi - phi0);
 
   return 0;
 }
 
-/*****************************************************************************
- *
- *  build_replace_fluid
- *
- *  Replace the distributions when a fluid site (index) is exposed.
- *  This gives rise to corrections on the particle force and torque.
- *
- *****************************************************************************/
-
-static int build_replace_fluid(lb_t * lb, colloids_info_t * cinfo, int index,
-			       colloid_t * p_colloid, map_t * map) {
-
-  int indexn, p, pdash;
-  int ia;
-  int status;
-  int nweight;
-  int ib[3];
-  int noffset[3];
-
-  double newrho;
-  double weight;
-  double g[3];                /* Change in momentum */
-  double r0[3];               /* Centre of colloid in local coordinates */
-  double rb[3];               /* Boundary vector at site index */
-  double rtmp[3];
-  double newf[NVEL];          /* Replacement distributions */
-  double rho0;
-
-  physics_t * phys = NULL;
-  colloid_t * pc = NULL;
-
-  assert(lb);
-  assert(p_colloid);
-  assert(map);
-
-  cs_nlocal_offset(lb->cs, noffset);
-  cs_index_to_ijk(lb->cs, index, ib);
-
-  physics_ref(&phys);
-  physics_rho0(phys, &rho0);
-
-  newrho = 0.0;
-  weight = 0.0;
-  nweight = 0;
-
-  for (ia = 0; ia < 3; ia++) {
-    g[ia] = 0.0;
-  }
-
-  /* Check the surrounding sites that were linked to inode,
-   * and accumulate a (weighted) average distribution. */
-
-  for (p = 0; p < NVEL; p++) {
-    newf[p] = 0.0;
-  }
-
-  for (p = 1; p < NVEL; p++) {
-
-    indexn = cs_index(lb->cs, ib[X] + cv[p][X], ib[Y] + cv[p][Y],
-		      ib[Z] + cv[p][Z]);
-
-    /* Site must have been fluid before position update */
-
-    colloids_info_map_old(cinfo, indexn, &pc);
-    if (pc) continue;
-    map_status(map, indexn, &status);
-    if (status == MAP_BOUNDARY) continue;
-
-    for (pdash = 0; pdash < NVEL; pdash++) {
-      lb_f(lb, indexn, pdash, 0, rtmp);
-      newf[pdash] += wv[p]*rtmp[0];
-    }
-    weight += wv[p];
-    nweight += 1;
-  }
-
-  /* Set new fluid distributions */
-
-  if (nweight == 0) {
-    /* Cannot interpolate: fall back to local replacement */
-    build_replace_fluid_local(cinfo, p_colloid, index, lb);
-  }
-  else {
-
-    weight = 1.0/weight;
-
-    for (p = 0; p < NVEL; p++) {
-      newf[p] *= weight;
-      lb_f_set(lb, index, p, 0, newf[p]);
-
-      /* ... and remember the new fluid properties */
-      newrho += newf[p];
-
-      /* minus sign is approprite for upcoming ...
-	 ... correction to colloid momentum */
-
-      for (ia = 0; ia < 3; ia++) {
-	g[ia] -= newf[p]*cv[p][ia];
-      }
-    }
-
-    /* Set corrections for excess mass and momentum. For the
-     * correction to the torque, we need the appropriate
-     * boundary vector rb */
-
-    p_colloid->deltam += (newrho - rho0);
-
-    for (ia = 0; ia < 3; ia++) {
-      p_colloid->f0[ia] += g[ia];
-      r0[ia] = p_colloid->s.r[ia] - 1.0*noffset[ia];
-      rtmp[ia] = 1.0*ib[ia];
-    }
-
-    cs_minimum_distance(lb->cs, r0, rtmp, rb);
-    cross_product(rb, g, rtmp);
-
-    for (ia = 0; ia < 3; ia++) {
-      p_colloid->t0[ia] += rtmp[ia];
-    }
-  }
-
-  return 0;
-}
-
 /*****************************************************************************
  *
  *  build_replace_fluid_local
@@ -992,6 +1462,7 @@ int build_replace_fluid_local(colloids_info_t * cinfo, colloid_t * pc,
  *  build_replace_order_parameter
  *
  *  Replace the order parameter(s) at a newly exposed site (index).
+ *  The binary LB distribution case is handled by build_fluid_kernel().
  *
  *****************************************************************************/
 
@@ -999,16 +1470,13 @@ static int build_replace_order_parameter(fe_t * fe, lb_t * lb,
 					 colloids_info_t * cinfo,
 					 field_t * f, int index,
 					 colloid_t * pc, map_t * map) {
-  int indexn, n, p, pdash;
+  int indexn, n, p;
   int status;
   int ri[3];
   int nf;
-  int ndist;
   int nweight;
 
-  double g;
   double weight = 0.0;
-  double newg[NVEL];
   double phi[NQAB];
   double qs[NQAB];
   double phi0;
@@ -1018,7 +1486,6 @@ static int build_replace_order_parameter(fe_t * fe, lb_t * lb,
 
   assert(map);
   assert(lb);
-  lb_ndist(lb, &ndist);
 
   field_nf(f, &nf);
   assert(nf <= NQAB);
@@ -1028,94 +1495,47 @@ static int build_replace_order_parameter(fe_t * fe, lb_t * lb,
   physics_phi0(phys, &phi0);
 
   /* Check the surrounding sites that were linked to inode,
-   * and accumulate a (weighted) average distribution. */
+   * and replace field value(s) based on a weighted average. */
 
-  for (p = 0; p < NVEL; p++) {
-    newg[p] = 0.0;
+  nweight = 0.0;
+  for (n = 0; n < nf; n++) {
+    phi[n] = 0.0;
   }
 
-  if (ndist == 2) {
-
-    /* Reset the distribution (distribution index 1) */
-
-    for (p = 1; p < NVEL; p++) {
+  for (p = 1; p < NVEL; p++) {
 
-      indexn = cs_index(lb->cs, ri[X] + cv[p][X], ri[Y] + cv[p][Y],
-			        ri[Z] + cv[p][Z]);
+    indexn = cs_index(lb->cs, ri[X] + cv[p][X], ri[Y] + cv[p][Y],
+		              ri[Z] + cv[p][Z]);
 
-      /* Site must have been fluid before position update */
+    /* Site must have been fluid before position update */
 
-      /* TODO Could be done with MAP_STATUS ? */
-      colloids_info_map_old(cinfo, indexn, &pcmap);
-      if (pcmap) continue;
-      map_status(map, indexn, &status);
-      if (status == MAP_BOUNDARY) continue;
+    colloids_info_map_old(cinfo, indexn, &pcmap);
+    if (pcmap) continue;
+    map_status(map, indexn, &status);
+    if (status == MAP_BOUNDARY) continue;
 
-      for (pdash = 0; pdash < NVEL; pdash++) {
-	lb_f(lb, indexn, pdash, LB_PHI, &g);
-	newg[pdash] += wv[p]*g;
-      }
-      weight += wv[p];
+    field_scalar_array(f, indexn, qs);
+    for (n = 0; n < nf; n++) {
+      phi[n] += wv[p]*qs[n];
     }
+    weight += wv[p];
+    nweight += 1;
+  }
 
-    /* Set new fluid distributions */
-
-    assert(weight > 0.0);
-    weight = 1.0/weight;
-    phi[0] = 0.0;
-
-    for (p = 0; p < NVEL; p++) {
-      newg[p] *= weight;
-      lb_f_set(lb, index, p, LB_PHI, newg[p]);
-
-      /* ... and remember the new fluid properties */
-      phi[0] += newg[p];
+  if (nweight == 0) {
+    if (n == NQAB) {
+      build_replace_q_local(fe, cinfo, pc, index, f);
+    }
+    else {
+      assert(0);
     }
   }
   else {
-
-    /* Replace field value(s), based on same average */
-
-    nweight = 0.0;
+    weight = 1.0 / weight;
     for (n = 0; n < nf; n++) {
-      phi[n] = 0.0;
-    }
-
-    for (p = 1; p < NVEL; p++) {
-
-      indexn = cs_index(lb->cs, ri[X] + cv[p][X], ri[Y] + cv[p][Y],
-		                ri[Z] + cv[p][Z]);
-
-      /* Site must have been fluid before position update */
-
-      colloids_info_map_old(cinfo, indexn, &pcmap);
-      if (pcmap) continue;
-      map_status(map, indexn, &status);
-      if (status == MAP_BOUNDARY) continue;
-
-      field_scalar_array(f, indexn, qs);
-      for (n = 0; n < nf; n++) {
-	phi[n] += wv[p]*qs[n];
-      }
-      weight += wv[p];
-      nweight += 1;
-    }
-
-    if (nweight == 0) {
-      if (n == NQAB) {
-	build_replace_q_local(fe, cinfo, pc, index, f);
-      }
-      else {
-	assert(0);
-      }
-    }
-    else {
-      weight = 1.0 / weight;
-      for (n = 0; n < nf; n++) {
-	phi[n] *= weight;
-      }
-      field_scalar_array_set(f, index, phi);
+      phi[n] *= weight;
     }
+    field_scalar_array_set(f, index, phi);
   }
 
   /* Set corrections arising from change in conserved order parameter,
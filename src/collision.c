@@ -13,7 +13,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2011-2018 The University of Edinburgh
+ *  (c) 2011-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *    Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -36,6 +36,7 @@
 #include "free_energy.h"
 #include "control.h"
 #include "collision.h"
+#include "collision_simd.h"
 #include "field_s.h"
 #include "map_s.h"
 #include "kernel.h"
@@ -47,11 +48,16 @@ __global__
 void lb_collision_mrt1(kernel_ctxt_t * ktx, lb_t * lb, hydro_t * hydro,
 		       map_t * map, noise_t * noise, fe_t * fe);
 __global__
+void lb_collision_mrt1_sparse(lb_t * lb, hydro_t * hydro, map_t * map,
+			      noise_t * noise, fe_t * fe,
+			      lb_sparse_t * sparse);
+__global__
 void lb_collision_mrt2(kernel_ctxt_t * ktx, lb_t * lb, hydro_t * hydro,
 		       fe_symm_t * fe, noise_t * noise);
 
 int lb_collision_mrt(lb_t * lb, hydro_t * hydro, map_t * map,
-		     noise_t * noise, fe_t * fe);
+		     noise_t * noise, fe_t * fe, kernel_info_t limits,
+		     int nshell);
 int lb_collision_binary(lb_t * lb, hydro_t * hydro, noise_t * noise,
 			fe_symm_t * fe);
 
@@ -59,11 +65,13 @@ static __host__ __device__
 void lb_collision_fluctuations(lb_t * lb, noise_t * noise, int index,
 			       double shat[3][3], double ghat[NVEL]);
 int lb_collision_noise_var_set(lb_t * lb, noise_t * noise);
-static __host__ int lb_collision_parameters_commit(lb_t * lb);
+static __host__ int lb_collision_parameters_commit(lb_t * lb, int masked);
+static __host__ void lb_collision_work(lb_t * lb, int timer, double nsite);
 
 static __device__
 void lb_collision_mrt1_site(lb_t * lb, hydro_t * hydro, map_t * map,
-			    noise_t * noise, fe_t * fe, const int index0);
+			    noise_t * noise, fe_t * fe, const int index0,
+			    const int maskv[NSIMDVL]);
 static __device__
 void lb_collision_mrt2_site(lb_t * lb, hydro_t * hydro, fe_symm_t * fe,
 			    noise_t * noise, const int index0);
@@ -76,7 +84,7 @@ __device__ void d3q19_mode2f_phi(double jdotc[NSIMDVL],
 				 double sphi[3][3][NSIMDVL],
 				 double phi[NSIMDVL],
 				 double jphi[3][NSIMDVL],
-				 double * f, int baseIndex);
+				 lb_real_t * f, int baseIndex);
 
 /* Additional file scope collide time constants */
 
@@ -86,6 +94,10 @@ struct collide_param_s {
   double force_global[3];
   double mobility;
   double rtau2;
+  int aastep;                /* lb_aa_step_enum_t */
+  int masked;                /* Only update sites within kernel limits */
+  int disp[NVEL];            /* Memory displacement of c_p (AA odd step) */
+  int simd;                  /* lb_simd_isa_enum_t for mode transforms */
 };
 
 static __constant__ lb_collide_param_t _lbp;
@@ -117,9 +129,216 @@ int lb_collide(lb_t * lb, hydro_t * hydro, map_t * map, noise_t * noise,
   lb_collision_noise_var_set(lb, noise);
   lb_collide_param_commit(lb);
 
-  if (ndist == 1) lb_collision_mrt(lb, hydro, map, noise, fe);
+  if (ndist == 1) {
+    int nlocal[3];
+    kernel_info_t limits;
+
+    cs_nlocal(lb->cs, nlocal);
+
+    limits.imin = 1; limits.imax = nlocal[X];
+    limits.jmin = 1; limits.jmax = nlocal[Y];
+    limits.kmin = 1; limits.kmax = nlocal[Z];
+
+    lb_collision_parameters_commit(lb, 0);
+    lb_collision_mrt(lb, hydro, map, noise, fe, limits, 0);
+  }
   if (ndist == 2) lb_collision_binary(lb, hydro, noise, (fe_symm_t *) fe);
 
+  noise_advance(noise, NOISE_RHO);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_collide_boundary
+ *
+ *  Collision at local sites within the width of the lattice halo
+ *  swap of the edge of the local domain only. Used with
+ *  lb_collide_interior() to overlap the halo swap with collision:
+ *
+ *    lb_collide_boundary(); lb_halo_start(); lb_collide_interior();
+ *    lb_halo_wait();
+ *
+ *  The boundary sites are one launch which visits only the SIMD
+ *  chunks at the edges (see kernel_ctxt_create_shell()). The
+ *  parameters committed here are also used by lb_collide_interior(),
+ *  which must follow in the same time step.
+ *
+ *  Single distribution (ndist = 1) and two-lattice propagation only.
+ *
+ *****************************************************************************/
+
+__host__ int lb_collide_boundary(lb_t * lb, hydro_t * hydro, map_t * map,
+				 noise_t * noise, fe_t * fe) {
+
+  int nlocal[3];
+  kernel_info_t limits;
+  const int nw = 1;         /* Width of lattice halo swap (see lb_init()) */
+
+  if (hydro == NULL) return 0;
+
+  assert(lb);
+  assert(map);
+  assert(lb->ndist == 1);
+  assert(lb->npropagation == LB_PROPAGATION_TWO_LATTICE);
+
+  lb_collision_relaxation_times_set(lb);
+  lb_collision_noise_var_set(lb, noise);
+  lb_collide_param_commit(lb);
+  lb_collision_parameters_commit(lb, 1);
+
+  cs_nlocal(lb->cs, nlocal);
+
+  limits.imin = 1; limits.imax = nlocal[X];
+  limits.jmin = 1; limits.jmax = nlocal[Y];
+  limits.kmin = 1; limits.kmax = nlocal[Z];
+
+  lb_collision_mrt(lb, hydro, map, noise, fe, limits, nw);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_collide_interior
+ *
+ *  Collision at the remaining local sites (see lb_collide_boundary()).
+ *  There is nothing to do if the boundary sites cover the domain.
+ *
+ *****************************************************************************/
+
+__host__ int lb_collide_interior(lb_t * lb, hydro_t * hydro, map_t * map,
+				 noise_t * noise, fe_t * fe) {
+
+  int nlocal[3];
+  kernel_info_t limits;
+  const int nw = 1;         /* As lb_collide_boundary() */
+
+  if (hydro == NULL) return 0;
+
+  assert(lb);
+  assert(map);
+  assert(lb->ndist == 1);
+  assert(lb->npropagation == LB_PROPAGATION_TWO_LATTICE);
+
+  cs_nlocal(lb->cs, nlocal);
+
+  limits.imin = 1 + nw; limits.imax = nlocal[X] - nw;
+  limits.jmin = 1 + nw; limits.jmax = nlocal[Y] - nw;
+  limits.kmin = 1 + nw; limits.kmax = nlocal[Z] - nw;
+
+  if (limits.imin <= limits.imax && limits.jmin <= limits.jmax &&
+      limits.kmin <= limits.kmax) {
+    lb_collision_mrt(lb, hydro, map, noise, fe, limits, 0);
+  }
+
+  /* Boundary and interior together make one step of the noise */
+
+  noise_advance(noise, NOISE_RHO);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_collide_extended
+ *
+ *  Collision at the local sites and at sites up to nextra into the
+ *  halo, for the communication-avoiding halo swap (see
+ *  lb_halo_depth_set()). The halo sites must hold valid distributions
+ *  to this depth; the extra collisions repeat those made by the
+ *  neighbouring process.
+ *
+ *  Single distribution (ndist = 1) and two-lattice propagation only.
+ *  There must be no site-dependent noise.
+ *
+ *****************************************************************************/
+
+__host__ int lb_collide_extended(lb_t * lb, hydro_t * hydro, map_t * map,
+				 noise_t * noise, fe_t * fe, int nextra) {
+
+  int nhalo;
+  int nlocal[3];
+  kernel_info_t limits;
+
+  if (hydro == NULL) return 0;
+
+  assert(lb);
+  assert(map);
+  assert(lb->ndist == 1);
+  assert(lb->npropagation == LB_PROPAGATION_TWO_LATTICE);
+
+  cs_nhalo(lb->cs, &nhalo);
+  cs_nlocal(lb->cs, nlocal);
+  assert(0 <= nextra && nextra <= nhalo);
+
+  lb_collision_relaxation_times_set(lb);
+  lb_collision_noise_var_set(lb, noise);
+  lb_collide_param_commit(lb);
+
+  limits.imin = 1 - nextra; limits.imax = nlocal[X] + nextra;
+  limits.jmin = 1 - nextra; limits.jmax = nlocal[Y] + nextra;
+  limits.kmin = 1 - nextra; limits.kmax = nlocal[Z] + nextra;
+
+  lb_collision_parameters_commit(lb, 0);
+  lb_collision_mrt(lb, hydro, map, noise, fe, limits, 0);
+
+  noise_advance(noise, NOISE_RHO);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_collide_sparse
+ *
+ *  Collision at the fluid sites listed in the sparse table only
+ *  (see lb_sparse.c). Single distribution (ndist = 1) and two-lattice
+ *  propagation only.
+ *
+ *****************************************************************************/
+
+__host__ int lb_collide_sparse(lb_t * lb, hydro_t * hydro, map_t * map,
+			       noise_t * noise, fe_t * fe,
+			       lb_sparse_t * sparse) {
+  dim3 nblk, ntpb;
+  fe_t * fetarget = NULL;
+
+  if (hydro == NULL) return 0;
+
+  assert(lb);
+  assert(map);
+  assert(sparse);
+  assert(lb->ndist == 1);
+  assert(lb->npropagation == LB_PROPAGATION_TWO_LATTICE);
+
+  lb_collision_relaxation_times_set(lb);
+  lb_collision_noise_var_set(lb, noise);
+  lb_collide_param_commit(lb);
+  lb_collision_parameters_commit(lb, 0);
+
+  if (fe) fe->func->target(fe, &fetarget);
+
+  if (sparse->nchunk > 0) {
+
+    kernel_launch_param(sparse->nchunk, &nblk, &ntpb);
+
+    TIMER_start(TIMER_COLLIDE_KERNEL);
+
+    tdpLaunchKernel(lb_collision_mrt1_sparse, nblk, ntpb, 0, 0,
+		    lb->target, hydro->target, map->target, noise->target,
+		    fetarget, sparse->target);
+
+    tdpAssert(tdpPeekAtLastError());
+    tdpAssert(tdpDeviceSynchronize());
+
+    TIMER_stop(TIMER_COLLIDE_KERNEL);
+    lb_collision_work(lb, TIMER_COLLIDE_KERNEL, 1.0*sparse->nfluid);
+  }
+
+  noise_advance(noise, NOISE_RHO);
+
   return 0;
 }
 
@@ -129,34 +348,54 @@ int lb_collide(lb_t * lb, hydro_t * hydro, map_t * map, noise_t * noise,
  *
  *  Single fluid collision driver (multiple relaxation time).
  *
+ *  If nshell > 0, only sites within nshell of the faces of the limits
+ *  are visited. The caller commits the parameters; if these are
+ *  masked, sites outside the kernel (or shell) are not updated
+ *  (the vectorised kernel otherwise visits whole y-z planes).
+ *
  *****************************************************************************/
 
 __host__ int lb_collision_mrt(lb_t * lb, hydro_t * hydro, map_t * map,
-			      noise_t * noise, fe_t * fe) {
-  int nlocal[3];
+			      noise_t * noise, fe_t * fe, kernel_info_t limits,
+			      int nshell) {
+  int ia;
+  int timer;
+  int nk[3];
+  double nsite;
   dim3 nblk, ntpb;
   fe_t * fetarget = NULL;
-  kernel_info_t limits;
   kernel_ctxt_t * ctxt = NULL;
 
   assert(lb);
   assert(hydro);
   assert(map);
+  assert(nshell >= 0);
 
-  cs_nlocal(lb->cs, nlocal);
+  nk[X] = limits.imax - limits.imin + 1;
+  nk[Y] = limits.jmax - limits.jmin + 1;
+  nk[Z] = limits.kmax - limits.kmin + 1;
+  nsite = 1.0*nk[X]*nk[Y]*nk[Z];
 
-  /* Local extent */
-  limits.imin = 1; limits.imax = nlocal[X];
-  limits.jmin = 1; limits.jmax = nlocal[Y];
-  limits.kmin = 1; limits.kmax = nlocal[Z];
+  if (nshell == 0) {
+    kernel_ctxt_create(lb->cs, NSIMDVL, limits, &ctxt);
+  }
+  else {
+    double ninner = 1.0;
+    kernel_ctxt_create_shell(lb->cs, NSIMDVL, limits, nshell, &ctxt);
+    for (ia = 0; ia < 3; ia++) ninner *= imax(0, nk[ia] - 2*nshell);
+    nsite -= ninner;
+  }
 
-  kernel_ctxt_create(lb->cs, NSIMDVL, limits, &ctxt);
   kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
 
-  lb_collision_parameters_commit(lb);
   if (fe) fe->func->target(fe, &fetarget);
 
-  TIMER_start(TIMER_COLLIDE_KERNEL);
+  /* The AA fused collision and propagation is timed separately */
+
+  timer = (lb->npropagation == LB_PROPAGATION_AA)
+    ? TIMER_COLLIDE_AA_KERNEL : TIMER_COLLIDE_KERNEL;
+
+  TIMER_start(timer);
 
   tdpLaunchKernel(lb_collision_mrt1, nblk, ntpb, 0, 0, ctxt->target,
 		  lb->target, hydro->target, map->target, noise->target,
@@ -165,7 +404,8 @@ __host__ int lb_collision_mrt(lb_t * lb, hydro_t * hydro, map_t * map,
   tdpAssert(tdpPeekAtLastError());
   tdpAssert(tdpDeviceSynchronize());
 
-  TIMER_stop(TIMER_COLLIDE_KERNEL);
+  TIMER_stop(timer);
+  lb_collision_work(lb, timer, nsite);
 
   kernel_ctxt_free(ctxt);
 
@@ -190,9 +430,56 @@ void lb_collision_mrt1(kernel_ctxt_t * ktx, lb_t * lb, hydro_t * hydro,
   kiter = kernel_vector_iterations(ktx);
 
   for_simt_parallel(kindex, kiter, NSIMDVL) {
+    int iv;
     int index0;
+    int ic[NSIMDVL];
+    int jc[NSIMDVL];
+    int kc[NSIMDVL];
+    int maskv[NSIMDVL];
+
     index0 = kernel_baseindex(ktx, kindex);
-    lb_collision_mrt1_site(lb, hydro, map, noise, fe, index0);
+
+    /* The AA steps must not touch halo sites */
+
+    if (_cp.aastep == LB_AA_NONE && _cp.masked == 0) {
+      for_simd_v(iv, NSIMDVL) maskv[iv] = 1;
+    }
+    else {
+      kernel_coords_v(ktx, kindex, ic, jc, kc);
+      kernel_mask_v(ktx, ic, jc, kc, maskv);
+    }
+
+    lb_collision_mrt1_site(lb, hydro, map, noise, fe, index0, maskv);
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  lb_collision_mrt1_sparse
+ *
+ *  Kernel driver for the sparse (fluid sites only) collision. Each
+ *  iteration is one SIMD chunk of consecutive sites.
+ *
+ *****************************************************************************/
+
+__global__
+void lb_collision_mrt1_sparse(lb_t * lb, hydro_t * hydro, map_t * map,
+			      noise_t * noise, fe_t * fe,
+			      lb_sparse_t * sparse) {
+  int n;
+
+  assert(sparse);
+
+  for_simt_parallel(n, sparse->nchunk, 1) {
+    int iv;
+    int maskv[NSIMDVL];
+
+    for_simd_v(iv, NSIMDVL) maskv[iv] = 1;
+
+    lb_collision_mrt1_site(lb, hydro, map, noise, fe, sparse->chunk[n],
+			   maskv);
   }
 
   return;
@@ -215,11 +502,20 @@ void lb_collision_mrt1(kernel_ctxt_t * ktx, lb_t * lb, hydro_t * hydro,
  *  body force present). The stress modes, and ghost modes, are
  *  relaxed toward their equilibrium values.
  *
+ *  For the AA propagation, collision and streaming are fused:
+ *    even step: read f(x, p) from x, write f*(x, p) to x at slot -p;
+ *    odd step:  read f(x, p) from x - c_p at slot -p, write f*(x, p)
+ *               to x + c_p at slot p.
+ *  Each site reads and writes the same set of memory locations, so
+ *  this is in place. Non-fluid sites still stream (no collision).
+ *  Halo sites (maskv = 0) are not touched.
+ *
  *****************************************************************************/
 
 static __device__
 void lb_collision_mrt1_site(lb_t * lb, hydro_t * hydro, map_t * map,
-			    noise_t * noise, fe_t * fe, const int index0) {
+			    noise_t * noise, fe_t * fe, const int index0,
+			    const int maskv[NSIMDVL]) {
   
   int p, m;                               /* velocity index */
   int ia, ib;                             /* indices ("alphabeta") */
@@ -235,6 +531,7 @@ void lb_collision_mrt1_site(lb_t * lb, hydro_t * hydro, map_t * map,
   double force[3][NSIMDVL];               /* External force */
   double tr_s[NSIMDVL], tr_seq[NSIMDVL];  /* Vectors for stress trace */
   double fchunk[NVEL*NSIMDVL];            /* 1-d SIMD distribution vector */
+  double fpre[NVEL*NSIMDVL];              /* Pre-collision values (AA) */
 
   char fullchunk=1;
   char includeSite[NSIMDVL];
@@ -258,6 +555,15 @@ void lb_collision_mrt1_site(lb_t * lb, hydro_t * hydro, map_t * map,
     }
   }
 
+  if (_cp.masked) {
+    for_simd_v(iv, NSIMDVL) {
+      if (maskv[iv] == 0) {
+	includeSite[iv] = 0;
+	fullchunk = 0;
+      }
+    }
+  }
+
   for (ia = 0; ia < 3; ia++) {
     for_simd_v(iv, NSIMDVL) u[ia][iv] = 0.0;
   }
@@ -276,9 +582,27 @@ void lb_collision_mrt1_site(lb_t * lb, hydro_t * hydro, map_t * map,
 
   /* Load SIMD vectors for distribution and force */
 
-  for (p = 0; p < NVEL; p++) {
-    for_simd_v(iv, NSIMDVL) fchunk[p*NSIMDVL+iv] = 
-      lb->f[ LB_ADDR(_lbp.nsite, 1, NVEL, index0 + iv, LB_RHO, p) ];
+  if (_cp.aastep == LB_AA_ODD) {
+    for (p = 0; p < NVEL; p++) {
+      int pbar = (NVEL - p) % NVEL;
+      for_simd_v(iv, NSIMDVL) {
+	int indexp = index0 + iv - maskv[iv]*_cp.disp[p];
+	fchunk[p*NSIMDVL+iv] =
+	  LB_F_LOAD(lb->f[ LB_ADDR(_lbp.nsite, 1, NVEL, indexp, LB_RHO, pbar) ],
+		    _lbp.wv[pbar], LB_RHO);
+      }
+    }
+  }
+  else {
+    for (p = 0; p < NVEL; p++) {
+      for_simd_v(iv, NSIMDVL) fchunk[p*NSIMDVL+iv] = 
+	LB_F_LOAD(lb->f[ LB_ADDR(_lbp.nsite, 1, NVEL, index0 + iv, LB_RHO, p) ],
+		  _lbp.wv[p], LB_RHO);
+    }
+  }
+
+  if (_cp.aastep != LB_AA_NONE) {
+    for (p = 0; p < NVEL*NSIMDVL; p++) fpre[p] = fchunk[p];
   }
 
   for (ia = 0; ia < 3; ia++) {
@@ -291,7 +615,16 @@ void lb_collision_mrt1_site(lb_t * lb, hydro_t * hydro, map_t * map,
   /* Compute all the modes */
 
 #ifdef _D3Q19_
+#ifdef LB_SIMD_X86
+  if (_cp.simd) {
+    d3q19_f2mode_simd(mode, fchunk);
+  }
+  else {
     d3q19_f2mode_chunk(mode, fchunk);
+  }
+#else
+    d3q19_f2mode_chunk(mode, fchunk);
+#endif
 #else
     for (m = 0; m < NVEL; m++) {
       for_simd_v(iv, NSIMDVL) mode[m*NSIMDVL+iv] = 0.0;
@@ -455,17 +788,32 @@ void lb_collision_mrt1_site(lb_t * lb, hydro_t * hydro, map_t * map,
 
   /* Ghost modes are relaxed toward zero equilibrium. */
 
-  for (m = NHYDRO; m < NVEL; m++) {  
-    for_simd_v(iv, NSIMDVL) {
-      mode[m*NSIMDVL+iv] = mode[m*NSIMDVL+iv]
-	- lb->param->rtau[m]*(mode[m*NSIMDVL+iv] - 0.0) + ghat[m][iv];
+#ifdef LB_SIMD_X86
+  if (_cp.simd) d3q19_relax_ghost_simd(mode, lb->param->rtau, &ghat[0][0]);
+#endif
+
+  if (_cp.simd == LB_SIMD_ISA_NONE) {
+    for (m = NHYDRO; m < NVEL; m++) {  
+      for_simd_v(iv, NSIMDVL) {
+	mode[m*NSIMDVL+iv] = mode[m*NSIMDVL+iv]
+	  - lb->param->rtau[m]*(mode[m*NSIMDVL+iv] - 0.0) + ghat[m][iv];
+      }
     }
   }
 
 
   /* Project post-collision modes back onto the distribution */
 #ifdef _D3Q19_
+#ifdef LB_SIMD_X86
+  if (_cp.simd) {
+    d3q19_mode2f_simd(mode, fchunk);
+  }
+  else {
+    d3q19_mode2f_chunk(mode, fchunk);
+  }
+#else
   d3q19_mode2f_chunk(mode, fchunk);
+#endif
 #else
     for (p = 0; p < NVEL; p++) {
       double ftmp[NSIMDVL];
@@ -479,11 +827,35 @@ void lb_collision_mrt1_site(lb_t * lb, hydro_t * hydro, map_t * map,
 
   /* Write SIMD chunks back to main arrays. */
 
-  if (fullchunk) {
+  if (_cp.aastep != LB_AA_NONE) {
+    for_simd_v(iv, NSIMDVL) {
+      if (maskv[iv] == 0) continue;
+      for (p = 0; p < NVEL; p++) {
+	int pbar = (NVEL - p) % NVEL;
+	double fp = (includeSite[iv]) ? fchunk[p*NSIMDVL+iv] : fpre[p*NSIMDVL+iv];
+	if (_cp.aastep == LB_AA_EVEN) {
+	  lb->f[LB_ADDR(_lbp.nsite, 1, NVEL, index0 + iv, LB_RHO, pbar)]
+	    = LB_F_STORE(fp, _lbp.wv[p], LB_RHO);
+	}
+	else {
+	  int indexp = index0 + iv + _cp.disp[p];
+	  lb->f[LB_ADDR(_lbp.nsite, 1, NVEL, indexp, LB_RHO, p)]
+	    = LB_F_STORE(fp, _lbp.wv[p], LB_RHO);
+	}
+      }
+      if (includeSite[iv]) {
+	for (ia = 0; ia < 3; ia++) {
+	  hydro->u[addr_rank1(hydro->nsite, NHDIM, index0 + iv, ia)] = u[ia][iv];
+	}
+      }
+    }
+  }
+  else if (fullchunk) {
     /* distribution */
     for (p = 0; p < NVEL; p++) {
       for_simd_v(iv, NSIMDVL) { 
-	lb->f[LB_ADDR(_lbp.nsite, _lbp.ndist, NVEL, index0+iv, LB_RHO, p)] = fchunk[p*NSIMDVL+iv];
+	lb->f[LB_ADDR(_lbp.nsite, _lbp.ndist, NVEL, index0+iv, LB_RHO, p)]
+	  = LB_F_STORE(fchunk[p*NSIMDVL+iv], _lbp.wv[p], LB_RHO);
       }
     }
     /* velocity */
@@ -499,7 +871,7 @@ void lb_collision_mrt1_site(lb_t * lb, hydro_t * hydro, map_t * map,
 	/* distribution */
 	for (p = 0; p < NVEL; p++) {
 	  lb->f[LB_ADDR(_lbp.nsite, _lbp.ndist, NVEL, index0 + iv, LB_RHO, p)]
-	    = fchunk[p*NSIMDVL+iv]; 
+	    = LB_F_STORE(fchunk[p*NSIMDVL+iv], _lbp.wv[p], LB_RHO);
 	}
 	/* velocity */
 
@@ -546,7 +918,7 @@ __host__ int lb_collision_binary(lb_t * lb, hydro_t * hydro, noise_t * noise,
   kernel_ctxt_create(lb->cs, NSIMDVL, limits, &ctxt);
   kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
 
-  lb_collision_parameters_commit(lb);
+  lb_collision_parameters_commit(lb, 0);
 
   TIMER_start(TIMER_COLLIDE_KERNEL);
 
@@ -557,6 +929,8 @@ __host__ int lb_collision_binary(lb_t * lb, hydro_t * hydro, noise_t * noise,
   tdpAssert(tdpDeviceSynchronize());
 
   TIMER_stop(TIMER_COLLIDE_KERNEL);
+  lb_collision_work(lb, TIMER_COLLIDE_KERNEL,
+		    1.0*nlocal[X]*nlocal[Y]*nlocal[Z]);
 
   kernel_ctxt_free(ctxt);
 
@@ -684,10 +1058,20 @@ __device__ void lb_collision_mrt2_site(lb_t * lb, hydro_t * hydro,
   for (p = 0; p < NVEL; p++) {
     for_simd_v(iv, NSIMDVL) {
       f[p*NSIMDVL+iv]
-	= lb->f[LB_ADDR(_lbp.nsite, _lbp.ndist, NVEL, index0 + iv, LB_RHO, p)];
+	= LB_F_LOAD(lb->f[LB_ADDR(_lbp.nsite, _lbp.ndist, NVEL, index0 + iv,
+				  LB_RHO, p)], _lbp.wv[p], LB_RHO);
     }
   }
+#ifdef LB_SIMD_X86
+  if (_cp.simd) {
+    d3q19_f2mode_simd(mode, f);
+  }
+  else {
+    d3q19_f2mode_chunk(mode, f);
+  }
+#else
   d3q19_f2mode_chunk(mode, f);
+#endif
 #else
   /* Compute all the modes */
   for (m = 0; m < NVEL; m++) {
@@ -697,7 +1081,8 @@ __device__ void lb_collision_mrt2_site(lb_t * lb, hydro_t * hydro,
     for (p = 0; p < NVEL; p++) {
       for_simd_v(iv, NSIMDVL) {
 	mode[m*NSIMDVL+iv] += _lbp.ma[m][p]
-	  *lb->f[LB_ADDR(_lbp.nsite, _lbp.ndist, NVEL, index0 + iv, LB_RHO, p)];
+	  *LB_F_LOAD(lb->f[LB_ADDR(_lbp.nsite, _lbp.ndist, NVEL, index0 + iv,
+				   LB_RHO, p)], _lbp.wv[p], LB_RHO);
       }
     }
   }
@@ -837,21 +1222,36 @@ __device__ void lb_collision_mrt2_site(lb_t * lb, hydro_t * hydro,
 
   /* Ghost modes are relaxed toward zero equilibrium. */
 
-  for (m = NHYDRO; m < NVEL; m++) { 
-    for_simd_v(iv, NSIMDVL)  {
-      mode[m*NSIMDVL+iv] = mode[m*NSIMDVL+iv] 
-	- lb->param->rtau[m]*(mode[m*NSIMDVL+iv] - 0.0) + ghat[m][iv];
+#ifdef LB_SIMD_X86
+  if (_cp.simd) d3q19_relax_ghost_simd(mode, lb->param->rtau, &ghat[0][0]);
+#endif
+
+  if (_cp.simd == LB_SIMD_ISA_NONE) {
+    for (m = NHYDRO; m < NVEL; m++) { 
+      for_simd_v(iv, NSIMDVL)  {
+	mode[m*NSIMDVL+iv] = mode[m*NSIMDVL+iv] 
+	  - lb->param->rtau[m]*(mode[m*NSIMDVL+iv] - 0.0) + ghat[m][iv];
+      }
     }
   }
 
   /* Project post-collision modes back onto the distribution */
 
 #ifdef _D3Q19_  
+#ifdef LB_SIMD_X86
+  if (_cp.simd) {
+    d3q19_mode2f_simd(mode, f);
+  }
+  else {
+    d3q19_mode2f_chunk(mode, f);
+  }
+#else
   d3q19_mode2f_chunk(mode, f);
+#endif
   for (p = 0; p < NVEL; p++) {
     for_simd_v(iv, NSIMDVL) {
       lb->f[LB_ADDR(_lbp.nsite, _lbp.ndist, NVEL, index0 + iv, LB_RHO, p)] =
-	f[p*NSIMDVL+iv];
+	LB_F_STORE(f[p*NSIMDVL+iv], _lbp.wv[p], LB_RHO);
     }
   }
 #else    
@@ -861,7 +1261,8 @@ __device__ void lb_collision_mrt2_site(lb_t * lb, hydro_t * hydro,
       for_simd_v(iv, NSIMDVL) f[p*NSIMDVL+iv] += _lbp.mi[p][m]*mode[m*NSIMDVL+iv];
     }
     for_simd_v(iv, NSIMDVL) {
-      lb->f[LB_ADDR(_lbp.nsite, NDIST, NVEL, index0+iv, LB_RHO, p)] = f[p*NSIMDVL+iv];
+      lb->f[LB_ADDR(_lbp.nsite, NDIST, NVEL, index0+iv, LB_RHO, p)]
+	= LB_F_STORE(f[p*NSIMDVL+iv], _lbp.wv[p], LB_RHO);
     }
   }
 #endif
@@ -967,6 +1368,9 @@ __device__ void lb_collision_mrt2_site(lb_t * lb, hydro_t * hydro,
   noise_present(noise, NOISE_RHO, &status);
   if (status == 0) return 0;
 
+  /* Statistics are accumulated on the host */
+  lb_memcpy(lb, tdpMemcpyDeviceToHost);
+
   physics_ref(&phys);
   physics_kt(phys, &kt);
 
@@ -1291,7 +1695,7 @@ static __host__ __device__
   /* Set symetric random stress matrix (elements with unit variance);
    * in practice always 3d (= 6 elements) required */
 
-  noise_reap_n(noise, index, 6, random);
+  noise_reap_stream_n(noise, NOISE_RHO, index, 0, 6, random);
 
   shat[X][X] = random[0];
   shat[X][Y] = random[1];
@@ -1341,7 +1745,7 @@ static __host__ __device__
   }
 
   if (lb->param->isghost == LB_GHOST_ON) {
-    noise_reap_n(noise, index, NVEL-NHYDRO, random);
+    noise_reap_stream_n(noise, NOISE_RHO, index, 1, NVEL-NHYDRO, random);
 
     for (ia = NHYDRO; ia < NVEL; ia++) {
       ghat[ia] = lb->param->var_noise[ia]*random[ia - NHYDRO];
@@ -1357,7 +1761,7 @@ static __host__ __device__
  *
  *****************************************************************************/
 
-static __host__ int lb_collision_parameters_commit(lb_t * lb) {
+static __host__ int lb_collision_parameters_commit(lb_t * lb, int masked) {
 
   collide_param_t p;
   physics_t * phys = NULL;
@@ -1369,6 +1773,10 @@ static __host__ int lb_collision_parameters_commit(lb_t * lb) {
   double fpulse_frequency_rad;
   double fpulse_amplitude[3] = {0.0, 0.0, 0.0};
   double force_pulsatile[3] = {0.0, 0.0, 0.0};
+  int np;
+  int xs, ys, zs;
+  int ndevice;
+  lb_aa_step_enum_t aastep = LB_AA_NONE;
 
   PI_DOUBLE(pi);
 
@@ -1395,6 +1803,23 @@ static __host__ int lb_collision_parameters_commit(lb_t * lb) {
   physics_mobility(phys, &p.mobility);
   p.rtau2 = 2.0 / (1.0 + 2.0*p.mobility);
 
+  /* AA propagation */
+
+  lb_aa_step(lb, &aastep);
+  cs_strides(lb->cs, &xs, &ys, &zs);
+
+  p.aastep = aastep;
+  p.masked = masked;
+  for (np = 0; np < NVEL; np++) {
+    p.disp[np] = xs*lb->param->cv[np][X] + ys*lb->param->cv[np][Y]
+      + zs*lb->param->cv[np][Z];
+  }
+
+  /* Explicit host SIMD is not relevant for a device */
+
+  tdpGetDeviceCount(&ndevice);
+  p.simd = (ndevice == 0) ? collision_simd_isa() : LB_SIMD_ISA_NONE;
+
   tdpMemcpyToSymbol(tdpSymbol(_lbp), lb->param, sizeof(lb_collide_param_t),
 		    0, tdpMemcpyHostToDevice);
   tdpMemcpyToSymbol(tdpSymbol(_cp), &p, sizeof(collide_param_t), 0,
@@ -2295,7 +2720,7 @@ __device__ void d3q19_mode2f_phi(double jdotc[NSIMDVL],
 				 double sphi[3][3][NSIMDVL],
 				 double phi[NSIMDVL],
 				 double jphi[3][NSIMDVL],
-				 double * f, int baseIndex){
+				 lb_real_t * f, int baseIndex){
 
   int iv=0;
   const double rcs2 = 3.0;
@@ -2566,3 +2991,22 @@ __device__ void d3q19_mode2f_phi(double jdotc[NSIMDVL],
   return;
 }
 #endif
+
+/*****************************************************************************
+ *
+ *  lb_collision_work
+ *
+ *  Telemetry: each site update reads and writes the distributions,
+ *  reads the force and writes the velocity.
+ *
+ *****************************************************************************/
+
+static __host__ void lb_collision_work(lb_t * lb, int timer, double nsite) {
+
+  assert(lb);
+
+  TIMER_work(timer, nsite, nsite*(2.0*NVEL*lb->ndist*sizeof(lb_real_t)
+				  + 2.0*NHDIM*sizeof(double)));
+
+  return;
+}
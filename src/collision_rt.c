@@ -5,7 +5,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2018 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -20,6 +20,7 @@
 #include "physics.h"
 #include "runtime.h"
 #include "collision.h"
+#include "collision_simd.h"
 
 /****************************************************************************
  *
@@ -27,6 +28,9 @@
  *
  *  Defaults are noise off and ghosts on.
  *
+ *  The instruction set for the explicit SIMD mode transforms is the
+ *  widest available on the host (via CPUID) unless otherwise requested.
+ *
  *  Note that the fluid properties must be set to get sensible
  *  values out at this stage.
  *
@@ -40,6 +44,8 @@ int collision_run_time(pe_t * pe, rt_t * rt, lb_t * lb, noise_t * noise) {
   int noise_on = 0;
   int nghost;
   char relax[10];
+  char isaname[BUFSIZ];
+  lb_simd_isa_enum_t isa;
   char tmp[BUFSIZ];
   double tau[NVEL];
 
@@ -85,6 +91,34 @@ int collision_run_time(pe_t * pe, rt_t * rt, lb_t * lb, noise_t * noise) {
     lb_collision_ghost_modes_off(lb);
   }
 
+  /* SIMD instruction set (default widest available) */
+
+  isa = collision_simd_isa_widest();
+  strcpy(isaname, "auto");
+  p = rt_string_parameter(rt, "lb_simd_isa", isaname, BUFSIZ);
+
+  if (p == 1) {
+    if (strcmp(isaname, "auto") == 0) {
+      isa = collision_simd_isa_widest();
+    }
+    else if (strcmp(isaname, "none") == 0) {
+      isa = LB_SIMD_ISA_NONE;
+    }
+    else if (strcmp(isaname, "avx2") == 0) {
+      isa = LB_SIMD_ISA_AVX2;
+    }
+    else if (strcmp(isaname, "avx512") == 0) {
+      isa = LB_SIMD_ISA_AVX512;
+    }
+    else {
+      pe_fatal(pe, "Unrecognised lb_simd_isa %s\n", isaname);
+    }
+  }
+
+  if (collision_simd_isa_set(isa) != 0) {
+    pe_fatal(pe, "lb_simd_isa %s is not available on this host\n", isaname);
+  }
+
   lb_collision_relaxation_times(lb, tau);
 
   pe_info(pe, "\n");
@@ -97,6 +131,8 @@ int collision_run_time(pe_t * pe, rt_t * rt, lb_t * lb, noise_t * noise) {
   pe_info(pe, "Shear relaxation time:   %12.5e\n", tau[LB_TAU_SHEAR]);
   pe_info(pe, "Bulk relaxation time:    %12.5e\n", tau[LB_TAU_BULK]);
   pe_info(pe, "Ghost relaxation time:   %12.5e\n", tau[NVEL-1]);
+  pe_info(pe, "SIMD vector ISA:          %s (%s)\n",
+	  collision_simd_isa_name(isa), isaname);
 
   return 0;
 }
@@ -0,0 +1,569 @@
+/*****************************************************************************
+ *
+ *  collision_simd.c
+ *
+ *  Explicitly vectorised D3Q19 mode transforms for x86.
+ *
+ *  The transforms mode = ma f and f = mi mode are computed one site
+ *  at a time, with the vector running over the 19 modes (or 19
+ *  velocities), so the kernels do not depend on NSIMDVL. The ghost
+ *  mode relaxation is treated in the same way.
+ *
+ *  Both AVX2 and AVX-512 versions are compiled into the same object
+ *  via the target attribute; the widest set supported by the CPU
+ *  (via CPUID) is selected at run time by collision_simd_isa_set().
+ *
+ *  The order of the arithmetic for each element is the same as the
+ *  unrolled scalar versions in collision.c, and multiply and add are
+ *  kept separate (no FMA), so the results are bit-for-bit the same
+ *  whichever instruction set is used.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "collision_simd.h"
+
+#ifdef LB_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/* Instruction set in use (process-wide, set at run time) */
+
+static lb_simd_isa_enum_t isa_ = LB_SIMD_ISA_NONE;
+
+#ifdef LB_SIMD_X86
+
+/* Transposed matrices with each row padded to a whole number of
+ * AVX-512 vectors (the padding is zero, and is never stored). */
+
+#define NVEL_PAD 24
+
+typedef void (* f2mode_ft)(double * mode, const double * f);
+typedef void (* mode2f_ft)(const double * mode, double * f);
+typedef void (* relax_ft)(double * mode, const double * rtau,
+			  const double * ghat);
+
+static double mat_[NVEL][NVEL_PAD] __attribute__((aligned(64)));
+static double mit_[NVEL][NVEL_PAD] __attribute__((aligned(64)));
+
+static void d3q19_f2mode_site(double * mode, const double * f);
+static void d3q19_mode2f_site(const double * mode, double * f);
+static void d3q19_relax_site(double * mode, const double * rtau,
+			     const double * ghat);
+
+static f2mode_ft f2mode_ = d3q19_f2mode_site;
+static mode2f_ft mode2f_ = d3q19_mode2f_site;
+static relax_ft  relax_  = d3q19_relax_site;
+
+#endif
+
+/*****************************************************************************
+ *
+ *  collision_simd_isa_available
+ *
+ *  Returns 1 if the instruction set is supported by this CPU (and
+ *  this build), otherwise 0.
+ *
+ *****************************************************************************/
+
+__host__ int collision_simd_isa_available(lb_simd_isa_enum_t isa) {
+
+  int available = 0;
+
+  if (isa == LB_SIMD_ISA_NONE) available = 1;
+
+#ifdef LB_SIMD_X86
+  __builtin_cpu_init();
+  if (isa == LB_SIMD_ISA_AVX2) {
+    available = __builtin_cpu_supports("avx2");
+  }
+  if (isa == LB_SIMD_ISA_AVX512) {
+    available = __builtin_cpu_supports("avx512f");
+  }
+#endif
+
+  return (available != 0);
+}
+
+/*****************************************************************************
+ *
+ *  collision_simd_isa_widest
+ *
+ *****************************************************************************/
+
+__host__ lb_simd_isa_enum_t collision_simd_isa_widest(void) {
+
+  lb_simd_isa_enum_t isa = LB_SIMD_ISA_NONE;
+
+  if (collision_simd_isa_available(LB_SIMD_ISA_AVX2)) {
+    isa = LB_SIMD_ISA_AVX2;
+  }
+  if (collision_simd_isa_available(LB_SIMD_ISA_AVX512)) {
+    isa = LB_SIMD_ISA_AVX512;
+  }
+
+  return isa;
+}
+
+/*****************************************************************************
+ *
+ *  collision_simd_isa_name
+ *
+ *****************************************************************************/
+
+__host__ const char * collision_simd_isa_name(lb_simd_isa_enum_t isa) {
+
+  const char * name = "none";
+
+  if (isa == LB_SIMD_ISA_AVX2)   name = "avx2";
+  if (isa == LB_SIMD_ISA_AVX512) name = "avx512";
+
+  return name;
+}
+
+/*****************************************************************************
+ *
+ *  collision_simd_isa
+ *
+ *****************************************************************************/
+
+__host__ lb_simd_isa_enum_t collision_simd_isa(void) {
+
+  return isa_;
+}
+
+#ifdef LB_SIMD_X86
+
+static void d3q19_f2mode_avx2(double * mode, const double * f);
+static void d3q19_mode2f_avx2(const double * mode, double * f);
+static void d3q19_relax_avx2(double * mode, const double * rtau,
+			     const double * ghat);
+static void d3q19_f2mode_avx512(double * mode, const double * f);
+static void d3q19_mode2f_avx512(const double * mode, double * f);
+static void d3q19_relax_avx512(double * mode, const double * rtau,
+			       const double * ghat);
+
+/*****************************************************************************
+ *
+ *  collision_simd_isa_set
+ *
+ *  Returns 0 on success, or -1 if the instruction set is not available,
+ *  in which case there is no change.
+ *
+ *****************************************************************************/
+
+__host__ int collision_simd_isa_set(lb_simd_isa_enum_t isa) {
+
+  int m, p;
+
+  if (collision_simd_isa_available(isa) == 0) return -1;
+
+  for (p = 0; p < NVEL; p++) {
+    for (m = 0; m < NVEL_PAD; m++) {
+      mat_[p][m] = (m < NVEL) ? ma_[m][p] : 0.0;
+      mit_[p][m] = (m < NVEL) ? mi_[m][p] : 0.0;
+    }
+  }
+
+  f2mode_ = d3q19_f2mode_site;
+  mode2f_ = d3q19_mode2f_site;
+  relax_  = d3q19_relax_site;
+
+  if (isa == LB_SIMD_ISA_AVX2) {
+    f2mode_ = d3q19_f2mode_avx2;
+    mode2f_ = d3q19_mode2f_avx2;
+    relax_  = d3q19_relax_avx2;
+  }
+
+  if (isa == LB_SIMD_ISA_AVX512) {
+    f2mode_ = d3q19_f2mode_avx512;
+    mode2f_ = d3q19_mode2f_avx512;
+    relax_  = d3q19_relax_avx512;
+  }
+
+  isa_ = isa;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  d3q19_f2mode_simd
+ *
+ *  mode[m] = sum_p ma[m][p] f[p] for each site in the chunk.
+ *
+ *****************************************************************************/
+
+__host__ void d3q19_f2mode_simd(double * mode, const double * fchunk) {
+
+  assert(mode);
+  assert(fchunk);
+
+  if (NSIMDVL == 1) {
+    f2mode_(mode, fchunk);
+  }
+  else {
+    int iv, p;
+    double f1[NVEL];
+    double mode1[NVEL];
+
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      for (p = 0; p < NVEL; p++) f1[p] = fchunk[p*NSIMDVL + iv];
+      f2mode_(mode1, f1);
+      for (p = 0; p < NVEL; p++) mode[p*NSIMDVL + iv] = mode1[p];
+    }
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  d3q19_mode2f_simd
+ *
+ *  f[p] = sum_m mi[p][m] mode[m] for each site in the chunk.
+ *
+ *****************************************************************************/
+
+__host__ void d3q19_mode2f_simd(const double * mode, double * fchunk) {
+
+  assert(mode);
+  assert(fchunk);
+
+  if (NSIMDVL == 1) {
+    mode2f_(mode, fchunk);
+  }
+  else {
+    int iv, p;
+    double f1[NVEL];
+    double mode1[NVEL];
+
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      for (p = 0; p < NVEL; p++) mode1[p] = mode[p*NSIMDVL + iv];
+      mode2f_(mode1, f1);
+      for (p = 0; p < NVEL; p++) fchunk[p*NSIMDVL + iv] = f1[p];
+    }
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  d3q19_relax_ghost_simd
+ *
+ *  Ghost modes m >= NHYDRO relax toward zero equilibrium with
+ *  noise ghat (same layout as mode).
+ *
+ *****************************************************************************/
+
+__host__ void d3q19_relax_ghost_simd(double * mode, const double * rtau,
+				     const double * ghat) {
+  assert(mode);
+  assert(rtau);
+  assert(ghat);
+
+  if (NSIMDVL == 1) {
+    relax_(mode, rtau, ghat);
+  }
+  else {
+    int iv, p;
+    double mode1[NVEL];
+    double ghat1[NVEL];
+
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      for (p = 0; p < NVEL; p++) mode1[p] = mode[p*NSIMDVL + iv];
+      for (p = 0; p < NVEL; p++) ghat1[p] = ghat[p*NSIMDVL + iv];
+      relax_(mode1, rtau, ghat1);
+      for (p = 0; p < NVEL; p++) mode[p*NSIMDVL + iv] = mode1[p];
+    }
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  d3q19_f2mode_site
+ *
+ *  Reference (scalar) versions for one site.
+ *
+ *****************************************************************************/
+
+static void d3q19_f2mode_site(double * mode, const double * f) {
+
+  int m, p;
+
+  for (m = 0; m < NVEL; m++) {
+    mode[m] = 0.0;
+    for (p = 0; p < NVEL; p++) mode[m] += f[p]*ma_[m][p];
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  d3q19_mode2f_site
+ *
+ *****************************************************************************/
+
+static void d3q19_mode2f_site(const double * mode, double * f) {
+
+  int m, p;
+
+  for (p = 0; p < NVEL; p++) {
+    f[p] = 0.0;
+    for (m = 0; m < NVEL; m++) f[p] += mi_[p][m]*mode[m];
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  d3q19_relax_site
+ *
+ *****************************************************************************/
+
+static void d3q19_relax_site(double * mode, const double * rtau,
+			     const double * ghat) {
+  int m;
+
+  for (m = NHYDRO; m < NVEL; m++) {
+    mode[m] = mode[m] - rtau[m]*(mode[m] - 0.0) + ghat[m];
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  d3q19_f2mode_avx2
+ *
+ *  Four vectors of four, plus a masked vector of three.
+ *
+ *****************************************************************************/
+
+__attribute__((target("avx2")))
+static void d3q19_f2mode_avx2(double * mode, const double * f) {
+
+  int p;
+  __m256d m0 = _mm256_setzero_pd();
+  __m256d m1 = _mm256_setzero_pd();
+  __m256d m2 = _mm256_setzero_pd();
+  __m256d m3 = _mm256_setzero_pd();
+  __m256d m4 = _mm256_setzero_pd();
+  const __m256i tail = _mm256_set_epi64x(0, -1, -1, -1);
+
+  for (p = 0; p < NVEL; p++) {
+    __m256d fp = _mm256_broadcast_sd(f + p);
+    m0 = _mm256_add_pd(m0, _mm256_mul_pd(fp, _mm256_load_pd(mat_[p] +  0)));
+    m1 = _mm256_add_pd(m1, _mm256_mul_pd(fp, _mm256_load_pd(mat_[p] +  4)));
+    m2 = _mm256_add_pd(m2, _mm256_mul_pd(fp, _mm256_load_pd(mat_[p] +  8)));
+    m3 = _mm256_add_pd(m3, _mm256_mul_pd(fp, _mm256_load_pd(mat_[p] + 12)));
+    m4 = _mm256_add_pd(m4, _mm256_mul_pd(fp, _mm256_load_pd(mat_[p] + 16)));
+  }
+
+  _mm256_storeu_pd(mode +  0, m0);
+  _mm256_storeu_pd(mode +  4, m1);
+  _mm256_storeu_pd(mode +  8, m2);
+  _mm256_storeu_pd(mode + 12, m3);
+  _mm256_maskstore_pd(mode + 16, tail, m4);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  d3q19_mode2f_avx2
+ *
+ *****************************************************************************/
+
+__attribute__((target("avx2")))
+static void d3q19_mode2f_avx2(const double * mode, double * f) {
+
+  int m;
+  __m256d f0 = _mm256_setzero_pd();
+  __m256d f1 = _mm256_setzero_pd();
+  __m256d f2 = _mm256_setzero_pd();
+  __m256d f3 = _mm256_setzero_pd();
+  __m256d f4 = _mm256_setzero_pd();
+  const __m256i tail = _mm256_set_epi64x(0, -1, -1, -1);
+
+  for (m = 0; m < NVEL; m++) {
+    __m256d mm = _mm256_broadcast_sd(mode + m);
+    f0 = _mm256_add_pd(f0, _mm256_mul_pd(_mm256_load_pd(mit_[m] +  0), mm));
+    f1 = _mm256_add_pd(f1, _mm256_mul_pd(_mm256_load_pd(mit_[m] +  4), mm));
+    f2 = _mm256_add_pd(f2, _mm256_mul_pd(_mm256_load_pd(mit_[m] +  8), mm));
+    f3 = _mm256_add_pd(f3, _mm256_mul_pd(_mm256_load_pd(mit_[m] + 12), mm));
+    f4 = _mm256_add_pd(f4, _mm256_mul_pd(_mm256_load_pd(mit_[m] + 16), mm));
+  }
+
+  _mm256_storeu_pd(f +  0, f0);
+  _mm256_storeu_pd(f +  4, f1);
+  _mm256_storeu_pd(f +  8, f2);
+  _mm256_storeu_pd(f + 12, f3);
+  _mm256_maskstore_pd(f + 16, tail, f4);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  d3q19_relax_avx2
+ *
+ *  Ghosts are modes NHYDRO = 10, ..., 18: two vectors of four and a
+ *  masked vector of one.
+ *
+ *****************************************************************************/
+
+__attribute__((target("avx2")))
+static void d3q19_relax_avx2(double * mode, const double * rtau,
+			     const double * ghat) {
+  int m;
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256i index = _mm256_set_epi64x(3, 2, 1, 0);
+
+  for (m = NHYDRO; m < NVEL; m += 4) {
+    __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(NVEL - m), index);
+    __m256d mv = _mm256_maskload_pd(mode + m, mask);
+    __m256d rv = _mm256_maskload_pd(rtau + m, mask);
+    __m256d gv = _mm256_maskload_pd(ghat + m, mask);
+    __m256d dv = _mm256_mul_pd(rv, _mm256_sub_pd(mv, zero));
+    mv = _mm256_add_pd(_mm256_sub_pd(mv, dv), gv);
+    _mm256_maskstore_pd(mode + m, mask, mv);
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  AVX-512
+ *
+ *  The explicit rounding forms of multiply and add are used as the
+ *  compiler may otherwise contract them to FMA (avx512f has FMA).
+ *
+ *****************************************************************************/
+
+#define mul512(a, b) _mm512_mul_round_pd((a), (b), _MM_FROUND_CUR_DIRECTION)
+#define add512(a, b) _mm512_add_round_pd((a), (b), _MM_FROUND_CUR_DIRECTION)
+#define sub512(a, b) _mm512_sub_round_pd((a), (b), _MM_FROUND_CUR_DIRECTION)
+
+/*****************************************************************************
+ *
+ *  d3q19_f2mode_avx512
+ *
+ *  Two vectors of eight, plus a masked vector of three.
+ *
+ *****************************************************************************/
+
+__attribute__((target("avx512f")))
+static void d3q19_f2mode_avx512(double * mode, const double * f) {
+
+  int p;
+  __m512d m0 = _mm512_setzero_pd();
+  __m512d m1 = _mm512_setzero_pd();
+  __m512d m2 = _mm512_setzero_pd();
+  const __mmask8 tail = 0x07;
+
+  for (p = 0; p < NVEL; p++) {
+    __m512d fp = _mm512_set1_pd(f[p]);
+    m0 = add512(m0, mul512(fp, _mm512_load_pd(mat_[p] +  0)));
+    m1 = add512(m1, mul512(fp, _mm512_load_pd(mat_[p] +  8)));
+    m2 = add512(m2, mul512(fp, _mm512_load_pd(mat_[p] + 16)));
+  }
+
+  _mm512_storeu_pd(mode +  0, m0);
+  _mm512_storeu_pd(mode +  8, m1);
+  _mm512_mask_storeu_pd(mode + 16, tail, m2);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  d3q19_mode2f_avx512
+ *
+ *****************************************************************************/
+
+__attribute__((target("avx512f")))
+static void d3q19_mode2f_avx512(const double * mode, double * f) {
+
+  int m;
+  __m512d f0 = _mm512_setzero_pd();
+  __m512d f1 = _mm512_setzero_pd();
+  __m512d f2 = _mm512_setzero_pd();
+  const __mmask8 tail = 0x07;
+
+  for (m = 0; m < NVEL; m++) {
+    __m512d mm = _mm512_set1_pd(mode[m]);
+    f0 = add512(f0, mul512(_mm512_load_pd(mit_[m] +  0), mm));
+    f1 = add512(f1, mul512(_mm512_load_pd(mit_[m] +  8), mm));
+    f2 = add512(f2, mul512(_mm512_load_pd(mit_[m] + 16), mm));
+  }
+
+  _mm512_storeu_pd(f +  0, f0);
+  _mm512_storeu_pd(f +  8, f1);
+  _mm512_mask_storeu_pd(f + 16, tail, f2);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  d3q19_relax_avx512
+ *
+ *  One vector of eight and a masked vector of one.
+ *
+ *****************************************************************************/
+
+__attribute__((target("avx512f")))
+static void d3q19_relax_avx512(double * mode, const double * rtau,
+			       const double * ghat) {
+  int m;
+  const __m512d zero = _mm512_setzero_pd();
+
+  for (m = NHYDRO; m < NVEL; m += 8) {
+    __mmask8 mask = (NVEL - m >= 8) ? 0xff : (1 << (NVEL - m)) - 1;
+    __m512d mv = _mm512_maskz_loadu_pd(mask, mode + m);
+    __m512d rv = _mm512_maskz_loadu_pd(mask, rtau + m);
+    __m512d gv = _mm512_maskz_loadu_pd(mask, ghat + m);
+    __m512d dv = mul512(rv, sub512(mv, zero));
+    mv = add512(sub512(mv, dv), gv);
+    _mm512_mask_storeu_pd(mode + m, mask, mv);
+  }
+
+  return;
+}
+
+#else
+
+/*****************************************************************************
+ *
+ *  collision_simd_isa_set
+ *
+ *  Only LB_SIMD_ISA_NONE is available.
+ *
+ *****************************************************************************/
+
+__host__ int collision_simd_isa_set(lb_simd_isa_enum_t isa) {
+
+  if (collision_simd_isa_available(isa) == 0) return -1;
+  isa_ = isa;
+
+  return 0;
+}
+
+#endif
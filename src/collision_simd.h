@@ -0,0 +1,53 @@
+/*****************************************************************************
+ *
+ *  collision_simd.h
+ *
+ *  Explicitly vectorised (AVX2, AVX-512) D3Q19 mode transforms with
+ *  selection of the instruction set at run time.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#ifndef LUDWIG_COLLISION_SIMD_H
+#define LUDWIG_COLLISION_SIMD_H
+
+#include "pe.h"
+#include "model.h"
+
+/* Explicit x86 kernels are host-only and specific to D3Q19 */
+
+#if defined(_D3Q19_) && defined(__x86_64__) && defined(__GNUC__)
+#ifndef __NVCC__
+#define LB_SIMD_X86
+#endif
+#endif
+
+typedef enum {LB_SIMD_ISA_NONE = 0,
+	      LB_SIMD_ISA_AVX2,
+	      LB_SIMD_ISA_AVX512} lb_simd_isa_enum_t;
+
+__host__ int collision_simd_isa_available(lb_simd_isa_enum_t isa);
+__host__ int collision_simd_isa_set(lb_simd_isa_enum_t isa);
+__host__ lb_simd_isa_enum_t collision_simd_isa(void);
+__host__ lb_simd_isa_enum_t collision_simd_isa_widest(void);
+__host__ const char * collision_simd_isa_name(lb_simd_isa_enum_t isa);
+
+#ifdef LB_SIMD_X86
+
+/* Arguments have the layout of the collision SIMD chunks, e.g.,
+ * mode[m*NSIMDVL + iv], and rtau[NVEL]. */
+
+__host__ void d3q19_f2mode_simd(double * mode, const double * fchunk);
+__host__ void d3q19_mode2f_simd(const double * mode, double * fchunk);
+__host__ void d3q19_relax_ghost_simd(double * mode, const double * rtau,
+				     const double * ghat);
+#endif
+
+#endif
@@ -0,0 +1,310 @@
+/*****************************************************************************
+ *
+ *  colloid_link_table.c
+ *
+ *  Flat (structure-of-arrays) table of colloid boundary links.
+ *
+ *  Storage grows as required, but is never reduced; the target copy
+ *  is only reallocated when the host copy is.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "colloid_link_table.h"
+
+static int colloid_link_table_target_alloc(colloid_link_table_t * table);
+static int colloid_link_table_target_free(colloid_link_table_t * table);
+
+/*****************************************************************************
+ *
+ *  colloid_link_table_create
+ *
+ *****************************************************************************/
+
+__host__ int colloid_link_table_create(pe_t * pe,
+				       colloid_link_table_t ** ptable) {
+  int ndevice;
+  colloid_link_table_t * table = NULL;
+
+  assert(pe);
+  assert(ptable);
+
+  table = (colloid_link_table_t *) calloc(1, sizeof(colloid_link_table_t));
+  assert(table);
+  if (table == NULL) pe_fatal(pe, "calloc(colloid_link_table_t) failed\n");
+
+  table->pe = pe;
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice == 0) {
+    table->target = table;
+  }
+  else {
+    tdpAssert(tdpMalloc((void **) &table->target,
+			sizeof(colloid_link_table_t)));
+    tdpAssert(tdpMemset(table->target, 0, sizeof(colloid_link_table_t)));
+  }
+
+  /* Avoid zero-sized allocations */
+  colloid_link_table_reserve(table, 1, 1);
+
+  *ptable = table;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_link_table_free
+ *
+ *****************************************************************************/
+
+__host__ int colloid_link_table_free(colloid_link_table_t * table) {
+
+  assert(table);
+
+  if (table->target != table) {
+    colloid_link_table_target_free(table);
+    tdpAssert(tdpFree(table->target));
+  }
+
+  free(table->deltaphi);
+  free(table->colloid);
+  free(table->rb);
+  free(table->ic);
+  free(table->status);
+  free(table->p);
+  free(table->j);
+  free(table->i);
+  free(table);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_link_table_reserve
+ *
+ *  Ensure there is room for at least nlink links and ncolloid colloids.
+ *  Existing contents are not preserved if reallocation takes place.
+ *
+ *****************************************************************************/
+
+__host__ int colloid_link_table_reserve(colloid_link_table_t * table,
+					int nlink, int ncolloid) {
+  pe_t * pe = NULL;
+
+  assert(table);
+
+  if (nlink <= table->nlinkmax && ncolloid <= table->ncolloidmax) return 0;
+
+  pe = table->pe;
+
+  if (table->target != table) colloid_link_table_target_free(table);
+
+  if (nlink > table->nlinkmax) {
+
+    /* Allow some slack to avoid frequent reallocation */
+    table->nlinkmax = nlink + nlink/4;
+
+    free(table->i);
+    free(table->j);
+    free(table->p);
+    free(table->status);
+    free(table->ic);
+    free(table->rb);
+
+    table->i = (int *) calloc(table->nlinkmax, sizeof(int));
+    table->j = (int *) calloc(table->nlinkmax, sizeof(int));
+    table->p = (int *) calloc(table->nlinkmax, sizeof(int));
+    table->status = (int *) calloc(table->nlinkmax, sizeof(int));
+    table->ic = (int *) calloc(table->nlinkmax, sizeof(int));
+    table->rb = (double *) calloc(3*table->nlinkmax, sizeof(double));
+
+    if (table->i == NULL) pe_fatal(pe, "calloc(table->i) failed\n");
+    if (table->j == NULL) pe_fatal(pe, "calloc(table->j) failed\n");
+    if (table->p == NULL) pe_fatal(pe, "calloc(table->p) failed\n");
+    if (table->status == NULL) pe_fatal(pe, "calloc(table->status) failed\n");
+    if (table->ic == NULL) pe_fatal(pe, "calloc(table->ic) failed\n");
+    if (table->rb == NULL) pe_fatal(pe, "calloc(table->rb) failed\n");
+  }
+
+  if (ncolloid > table->ncolloidmax) {
+
+    table->ncolloidmax = ncolloid + ncolloid/4;
+
+    free(table->colloid);
+    free(table->deltaphi);
+
+    table->colloid = (struct colloid **) calloc(table->ncolloidmax,
+						sizeof(struct colloid *));
+    table->deltaphi = (double *) calloc(table->ncolloidmax, sizeof(double));
+
+    if (table->colloid == NULL) pe_fatal(pe, "calloc(table->colloid) failed\n");
+    if (table->deltaphi == NULL) pe_fatal(pe, "calloc(table->deltaphi) failed\n");
+  }
+
+  if (table->target != table) colloid_link_table_target_alloc(table);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_link_table_memcpy
+ *
+ *  Host to device copies the whole table; device to host returns
+ *  only the per-colloid accumulator.
+ *
+ *****************************************************************************/
+
+__host__ int colloid_link_table_memcpy(colloid_link_table_t * table,
+				       tdpMemcpyKind flag) {
+  int ndevice;
+
+  assert(table);
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice == 0) {
+    assert(table->target == table);
+  }
+  else {
+    int nlink = table->nlink;
+    int nlinkmax = table->nlinkmax;
+    int ncolloid = table->ncolloid;
+    colloid_link_table_t tmp;
+
+    tdpAssert(tdpMemcpy(&tmp, table->target, sizeof(colloid_link_table_t),
+			tdpMemcpyDeviceToHost));
+
+    switch (flag) {
+    case tdpMemcpyHostToDevice:
+      tdpMemcpy(&table->target->nlink, &table->nlink, sizeof(int), flag);
+      tdpMemcpy(&table->target->ncolloid, &table->ncolloid, sizeof(int),
+		flag);
+      tdpMemcpy(tmp.i, table->i, nlink*sizeof(int), flag);
+      tdpMemcpy(tmp.j, table->j, nlink*sizeof(int), flag);
+      tdpMemcpy(tmp.p, table->p, nlink*sizeof(int), flag);
+      tdpMemcpy(tmp.status, table->status, nlink*sizeof(int), flag);
+      tdpMemcpy(tmp.ic, table->ic, nlink*sizeof(int), flag);
+      tdpMemcpy(tmp.rb, table->rb, 3*nlinkmax*sizeof(double), flag);
+      tdpMemcpy(tmp.colloid, table->colloid,
+		ncolloid*sizeof(struct colloid *), flag);
+      tdpMemcpy(tmp.deltaphi, table->deltaphi, ncolloid*sizeof(double), flag);
+      break;
+    case tdpMemcpyDeviceToHost:
+      tdpMemcpy(table->deltaphi, tmp.deltaphi, ncolloid*sizeof(double), flag);
+      break;
+    default:
+      pe_fatal(table->pe, "Bad flag in colloid_link_table_memcpy\n");
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_link_table_deltaphi_zero
+ *
+ *  Zero the per-colloid accumulator (host and target).
+ *
+ *****************************************************************************/
+
+__host__ int colloid_link_table_deltaphi_zero(colloid_link_table_t * table) {
+
+  int n;
+
+  assert(table);
+
+  for (n = 0; n < table->ncolloid; n++) {
+    table->deltaphi[n] = 0.0;
+  }
+
+  if (table->target != table) {
+    colloid_link_table_t tmp;
+    tdpAssert(tdpMemcpy(&tmp, table->target, sizeof(colloid_link_table_t),
+			tdpMemcpyDeviceToHost));
+    tdpAssert(tdpMemset(tmp.deltaphi, 0, table->ncolloidmax*sizeof(double)));
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_link_table_target_alloc
+ *
+ *****************************************************************************/
+
+static int colloid_link_table_target_alloc(colloid_link_table_t * table) {
+
+  int nlinkmax;
+  int ncolloidmax;
+  colloid_link_table_t tmp;
+
+  assert(table);
+  assert(table->target != table);
+
+  nlinkmax = table->nlinkmax;
+  ncolloidmax = table->ncolloidmax;
+
+  tmp = *table;
+  tmp.target = NULL;
+  tmp.pe = NULL;
+
+  tdpAssert(tdpMalloc((void **) &tmp.i, nlinkmax*sizeof(int)));
+  tdpAssert(tdpMalloc((void **) &tmp.j, nlinkmax*sizeof(int)));
+  tdpAssert(tdpMalloc((void **) &tmp.p, nlinkmax*sizeof(int)));
+  tdpAssert(tdpMalloc((void **) &tmp.status, nlinkmax*sizeof(int)));
+  tdpAssert(tdpMalloc((void **) &tmp.ic, nlinkmax*sizeof(int)));
+  tdpAssert(tdpMalloc((void **) &tmp.rb, 3*nlinkmax*sizeof(double)));
+  tdpAssert(tdpMalloc((void **) &tmp.colloid,
+		      ncolloidmax*sizeof(struct colloid *)));
+  tdpAssert(tdpMalloc((void **) &tmp.deltaphi, ncolloidmax*sizeof(double)));
+
+  tdpAssert(tdpMemcpy(table->target, &tmp, sizeof(colloid_link_table_t),
+		      tdpMemcpyHostToDevice));
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_link_table_target_free
+ *
+ *****************************************************************************/
+
+static int colloid_link_table_target_free(colloid_link_table_t * table) {
+
+  colloid_link_table_t tmp;
+
+  assert(table);
+  assert(table->target != table);
+
+  tdpAssert(tdpMemcpy(&tmp, table->target, sizeof(colloid_link_table_t),
+		      tdpMemcpyDeviceToHost));
+
+  if (tmp.i) tdpFree(tmp.i);
+  if (tmp.j) tdpFree(tmp.j);
+  if (tmp.p) tdpFree(tmp.p);
+  if (tmp.status) tdpFree(tmp.status);
+  if (tmp.ic) tdpFree(tmp.ic);
+  if (tmp.rb) tdpFree(tmp.rb);
+  if (tmp.colloid) tdpFree(tmp.colloid);
+  if (tmp.deltaphi) tdpFree(tmp.deltaphi);
+
+  return 0;
+}
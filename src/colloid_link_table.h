@@ -0,0 +1,59 @@
+/*****************************************************************************
+ *
+ *  colloid_link_table.h
+ *
+ *  A flat, structure-of-arrays, copy of the boundary links of all the
+ *  colloids (including halo colloids) on this rank, suitable for
+ *  kernels running on the target. The linked lists of colloid_link_t
+ *  remain the master copy; the table is refilled from them when the
+ *  links are updated.
+ *
+ *  As for colloid_link_t, the implementation is exposed.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#ifndef LUDWIG_COLLOID_LINK_TABLE_H
+#define LUDWIG_COLLOID_LINK_TABLE_H
+
+#include "pe.h"
+#include "colloid_link.h"
+
+typedef struct colloid_link_table_s colloid_link_table_t;
+
+struct colloid_link_table_s {
+  pe_t * pe;                    /* Parallel environment */
+  int nlink;                    /* Number of links in table */
+  int ncolloid;                 /* Number of colloids in table */
+  int nlinkmax;                 /* Allocated size (links) */
+  int ncolloidmax;              /* Allocated size (colloids) */
+
+  int * i;                      /* Outside site index */
+  int * j;                      /* Inside site index */
+  int * p;                      /* Velocity connecting i -> j */
+  int * status;                 /* link_status enum */
+  int * ic;                     /* Owning colloid (index in table) */
+  double * rb;                  /* rb[addr_rank1(nlinkmax, 3, n, ia)] */
+
+  struct colloid ** colloid;    /* Colloid for each index */
+  double * deltaphi;            /* Per colloid accumulator */
+
+  colloid_link_table_t * target;  /* Target copy */
+};
+
+__host__ int colloid_link_table_create(pe_t * pe, colloid_link_table_t ** p);
+__host__ int colloid_link_table_free(colloid_link_table_t * table);
+__host__ int colloid_link_table_reserve(colloid_link_table_t * table,
+					int nlink, int ncolloid);
+__host__ int colloid_link_table_memcpy(colloid_link_table_t * table,
+				       tdpMemcpyKind flag);
+__host__ int colloid_link_table_deltaphi_zero(colloid_link_table_t * table);
+
+#endif
@@ -0,0 +1,638 @@
+/*****************************************************************************
+ *
+ *  colloid_nlist.c
+ *
+ *  Colloid-colloid neighbour (Verlet) list.
+ *
+ *  The list holds pairs (pc1, pc2) where pc1 is local, pc2 is found
+ *  in one of the neighbouring cells (local or halo), and the global
+ *  index of pc1 is less than that of pc2. The order is that of the
+ *  original cell list search, so each pair appears exactly once.
+ *
+ *  With zero skin (the default) the list is rebuilt at every update
+ *  and holds all candidate pairs from the cell list, i.e., there is
+ *  no distance criterion.
+ *
+ *  With a non-zero skin, only pairs with centre-centre separation
+ *  less than range + skin are retained. The list is rebuilt when
+ *  any colloid has moved more than skin/2 since the last build, or
+ *  any colloid has changed owner. Between builds, the halo copies
+ *  are re-created, so pairs are held as global indices and the
+ *  current pointers are recovered at each update.
+ *
+ *  The cell width must be at least range + skin.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "util.h"
+#include "timer.h"
+#include "colloid_nlist.h"
+
+typedef struct colloid_nlist_entry_s entry_t;
+
+struct colloid_nlist_entry_s {
+  int index;              /* Global colloid index */
+  int islocal;            /* Local copy (not a halo copy) */
+  double r[3];            /* Position */
+  colloid_t * pc;         /* Current copy */
+};
+
+struct colloid_nlist_s {
+  pe_t * pe;              /* Parallel environment */
+  cs_t * cs;              /* Coordinate system */
+  double skin;            /* Verlet skin (zero means no list) */
+  double range;           /* Centre-centre interaction range */
+  int stale;              /* Force a rebuild at next update */
+
+  int nlist;              /* Number of pairs in list */
+  int nlistmax;           /* Allocated size of list */
+  int npair;              /* Number of current pairs (pointers) */
+  int * index1;           /* Global index of first colloid */
+  int * index2;           /* Global index of second colloid */
+  colloid_t ** pc1;       /* Current pointers */
+  colloid_t ** pc2;
+
+  int nref;               /* State at last build */
+  int nrefmax;
+  entry_t * ref;
+  int ncurrent;           /* State at this update */
+  int ncurrentmax;
+  entry_t * current;
+
+  int nbuild;             /* Number of builds */
+  int nupdate;            /* Number of updates */
+};
+
+static int colloid_nlist_build(colloid_nlist_t * obj, colloids_info_t * cinfo);
+static int colloid_nlist_resolve(colloid_nlist_t * obj);
+static int colloid_nlist_rebuild_required(colloid_nlist_t * obj,
+					  int * rebuild);
+static int colloid_nlist_append(colloid_nlist_t * obj, colloid_t * pc1,
+				colloid_t * pc2);
+static int colloid_nlist_entries(colloid_nlist_t * obj,
+				 colloids_info_t * cinfo);
+static entry_t * colloid_nlist_find(entry_t * entry, int n, int index);
+static int colloid_nlist_compare(const void * a, const void * b);
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_create
+ *
+ *****************************************************************************/
+
+int colloid_nlist_create(pe_t * pe, cs_t * cs, colloid_nlist_t ** pobj) {
+
+  colloid_nlist_t * obj = NULL;
+
+  assert(pe);
+  assert(cs);
+  assert(pobj);
+
+  obj = (colloid_nlist_t *) calloc(1, sizeof(colloid_nlist_t));
+  assert(obj);
+  if (obj == NULL) pe_fatal(pe, "calloc(colloid_nlist_t) failed\n");
+
+  obj->pe = pe;
+  obj->cs = cs;
+  obj->stale = 1;
+
+  *pobj = obj;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_free
+ *
+ *****************************************************************************/
+
+int colloid_nlist_free(colloid_nlist_t * obj) {
+
+  assert(obj);
+
+  free(obj->current);
+  free(obj->ref);
+  free(obj->pc2);
+  free(obj->pc1);
+  free(obj->index2);
+  free(obj->index1);
+  free(obj);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_info
+ *
+ *****************************************************************************/
+
+int colloid_nlist_info(colloid_nlist_t * obj) {
+
+  assert(obj);
+
+  if (obj->skin > 0.0) {
+    pe_info(obj->pe, "Verlet list skin:             %14.7e\n", obj->skin);
+    pe_info(obj->pe, "Verlet list range:            %14.7e\n",
+	    obj->range + obj->skin);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_skin_set
+ *
+ *****************************************************************************/
+
+int colloid_nlist_skin_set(colloid_nlist_t * obj, double skin) {
+
+  assert(obj);
+  assert(skin >= 0.0);
+
+  obj->skin = skin;
+  obj->stale = 1;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_skin
+ *
+ *****************************************************************************/
+
+int colloid_nlist_skin(colloid_nlist_t * obj, double * skin) {
+
+  assert(obj);
+  assert(skin);
+
+  *skin = obj->skin;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_range_set
+ *
+ *  Centre-centre range (excluding the skin).
+ *
+ *****************************************************************************/
+
+int colloid_nlist_range_set(colloid_nlist_t * obj, double range) {
+
+  assert(obj);
+  assert(range >= 0.0);
+
+  obj->range = range;
+  obj->stale = 1;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_range
+ *
+ *****************************************************************************/
+
+int colloid_nlist_range(colloid_nlist_t * obj, double * range) {
+
+  assert(obj);
+  assert(range);
+
+  *range = obj->range;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_npair
+ *
+ *****************************************************************************/
+
+int colloid_nlist_npair(colloid_nlist_t * obj, int * npair) {
+
+  assert(obj);
+  assert(npair);
+
+  *npair = obj->npair;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_pair
+ *
+ *****************************************************************************/
+
+int colloid_nlist_pair(colloid_nlist_t * obj, int n, colloid_t ** pc1,
+		       colloid_t ** pc2) {
+  assert(obj);
+  assert(0 <= n && n < obj->npair);
+  assert(pc1);
+  assert(pc2);
+
+  *pc1 = obj->pc1[n];
+  *pc2 = obj->pc2[n];
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_stats
+ *
+ *  Number of builds, and number of updates (steps), so far.
+ *
+ *****************************************************************************/
+
+int colloid_nlist_stats(colloid_nlist_t * obj, int * nbuild, int * nupdate) {
+
+  assert(obj);
+  assert(nbuild);
+  assert(nupdate);
+
+  *nbuild = obj->nbuild;
+  *nupdate = obj->nupdate;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_update
+ *
+ *  To be called (collectively) once the current positions and halo
+ *  copies are available, and before any pairs are examined.
+ *
+ *****************************************************************************/
+
+int colloid_nlist_update(colloid_nlist_t * obj, colloids_info_t * cinfo) {
+
+  int rebuild = 1;
+  int ntmp;
+  entry_t * tmp = NULL;
+
+  assert(obj);
+  assert(cinfo);
+
+  obj->nupdate += 1;
+
+  if (obj->skin > 0.0) {
+    colloid_nlist_entries(obj, cinfo);
+    colloid_nlist_rebuild_required(obj, &rebuild);
+  }
+
+  if (rebuild) {
+    TIMER_start(TIMER_PARTICLE_NLIST);
+    colloid_nlist_build(obj, cinfo);
+    TIMER_stop(TIMER_PARTICLE_NLIST);
+
+    /* The current state becomes the reference state */
+    tmp = obj->ref;
+    obj->ref = obj->current;
+    obj->current = tmp;
+    obj->nref = obj->ncurrent;
+    obj->ncurrent = 0;
+    ntmp = obj->nrefmax;
+    obj->nrefmax = obj->ncurrentmax;
+    obj->ncurrentmax = ntmp;
+
+    obj->stale = 0;
+    obj->nbuild += 1;
+  }
+  else {
+    colloid_nlist_resolve(obj);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_build
+ *
+ *  The cell list search, in the same order as the pair potentials
+ *  have always used.
+ *
+ *****************************************************************************/
+
+static int colloid_nlist_build(colloid_nlist_t * obj,
+			       colloids_info_t * cinfo) {
+
+  int ic1, jc1, kc1, ic2, jc2, kc2;
+  int di[2], dj[2], dk[2];
+  int ncell[3];
+  double rlist2;
+  double r12[3];
+
+  colloid_t * pc1 = NULL;
+  colloid_t * pc2 = NULL;
+
+  assert(obj);
+  assert(cinfo);
+
+  colloids_info_ncell(cinfo, ncell);
+
+  rlist2 = (obj->range + obj->skin)*(obj->range + obj->skin);
+
+  obj->nlist = 0;
+  obj->npair = 0;
+
+  for (ic1 = 1; ic1 <= ncell[X]; ic1++) {
+    colloids_info_climits(cinfo, X, ic1, di);
+    for (jc1 = 1; jc1 <= ncell[Y]; jc1++) {
+      colloids_info_climits(cinfo, Y, jc1, dj);
+      for (kc1 = 1; kc1 <= ncell[Z]; kc1++) {
+	colloids_info_climits(cinfo, Z, kc1, dk);
+
+	colloids_info_cell_list_head(cinfo, ic1, jc1, kc1, &pc1);
+	for (; pc1; pc1 = pc1->next) {
+
+	  for (ic2 = di[0]; ic2 <= di[1]; ic2++) {
+	    for (jc2 = dj[0]; jc2 <= dj[1]; jc2++) {
+	      for (kc2 = dk[0]; kc2 <= dk[1]; kc2++) {
+
+		colloids_info_cell_list_head(cinfo, ic2, jc2, kc2, &pc2);
+		for (; pc2; pc2 = pc2->next) {
+
+		  if (pc1->s.index >= pc2->s.index) continue;
+
+		  if (obj->skin > 0.0) {
+		    cs_minimum_distance(obj->cs, pc1->s.r, pc2->s.r, r12);
+		    if (dot_product(r12, r12) >= rlist2) continue;
+		  }
+
+		  colloid_nlist_append(obj, pc1, pc2);
+		}
+	      }
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_append
+ *
+ *****************************************************************************/
+
+static int colloid_nlist_append(colloid_nlist_t * obj, colloid_t * pc1,
+				colloid_t * pc2) {
+  int n;
+
+  assert(obj);
+  assert(pc1);
+  assert(pc2);
+
+  if (obj->nlist == obj->nlistmax) {
+    int nmax = imax(1024, 2*obj->nlistmax);
+
+    obj->index1 = (int *) realloc(obj->index1, nmax*sizeof(int));
+    obj->index2 = (int *) realloc(obj->index2, nmax*sizeof(int));
+    obj->pc1 = (colloid_t **) realloc(obj->pc1, nmax*sizeof(colloid_t *));
+    obj->pc2 = (colloid_t **) realloc(obj->pc2, nmax*sizeof(colloid_t *));
+
+    if (obj->index1 == NULL) pe_fatal(obj->pe, "realloc(index1) failed\n");
+    if (obj->index2 == NULL) pe_fatal(obj->pe, "realloc(index2) failed\n");
+    if (obj->pc1 == NULL) pe_fatal(obj->pe, "realloc(pc1) failed\n");
+    if (obj->pc2 == NULL) pe_fatal(obj->pe, "realloc(pc2) failed\n");
+
+    obj->nlistmax = nmax;
+  }
+
+  n = obj->nlist;
+  obj->index1[n] = pc1->s.index;
+  obj->index2[n] = pc2->s.index;
+  obj->pc1[n] = pc1;
+  obj->pc2[n] = pc2;
+
+  obj->nlist += 1;
+  obj->npair += 1;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_entries
+ *
+ *  Record index, position, and current pointer for all colloids
+ *  (including halo copies), sorted by index with a local copy first.
+ *
+ *****************************************************************************/
+
+static int colloid_nlist_entries(colloid_nlist_t * obj,
+				 colloids_info_t * cinfo) {
+  int ic, jc, kc;
+  int ncell[3];
+  int nhalo;
+  int islocal;
+  int n = 0;
+  colloid_t * pc = NULL;
+
+  assert(obj);
+  assert(cinfo);
+
+  colloids_info_ncell(cinfo, ncell);
+  colloids_info_nhalo(cinfo, &nhalo);
+
+  for (ic = 1 - nhalo; ic <= ncell[X] + nhalo; ic++) {
+    for (jc = 1 - nhalo; jc <= ncell[Y] + nhalo; jc++) {
+      for (kc = 1 - nhalo; kc <= ncell[Z] + nhalo; kc++) {
+
+	islocal = (ic >= 1 && ic <= ncell[X] && jc >= 1 && jc <= ncell[Y]
+		   && kc >= 1 && kc <= ncell[Z]);
+
+	colloids_info_cell_list_head(cinfo, ic, jc, kc, &pc);
+
+	for (; pc; pc = pc->next) {
+
+	  if (n == obj->ncurrentmax) {
+	    int nmax = imax(256, 2*obj->ncurrentmax);
+	    obj->current = (entry_t *) realloc(obj->current,
+					       nmax*sizeof(entry_t));
+	    if (obj->current == NULL) {
+	      pe_fatal(obj->pe, "realloc(colloid_nlist entries) failed\n");
+	    }
+	    obj->ncurrentmax = nmax;
+	  }
+
+	  obj->current[n].index = pc->s.index;
+	  obj->current[n].islocal = islocal;
+	  obj->current[n].r[X] = pc->s.r[X];
+	  obj->current[n].r[Y] = pc->s.r[Y];
+	  obj->current[n].r[Z] = pc->s.r[Z];
+	  obj->current[n].pc = pc;
+	  n += 1;
+	}
+      }
+    }
+  }
+
+  obj->ncurrent = n;
+  if (n > 0) qsort(obj->current, n, sizeof(entry_t), colloid_nlist_compare);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_rebuild_required
+ *
+ *  Global decision based on the maximum displacement of local
+ *  colloids since the last build, and any change of ownership.
+ *
+ *****************************************************************************/
+
+static int colloid_nlist_rebuild_required(colloid_nlist_t * obj,
+					  int * rebuild) {
+  int n;
+  int nlocal = 0;
+  int nlocalref = 0;
+  double dr[3];
+  double dlocal[2] = {0.0, 0.0};    /* Flag, maximum displacement */
+  double dglobal[2];
+  entry_t * pref = NULL;
+  MPI_Comm comm;
+
+  assert(obj);
+  assert(rebuild);
+
+  if (obj->stale) dlocal[0] = 1.0;
+
+  for (n = 0; n < obj->nref; n++) {
+    if (obj->ref[n].islocal) nlocalref += 1;
+  }
+
+  for (n = 0; n < obj->ncurrent; n++) {
+
+    if (obj->current[n].islocal == 0) continue;
+
+    nlocal += 1;
+    pref = colloid_nlist_find(obj->ref, obj->nref, obj->current[n].index);
+
+    if (pref == NULL || pref->islocal == 0) {
+      /* Colloid has arrived from elsewhere */
+      dlocal[0] = 1.0;
+    }
+    else {
+      cs_minimum_distance(obj->cs, pref->r, obj->current[n].r, dr);
+      dlocal[1] = dmax(dlocal[1], modulus(dr));
+    }
+  }
+
+  if (nlocal != nlocalref) dlocal[0] = 1.0;
+
+  cs_cart_comm(obj->cs, &comm);
+  MPI_Allreduce(dlocal, dglobal, 2, MPI_DOUBLE, MPI_MAX, comm);
+
+  *rebuild = (dglobal[0] > 0.0 || 2.0*dglobal[1] > obj->skin);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_resolve
+ *
+ *  Recover the current pointers for the pairs in the list. A second
+ *  colloid which is no longer present in the halo cannot be within
+ *  range, and the pair is omitted at this step.
+ *
+ *****************************************************************************/
+
+static int colloid_nlist_resolve(colloid_nlist_t * obj) {
+
+  int n;
+  entry_t * p1 = NULL;
+  entry_t * p2 = NULL;
+
+  assert(obj);
+
+  obj->npair = 0;
+
+  for (n = 0; n < obj->nlist; n++) {
+    p1 = colloid_nlist_find(obj->current, obj->ncurrent, obj->index1[n]);
+    p2 = colloid_nlist_find(obj->current, obj->ncurrent, obj->index2[n]);
+    assert(p1 && p1->islocal);
+    if (p1 == NULL || p2 == NULL) continue;
+    obj->pc1[obj->npair] = p1->pc;
+    obj->pc2[obj->npair] = p2->pc;
+    obj->npair += 1;
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_find
+ *
+ *  Return the first entry with the given index (the local copy if
+ *  present), or NULL if there is none.
+ *
+ *****************************************************************************/
+
+static entry_t * colloid_nlist_find(entry_t * entry, int n, int index) {
+
+  int lo = 0;
+  int hi = n;
+
+  /* First position with entry[].index >= index */
+
+  while (lo < hi) {
+    int mid = lo + (hi - lo)/2;
+    if (entry[mid].index < index) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+
+  if (lo < n && entry[lo].index == index) return entry + lo;
+
+  return NULL;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_nlist_compare
+ *
+ *  Ascending index; local copy before any halo copies.
+ *
+ *****************************************************************************/
+
+static int colloid_nlist_compare(const void * a, const void * b) {
+
+  const entry_t * ea = (const entry_t *) a;
+  const entry_t * eb = (const entry_t *) b;
+
+  if (ea->index != eb->index) return (ea->index < eb->index) ? -1 : +1;
+
+  return (eb->islocal - ea->islocal);
+}
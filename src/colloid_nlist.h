@@ -0,0 +1,37 @@
+/*****************************************************************************
+ *
+ *  colloid_nlist.h
+ *
+ *  Colloid-colloid neighbour (Verlet) list.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#ifndef LUDWIG_COLLOID_NLIST_H
+#define LUDWIG_COLLOID_NLIST_H
+
+#include "pe.h"
+#include "coords.h"
+#include "colloids.h"
+
+int colloid_nlist_create(pe_t * pe, cs_t * cs, colloid_nlist_t ** pobj);
+int colloid_nlist_free(colloid_nlist_t * obj);
+int colloid_nlist_info(colloid_nlist_t * obj);
+int colloid_nlist_skin_set(colloid_nlist_t * obj, double skin);
+int colloid_nlist_skin(colloid_nlist_t * obj, double * skin);
+int colloid_nlist_range_set(colloid_nlist_t * obj, double range);
+int colloid_nlist_range(colloid_nlist_t * obj, double * range);
+int colloid_nlist_update(colloid_nlist_t * obj, colloids_info_t * cinfo);
+int colloid_nlist_npair(colloid_nlist_t * obj, int * npair);
+int colloid_nlist_pair(colloid_nlist_t * obj, int n, colloid_t ** pc1,
+		       colloid_t ** pc2);
+int colloid_nlist_stats(colloid_nlist_t * obj, int * nbuild, int * nupdate);
+
+#endif
@@ -0,0 +1,268 @@
+/*****************************************************************************
+ *
+ *  colloid_site_table.c
+ *
+ *  Flat (structure-of-arrays) table of lattice sites touched by the
+ *  colloid map.
+ *
+ *  Storage grows as required, but is never reduced; the target copy
+ *  is only reallocated when the host copy is.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "colloid_site_table.h"
+
+static int colloid_site_table_target_alloc(colloid_site_table_t * table);
+static int colloid_site_table_target_free(colloid_site_table_t * table);
+
+/*****************************************************************************
+ *
+ *  colloid_site_table_create
+ *
+ *****************************************************************************/
+
+__host__ int colloid_site_table_create(pe_t * pe,
+				       colloid_site_table_t ** ptable) {
+  int ndevice;
+  colloid_site_table_t * table = NULL;
+
+  assert(pe);
+  assert(ptable);
+
+  table = (colloid_site_table_t *) calloc(1, sizeof(colloid_site_table_t));
+  assert(table);
+  if (table == NULL) pe_fatal(pe, "calloc(colloid_site_table_t) failed\n");
+
+  table->pe = pe;
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice == 0) {
+    table->target = table;
+  }
+  else {
+    tdpAssert(tdpMalloc((void **) &table->target,
+			sizeof(colloid_site_table_t)));
+    tdpAssert(tdpMemset(table->target, 0, sizeof(colloid_site_table_t)));
+  }
+
+  /* Avoid zero-sized allocations */
+  colloid_site_table_reserve(table, 1);
+
+  *ptable = table;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_site_table_free
+ *
+ *****************************************************************************/
+
+__host__ int colloid_site_table_free(colloid_site_table_t * table) {
+
+  assert(table);
+
+  if (table->target != table) {
+    colloid_site_table_target_free(table);
+    tdpAssert(tdpFree(table->target));
+  }
+
+  free(table->map_new);
+  free(table->colloid);
+  free(table->rb);
+  free(table->data);
+  free(table->status);
+  free(table->mask);
+  free(table->type);
+  free(table->index);
+  free(table);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_site_table_reserve
+ *
+ *  Ensure there is room for at least nsite sites. Existing contents
+ *  are not preserved if reallocation takes place.
+ *
+ *****************************************************************************/
+
+__host__ int colloid_site_table_reserve(colloid_site_table_t * table,
+					int nsite) {
+  int nmax;
+  pe_t * pe = NULL;
+
+  assert(table);
+
+  if (nsite <= table->nsitemax) return 0;
+
+  pe = table->pe;
+
+  if (table->target != table) colloid_site_table_target_free(table);
+
+  /* Allow some slack to avoid frequent reallocation */
+  table->nsitemax = nsite + nsite/4;
+  nmax = table->nsitemax;
+
+  free(table->index);
+  free(table->type);
+  free(table->mask);
+  free(table->status);
+  free(table->data);
+  free(table->rb);
+  free(table->colloid);
+  free(table->map_new);
+
+  table->index = (int *) calloc(nmax, sizeof(int));
+  table->type = (int *) calloc(nmax, sizeof(int));
+  table->mask = (int *) calloc(nmax, sizeof(int));
+  table->status = (char *) calloc(nmax, sizeof(char));
+  table->data = (double *) calloc(COLLOID_SITE_NDATA*nmax, sizeof(double));
+  table->rb = (double *) calloc(3*nmax, sizeof(double));
+  table->colloid = (struct colloid **) calloc(nmax, sizeof(struct colloid *));
+  table->map_new = (struct colloid **) calloc(nmax, sizeof(struct colloid *));
+
+  if (table->index == NULL) pe_fatal(pe, "calloc(table->index) failed\n");
+  if (table->type == NULL) pe_fatal(pe, "calloc(table->type) failed\n");
+  if (table->mask == NULL) pe_fatal(pe, "calloc(table->mask) failed\n");
+  if (table->status == NULL) pe_fatal(pe, "calloc(table->status) failed\n");
+  if (table->data == NULL) pe_fatal(pe, "calloc(table->data) failed\n");
+  if (table->rb == NULL) pe_fatal(pe, "calloc(table->rb) failed\n");
+  if (table->colloid == NULL) pe_fatal(pe, "calloc(table->colloid) failed\n");
+  if (table->map_new == NULL) pe_fatal(pe, "calloc(table->map_new) failed\n");
+
+  if (table->target != table) colloid_site_table_target_alloc(table);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_site_table_memcpy
+ *
+ *  Host to device only: the table is always filled on the host.
+ *
+ *****************************************************************************/
+
+__host__ int colloid_site_table_memcpy(colloid_site_table_t * table,
+				       tdpMemcpyKind flag) {
+  int ndevice;
+
+  assert(table);
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice == 0) {
+    assert(table->target == table);
+  }
+  else {
+    int nsite = table->nsite;
+    int nsitemax = table->nsitemax;
+    colloid_site_table_t tmp;
+
+    tdpAssert(tdpMemcpy(&tmp, table->target, sizeof(colloid_site_table_t),
+			tdpMemcpyDeviceToHost));
+
+    switch (flag) {
+    case tdpMemcpyHostToDevice:
+      tdpMemcpy(&table->target->nsite, &table->nsite, sizeof(int), flag);
+      tdpMemcpy(tmp.index, table->index, nsite*sizeof(int), flag);
+      tdpMemcpy(tmp.type, table->type, nsite*sizeof(int), flag);
+      tdpMemcpy(tmp.mask, table->mask, nsite*sizeof(int), flag);
+      tdpMemcpy(tmp.status, table->status, nsite*sizeof(char), flag);
+      tdpMemcpy(tmp.data, table->data,
+		COLLOID_SITE_NDATA*nsitemax*sizeof(double), flag);
+      tdpMemcpy(tmp.rb, table->rb, 3*nsitemax*sizeof(double), flag);
+      tdpMemcpy(tmp.colloid, table->colloid,
+		nsite*sizeof(struct colloid *), flag);
+      tdpMemcpy(tmp.map_new, table->map_new,
+		nsite*sizeof(struct colloid *), flag);
+      break;
+    default:
+      pe_fatal(table->pe, "Bad flag in colloid_site_table_memcpy\n");
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_site_table_target_alloc
+ *
+ *****************************************************************************/
+
+static int colloid_site_table_target_alloc(colloid_site_table_t * table) {
+
+  int nmax;
+  colloid_site_table_t tmp;
+
+  assert(table);
+  assert(table->target != table);
+
+  nmax = table->nsitemax;
+
+  tmp = *table;
+  tmp.target = NULL;
+  tmp.pe = NULL;
+
+  tdpAssert(tdpMalloc((void **) &tmp.index, nmax*sizeof(int)));
+  tdpAssert(tdpMalloc((void **) &tmp.type, nmax*sizeof(int)));
+  tdpAssert(tdpMalloc((void **) &tmp.mask, nmax*sizeof(int)));
+  tdpAssert(tdpMalloc((void **) &tmp.status, nmax*sizeof(char)));
+  tdpAssert(tdpMalloc((void **) &tmp.data,
+		      COLLOID_SITE_NDATA*nmax*sizeof(double)));
+  tdpAssert(tdpMalloc((void **) &tmp.rb, 3*nmax*sizeof(double)));
+  tdpAssert(tdpMalloc((void **) &tmp.colloid,
+		      nmax*sizeof(struct colloid *)));
+  tdpAssert(tdpMalloc((void **) &tmp.map_new,
+		      nmax*sizeof(struct colloid *)));
+
+  tdpAssert(tdpMemcpy(table->target, &tmp, sizeof(colloid_site_table_t),
+		      tdpMemcpyHostToDevice));
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloid_site_table_target_free
+ *
+ *****************************************************************************/
+
+static int colloid_site_table_target_free(colloid_site_table_t * table) {
+
+  colloid_site_table_t tmp;
+
+  assert(table);
+  assert(table->target != table);
+
+  tdpAssert(tdpMemcpy(&tmp, table->target, sizeof(colloid_site_table_t),
+		      tdpMemcpyDeviceToHost));
+
+  if (tmp.index) tdpFree(tmp.index);
+  if (tmp.type) tdpFree(tmp.type);
+  if (tmp.mask) tdpFree(tmp.mask);
+  if (tmp.status) tdpFree(tmp.status);
+  if (tmp.data) tdpFree(tmp.data);
+  if (tmp.rb) tdpFree(tmp.rb);
+  if (tmp.colloid) tdpFree(tmp.colloid);
+  if (tmp.map_new) tdpFree(tmp.map_new);
+
+  return 0;
+}
@@ -0,0 +1,69 @@
+/*****************************************************************************
+ *
+ *  colloid_site_table.h
+ *
+ *  A flat, structure-of-arrays, list of the lattice sites at which
+ *  the colloid map has changed at the current step: sites newly
+ *  covered, sites just vacated, and sites whose map data must be
+ *  refreshed. Each entry carries what the target needs to remove or
+ *  replace fluid at the site, and the new map values, so that neither
+ *  the distributions nor the map need be copied in full between host
+ *  and target when colloids move.
+ *
+ *  As for colloid_link_table_t, the implementation is exposed.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#ifndef LUDWIG_COLLOID_SITE_TABLE_H
+#define LUDWIG_COLLOID_SITE_TABLE_H
+
+#include "pe.h"
+
+/* Map data per site is at most two (see build_update_map()) */
+
+#define COLLOID_SITE_NDATA 2
+
+typedef enum colloid_site_enum {
+  COLLOID_SITE_MAP = 0,          /* Map update only */
+  COLLOID_SITE_REMOVE,           /* Fluid covered by colloid */
+  COLLOID_SITE_REPLACE,          /* Fluid exposed (interpolation) */
+  COLLOID_SITE_REPLACE_LOCAL     /* Fluid exposed (no fluid neighbours) */
+} colloid_site_enum_t;
+
+typedef struct colloid_site_table_s colloid_site_table_t;
+
+struct colloid_site_table_s {
+  pe_t * pe;                    /* Parallel environment */
+  int nsite;                    /* Number of sites in table */
+  int nsitemax;                 /* Allocated size */
+
+  int * index;                  /* Lattice site index */
+  int * type;                   /* colloid_site_enum_t */
+  int * mask;                   /* Replacement: bit p set if neighbour
+				 * index + c_p was fluid */
+  char * status;                /* New map status */
+  double * data;                /* data[addr_rank1(nsitemax, NDATA, n, i)] */
+  double * rb;                  /* rb[addr_rank1(nsitemax, 3, n, ia)] */
+
+  struct colloid ** colloid;    /* Colloid removing/replacing fluid */
+  struct colloid ** map_new;    /* New colloid map value at site */
+
+  colloid_site_table_t * target;  /* Target copy */
+};
+
+__host__ int colloid_site_table_create(pe_t * pe, colloid_site_table_t ** p);
+__host__ int colloid_site_table_free(colloid_site_table_t * table);
+__host__ int colloid_site_table_reserve(colloid_site_table_t * table,
+					int nsite);
+__host__ int colloid_site_table_memcpy(colloid_site_table_t * table,
+				       tdpMemcpyKind flag);
+
+#endif
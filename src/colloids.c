@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2018 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -25,6 +25,7 @@
 #include "util.h"
 #include "colloids.h"
 #include "colloids_s.h"
+#include "colloid_nlist.h"
 #define RHO_DEFAULT 1.0
 #define DRMAX_DEFAULT 0.8
 
@@ -87,6 +88,10 @@ __host__ int colloids_info_create(pe_t * pe, cs_t * cs, int ncell[3],
     tdpAssert(tdpMemset(obj->target, 0, sizeof(colloids_info_t)));
   }
 
+  colloid_link_table_create(pe, &obj->links);
+  colloid_site_table_create(pe, &obj->sites);
+  colloid_nlist_create(pe, cs, &obj->nlist);
+
   *pinfo = obj;
 
   return 0;
@@ -107,6 +112,11 @@ __host__ void colloids_info_free(colloids_info_t * info) {
   free(info->clist);
   if (info->map_old) free(info->map_old);
   if (info->map_new) free(info->map_new);
+  free(info->mapsite_old);
+  free(info->mapsite_new);
+  if (info->links) colloid_link_table_free(info->links);
+  if (info->sites) colloid_site_table_free(info->sites);
+  if (info->nlist) colloid_nlist_free(info->nlist);
 
   if (info->target != info) tdpAssert(tdpFree(info->target));
 
@@ -149,6 +159,20 @@ __host__ int colloids_info_recreate(int newcell[3], colloids_info_t ** pinfo) {
   colloids_info_ntotal_set(newinfo);
   assert(newinfo->ntotal == (*pinfo)->ntotal);
 
+  /* Retain the neighbour list settings */
+  {
+    colloid_nlist_t * tmp = newinfo->nlist;
+    double skin, range;
+
+    newinfo->nlist = oldinfo->nlist;
+    oldinfo->nlist = tmp;
+
+    colloid_nlist_skin(newinfo->nlist, &skin);
+    colloid_nlist_range(newinfo->nlist, &range);
+    colloid_nlist_skin_set(newinfo->nlist, skin);
+    colloid_nlist_range_set(newinfo->nlist, range);
+  }
+
   colloids_info_free(*pinfo);
   *pinfo = newinfo;
 
@@ -378,6 +402,60 @@ __host__ int colloids_info_map(colloids_info_t * info, int index, colloid_t ** p
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  colloids_info_link_table
+ *
+ *  The flat table of boundary links (filled by build_update_links()).
+ *
+ *****************************************************************************/
+
+__host__ int colloids_info_link_table(colloids_info_t * cinfo,
+				      colloid_link_table_t ** table) {
+  assert(cinfo);
+  assert(table);
+
+  *table = cinfo->links;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloids_info_site_table
+ *
+ *  The flat table of map sites (filled by build_remove_replace()).
+ *
+ *****************************************************************************/
+
+__host__ int colloids_info_site_table(colloids_info_t * cinfo,
+				      colloid_site_table_t ** table) {
+  assert(cinfo);
+  assert(table);
+
+  *table = cinfo->sites;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloids_info_nlist
+ *
+ *  The colloid-colloid neighbour list.
+ *
+ *****************************************************************************/
+
+__host__ int colloids_info_nlist(colloids_info_t * cinfo,
+				 colloid_nlist_t ** nlist) {
+  assert(cinfo);
+  assert(nlist);
+
+  *nlist = cinfo->nlist;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  colloids_info_map_old
@@ -401,7 +479,8 @@ __host__ int colloids_info_map_old(colloids_info_t * info, int index, colloid_t
  *
  *  colloids_info_map_set
  *
- *  Colloid pc may be NULL.
+ *  Colloid pc may be NULL. The site is recorded, so that the map can
+ *  be reset without a sweep of the whole lattice.
  *
  *****************************************************************************/
 
@@ -412,7 +491,16 @@ __host__ int colloids_info_map_set(colloids_info_t * cinfo, int index, colloid_t
   assert(index >= 0);
   assert(index < cinfo->nsites);
 
+  if (cinfo->nmap_new == cinfo->nmapmax_new) {
+    int nmax = 2*cinfo->nmapmax_new + 1;
+    int * tmp = (int *) realloc(cinfo->mapsite_new, nmax*sizeof(int));
+    if (tmp == NULL) pe_fatal(cinfo->pe, "realloc(mapsite_new) failed\n");
+    cinfo->mapsite_new = tmp;
+    cinfo->nmapmax_new = nmax;
+  }
+
   cinfo->map_new[index] = pc;
+  cinfo->mapsite_new[cinfo->nmap_new++] = index;
 
   return 0;
 }
@@ -421,23 +509,65 @@ __host__ int colloids_info_map_set(colloids_info_t * cinfo, int index, colloid_t
  *
  *  colloids_info_map_update
  *
+ *  The current map becomes the old map, and the new map is empty.
+ *  Only the sites recorded as set need be cleared.
+ *
  *****************************************************************************/
 
 __host__ int colloids_info_map_update(colloids_info_t * cinfo) {
 
   int n;
+  int ntmp;
+  int * stmp;
   colloid_t ** maptmp;
 
   assert(cinfo);
 
-  for (n = 0; n < cinfo->nsites; n++) {
-    cinfo->map_old[n] = NULL;
+  for (n = 0; n < cinfo->nmap_old; n++) {
+    cinfo->map_old[cinfo->mapsite_old[n]] = NULL;
   }
 
   maptmp = cinfo->map_old;
   cinfo->map_old = cinfo->map_new;
   cinfo->map_new = maptmp;
 
+  stmp = cinfo->mapsite_old;
+  cinfo->mapsite_old = cinfo->mapsite_new;
+  cinfo->mapsite_new = stmp;
+
+  ntmp = cinfo->nmapmax_old;
+  cinfo->nmapmax_old = cinfo->nmapmax_new;
+  cinfo->nmapmax_new = ntmp;
+
+  cinfo->nmap_old = cinfo->nmap_new;
+  cinfo->nmap_new = 0;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  colloids_info_map_sites
+ *
+ *  The lists of sites set in the old and new maps. A site may appear
+ *  more than once, and the order is that of painting.
+ *
+ *****************************************************************************/
+
+__host__ int colloids_info_map_sites(colloids_info_t * cinfo,
+				     int * nold, int ** sold,
+				     int * nnew, int ** snew) {
+  assert(cinfo);
+  assert(nold);
+  assert(sold);
+  assert(nnew);
+  assert(snew);
+
+  *nold = cinfo->nmap_old;
+  *sold = cinfo->mapsite_old;
+  *nnew = cinfo->nmap_new;
+  *snew = cinfo->mapsite_new;
+
   return 0;
 }
 
@@ -9,7 +9,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2017 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -22,6 +22,8 @@
 #include "coords.h"
 #include "colloid.h"
 #include "colloid_link.h"
+#include "colloid_link_table.h"
+#include "colloid_site_table.h"
 
 typedef struct colloid colloid_t;
 
@@ -62,6 +64,7 @@ struct colloid {
 };
 
 typedef struct colloids_info_s colloids_info_t;
+typedef struct colloid_nlist_s colloid_nlist_t;
 
 __host__ int colloids_info_create(pe_t * pe, cs_t * cs, int ncell[3],
 				  colloids_info_t ** pinfo);
@@ -78,7 +81,16 @@ __host__ int colloids_info_ntotal(colloids_info_t * info, int * ntotal);
 __host__ int colloids_info_nlocal(colloids_info_t * cinfo, int * nlocal);
 __host__ int colloids_info_ntotal_set(colloids_info_t * cinfo);
 __host__ int colloids_info_map(colloids_info_t * info, int index, colloid_t ** pc);
+__host__ int colloids_info_link_table(colloids_info_t * cinfo,
+				     colloid_link_table_t ** table);
+__host__ int colloids_info_site_table(colloids_info_t * cinfo,
+				     colloid_site_table_t ** table);
+__host__ int colloids_info_nlist(colloids_info_t * cinfo,
+				colloid_nlist_t ** nlist);
 __host__ int colloids_info_map_old(colloids_info_t * info, int index, colloid_t ** pc);
+__host__ int colloids_info_map_sites(colloids_info_t * cinfo,
+				     int * nold, int ** sold,
+				     int * nnew, int ** snew);
 __host__ int colloids_info_cell_index(colloids_info_t * cinfo, int ic, int jc, int kc);
 __host__ int colloids_info_insert_colloid(colloids_info_t * cinfo, colloid_t * coll);
 __host__ int colloids_info_cell_list_clean(colloids_info_t * cinfo);
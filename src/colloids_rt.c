@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2014-2017 The University of Edinburgh
+ *  (c) 2014-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -32,6 +32,7 @@
 #include "bond_fene.h"
 #include "angle_cosine.h"
 
+#include "colloid_nlist.h"
 #include "colloids_halo.h"
 #include "colloids_init.h"
 #include "colloid_io_rt.h"
@@ -59,6 +60,7 @@ int colloids_rt_init_random(pe_t * pe, cs_t * cs, rt_t * rt, wall_t * wall,
 int colloids_rt_state_stub(pe_t * pe, rt_t * rt, colloids_info_t * cinfo,
 			   const char * stub,
 			   colloid_state_t * state);
+int colloids_rt_verlet_skin(pe_t * pe, rt_t * rt, colloids_info_t * cinfo);
 int colloids_rt_cell_list_checks(pe_t * pe, cs_t * cs, colloids_info_t ** pinfo,
 				 interact_t * interact);
 
@@ -141,6 +143,7 @@ int colloids_init_rt(pe_t * pe, rt_t * rt, cs_t * cs, colloids_info_t ** pinfo,
   bond_fene_init(pe, cs, rt, *interact);
   angle_cosine_init(pe, cs, rt, *interact);
 
+  colloids_rt_verlet_skin(pe, rt, *pinfo);
   colloids_rt_cell_list_checks(pe, cs, pinfo, *interact);
   colloids_init_halo_range_check(pe, cs, *pinfo);
   if (nc > 1) interact_range_check(*interact, *pinfo);
@@ -511,6 +514,33 @@ int colloids_rt_gravity(pe_t * pe, rt_t * rt, colloids_info_t * cinfo) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  colloids_rt_verlet_skin
+ *
+ *  Optional skin for the colloid-colloid neighbour list. The default
+ *  (zero) means the cell list is searched afresh at every step.
+ *
+ *****************************************************************************/
+
+int colloids_rt_verlet_skin(pe_t * pe, rt_t * rt, colloids_info_t * cinfo) {
+
+  double skin = 0.0;
+  colloid_nlist_t * nlist = NULL;
+
+  assert(pe);
+  assert(rt);
+  assert(cinfo);
+
+  rt_double_parameter(rt, "colloid_verlet_skin", &skin);
+  if (skin < 0.0) pe_fatal(pe, "colloid_verlet_skin must be >= 0.0\n");
+
+  colloids_info_nlist(cinfo, &nlist);
+  colloid_nlist_skin_set(nlist, skin);
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  colloids_rt_cell_list_checks
@@ -534,7 +564,9 @@ int colloids_rt_cell_list_checks(pe_t * pe, cs_t * cs,
   double a0max, ahmax;  /* maximum radii */
   double rcmax, hcmax;  /* Interaction ranges */
   double rmax;          /* Maximum interaction range */
+  double skin;          /* Verlet list skin */
   double wcell[3];      /* Final cell widths */
+  colloid_nlist_t * nlist = NULL;
 
   assert(pe);
   assert(cs);
@@ -573,6 +605,13 @@ int colloids_rt_cell_list_checks(pe_t * pe, cs_t * cs,
     interact_rcmax(interact, &rcmax);
     interact_hcmax(interact, &hcmax);
     rmax = dmax(2.0*ahmax + hcmax, rcmax);
+
+    /* Any neighbour list requires the cells to include the skin */
+    colloids_info_nlist(*pinfo, &nlist);
+    colloid_nlist_skin(nlist, &skin);
+    colloid_nlist_range_set(nlist, rmax);
+    rmax += skin;
+
     rmax = dmax(rmax, 1.5); /* subgrid particles again */
     nbest[X] = (int) floor(1.0*nlocal[X] / rmax);
     nbest[Y] = (int) floor(1.0*nlocal[Y] / rmax);
@@ -595,6 +634,9 @@ int colloids_rt_cell_list_checks(pe_t * pe, cs_t * cs,
   pe_info(pe, "Final cell lengths:          %14.7e %14.7e %14.7e\n",
        wcell[X], wcell[Y], wcell[Z]);
 
+  colloids_info_nlist(*pinfo, &nlist);
+  colloid_nlist_info(nlist);
+
 
   return 0;
 }
@@ -614,6 +656,7 @@ int colloids_init_ewald_rt(pe_t * pe, rt_t * rt, cs_t * cs,
   int is_required = 0;
   double mu;               /* Dipole strength */
   double rc;               /* Real space cut off */
+  char method[BUFSIZ] = "direct";
 
   assert(cinfo);
 
@@ -631,6 +674,41 @@ int colloids_init_ewald_rt(pe_t * pe, rt_t * rt, cs_t * cs,
 
     ewald_create(pe, cs, mu, rc, cinfo, pewald);
     assert(*pewald);
+
+    /* Any neighbour list must also capture the real space sum */
+    {
+      double range;
+      colloid_nlist_t * nlist = NULL;
+
+      colloids_info_nlist(cinfo, &nlist);
+      colloid_nlist_range(nlist, &range);
+      colloid_nlist_range_set(nlist, dmax(range, rc));
+    }
+
+    /* Optional particle-mesh Fourier space sum; the mesh is tuned
+     * against the direct sum if not given explicitly. */
+
+    rt_string_parameter(rt, "ewald_method", method, BUFSIZ);
+
+    if (strcmp(method, "pme") == 0) {
+      int order = 6;
+      int ngrid[3];
+      double tol = 1.0e-03;
+
+      rt_int_parameter(rt, "ewald_pme_order", &order);
+
+      if (rt_int_parameter_vector(rt, "ewald_pme_grid", ngrid)) {
+	ewald_method_pme(*pewald, ngrid, order);
+      }
+      else {
+	rt_double_parameter(rt, "ewald_pme_tolerance", &tol);
+	ewald_tune(*pewald, tol);
+      }
+    }
+    else if (strcmp(method, "direct") != 0) {
+      pe_fatal(pe, "ewald_method must be direct or pme (got %s)\n", method);
+    }
+
     ewald_info(*pewald); 
   }
 
@@ -8,7 +8,7 @@
  *  Edinburgh Parallel Computing Centre
  *
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
- *  (c) 2012-2016 The University of Edinburgh
+ *  (c) 2012-2019 The University of Edinburgh
  *
  *****************************************************************************/
 
@@ -18,6 +18,8 @@
 #include "pe.h"
 #include "coords.h"
 #include "colloids.h"
+#include "colloid_link_table.h"
+#include "colloid_site_table.h"
 
 
 struct colloids_info_s {
@@ -34,8 +36,17 @@ struct colloids_info_s {
   colloid_t ** clist;         /* Cell list pointers */
   colloid_t ** map_old;       /* Map (previous time step) pointers */
   colloid_t ** map_new;       /* Map (current time step) pointers */
+  int nmap_old;               /* Number of entries set in map_old */
+  int nmap_new;               /* Number of entries set in map_new */
+  int nmapmax_old;            /* Allocated size of mapsite_old */
+  int nmapmax_new;            /* Allocated size of mapsite_new */
+  int * mapsite_old;          /* Site indices set in map_old */
+  int * mapsite_new;          /* Site indices set in map_new */
   colloid_t * headall;        /* All colloid list (incl. halo) head */
   colloid_t * headlocal;      /* Local list (excl. halo) head */
+  colloid_link_table_t * links; /* Flat table of boundary links */
+  colloid_site_table_t * sites; /* Flat table of map sites */
+  colloid_nlist_t * nlist;    /* Colloid-colloid neighbour list */
 
   pe_t * pe;                  /* Parallel environment */
   cs_t * cs;                  /* Coordinate system */
@@ -46,6 +46,10 @@ int lb_run_time(pe_t * pe, cs_t * cs, rt_t * rt, lb_t * lb) {
 
   int ndist;
   int nreduced;
+  int nprop;
+  int ndevice;
+  int noverlap;
+  int ndepth;
   int io_grid[3] = {1, 1, 1};
   char string[FILENAME_MAX];
   char memory = ' ';
@@ -66,6 +70,31 @@ int lb_run_time(pe_t * pe, cs_t * cs, rt_t * rt, lb_t * lb) {
   rt_string_parameter(rt,"reduced_halo", string, FILENAME_MAX);
   if (strcmp(string, "yes") == 0) nreduced = 1;
 
+  /* Propagation: "two_lattice" (default) or "aa" (fused, in place) */
+
+  nprop = LB_PROPAGATION_TWO_LATTICE;
+  strcpy(string, "two_lattice");
+  rt_string_parameter(rt, "lb_propagation_scheme", string, FILENAME_MAX);
+
+  if (strcmp(string, "aa") == 0) {
+    nprop = LB_PROPAGATION_AA;
+  }
+  else if (strcmp(string, "two_lattice") != 0) {
+    pe_fatal(pe, "lb_propagation_scheme must be two_lattice or aa\n");
+  }
+
+  /* Overlap lattice halo swap with collision at interior sites */
+
+  noverlap = 0;
+  strcpy(string, "no");
+  rt_string_parameter(rt, "lb_halo_overlap", string, FILENAME_MAX);
+  if (strcmp(string, "yes") == 0) noverlap = 1;
+
+  /* Communication-avoiding halo swap every ndepth steps */
+
+  ndepth = 1;
+  rt_int_parameter(rt, "lb_halo_depth", &ndepth);
+
   rt_int_parameter_vector(rt, "distribution_io_grid", io_grid);
 
   param.grid[X] = io_grid[X];
@@ -91,6 +120,39 @@ int lb_run_time(pe_t * pe, cs_t * cs, rt_t * rt, lb_t * lb) {
   pe_info(pe, "Number of sets:   %d\n", ndist);
   pe_info(pe, "Halo type:        %s\n", (nreduced == 1) ? "reduced" : "full");
 
+  if (nprop == LB_PROPAGATION_AA) {
+    pe_info(pe, "Propagation:      AA (fused with collision, in place)\n");
+    tdpGetDeviceCount(&ndevice);
+    if (ndist != 1) pe_fatal(pe, "AA propagation requires ndist = 1\n");
+    if (ndevice > 0) pe_fatal(pe, "AA propagation is not available on GPU\n");
+    lb_propagation_scheme_set(lb, LB_PROPAGATION_AA);
+  }
+
+  if (noverlap) {
+    pe_info(pe, "Halo overlap:     yes (interior collision)\n");
+    if (ndist != 1) pe_fatal(pe, "lb_halo_overlap requires ndist = 1\n");
+    if (nprop != LB_PROPAGATION_TWO_LATTICE) {
+      pe_fatal(pe, "lb_halo_overlap requires two_lattice propagation\n");
+    }
+    lb_halo_overlap_set(lb, 1);
+  }
+
+  if (ndepth != 1) {
+    pe_info(pe, "Halo depth:       %d (one swap every %d steps)\n",
+	    ndepth, ndepth);
+    if (ndist != 1) pe_fatal(pe, "lb_halo_depth requires ndist = 1\n");
+    if (nprop != LB_PROPAGATION_TWO_LATTICE) {
+      pe_fatal(pe, "lb_halo_depth requires two_lattice propagation\n");
+    }
+    if (noverlap) {
+      pe_fatal(pe, "lb_halo_depth is not available with lb_halo_overlap\n");
+    }
+    if (nreduced) {
+      pe_fatal(pe, "lb_halo_depth is not available with reduced_halo\n");
+    }
+    lb_halo_depth_set(lb, ndepth);
+  }
+
   if (strcmp("BINARY_SERIAL", string) == 0) {
     pe_info(pe, "Input format:     binary single serial file\n");
     io_info_set_processor_independent(io_info);
@@ -101,6 +163,11 @@ int lb_run_time(pe_t * pe, cs_t * cs, rt_t * rt, lb_t * lb) {
     pe_info(pe, "Input format:     ASCII\n");
     pe_info(pe, "Output format:    ASCII\n");
   }
+  else if (strcmp(string, "BINARY_MPIIO") == 0) {
+    form_out = IO_FORMAT_BINARY_MPIIO;
+    pe_info(pe, "Input format:     binary\n");
+    pe_info(pe, "Output format:    binary (MPI-IO)\n");
+  }
   else {
     pe_info(pe, "Input format:     binary\n");
     pe_info(pe, "Output format:    binary\n");
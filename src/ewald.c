@@ -7,10 +7,14 @@
  *
  *  See, for example, Allen and Tildesley, Computer Simulation of Liquids.
  *
+ *  The Fourier space part may optionally be computed by smooth
+ *  particle-mesh Ewald (see ewald_pme.c), with the mesh parameters
+ *  either given or tuned against the direct sum here.
+ *
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2007-2018 The University of Edinburgh.
+ *  (c) 2007-2019 The University of Edinburgh.
  *
  *  Contributing authors:
  *  Grace Kim
@@ -19,13 +23,16 @@
  *****************************************************************************/
 
 #include <assert.h>
+#include <float.h>
 #include <math.h>
 #include <stdlib.h>
 
 #include "pe.h"
 #include "coords.h"
 #include "colloids.h"
+#include "colloid_nlist.h"
 #include "ewald.h"
+#include "ewald_pme.h"
 #include "timer.h"
 #include "util.h"
 
@@ -51,11 +58,19 @@ struct ewald_s {
   pe_t * pe;                 /* Parallel environment */
   cs_t * cs;                 /* Coordinate system */
   colloids_info_t * cinfo;   /* Retain a reference to colloids_info_t */
+  ewald_pme_t * pme;         /* Particle-mesh Fourier space (if not NULL) */
 };
 
+static int ewald_kappa_set(ewald_t * ewald, double kappa, double kscale);
+static int ewald_fourier_space_direct(ewald_t * ewald);
+static int ewald_ft_local(ewald_t * ewald, double * ft, int get);
+static int ewald_pme_error(ewald_t * ewald, ewald_pme_t * pme,
+			   double eref, const double * ftref, double * err);
 static int ewald_sum_sin_cos_terms(ewald_t * ewald);
 static int ewald_get_number_fourier_terms(ewald_t * ewald);
 static int ewald_set_kr_table(ewald_t * ewlad, double []);
+static int ewald_real_space_pair(ewald_t * ewald, colloid_t * p_c1,
+				 colloid_t * p_c2);
 
 /*****************************************************************************
  *
@@ -71,8 +86,6 @@ static int ewald_set_kr_table(ewald_t * ewlad, double []);
 
 int ewald_create(pe_t * pe, cs_t * cs, double mu_input, double rc_input,
 		 colloids_info_t * cinfo, ewald_t ** pewald) {
-  int nk;
-  double ltot[3];
   PI_DOUBLE(pi);
   ewald_t * ewald = NULL;
 
@@ -89,17 +102,44 @@ int ewald_create(pe_t * pe, cs_t * cs, double mu_input, double rc_input,
   ewald->cs = cs;
   ewald->cinfo = cinfo;
 
-  cs_ltot(cs, ltot);
-
   /* Set constants */
 
   rpi_      = 1.0/sqrt(pi);
   mu_       = mu_input;
   ewald_rc_ = rc_input;
   ewald_on_ = 1;
-  kappa_    = 5.0/(2.0*ewald_rc_);
 
-  nk = ceil(kappa_*kappa_*ewald_rc_*ltot[X]/pi);
+  ewald_kappa_set(ewald, 5.0/(2.0*ewald_rc_), 1.0);
+
+  *pewald = ewald;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_kappa_set
+ *
+ *  Set kappa and the dependent Fourier space cut off and tables.
+ *  The usual cut off is extended by a factor kscale (>= 1).
+ *
+ *****************************************************************************/
+
+static int ewald_kappa_set(ewald_t * ewald, double kappa, double kscale) {
+
+  int nk;
+  double ltot[3];
+  pe_t * pe = NULL;
+  PI_DOUBLE(pi);
+
+  assert(ewald);
+
+  pe = ewald->pe;
+  cs_ltot(ewald->cs, ltot);
+
+  kappa_ = kappa;
+
+  nk = ceil(kscale*kappa_*kappa_*ewald_rc_*ltot[X]/pi);
 
   nk_[X] = nk;
   nk_[Y] = nk;
@@ -109,6 +149,11 @@ int ewald_create(pe_t * pe, cs_t * cs, double mu_input, double rc_input,
   nktot_ = ewald_get_number_fourier_terms(ewald);
   assert(nktot_ > 0);
 
+  free(sinx_);
+  free(cosx_);
+  free(sinkr_);
+  free(coskr_);
+
   sinx_ = (double *) malloc(nktot_*sizeof(double));
   cosx_ = (double *) malloc(nktot_*sizeof(double));
 
@@ -121,8 +166,6 @@ int ewald_create(pe_t * pe, cs_t * cs, double mu_input, double rc_input,
   if (sinkr_ == NULL) pe_fatal(pe, "Ewald sum malloc(sinx_) failed\n");
   if (coskr_ == NULL) pe_fatal(pe, "Ewald sum malloc(cosx_) failed\n");
 
-  *pewald = ewald;
-
   return 0;
 }
 
@@ -135,6 +178,7 @@ int ewald_create(pe_t * pe, cs_t * cs, double mu_input, double rc_input,
 int ewald_free(ewald_t * ewald) {
 
   assert(ewald);
+  if (ewald->pme) ewald_pme_free(ewald->pme);
   free(ewald);
 
   return 0;
@@ -166,7 +210,9 @@ int ewald_info(ewald_t * ewald) {
   pe_info(ewald->pe, "Self energy (constant):                  %14.7e\n", eself);
   pe_info(ewald->pe, "Maximum square wavevector:               %14.7e\n", kmax_);
   pe_info(ewald->pe, "Max. term retained in Fourier space sum:  %d\n", nkmax_);
-  pe_info(ewald->pe, "Total terms kept in Fourier space sum:    %d\n\n", nktot_);
+  pe_info(ewald->pe, "Total terms kept in Fourier space sum:    %d\n", nktot_);
+  if (ewald->pme) ewald_pme_info(ewald->pme);
+  pe_info(ewald->pe, "\n");
 
   return 0;
 }
@@ -502,6 +548,10 @@ int ewald_total_energy(ewald_t * ewald, double * ereal, double * efour,
  *  Look for interactions in real space and accumulate the force
  *  and torque on each particle involved.
  *
+ *  If a Verlet skin is set, the pairs come from the colloid neighbour
+ *  list (whose range includes the real space cut off); otherwise the
+ *  cell list is searched directly.
+ *
  *****************************************************************************/
 
 int ewald_real_space_sum(ewald_t * ewald) {
@@ -511,16 +561,33 @@ int ewald_real_space_sum(ewald_t * ewald) {
 
   int ic, jc, kc, id, jd, kd, dx, dy, dz;
   int ncell[3];
-
-  double r12[3];
+  double skin = 0.0;
+  colloid_nlist_t * nlist = NULL;
 
   TIMER_start(TIMER_EWALD_REAL_SPACE);
 
   assert(ewald);
   colloids_info_ncell(ewald->cinfo, ncell);
+  colloids_info_nlist(ewald->cinfo, &nlist);
+  colloid_nlist_skin(nlist, &skin);
 
   ereal_ = 0.0;
 
+  if (skin > 0.0) {
+    int n, npair;
+
+    colloid_nlist_npair(nlist, &npair);
+
+    for (n = 0; n < npair; n++) {
+      colloid_nlist_pair(nlist, n, &p_c1, &p_c2);
+      ewald_real_space_pair(ewald, p_c1, p_c2);
+    }
+
+    TIMER_stop(TIMER_EWALD_REAL_SPACE);
+
+    return 0;
+  }
+
   for (ic = 1; ic <= ncell[X]; ic++) {
     for (jc = 1; jc <= ncell[Y]; jc++) {
       for (kc = 1; kc <= ncell[Z]; kc++) {
@@ -541,88 +608,103 @@ int ewald_real_space_sum(ewald_t * ewald) {
 
 		while (p_c2) {
 		  if (p_c1->s.index < p_c2->s.index) {
-		    double r;
+		    ewald_real_space_pair(ewald, p_c1, p_c2);
+		  }
 
-		    /* Here we need r2-r1 */
+		  p_c2 = p_c2->next;
+		}
 
-		    cs_minimum_distance(ewald->cs, p_c2->s.r, p_c1->s.r, r12);
-		    r = sqrt(r12[X]*r12[X] + r12[Y]*r12[Y] + r12[Z]*r12[Z]);
+		/* Next cell */
+	      }
+	    }
+	  }
 
-		    if (r < ewald_rc_) {
-		      double rr = 1.0/r;
-		      double b, b1, b2, c, d;
-		      double udotu, u1dotr, u2dotr;
-		      double f[3], g[3];
-		      int i;
+	  p_c1 = p_c1->next;
+	}
 
-		      /* Energy */
-		      b1 = mu_*mu_*erfc(kappa_*r)*(rr*rr*rr);
-		      b2 = mu_*mu_*(2.0*kappa_*rpi_)
-			*exp(-kappa_*kappa_*r*r)*(rr*rr);
+	/* Next cell */
+      }
+    }
+  }
 
-		      b = b1 + b2;
-		      c = 3.0*b1*rr*rr + (2.0*kappa_*kappa_ + 3.0*rr*rr)*b2;
-		      d = 5.0*c/(r*r)
-			+ 4.0*kappa_*kappa_*kappa_*kappa_*b2;
+  TIMER_stop(TIMER_EWALD_REAL_SPACE);
 
-		      udotu  = dot_product(p_c1->s.s, p_c2->s.s);
-		      u1dotr = dot_product(p_c1->s.s, r12);
-		      u2dotr = dot_product(p_c2->s.s, r12);
+  return 0;
+}
 
-		      ereal_ += udotu*b - u1dotr*u2dotr*c;
+/*****************************************************************************
+ *
+ *  ewald_real_space_pair
+ *
+ *  Real space contribution to energy, force and torque for one pair.
+ *
+ *****************************************************************************/
 
-		      /* Force */
+static int ewald_real_space_pair(ewald_t * ewald, colloid_t * p_c1,
+				 colloid_t * p_c2) {
+  double r;
+  double r12[3];
 
-		      for (i = 0; i < 3; i++) {
-			f[i] = (udotu*c - u1dotr*u2dotr*d)*r12[i]
-			  + c*(u2dotr*p_c1->s.s[i] + u1dotr*p_c2->s.s[i]);
-		      }
+  /* Here we need r2-r1 */
 
-		      for (i = 0; i < 3; i++) {
-			p_c1->force[i] += f[i];
-			p_c2->force[i] -= f[i];
-		      }
+  cs_minimum_distance(ewald->cs, p_c2->s.r, p_c1->s.r, r12);
+  r = sqrt(r12[X]*r12[X] + r12[Y]*r12[Y] + r12[Z]*r12[Z]);
 
-		      /* Torque on particle 1 */
+  if (r < ewald_rc_) {
+    double rr = 1.0/r;
+    double b, b1, b2, c, d;
+    double udotu, u1dotr, u2dotr;
+    double f[3], g[3];
+    int i;
 
-		      g[X] = b*p_c2->s.s[X] - c*u2dotr*r12[X];
-		      g[Y] = b*p_c2->s.s[Y] - c*u2dotr*r12[Y];
-		      g[Z] = b*p_c2->s.s[Z] - c*u2dotr*r12[Z];
+    /* Energy */
+    b1 = mu_*mu_*erfc(kappa_*r)*(rr*rr*rr);
+    b2 = mu_*mu_*(2.0*kappa_*rpi_)
+      *exp(-kappa_*kappa_*r*r)*(rr*rr);
 
-		      p_c1->torque[X] += -(p_c1->s.s[Y]*g[Z] - p_c1->s.s[Z]*g[Y]);
-		      p_c1->torque[Y] += -(p_c1->s.s[Z]*g[X] - p_c1->s.s[X]*g[Z]);
-		      p_c1->torque[Z] += -(p_c1->s.s[X]*g[Y] - p_c1->s.s[Y]*g[X]);
+    b = b1 + b2;
+    c = 3.0*b1*rr*rr + (2.0*kappa_*kappa_ + 3.0*rr*rr)*b2;
+    d = 5.0*c/(r*r)
+      + 4.0*kappa_*kappa_*kappa_*kappa_*b2;
 
-		      /* Torque on particle 2 */
+    udotu  = dot_product(p_c1->s.s, p_c2->s.s);
+    u1dotr = dot_product(p_c1->s.s, r12);
+    u2dotr = dot_product(p_c2->s.s, r12);
 
-		      g[X] = b*p_c1->s.s[X] - c*u1dotr*r12[X];
-		      g[Y] = b*p_c1->s.s[Y] - c*u1dotr*r12[Y];
-		      g[Z] = b*p_c1->s.s[Z] - c*u1dotr*r12[Z];
+    ereal_ += udotu*b - u1dotr*u2dotr*c;
 
-		      p_c2->torque[X] += -(p_c2->s.s[Y]*g[Z] - p_c2->s.s[Z]*g[Y]);
-		      p_c2->torque[Y] += -(p_c2->s.s[Z]*g[X] - p_c2->s.s[X]*g[Z]);
-		      p_c2->torque[Z] += -(p_c2->s.s[X]*g[Y] - p_c2->s.s[Y]*g[X]);
-		    }
- 
-		  }
+    /* Force */
 
-		  p_c2 = p_c2->next;
-		}
+    for (i = 0; i < 3; i++) {
+      f[i] = (udotu*c - u1dotr*u2dotr*d)*r12[i]
+	+ c*(u2dotr*p_c1->s.s[i] + u1dotr*p_c2->s.s[i]);
+    }
 
-		/* Next cell */
-	      }
-	    }
-	  }
+    for (i = 0; i < 3; i++) {
+      p_c1->force[i] += f[i];
+      p_c2->force[i] -= f[i];
+    }
 
-	  p_c1 = p_c1->next;
-	}
+    /* Torque on particle 1 */
 
-	/* Next cell */
-      }
-    }
-  }
+    g[X] = b*p_c2->s.s[X] - c*u2dotr*r12[X];
+    g[Y] = b*p_c2->s.s[Y] - c*u2dotr*r12[Y];
+    g[Z] = b*p_c2->s.s[Z] - c*u2dotr*r12[Z];
 
-  TIMER_stop(TIMER_EWALD_REAL_SPACE);
+    p_c1->torque[X] += -(p_c1->s.s[Y]*g[Z] - p_c1->s.s[Z]*g[Y]);
+    p_c1->torque[Y] += -(p_c1->s.s[Z]*g[X] - p_c1->s.s[X]*g[Z]);
+    p_c1->torque[Z] += -(p_c1->s.s[X]*g[Y] - p_c1->s.s[Y]*g[X]);
+
+    /* Torque on particle 2 */
+
+    g[X] = b*p_c1->s.s[X] - c*u1dotr*r12[X];
+    g[Y] = b*p_c1->s.s[Y] - c*u1dotr*r12[Y];
+    g[Z] = b*p_c1->s.s[Z] - c*u1dotr*r12[Z];
+
+    p_c2->torque[X] += -(p_c2->s.s[Y]*g[Z] - p_c2->s.s[Z]*g[Y]);
+    p_c2->torque[Y] += -(p_c2->s.s[Z]*g[X] - p_c2->s.s[X]*g[Z]);
+    p_c2->torque[Z] += -(p_c2->s.s[X]*g[Y] - p_c2->s.s[Y]*g[X]);
+  }
 
   return 0;
 }
@@ -638,6 +720,313 @@ int ewald_real_space_sum(ewald_t * ewald) {
 
 int ewald_fourier_space_sum(ewald_t * ewald) {
 
+  assert(ewald);
+
+  TIMER_start(TIMER_EWALD_FOURIER_SPACE);
+
+  if (ewald->pme) {
+    ewald_pme_fourier_space_sum(ewald->pme, ewald->cinfo, mu_, kappa_,
+				&efourier_);
+  }
+  else {
+    ewald_fourier_space_direct(ewald);
+  }
+
+  TIMER_stop(TIMER_EWALD_FOURIER_SPACE);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_method_pme
+ *
+ *  Use smooth particle-mesh Ewald for the Fourier space part with
+ *  the given mesh and B-spline order.
+ *
+ *****************************************************************************/
+
+int ewald_method_pme(ewald_t * ewald, const int ngrid[3], int order) {
+
+  assert(ewald);
+
+  if (ewald->pme) ewald_pme_free(ewald->pme);
+  ewald_pme_create(ewald->pe, ewald->cs, ngrid, order, &ewald->pme);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_tune
+ *
+ *  Choose kappa, the PME mesh and the B-spline order for the current
+ *  configuration to meet a relative accuracy tol, and switch to PME.
+ *
+ *  kappa is increased from the default 5/(2 rc) only if the real space
+ *  truncation estimate exp(-kappa^2 rc^2) exceeds tol. For each order,
+ *  the coarsest mesh whose energy, force and torque agree with the
+ *  direct Fourier space sum to within tol is timed, and the fastest
+ *  of these retained. The forces and torques on entry are preserved.
+ *
+ *****************************************************************************/
+
+int ewald_tune(ewald_t * ewald, double tol) {
+
+  int ia, n;
+  int nlocal;
+  int order;
+  int ngrid[3];
+  int nbest[3] = {0, 0, 0};
+  int pbest = 0;
+  int measure = 1;
+  double kappa;
+  double ltot[3], lmax;
+  double eref;
+  double err, errbest = DBL_MAX;
+  double tbest = DBL_MAX;
+  double ftmax_local = 0.0;
+  double ftmax;
+  double * ftsave = NULL;
+  double * ftref = NULL;
+  MPI_Comm comm;
+
+  const int nrepeat = 3;
+  const int nmeshmax = 128;
+
+  assert(ewald);
+  assert(tol > 0.0);
+
+  cs_ltot(ewald->cs, ltot);
+  cs_cart_comm(ewald->cs, &comm);
+  lmax = dmax(ltot[X], dmax(ltot[Y], ltot[Z]));
+
+  kappa = dmax(5.0/(2.0*ewald_rc_), sqrt(-log(tol))/ewald_rc_);
+
+  /* Reference: direct sum with an extended cut off, so that its own
+   * truncation error is well below tol */
+
+  ewald_kappa_set(ewald, kappa, 1.5);
+
+  nlocal = ewald_ft_local(ewald, NULL, 1);
+  ftsave = (double *) calloc(6*nlocal + 1, sizeof(double));
+  ftref = (double *) calloc(6*nlocal + 1, sizeof(double));
+  if (ftsave == NULL) pe_fatal(ewald->pe, "calloc(ftsave) failed\n");
+  if (ftref == NULL) pe_fatal(ewald->pe, "calloc(ftref) failed\n");
+
+  ewald_ft_local(ewald, ftsave, 1);
+  ewald_ft_local(ewald, NULL, 0);
+  ewald_fourier_space_direct(ewald);
+  ewald_fourier_space_energy(ewald, &eref);
+  ewald_ft_local(ewald, ftref, 1);
+  ewald_kappa_set(ewald, kappa, 1.0);
+
+  /* If there is nothing to measure (e.g., all dipoles zero), resolve
+   * all the wavevectors retained in the direct sum at order 6. */
+
+  for (n = 0; n < 6*nlocal; n++) {
+    ftmax_local = dmax(ftmax_local, fabs(ftref[n]));
+  }
+  MPI_Allreduce(&ftmax_local, &ftmax, 1, MPI_DOUBLE, MPI_MAX, comm);
+
+  if (eref == 0.0 && ftmax == 0.0) {
+    measure = 0;
+    pbest = 6;
+    errbest = 0.0;
+    for (ia = 0; ia < 3; ia++) {
+      nbest[ia] = 1;
+      while (nbest[ia] < imax(pbest, 2*nk_[ia] + 1)) nbest[ia] *= 2;
+    }
+  }
+
+  for (order = EWALD_PME_ORDER_MIN; order <= EWALD_PME_ORDER_MAX && measure;
+       order += 2) {
+
+    int nmesh;
+
+    for (nmesh = 8; nmesh <= nmeshmax; nmesh *= 2) {
+
+      ewald_pme_t * pme = NULL;
+
+      /* Similar mesh spacing in each direction */
+      for (ia = 0; ia < 3; ia++) {
+	ngrid[ia] = 1;
+	while (ngrid[ia] < imax(order, nmesh*ltot[ia]/lmax)) ngrid[ia] *= 2;
+      }
+
+      ewald_pme_create(ewald->pe, ewald->cs, ngrid, order, &pme);
+      ewald_pme_error(ewald, pme, eref, ftref, &err);
+
+      if (err <= tol) {
+	double t0, t1, ef;
+	t0 = MPI_Wtime();
+	for (n = 0; n < nrepeat; n++) {
+	  ewald_pme_fourier_space_sum(pme, ewald->cinfo, mu_, kappa_, &ef);
+	}
+	t1 = (MPI_Wtime() - t0)/nrepeat;
+	MPI_Allreduce(&t1, &t0, 1, MPI_DOUBLE, MPI_MAX, comm);
+
+	if (t0 < tbest || errbest > tol) {
+	  tbest = t0;
+	  errbest = err;
+	  pbest = order;
+	  for (ia = 0; ia < 3; ia++) nbest[ia] = ngrid[ia];
+	}
+      }
+      else if (errbest > tol && err < errbest) {
+	errbest = err;
+	pbest = order;
+	for (ia = 0; ia < 3; ia++) nbest[ia] = ngrid[ia];
+      }
+
+      ewald_pme_free(pme);
+      if (err <= tol) break;
+    }
+  }
+
+  ewald_ft_local(ewald, ftsave, 0);
+  ewald_method_pme(ewald, nbest, pbest);
+
+  pe_info(ewald->pe, "\n");
+  pe_info(ewald->pe, "PME tuning\n");
+  pe_info(ewald->pe, "----------\n");
+  pe_info(ewald->pe, "Target relative accuracy:                %14.7e\n", tol);
+  pe_info(ewald->pe, "Ewald parameter kappa:                   %14.7e\n", kappa_);
+  pe_info(ewald->pe, "Selected mesh:                            %d %d %d\n",
+	  nbest[X], nbest[Y], nbest[Z]);
+  pe_info(ewald->pe, "Selected B-spline order:                  %d\n", pbest);
+  pe_info(ewald->pe, "Error against direct sum:                %14.7e\n",
+	  errbest);
+  if (measure == 0) {
+    pe_info(ewald->pe, "(No dipole interactions: mesh set from kappa)\n");
+  }
+  if (errbest > tol) {
+    pe_info(ewald->pe, "Warning: target accuracy not reached\n");
+  }
+
+  free(ftref);
+  free(ftsave);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_error
+ *
+ *  Relative difference between the PME and reference (direct) Fourier
+ *  space energy, forces and torques. The largest of the three measures
+ *  (the force and torque as rms over all particles) is returned.
+ *  The forces and torques are left zero on exit.
+ *
+ *****************************************************************************/
+
+static int ewald_pme_error(ewald_t * ewald, ewald_pme_t * pme,
+			   double eref, const double * ftref, double * err) {
+
+  int n, nlocal;
+  double e;
+  double * ft = NULL;
+  double sum_local[4] = {0.0, 0.0, 0.0, 0.0};
+  double sum[4];
+  MPI_Comm comm;
+
+  assert(ewald);
+  assert(pme);
+  assert(ftref);
+  assert(err);
+
+  cs_cart_comm(ewald->cs, &comm);
+  nlocal = ewald_ft_local(ewald, NULL, 1);
+  ft = (double *) calloc(6*nlocal + 1, sizeof(double));
+  if (ft == NULL) pe_fatal(ewald->pe, "calloc(ft) failed\n");
+
+  ewald_ft_local(ewald, NULL, 0);
+  ewald_pme_fourier_space_sum(pme, ewald->cinfo, mu_, kappa_, &e);
+  ewald_ft_local(ewald, ft, 1);
+  ewald_ft_local(ewald, NULL, 0);
+
+  for (n = 0; n < 6*nlocal; n++) {
+    double d = ft[n] - ftref[n];
+    int it = (n % 6)/3;             /* 0 force, 1 torque */
+    sum_local[2*it    ] += d*d;
+    sum_local[2*it + 1] += ftref[n]*ftref[n];
+  }
+
+  MPI_Allreduce(sum_local, sum, 4, MPI_DOUBLE, MPI_SUM, comm);
+
+  *err = fabs(e - eref)/dmax(fabs(eref), DBL_MIN);
+  if (sum[1] > 0.0) *err = dmax(*err, sqrt(sum[0]/sum[1]));
+  if (sum[3] > 0.0) *err = dmax(*err, sqrt(sum[2]/sum[3]));
+
+  free(ft);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_ft_local
+ *
+ *  Copy force and torque of local particles to (get) or from ft[6*n],
+ *  in cell list order. If ft is NULL, get returns the number of local
+ *  particles and !get zeros the forces and torques.
+ *
+ *****************************************************************************/
+
+static int ewald_ft_local(ewald_t * ewald, double * ft, int get) {
+
+  int ic, jc, kc;
+  int ia;
+  int n = 0;
+  int ncell[3];
+
+  assert(ewald);
+
+  colloids_info_ncell(ewald->cinfo, ncell);
+
+  for (ic = 1; ic <= ncell[X]; ic++) {
+    for (jc = 1; jc <= ncell[Y]; jc++) {
+      for (kc = 1; kc <= ncell[Z]; kc++) {
+
+	colloid_t * pc = NULL;
+
+	colloids_info_cell_list_head(ewald->cinfo, ic, jc, kc, &pc);
+
+	for ( ; pc; pc = pc->next) {
+	  for (ia = 0; ia < 3; ia++) {
+	    if (ft == NULL) {
+	      if (get == 0) pc->force[ia] = 0.0;
+	      if (get == 0) pc->torque[ia] = 0.0;
+	    }
+	    else if (get) {
+	      ft[6*n + ia] = pc->force[ia];
+	      ft[6*n + 3 + ia] = pc->torque[ia];
+	    }
+	    else {
+	      pc->force[ia] = ft[6*n + ia];
+	      pc->torque[ia] = ft[6*n + 3 + ia];
+	    }
+	  }
+	  n += 1;
+	}
+      }
+    }
+  }
+
+  return n;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_fourier_space_direct
+ *
+ *  Direct summation over wavevectors.
+ *
+ *****************************************************************************/
+
+static int ewald_fourier_space_direct(ewald_t * ewald) {
+
   double k[3], ksq;
   double b0, b;
   double fkx, fky, fkz;
@@ -649,8 +1038,6 @@ int ewald_fourier_space_sum(ewald_t * ewald) {
   int ncell[3];
   PI_DOUBLE(pi);
 
-  TIMER_start(TIMER_EWALD_FOURIER_SPACE);
-
   assert(ewald);
 
   cs_ltot(ewald->cs, ltot);
@@ -758,8 +1145,6 @@ int ewald_fourier_space_sum(ewald_t * ewald) {
     }
   }
 
-  TIMER_stop(TIMER_EWALD_FOURIER_SPACE);
-
   return 0;
 }
 
@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2017 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -32,6 +32,8 @@ int ewald_kappa(ewald_t * ewald, double * kappa);
 int ewald_sum(ewald_t * ewald);
 int ewald_real_space_sum(ewald_t * ewald);
 int ewald_fourier_space_sum(ewald_t * ewald);
+int ewald_method_pme(ewald_t * ewald, const int ngrid[3], int order);
+int ewald_tune(ewald_t * ewald, double tol);
 
 int ewald_total_energy(ewald_t * ewald, double * ereal, double * efourier,
 		       double * eself);
@@ -0,0 +1,898 @@
+/*****************************************************************************
+ *
+ *  ewald_pme.c
+ *
+ *  Smooth particle-mesh Ewald (SPME) for the Fourier space part of
+ *  the dipolar Ewald sum.
+ *
+ *  Each dipole is spread to a regular mesh using cardinal B-splines
+ *  of order p (the charge density of a point dipole is -mu.grad of
+ *  a delta function, so the mesh "charge" is the derivative of the
+ *  usual SPME weight). The mesh is convolved with the Ewald kernel
+ *  via FFT and the resulting potential interpolated back to give
+ *  the energy, force and torque on each particle.
+ *
+ *  See U. Essmann et al., J. Chem. Phys. 103, 8577 (1995) for the
+ *  method in the case of charges.
+ *
+ *  Each rank spreads its own particles; the mesh is then reduced and
+ *  the FFT is distributed as slabs (in x, then in y after a transpose)
+ *  over the Cartesian communicator. This requires that the number of
+ *  ranks divides both the x and y mesh sizes; otherwise every rank
+ *  performs the (small) FFT redundantly. Mesh sizes must be powers
+ *  of two for the radix-2 FFT.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ewald_pme.h"
+#include "util.h"
+
+struct ewald_pme_s {
+  pe_t * pe;                /* Parallel environment */
+  cs_t * cs;                /* Coordinate system */
+  MPI_Comm comm;            /* Communicator for the FFT */
+  int nrank;                /* Number of ranks sharing the FFT */
+  int rank;                 /* Rank in FFT communicator */
+  int order;                /* B-spline order p */
+  int ngrid[3];             /* Mesh size (powers of two) */
+  int nslab[2];             /* Local x-slab and y-slab extents */
+  int nmesh;                /* Total mesh points */
+  double kappa;             /* Ewald kappa for which gb is current */
+  double * qlocal;          /* Local contribution to mesh charge */
+  double * q;               /* Mesh charge (all ranks) */
+  double * phi;             /* Mesh potential (all ranks) */
+  double * a;               /* x-slab (complex) */
+  double * b;               /* y-slab (complex) */
+  double * buf;             /* Transpose buffer (complex) */
+  double * gb;              /* Influence function G(k)B(k) on y-slab */
+  double * bsp[3];          /* |b(k)|^2 in each direction */
+  double * tw[3];           /* FFT twiddle factors in each direction */
+  double * work;            /* FFT line buffer */
+};
+
+static int ewald_pme_bspline(int p, double w, double * m, double * dm,
+			     double * d2m);
+static int ewald_pme_bsp_mod(ewald_pme_t * pme);
+static int ewald_pme_influence(ewald_pme_t * pme, double kappa);
+static int ewald_pme_spread(ewald_pme_t * pme, colloids_info_t * cinfo,
+			    double mu);
+static int ewald_pme_convolve(ewald_pme_t * pme);
+static int ewald_pme_interpolate(ewald_pme_t * pme, colloids_info_t * cinfo,
+				 double mu);
+static int ewald_pme_transpose(ewald_pme_t * pme, int forward);
+static int ewald_pme_fft_lines(ewald_pme_t * pme, int id, double * z,
+			       int stride, int n1, int s1, int n2, int s2,
+			       int sign);
+static int ewald_pme_fft(int n, const double * tw, double * z, int sign);
+
+/*****************************************************************************
+ *
+ *  ewald_pme_create
+ *
+ *  ngrid[] must be powers of two, and order in the range
+ *  EWALD_PME_ORDER_MIN to EWALD_PME_ORDER_MAX.
+ *
+ *****************************************************************************/
+
+int ewald_pme_create(pe_t * pe, cs_t * cs, const int ngrid[3], int order,
+		     ewald_pme_t ** ppme) {
+
+  int ia, k;
+  int nlocal;
+  int nrank;
+  MPI_Comm comm;
+  PI_DOUBLE(pi);
+  ewald_pme_t * pme = NULL;
+
+  assert(pe);
+  assert(cs);
+  assert(ppme);
+
+  if (order < EWALD_PME_ORDER_MIN || order > EWALD_PME_ORDER_MAX) {
+    pe_fatal(pe, "PME B-spline order must be %d-%d (got %d)\n",
+	     EWALD_PME_ORDER_MIN, EWALD_PME_ORDER_MAX, order);
+  }
+
+  for (ia = 0; ia < 3; ia++) {
+    if (ngrid[ia] < order || (ngrid[ia] & (ngrid[ia] - 1))) {
+      pe_fatal(pe, "PME grid must be a power of two not less than the "
+	       "spline order (got %d)\n", ngrid[ia]);
+    }
+  }
+
+  pme = (ewald_pme_t *) calloc(1, sizeof(ewald_pme_t));
+  assert(pme);
+  if (pme == NULL) pe_fatal(pe, "calloc(ewald_pme_t) failed\n");
+
+  pme->pe = pe;
+  pme->cs = cs;
+  pme->order = order;
+  pme->kappa = 0.0;
+
+  for (ia = 0; ia < 3; ia++) {
+    pme->ngrid[ia] = ngrid[ia];
+  }
+
+  /* Slabs over the Cartesian communicator if they fit, else replicate. */
+
+  cs_cart_comm(cs, &comm);
+  MPI_Comm_size(comm, &nrank);
+
+  if (ngrid[X] % nrank == 0 && ngrid[Y] % nrank == 0) {
+    pme->comm = comm;
+  }
+  else {
+    pme->comm = MPI_COMM_SELF;
+  }
+
+  MPI_Comm_size(pme->comm, &pme->nrank);
+  MPI_Comm_rank(pme->comm, &pme->rank);
+
+  pme->nslab[X] = ngrid[X]/pme->nrank;
+  pme->nslab[Y] = ngrid[Y]/pme->nrank;
+  pme->nmesh = ngrid[X]*ngrid[Y]*ngrid[Z];
+
+  nlocal = pme->nslab[X]*ngrid[Y]*ngrid[Z];
+  assert(nlocal == ngrid[X]*pme->nslab[Y]*ngrid[Z]);
+
+  pme->qlocal = (double *) calloc(pme->nmesh, sizeof(double));
+  pme->q = (double *) calloc(pme->nmesh, sizeof(double));
+  pme->phi = (double *) calloc(pme->nmesh, sizeof(double));
+  pme->a = (double *) calloc(2*nlocal, sizeof(double));
+  pme->b = (double *) calloc(2*nlocal, sizeof(double));
+  pme->buf = (double *) calloc(2*nlocal, sizeof(double));
+  pme->gb = (double *) calloc(nlocal, sizeof(double));
+
+  if (pme->qlocal == NULL) pe_fatal(pe, "calloc(pme->qlocal) failed\n");
+  if (pme->q == NULL) pe_fatal(pe, "calloc(pme->q) failed\n");
+  if (pme->phi == NULL) pe_fatal(pe, "calloc(pme->phi) failed\n");
+  if (pme->a == NULL) pe_fatal(pe, "calloc(pme->a) failed\n");
+  if (pme->b == NULL) pe_fatal(pe, "calloc(pme->b) failed\n");
+  if (pme->buf == NULL) pe_fatal(pe, "calloc(pme->buf) failed\n");
+  if (pme->gb == NULL) pe_fatal(pe, "calloc(pme->gb) failed\n");
+
+  for (ia = 0; ia < 3; ia++) {
+    pme->bsp[ia] = (double *) calloc(ngrid[ia], sizeof(double));
+    pme->tw[ia] = (double *) calloc(ngrid[ia], sizeof(double));
+    if (pme->bsp[ia] == NULL) pe_fatal(pe, "calloc(pme->bsp) failed\n");
+    if (pme->tw[ia] == NULL) pe_fatal(pe, "calloc(pme->tw) failed\n");
+
+    /* tw[k] = exp(-2 pi i k/n) for k < n/2 */
+    for (k = 0; k < ngrid[ia]/2; k++) {
+      pme->tw[ia][2*k    ] =  cos(2.0*pi*k/ngrid[ia]);
+      pme->tw[ia][2*k + 1] = -sin(2.0*pi*k/ngrid[ia]);
+    }
+  }
+
+  k = imax(ngrid[X], imax(ngrid[Y], ngrid[Z]));
+  pme->work = (double *) calloc(2*k, sizeof(double));
+  if (pme->work == NULL) pe_fatal(pe, "calloc(pme->work) failed\n");
+
+  ewald_pme_bsp_mod(pme);
+
+  *ppme = pme;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_free
+ *
+ *****************************************************************************/
+
+int ewald_pme_free(ewald_pme_t * pme) {
+
+  int ia;
+
+  assert(pme);
+
+  for (ia = 0; ia < 3; ia++) {
+    free(pme->tw[ia]);
+    free(pme->bsp[ia]);
+  }
+
+  free(pme->work);
+  free(pme->gb);
+  free(pme->buf);
+  free(pme->b);
+  free(pme->a);
+  free(pme->phi);
+  free(pme->q);
+  free(pme->qlocal);
+  free(pme);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_info
+ *
+ *****************************************************************************/
+
+int ewald_pme_info(ewald_pme_t * pme) {
+
+  assert(pme);
+
+  pe_info(pme->pe, "Fourier space method:                     SPME\n");
+  pe_info(pme->pe, "PME mesh:                                 %d %d %d\n",
+	  pme->ngrid[X], pme->ngrid[Y], pme->ngrid[Z]);
+  pe_info(pme->pe, "PME B-spline order:                       %d\n",
+	  pme->order);
+
+  if (pme->nrank > 1) {
+    pe_info(pme->pe, "PME FFT decomposition:                    "
+	    "slabs (%d ranks)\n", pme->nrank);
+  }
+  else {
+    pe_info(pme->pe, "PME FFT decomposition:                    "
+	    "replicated\n");
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_grid
+ *
+ *****************************************************************************/
+
+int ewald_pme_grid(ewald_pme_t * pme, int ngrid[3]) {
+
+  assert(pme);
+
+  ngrid[X] = pme->ngrid[X];
+  ngrid[Y] = pme->ngrid[Y];
+  ngrid[Z] = pme->ngrid[Z];
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_order
+ *
+ *****************************************************************************/
+
+int ewald_pme_order(ewald_pme_t * pme, int * order) {
+
+  assert(pme);
+  assert(order);
+
+  *order = pme->order;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_fourier_space_sum
+ *
+ *  Accumulate the Fourier space force and torque on each local
+ *  particle for dipole strength mu and Ewald parameter kappa.
+ *  The Fourier space energy is returned (the same on all ranks).
+ *
+ *****************************************************************************/
+
+int ewald_pme_fourier_space_sum(ewald_pme_t * pme, colloids_info_t * cinfo,
+				double mu, double kappa, double * efourier) {
+
+  int n;
+  double e = 0.0;
+
+  assert(pme);
+  assert(cinfo);
+  assert(efourier);
+  assert(kappa > 0.0);
+
+  if (kappa != pme->kappa) ewald_pme_influence(pme, kappa);
+
+  ewald_pme_spread(pme, cinfo, mu);
+  ewald_pme_convolve(pme);
+
+  for (n = 0; n < pme->nmesh; n++) {
+    e += pme->q[n]*pme->phi[n];
+  }
+  *efourier = 0.5*e;
+
+  ewald_pme_interpolate(pme, cinfo, mu);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_bspline
+ *
+ *  Cardinal B-spline weights m[j] = M_p(w + j), j = 0, ..., p-1 for
+ *  fractional offset 0 <= w < 1, with first and second derivatives,
+ *  via the usual recursion
+ *
+ *    M_n(x) = [x M_{n-1}(x) + (n - x) M_{n-1}(x - 1)] / (n - 1)
+ *    M'_n(x) = M_{n-1}(x) - M_{n-1}(x - 1)
+ *
+ *****************************************************************************/
+
+static int ewald_pme_bspline(int p, double w, double * m, double * dm,
+			     double * d2m) {
+
+  int n, j;
+  double a[EWALD_PME_ORDER_MAX + 1][EWALD_PME_ORDER_MAX + 2];
+
+  assert(p >= EWALD_PME_ORDER_MIN && p <= EWALD_PME_ORDER_MAX);
+
+  /* a[n][j + 1] holds M_n(w + j); a[n][0] is zero padding. */
+
+  for (n = 0; n <= p; n++) {
+    for (j = 0; j <= p + 1; j++) {
+      a[n][j] = 0.0;
+    }
+  }
+
+  a[1][1] = 1.0;
+
+  for (n = 2; n <= p; n++) {
+    for (j = 0; j < n; j++) {
+      a[n][j+1] = ((w + j)*a[n-1][j+1] + (n - w - j)*a[n-1][j])/(n - 1);
+    }
+  }
+
+  for (j = 0; j < p; j++) {
+    m[j] = a[p][j+1];
+    dm[j] = a[p-1][j+1] - a[p-1][j];
+    d2m[j] = a[p-2][j+1] - 2.0*a[p-2][j] + (j > 0 ? a[p-2][j-1] : 0.0);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_bsp_mod
+ *
+ *  |b(k)|^2 = 1 / |sum_{j=0}^{p-2} M_p(j+1) exp(2 pi i k j/K)|^2
+ *
+ *  Where the denominator vanishes (k = K/2 for odd p) the mode is
+ *  dropped.
+ *
+ *****************************************************************************/
+
+static int ewald_pme_bsp_mod(ewald_pme_t * pme) {
+
+  int ia, j, k;
+  double m[EWALD_PME_ORDER_MAX];
+  double dm[EWALD_PME_ORDER_MAX];
+  double d2m[EWALD_PME_ORDER_MAX];
+  PI_DOUBLE(pi);
+
+  assert(pme);
+
+  ewald_pme_bspline(pme->order, 0.0, m, dm, d2m);
+
+  for (ia = 0; ia < 3; ia++) {
+    int nk = pme->ngrid[ia];
+    for (k = 0; k < nk; k++) {
+      double re = 0.0;
+      double im = 0.0;
+      double den;
+      for (j = 0; j < pme->order - 1; j++) {
+	re += m[j+1]*cos(2.0*pi*k*j/nk);
+	im += m[j+1]*sin(2.0*pi*k*j/nk);
+      }
+      den = re*re + im*im;
+      pme->bsp[ia][k] = (den < DBL_EPSILON) ? 0.0 : 1.0/den;
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_influence
+ *
+ *  G(k)B(k) on the local y-slab, with
+ *    G(k) = (4 pi / V) exp(-k^2/4kappa^2) / k^2,  G(0) = 0.
+ *
+ *****************************************************************************/
+
+static int ewald_pme_influence(ewald_pme_t * pme, double kappa) {
+
+  int ix, iyl, iz;
+  int kk[3];
+  double k[3], ksq;
+  double ltot[3];
+  double r4kappa_sq;
+  double g0;
+  PI_DOUBLE(pi);
+
+  assert(pme);
+
+  cs_ltot(pme->cs, ltot);
+
+  r4kappa_sq = 1.0/(4.0*kappa*kappa);
+  g0 = 4.0*pi/(ltot[X]*ltot[Y]*ltot[Z]);
+
+  for (ix = 0; ix < pme->ngrid[X]; ix++) {
+    for (iyl = 0; iyl < pme->nslab[Y]; iyl++) {
+      for (iz = 0; iz < pme->ngrid[Z]; iz++) {
+
+	int index = (ix*pme->nslab[Y] + iyl)*pme->ngrid[Z] + iz;
+
+	kk[X] = ix;
+	kk[Y] = pme->rank*pme->nslab[Y] + iyl;
+	kk[Z] = iz;
+
+	if (kk[X] > pme->ngrid[X]/2) kk[X] -= pme->ngrid[X];
+	if (kk[Y] > pme->ngrid[Y]/2) kk[Y] -= pme->ngrid[Y];
+	if (kk[Z] > pme->ngrid[Z]/2) kk[Z] -= pme->ngrid[Z];
+
+	k[X] = 2.0*pi*kk[X]/ltot[X];
+	k[Y] = 2.0*pi*kk[Y]/ltot[Y];
+	k[Z] = 2.0*pi*kk[Z]/ltot[Z];
+	ksq = k[X]*k[X] + k[Y]*k[Y] + k[Z]*k[Z];
+
+	pme->gb[index] = 0.0;
+	if (ksq > 0.0) {
+	  pme->gb[index] = g0*exp(-r4kappa_sq*ksq)/ksq
+	    *pme->bsp[X][ix]
+	    *pme->bsp[Y][pme->rank*pme->nslab[Y] + iyl]
+	    *pme->bsp[Z][iz];
+	}
+      }
+    }
+  }
+
+  pme->kappa = kappa;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_spread
+ *
+ *  Q(m) = sum_i mu s_i . grad_r W(u_i - m) for the local particles.
+ *
+ *****************************************************************************/
+
+static int ewald_pme_spread(ewald_pme_t * pme, colloids_info_t * cinfo,
+			    double mu) {
+
+  int ic, jc, kc;
+  int ia, j;
+  int jx, jy, jz;
+  int ncell[3];
+  int m0[3];
+  int mx, my, mz;
+  double lmin[3];
+  double ltot[3];
+  double h[3];
+  double c[3];
+  double th[3][EWALD_PME_ORDER_MAX];
+  double dth[3][EWALD_PME_ORDER_MAX];
+  double d2th[3][EWALD_PME_ORDER_MAX];
+
+  assert(pme);
+  assert(cinfo);
+
+  cs_lmin(pme->cs, lmin);
+  cs_ltot(pme->cs, ltot);
+  colloids_info_ncell(cinfo, ncell);
+
+  for (ia = 0; ia < 3; ia++) {
+    h[ia] = pme->ngrid[ia]/ltot[ia];
+  }
+
+  memset(pme->qlocal, 0, pme->nmesh*sizeof(double));
+
+  for (ic = 1; ic <= ncell[X]; ic++) {
+    for (jc = 1; jc <= ncell[Y]; jc++) {
+      for (kc = 1; kc <= ncell[Z]; kc++) {
+
+	colloid_t * pc = NULL;
+
+	colloids_info_cell_list_head(cinfo, ic, jc, kc, &pc);
+
+	for ( ; pc; pc = pc->next) {
+
+	  for (ia = 0; ia < 3; ia++) {
+	    double u = h[ia]*(pc->s.r[ia] - lmin[ia]);
+	    double fl = floor(u);
+	    m0[ia] = (int) fl;
+	    c[ia] = mu*pc->s.s[ia]*h[ia];
+	    ewald_pme_bspline(pme->order, u - fl, th[ia], dth[ia], d2th[ia]);
+	  }
+
+	  for (jx = 0; jx < pme->order; jx++) {
+	    j = m0[X] - jx;
+	    mx = (j % pme->ngrid[X] + pme->ngrid[X]) % pme->ngrid[X];
+	    for (jy = 0; jy < pme->order; jy++) {
+	      j = m0[Y] - jy;
+	      my = (j % pme->ngrid[Y] + pme->ngrid[Y]) % pme->ngrid[Y];
+	      for (jz = 0; jz < pme->order; jz++) {
+		j = m0[Z] - jz;
+		mz = (j % pme->ngrid[Z] + pme->ngrid[Z]) % pme->ngrid[Z];
+
+		pme->qlocal[(mx*pme->ngrid[Y] + my)*pme->ngrid[Z] + mz] +=
+		    c[X]*dth[X][jx]*th[Y][jy]*th[Z][jz]
+		  + c[Y]*th[X][jx]*dth[Y][jy]*th[Z][jz]
+		  + c[Z]*th[X][jx]*th[Y][jy]*dth[Z][jz];
+	      }
+	    }
+	  }
+	}
+	/* Next cell */
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_convolve
+ *
+ *  Reduce the mesh charge, then phi = FFT^{-1}[G B FFT(Q)] without
+ *  the 1/N normalisation, so that E = (1/2) sum_m Q(m) phi(m).
+ *  On exit both q and phi are complete on every rank.
+ *
+ *****************************************************************************/
+
+static int ewald_pme_convolve(ewald_pme_t * pme) {
+
+  int n, nlocal;
+  int ixl, iy, iz;
+  int offset;
+  int nk[3];
+  MPI_Comm comm;
+
+  assert(pme);
+
+  nk[X] = pme->ngrid[X];
+  nk[Y] = pme->ngrid[Y];
+  nk[Z] = pme->ngrid[Z];
+  nlocal = pme->nslab[X]*nk[Y]*nk[Z];
+
+  cs_cart_comm(pme->cs, &comm);
+  MPI_Allreduce(pme->qlocal, pme->q, pme->nmesh, MPI_DOUBLE, MPI_SUM, comm);
+
+  /* Local x-slab */
+
+  offset = pme->rank*nlocal;
+
+  for (ixl = 0; ixl < pme->nslab[X]; ixl++) {
+    for (iy = 0; iy < nk[Y]; iy++) {
+      for (iz = 0; iz < nk[Z]; iz++) {
+	n = (ixl*nk[Y] + iy)*nk[Z] + iz;
+	pme->a[2*n    ] = pme->q[offset + n];
+	pme->a[2*n + 1] = 0.0;
+      }
+    }
+  }
+
+  /* Forward: z, y on x-slab; x on y-slab */
+
+  ewald_pme_fft_lines(pme, Z, pme->a, 1, pme->nslab[X]*nk[Y], nk[Z],
+		      1, 0, -1);
+  ewald_pme_fft_lines(pme, Y, pme->a, nk[Z], pme->nslab[X], nk[Y]*nk[Z],
+		      nk[Z], 1, -1);
+  ewald_pme_transpose(pme, 1);
+  ewald_pme_fft_lines(pme, X, pme->b, pme->nslab[Y]*nk[Z],
+		      pme->nslab[Y]*nk[Z], 1, 1, 0, -1);
+
+  for (n = 0; n < nlocal; n++) {
+    pme->b[2*n    ] *= pme->gb[n];
+    pme->b[2*n + 1] *= pme->gb[n];
+  }
+
+  /* Inverse in the reverse order */
+
+  ewald_pme_fft_lines(pme, X, pme->b, pme->nslab[Y]*nk[Z],
+		      pme->nslab[Y]*nk[Z], 1, 1, 0, +1);
+  ewald_pme_transpose(pme, 0);
+  ewald_pme_fft_lines(pme, Y, pme->a, nk[Z], pme->nslab[X], nk[Y]*nk[Z],
+		      nk[Z], 1, +1);
+  ewald_pme_fft_lines(pme, Z, pme->a, 1, pme->nslab[X]*nk[Y], nk[Z],
+		      1, 0, +1);
+
+  /* The real part is the potential; collect the slabs (qlocal is
+   * free as a send buffer at this point). */
+
+  for (n = 0; n < nlocal; n++) {
+    pme->qlocal[n] = pme->a[2*n];
+  }
+
+  MPI_Allgather(pme->qlocal, nlocal, MPI_DOUBLE, pme->phi, nlocal,
+		MPI_DOUBLE, pme->comm);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_interpolate
+ *
+ *  F_i = - sum_m phi(m) dQ(m)/dr_i
+ *  T_i = - s_i x dE/ds_i  with  dE/ds_i = mu sum_m phi(m) grad_r W
+ *
+ *****************************************************************************/
+
+static int ewald_pme_interpolate(ewald_pme_t * pme, colloids_info_t * cinfo,
+				 double mu) {
+
+  int ic, jc, kc;
+  int ia, ib, j;
+  int jx, jy, jz;
+  int ncell[3];
+  int m0[3];
+  int mx, my, mz;
+  double lmin[3];
+  double ltot[3];
+  double h[3];
+  double c[3];
+  double th[3][EWALD_PME_ORDER_MAX];
+  double dth[3][EWALD_PME_ORDER_MAX];
+  double d2th[3][EWALD_PME_ORDER_MAX];
+
+  assert(pme);
+  assert(cinfo);
+
+  cs_lmin(pme->cs, lmin);
+  cs_ltot(pme->cs, ltot);
+  colloids_info_ncell(cinfo, ncell);
+
+  for (ia = 0; ia < 3; ia++) {
+    h[ia] = pme->ngrid[ia]/ltot[ia];
+  }
+
+  for (ic = 1; ic <= ncell[X]; ic++) {
+    for (jc = 1; jc <= ncell[Y]; jc++) {
+      for (kc = 1; kc <= ncell[Z]; kc++) {
+
+	colloid_t * pc = NULL;
+
+	colloids_info_cell_list_head(cinfo, ic, jc, kc, &pc);
+
+	for ( ; pc; pc = pc->next) {
+
+	  double f[3] = {0.0, 0.0, 0.0};
+	  double g[3] = {0.0, 0.0, 0.0};
+
+	  for (ia = 0; ia < 3; ia++) {
+	    double u = h[ia]*(pc->s.r[ia] - lmin[ia]);
+	    double fl = floor(u);
+	    m0[ia] = (int) fl;
+	    c[ia] = mu*pc->s.s[ia]*h[ia];
+	    ewald_pme_bspline(pme->order, u - fl, th[ia], dth[ia], d2th[ia]);
+	  }
+
+	  for (jx = 0; jx < pme->order; jx++) {
+	    j = m0[X] - jx;
+	    mx = (j % pme->ngrid[X] + pme->ngrid[X]) % pme->ngrid[X];
+	    for (jy = 0; jy < pme->order; jy++) {
+	      j = m0[Y] - jy;
+	      my = (j % pme->ngrid[Y] + pme->ngrid[Y]) % pme->ngrid[Y];
+	      for (jz = 0; jz < pme->order; jz++) {
+
+		double phi;
+		double dw[3];
+		double d2w[3][3];
+
+		j = m0[Z] - jz;
+		mz = (j % pme->ngrid[Z] + pme->ngrid[Z]) % pme->ngrid[Z];
+		phi = pme->phi[(mx*pme->ngrid[Y] + my)*pme->ngrid[Z] + mz];
+
+		/* First and second derivatives of W wrt u */
+
+		dw[X] = dth[X][jx]*th[Y][jy]*th[Z][jz];
+		dw[Y] = th[X][jx]*dth[Y][jy]*th[Z][jz];
+		dw[Z] = th[X][jx]*th[Y][jy]*dth[Z][jz];
+
+		d2w[X][X] = d2th[X][jx]*th[Y][jy]*th[Z][jz];
+		d2w[Y][Y] = th[X][jx]*d2th[Y][jy]*th[Z][jz];
+		d2w[Z][Z] = th[X][jx]*th[Y][jy]*d2th[Z][jz];
+		d2w[X][Y] = dth[X][jx]*dth[Y][jy]*th[Z][jz];
+		d2w[X][Z] = dth[X][jx]*th[Y][jy]*dth[Z][jz];
+		d2w[Y][Z] = th[X][jx]*dth[Y][jy]*dth[Z][jz];
+		d2w[Y][X] = d2w[X][Y];
+		d2w[Z][X] = d2w[X][Z];
+		d2w[Z][Y] = d2w[Y][Z];
+
+		for (ia = 0; ia < 3; ia++) {
+		  double dq = 0.0;
+		  for (ib = 0; ib < 3; ib++) {
+		    dq += c[ib]*d2w[ib][ia];
+		  }
+		  f[ia] -= phi*h[ia]*dq;
+		  g[ia] += phi*mu*h[ia]*dw[ia];
+		}
+	      }
+	    }
+	  }
+
+	  pc->force[X] += f[X];
+	  pc->force[Y] += f[Y];
+	  pc->force[Z] += f[Z];
+
+	  pc->torque[X] += -(pc->s.s[Y]*g[Z] - pc->s.s[Z]*g[Y]);
+	  pc->torque[Y] += -(pc->s.s[Z]*g[X] - pc->s.s[X]*g[Z]);
+	  pc->torque[Z] += -(pc->s.s[X]*g[Y] - pc->s.s[Y]*g[X]);
+	}
+	/* Next cell */
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_transpose
+ *
+ *  Forward: x-slab a[nx][Ky][Kz] to y-slab b[Kx][ny][Kz].
+ *  Backward: the reverse.
+ *
+ *  The block exchanged with rank r is contiguous in b (x-range of r),
+ *  so only a needs to be packed or unpacked.
+ *
+ *****************************************************************************/
+
+static int ewald_pme_transpose(ewald_pme_t * pme, int forward) {
+
+  int r, ixl, iyl, iz;
+  int nx, ny, nz, nky;
+  int nblock;
+
+  assert(pme);
+
+  nx = pme->nslab[X];
+  ny = pme->nslab[Y];
+  nz = pme->ngrid[Z];
+  nky = pme->ngrid[Y];
+  nblock = nx*ny*nz;
+
+  if (forward) {
+    for (r = 0; r < pme->nrank; r++) {
+      for (ixl = 0; ixl < nx; ixl++) {
+	for (iyl = 0; iyl < ny; iyl++) {
+	  int ia = (ixl*nky + r*ny + iyl)*nz;
+	  int ib = r*nblock + (ixl*ny + iyl)*nz;
+	  for (iz = 0; iz < nz; iz++) {
+	    pme->buf[2*(ib + iz)    ] = pme->a[2*(ia + iz)    ];
+	    pme->buf[2*(ib + iz) + 1] = pme->a[2*(ia + iz) + 1];
+	  }
+	}
+      }
+    }
+    MPI_Alltoall(pme->buf, 2*nblock, MPI_DOUBLE, pme->b, 2*nblock,
+		 MPI_DOUBLE, pme->comm);
+  }
+  else {
+    MPI_Alltoall(pme->b, 2*nblock, MPI_DOUBLE, pme->buf, 2*nblock,
+		 MPI_DOUBLE, pme->comm);
+    for (r = 0; r < pme->nrank; r++) {
+      for (ixl = 0; ixl < nx; ixl++) {
+	for (iyl = 0; iyl < ny; iyl++) {
+	  int ia = (ixl*nky + r*ny + iyl)*nz;
+	  int ib = r*nblock + (ixl*ny + iyl)*nz;
+	  for (iz = 0; iz < nz; iz++) {
+	    pme->a[2*(ia + iz)    ] = pme->buf[2*(ib + iz)    ];
+	    pme->a[2*(ia + iz) + 1] = pme->buf[2*(ib + iz) + 1];
+	  }
+	}
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_fft_lines
+ *
+ *  Transform the n1 x n2 complex lines of length ngrid[id] with
+ *  element stride "stride" starting at i1*s1 + i2*s2 (all in units
+ *  of complex numbers). sign = -1 is forward, +1 is inverse
+ *  (unnormalised).
+ *
+ *****************************************************************************/
+
+static int ewald_pme_fft_lines(ewald_pme_t * pme, int id, double * z,
+			       int stride, int n1, int s1, int n2, int s2,
+			       int sign) {
+  int i1, i2, k;
+  int n;
+
+  assert(pme);
+
+  n = pme->ngrid[id];
+
+  for (i1 = 0; i1 < n1; i1++) {
+    for (i2 = 0; i2 < n2; i2++) {
+      double * line = z + 2*(i1*s1 + i2*s2);
+      for (k = 0; k < n; k++) {
+	pme->work[2*k    ] = line[2*k*stride    ];
+	pme->work[2*k + 1] = line[2*k*stride + 1];
+      }
+      ewald_pme_fft(n, pme->tw[id], pme->work, sign);
+      for (k = 0; k < n; k++) {
+	line[2*k*stride    ] = pme->work[2*k    ];
+	line[2*k*stride + 1] = pme->work[2*k + 1];
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ewald_pme_fft
+ *
+ *  In-place iterative radix-2 complex FFT of length n (a power of
+ *  two). tw[] holds exp(-2 pi i k/n) for k < n/2.
+ *
+ *****************************************************************************/
+
+static int ewald_pme_fft(int n, const double * tw, double * z, int sign) {
+
+  int i, j, k;
+  int len, half, step;
+
+  assert(tw);
+  assert(z);
+
+  /* Bit reversal */
+
+  for (i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for ( ; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      double tr = z[2*i], ti = z[2*i + 1];
+      z[2*i] = z[2*j]; z[2*i + 1] = z[2*j + 1];
+      z[2*j] = tr;     z[2*j + 1] = ti;
+    }
+  }
+
+  for (len = 2; len <= n; len <<= 1) {
+    half = len/2;
+    step = n/len;
+    for (i = 0; i < n; i += len) {
+      for (k = 0; k < half; k++) {
+	double wr = tw[2*k*step];
+	double wi = (sign < 0) ? tw[2*k*step + 1] : -tw[2*k*step + 1];
+	int i0 = 2*(i + k);
+	int i1 = 2*(i + k + half);
+	double vr = z[i1]*wr - z[i1 + 1]*wi;
+	double vi = z[i1]*wi + z[i1 + 1]*wr;
+	z[i1    ] = z[i0    ] - vr;
+	z[i1 + 1] = z[i0 + 1] - vi;
+	z[i0    ] += vr;
+	z[i0 + 1] += vi;
+      }
+    }
+  }
+
+  return 0;
+}
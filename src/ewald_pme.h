@@ -0,0 +1,36 @@
+/*****************************************************************************
+ *
+ *  ewald_pme.h
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#ifndef LUDWIG_EWALD_PME_H
+#define LUDWIG_EWALD_PME_H
+
+#include "pe.h"
+#include "coords.h"
+#include "colloids.h"
+
+#define EWALD_PME_ORDER_MIN 4
+#define EWALD_PME_ORDER_MAX 8
+
+typedef struct ewald_pme_s ewald_pme_t;
+
+int ewald_pme_create(pe_t * pe, cs_t * cs, const int ngrid[3], int order,
+		     ewald_pme_t ** ppme);
+int ewald_pme_free(ewald_pme_t * pme);
+int ewald_pme_info(ewald_pme_t * pme);
+int ewald_pme_grid(ewald_pme_t * pme, int ngrid[3]);
+int ewald_pme_order(ewald_pme_t * pme, int * order);
+int ewald_pme_fourier_space_sum(ewald_pme_t * pme, colloids_info_t * cinfo,
+				double mu, double kappa, double * efourier);
+
+#endif
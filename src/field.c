@@ -14,7 +14,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2012-2018 The University of Edinburgh
+ *  (c) 2012-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -37,6 +37,7 @@
 
 static int field_write(FILE * fp, int index, void * self);
 static int field_write_ascii(FILE * fp, int index, void * self);
+static int field_pack(void * self, char * buf);
 static int field_read(FILE * fp, int index, void * self);
 static int field_read_ascii(FILE * fp, int index, void * self);
 
@@ -112,7 +113,7 @@ __host__ int field_free(field_t * obj) {
     tdpFree(obj->target);
   }
 
-  if (obj->data) free(obj->data);
+  mem_lattice_free(obj->data);
   if (obj->name) free(obj->name);
   if (obj->halo) halo_swap_free(obj->halo);
   if (obj->info) io_info_free(obj->info);
@@ -154,7 +155,7 @@ __host__ int field_init(field_t * obj, int nhcomm, lees_edw_t * le) {
   obj->nhcomm = nhcomm;
   obj->nsites = nsites;
 #ifndef OLD_DATA
-  obj->data = (double *) calloc(obj->nf*nsites, sizeof(double));
+  obj->data = (double *) mem_lattice_calloc(nsites, obj->nf, sizeof(double));
   if (obj->data == NULL) pe_fatal(obj->pe, "calloc(obj->data) failed\n");
 #else
   obj->data = (double *) mem_aligned_malloc(MEM_PAGESIZE, obj->nf*nsites*
@@ -279,6 +280,7 @@ __host__ int field_init_io_info(field_t * obj, int grid[3], int form_in,
   io_info_write_set(obj->info, IO_FORMAT_ASCII, field_write_ascii);
   io_info_read_set(obj->info, IO_FORMAT_BINARY, field_read);
   io_info_read_set(obj->info, IO_FORMAT_ASCII, field_read_ascii);
+  io_info_pack_set(obj->info, field_pack);
 
   /* ASCII format size is 23 bytes per element plus a '\n' */
   io_info_set_bytesize(obj->info, IO_FORMAT_BINARY, obj->nf*sizeof(double));
@@ -913,6 +915,44 @@ static int field_write(FILE * fp, int index, void * self) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  field_pack
+ *
+ *  Binary output for all local sites to buf (same format as field_write).
+ *  Sites are contiguous in memory along z, so the inner loop vectorises.
+ *
+ *****************************************************************************/
+
+static int field_pack(void * self, char * buf) {
+
+  int ic, jc, kc, n;
+  int index0;
+  int nlocal[3];
+  double * out = (double *) buf;
+  field_t * obj = (field_t *) self;
+
+  assert(obj);
+  assert(buf);
+
+  cs_nlocal(obj->cs, nlocal);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      index0 = cs_index(obj->cs, ic, jc, 1);
+      for (n = 0; n < obj->nf; n++) {
+	for (kc = 0; kc < nlocal[Z]; kc++) {
+	  out[kc*obj->nf + n]
+	    = obj->data[addr_rank1(obj->nsites, obj->nf, index0 + kc, n)];
+	}
+      }
+      out += obj->nf*nlocal[Z];
+    }
+  }
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  field_write_ascii
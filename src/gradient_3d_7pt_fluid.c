@@ -25,7 +25,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2016 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -205,7 +205,7 @@ __host__ int grad_3d_7pt_fluid_operator(cs_t * cs, lees_edw_t * le,
   limits.jmin = 1 - nextra; limits.jmax = nlocal[Y] + nextra;
   limits.kmin = 1 - nextra; limits.kmax = nlocal[Z] + nextra;
 
-  kernel_ctxt_create(cs, NSIMDVL, limits, &ctxt);
+  kernel_ctxt_create_tiled(cs, NSIMDVL, limits, &ctxt);
   kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
 
   TIMER_start(TIMER_PHI_GRAD_KERNEL);
@@ -218,6 +218,14 @@ __host__ int grad_3d_7pt_fluid_operator(cs_t * cs, lees_edw_t * le,
 
   TIMER_stop(TIMER_PHI_GRAD_KERNEL);
 
+  /* Telemetry: read field, write gradient and Laplacian */
+  {
+    double nsite = 1.0*(limits.imax - limits.imin + 1)
+      *(limits.jmax - limits.jmin + 1)*(limits.kmax - limits.kmin + 1);
+    TIMER_work(TIMER_PHI_GRAD_KERNEL, nsite,
+	       nsite*(1 + NVECTOR + 1)*fg->field->nf*sizeof(double));
+  }
+
   kernel_ctxt_free(ctxt);
 
   return 0;
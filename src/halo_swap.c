@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2016-2018 The University of Edinburgh
+ *  (c) 2016-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Alan Gray (alang@epcc.ed.ac.uk)
@@ -19,6 +19,7 @@
 #include <string.h>
 
 #include "util.h"
+#include "timer.h"
 #include "halo_swap.h"
 
 typedef struct halo_swap_param_s halo_swap_param_t;
@@ -41,7 +42,13 @@ struct halo_swap_s {
   double * hzhi;
   f_pack_t data_pack;       /* Pack buffer kernel function */
   f_unpack_t data_unpack;   /* Unpack buffer kernel function */
+  MPI_Datatype mpidata;     /* Element type of buffers and messages */
+  size_t szel;              /* Element size (bytes) */
   tdpStream_t stream[3];    /* Stream for each of X,Y,Z */
+  MPI_Request request[3][4]; /* Split phase: recv lo, hi; send hi, lo */
+  int nsend;                /* Split phase: directions sent */
+  int nrecv;                /* Split phase: directions complete */
+  long int nmessage;        /* Running total of messages sent */
   halo_swap_t * target;     /* Device memory */
 };
 
@@ -64,12 +71,23 @@ struct halo_swap_param_s {
 
 static __constant__ halo_swap_param_t const_param;
 
+/* Message tags for halo_swap_packed() (backward, forward) */
+
+static const int btag_[3] = {639, 640, 641};
+static const int ftag_[3] = {642, 643, 644};
+
 __host__ int halo_swap_create(pe_t * pe, cs_t * cs, int nhcomm, int naddr,
 			      int na, int nb, halo_swap_t ** phalo);
 __host__ __device__ void halo_swap_coords(halo_swap_t * halo, int id, int index, int * ic, int * jc, int * kc);
 __host__ __device__ int halo_swap_index(halo_swap_t * halo, int ic, int jc, int kc);
 __host__ __device__ int halo_swap_bufindex(halo_swap_t * halo, int id, int ic, int jc, int kc);
 
+static __host__ int halo_swap_send(halo_swap_t * halo, int id);
+static __host__ int halo_swap_recv(halo_swap_t * halo, int id, void * data);
+static __host__ int halo_swap_corners(halo_swap_t * halo, int id);
+static __host__ void halo_swap_copy_el(halo_swap_t * halo, double * dst,
+				       int idst, const double * src, int isrc);
+
 /*****************************************************************************
  *
  *  halo_swap_create_r1
@@ -188,6 +206,11 @@ __host__ int halo_swap_create(pe_t * pe, cs_t * cs, int nhcomm, int naddr,
   tdpStreamCreate(&halo->stream[Y]);
   tdpStreamCreate(&halo->stream[Z]);
 
+  /* Default element type for messages */
+
+  halo->mpidata = MPI_DOUBLE;
+  halo->szel = sizeof(double);
+
   /* Device buffers: allocate or alias */
 
   tdpGetDeviceCount(&ndevice);
@@ -364,6 +387,29 @@ __host__ int halo_swap_handlers_set(halo_swap_t * halo, f_pack_t pack,
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  halo_swap_datatype_set
+ *
+ *  The default element is double (MPI_DOUBLE). Data stored in single
+ *  precision may use MPI_FLOAT, in which case the pack and unpack
+ *  handlers must also be the float versions. The buffers, which are
+ *  sized for double, are then only partly used.
+ *
+ *****************************************************************************/
+
+__host__ int halo_swap_datatype_set(halo_swap_t * halo, MPI_Datatype mpidata) {
+
+  assert(halo);
+  assert(mpidata == MPI_DOUBLE || mpidata == MPI_FLOAT);
+
+  halo->mpidata = mpidata;
+  if (mpidata == MPI_DOUBLE) halo->szel = sizeof(double);
+  if (mpidata == MPI_FLOAT) halo->szel = sizeof(float);
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  halo_swap_commit
@@ -445,6 +491,7 @@ __host__ int halo_swap_host_rank1(halo_swap_t * halo, void * mbuf,
 
   /* Load send buffers */
 
+  TIMER_start(TIMER_HALO_PACK);
   icount = 0;
 
   for (nh = 0; nh < hp->nswap; nh++) {
@@ -466,6 +513,7 @@ __host__ int halo_swap_host_rank1(halo_swap_t * halo, void * mbuf,
   }
 
   assert(icount == nsend);
+  TIMER_stop(TIMER_HALO_PACK);
 
   if (mpicartsz[X] == 1) {
     memcpy(recvback, sendforw, nsend*sz);
@@ -481,11 +529,14 @@ __host__ int halo_swap_host_rank1(halo_swap_t * halo, void * mbuf,
     MPI_Issend(sendback, nsend, mpidata, pback, tagb, comm, req + 2);
     MPI_Issend(sendforw, nsend, mpidata, pforw, tagf, comm, req + 3);
     /* Wait for receives */
+    TIMER_start(TIMER_HALO_WAIT);
     MPI_Waitall(2, req, status);
+    TIMER_stop(TIMER_HALO_WAIT);
   }
 
   /* Unload */
 
+  TIMER_start(TIMER_HALO_PACK);
   icount = 0;
 
   for (nh = 0; nh < hp->nswap; nh++) {
@@ -505,11 +556,14 @@ __host__ int halo_swap_host_rank1(halo_swap_t * halo, void * mbuf,
   }
 
   assert(icount == nsend);
+  TIMER_stop(TIMER_HALO_PACK);
 
   free(recvback);
   free(recvforw);
 
+  TIMER_start(TIMER_HALO_WAIT);
   MPI_Waitall(2, req + 2, status);
+  TIMER_stop(TIMER_HALO_WAIT);
 
   free(sendback);
   free(sendforw);
@@ -530,6 +584,7 @@ __host__ int halo_swap_host_rank1(halo_swap_t * halo, void * mbuf,
 
   /* Load buffers */
 
+  TIMER_start(TIMER_HALO_PACK);
   icount = 0;
 
   for (nh = 0; nh < hp->nswap; nh++) {
@@ -549,6 +604,7 @@ __host__ int halo_swap_host_rank1(halo_swap_t * halo, void * mbuf,
   }
 
   assert(icount == nsend);
+  TIMER_stop(TIMER_HALO_PACK);
 
   if (mpicartsz[Y] == 1) {
     memcpy(recvback, sendforw, nsend*sz);
@@ -564,11 +620,14 @@ __host__ int halo_swap_host_rank1(halo_swap_t * halo, void * mbuf,
     MPI_Issend(sendback, nsend, mpidata, pback, tagb, comm, req + 2);
     MPI_Issend(sendforw, nsend, mpidata, pforw, tagf, comm, req + 3);
     /* Wait for receives */
+    TIMER_start(TIMER_HALO_WAIT);
     MPI_Waitall(2, req, status);
+    TIMER_stop(TIMER_HALO_WAIT);
   }
 
   /* Unload */
 
+  TIMER_start(TIMER_HALO_PACK);
   icount = 0;
 
   for (nh = 0; nh < hp->nswap; nh++) {
@@ -588,11 +647,14 @@ __host__ int halo_swap_host_rank1(halo_swap_t * halo, void * mbuf,
   }
 
   assert(icount == nsend);
+  TIMER_stop(TIMER_HALO_PACK);
 
   free(recvback);
   free(recvforw);
 
+  TIMER_start(TIMER_HALO_WAIT);
   MPI_Waitall(2, req + 2, status);
+  TIMER_stop(TIMER_HALO_WAIT);
 
   free(sendback);
   free(sendforw);
@@ -614,6 +676,7 @@ __host__ int halo_swap_host_rank1(halo_swap_t * halo, void * mbuf,
   /* Load */
   /* Some adjustment in the load required for 2d systems (X-Y) */
 
+  TIMER_start(TIMER_HALO_PACK);
   icount = 0;
 
   for (nh = 0; nh < hp->nswap; nh++) {
@@ -635,6 +698,7 @@ __host__ int halo_swap_host_rank1(halo_swap_t * halo, void * mbuf,
   }
 
   assert(icount == nsend);
+  TIMER_stop(TIMER_HALO_PACK);
 
   if (mpicartsz[Z] == 1) {
     memcpy(recvback, sendforw, nsend*sz);
@@ -650,11 +714,14 @@ __host__ int halo_swap_host_rank1(halo_swap_t * halo, void * mbuf,
     MPI_Issend(sendback, nsend, mpidata, pback, tagb, comm, req + 2);
     MPI_Issend(sendforw, nsend, mpidata, pforw, tagf, comm, req + 3);
     /* Wait before unloading */
+    TIMER_start(TIMER_HALO_WAIT);
     MPI_Waitall(2, req, status);
+    TIMER_stop(TIMER_HALO_WAIT);
   }
 
   /* Unload */
 
+  TIMER_start(TIMER_HALO_PACK);
   icount = 0;
 
   for (nh = 0; nh < hp->nswap; nh++) {
@@ -674,11 +741,14 @@ __host__ int halo_swap_host_rank1(halo_swap_t * halo, void * mbuf,
   }
 
   assert(icount == nsend);
+  TIMER_stop(TIMER_HALO_PACK);
 
   free(recvback);
   free(recvforw);
 
+  TIMER_start(TIMER_HALO_WAIT);
   MPI_Waitall(2, req + 2, status);
+  TIMER_stop(TIMER_HALO_WAIT);
 
   free(sendback);
   free(sendforw);
@@ -698,30 +768,46 @@ __host__ int halo_swap_host_rank1(halo_swap_t * halo, void * mbuf,
  *
  *****************************************************************************/
 
-__host__ int halo_swap_packed(halo_swap_t * halo, double * data) {
+__host__ int halo_swap_packed(halo_swap_t * halo, void * data) {
+
+  assert(halo);
+
+  halo_swap_start(halo, data);
+  halo_swap_wait(halo, data);
 
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  halo_swap_start
+ *
+ *  First half of a split-phase halo_swap_packed(). All receives are
+ *  posted and all edges are packed before any messages are sent.
+ *  The X messages are then sent.
+ *
+ *  The corners of the Y edges come from the X halo, and those of
+ *  the Z edges from the X and Y halos. A direction which is not
+ *  decomposed is just a copy and is completed here, so the next
+ *  direction can be sent at once. Only a decomposed direction
+ *  must wait for its messages before the next can go.
+ *
+ *  Until halo_swap_wait() the caller may update any sites which are
+ *  not in the halo and are not within nswap of the edge of the local
+ *  domain (these have already been packed). At most one swap using
+ *  the packed tags can be in flight at any one time.
+ *
+ *****************************************************************************/
+
+__host__ int halo_swap_start(halo_swap_t * halo, void * data) {
+
+  int id, p;
   int ncount;
   int ndevice;
-  int ic, jc, kc;
-  int ih, jh, kh;
-  int ixlo, ixhi;
-  int iylo, iyhi;
-  int izlo, izhi;  
-  int m, mc, p;
-  int nd, nh;
-  int hsz[3];
   int mpicartsz[3];
   dim3 nblk, ntpb;
   double * tmp;
-
   MPI_Comm comm;
-  MPI_Request req_x[4];
-  MPI_Request req_y[4];
-  MPI_Request req_z[4];
-  MPI_Status  status[4];
-
-  const int btagx = 639, btagy = 640, btagz = 641;
-  const int ftagx = 642, ftagy = 643, ftagz = 644;
 
   assert(halo);
 
@@ -734,324 +820,461 @@ __host__ int halo_swap_packed(halo_swap_t * halo, double * data) {
   cs_cart_comm(halo->cs, &comm);
   cs_cartsz(halo->cs, mpicartsz);
 
-  /* hsz[] is just shorthand for local halo sizes */
-  /* An offset nd is required if nswap < nhalo */
-
-  hsz[X] = halo->param->hsz[X];
-  hsz[Y] = halo->param->hsz[Y];
-  hsz[Z] = halo->param->hsz[Z];
-  nh = halo->param->nhalo;
-  nd = nh - halo->param->nswap;
-
   /* POST ALL RELEVANT Irecv() ahead of time */
 
-  for (p = 0; p < 4; p++) {
-    req_x[p] = MPI_REQUEST_NULL;
-    req_y[p] = MPI_REQUEST_NULL;
-    req_z[p] = MPI_REQUEST_NULL;
+  for (id = 0; id < 3; id++) {
+    for (p = 0; p < 4; p++) {
+      halo->request[id][p] = MPI_REQUEST_NULL;
+    }
   }
 
   if (mpicartsz[X] > 1) {
     ncount = halo->param->hsz[X]*halo->param->nfel;
-    MPI_Irecv(halo->hxlo, ncount, MPI_DOUBLE,
-	      cs_cart_neighb(halo->cs,BACKWARD,X), ftagx, comm, req_x);
-    MPI_Irecv(halo->hxhi, ncount, MPI_DOUBLE,
-	      cs_cart_neighb(halo->cs,FORWARD,X), btagx, comm, req_x + 1);
+    MPI_Irecv(halo->hxlo, ncount, halo->mpidata,
+	      cs_cart_neighb(halo->cs,BACKWARD,X), ftag_[X], comm,
+	      halo->request[X]);
+    MPI_Irecv(halo->hxhi, ncount, halo->mpidata,
+	      cs_cart_neighb(halo->cs,FORWARD,X), btag_[X], comm,
+	      halo->request[X] + 1);
   }
 
   if (mpicartsz[Y] > 1) {
     ncount = halo->param->hsz[Y]*halo->param->nfel;
-    MPI_Irecv(halo->hylo, ncount, MPI_DOUBLE,
-	      cs_cart_neighb(halo->cs,BACKWARD,Y), ftagy, comm, req_y);
-    MPI_Irecv(halo->hyhi, ncount, MPI_DOUBLE,
-	      cs_cart_neighb(halo->cs,FORWARD,Y), btagy, comm, req_y + 1);
+    MPI_Irecv(halo->hylo, ncount, halo->mpidata,
+	      cs_cart_neighb(halo->cs,BACKWARD,Y), ftag_[Y], comm,
+	      halo->request[Y]);
+    MPI_Irecv(halo->hyhi, ncount, halo->mpidata,
+	      cs_cart_neighb(halo->cs,FORWARD,Y), btag_[Y], comm,
+	      halo->request[Y] + 1);
   }
 
   if (mpicartsz[Z] > 1) {
     ncount = halo->param->hsz[Z]*halo->param->nfel;
-    MPI_Irecv(halo->hzlo, ncount, MPI_DOUBLE,
-	      cs_cart_neighb(halo->cs,BACKWARD,Z), ftagz, comm, req_z);
-    MPI_Irecv(halo->hzhi, ncount, MPI_DOUBLE,
-	      cs_cart_neighb(halo->cs,FORWARD,Z), btagz, comm, req_z + 1);
+    MPI_Irecv(halo->hzlo, ncount, halo->mpidata,
+	      cs_cart_neighb(halo->cs,BACKWARD,Z), ftag_[Z], comm,
+	      halo->request[Z]);
+    MPI_Irecv(halo->hzhi, ncount, halo->mpidata,
+	      cs_cart_neighb(halo->cs,FORWARD,Z), btag_[Z], comm,
+	      halo->request[Z] + 1);
   }
 
   /* pack X edges on accelerator */
 
-  kernel_launch_param(hsz[X], &nblk, &ntpb);
+  TIMER_start(TIMER_HALO_PACK);
+
+  kernel_launch_param(halo->param->hsz[X], &nblk, &ntpb);
   tdpLaunchKernel(halo->data_pack, nblk, ntpb, 0, halo->stream[X],
 		  halo->target, X, data);
 
   if (ndevice > 0) {
-    ncount = hsz[X]*halo->param->nfel;
+    ncount = halo->param->hsz[X]*halo->param->nfel;
     tdpMemcpy(&tmp, &halo->target->fxlo, sizeof(double *),
 	      tdpMemcpyDeviceToHost);
-    tdpMemcpyAsync(halo->fxlo, tmp, ncount*sizeof(double),
+    tdpMemcpyAsync(halo->fxlo, tmp, ncount*halo->szel,
 		   tdpMemcpyDeviceToHost, halo->stream[X]);
     tdpMemcpy(&tmp, &halo->target->fxhi, sizeof(double *),
 	      tdpMemcpyDeviceToHost);
-    tdpMemcpyAsync(halo->fxhi, tmp, ncount*sizeof(double),
+    tdpMemcpyAsync(halo->fxhi, tmp, ncount*halo->szel,
 		   tdpMemcpyDeviceToHost, halo->stream[X]);
   }
 
   /* pack Y edges on accelerator */
 
-  kernel_launch_param(hsz[Y], &nblk, &ntpb);
+  kernel_launch_param(halo->param->hsz[Y], &nblk, &ntpb);
   tdpLaunchKernel(halo->data_pack, nblk, ntpb, 0, halo->stream[Y],
 		  halo->target, Y, data);
 
   if (ndevice > 0) {
-    ncount = hsz[Y]*halo->param->nfel;
+    ncount = halo->param->hsz[Y]*halo->param->nfel;
     tdpMemcpy(&tmp, &halo->target->fylo, sizeof(double *),
 	      tdpMemcpyDeviceToHost);
-    tdpMemcpyAsync(halo->fylo, tmp, ncount*sizeof(double),
+    tdpMemcpyAsync(halo->fylo, tmp, ncount*halo->szel,
 		   tdpMemcpyDeviceToHost, halo->stream[Y]);
     tdpMemcpy(&tmp, &halo->target->fyhi, sizeof(double *),
 	      tdpMemcpyDeviceToHost);
-    tdpMemcpyAsync(halo->fyhi, tmp, ncount*sizeof(double),
+    tdpMemcpyAsync(halo->fyhi, tmp, ncount*halo->szel,
 		   tdpMemcpyDeviceToHost, halo->stream[Y]);
   }
 
   /* pack Z edges on accelerator */
 
-  kernel_launch_param(hsz[Z], &nblk, &ntpb);
+  kernel_launch_param(halo->param->hsz[Z], &nblk, &ntpb);
   tdpLaunchKernel(halo->data_pack, nblk, ntpb, 0, halo->stream[Z],
 		  halo->target, Z, data);
 
   if (ndevice > 0) {
-    ncount = hsz[Z]*halo->param->nfel;
+    ncount = halo->param->hsz[Z]*halo->param->nfel;
     tdpMemcpy(&tmp, &halo->target->fzlo, sizeof(double *),
 	      tdpMemcpyDeviceToHost);
-    tdpMemcpyAsync(halo->fzlo, tmp, ncount*sizeof(double),
+    tdpMemcpyAsync(halo->fzlo, tmp, ncount*halo->szel,
 		   tdpMemcpyDeviceToHost, halo->stream[Z]);
     tdpMemcpy(&tmp, &halo->target->fzhi, sizeof(double *),
 	      tdpMemcpyDeviceToHost);
-    tdpMemcpyAsync(halo->fzhi, tmp, ncount*sizeof(double),
+    tdpMemcpyAsync(halo->fzhi, tmp, ncount*halo->szel,
 		   tdpMemcpyDeviceToHost, halo->stream[Z]);
   }
 
+  TIMER_stop(TIMER_HALO_PACK);
 
-  /* Wait for X; copy or MPI recvs; put X halos back on device, and unpack */
+  /* Send as many directions as possible without blocking */
 
-  tdpStreamSynchronize(halo->stream[X]);
-  ncount = hsz[X]*halo->param->nfel;
+  halo->nsend = 0;
+  halo->nrecv = 0;
 
-  if (mpicartsz[X] == 1) {
-    /* note these copies do not alias for ndevice == 1 */
-    /* fxhi -> hxlo */
-    memcpy(halo->hxlo, halo->fxhi, ncount*sizeof(double));
-    tdpMemcpy(&tmp, &halo->target->hxlo, sizeof(double *),
-	      tdpMemcpyDeviceToHost);
-    tdpMemcpyAsync(tmp, halo->fxhi, ncount*sizeof(double),
-		    tdpMemcpyHostToDevice, halo->stream[X]);
-    /* fxlo -> hxhi */
-    memcpy(halo->hxhi, halo->fxlo, ncount*sizeof(double));
-    tdpMemcpy(&tmp, &halo->target->hxhi, sizeof(double *),
-	      tdpMemcpyDeviceToHost);
-    tdpMemcpyAsync(tmp, halo->fxlo, ncount*sizeof(double),
-		    tdpMemcpyHostToDevice, halo->stream[X]);
+  for (id = X; id <= Z; id++) {
+    halo_swap_send(halo, id);
+    halo->nsend += 1;
+    if (mpicartsz[id] > 1) break;
+    halo_swap_recv(halo, id, data);
+    halo->nrecv += 1;
   }
-  else {
-    MPI_Isend(halo->fxhi, ncount, MPI_DOUBLE,
-	      cs_cart_neighb(halo->cs,FORWARD,X), ftagx, comm, req_x + 2);
-    MPI_Isend(halo->fxlo, ncount, MPI_DOUBLE,
-	      cs_cart_neighb(halo->cs,BACKWARD,X), btagx, comm, req_x + 3);
 
-    for (m = 0; m < 4; m++) {
-      MPI_Waitany(4, req_x, &mc, status);
-      if (mc == 0 && ndevice > 0) {
-	tdpMemcpy(&tmp, &halo->target->hxlo, sizeof(double *),
-		  tdpMemcpyDeviceToHost);
-	tdpMemcpyAsync(tmp, halo->hxlo, ncount*sizeof(double),
-		       tdpMemcpyHostToDevice, halo->stream[X]);
-      }
-      if (mc == 1 && ndevice > 0) {
-	tdpMemcpy(&tmp, &halo->target->hxhi, sizeof(double *),
-		  tdpMemcpyDeviceToHost);
-	tdpMemcpyAsync(tmp, halo->hxhi, ncount*sizeof(double),
-		       tdpMemcpyHostToDevice, halo->stream[X]);
-      }
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  halo_swap_wait
+ *
+ *  Second half of the split-phase swap: complete the outstanding
+ *  directions in order and unpack. On return the halo is up-to-date.
+ *
+ *****************************************************************************/
+
+__host__ int halo_swap_wait(halo_swap_t * halo, void * data) {
+
+  int id;
+
+  assert(halo);
+  assert(halo->nsend >= halo->nrecv);
+
+  for (id = halo->nrecv; id <= Z; id++) {
+    if (id >= halo->nsend) {
+      halo_swap_send(halo, id);
+      halo->nsend += 1;
     }
+    halo_swap_recv(halo, id, data);
+    halo->nrecv += 1;
   }
 
-  kernel_launch_param(hsz[X], &nblk, &ntpb);
-  tdpLaunchKernel(halo->data_unpack, nblk, ntpb, 0, halo->stream[X],
-		  halo->target, X, data);
+  TIMER_start(TIMER_HALO_PACK);
+  tdpStreamSynchronize(halo->stream[X]);
+  tdpStreamSynchronize(halo->stream[Y]);
+  tdpStreamSynchronize(halo->stream[Z]);
+  TIMER_stop(TIMER_HALO_PACK);
 
-  /* Now wait for Y data to arrive from device */
-  /* Fill in 4 corners of Y edge data from X halo */
+  return 0;
+}
 
-  tdpStreamSynchronize(halo->stream[Y]);
+/*****************************************************************************
+ *
+ *  halo_swap_nmessage
+ *
+ *  Number of messages sent by halo_swap_packed() (or the split phase
+ *  equivalent) since creation. Directions which are not decomposed
+ *  are copies, and are not counted.
+ *
+ *****************************************************************************/
 
-  ih = halo->param->hext[Y][X] - nh;
-  jh = halo->param->hext[X][Y] - nh - halo->param->nswap;
-
-  for (ic = 0; ic < halo->param->nswap; ic++) {
-    for (jc = 0; jc < halo->param->nswap; jc++) {
-      for (kc = 0; kc < halo->param->nall[Z]; kc++) {
-
-	/* This looks a bit odd, but iylo and ixhi relate to Y halo,
-	 * and ixlo and iyhi relate to X halo buffers */
-        ixlo = halo_swap_bufindex(halo, X,      ic, nh + jc, kc);
-        iylo = halo_swap_bufindex(halo, Y, nd + ic,      jc, kc);
-        ixhi = halo_swap_bufindex(halo, Y, ih + ic,      jc, kc);
-        iyhi = halo_swap_bufindex(halo, X, ic,      jh + jc, kc);
-
-        for (p = 0; p < halo->param->nfel; p++) {
-          halo->fylo[hsz[Y]*p + iylo] = halo->hxlo[hsz[X]*p + ixlo];
-          halo->fyhi[hsz[Y]*p + iylo] = halo->hxlo[hsz[X]*p + iyhi];
-          halo->fylo[hsz[Y]*p + ixhi] = halo->hxhi[hsz[X]*p + ixlo];
-          halo->fyhi[hsz[Y]*p + ixhi] = halo->hxhi[hsz[X]*p + iyhi];
-        }
-      }
-    }
+__host__ int halo_swap_nmessage(halo_swap_t * halo, long int * nmessage) {
+
+  assert(halo);
+  assert(nmessage);
+
+  *nmessage = halo->nmessage;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  halo_swap_send
+ *
+ *  Wait for the packed edges in direction id to arrive from the
+ *  device, fill in any corners from the halos already received,
+ *  and send (or copy if the direction is not decomposed).
+ *
+ *****************************************************************************/
+
+static __host__ int halo_swap_send(halo_swap_t * halo, int id) {
+
+  int ncount;
+  int mpicartsz[3];
+  double * tmp;
+  double * flo = NULL;
+  double * fhi = NULL;
+  double * hlo = NULL;
+  double * hhi = NULL;
+  double ** thlo = NULL;
+  double ** thhi = NULL;
+  MPI_Comm comm;
+
+  assert(halo);
+  assert(id == X || id == Y || id == Z);
+
+  cs_cart_comm(halo->cs, &comm);
+  cs_cartsz(halo->cs, mpicartsz);
+
+  if (id == X) {
+    flo = halo->fxlo; fhi = halo->fxhi; hlo = halo->hxlo; hhi = halo->hxhi;
+    thlo = &halo->target->hxlo; thhi = &halo->target->hxhi;
+  }
+  if (id == Y) {
+    flo = halo->fylo; fhi = halo->fyhi; hlo = halo->hylo; hhi = halo->hyhi;
+    thlo = &halo->target->hylo; thhi = &halo->target->hyhi;
+  }
+  if (id == Z) {
+    flo = halo->fzlo; fhi = halo->fzhi; hlo = halo->hzlo; hhi = halo->hzhi;
+    thlo = &halo->target->hzlo; thhi = &halo->target->hzhi;
   }
 
-  /* Swap in Y, send data back to device and unpack */
+  TIMER_start(TIMER_HALO_PACK);
+  tdpStreamSynchronize(halo->stream[id]);
+  if (id != X) halo_swap_corners(halo, id);
+  TIMER_stop(TIMER_HALO_PACK);
 
-  ncount = halo->param->hsz[Y]*halo->param->nfel;
+  ncount = halo->param->hsz[id]*halo->param->nfel;
 
-  if (mpicartsz[Y] == 1) {
-    /* fyhi -> hylo */
-    memcpy(halo->hylo, halo->fyhi, ncount*sizeof(double));
-    tdpMemcpy(&tmp, &halo->target->hylo, sizeof(double *),
-	      tdpMemcpyDeviceToHost);
-    tdpMemcpyAsync(tmp, halo->fyhi, ncount*sizeof(double),
-		   tdpMemcpyHostToDevice, halo->stream[Y]);
-    /* fylo -> hyhi */
-    memcpy(halo->hyhi, halo->fylo, ncount*sizeof(double));
-    tdpMemcpy(&tmp, &halo->target->hyhi, sizeof(double *),
-	      tdpMemcpyDeviceToHost);
-    tdpMemcpyAsync(tmp, halo->fylo,ncount*sizeof(double),
-		   tdpMemcpyHostToDevice, halo->stream[Y]);
+  if (mpicartsz[id] == 1) {
+    /* note these copies do not alias for ndevice == 1 */
+    /* The host halo of X and Y is required for later corners. */
+    /* fhi -> hlo */
+    if (id != Z) memcpy(hlo, fhi, ncount*halo->szel);
+    tdpMemcpy(&tmp, thlo, sizeof(double *), tdpMemcpyDeviceToHost);
+    tdpMemcpyAsync(tmp, fhi, ncount*halo->szel,
+		   tdpMemcpyHostToDevice, halo->stream[id]);
+    /* flo -> hhi */
+    if (id != Z) memcpy(hhi, flo, ncount*halo->szel);
+    tdpMemcpy(&tmp, thhi, sizeof(double *), tdpMemcpyDeviceToHost);
+    tdpMemcpyAsync(tmp, flo, ncount*halo->szel,
+		   tdpMemcpyHostToDevice, halo->stream[id]);
   }
   else {
-    MPI_Isend(halo->fyhi, ncount, MPI_DOUBLE,
-	      cs_cart_neighb(halo->cs, FORWARD,Y), ftagy, comm, req_y + 2);
-    MPI_Isend(halo->fylo, ncount, MPI_DOUBLE,
-	      cs_cart_neighb(halo->cs, BACKWARD,Y), btagy, comm, req_y + 3);
+    MPI_Isend(fhi, ncount, halo->mpidata, cs_cart_neighb(halo->cs, FORWARD, id),
+	      ftag_[id], comm, halo->request[id] + 2);
+    MPI_Isend(flo, ncount, halo->mpidata, cs_cart_neighb(halo->cs, BACKWARD, id),
+	      btag_[id], comm, halo->request[id] + 3);
+    halo->nmessage += 2;
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  halo_swap_recv
+ *
+ *  Complete the messages in direction id, put the halo back on the
+ *  device and unpack.
+ *
+ *****************************************************************************/
+
+static __host__ int halo_swap_recv(halo_swap_t * halo, int id,
+				   void * data) {
+  int m, mc;
+  int ncount;
+  int ndevice;
+  int mpicartsz[3];
+  dim3 nblk, ntpb;
+  double * tmp;
+  double * hlo = NULL;
+  double * hhi = NULL;
+  double ** thlo = NULL;
+  double ** thhi = NULL;
+  MPI_Status status;
+
+  assert(halo);
+  assert(id == X || id == Y || id == Z);
+
+  tdpGetDeviceCount(&ndevice);
+  cs_cartsz(halo->cs, mpicartsz);
+
+  if (id == X) {
+    hlo = halo->hxlo; hhi = halo->hxhi;
+    thlo = &halo->target->hxlo; thhi = &halo->target->hxhi;
+  }
+  if (id == Y) {
+    hlo = halo->hylo; hhi = halo->hyhi;
+    thlo = &halo->target->hylo; thhi = &halo->target->hyhi;
+  }
+  if (id == Z) {
+    hlo = halo->hzlo; hhi = halo->hzhi;
+    thlo = &halo->target->hzlo; thhi = &halo->target->hzhi;
+  }
+
+  ncount = halo->param->hsz[id]*halo->param->nfel;
 
+  if (mpicartsz[id] > 1) {
     for (m = 0; m < 4; m++) {
-      MPI_Waitany(4, req_y, &mc, status);
+      TIMER_start(TIMER_HALO_WAIT);
+      MPI_Waitany(4, halo->request[id], &mc, &status);
+      TIMER_stop(TIMER_HALO_WAIT);
       if (mc == 0 && ndevice > 0) {
-	tdpMemcpy(&tmp, &halo->target->hylo, sizeof(double *),
-		  tdpMemcpyDeviceToHost);
-	tdpMemcpyAsync(tmp, halo->hylo, ncount*sizeof(double),
-		       tdpMemcpyHostToDevice, halo->stream[Y]);
+	tdpMemcpy(&tmp, thlo, sizeof(double *), tdpMemcpyDeviceToHost);
+	tdpMemcpyAsync(tmp, hlo, ncount*halo->szel,
+		       tdpMemcpyHostToDevice, halo->stream[id]);
       }
       if (mc == 1 && ndevice > 0) {
-	tdpMemcpy(&tmp, &halo->target->hyhi, sizeof(double *),
-		  tdpMemcpyDeviceToHost);
-	tdpMemcpyAsync(tmp, halo->hyhi, ncount*sizeof(double),
-			tdpMemcpyHostToDevice, halo->stream[Y]);
+	tdpMemcpy(&tmp, thhi, sizeof(double *), tdpMemcpyDeviceToHost);
+	tdpMemcpyAsync(tmp, hhi, ncount*halo->szel,
+		       tdpMemcpyHostToDevice, halo->stream[id]);
       }
     }
   }
 
+  TIMER_start(TIMER_HALO_PACK);
+  kernel_launch_param(halo->param->hsz[id], &nblk, &ntpb);
+  tdpLaunchKernel(halo->data_unpack, nblk, ntpb, 0, halo->stream[id],
+		  halo->target, id, data);
+  TIMER_stop(TIMER_HALO_PACK);
 
-  kernel_launch_param(hsz[Y], &nblk, &ntpb);
-  tdpLaunchKernel(halo->data_unpack, nblk, ntpb, 0, halo->stream[Y],
-		  halo->target, Y, data);
+  return 0;
+}
 
-  /* Wait for Z data from device */
-  /* Fill in 4 corners of Z edge data from X halo  */
+/*****************************************************************************
+ *
+ *  halo_swap_corners
+ *
+ *  Fill in the corners of the packed Y edges from the X halo, or
+ *  those of the Z edges from the X and Y halos (host buffers).
+ *
+ *****************************************************************************/
 
-  tdpStreamSynchronize(halo->stream[Z]);
+static __host__ int halo_swap_corners(halo_swap_t * halo, int id) {
 
-  ih = halo->param->hext[Z][X] - nh;
-  kh = halo->param->hext[X][Z] - nh - halo->param->nswap;
+  int ic, jc, kc;
+  int ih, jh, kh;
+  int ixlo, ixhi;
+  int iylo, iyhi;
+  int izlo, izhi;
+  int p;
+  int nd, nh;
+  int hsz[3];
 
-  for (ic = 0; ic < halo->param->nswap; ic++) {
-    for (jc = 0; jc < halo->param->nall[Y]; jc++) {
-      for (kc = 0; kc < halo->param->nswap; kc++) {
+  assert(halo);
+  assert(id == Y || id == Z);
 
-        ixlo = halo_swap_bufindex(halo, X,      ic, jc, nh + kc);
-        izlo = halo_swap_bufindex(halo, Z, nd + ic, jc,      kc);
-        ixhi = halo_swap_bufindex(halo, X,      ic, jc, kh + kc);
-	izhi = halo_swap_bufindex(halo, Z, ih + ic, jc,      kc);
+  /* hsz[] is just shorthand for local halo sizes */
+  /* An offset nd is required if nswap < nhalo */
 
-        for (p = 0; p < halo->param->nfel; p++) {
-          halo->fzlo[hsz[Z]*p + izlo] = halo->hxlo[hsz[X]*p + ixlo];
-          halo->fzhi[hsz[Z]*p + izlo] = halo->hxlo[hsz[X]*p + ixhi];
-          halo->fzlo[hsz[Z]*p + izhi] = halo->hxhi[hsz[X]*p + ixlo];
-          halo->fzhi[hsz[Z]*p + izhi] = halo->hxhi[hsz[X]*p + ixhi];
-        }
-      }
-    }
-  }
+  hsz[X] = halo->param->hsz[X];
+  hsz[Y] = halo->param->hsz[Y];
+  hsz[Z] = halo->param->hsz[Z];
+  nh = halo->param->nhalo;
+  nd = nh - halo->param->nswap;
 
-  /* Fill in 4 strips in X of Z edge data: from Y halo  */
-
-  jh = halo->param->hext[Z][Y] - nh;
-  kh = halo->param->hext[Y][Z] - nh - halo->param->nswap;
-  
-  for (ic = 0; ic < halo->param->nall[X]; ic++) {
-    for (jc = 0; jc < halo->param->nswap; jc++) {
-      for (kc = 0; kc < halo->param->nswap; kc++) {
-
-        iylo = halo_swap_bufindex(halo, Y, ic,      jc, nh + kc);
-        izlo = halo_swap_bufindex(halo, Z, ic, nd + jc,      kc);
-        iyhi = halo_swap_bufindex(halo, Y, ic,      jc, kh + kc);
-        izhi = halo_swap_bufindex(halo, Z, ic, jh + jc,      kc);
-
-        for (p = 0; p < halo->param->nfel; p++) {
-          halo->fzlo[hsz[Z]*p + izlo] = halo->hylo[hsz[Y]*p + iylo];
-          halo->fzhi[hsz[Z]*p + izlo] = halo->hylo[hsz[Y]*p + iyhi];
-          halo->fzlo[hsz[Z]*p + izhi] = halo->hyhi[hsz[Y]*p + iylo];
-          halo->fzhi[hsz[Z]*p + izhi] = halo->hyhi[hsz[Y]*p + iyhi];
-        }
+  if (id == Y) {
+
+    /* Fill in 4 corners of Y edge data from X halo */
+
+    ih = halo->param->hext[Y][X] - nh;
+    jh = halo->param->hext[X][Y] - nh - halo->param->nswap;
+
+    for (ic = 0; ic < halo->param->nswap; ic++) {
+      for (jc = 0; jc < halo->param->nswap; jc++) {
+	for (kc = 0; kc < halo->param->nall[Z]; kc++) {
+
+	  /* This looks a bit odd, but iylo and ixhi relate to Y halo,
+	   * and ixlo and iyhi relate to X halo buffers */
+	  ixlo = halo_swap_bufindex(halo, X,      ic, nh + jc, kc);
+	  iylo = halo_swap_bufindex(halo, Y, nd + ic,      jc, kc);
+	  ixhi = halo_swap_bufindex(halo, Y, ih + ic,      jc, kc);
+	  iyhi = halo_swap_bufindex(halo, X, ic,      jh + jc, kc);
+
+	  for (p = 0; p < halo->param->nfel; p++) {
+	    halo_swap_copy_el(halo, halo->fylo, hsz[Y]*p + iylo,
+			      halo->hxlo, hsz[X]*p + ixlo);
+	    halo_swap_copy_el(halo, halo->fyhi, hsz[Y]*p + iylo,
+			      halo->hxlo, hsz[X]*p + iyhi);
+	    halo_swap_copy_el(halo, halo->fylo, hsz[Y]*p + ixhi,
+			      halo->hxhi, hsz[X]*p + ixlo);
+	    halo_swap_copy_el(halo, halo->fyhi, hsz[Y]*p + ixhi,
+			      halo->hxhi, hsz[X]*p + iyhi);
+	  }
+	}
       }
     }
   }
 
+  if (id == Z) {
 
-  /* The z-direction swap  */
+    /* Fill in 4 corners of Z edge data from X halo  */
 
-  ncount = halo->param->hsz[Z]*halo->param->nfel;
+    ih = halo->param->hext[Z][X] - nh;
+    kh = halo->param->hext[X][Z] - nh - halo->param->nswap;
 
-  if (mpicartsz[Z] == 1) {
-    /* fzhi -> hzlo */
-    tdpMemcpy(&tmp, &halo->target->hzlo, sizeof(double *),
-	      tdpMemcpyDeviceToHost);
-    tdpMemcpyAsync(tmp, halo->fzhi, ncount*sizeof(double),
-		   tdpMemcpyHostToDevice, halo->stream[Z]);
-    /* fzlo -> hzhi */
-    tdpMemcpy(&tmp, &halo->target->hzhi, sizeof(double *),
-	      tdpMemcpyDeviceToHost);
-    tdpMemcpyAsync(tmp, halo->fzlo, ncount*sizeof(double),
-		   tdpMemcpyHostToDevice, halo->stream[Z]);
-  }
-  else {
-    MPI_Isend(halo->fzhi, ncount, MPI_DOUBLE,
-	      cs_cart_neighb(halo->cs,FORWARD,Z), ftagz, comm, req_z + 2);
-    MPI_Isend(halo->fzlo,  ncount, MPI_DOUBLE,
-	      cs_cart_neighb(halo->cs,BACKWARD,Z), btagz, comm, req_z + 3);
+    for (ic = 0; ic < halo->param->nswap; ic++) {
+      for (jc = 0; jc < halo->param->nall[Y]; jc++) {
+	for (kc = 0; kc < halo->param->nswap; kc++) {
 
-    for (m = 0; m < 4; m++) {
-      MPI_Waitany(4, req_z, &mc, status);
-      if (mc == 0 && ndevice > 0) {
-	tdpMemcpy(&tmp, &halo->target->hzlo, sizeof(double *),
-		  tdpMemcpyDeviceToHost);
-	tdpMemcpyAsync(tmp, halo->hzlo, ncount*sizeof(double),
-		       tdpMemcpyHostToDevice, halo->stream[Z]);
+	  ixlo = halo_swap_bufindex(halo, X,      ic, jc, nh + kc);
+	  izlo = halo_swap_bufindex(halo, Z, nd + ic, jc,      kc);
+	  ixhi = halo_swap_bufindex(halo, X,      ic, jc, kh + kc);
+	  izhi = halo_swap_bufindex(halo, Z, ih + ic, jc,      kc);
+
+	  for (p = 0; p < halo->param->nfel; p++) {
+	    halo_swap_copy_el(halo, halo->fzlo, hsz[Z]*p + izlo,
+			      halo->hxlo, hsz[X]*p + ixlo);
+	    halo_swap_copy_el(halo, halo->fzhi, hsz[Z]*p + izlo,
+			      halo->hxlo, hsz[X]*p + ixhi);
+	    halo_swap_copy_el(halo, halo->fzlo, hsz[Z]*p + izhi,
+			      halo->hxhi, hsz[X]*p + ixlo);
+	    halo_swap_copy_el(halo, halo->fzhi, hsz[Z]*p + izhi,
+			      halo->hxhi, hsz[X]*p + ixhi);
+	  }
+	}
       }
-      if (mc == 1 && ndevice > 0) {
-	tdpMemcpy(&tmp, &halo->target->hzhi, sizeof(double *),
-		  tdpMemcpyDeviceToHost);
-	tdpMemcpyAsync(tmp, halo->hzhi, ncount*sizeof(double),
-		       tdpMemcpyHostToDevice, halo->stream[Z]);
+    }
+
+    /* Fill in 4 strips in X of Z edge data: from Y halo  */
+
+    jh = halo->param->hext[Z][Y] - nh;
+    kh = halo->param->hext[Y][Z] - nh - halo->param->nswap;
+
+    for (ic = 0; ic < halo->param->nall[X]; ic++) {
+      for (jc = 0; jc < halo->param->nswap; jc++) {
+	for (kc = 0; kc < halo->param->nswap; kc++) {
+
+	  iylo = halo_swap_bufindex(halo, Y, ic,      jc, nh + kc);
+	  izlo = halo_swap_bufindex(halo, Z, ic, nd + jc,      kc);
+	  iyhi = halo_swap_bufindex(halo, Y, ic,      jc, kh + kc);
+	  izhi = halo_swap_bufindex(halo, Z, ic, jh + jc,      kc);
+
+	  for (p = 0; p < halo->param->nfel; p++) {
+	    halo_swap_copy_el(halo, halo->fzlo, hsz[Z]*p + izlo,
+			      halo->hylo, hsz[Y]*p + iylo);
+	    halo_swap_copy_el(halo, halo->fzhi, hsz[Z]*p + izlo,
+			      halo->hylo, hsz[Y]*p + iyhi);
+	    halo_swap_copy_el(halo, halo->fzlo, hsz[Z]*p + izhi,
+			      halo->hyhi, hsz[Y]*p + iylo);
+	    halo_swap_copy_el(halo, halo->fzhi, hsz[Z]*p + izhi,
+			      halo->hyhi, hsz[Y]*p + iyhi);
+	  }
+	}
       }
     }
   }
 
-  kernel_launch_param(hsz[Z], &nblk, &ntpb);
-  tdpLaunchKernel(halo->data_unpack, nblk, ntpb, 0, halo->stream[Z],
-		  halo->target, Z, data);
+  return 0;
+}
 
-  tdpStreamSynchronize(halo->stream[X]);
-  tdpStreamSynchronize(halo->stream[Y]);
-  tdpStreamSynchronize(halo->stream[Z]);
+/*****************************************************************************
+ *
+ *  halo_swap_copy_el
+ *
+ *  Copy one buffer element dst[idst] = src[isrc] of the current type.
+ *
+ *****************************************************************************/
 
-  return 0;
+static __host__ void halo_swap_copy_el(halo_swap_t * halo, double * dst,
+				       int idst, const double * src, int isrc) {
+
+  unsigned char * d = (unsigned char *) dst;
+  const unsigned char * s = (const unsigned char *) src;
+
+  memcpy(d + idst*halo->szel, s + isrc*halo->szel, halo->szel);
+
+  return;
 }
 
 /*****************************************************************************
@@ -1064,9 +1287,10 @@ __host__ int halo_swap_packed(halo_swap_t * halo, double * data) {
  *****************************************************************************/
 
 __global__
-void halo_swap_pack_rank1(halo_swap_t * halo, int id, double * data) {
+void halo_swap_pack_rank1(halo_swap_t * halo, int id, void * mbuf) {
 
   int kindex;
+  double * data = (double *) mbuf;
 
   assert(halo);
   assert(id == X || id == Y || id == Z);
@@ -1166,9 +1390,10 @@ void halo_swap_pack_rank1(halo_swap_t * halo, int id, double * data) {
  *****************************************************************************/
 
 __global__
-void halo_swap_unpack_rank1(halo_swap_t * halo, int id, double * data) {
+void halo_swap_unpack_rank1(halo_swap_t * halo, int id, void * mbuf) {
 
   int kindex;
+  double * data = (double *) mbuf;
 
   assert(halo);
   assert(id == X || id == Y || id == Z);
@@ -1265,6 +1490,163 @@ void halo_swap_unpack_rank1(halo_swap_t * halo, int id, double * data) {
   return;
 }
 
+/*****************************************************************************
+ *
+ *  halo_swap_pack_rank1_float
+ *
+ *  As halo_swap_pack_rank1() for data stored as float (rank 1 or
+ *  rank 2). Requires halo_swap_datatype_set(halo, MPI_FLOAT).
+ *
+ *****************************************************************************/
+
+__global__
+void halo_swap_pack_rank1_float(halo_swap_t * halo, int id, void * mbuf) {
+
+  int kindex;
+  float * data = (float *) mbuf;
+
+  assert(halo);
+  assert(id == X || id == Y || id == Z);
+  assert(data);
+
+  for_simt_parallel(kindex, halo->param->hsz[id], 1) {
+
+    int nh;
+    int hsz;
+    int ia, ib, nel;
+    int indexl, indexh, ic, jc, kc;
+    int hi; /* high end offset */
+    float * __restrict__ buflo = NULL;
+    float * __restrict__ bufhi = NULL;
+    halo_swap_param_t * hp;
+
+    hp = halo->param;
+    hsz = halo->param->hsz[id];
+
+    nh = halo->param->nhalo;
+    halo_swap_coords(halo, id, kindex, &ic, &jc, &kc);
+
+    indexl = 0;
+    indexh = 0;
+
+    if (id == X) {
+      hi = nh + hp->nlocal[X] - hp->nswap;
+      indexl = halo_swap_index(halo, hp->nhalo + ic, jc, kc);
+      indexh = halo_swap_index(halo, hi + ic, jc, kc);
+      buflo = (float *) halo->fxlo;
+      bufhi = (float *) halo->fxhi;
+    }
+    if (id == Y) {
+      hi = nh + hp->nlocal[Y] - hp->nswap;
+      indexl = halo_swap_index(halo, ic, nh + jc, kc);
+      indexh = halo_swap_index(halo, ic, hi + jc, kc);
+      buflo = (float *) halo->fylo;
+      bufhi = (float *) halo->fyhi;
+    }
+    if (id == Z) {
+      hi = nh + hp->nlocal[Z] - hp->nswap;
+      indexl = halo_swap_index(halo, ic, jc, nh + kc);
+      indexh = halo_swap_index(halo, ic, jc, hi + kc);
+      buflo = (float *) halo->fzlo;
+      bufhi = (float *) halo->fzhi;
+    }
+
+    /* Rank 1 is the special case nb = 1 */
+
+    nel = 0;
+    for (ia = 0; ia < hp->na; ia++) {
+      for (ib = 0; ib < hp->nb; ib++) {
+	buflo[hsz*nel + kindex] =
+	  data[addr_rank2(hp->naddr, hp->na, hp->nb, indexl, ia, ib)];
+	bufhi[hsz*nel + kindex] =
+	  data[addr_rank2(hp->naddr, hp->na, hp->nb, indexh, ia, ib)];
+	nel += 1;
+      }
+    }
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  halo_swap_unpack_rank1_float
+ *
+ *  As halo_swap_unpack_rank1() for data stored as float.
+ *
+ *****************************************************************************/
+
+__global__
+void halo_swap_unpack_rank1_float(halo_swap_t * halo, int id, void * mbuf) {
+
+  int kindex;
+  float * data = (float *) mbuf;
+
+  assert(halo);
+  assert(id == X || id == Y || id == Z);
+  assert(data);
+
+  for_simt_parallel(kindex, halo->param->hsz[id], 1) {
+
+    int hsz;
+    int ia, ib, nel;
+    int indexl, indexh;
+    int nh;                          /* Full halo width */
+    int ic, jc, kc;                  /* Lattice ooords */
+    int lo, hi;                      /* Offset for low, high end */
+    float * __restrict__ buflo = NULL;
+    float * __restrict__ bufhi = NULL;
+    halo_swap_param_t * hp;
+
+    hp = halo->param;
+    hsz = halo->param->hsz[id];
+
+    nh = halo->param->nhalo;
+    halo_swap_coords(halo, id, kindex, &ic, &jc, &kc);
+
+    indexl = 0;
+    indexh = 0;
+    lo = nh - hp->nswap;
+
+    if (id == X) {
+      hi = nh + hp->nlocal[X];
+      indexl = halo_swap_index(halo, lo + ic, jc, kc);
+      indexh = halo_swap_index(halo, hi + ic, jc, kc);
+      buflo = (float *) halo->hxlo;
+      bufhi = (float *) halo->hxhi;
+    }
+
+    if (id == Y) {
+      hi = nh + hp->nlocal[Y];
+      indexl = halo_swap_index(halo, ic, lo + jc, kc);
+      indexh = halo_swap_index(halo, ic, hi + jc, kc);
+      buflo = (float *) halo->hylo;
+      bufhi = (float *) halo->hyhi;
+    }
+
+    if (id == Z) {
+      hi = nh + hp->nlocal[Z];
+      indexl = halo_swap_index(halo, ic, jc, lo + kc);
+      indexh = halo_swap_index(halo, ic, jc, hi + kc);
+      buflo = (float *) halo->hzlo;
+      bufhi = (float *) halo->hzhi;
+    }
+
+    nel = 0;
+    for (ia = 0; ia < hp->na; ia++) {
+      for (ib = 0; ib < hp->nb; ib++) {
+	data[addr_rank2(hp->naddr, hp->na, hp->nb, indexl, ia, ib)] =
+	  buflo[hsz*nel + kindex];
+	data[addr_rank2(hp->naddr, hp->na, hp->nb, indexh, ia, ib)] =
+	  bufhi[hsz*nel + kindex];
+	nel += 1;
+      }
+    }
+  }
+
+  return;
+}
+
 /*****************************************************************************
  *
  *  halo_swap_coords
@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2012-2018 The University of Edinburgh
+ *  (c) 2012-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -27,6 +27,7 @@
 static int hydro_lees_edwards_parallel(hydro_t * obj);
 static int hydro_u_write(FILE * fp, int index, void * self);
 static int hydro_u_write_ascii(FILE * fp, int index, void * self);
+static int hydro_u_pack(void * self, char * buf);
 static int hydro_u_read(FILE * fp, int index, void * self);
 static int hydro_u_read_ascii(FILE * fp, int index, void * self);
 
@@ -78,12 +79,10 @@ __host__ int hydro_create(pe_t * pe, cs_t * cs, lees_edw_t * le, int nhcomm,
   cs_nsites(cs, &obj->nsite);
   if (le) lees_edw_nsites(le, &obj->nsite);
 
-  obj->u = (double *) mem_aligned_calloc(MEM_PAGESIZE, NHDIM*obj->nsite,
-					 sizeof(double));
+  obj->u = (double *) mem_lattice_calloc(obj->nsite, NHDIM, sizeof(double));
   if (obj->u == NULL) pe_fatal(pe, "calloc(hydro->u) failed\n");
 
-  obj->f = (double *) mem_aligned_calloc(MEM_PAGESIZE, NHDIM*obj->nsite,
-					 sizeof(double));
+  obj->f = (double *) mem_lattice_calloc(obj->nsite, NHDIM, sizeof(double));
   if (obj->f == NULL) pe_fatal(pe, "calloc(hydro->f) failed\n");
 
   halo_swap_create_r1(pe, cs, nhcomm, obj->nsite, NHDIM, &obj->halo);
@@ -148,8 +147,8 @@ __host__ int hydro_free(hydro_t * obj) {
   }
 
   halo_swap_free(obj->halo);
-  free(obj->f);
-  free(obj->u);
+  mem_lattice_free(obj->f);
+  mem_lattice_free(obj->u);
   free(obj);
 
   return 0;
@@ -272,6 +271,7 @@ __host__ int hydro_init_io_info(hydro_t * obj, int grid[3], int form_in,
   io_info_write_set(obj->info, IO_FORMAT_ASCII, hydro_u_write_ascii);
   io_info_read_set(obj->info, IO_FORMAT_BINARY, hydro_u_read);
   io_info_read_set(obj->info, IO_FORMAT_ASCII, hydro_u_read_ascii);
+  io_info_pack_set(obj->info, hydro_u_pack);
 
   /* ASCII output size (see write_ascii) is 69 bytes */
   io_info_set_bytesize(obj->info, IO_FORMAT_BINARY, NHDIM*sizeof(double));
@@ -754,6 +754,43 @@ static int hydro_u_write(FILE * fp, int index, void * arg) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  hydro_u_pack
+ *
+ *  Binary velocity for all local sites to buf (as hydro_u_write).
+ *
+ *****************************************************************************/
+
+static int hydro_u_pack(void * self, char * buf) {
+
+  int ic, jc, kc, ia;
+  int index0;
+  int nlocal[3];
+  double * out = (double *) buf;
+  hydro_t * obj = (hydro_t *) self;
+
+  assert(obj);
+  assert(buf);
+
+  cs_nlocal(obj->cs, nlocal);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      index0 = cs_index(obj->cs, ic, jc, 1);
+      for (ia = 0; ia < NHDIM; ia++) {
+	for (kc = 0; kc < nlocal[Z]; kc++) {
+	  out[kc*NHDIM + ia]
+	    = obj->u[addr_rank1(obj->nsite, NHDIM, index0 + kc, ia)];
+	}
+      }
+      out += NHDIM*nlocal[Z];
+    }
+  }
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  hydro_u_write_ascii
@@ -79,6 +79,9 @@ static int hydro_do_init(pe_t * pe, rt_t * rt, cs_t * cs, lees_edw_t * le,
     io_format_in = IO_FORMAT_ASCII;
     io_format_out = IO_FORMAT_ASCII;
   }
+  if (strcmp(value, "BINARY_MPIIO") == 0) {
+    io_format_out = IO_FORMAT_BINARY_MPIIO;
+  }
 
   hydro_init_io_info(obj, io_grid, io_format_in, io_format_out);
 
@@ -17,7 +17,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2018 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -35,6 +35,7 @@
 #include "control.h"
 #include "stats_colloid.h"
 #include "driven_colloid.h"
+#include "colloid_nlist.h"
 #include "interaction.h"
 
 struct interact_s {
@@ -208,6 +209,7 @@ int interact_compute(interact_t * interact, colloids_info_t * cinfo,
       pe_info(interact->pe, "\nParticle statistics:\n");
 
       interact_stats(interact, cinfo);
+      interact_nlist_stats(interact, cinfo);
       pe_info(interact->pe, "\n");
       stats_colloid_velocity_minmax(cinfo);
     }
@@ -326,6 +328,35 @@ int interact_stats(interact_t * obj, colloids_info_t * cinfo) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  interact_nlist_stats
+ *
+ *  Report the frequency of neighbour list rebuilds (if a skin is set).
+ *
+ *****************************************************************************/
+
+int interact_nlist_stats(interact_t * obj, colloids_info_t * cinfo) {
+
+  int nbuild = 0;
+  int nupdate = 0;
+  double skin = 0.0;
+  colloid_nlist_t * nlist = NULL;
+
+  assert(obj);
+  assert(cinfo);
+
+  colloids_info_nlist(cinfo, &nlist);
+  colloid_nlist_skin(nlist, &skin);
+
+  if (skin > 0.0) {
+    colloid_nlist_stats(nlist, &nbuild, &nupdate);
+    pe_info(obj->pe, "Verlet list builds/updates:  %d/%d\n", nbuild, nupdate);
+  }
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  colloid_forces_zero_set
@@ -528,10 +559,22 @@ int colloids_update_forces_fluid_driven(colloids_info_t * cinfo,
 int interact_pairwise(interact_t * obj, colloids_info_t * cinfo) {
 
   void * intr = NULL;
+  double skin = 0.0;
+  colloid_nlist_t * nlist = NULL;
 
   assert(obj);
   assert(cinfo);
 
+  /* The neighbour list is shared by all the pairwise interactions
+   * (including the Ewald real space sum, if the skin is set). */
+
+  colloids_info_nlist(cinfo, &nlist);
+  colloid_nlist_skin(nlist, &skin);
+
+  if (obj->abstr[INTERACT_LUBR] || obj->abstr[INTERACT_PAIR] || skin > 0.0) {
+    colloid_nlist_update(nlist, cinfo);
+  }
+
   intr = obj->abstr[INTERACT_LUBR];
   if (intr) obj->compute[INTERACT_LUBR](cinfo, intr);
 
@@ -746,8 +789,10 @@ int interact_range_check(interact_t * obj, colloids_info_t * cinfo) {
   double rmax = 0.0;
   double lmin = DBL_MAX;
   double hc, rc;
+  double skin = 0.0;
 
   double lcell[3];
+  colloid_nlist_t * nlist = NULL;
 
   assert(obj);
   assert(cinfo);
@@ -764,6 +809,12 @@ int interact_range_check(interact_t * obj, colloids_info_t * cinfo) {
   interact_hcmax(obj, &hc);
   rmax = dmax(2.0*ahmax + hc, rc);
 
+  /* Any Verlet skin must also fit in the cell list */
+
+  colloids_info_nlist(cinfo, &nlist);
+  colloid_nlist_skin(nlist, &skin);
+  rmax += skin;
+
   /* Check against the cell list */
 
   colloids_info_ncell(cinfo, ncell);
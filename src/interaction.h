@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2011-2017 The University of Edinburgh
+ *  (c) 2011-2019 The University of Edinburgh
  *
  *  Kevin Stratford (kevin@epc.ed.ac.uk)
  *
@@ -61,6 +61,7 @@ int interact_bonds(interact_t * obj, colloids_info_t * cinfo);
 int interact_angles(interact_t * obj, colloids_info_t * cinfo);
 int interact_find_bonds(interact_t * obj, colloids_info_t * cinfo);
 int interact_stats(interact_t * obj, colloids_info_t * cinfo);
+int interact_nlist_stats(interact_t * obj, colloids_info_t * cinfo);
 int interact_hcmax(interact_t * obj, double * hcmax);
 int interact_rcmax(interact_t * obj, double * rcmax);
 
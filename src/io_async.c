@@ -0,0 +1,430 @@
+/*****************************************************************************
+ *
+ *  io_async.c
+ *
+ *  Asynchronous (background) output of lattice quantities.
+ *
+ *  A write takes a snapshot of the local data into a staging buffer
+ *  (via io_write_data_pack()) and returns immediately. A dedicated
+ *  I/O thread on each rank then drains the staging buffers to disk,
+ *  while the time step loop continues. The thread makes no MPI calls:
+ *  each rank writes its own block of the usual single decomposition
+ *  independent file directly at the appropriate offsets, so the files
+ *  are identical to those from io_write_data().
+ *
+ *  Memory is bounded: staging buffers are grouped by time step, and
+ *  at most nbuffer time steps may be outstanding. A write for a new
+ *  time step will block until output from the step nbuffer steps
+ *  previous has been completed. With nbuffer = 2 (the default), one
+ *  checkpoint may be written while the next is staged.
+ *
+ *  Formats which cannot be written in this way (ASCII, or processor
+ *  dependent output) are written synchronously via io_write_data().
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "io_async.h"
+
+typedef struct io_async_req_s io_async_req_t;
+
+struct io_async_req_s {
+  char filename[FILENAME_MAX];  /* Full file name */
+  char * buf;                   /* Staged local data */
+  size_t itemsz;                /* Bytes per site */
+  int nlocal[3];                /* Local lattice ... */
+  int ntotal[3];                /* ... system size ... */
+  int noffset[3];               /* ... and offset of local block in file */
+  io_async_req_t * next;        /* Queue */
+};
+
+struct io_async_s {
+  pe_t * pe;
+  cs_t * cs;
+  int nbuffer;                  /* Max. time steps outstanding */
+  int step;                     /* Time step of current staging epoch */
+  int epoch;                    /* Current staging epoch (-1 before first) */
+  long int * mark;              /* Requests submitted at end of each epoch */
+  long int nsubmit;             /* Requests submitted */
+  long int ncomplete;           /* Requests completed by I/O thread */
+  int ifail;                    /* Error flag from I/O thread */
+  int shutdown;                 /* Signal for I/O thread to exit */
+  io_async_req_t * head;        /* Queue of pending requests ... */
+  io_async_req_t * tail;        /* ... in order of submission */
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t work;          /* Signals new request or shutdown */
+  pthread_cond_t done;          /* Signals request completed */
+};
+
+static void * io_async_thread(void * arg);
+static int io_async_write_local(io_async_t * obj, io_async_req_t * req);
+static int io_async_epoch(io_async_t * obj, int step);
+static int io_async_drain(io_async_t * obj, long int ncomplete);
+
+/*****************************************************************************
+ *
+ *  io_async_create
+ *
+ *****************************************************************************/
+
+__host__ int io_async_create(pe_t * pe, cs_t * cs, int nbuffer,
+			     io_async_t ** pobj) {
+
+  io_async_t * obj = NULL;
+
+  assert(pe);
+  assert(cs);
+  assert(pobj);
+
+  if (nbuffer < 1) pe_fatal(pe, "io_async: nbuffer must be at least 1\n");
+
+  obj = (io_async_t *) calloc(1, sizeof(io_async_t));
+  assert(obj);
+  if (obj == NULL) pe_fatal(pe, "calloc(io_async_t) failed\n");
+
+  obj->mark = (long int *) calloc(nbuffer, sizeof(long int));
+  assert(obj->mark);
+  if (obj->mark == NULL) pe_fatal(pe, "calloc(io_async_t->mark) failed\n");
+
+  obj->pe = pe;
+  obj->cs = cs;
+  obj->nbuffer = nbuffer;
+  obj->epoch = -1;
+
+  pthread_mutex_init(&obj->lock, NULL);
+  pthread_cond_init(&obj->work, NULL);
+  pthread_cond_init(&obj->done, NULL);
+
+  if (pthread_create(&obj->thread, NULL, io_async_thread, obj) != 0) {
+    pe_fatal(pe, "io_async: failed to create I/O thread\n");
+  }
+
+  pe_retain(pe);
+  cs_retain(cs);
+
+  *pobj = obj;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  io_async_free
+ *
+ *  All outstanding output is completed first.
+ *
+ *****************************************************************************/
+
+__host__ int io_async_free(io_async_t * obj) {
+
+  assert(obj);
+
+  io_async_wait(obj);
+
+  pthread_mutex_lock(&obj->lock);
+  obj->shutdown = 1;
+  pthread_cond_signal(&obj->work);
+  pthread_mutex_unlock(&obj->lock);
+
+  pthread_join(obj->thread, NULL);
+
+  pthread_cond_destroy(&obj->done);
+  pthread_cond_destroy(&obj->work);
+  pthread_mutex_destroy(&obj->lock);
+
+  cs_free(obj->cs);
+  pe_free(obj->pe);
+
+  free(obj->mark);
+  free(obj);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  io_async_write
+ *
+ *  Collective. Stage the data for output at time step 'step' and
+ *  return. The file is created (truncated) here, so any existing
+ *  file of the same name is replaced as for io_write_data().
+ *
+ *****************************************************************************/
+
+__host__ int io_async_write(io_async_t * obj, int step, io_info_t * info,
+			    const char * filename_stub, void * data) {
+
+  int ifail;
+  FILE * fp = NULL;
+  MPI_Comm comm;
+  io_async_req_t * req = NULL;
+
+  assert(obj);
+  assert(info);
+  assert(filename_stub);
+  assert(data);
+
+  io_async_epoch(obj, step);
+
+  req = (io_async_req_t *) calloc(1, sizeof(io_async_req_t));
+  assert(req);
+  if (req == NULL) pe_fatal(obj->pe, "calloc(io_async_req_t) failed\n");
+
+  ifail = io_write_data_pack(info, data, &req->buf, &req->itemsz);
+
+  if (ifail) {
+    /* Not available asynchronously */
+    free(req);
+    io_write_data(info, filename_stub, data);
+    return 0;
+  }
+
+  assert(strlen(filename_stub) < FILENAME_MAX/2);
+  sprintf(req->filename, "%s.%3.3d-%3.3d", filename_stub, 1, 1);
+  cs_nlocal(obj->cs, req->nlocal);
+  cs_ntotal(obj->cs, req->ntotal);
+  cs_nlocal_offset(obj->cs, req->noffset);
+
+  /* The file must exist, and be empty, before any rank writes */
+
+  cs_cart_comm(obj->cs, &comm);
+
+  if (cs_cart_rank(obj->cs) == 0) {
+    fp = fopen(req->filename, "wb");
+    if (fp == NULL) pe_fatal(obj->pe, "Failed to open %s\n", req->filename);
+    fclose(fp);
+  }
+
+  MPI_Barrier(comm);
+
+  /* Queue for the I/O thread */
+
+  pthread_mutex_lock(&obj->lock);
+  if (obj->tail) {
+    obj->tail->next = req;
+  }
+  else {
+    obj->head = req;
+  }
+  obj->tail = req;
+  obj->nsubmit += 1;
+  pthread_cond_signal(&obj->work);
+  pthread_mutex_unlock(&obj->lock);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  io_async_wait
+ *
+ *  Collective. Block until all outstanding output is complete on all
+ *  ranks, i.e., all files are complete on return.
+ *
+ *****************************************************************************/
+
+__host__ int io_async_wait(io_async_t * obj) {
+
+  MPI_Comm comm;
+
+  assert(obj);
+
+  pthread_mutex_lock(&obj->lock);
+  io_async_drain(obj, obj->nsubmit);
+  pthread_mutex_unlock(&obj->lock);
+
+  cs_cart_comm(obj->cs, &comm);
+  MPI_Barrier(comm);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  io_async_pending
+ *
+ *  Number of requests not yet completed (this rank).
+ *
+ *****************************************************************************/
+
+__host__ int io_async_pending(io_async_t * obj, int * npending) {
+
+  assert(obj);
+  assert(npending);
+
+  pthread_mutex_lock(&obj->lock);
+  *npending = obj->nsubmit - obj->ncomplete;
+  pthread_mutex_unlock(&obj->lock);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  io_async_epoch
+ *
+ *  Requests from the same time step belong to the same staging epoch.
+ *  On starting a new epoch, wait until the epoch nbuffer previous is
+ *  complete, so at most nbuffer epochs are ever staged at once.
+ *
+ *****************************************************************************/
+
+static int io_async_epoch(io_async_t * obj, int step) {
+
+  int ib;
+
+  assert(obj);
+
+  if (obj->epoch >= 0 && step == obj->step) return 0;
+
+  pthread_mutex_lock(&obj->lock);
+
+  if (obj->epoch >= 0) {
+    /* Close the current epoch */
+    obj->mark[obj->epoch % obj->nbuffer] = obj->nsubmit;
+  }
+
+  obj->epoch += 1;
+  obj->step = step;
+
+  /* mark[ib] now holds the end of the epoch nbuffer previous */
+  ib = obj->epoch % obj->nbuffer;
+  io_async_drain(obj, obj->mark[ib]);
+
+  pthread_mutex_unlock(&obj->lock);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  io_async_drain
+ *
+ *  Wait until at least ncomplete requests have completed. The lock
+ *  must be held by the caller.
+ *
+ *****************************************************************************/
+
+static int io_async_drain(io_async_t * obj, long int ncomplete) {
+
+  assert(obj);
+
+  while (obj->ncomplete < ncomplete) {
+    pthread_cond_wait(&obj->done, &obj->lock);
+  }
+
+  if (obj->ifail) {
+    pe_fatal(obj->pe, "io_async: file error in background write\n");
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  io_async_thread
+ *
+ *  The I/O thread: write each request in turn until shutdown.
+ *
+ *****************************************************************************/
+
+static void * io_async_thread(void * arg) {
+
+  int ifail;
+  io_async_t * obj = (io_async_t *) arg;
+  io_async_req_t * req = NULL;
+
+  assert(obj);
+
+  pthread_mutex_lock(&obj->lock);
+
+  while (1) {
+
+    while (obj->head == NULL && obj->shutdown == 0) {
+      pthread_cond_wait(&obj->work, &obj->lock);
+    }
+    if (obj->head == NULL) break;
+
+    req = obj->head;
+    pthread_mutex_unlock(&obj->lock);
+
+    ifail = io_async_write_local(obj, req);
+
+    pthread_mutex_lock(&obj->lock);
+    obj->head = req->next;
+    if (obj->head == NULL) obj->tail = NULL;
+    obj->ncomplete += 1;
+    obj->ifail += ifail;
+    pthread_cond_broadcast(&obj->done);
+
+    free(req->buf);
+    free(req);
+  }
+
+  pthread_mutex_unlock(&obj->lock);
+
+  return NULL;
+}
+
+/*****************************************************************************
+ *
+ *  io_async_write_local
+ *
+ *  Write this rank's block of the file. The staged buffer holds
+ *  contiguous z-strips for each (ic, jc) in local order; strips which
+ *  are also contiguous in the file are written together.
+ *
+ *  Called from the I/O thread: no MPI, no pe_fatal(), and no access
+ *  to shared objects.
+ *
+ *****************************************************************************/
+
+static int io_async_write_local(io_async_t * obj, io_async_req_t * req) {
+
+  int ic, jc;
+  long int offset;
+  long int nextoffset = -1;
+  size_t stripsz;
+  FILE * fp = NULL;
+
+  assert(obj);
+  assert(req);
+
+  fp = fopen(req->filename, "r+b");
+  if (fp == NULL) return 1;
+
+  stripsz = req->itemsz*req->nlocal[Z];
+
+  for (ic = 0; ic < req->nlocal[X]; ic++) {
+    for (jc = 0; jc < req->nlocal[Y]; jc++) {
+      offset = (long int) (req->noffset[X] + ic)*req->ntotal[Y]
+	+ (req->noffset[Y] + jc);
+      offset = offset*req->ntotal[Z] + req->noffset[Z];
+      offset *= req->itemsz;
+      if (offset != nextoffset) fseek(fp, offset, SEEK_SET);
+      fwrite(req->buf + (ic*req->nlocal[Y] + jc)*stripsz, 1, stripsz, fp);
+      nextoffset = offset + stripsz;
+    }
+  }
+
+  if (ferror(fp)) {
+    fclose(fp);
+    return 1;
+  }
+
+  return (fclose(fp) == 0) ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+/*****************************************************************************
+ *
+ *  io_async.h
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#ifndef LUDWIG_IO_ASYNC_H
+#define LUDWIG_IO_ASYNC_H
+
+#include "pe.h"
+#include "coords.h"
+#include "io_harness.h"
+
+typedef struct io_async_s io_async_t;
+
+__host__ int io_async_create(pe_t * pe, cs_t * cs, int nbuffer,
+			     io_async_t ** pobj);
+__host__ int io_async_free(io_async_t * obj);
+__host__ int io_async_write(io_async_t * obj, int step, io_info_t * info,
+			    const char * filename_stub, void * data);
+__host__ int io_async_wait(io_async_t * obj);
+__host__ int io_async_pending(io_async_t * obj, int * npending);
+
+#endif
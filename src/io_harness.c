@@ -16,11 +16,15 @@
  *  lattice Cartesian communicator. Each IO communicator group so
  *  defined then deals with its own file.
  *
+ *  Binary output may alternatively use MPI-IO (IO_FORMAT_BINARY_MPIIO),
+ *  where all ranks write the single decomposition-independent file
+ *  collectively via a subarray file view. The file layout is the same.
+ *
  *
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2007-2018 The University of Edinburgh
+ *  (c) 2007-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -75,6 +79,7 @@ struct io_info_s {
   io_rw_cb_ft read_data;
   io_rw_cb_ft read_ascii;
   io_rw_cb_ft read_binary;
+  io_pack_cb_ft pack_binary;         /* Optional: pack all local sites */
 };
 
 static void io_set_group_filename(char *, const char *, io_info_t *);
@@ -86,6 +91,9 @@ static int io_decomposition_free(io_decomposition_t *);
 
 int io_write_data_p(io_info_t * obj, const char * filename_stub, void * data);
 int io_write_data_s(io_info_t * obj, const char * filename_stub, void * data);
+int io_write_data_mpiio(io_info_t * obj, const char * filename_stub,
+			void * data);
+static int io_pack_local_buf(io_info_t * obj, void * data, char * buf);
 int io_unpack_local_buf(io_info_t * obj, int mpi_sender, const char * buf,
 			char * io_buf);
 
@@ -600,6 +608,7 @@ int io_info_format_in_set(io_info_t * obj, int form_in) {
     obj->processor_independent = 0;
     break;
   case IO_FORMAT_BINARY:
+  case IO_FORMAT_BINARY_MPIIO:
   case IO_FORMAT_DEFAULT:
     obj->read_data = obj->read_binary;
     obj->processor_independent = 1;
@@ -640,6 +649,12 @@ int io_info_format_out_set(io_info_t * obj, int form_out) {
     obj->processor_independent = 1;
     obj->bytesize = obj->bytesize_binary;
     break;
+  case IO_FORMAT_BINARY_MPIIO:
+    obj->output_format = IO_FORMAT_BINARY_MPIIO;
+    obj->write_data = obj->write_binary;
+    obj->processor_independent = 1;
+    obj->bytesize = obj->bytesize_binary;
+    break;
   default:
     pe_fatal(obj->pe, "Bad i/o output format\n");
   }
@@ -683,6 +698,26 @@ int io_info_write_set(io_info_t * obj, int format, io_rw_cb_ft f) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  io_info_pack_set
+ *
+ *  Optional binary pack function which writes all local sites to a
+ *  contiguous buffer in the same order (and format) as the site-by-site
+ *  binary write callback. If present, it is used for aggregated output.
+ *
+ *****************************************************************************/
+
+int io_info_pack_set(io_info_t * obj, io_pack_cb_ft f) {
+
+  assert(obj);
+  assert(f);
+
+  obj->pack_binary = f;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  io_write_data
@@ -708,10 +743,15 @@ int io_write_data(io_info_t * obj, const char * filename_stub, void * data) {
     io_write_data_p(obj, filename_stub, data);
   }
   else {
-    /* This is serial output format if one I/O group */
-    assert(obj->io_comm->ngroup[X] == 1);
     t0 = MPI_Wtime();
-    io_write_data_s(obj, filename_stub, data);
+    if (obj->output_format == IO_FORMAT_BINARY_MPIIO) {
+      io_write_data_mpiio(obj, filename_stub, data);
+    }
+    else {
+      /* This is serial output format if one I/O group */
+      assert(obj->io_comm->ngroup[X] == 1);
+      io_write_data_s(obj, filename_stub, data);
+    }
     t1 = MPI_Wtime();
     if (obj->report) {
       pe_info(obj->pe, "Write %lu bytes in %f secs %f GB/s\n",
@@ -816,7 +856,6 @@ int io_write_data_p(io_info_t * obj, const char * filename_stub, void * data) {
 int io_write_data_s(io_info_t * obj, const char * filename_stub, void * data) {
 
   int nr;
-  int ic, jc, kc, index;
   int nlocal[3];
   int itemsz;                      /* Data size per site (bytes) */
   int iosz;                        /* Data size io_buf (bytes) */
@@ -827,7 +866,6 @@ int io_write_data_s(io_info_t * obj, const char * filename_stub, void * data) {
   char filename_io[FILENAME_MAX];
   long int offset;
   FILE * fp_state = NULL;
-  FILE * fp_buf;
 
   const int tag = 2017;
   MPI_Status status;
@@ -844,27 +882,13 @@ int io_write_data_s(io_info_t * obj, const char * filename_stub, void * data) {
 
   itemsz = obj->bytesize;
 
-  /* Local buffer to be assoicated with file handle for write... */
+  /* Write to the local buffer in local order */
 
   localsz = itemsz*nlocal[X]*nlocal[Y]*nlocal[Z];
   buf = (char *) malloc(localsz*sizeof(char));
-  fp_buf = fopen("/dev/null", "w"); /* TODO: de-hardwire this */
-  setvbuf(fp_buf, buf, _IOFBF, localsz);
-
-  if (buf == NULL || fp_buf == NULL) {
-    pe_fatal(obj->pe, "Buffer initialisation failed\n");
-  }
-
-  /* Write to the local buffer in local order */
+  if (buf == NULL) pe_fatal(obj->pe, "malloc(buf)\n");
 
-  for (ic = 1; ic <= nlocal[X]; ic++) {
-    for (jc = 1; jc <= nlocal[Y]; jc++) {
-      for (kc = 1; kc <= nlocal[Z]; kc++) {
-	index = cs_index(obj->cs, ic, jc, kc);
-	obj->write_data(fp_buf, index, data);
-      }
-    }
-  }
+  io_pack_local_buf(obj, data, buf);
 
   /* Send local buffer to root. */
 
@@ -925,12 +949,190 @@ int io_write_data_s(io_info_t * obj, const char * filename_stub, void * data) {
     free(io_buf);
   }
 
-  fclose(fp_buf);
   free(buf);
 
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  io_write_data_mpiio
+ *
+ *  Decomposition-independent output via MPI-IO. Each rank packs its
+ *  local sites into a contiguous buffer; the file view is the local
+ *  subarray of the global lattice (with the site record as the
+ *  fastest-varying dimension), so a single collective write produces
+ *  the same file as io_write_data_s().
+ *
+ *****************************************************************************/
+
+int io_write_data_mpiio(io_info_t * obj, const char * filename_stub,
+			void * data) {
+
+  int ifail;
+  int itemsz;                      /* Data size per site (bytes) */
+  int localsz;                     /* Data size local buffer (bytes) */
+  int nlocal[3];
+  int ntotal[3];
+  int noffset[3];
+  int sizes[4], subsizes[4], starts[4];
+  char * buf = NULL;
+  char filename_io[FILENAME_MAX];
+
+  MPI_Comm comm;
+  MPI_Datatype filetype;
+  MPI_File fh = MPI_FILE_NULL;
+  MPI_Status status;
+
+  assert(obj);
+  assert(data);
+
+  if (obj->io_comm->n_io != 1) {
+    pe_fatal(obj->pe, "MPI-IO output requires a single I/O group\n");
+  }
+
+  if (obj->metadata_written == 0) io_write_metadata(obj);
+
+  cs_cart_comm(obj->cs, &comm);
+  cs_nlocal(obj->cs, nlocal);
+  cs_ntotal(obj->cs, ntotal);
+  cs_nlocal_offset(obj->cs, noffset);
+  sprintf(filename_io, "%s.%3.3d-%3.3d", filename_stub, 1, 1);
+
+  itemsz = obj->bytesize;
+  localsz = itemsz*nlocal[X]*nlocal[Y]*nlocal[Z];
+
+  buf = (char *) malloc(localsz*sizeof(char));
+  if (buf == NULL) pe_fatal(obj->pe, "malloc(buf)\n");
+
+  io_pack_local_buf(obj, data, buf);
+
+  /* File view: this rank's block of the global {X, Y, Z, record} array */
+
+  sizes[X] = ntotal[X]; subsizes[X] = nlocal[X]; starts[X] = noffset[X];
+  sizes[Y] = ntotal[Y]; subsizes[Y] = nlocal[Y]; starts[Y] = noffset[Y];
+  sizes[Z] = ntotal[Z]; subsizes[Z] = nlocal[Z]; starts[Z] = noffset[Z];
+  sizes[3] = itemsz;    subsizes[3] = itemsz;    starts[3] = 0;
+
+  MPI_Type_create_subarray(4, sizes, subsizes, starts, MPI_ORDER_C,
+			   MPI_BYTE, &filetype);
+  MPI_Type_commit(&filetype);
+
+  ifail = MPI_File_open(comm, filename_io, MPI_MODE_WRONLY | MPI_MODE_CREATE,
+			MPI_INFO_NULL, &fh);
+  if (ifail != MPI_SUCCESS) {
+    pe_fatal(obj->pe, "MPI_File_open(%s) failed\n", filename_io);
+  }
+
+  MPI_File_set_size(fh, 0);
+  MPI_File_set_view(fh, 0, MPI_BYTE, filetype, "native", MPI_INFO_NULL);
+
+  ifail = MPI_File_write_at_all(fh, 0, buf, localsz, MPI_BYTE, &status);
+  if (ifail != MPI_SUCCESS) {
+    pe_fatal(obj->pe, "File error on writing %s\n", filename_io);
+  }
+
+  MPI_File_close(&fh);
+  MPI_Type_free(&filetype);
+  free(buf);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  io_write_data_pack
+ *
+ *  Snapshot for deferred output. For binary decomposition-independent
+ *  output to a single file, write the metadata (if required) and return
+ *  a newly allocated buffer holding all local sites in file record
+ *  format, with the record size (bytes). The caller must free(*buf).
+ *
+ *  Returns non-zero, and no buffer, for any other output format; such
+ *  output must go via io_write_data().
+ *
+ *****************************************************************************/
+
+int io_write_data_pack(io_info_t * obj, void * data, char ** buf,
+		       size_t * itemsz) {
+
+  int nlocal[3];
+  size_t localsz;
+
+  assert(obj);
+  assert(data);
+  assert(buf);
+  assert(itemsz);
+
+  if (obj->processor_independent == 0) return -1;
+  if (obj->output_format == IO_FORMAT_ASCII) return -1;
+  if (obj->io_comm->n_io != 1) return -1;
+
+  if (obj->metadata_written == 0) io_write_metadata(obj);
+
+  cs_nlocal(obj->cs, nlocal);
+  localsz = obj->bytesize*nlocal[X]*nlocal[Y]*nlocal[Z];
+
+  *buf = (char *) malloc(localsz*sizeof(char));
+  if (*buf == NULL) pe_fatal(obj->pe, "malloc(buf)\n");
+
+  io_pack_local_buf(obj, data, *buf);
+  *itemsz = obj->bytesize;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  io_pack_local_buf
+ *
+ *  Write all local sites to buf (of size at least bytesize*nlocal) in
+ *  local order. The pack callback is used if available; otherwise the
+ *  site-by-site write callback is directed at the buffer.
+ *
+ *****************************************************************************/
+
+static int io_pack_local_buf(io_info_t * obj, void * data, char * buf) {
+
+  int ic, jc, kc, index;
+  int nlocal[3];
+  size_t localsz;
+  FILE * fp_buf = NULL;
+
+  assert(obj);
+  assert(data);
+  assert(buf);
+
+  if (obj->pack_binary && obj->write_data == obj->write_binary) {
+    obj->pack_binary(data, buf);
+    return 0;
+  }
+
+  assert(obj->write_data);
+
+  cs_nlocal(obj->cs, nlocal);
+  localsz = obj->bytesize*nlocal[X]*nlocal[Y]*nlocal[Z];
+
+  /* Stream buffer is the local buffer; nothing reaches the file */
+
+  fp_buf = fopen("/dev/null", "w"); /* TODO: de-hardwire this */
+  if (fp_buf == NULL) pe_fatal(obj->pe, "Buffer initialisation failed\n");
+  setvbuf(fp_buf, buf, _IOFBF, localsz);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	index = cs_index(obj->cs, ic, jc, kc);
+	obj->write_data(fp_buf, index, data);
+      }
+    }
+  }
+
+  fclose(fp_buf);
+
+  return 0;
+}
+
 /****************************************************************************
  *
  *  io_unpack_local_buf
@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2007-2017 The University of Edinburgh
+ *  (c) 2007-2019 The University of Edinburgh
  *
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
  *
@@ -26,6 +26,7 @@ typedef enum io_format_enum {IO_FORMAT_NULL,
 			     IO_FORMAT_BINARY,
 			     IO_FORMAT_ASCII_SERIAL,
 			     IO_FORMAT_BINARY_SERIAL,
+			     IO_FORMAT_BINARY_MPIIO,
 			     IO_FORMAT_DEFAULT} io_format_enum_t;
 
 /* io_info_arg_t to eventually include all relevant parameters */
@@ -41,6 +42,9 @@ struct io_info_arg_s {
 /* Callback signature for lattice site I/O */
 typedef int (*io_rw_cb_ft)(FILE * fp, int index, void * self);
 
+/* Callback signature to pack all local sites to a contiguous buffer */
+typedef int (*io_pack_cb_ft)(void * self, char * buf);
+
 
 __host__ int io_info_create(pe_t * pe, cs_t * cs, io_info_arg_t * arg,
 			    io_info_t ** pinfo);
@@ -66,7 +70,10 @@ __host__ int io_info_format_out_set(io_info_t * obj, int form_out);
 
 __host__ int io_info_read_set(io_info_t * obj, int format, io_rw_cb_ft);
 __host__ int io_info_write_set(io_info_t * obj, int format, io_rw_cb_ft);
+__host__ int io_info_pack_set(io_info_t * obj, io_pack_cb_ft);
 __host__ int io_write_data(io_info_t * obj, const char * filename_stub, void * data);
 __host__ int io_read_data(io_info_t * obj, const char * filename_stub, void * data);
+__host__ int io_write_data_pack(io_info_t * obj, void * data, char ** buf,
+				size_t * itemsz);
 
 #endif
@@ -4,10 +4,22 @@
  *
  *  Help for kernel execution.
  *
+ *  Vectorised kernels (kernel_vector_iterations(), kernel_baseindex(),
+ *  kernel_coords_v()) usually sweep whole planes including the halo.
+ *  A context from kernel_ctxt_create_tiled() instead visits only the
+ *  SIMD chunks which contain sites within the kernel limits, in order
+ *  of cache-sized tiles (bx, by, bz) set via kernel_tile_set(). As
+ *  for_simt_parallel() shares out contiguous iterations, each OpenMP
+ *  thread then receives whole tiles. Each chunk appears exactly once.
+ *
+ *  A context from kernel_ctxt_create_shell() visits only the chunks
+ *  holding sites within a given width of the faces of the limits,
+ *  and kernel_mask() and kernel_mask_v() exclude the sites inside.
+ *
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2016-2018 The University of Edinburgh
+ *  (c) 2016-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -18,6 +30,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "pe.h"
 #include "coords_s.h"
@@ -39,58 +52,177 @@ struct kernel_param_s {
   int kernel_vector_iterations;
   int nkv_local[3];
   kernel_info_t lim;
+  /* Tiled vectorised iteration */
+  int tiled;
+  int tile[3];
+  int order;
+  /* Shell of given width only (0 is the full limits) */
+  int shell;
 };
 
-/* A static device context is provided to prevent repeated device
- * memory allocations/deallocations. */
+/* Contexts are cached, and re-used for the same limits and coordinate
+ * system, to prevent repeated host/device memory allocations. Each
+ * cached context holds its own device copy, so that a sequence of
+ * kernels may use different contexts concurrently. */
+
+#define KERNEL_CTXT_CACHE_MAX 32
+
+static kernel_ctxt_t * ctxt_cache[KERNEL_CTXT_CACHE_MAX];
+
+/* Tile size (zero is the full extent) and order; all zero is no tiling */
 
-static __device__   kernel_ctxt_t  static_ctxt;   
-static __constant__ kernel_param_t static_param;
+static int tile_[3] = {0, 0, 0};
+static kernel_tile_order_enum_t tile_order_ = KERNEL_TILE_ORDER_TILE;
 
-static __host__ int kernel_ctxt_commit(kernel_ctxt_t * ctxt, cs_t * cs,
-				       int nsimdvl,
-				       kernel_info_t lim);
+static __host__ int kernel_ctxt_obtain(cs_t * cs, int nsimdvl,
+				       kernel_info_t info, int tiled,
+				       int shell, kernel_ctxt_t ** p);
+static __host__ int kernel_ctxt_param(cs_t * cs, int nsimdvl,
+				      kernel_info_t lim, int tiled,
+				      int shell, kernel_param_t * param);
+static __host__ int kernel_ctxt_release(kernel_ctxt_t * obj);
+static __host__ int kernel_tile_nchunk(cs_t * cs, kernel_param_t * param);
+static __host__ int kernel_tile_list(cs_t * cs, kernel_param_t * param,
+				     int * list);
+static __host__ int kernel_shell_list(cs_t * cs, kernel_param_t * param,
+				      int * list);
 
 /*****************************************************************************
  *
  *  kernel_ctxt_create
  *
+ *  Returns a cached context if one matches, or a new one.
+ *
  *****************************************************************************/
 
 __host__ int kernel_ctxt_create(cs_t * cs, int nsimdvl, kernel_info_t info,
 				kernel_ctxt_t ** p) {
 
+  return kernel_ctxt_obtain(cs, nsimdvl, info, 0, 0, p);
+}
+
+/*****************************************************************************
+ *
+ *  kernel_ctxt_create_tiled
+ *
+ *  As kernel_ctxt_create(), but the vectorised iteration is tiled
+ *  if tiles are set (else the context is the same).
+ *
+ *****************************************************************************/
+
+__host__ int kernel_ctxt_create_tiled(cs_t * cs, int nsimdvl,
+				      kernel_info_t info, kernel_ctxt_t ** p) {
+
+  return kernel_ctxt_obtain(cs, nsimdvl, info, 1, 0, p);
+}
+
+/*****************************************************************************
+ *
+ *  kernel_ctxt_create_shell
+ *
+ *  Vectorised iteration over the sites within the limits which are
+ *  also within width nw of any face of the limits (e.g., the sites
+ *  at the edge of the local domain which enter a halo swap).
+ *
+ *****************************************************************************/
+
+__host__ int kernel_ctxt_create_shell(cs_t * cs, int nsimdvl,
+				      kernel_info_t info, int nw,
+				      kernel_ctxt_t ** p) {
+
+  assert(nsimdvl == NSIMDVL);
+  assert(nw > 0);
+
+  return kernel_ctxt_obtain(cs, nsimdvl, info, 0, nw, p);
+}
+
+/*****************************************************************************
+ *
+ *  kernel_ctxt_obtain
+ *
+ *****************************************************************************/
+
+static __host__ int kernel_ctxt_obtain(cs_t * cs, int nsimdvl,
+				       kernel_info_t info, int tiled,
+				       int shell, kernel_ctxt_t ** p) {
+  int n;
   int ndevice;
+  kernel_param_t param = {0};
   kernel_ctxt_t * obj = NULL;
 
   assert(p);
   assert(cs);
+  assert(nsimdvl == 1 || nsimdvl == NSIMDVL);
+
+  kernel_ctxt_param(cs, nsimdvl, info, tiled, shell, &param);
+
+  for (n = 0; n < KERNEL_CTXT_CACHE_MAX; n++) {
+    obj = ctxt_cache[n];
+    if (obj && memcmp(obj->param, &param, sizeof(kernel_param_t)) == 0) {
+      obj->nref += 1;
+      *p = obj;
+      return 0;
+    }
+  }
 
   obj = (kernel_ctxt_t *) calloc(1, sizeof(kernel_ctxt_t));
   assert(obj);
   if (obj == NULL) pe_fatal(cs->pe, "calloc(kernel_ctxt_t) failed\n");
 
-  assert(nsimdvl == 1 || nsimdvl == NSIMDVL);
-
   obj->param = (kernel_param_t *) calloc(1, sizeof(kernel_param_t));
   assert(obj->param);
   if (obj->param == NULL) pe_fatal(cs->pe, "calloc(kernel_param_t) failed\n");
 
+  *obj->param = param;
+  obj->nref = 1;
+
+  if (param.tiled) {
+    int nchunk = param.kernel_vector_iterations/NSIMDVL;
+    obj->tile = (int *) malloc(nchunk*sizeof(int));
+    assert(obj->tile);
+    if (obj->tile == NULL) pe_fatal(cs->pe, "malloc(kernel tile) failed\n");
+    if (param.shell) {
+      kernel_shell_list(cs, obj->param, obj->tile);
+    }
+    else {
+      kernel_tile_list(cs, obj->param, obj->tile);
+    }
+  }
+
   tdpGetDeviceCount(&ndevice);
 
   if (ndevice == 0) {
     obj->target = obj;
   }
   else {
-    kernel_param_t * tmp;
-    /* Link to static device memory */
-    tdpGetSymbolAddress((void **) &obj->target, tdpSymbol(static_ctxt));
-    tdpGetSymbolAddress((void **) &tmp, tdpSymbol(static_param));
+    kernel_param_t * tmp = NULL;
+    int * tile = NULL;
+
+    tdpAssert(tdpMalloc((void **) &obj->target, sizeof(kernel_ctxt_t)));
+    tdpAssert(tdpMalloc((void **) &tmp, sizeof(kernel_param_t)));
+    tdpAssert(tdpMemcpy(tmp, obj->param, sizeof(kernel_param_t),
+			tdpMemcpyHostToDevice));
     tdpAssert(tdpMemcpy(&obj->target->param, &tmp, sizeof(kernel_param_t *),
 			tdpMemcpyHostToDevice));
+
+    if (param.tiled) {
+      size_t nsz = (param.kernel_vector_iterations/NSIMDVL)*sizeof(int);
+      tdpAssert(tdpMalloc((void **) &tile, nsz));
+      tdpAssert(tdpMemcpy(tile, obj->tile, nsz, tdpMemcpyHostToDevice));
+    }
+    tdpAssert(tdpMemcpy(&obj->target->tile, &tile, sizeof(int *),
+			tdpMemcpyHostToDevice));
   }
 
-  kernel_ctxt_commit(obj, cs, nsimdvl, info);
+  /* Cache if there is room (else released by kernel_ctxt_free()) */
+
+  for (n = 0; n < KERNEL_CTXT_CACHE_MAX; n++) {
+    if (ctxt_cache[n] == NULL) {
+      ctxt_cache[n] = obj;
+      obj->cached = 1;
+      break;
+    }
+  }
 
   *p = obj;
 
@@ -101,12 +233,71 @@ __host__ int kernel_ctxt_create(cs_t * cs, int nsimdvl, kernel_info_t info,
  *
  *  kernel_ctxt_free
  *
+ *  Cached contexts are retained for re-use.
+ *
  *****************************************************************************/
 
 __host__ int kernel_ctxt_free(kernel_ctxt_t * obj) {
 
   assert(obj);
+  assert(obj->nref > 0);
+
+  obj->nref -= 1;
+
+  if (obj->cached == 0 && obj->nref == 0) kernel_ctxt_release(obj);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  kernel_ctxt_cache_clear
+ *
+ *  Release any cached contexts which are not in use.
+ *
+ *****************************************************************************/
+
+__host__ int kernel_ctxt_cache_clear(void) {
+
+  int n;
+
+  for (n = 0; n < KERNEL_CTXT_CACHE_MAX; n++) {
+    if (ctxt_cache[n] && ctxt_cache[n]->nref == 0) {
+      kernel_ctxt_release(ctxt_cache[n]);
+      ctxt_cache[n] = NULL;
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  kernel_ctxt_release
+ *
+ *****************************************************************************/
+
+static __host__ int kernel_ctxt_release(kernel_ctxt_t * obj) {
+
+  int ndevice;
+
+  assert(obj);
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice > 0) {
+    kernel_param_t * tmp = NULL;
+    int * tile = NULL;
+    tdpAssert(tdpMemcpy(&tmp, &obj->target->param, sizeof(kernel_param_t *),
+			tdpMemcpyDeviceToHost));
+    tdpAssert(tdpMemcpy(&tile, &obj->target->tile, sizeof(int *),
+			tdpMemcpyDeviceToHost));
+    if (tile) tdpAssert(tdpFree(tile));
+    tdpAssert(tdpFree(tmp));
+    tdpAssert(tdpFree(obj->target));
+  }
 
+  free(obj->tile);
   free(obj->param);
   free(obj);
 
@@ -161,66 +352,355 @@ __host__ int kernel_launch_param(int iterations, dim3 * nblk, dim3 * ntpb) {
 
 /*****************************************************************************
  *
- *  kernel_ctxt_commit
+ *  kernel_ctxt_param
+ *
+ *  Compute the parameters for the given coordinate system and limits.
  *
  *****************************************************************************/
 
-static __host__ int kernel_ctxt_commit(kernel_ctxt_t * obj, cs_t * cs,
-				       int nsimdvl, kernel_info_t lim) {
+static __host__ int kernel_ctxt_param(cs_t * cs, int nsimdvl,
+				      kernel_info_t lim, int tiled,
+				      int shell, kernel_param_t * param) {
 
-  int ndevice;
   int kiter;
   int kv_imin;
   int kv_jmin;
   int kv_kmin;
 
   assert(cs);
+  assert(param);
 
-  cs_nhalo(cs, &obj->param->nhalo);
-  cs_nsites(cs, &obj->param->nsites);
-  cs_nlocal(cs, obj->param->nlocal);
+  cs_nhalo(cs, &param->nhalo);
+  cs_nsites(cs, &param->nsites);
+  cs_nlocal(cs, param->nlocal);
 
-  obj->param->nsimdvl = nsimdvl;
-  obj->param->lim = lim;
+  param->nsimdvl = nsimdvl;
+  param->lim = lim;
 
-  obj->param->nklocal[X] = lim.imax - lim.imin + 1;
-  obj->param->nklocal[Y] = lim.jmax - lim.jmin + 1;
-  obj->param->nklocal[Z] = lim.kmax - lim.kmin + 1;
+  param->nklocal[X] = lim.imax - lim.imin + 1;
+  param->nklocal[Y] = lim.jmax - lim.jmin + 1;
+  param->nklocal[Z] = lim.kmax - lim.kmin + 1;
 
-  obj->param->kernel_iterations
-    = obj->param->nklocal[X]*obj->param->nklocal[Y]*obj->param->nklocal[Z];
+  param->kernel_iterations
+    = param->nklocal[X]*param->nklocal[Y]*param->nklocal[Z];
 
   /* Vectorised case */
 
   kv_imin = lim.imin;
-  kv_jmin = 1 - obj->param->nhalo;
-  kv_kmin = 1 - obj->param->nhalo;
+  kv_jmin = 1 - param->nhalo;
+  kv_kmin = 1 - param->nhalo;
 
-  obj->param->nkv_local[X] = obj->param->nklocal[X];
-  obj->param->nkv_local[Y] = obj->param->nlocal[Y] + 2*obj->param->nhalo;
-  obj->param->nkv_local[Z] = obj->param->nlocal[Z] + 2*obj->param->nhalo;
+  param->nkv_local[X] = param->nklocal[X];
+  param->nkv_local[Y] = param->nlocal[Y] + 2*param->nhalo;
+  param->nkv_local[Z] = param->nlocal[Z] + 2*param->nhalo;
 
   /* Offset of first site must be start of a SIMD vector block */
 
   kiter = cs_index(cs, kv_imin, kv_jmin, kv_kmin);
-  obj->param->kindex0 = (kiter/NSIMDVL)*NSIMDVL;
+  param->kindex0 = (kiter/NSIMDVL)*NSIMDVL;
 
   /* Extent of the contiguous block ... */
-  kiter = obj->param->nkv_local[X]*obj->param->nkv_local[Y]*obj->param->nkv_local[Z];
-  obj->param->kernel_vector_iterations = kiter;
+  kiter = param->nkv_local[X]*param->nkv_local[Y]*param->nkv_local[Z];
+  param->kernel_vector_iterations = kiter;
+
+  /* Tiled case: only chunks with sites within the limits */
+
+  if (tiled && nsimdvl == NSIMDVL) {
+    if (tile_[X] > 0 || tile_[Y] > 0 || tile_[Z] > 0) {
+      param->tiled = 1;
+      param->tile[X] = (tile_[X] > 0) ? tile_[X] : param->nklocal[X];
+      param->tile[Y] = (tile_[Y] > 0) ? tile_[Y] : param->nklocal[Y];
+      param->tile[Z] = (tile_[Z] > 0) ? tile_[Z] : param->nklocal[Z];
+      param->order = tile_order_;
+      param->kernel_vector_iterations = NSIMDVL*kernel_tile_nchunk(cs, param);
+    }
+  }
 
-  /* Copy the results to device memory */
+  /* Shell: only chunks with sites near the faces (uses the chunk list) */
 
-  tdpGetDeviceCount(&ndevice);
+  if (shell > 0) {
+    param->tiled = 1;
+    param->shell = shell;
+    param->kernel_vector_iterations = NSIMDVL*kernel_shell_list(cs, param,
+								 NULL);
+  }
 
-  if (ndevice > 0) {
-    tdpMemcpyToSymbol(tdpSymbol(static_param), obj->param,
-		      sizeof(kernel_param_t), 0, tdpMemcpyHostToDevice);
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  kernel_tile_set
+ *
+ *  Tile extent for each direction (zero is the full extent of the
+ *  kernel limits); all zero switches tiling off. Affects contexts
+ *  subsequently created by kernel_ctxt_create_tiled().
+ *
+ *****************************************************************************/
+
+__host__ int kernel_tile_set(const int tile[3],
+			     kernel_tile_order_enum_t order) {
+
+  assert(tile);
+  assert(tile[X] >= 0 && tile[Y] >= 0 && tile[Z] >= 0);
+
+  tile_[X] = tile[X];
+  tile_[Y] = tile[Y];
+  tile_[Z] = tile[Z];
+  tile_order_ = order;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  kernel_tile
+ *
+ *****************************************************************************/
+
+__host__ int kernel_tile(int tile[3], kernel_tile_order_enum_t * order) {
+
+  assert(tile);
+  assert(order);
+
+  tile[X] = tile_[X];
+  tile[Y] = tile_[Y];
+  tile[Z] = tile_[Z];
+  *order = tile_order_;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  kernel_tile_nchunk
+ *
+ *  Number of SIMD chunks (counted from kindex0) holding at least one
+ *  site within the limits. Rows (ic, jc) are visited in memory order,
+ *  so a chunk can only be shared with an earlier row.
+ *
+ *****************************************************************************/
+
+static __host__ int kernel_tile_nchunk(cs_t * cs, kernel_param_t * param) {
+
+  int ic, jc;
+  int c0, c1;
+  int clast = -1;
+  int nchunk = 0;
+  kernel_info_t lim;
+
+  assert(cs);
+  assert(param);
+
+  lim = param->lim;
+
+  for (ic = lim.imin; ic <= lim.imax; ic++) {
+    for (jc = lim.jmin; jc <= lim.jmax; jc++) {
+      c0 = (cs_index(cs, ic, jc, lim.kmin) - param->kindex0)/NSIMDVL;
+      c1 = (cs_index(cs, ic, jc, lim.kmax) - param->kindex0)/NSIMDVL;
+      if (c0 <= clast) c0 = clast + 1;
+      if (c1 >= c0) nchunk += (c1 - c0 + 1);
+      if (c1 > clast) clast = c1;
+    }
   }
 
+  return nchunk;
+}
+
+/*****************************************************************************
+ *
+ *  kernel_tile_morton
+ *
+ *  Interleave the bits of the tile coordinates (Z-order).
+ *
+ *****************************************************************************/
+
+typedef struct kernel_tile_key_s kernel_tile_key_t;
+
+struct kernel_tile_key_s {
+  unsigned int key;
+  int n;
+};
+
+static unsigned int kernel_tile_morton(int ti, int tj, int tk) {
+
+  int b;
+  unsigned int key = 0;
+
+  for (b = 0; b < 10; b++) {
+    key |= ((tk >> b) & 1u) << (3*b);
+    key |= ((tj >> b) & 1u) << (3*b + 1);
+    key |= ((ti >> b) & 1u) << (3*b + 2);
+  }
+
+  return key;
+}
+
+static int kernel_tile_key_cmp(const void * a, const void * b) {
+
+  const kernel_tile_key_t * ka = (const kernel_tile_key_t *) a;
+  const kernel_tile_key_t * kb = (const kernel_tile_key_t *) b;
+
+  if (ka->key < kb->key) return -1;
+  if (ka->key > kb->key) return +1;
+
+  return (ka->n - kb->n);
+}
+
+/*****************************************************************************
+ *
+ *  kernel_tile_list
+ *
+ *  Base site index of each chunk, tile by tile (in tile-major or
+ *  Morton order). A chunk which straddles a tile boundary is assigned
+ *  to the first tile which visits it.
+ *
+ *****************************************************************************/
+
+static __host__ int kernel_tile_list(cs_t * cs, kernel_param_t * param,
+				     int * list) {
+  int nsites;
+  int nchunk = 0;
+  int ntile[3];
+  int ntotal;
+  int it, ic, jc, c;
+  char * claimed = NULL;
+  kernel_tile_key_t * tkey = NULL;
+  kernel_info_t lim;
+
+  assert(cs);
+  assert(param);
+  assert(param->tiled);
+  assert(list);
+
+  lim = param->lim;
+  cs_nsites(cs, &nsites);
+
+  ntile[X] = (param->nklocal[X] + param->tile[X] - 1)/param->tile[X];
+  ntile[Y] = (param->nklocal[Y] + param->tile[Y] - 1)/param->tile[Y];
+  ntile[Z] = (param->nklocal[Z] + param->tile[Z] - 1)/param->tile[Z];
+  ntotal = ntile[X]*ntile[Y]*ntile[Z];
+
+  claimed = (char *) calloc(nsites/NSIMDVL + 1, sizeof(char));
+  tkey = (kernel_tile_key_t *) calloc(ntotal, sizeof(kernel_tile_key_t));
+  assert(claimed);
+  assert(tkey);
+  if (claimed == NULL) pe_fatal(cs->pe, "calloc(claimed) failed\n");
+  if (tkey == NULL) pe_fatal(cs->pe, "calloc(kernel_tile_key_t) failed\n");
+
+  for (it = 0; it < ntotal; it++) {
+    int ti = it/(ntile[Y]*ntile[Z]);
+    int tj = (it - ti*ntile[Y]*ntile[Z])/ntile[Z];
+    int tk = it - ti*ntile[Y]*ntile[Z] - tj*ntile[Z];
+    tkey[it].n = it;
+    tkey[it].key = (unsigned int) it;
+    if (param->order == KERNEL_TILE_ORDER_MORTON) {
+      tkey[it].key = kernel_tile_morton(ti, tj, tk);
+    }
+  }
+
+  qsort(tkey, ntotal, sizeof(kernel_tile_key_t), kernel_tile_key_cmp);
+
+  for (it = 0; it < ntotal; it++) {
+    int n = tkey[it].n;
+    int ti = n/(ntile[Y]*ntile[Z]);
+    int tj = (n - ti*ntile[Y]*ntile[Z])/ntile[Z];
+    int tk = n - ti*ntile[Y]*ntile[Z] - tj*ntile[Z];
+    int imin = lim.imin + ti*param->tile[X];
+    int jmin = lim.jmin + tj*param->tile[Y];
+    int kmin = lim.kmin + tk*param->tile[Z];
+    int imax = imin + param->tile[X] - 1;
+    int jmax = jmin + param->tile[Y] - 1;
+    int kmax = kmin + param->tile[Z] - 1;
+
+    if (imax > lim.imax) imax = lim.imax;
+    if (jmax > lim.jmax) jmax = lim.jmax;
+    if (kmax > lim.kmax) kmax = lim.kmax;
+
+    for (ic = imin; ic <= imax; ic++) {
+      for (jc = jmin; jc <= jmax; jc++) {
+	int c0 = (cs_index(cs, ic, jc, kmin) - param->kindex0)/NSIMDVL;
+	int c1 = (cs_index(cs, ic, jc, kmax) - param->kindex0)/NSIMDVL;
+	for (c = c0; c <= c1; c++) {
+	  if (claimed[c]) continue;
+	  claimed[c] = 1;
+	  list[nchunk++] = param->kindex0 + c*NSIMDVL;
+	}
+      }
+    }
+  }
+
+  assert(nchunk == param->kernel_vector_iterations/NSIMDVL);
+
+  free(tkey);
+  free(claimed);
+
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  kernel_shell_list
+ *
+ *  Base site index of each chunk holding a site within the limits
+ *  and within param->shell of a face of the limits. Rows (ic, jc)
+ *  are visited in memory order, so a chunk can only be shared with
+ *  an earlier row (or segment). If list is NULL, just count.
+ *
+ *  Returns the number of chunks.
+ *
+ *****************************************************************************/
+
+static __host__ int kernel_shell_list(cs_t * cs, kernel_param_t * param,
+				      int * list) {
+  int ic, jc;
+  int ns, n;
+  int c, c0, c1;
+  int clast = -1;
+  int nchunk = 0;
+  int kmin[2], kmax[2];
+  kernel_info_t lim;
+
+  assert(cs);
+  assert(param);
+  assert(param->shell > 0);
+
+  lim = param->lim;
+
+  for (ic = lim.imin; ic <= lim.imax; ic++) {
+    for (jc = lim.jmin; jc <= lim.jmax; jc++) {
+
+      /* Whole row if (ic, jc) is near an edge, else two segments */
+
+      ns = 1;
+      kmin[0] = lim.kmin;
+      kmax[0] = lim.kmax;
+
+      if (ic >= lim.imin + param->shell && ic <= lim.imax - param->shell &&
+	  jc >= lim.jmin + param->shell && jc <= lim.jmax - param->shell &&
+	  lim.kmin + param->shell <= lim.kmax - param->shell) {
+	ns = 2;
+	kmax[0] = lim.kmin + param->shell - 1;
+	kmin[1] = lim.kmax - param->shell + 1;
+	kmax[1] = lim.kmax;
+      }
+
+      for (n = 0; n < ns; n++) {
+	c0 = (cs_index(cs, ic, jc, kmin[n]) - param->kindex0)/NSIMDVL;
+	c1 = (cs_index(cs, ic, jc, kmax[n]) - param->kindex0)/NSIMDVL;
+	if (c0 <= clast) c0 = clast + 1;
+	for (c = c0; c <= c1; c++) {
+	  if (list) list[nchunk] = param->kindex0 + c*NSIMDVL;
+	  nchunk += 1;
+	}
+	if (c1 > clast) clast = c1;
+      }
+    }
+  }
+
+  return nchunk;
+}
+
 /*****************************************************************************
  *
  *  kernel_baseindex
@@ -233,6 +713,8 @@ __host__ __device__ int kernel_baseindex(kernel_ctxt_t * obj, int kindex) {
 
   assert(obj);
 
+  if (obj->param->tiled) return obj->tile[kindex/NSIMDVL];
+
   return obj->param->kindex0 + kindex;
 }
 
@@ -319,6 +801,7 @@ __host__ __device__ int kernel_coords_v(kernel_ctxt_t * obj,
 					int jc[NSIMDVL], int kc[NSIMDVL]) {
   int iv;
   int index;
+  int index0;
   int xs;
   int * __restrict__ icv = ic;
   int * __restrict__ jcv = jc;
@@ -326,9 +809,10 @@ __host__ __device__ int kernel_coords_v(kernel_ctxt_t * obj,
 
   assert(obj);
   xs = obj->param->nkv_local[Y]*obj->param->nkv_local[Z];
+  index0 = kernel_baseindex(obj, kindex0);
 
   for_simd_v(iv, NSIMDVL) {
-    index = obj->param->kindex0 + kindex0 + iv;
+    index = index0 + iv;
 
     icv[iv] = index/xs;
     jcv[iv] = (index - icv[iv]*xs)/obj->param->nkv_local[Z];
@@ -363,6 +847,15 @@ int kernel_mask(kernel_ctxt_t * obj, int ic, int jc, int kc) {
       jc < obj->param->lim.jmin || jc > obj->param->lim.jmax ||
       kc < obj->param->lim.kmin || kc > obj->param->lim.kmax) return 0;
 
+  if (obj->param->shell) {
+    int nw = obj->param->shell;
+    if (ic >= obj->param->lim.imin + nw && ic <= obj->param->lim.imax - nw &&
+	jc >= obj->param->lim.jmin + nw && jc <= obj->param->lim.jmax - nw &&
+	kc >= obj->param->lim.kmin + nw && kc <= obj->param->lim.kmax - nw) {
+      return 0;
+    }
+  }
+
   return 1;
 }
 
@@ -397,6 +890,20 @@ __host__ __device__ int kernel_mask_v(kernel_ctxt_t * obj,
     }
   }
 
+  if (obj->param->shell) {
+    int nw = obj->param->shell;
+    for_simd_v(iv, NSIMDVL) {
+      if (icv[iv] >= obj->param->lim.imin + nw &&
+	  icv[iv] <= obj->param->lim.imax - nw &&
+	  jcv[iv] >= obj->param->lim.jmin + nw &&
+	  jcv[iv] <= obj->param->lim.jmax - nw &&
+	  kcv[iv] >= obj->param->lim.kmin + nw &&
+	  kcv[iv] <= obj->param->lim.kmax - nw) {
+	maskv[iv] = 0;
+      }
+    }
+  }
+
   return 0;
 }
 
@@ -5,7 +5,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2016-2017 The University of Edinburgh
+ *  (c) 2016-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -28,8 +28,16 @@ typedef struct kernel_param_s kernel_param_t;
 struct kernel_ctxt_s {
   kernel_param_t * param;
   kernel_ctxt_t * target;
+  int nref;                    /* Number of current users */
+  int cached;                  /* Retained for re-use after free */
+  int * tile;                  /* Tiled or shell: base index of each chunk */
 };
 
+/* Tiled vectorised iteration: order of tiles over the threads */
+
+typedef enum {KERNEL_TILE_ORDER_TILE = 0,
+	      KERNEL_TILE_ORDER_MORTON} kernel_tile_order_enum_t;
+
 /* kernel_info_t
  * is just a convenience to allow the user to pass the
  * relevant information to the context constructor. */
@@ -46,9 +54,17 @@ struct kernel_info_s {
 
 __host__ int kernel_ctxt_create(cs_t * cs, int nsimdvl, kernel_info_t info,
 				kernel_ctxt_t ** p);
+__host__ int kernel_ctxt_create_tiled(cs_t * cs, int nsimdvl,
+				      kernel_info_t info, kernel_ctxt_t ** p);
+__host__ int kernel_ctxt_create_shell(cs_t * cs, int nsimdvl,
+				      kernel_info_t info, int nw,
+				      kernel_ctxt_t ** p);
 __host__ int kernel_ctxt_launch_param(kernel_ctxt_t * obj, dim3 * nblk, dim3 * ntpb);
 __host__ int kernel_ctxt_info(kernel_ctxt_t * obj, kernel_info_t * lim);
 __host__ int kernel_ctxt_free(kernel_ctxt_t * obj);
+__host__ int kernel_ctxt_cache_clear(void);
+__host__ int kernel_tile_set(const int tile[3], kernel_tile_order_enum_t order);
+__host__ int kernel_tile(int tile[3], kernel_tile_order_enum_t * order);
 
 __host__ __device__ int kernel_iterations(kernel_ctxt_t * ctxt);
 __host__ __device__ int kernel_vector_iterations(kernel_ctxt_t * ctxt);
@@ -0,0 +1,260 @@
+/*****************************************************************************
+ *
+ *  kernel_reduce.c
+ *
+ *  Global reductions computed by kernels.
+ *
+ *  A kernel accumulates per-thread partial sums in __shared__ arrays
+ *  (one element per thread) and per-thread minima and maxima, and
+ *  hands them over via kernel_reduce_sum(), kernel_reduce_min(), and
+ *  kernel_reduce_max() at the end of the kernel. Sums are reduced
+ *  within the block and then added atomically; only the results
+ *  are copied back to the host, via kernel_reduce_local(). A global
+ *  result is then available from kernel_reduce_mpi().
+ *
+ *  The usual pattern is
+ *
+ *    kernel_reduce_create(pe, nvalue, &red);
+ *    kernel_reduce_zero(red);
+ *    tdpLaunchKernel(..., red->target);
+ *    kernel_reduce_local(red);
+ *    kernel_reduce_mpi(red, 0, comm);
+ *    ... use red->sum[], red->min[], red->max[] at root ...
+ *    kernel_reduce_free(red);
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel_reduce.h"
+
+/*****************************************************************************
+ *
+ *  kernel_reduce_create
+ *
+ *****************************************************************************/
+
+__host__ int kernel_reduce_create(pe_t * pe, int nvalue, kernel_reduce_t ** p) {
+
+  int ndevice;
+  kernel_reduce_t * red = NULL;
+
+  assert(pe);
+  assert(p);
+
+  if (nvalue < 1 || nvalue > KERNEL_REDUCE_NMAX) {
+    pe_fatal(pe, "kernel_reduce_create: nvalue %d not in 1-%d\n", nvalue,
+	     KERNEL_REDUCE_NMAX);
+  }
+
+  red = (kernel_reduce_t *) calloc(1, sizeof(kernel_reduce_t));
+  assert(red);
+  if (red == NULL) pe_fatal(pe, "calloc(kernel_reduce_t) failed\n");
+
+  red->pe = pe;
+  red->nvalue = nvalue;
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice == 0) {
+    red->target = red;
+  }
+  else {
+    tdpAssert(tdpMalloc((void **) &red->target, sizeof(kernel_reduce_t)));
+    tdpAssert(tdpMemcpy(&red->target->nvalue, &red->nvalue, sizeof(int),
+			tdpMemcpyHostToDevice));
+  }
+
+  kernel_reduce_zero(red);
+
+  *p = red;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  kernel_reduce_free
+ *
+ *****************************************************************************/
+
+__host__ int kernel_reduce_free(kernel_reduce_t * red) {
+
+  int ndevice;
+
+  assert(red);
+
+  tdpGetDeviceCount(&ndevice);
+  if (ndevice > 0) tdpAssert(tdpFree(red->target));
+
+  free(red);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  kernel_reduce_zero
+ *
+ *  Reset the initial values (host and target).
+ *
+ *****************************************************************************/
+
+__host__ int kernel_reduce_zero(kernel_reduce_t * red) {
+
+  int n;
+  int ndevice;
+
+  assert(red);
+
+  for (n = 0; n < KERNEL_REDUCE_NMAX; n++) {
+    red->sum[n] = 0.0;
+    red->min[n] = +DBL_MAX;
+    red->max[n] = -DBL_MAX;
+  }
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice > 0) {
+    size_t nsz = KERNEL_REDUCE_NMAX*sizeof(double);
+    tdpAssert(tdpMemcpy(red->target->sum, red->sum, nsz,
+			tdpMemcpyHostToDevice));
+    tdpAssert(tdpMemcpy(red->target->min, red->min, nsz,
+			tdpMemcpyHostToDevice));
+    tdpAssert(tdpMemcpy(red->target->max, red->max, nsz,
+			tdpMemcpyHostToDevice));
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  kernel_reduce_local
+ *
+ *  Copy the local (this rank) results back to the host. The kernel
+ *  must have completed.
+ *
+ *****************************************************************************/
+
+__host__ int kernel_reduce_local(kernel_reduce_t * red) {
+
+  int ndevice;
+
+  assert(red);
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice > 0) {
+    size_t nsz = KERNEL_REDUCE_NMAX*sizeof(double);
+    tdpAssert(tdpMemcpy(red->sum, red->target->sum, nsz,
+			tdpMemcpyDeviceToHost));
+    tdpAssert(tdpMemcpy(red->min, red->target->min, nsz,
+			tdpMemcpyDeviceToHost));
+    tdpAssert(tdpMemcpy(red->max, red->target->max, nsz,
+			tdpMemcpyDeviceToHost));
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  kernel_reduce_mpi
+ *
+ *  Reduce the local host results to rank root in comm. The results
+ *  are only significant at root.
+ *
+ *****************************************************************************/
+
+__host__ int kernel_reduce_mpi(kernel_reduce_t * red, int root,
+			       MPI_Comm comm) {
+
+  int nv;
+  double local[KERNEL_REDUCE_NMAX];
+
+  assert(red);
+
+  nv = red->nvalue;
+
+  memcpy(local, red->sum, nv*sizeof(double));
+  MPI_Reduce(local, red->sum, nv, MPI_DOUBLE, MPI_SUM, root, comm);
+  memcpy(local, red->min, nv*sizeof(double));
+  MPI_Reduce(local, red->min, nv, MPI_DOUBLE, MPI_MIN, root, comm);
+  memcpy(local, red->max, nv*sizeof(double));
+  MPI_Reduce(local, red->max, nv, MPI_DOUBLE, MPI_MAX, root, comm);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  kernel_reduce_sum
+ *
+ *  partsum[] must be __shared__ with one element per thread holding
+ *  each thread's contribution; it is destroyed. All threads in the
+ *  block must call.
+ *
+ *****************************************************************************/
+
+__device__ void kernel_reduce_sum(kernel_reduce_t * red, int n,
+				  double * partsum) {
+
+  double bsum;
+
+  assert(red);
+  assert(0 <= n && n < red->nvalue);
+
+  bsum = tdpAtomicBlockAddDouble(partsum);
+
+  if (threadIdx.x == 0) tdpAtomicAddDouble(red->sum + n, bsum);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  kernel_reduce_min
+ *
+ *  Each thread contributes its own partial minimum.
+ *
+ *****************************************************************************/
+
+__device__ void kernel_reduce_min(kernel_reduce_t * red, int n, double val) {
+
+  assert(red);
+  assert(0 <= n && n < red->nvalue);
+
+  tdpAtomicMinDouble(red->min + n, val);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  kernel_reduce_max
+ *
+ *  Each thread contributes its own partial maximum.
+ *
+ *****************************************************************************/
+
+__device__ void kernel_reduce_max(kernel_reduce_t * red, int n, double val) {
+
+  assert(red);
+  assert(0 <= n && n < red->nvalue);
+
+  tdpAtomicMaxDouble(red->max + n, val);
+
+  return;
+}
@@ -0,0 +1,50 @@
+/*****************************************************************************
+ *
+ *  kernel_reduce.h
+ *
+ *  Global reductions (sum, minimum, maximum) computed by kernels.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#ifndef LUDWIG_KERNEL_REDUCE_H
+#define LUDWIG_KERNEL_REDUCE_H
+
+#include "pe.h"
+
+#define KERNEL_REDUCE_NMAX 16
+
+typedef struct kernel_reduce_s kernel_reduce_t;
+
+/* kernel_reduce_t
+ * Exposed to allow the host to read the results, and kernels to
+ * obtain the target copy. */
+
+struct kernel_reduce_s {
+  int nvalue;                        /* Number of values in use */
+  double sum[KERNEL_REDUCE_NMAX];    /* Sums (zero initially) */
+  double min[KERNEL_REDUCE_NMAX];    /* Minima (+DBL_MAX initially) */
+  double max[KERNEL_REDUCE_NMAX];    /* Maxima (-DBL_MAX initially) */
+  pe_t * pe;
+  kernel_reduce_t * target;
+};
+
+__host__ int kernel_reduce_create(pe_t * pe, int nvalue, kernel_reduce_t ** p);
+__host__ int kernel_reduce_free(kernel_reduce_t * red);
+__host__ int kernel_reduce_zero(kernel_reduce_t * red);
+__host__ int kernel_reduce_local(kernel_reduce_t * red);
+__host__ int kernel_reduce_mpi(kernel_reduce_t * red, int root, MPI_Comm comm);
+
+__device__ void kernel_reduce_sum(kernel_reduce_t * red, int n,
+				  double * partsum);
+__device__ void kernel_reduce_min(kernel_reduce_t * red, int n, double val);
+__device__ void kernel_reduce_max(kernel_reduce_t * red, int n, double val);
+
+#endif
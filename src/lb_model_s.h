@@ -17,11 +17,42 @@
 #ifndef LB_MODEL_S_H
 #define LB_MODEL_S_H
 
+#include <float.h>
+
 #include "model.h"
 #include "halo_swap.h"
 #include "io_harness.h"
 #include "stdint.h"
 
+/* Storage for the distributions. The default is double precision.
+ * If LB_FLOAT is defined at compile time, the distributions are
+ * stored in single precision, while all arithmetic (collision,
+ * moments, boundary conditions) remains double precision. To limit
+ * round-off, the density distribution n = LB_RHO is then held as
+ * the deviation from the rest equilibrium at unit density, f_p - w_p.
+ * LB_F_LOAD() and LB_F_STORE() convert to and from the stored value;
+ * copies of the stored value (propagation, halo swaps) need no
+ * conversion. LB_F_ROUND() is the value of f recovered from storage,
+ * and LB_F_EPSILON the machine epsilon of the storage.
+ * I/O is always of f_p itself in double precision, so the file
+ * format does not depend on LB_FLOAT. */
+
+#ifdef LB_FLOAT
+typedef float lb_real_t;
+#define LB_MPI_REAL MPI_FLOAT
+#define LB_F_LOAD(fs, w, n) ((double) (fs) + ((n) == LB_RHO)*(w))
+#define LB_F_STORE(f, w, n) ((lb_real_t) ((f) - ((n) == LB_RHO)*(w)))
+#define LB_F_EPSILON FLT_EPSILON
+#else
+typedef double lb_real_t;
+#define LB_MPI_REAL MPI_DOUBLE
+#define LB_F_LOAD(fs, w, n) (fs)
+#define LB_F_STORE(f, w, n) (f)
+#define LB_F_EPSILON DBL_EPSILON
+#endif
+
+#define LB_F_ROUND(f, w, n) LB_F_LOAD(LB_F_STORE(f, w, n), w, n)
+
 typedef struct lb_collide_param_s lb_collide_param_t;
 
 struct lb_collide_param_s {
@@ -46,6 +77,10 @@ struct lb_data_s {
   int nsite;             /* Number of lattice sites (local) */
   int model;             /* MODEL or MODEL_R */
   int nrelax;            /* Relaxation scheme */
+  int npropagation;      /* Propagation scheme */
+  int aaswapped;         /* AA: distributions currently in swapped order */
+  int haloverlap;        /* Overlap halo swap with interior collision */
+  int ndepth;            /* Halo swap width; one swap every ndepth steps */
 
   pe_t * pe;             /* parallel environment */
   cs_t * cs;             /* coordinate system */
@@ -53,8 +88,8 @@ struct lb_data_s {
   io_info_t * io_info;   /* Distributions */ 
   io_info_t * io_rho;    /* Fluid density (here; could be hydrodynamics...) */
 
-  double * f;            /* Distributions */
-  double * fprime;       /* used in propagation only */
+  lb_real_t * f;         /* Distributions */
+  lb_real_t * fprime;    /* used in propagation only (not AA) */
 
   lb_collide_param_t * param;
 
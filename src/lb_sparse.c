@@ -0,0 +1,808 @@
+/*****************************************************************************
+ *
+ *  lb_sparse.c
+ *
+ *  Indirect addressing of fluid sites for the lattice Boltzmann
+ *  collision and propagation stages.
+ *
+ *  In porous media the majority of lattice sites may be solid. Here
+ *  we compute, from the map, a compact list of the local fluid sites,
+ *  and a table giving the source location for a "pull" propagation
+ *  of each distribution at each fluid site. Bounce-back on links at
+ *  stationary solid sites is folded into the table: if the upstream
+ *  site x - c_p is solid, the post-collision f(x, -p) at the same site
+ *  is the source.
+ *
+ *  The distributions themselves retain the dense storage so that
+ *  I/O, statistics, and so on, are unaffected. Collision and
+ *  propagation are computed at fluid sites only, and the halo swap
+ *  only transfers distributions at fluid sites in the halo region.
+ *
+ *  The tables must be rebuilt via lb_sparse_build() if the map
+ *  changes (any time after map_halo()).
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel.h"
+#include "util.h"
+#include "lb_sparse.h"
+
+static int lb_sparse_release(lb_sparse_t * sparse);
+static int lb_sparse_target_alloc(lb_sparse_t * sparse);
+static int lb_sparse_target_free(lb_sparse_t * sparse);
+static int lb_sparse_build_sites(lb_sparse_t * sparse, map_t * map);
+static int lb_sparse_build_halo(lb_sparse_t * sparse, map_t * map, int id);
+static int lb_sparse_plane(lb_sparse_t * sparse, int id, int ip, int * index);
+
+__global__ void lb_sparse_pack_kernel(lb_sparse_t * sparse, lb_t * lb,
+				      int id, int iw, lb_real_t * buf);
+__global__ void lb_sparse_unpack_kernel(lb_sparse_t * sparse, lb_t * lb,
+					int id, int iw, lb_real_t * buf);
+
+/*****************************************************************************
+ *
+ *  lb_sparse_create
+ *
+ *  The tables are empty until lb_sparse_build() is called.
+ *
+ *****************************************************************************/
+
+__host__ int lb_sparse_create(pe_t * pe, cs_t * cs, lb_t * lb,
+			      lb_sparse_t ** p) {
+  int ndevice;
+  lb_sparse_t * sparse = NULL;
+
+  assert(pe);
+  assert(cs);
+  assert(lb);
+  assert(p);
+
+  sparse = (lb_sparse_t *) calloc(1, sizeof(lb_sparse_t));
+  assert(sparse);
+  if (sparse == NULL) pe_fatal(pe, "calloc(lb_sparse_t) failed\n");
+
+  sparse->pe = pe;
+  sparse->cs = cs;
+  sparse->lb = lb;
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice == 0) {
+    sparse->target = sparse;
+  }
+  else {
+    tdpAssert(tdpMalloc((void **) &sparse->target, sizeof(lb_sparse_t)));
+    tdpAssert(tdpMemset(sparse->target, 0, sizeof(lb_sparse_t)));
+  }
+
+  *p = sparse;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_sparse_free
+ *
+ *****************************************************************************/
+
+__host__ int lb_sparse_free(lb_sparse_t * sparse) {
+
+  assert(sparse);
+
+  lb_sparse_release(sparse);
+  if (sparse->target != sparse) tdpAssert(tdpFree(sparse->target));
+  free(sparse);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_sparse_release
+ *
+ *  Release any existing tables (host and target).
+ *
+ *****************************************************************************/
+
+static int lb_sparse_release(lb_sparse_t * sparse) {
+
+  int id, iw;
+
+  assert(sparse);
+
+  if (sparse->target != sparse) {
+    lb_sparse_target_free(sparse);
+    for (iw = 0; iw < LB_SPARSE_HALO_MAX; iw++) {
+      free(sparse->hbuf[iw]);
+    }
+  }
+
+  for (iw = 0; iw < LB_SPARSE_HALO_MAX; iw++) {
+    if (sparse->tbuf[iw]) tdpAssert(tdpFree(sparse->tbuf[iw]));
+    sparse->tbuf[iw] = NULL;
+    sparse->hbuf[iw] = NULL;
+  }
+
+  for (id = 0; id < 3; id++) {
+    for (iw = 0; iw < LB_SPARSE_HALO_MAX; iw++) {
+      free(sparse->halo[id][iw]);
+      sparse->halo[id][iw] = NULL;
+      sparse->nhalo[id][iw] = 0;
+    }
+  }
+
+  free(sparse->source);
+  free(sparse->chunk);
+  free(sparse->fluid);
+
+  sparse->source = NULL;
+  sparse->chunk = NULL;
+  sparse->fluid = NULL;
+  sparse->nfluid = 0;
+  sparse->nchunk = 0;
+  sparse->nbuf = 0;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_sparse_build
+ *
+ *  (Re-)compute all the tables from the current map, which must
+ *  have valid halo information.
+ *
+ *****************************************************************************/
+
+__host__ int lb_sparse_build(lb_sparse_t * sparse, map_t * map) {
+
+  int id, iw;
+  int nmax = 0;
+  int ndevice;
+
+  assert(sparse);
+  assert(map);
+
+  /* Retain any momentum accumulated on the target so far */
+
+  if (sparse->target != sparse) {
+    double g[3];
+    lb_sparse_momentum(sparse, g);
+  }
+
+  lb_sparse_release(sparse);
+  lb_sparse_build_sites(sparse, map);
+
+  for (id = 0; id < 3; id++) {
+    lb_sparse_build_halo(sparse, map, id);
+    for (iw = 0; iw < LB_SPARSE_HALO_MAX; iw++) {
+      nmax = imax(nmax, sparse->nhalo[id][iw]);
+    }
+  }
+
+  /* Halo buffers are large enough for any one list (at least one site) */
+
+  sparse->nbuf = sparse->lb->ndist*NVEL*imax(1, nmax);
+
+  tdpGetDeviceCount(&ndevice);
+
+  for (iw = 0; iw < LB_SPARSE_HALO_MAX; iw++) {
+    tdpAssert(tdpMalloc((void **) &sparse->tbuf[iw],
+			sparse->nbuf*sizeof(lb_real_t)));
+    if (ndevice == 0) {
+      sparse->hbuf[iw] = sparse->tbuf[iw];
+    }
+    else {
+      sparse->hbuf[iw] = (lb_real_t *) malloc(sparse->nbuf*sizeof(lb_real_t));
+      assert(sparse->hbuf[iw]);
+      if (sparse->hbuf[iw] == NULL) {
+	pe_fatal(sparse->pe, "malloc(sparse->hbuf) failed\n");
+      }
+    }
+  }
+
+  if (sparse->target != sparse) lb_sparse_target_alloc(sparse);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_sparse_build_sites
+ *
+ *  Fluid site list, SIMD chunk list, and propagation table.
+ *
+ *  A chunk is NSIMDVL consecutive sites starting at a fluid site;
+ *  any non-fluid sites within a chunk are masked by the collision.
+ *
+ *****************************************************************************/
+
+static int lb_sparse_build_sites(lb_sparse_t * sparse, map_t * map) {
+
+  int ic, jc, kc, p;
+  int index, indexp;
+  int ibase;
+  int n, nfluid;
+  int nlocal[3];
+  int status;
+  int nalloc;
+
+  assert(sparse);
+  assert(map);
+
+  cs_nlocal(sparse->cs, nlocal);
+
+  nfluid = 0;
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	index = cs_index(sparse->cs, ic, jc, kc);
+	map_status(map, index, &status);
+	if (status == MAP_FLUID) nfluid += 1;
+      }
+    }
+  }
+
+  /* Avoid zero-sized allocations */
+
+  nalloc = imax(1, nfluid);
+
+  sparse->fluid = (int *) calloc(nalloc, sizeof(int));
+  sparse->chunk = (int *) calloc(nalloc, sizeof(int));
+  sparse->source = (int *) calloc(nalloc*NVEL, sizeof(int));
+  assert(sparse->fluid);
+  assert(sparse->chunk);
+  assert(sparse->source);
+  if (sparse->fluid == NULL) pe_fatal(sparse->pe, "calloc(fluid) failed\n");
+  if (sparse->chunk == NULL) pe_fatal(sparse->pe, "calloc(chunk) failed\n");
+  if (sparse->source == NULL) pe_fatal(sparse->pe, "calloc(source) failed\n");
+
+  sparse->nfluid = nfluid;
+  sparse->nchunk = 0;
+
+  n = 0;
+  ibase = -NSIMDVL;
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+
+	index = cs_index(sparse->cs, ic, jc, kc);
+	map_status(map, index, &status);
+	if (status != MAP_FLUID) continue;
+
+	sparse->fluid[n] = index;
+
+	/* Site indices increase monotonically in this loop order */
+
+	if (index >= ibase + NSIMDVL) {
+	  ibase = index;
+	  sparse->chunk[sparse->nchunk] = ibase;
+	  sparse->nchunk += 1;
+	}
+
+	/* Pull from upstream, or bounce back if upstream is solid */
+
+	for (p = 0; p < NVEL; p++) {
+	  indexp = cs_index(sparse->cs, ic - cv[p][X], jc - cv[p][Y],
+			    kc - cv[p][Z]);
+	  map_status(map, indexp, &status);
+	  if (status != MAP_FLUID) indexp = index;
+	  sparse->source[addr_rank1(nfluid, NVEL, n, p)] = indexp;
+	}
+	n += 1;
+      }
+    }
+  }
+
+  assert(n == nfluid);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_sparse_plane
+ *
+ *  Site indices in the plane at coordinate ip in direction id, in the
+ *  order used by the halo swap. As for lb_halo_via_copy(), the extent
+ *  includes the halo in directions which have already been swapped
+ *  (so that the edges and corners are correct).
+ *
+ *  Returns the number of sites via the return value; index may be NULL.
+ *
+ *****************************************************************************/
+
+static int lb_sparse_plane(lb_sparse_t * sparse, int id, int ip, int * index) {
+
+  int ia;
+  int ic, jc, kc;
+  int n = 0;
+  int nlocal[3];
+  int imin[3], imax[3];
+
+  assert(sparse);
+
+  cs_nlocal(sparse->cs, nlocal);
+
+  for (ia = 0; ia < 3; ia++) {
+    imin[ia] = (ia < id) ? 0 : 1;
+    imax[ia] = (ia < id) ? nlocal[ia] + 1 : nlocal[ia];
+  }
+  imin[id] = ip;
+  imax[id] = ip;
+
+  for (ic = imin[X]; ic <= imax[X]; ic++) {
+    for (jc = imin[Y]; jc <= imax[Y]; jc++) {
+      for (kc = imin[Z]; kc <= imax[Z]; kc++) {
+	if (index) index[n] = cs_index(sparse->cs, ic, jc, kc);
+	n += 1;
+      }
+    }
+  }
+
+  return n;
+}
+
+/*****************************************************************************
+ *
+ *  lb_sparse_build_halo
+ *
+ *  Lists for halo swap in direction id.
+ *
+ *  A rank receives distributions at the fluid sites in its halo
+ *  planes. As the status of a halo site need not be the same as
+ *  that of the corresponding site on the neighbouring rank (e.g.,
+ *  at a wall), the receiving rank sends a mask for each halo
+ *  plane to the relevant neighbour, which then sends exactly the
+ *  sites required.
+ *
+ *****************************************************************************/
+
+static int lb_sparse_build_halo(lb_sparse_t * sparse, map_t * map, int id) {
+
+  int n, iw;
+  int nplane;
+  int status;
+  int nlocal[3];
+  int mpi_cartsz[3];
+  int pforw, pback;
+  int ip[LB_SPARSE_HALO_MAX];
+  int * index = NULL;
+  char * mask[LB_SPARSE_HALO_MAX];
+
+  const int tagf = 910;
+  const int tagb = 911;
+
+  MPI_Comm comm;
+  MPI_Request request[4];
+  MPI_Status mstatus[4];
+
+  assert(sparse);
+  assert(map);
+
+  cs_nlocal(sparse->cs, nlocal);
+  cs_cartsz(sparse->cs, mpi_cartsz);
+  cs_cart_comm(sparse->cs, &comm);
+
+  ip[LB_SPARSE_SEND_BACK] = 1;
+  ip[LB_SPARSE_SEND_FORW] = nlocal[id];
+  ip[LB_SPARSE_RECV_BACK] = 0;
+  ip[LB_SPARSE_RECV_FORW] = nlocal[id] + 1;
+
+  nplane = lb_sparse_plane(sparse, id, 0, NULL);
+
+  index = (int *) calloc(nplane, sizeof(int));
+  assert(index);
+  if (index == NULL) pe_fatal(sparse->pe, "calloc(plane) failed\n");
+
+  for (iw = 0; iw < LB_SPARSE_HALO_MAX; iw++) {
+    mask[iw] = (char *) calloc(nplane, sizeof(char));
+    assert(mask[iw]);
+    if (mask[iw] == NULL) pe_fatal(sparse->pe, "calloc(mask) failed\n");
+  }
+
+  /* Receive masks from the local halo status */
+
+  for (iw = LB_SPARSE_RECV_BACK; iw <= LB_SPARSE_RECV_FORW; iw++) {
+    lb_sparse_plane(sparse, id, ip[iw], index);
+    for (n = 0; n < nplane; n++) {
+      map_status(map, index[n], &status);
+      mask[iw][n] = (status == MAP_FLUID);
+    }
+  }
+
+  /* Send masks are the neighbours' receive masks */
+
+  if (mpi_cartsz[id] == 1) {
+    memcpy(mask[LB_SPARSE_SEND_FORW], mask[LB_SPARSE_RECV_BACK], nplane);
+    memcpy(mask[LB_SPARSE_SEND_BACK], mask[LB_SPARSE_RECV_FORW], nplane);
+  }
+  else {
+    pforw = cs_cart_neighb(sparse->cs, CS_FORW, id);
+    pback = cs_cart_neighb(sparse->cs, CS_BACK, id);
+
+    MPI_Irecv(mask[LB_SPARSE_SEND_FORW], nplane, MPI_CHAR, pforw, tagb,
+	      comm, request);
+    MPI_Irecv(mask[LB_SPARSE_SEND_BACK], nplane, MPI_CHAR, pback, tagf,
+	      comm, request + 1);
+    MPI_Issend(mask[LB_SPARSE_RECV_BACK], nplane, MPI_CHAR, pback, tagb,
+	       comm, request + 2);
+    MPI_Issend(mask[LB_SPARSE_RECV_FORW], nplane, MPI_CHAR, pforw, tagf,
+	       comm, request + 3);
+    MPI_Waitall(4, request, mstatus);
+  }
+
+  /* Lists */
+
+  for (iw = 0; iw < LB_SPARSE_HALO_MAX; iw++) {
+
+    int nlist = 0;
+    int * list = NULL;
+
+    for (n = 0; n < nplane; n++) {
+      nlist += mask[iw][n];
+    }
+
+    list = (int *) calloc(imax(1, nlist), sizeof(int));
+    assert(list);
+    if (list == NULL) pe_fatal(sparse->pe, "calloc(halo list) failed\n");
+
+    lb_sparse_plane(sparse, id, ip[iw], index);
+
+    nlist = 0;
+    for (n = 0; n < nplane; n++) {
+      if (mask[iw][n]) list[nlist++] = index[n];
+    }
+
+    sparse->nhalo[id][iw] = nlist;
+    sparse->halo[id][iw] = list;
+  }
+
+  for (iw = 0; iw < LB_SPARSE_HALO_MAX; iw++) {
+    free(mask[iw]);
+  }
+  free(index);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_sparse_target_alloc
+ *
+ *****************************************************************************/
+
+static int lb_sparse_target_alloc(lb_sparse_t * sparse) {
+
+  int id, iw;
+  int nalloc;
+  lb_sparse_t tmp;
+
+  assert(sparse);
+  assert(sparse->target != sparse);
+
+  nalloc = imax(1, sparse->nfluid);
+
+  tmp = *sparse;
+  tmp.target = NULL;
+  tmp.pe = NULL;
+  tmp.cs = NULL;
+  tmp.lb = NULL;
+  tmp.fnet[X] = 0.0; tmp.fnet[Y] = 0.0; tmp.fnet[Z] = 0.0;
+
+  tdpAssert(tdpMalloc((void **) &tmp.fluid, nalloc*sizeof(int)));
+  tdpAssert(tdpMalloc((void **) &tmp.chunk, nalloc*sizeof(int)));
+  tdpAssert(tdpMalloc((void **) &tmp.source, NVEL*nalloc*sizeof(int)));
+
+  tdpAssert(tdpMemcpy(tmp.fluid, sparse->fluid, nalloc*sizeof(int),
+		      tdpMemcpyHostToDevice));
+  tdpAssert(tdpMemcpy(tmp.chunk, sparse->chunk, nalloc*sizeof(int),
+		      tdpMemcpyHostToDevice));
+  tdpAssert(tdpMemcpy(tmp.source, sparse->source, NVEL*nalloc*sizeof(int),
+		      tdpMemcpyHostToDevice));
+
+  for (id = 0; id < 3; id++) {
+    for (iw = 0; iw < LB_SPARSE_HALO_MAX; iw++) {
+      nalloc = imax(1, sparse->nhalo[id][iw]);
+      tdpAssert(tdpMalloc((void **) &tmp.halo[id][iw], nalloc*sizeof(int)));
+      tdpAssert(tdpMemcpy(tmp.halo[id][iw], sparse->halo[id][iw],
+			  nalloc*sizeof(int), tdpMemcpyHostToDevice));
+    }
+  }
+
+  tdpAssert(tdpMemcpy(sparse->target, &tmp, sizeof(lb_sparse_t),
+		      tdpMemcpyHostToDevice));
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_sparse_target_free
+ *
+ *****************************************************************************/
+
+static int lb_sparse_target_free(lb_sparse_t * sparse) {
+
+  int id, iw;
+  lb_sparse_t tmp;
+
+  assert(sparse);
+  assert(sparse->target != sparse);
+
+  tdpAssert(tdpMemcpy(&tmp, sparse->target, sizeof(lb_sparse_t),
+		      tdpMemcpyDeviceToHost));
+
+  if (tmp.fluid) tdpFree(tmp.fluid);
+  if (tmp.chunk) tdpFree(tmp.chunk);
+  if (tmp.source) tdpFree(tmp.source);
+
+  for (id = 0; id < 3; id++) {
+    for (iw = 0; iw < LB_SPARSE_HALO_MAX; iw++) {
+      if (tmp.halo[id][iw]) tdpFree(tmp.halo[id][iw]);
+    }
+  }
+
+  tdpAssert(tdpMemset(sparse->target, 0, sizeof(lb_sparse_t)));
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_sparse_info
+ *
+ *****************************************************************************/
+
+__host__ int lb_sparse_info(lb_sparse_t * sparse) {
+
+  int ntotal[3];
+  long int nlocal[2] = {0, 0};
+  long int nsum[2] = {0, 0};
+  int id, iw;
+  MPI_Comm comm;
+
+  assert(sparse);
+
+  cs_ntotal(sparse->cs, ntotal);
+  cs_cart_comm(sparse->cs, &comm);
+
+  nlocal[0] = sparse->nfluid;
+  for (id = 0; id < 3; id++) {
+    for (iw = LB_SPARSE_RECV_BACK; iw <= LB_SPARSE_RECV_FORW; iw++) {
+      nlocal[1] += sparse->nhalo[id][iw];
+    }
+  }
+
+  MPI_Reduce(nlocal, nsum, 2, MPI_LONG, MPI_SUM, 0, comm);
+
+  pe_info(sparse->pe, "\n");
+  pe_info(sparse->pe, "Sparse lattice Boltzmann\n");
+  pe_info(sparse->pe, "------------------------\n");
+  pe_info(sparse->pe, "Fluid sites:      %ld\n", nsum[0]);
+  pe_info(sparse->pe, "Fluid fraction:   %8.6f\n",
+	  1.0*nsum[0]/(1.0*ntotal[X]*ntotal[Y]*ntotal[Z]));
+  pe_info(sparse->pe, "Halo fluid sites: %ld\n", nsum[1]);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_sparse_halo
+ *
+ *  Halo swap of the distributions at fluid sites only. The three
+ *  directions are taken in turn (as lb_halo_via_copy()).
+ *
+ *****************************************************************************/
+
+__host__ int lb_sparse_halo(lb_sparse_t * sparse) {
+
+  int id, iw;
+  int nd;
+  int ndevice;
+  int mpi_cartsz[3];
+  int pforw, pback;
+  dim3 nblk, ntpb;
+  lb_t * lb = NULL;
+
+  const int tagf = 912;
+  const int tagb = 913;
+
+  MPI_Comm comm;
+  MPI_Request request[4];
+  MPI_Status status[4];
+
+  assert(sparse);
+
+  lb = sparse->lb;
+  nd = lb->ndist*NVEL;
+
+  cs_cartsz(sparse->cs, mpi_cartsz);
+  cs_cart_comm(sparse->cs, &comm);
+  tdpGetDeviceCount(&ndevice);
+
+  for (id = 0; id < 3; id++) {
+
+    int * nhalo = sparse->nhalo[id];
+    lb_real_t ** hbuf = sparse->hbuf;
+
+    for (iw = LB_SPARSE_SEND_BACK; iw <= LB_SPARSE_SEND_FORW; iw++) {
+      if (nhalo[iw] == 0) continue;
+      kernel_launch_param(nhalo[iw], &nblk, &ntpb);
+      tdpLaunchKernel(lb_sparse_pack_kernel, nblk, ntpb, 0, 0,
+		      sparse->target, lb->target, id, iw, sparse->tbuf[iw]);
+      tdpAssert(tdpPeekAtLastError());
+    }
+    tdpAssert(tdpDeviceSynchronize());
+
+    if (ndevice > 0) {
+      for (iw = LB_SPARSE_SEND_BACK; iw <= LB_SPARSE_SEND_FORW; iw++) {
+	tdpAssert(tdpMemcpy(hbuf[iw], sparse->tbuf[iw],
+			    nd*nhalo[iw]*sizeof(lb_real_t),
+			    tdpMemcpyDeviceToHost));
+      }
+    }
+
+    if (mpi_cartsz[id] == 1) {
+      assert(nhalo[LB_SPARSE_RECV_BACK] == nhalo[LB_SPARSE_SEND_FORW]);
+      assert(nhalo[LB_SPARSE_RECV_FORW] == nhalo[LB_SPARSE_SEND_BACK]);
+      memcpy(hbuf[LB_SPARSE_RECV_BACK], hbuf[LB_SPARSE_SEND_FORW],
+	     nd*nhalo[LB_SPARSE_RECV_BACK]*sizeof(lb_real_t));
+      memcpy(hbuf[LB_SPARSE_RECV_FORW], hbuf[LB_SPARSE_SEND_BACK],
+	     nd*nhalo[LB_SPARSE_RECV_FORW]*sizeof(lb_real_t));
+    }
+    else {
+      pforw = cs_cart_neighb(sparse->cs, CS_FORW, id);
+      pback = cs_cart_neighb(sparse->cs, CS_BACK, id);
+
+      MPI_Irecv(hbuf[LB_SPARSE_RECV_FORW], nd*nhalo[LB_SPARSE_RECV_FORW],
+		LB_MPI_REAL, pforw, tagb, comm, request);
+      MPI_Irecv(hbuf[LB_SPARSE_RECV_BACK], nd*nhalo[LB_SPARSE_RECV_BACK],
+		LB_MPI_REAL, pback, tagf, comm, request + 1);
+      MPI_Issend(hbuf[LB_SPARSE_SEND_BACK], nd*nhalo[LB_SPARSE_SEND_BACK],
+		 LB_MPI_REAL, pback, tagb, comm, request + 2);
+      MPI_Issend(hbuf[LB_SPARSE_SEND_FORW], nd*nhalo[LB_SPARSE_SEND_FORW],
+		 LB_MPI_REAL, pforw, tagf, comm, request + 3);
+      MPI_Waitall(4, request, status);
+    }
+
+    if (ndevice > 0) {
+      for (iw = LB_SPARSE_RECV_BACK; iw <= LB_SPARSE_RECV_FORW; iw++) {
+	tdpAssert(tdpMemcpy(sparse->tbuf[iw], hbuf[iw],
+			    nd*nhalo[iw]*sizeof(lb_real_t),
+			    tdpMemcpyHostToDevice));
+      }
+    }
+
+    for (iw = LB_SPARSE_RECV_BACK; iw <= LB_SPARSE_RECV_FORW; iw++) {
+      if (nhalo[iw] == 0) continue;
+      kernel_launch_param(nhalo[iw], &nblk, &ntpb);
+      tdpLaunchKernel(lb_sparse_unpack_kernel, nblk, ntpb, 0, 0,
+		      sparse->target, lb->target, id, iw, sparse->tbuf[iw]);
+      tdpAssert(tdpPeekAtLastError());
+    }
+    tdpAssert(tdpDeviceSynchronize());
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_sparse_pack_kernel
+ *
+ *  Buffer order is buf[(n*NVEL + p)*nsite + k] for site k of the list.
+ *
+ *****************************************************************************/
+
+__global__ void lb_sparse_pack_kernel(lb_sparse_t * sparse, lb_t * lb,
+				      int id, int iw, lb_real_t * buf) {
+  int k;
+  int nsite;
+
+  assert(sparse);
+  assert(lb);
+
+  nsite = sparse->nhalo[id][iw];
+
+  for_simt_parallel(k, nsite, 1) {
+
+    int n, p;
+    int index = sparse->halo[id][iw][k];
+
+    for (n = 0; n < lb->ndist; n++) {
+      for (p = 0; p < NVEL; p++) {
+	buf[(n*NVEL + p)*nsite + k] =
+	  lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)];
+      }
+    }
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  lb_sparse_unpack_kernel
+ *
+ *****************************************************************************/
+
+__global__ void lb_sparse_unpack_kernel(lb_sparse_t * sparse, lb_t * lb,
+					int id, int iw, lb_real_t * buf) {
+  int k;
+  int nsite;
+
+  assert(sparse);
+  assert(lb);
+
+  nsite = sparse->nhalo[id][iw];
+
+  for_simt_parallel(k, nsite, 1) {
+
+    int n, p;
+    int index = sparse->halo[id][iw][k];
+
+    for (n = 0; n < lb->ndist; n++) {
+      for (p = 0; p < NVEL; p++) {
+	lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)] =
+	  buf[(n*NVEL + p)*nsite + k];
+      }
+    }
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  lb_sparse_momentum
+ *
+ *  Net momentum transferred to solid at bounce-back links in the
+ *  propagation (cf. wall_momentum()). This is the local contribution;
+ *  the caller is responsible for any reduction.
+ *
+ *****************************************************************************/
+
+__host__ int lb_sparse_momentum(lb_sparse_t * sparse, double g[3]) {
+
+  int ndevice;
+  double gtmp[3] = {0.0, 0.0, 0.0};
+
+  assert(sparse);
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice > 0) {
+    /* Accumulate the device total on the host, and zero the device */
+    tdpAssert(tdpMemcpy(gtmp, sparse->target->fnet, 3*sizeof(double),
+			tdpMemcpyDeviceToHost));
+    sparse->fnet[X] += gtmp[X];
+    sparse->fnet[Y] += gtmp[Y];
+    sparse->fnet[Z] += gtmp[Z];
+    gtmp[X] = 0.0; gtmp[Y] = 0.0; gtmp[Z] = 0.0;
+    tdpAssert(tdpMemcpy(sparse->target->fnet, gtmp, 3*sizeof(double),
+			tdpMemcpyHostToDevice));
+  }
+
+  g[X] = sparse->fnet[X];
+  g[Y] = sparse->fnet[Y];
+  g[Z] = sparse->fnet[Z];
+
+  return 0;
+}
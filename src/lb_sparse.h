@@ -0,0 +1,67 @@
+/*****************************************************************************
+ *
+ *  lb_sparse.h
+ *
+ *  Indirect addressing of fluid sites for the lattice Boltzmann
+ *  collision and propagation stages (e.g., porous media).
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#ifndef LUDWIG_LB_SPARSE_H
+#define LUDWIG_LB_SPARSE_H
+
+#include "pe.h"
+#include "coords.h"
+#include "map.h"
+#include "lb_model_s.h"
+
+/* Halo plane lists for each coordinate direction */
+
+enum lb_sparse_halo_enum {LB_SPARSE_SEND_BACK = 0,
+			  LB_SPARSE_SEND_FORW,
+			  LB_SPARSE_RECV_BACK,
+			  LB_SPARSE_RECV_FORW,
+			  LB_SPARSE_HALO_MAX};
+
+typedef struct lb_sparse_s lb_sparse_t;
+
+struct lb_sparse_s {
+  pe_t * pe;                    /* Parallel environment */
+  cs_t * cs;                    /* Coordinate system */
+  lb_t * lb;                    /* Distributions (dense storage) */
+
+  int nfluid;                   /* Number of local fluid sites */
+  int nchunk;                   /* Number of SIMD chunks with fluid sites */
+  int * fluid;                  /* Site index of each fluid site */
+  int * chunk;                  /* Base site index of each chunk */
+  int * source;                 /* Pull source [addr_rank1(nfluid,NVEL,n,p)] */
+
+  int nhalo[3][LB_SPARSE_HALO_MAX];    /* Fluid sites in each halo list */
+  int * halo[3][LB_SPARSE_HALO_MAX];   /* Site indices in each halo list */
+
+  int nbuf;                            /* Halo buffer size (elements) */
+  lb_real_t * hbuf[LB_SPARSE_HALO_MAX];  /* Host halo buffers */
+  lb_real_t * tbuf[LB_SPARSE_HALO_MAX];  /* Target halo buffers */
+
+  double fnet[3];               /* Momentum transfer at bounce-back links */
+
+  lb_sparse_t * target;         /* Target copy */
+};
+
+__host__ int lb_sparse_create(pe_t * pe, cs_t * cs, lb_t * lb,
+			      lb_sparse_t ** p);
+__host__ int lb_sparse_free(lb_sparse_t * sparse);
+__host__ int lb_sparse_build(lb_sparse_t * sparse, map_t * map);
+__host__ int lb_sparse_info(lb_sparse_t * sparse);
+__host__ int lb_sparse_halo(lb_sparse_t * sparse);
+__host__ int lb_sparse_momentum(lb_sparse_t * sparse, double g[3]);
+
+#endif
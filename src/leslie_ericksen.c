@@ -5,12 +5,15 @@
  *  Updates a vector order parameter according to something looking
  *  like a Leslie-Ericksen equation.
  *
+ *  The update and the self-advection (swimming) contribution to the
+ *  velocity are vectorised kernels which run on the target.
+ *
  *  $Id: leslie_ericksen.c,v 1.2 2010-10-15 12:40:03 kevin Exp $
  *
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2017 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -22,7 +25,10 @@
 
 #include "pe.h"
 #include "coords.h"
+#include "kernel.h"
+#include "leesedwards.h"
 #include "field_s.h"
+#include "hydro_s.h"
 #include "advection_s.h"
 #include "leslie_ericksen.h"
 
@@ -35,6 +41,15 @@ static int leslie_ericksen_update_fluid(fe_polar_t *fe,
 static int leslie_ericksen_add_swimming_velocity(field_t * p,
 						 hydro_t * hydro);
 
+__global__ void leslie_ericksen_kernel_v(kernel_ctxt_t * ktx,
+					 fe_polar_t * fe, field_t * fp,
+					 hydro_t * hydro, lees_edw_t * le,
+					 advflux_t * flux,
+					 double lambda, double gamma);
+__global__ void leslie_ericksen_swim_kernel_v(kernel_ctxt_t * ktx,
+					      field_t * fp, hydro_t * hydro,
+					      double swim);
+
 /*****************************************************************************
  *
  *  leslie_ericken_gamma_set
@@ -99,7 +114,9 @@ int leslie_ericksen_update(cs_t * cs, fe_polar_t * fe, field_t * p,
 
 /*****************************************************************************
  *
- * leslie_ericksen_update_fluid
+ *  leslie_ericksen_update_fluid
+ *
+ *  Driver for the update kernel.
  *
  *  hydro is allowed to be NULL, in which case there is relaxational
  *  dynmaics only.
@@ -110,120 +127,309 @@ static int leslie_ericksen_update_fluid(fe_polar_t * fe,
 					field_t * fp,
 					hydro_t * hydro,
 					advflux_t * flux) {
-  int ic, jc, kc, index;
-  int indexj, indexk;
-  int ia, ib;
   int nlocal[3];
+  dim3 nblk, ntpb;
+  kernel_info_t limits;
+  kernel_ctxt_t * ctxt = NULL;
 
-  double p[3];
-  double h[3];
-  double d[3][3];
-  double omega[3][3];
-  double w[3][3];
-  double sum;
+  fe_t * fe_target = NULL;
+  hydro_t * hydrotarget = NULL;
+  lees_edw_t * letarget = NULL;
   fe_polar_param_t param;
-  const double dt = 1.0;
 
   assert(fe);
   assert(fp);
   assert(flux);
 
   fe_polar_param(fe, &param);
+  fe_polar_target(fe, &fe_target);
   cs_nlocal(flux->cs, nlocal);
 
-  for (ia = 0; ia < 3; ia++) {
-    for (ib = 0; ib < 3; ib++) {
-      w[ia][ib] = 0.0;
-    }
+  if (hydro) {
+    assert(hydro->le);
+    hydrotarget = hydro->target;
+    lees_edw_target(hydro->le, &letarget);
   }
 
-  for (ic = 1; ic <= nlocal[X]; ic++) {
-    for (jc = 1; jc <= nlocal[Y]; jc++) {
-      for (kc = 1; kc <= nlocal[Z]; kc++) {
-
-	index = cs_index(flux->cs, ic, jc, kc);
-	field_vector(fp, index, p);
-	fe_polar_mol_field(fe, index, h);
-	if (hydro) hydro_u_gradient_tensor(hydro, ic, jc, kc, w);
-
-	/* Note that the convection for Leslie Ericksen is that
-	 * w_ab = d_a u_b, which is the transpose of what the
-	 * above returns. Hence an extra minus sign in the
-	 * omega term in the following. */
-
-	for (ia = 0; ia < 3; ia++) {
-	  for (ib = 0; ib < 3; ib++) {
-	    d[ia][ib]     = 0.5*(w[ia][ib] + w[ib][ia]);
-	    omega[ia][ib] = -0.5*(w[ia][ib] - w[ib][ia]);
-	  }
+  limits.imin = 1; limits.imax = nlocal[X];
+  limits.jmin = 1; limits.jmax = nlocal[Y];
+  limits.kmin = 1; limits.kmax = nlocal[Z];
+
+  kernel_ctxt_create(flux->cs, NSIMDVL, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+  tdpLaunchKernel(leslie_ericksen_kernel_v, nblk, ntpb, 0, 0,
+		  ctxt->target, (fe_polar_t *) fe_target, fp->target,
+		  hydrotarget, letarget, flux->target, param.lambda, Gamma_);
+
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  kernel_ctxt_free(ctxt);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  leslie_ericksen_kernel_v
+ *
+ *  Euler forward step for p. The molecular field is computed for each
+ *  SIMD block before the update.
+ *
+ *  If hydro is present, le must be the Lees Edwards object (target)
+ *  associated with the velocity field.
+ *
+ *****************************************************************************/
+
+__global__ void leslie_ericksen_kernel_v(kernel_ctxt_t * ktx,
+					 fe_polar_t * fe, field_t * fp,
+					 hydro_t * hydro, lees_edw_t * le,
+					 advflux_t * flux,
+					 double lambda, double gamma) {
+  int kindex;
+  __shared__ int kiterations;
+
+  const double dt = 1.0;
+  const double r3 = (1.0/3.0);
+
+  assert(ktx);
+  assert(fe);
+  assert(fp);
+  assert(flux);
+
+  kiterations = kernel_vector_iterations(ktx);
+
+  for_simt_parallel(kindex, kiterations, NSIMDVL) {
+
+    int iv;
+    int ia, ib;
+    int index;
+    int ic[NSIMDVL], jc[NSIMDVL], kc[NSIMDVL];
+    int im1[NSIMDVL], ip1[NSIMDVL];
+    int indexj[NSIMDVL], indexk[NSIMDVL];
+    int maskv[NSIMDVL];
+
+    double p[3][NSIMDVL];
+    double h[3][NSIMDVL];
+    double w[3][3][NSIMDVL];
+    double d[3][3][NSIMDVL];
+    double omega[3][3][NSIMDVL];
+    double sum[NSIMDVL];
+    double tr[NSIMDVL];
+
+    index = kernel_baseindex(ktx, kindex);
+    kernel_coords_v(ktx, kindex, ic, jc, kc);
+    kernel_mask_v(ktx, ic, jc, kc, maskv);
+
+    /* Molecular field (before p is updated) */
+
+    fe_polar_mol_field_v(fe, index, h);
+
+    for (ia = 0; ia < 3; ia++) {
+      for_simd_v(iv, NSIMDVL) {
+	p[ia][iv] = fp->data[addr_rank1(fp->nsites, NVECTOR, index+iv, ia)];
+      }
+    }
+
+    for (ia = 0; ia < 3; ia++) {
+      for (ib = 0; ib < 3; ib++) {
+	for_simd_v(iv, NSIMDVL) w[ia][ib][iv] = 0.0;
+      }
+    }
+
+    if (hydro) {
+      /* Velocity gradient tensor w_ab = d_b u_a (cf. hydro.c) */
+
+      for_simd_v(iv, NSIMDVL) im1[iv] = lees_edw_ic_to_buff(le, ic[iv], -1);
+      for_simd_v(iv, NSIMDVL) ip1[iv] = lees_edw_ic_to_buff(le, ic[iv], +1);
+
+      for_simd_v(iv, NSIMDVL) im1[iv] = lees_edw_index(le, im1[iv], jc[iv], kc[iv]);
+      for_simd_v(iv, NSIMDVL) ip1[iv] = lees_edw_index(le, ip1[iv], jc[iv], kc[iv]);
+
+      for (ia = 0; ia < 3; ia++) {
+	for_simd_v(iv, NSIMDVL) {
+	  w[ia][X][iv] = 0.5*
+	    (hydro->u[addr_rank1(hydro->nsite, NHDIM, ip1[iv], ia)] -
+	     hydro->u[addr_rank1(hydro->nsite, NHDIM, im1[iv], ia)]);
+	}
+      }
+
+      for_simd_v(iv, NSIMDVL) {
+	im1[iv] = lees_edw_index(le, ic[iv], jc[iv] - maskv[iv], kc[iv]);
+      }
+      for_simd_v(iv, NSIMDVL) {
+	ip1[iv] = lees_edw_index(le, ic[iv], jc[iv] + maskv[iv], kc[iv]);
+      }
+
+      for (ia = 0; ia < 3; ia++) {
+	for_simd_v(iv, NSIMDVL) {
+	  w[ia][Y][iv] = 0.5*
+	    (hydro->u[addr_rank1(hydro->nsite, NHDIM, ip1[iv], ia)] -
+	     hydro->u[addr_rank1(hydro->nsite, NHDIM, im1[iv], ia)]);
+	}
+      }
+
+      for_simd_v(iv, NSIMDVL) {
+	im1[iv] = lees_edw_index(le, ic[iv], jc[iv], kc[iv] - maskv[iv]);
+      }
+      for_simd_v(iv, NSIMDVL) {
+	ip1[iv] = lees_edw_index(le, ic[iv], jc[iv], kc[iv] + maskv[iv]);
+      }
+
+      for (ia = 0; ia < 3; ia++) {
+	for_simd_v(iv, NSIMDVL) {
+	  w[ia][Z][iv] = 0.5*
+	    (hydro->u[addr_rank1(hydro->nsite, NHDIM, ip1[iv], ia)] -
+	     hydro->u[addr_rank1(hydro->nsite, NHDIM, im1[iv], ia)]);
+	}
+      }
+
+      /* Enforce tracelessness */
+
+      for_simd_v(iv, NSIMDVL) tr[iv] = r3*(w[X][X][iv] + w[Y][Y][iv] + w[Z][Z][iv]);
+      for_simd_v(iv, NSIMDVL) w[X][X][iv] -= tr[iv];
+      for_simd_v(iv, NSIMDVL) w[Y][Y][iv] -= tr[iv];
+      for_simd_v(iv, NSIMDVL) w[Z][Z][iv] -= tr[iv];
+    }
+
+    /* Note that the convection for Leslie Ericksen is that
+     * w_ab = d_a u_b, which is the transpose of the above.
+     * Hence an extra minus sign in the omega term. */
+
+    for (ia = 0; ia < 3; ia++) {
+      for (ib = 0; ib < 3; ib++) {
+	for_simd_v(iv, NSIMDVL) {
+	  d[ia][ib][iv] = 0.5*(w[ia][ib][iv] + w[ib][ia][iv]);
+	}
+	for_simd_v(iv, NSIMDVL) {
+	  omega[ia][ib][iv] = -0.5*(w[ia][ib][iv] - w[ib][ia][iv]);
 	}
+      }
+    }
 
-	/* update */
+    /* Update. Components are updated in turn, as for the original
+     * site-by-site version, so later components see earlier ones. */
 
-	indexj = cs_index(flux->cs, ic, jc-1, kc);
-	indexk = cs_index(flux->cs, ic, jc, kc-1);
+    for_simd_v(iv, NSIMDVL) im1[iv] = jc[iv] - maskv[iv];
+    kernel_coords_index_v(ktx, ic, im1, kc, indexj);
+    for_simd_v(iv, NSIMDVL) im1[iv] = kc[iv] - maskv[iv];
+    kernel_coords_index_v(ktx, ic, jc, im1, indexk);
 
-	for (ia = 0; ia < 3; ia++) {
+    for (ia = 0; ia < 3; ia++) {
 
-	  sum = 0.0;
-	  for (ib = 0; ib < 3; ib++) {
-	    sum += param.lambda*d[ia][ib]*p[ib] - omega[ia][ib]*p[ib];
-	  }
+      for_simd_v(iv, NSIMDVL) sum[iv] = 0.0;
 
-	  p[ia] += dt*(- flux->fe[addr_rank1(flux->nsite, 3, index,  ia)]
-		       + flux->fw[addr_rank1(flux->nsite, 3, index,  ia)]
-		       - flux->fy[addr_rank1(flux->nsite, 3, index,  ia)]
-		       + flux->fy[addr_rank1(flux->nsite, 3, indexj, ia)]
-		       - flux->fz[addr_rank1(flux->nsite, 3, index,  ia)]
-		       + flux->fz[addr_rank1(flux->nsite, 3, indexk, ia)]
-		       + sum + Gamma_*h[ia]);
+      for (ib = 0; ib < 3; ib++) {
+	for_simd_v(iv, NSIMDVL) {
+	  sum[iv] += lambda*d[ia][ib][iv]*p[ib][iv]
+	    - omega[ia][ib][iv]*p[ib][iv];
 	}
+      }
 
-	field_vector_set(fp, index, p);
+      for_simd_v(iv, NSIMDVL) {
+	if (maskv[iv]) {
+	  p[ia][iv] += dt*
+	    (- flux->fe[addr_rank1(flux->nsite, 3, index + iv, ia)]
+	     + flux->fw[addr_rank1(flux->nsite, 3, index + iv, ia)]
+	     - flux->fy[addr_rank1(flux->nsite, 3, index + iv, ia)]
+	     + flux->fy[addr_rank1(flux->nsite, 3, indexj[iv], ia)]
+	     - flux->fz[addr_rank1(flux->nsite, 3, index + iv, ia)]
+	     + flux->fz[addr_rank1(flux->nsite, 3, indexk[iv], ia)]
+	     + sum[iv] + gamma*h[ia][iv]);
+	}
+      }
+    }
 
-	/* Next lattice site */
+    for (ia = 0; ia < 3; ia++) {
+      for_simd_v(iv, NSIMDVL) {
+	fp->data[addr_rank1(fp->nsites, NVECTOR, index+iv, ia)] = p[ia][iv];
       }
     }
+
+    /* Next sites */
   }
 
-  return 0;
+  return;
 }
 
 /*****************************************************************************
  *
  *  leslie_ericksen_add_swimming_velocity
  *
+ *  Driver for the self-advection contribution u_a += swim p_a.
+ *
  *****************************************************************************/
 
 static int leslie_ericksen_add_swimming_velocity(field_t * fp,
 						 hydro_t * hydro) {
-  int ic, jc, kc, index;
-  int ia;
   int nlocal[3];
-
-  double p[3];
-  double u[3];
+  dim3 nblk, ntpb;
+  kernel_info_t limits;
+  kernel_ctxt_t * ctxt = NULL;
 
   assert(fp);
   assert(hydro);
 
   cs_nlocal(fp->cs, nlocal);
 
-  for (ic = 1; ic <= nlocal[X]; ic++) {
-    for (jc = 1; jc <= nlocal[Y]; jc++) {
-      for (kc = 1; kc <= nlocal[Z]; kc++) {
+  limits.imin = 1; limits.imax = nlocal[X];
+  limits.jmin = 1; limits.jmax = nlocal[Y];
+  limits.kmin = 1; limits.kmax = nlocal[Z];
+
+  kernel_ctxt_create(fp->cs, NSIMDVL, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+  tdpLaunchKernel(leslie_ericksen_swim_kernel_v, nblk, ntpb, 0, 0,
+		  ctxt->target, fp->target, hydro->target, swim_);
+
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
 
-	index = cs_index(fp->cs, ic, jc, kc);
-	field_vector(fp, index, p);
-	hydro_u(hydro, index, u);
+  kernel_ctxt_free(ctxt);
 
-	for (ia = 0; ia < 3; ia++) {
-	  u[ia] += swim_*p[ia];
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  leslie_ericksen_swim_kernel_v
+ *
+ *****************************************************************************/
+
+__global__ void leslie_ericksen_swim_kernel_v(kernel_ctxt_t * ktx,
+					      field_t * fp, hydro_t * hydro,
+					      double swim) {
+  int kindex;
+  __shared__ int kiterations;
+
+  assert(ktx);
+  assert(fp);
+  assert(hydro);
+
+  kiterations = kernel_vector_iterations(ktx);
+
+  for_simt_parallel(kindex, kiterations, NSIMDVL) {
+
+    int iv;
+    int ia;
+    int index;
+    int ic[NSIMDVL], jc[NSIMDVL], kc[NSIMDVL];
+    int maskv[NSIMDVL];
+
+    index = kernel_baseindex(ktx, kindex);
+    kernel_coords_v(ktx, kindex, ic, jc, kc);
+    kernel_mask_v(ktx, ic, jc, kc, maskv);
+
+    for (ia = 0; ia < 3; ia++) {
+      for_simd_v(iv, NSIMDVL) {
+	if (maskv[iv]) {
+	  hydro->u[addr_rank1(hydro->nsite, NHDIM, index+iv, ia)]
+	    += swim*fp->data[addr_rank1(fp->nsites, NVECTOR, index+iv, ia)];
 	}
-	hydro_u_set(hydro, index, u);
       }
     }
   }
 
-  return 0;
+  return;
 }
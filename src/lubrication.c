@@ -8,7 +8,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2014-2018 The University of Edinburgh
+ *  (c) 2014-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -24,6 +24,7 @@
 #include "coords.h"
 #include "physics.h"
 #include "colloids.h"
+#include "colloid_nlist.h"
 #include "lubrication.h"
 
 struct lubrication_s {
@@ -87,9 +88,7 @@ int lubrication_compute(colloids_info_t * cinfo, void * self) {
 
   lubr_t * obj = (lubr_t *) self;
 
-  int ic1, jc1, kc1, ic2, jc2, kc2;
-  int di[2], dj[2], dk[2];
-  int ncell[3];
+  int n, npair;
 
   double ran[2];  /* Random numbers for fluctuation dissipation correction */
   double r12[3];
@@ -98,6 +97,7 @@ int lubrication_compute(colloids_info_t * cinfo, void * self) {
 
   colloid_t * pc1;
   colloid_t * pc2;
+  colloid_nlist_t * nlist = NULL;
 
   assert(cinfo);
   assert(obj);
@@ -105,48 +105,27 @@ int lubrication_compute(colloids_info_t * cinfo, void * self) {
   cs_ltot(obj->cs, ltot);
 
   obj->hminlocal = ltot[X];
-  colloids_info_ncell(cinfo, ncell);
-
-  for (ic1 = 1; ic1 <= ncell[X]; ic1++) {
-    colloids_info_climits(cinfo, X, ic1, di); 
-    for (jc1 = 1; jc1 <= ncell[Y]; jc1++) {
-      colloids_info_climits(cinfo, Y, jc1, dj);
-      for (kc1 = 1; kc1 <= ncell[Z]; kc1++) {
-        colloids_info_climits(cinfo, Z, kc1, dk);
-
-        colloids_info_cell_list_head(cinfo, ic1, jc1, kc1, &pc1);
-        for (; pc1; pc1 = pc1->next) {
-
-          for (ic2 = di[0]; ic2 <= di[1]; ic2++) {
-            for (jc2 = dj[0]; jc2 <= dj[1]; jc2++) {
-              for (kc2 = dk[0]; kc2 <= dk[1]; kc2++) {
-   
-                colloids_info_cell_list_head(cinfo, ic2, jc2, kc2, &pc2);
-                for (; pc2; pc2 = pc2->next) {
-
-                  if (pc1->s.index >= pc2->s.index) continue;
-
-                  cs_minimum_distance(obj->cs, pc1->s.r, pc2->s.r, r12);
-		  util_ranlcg_reap_gaussian(&pc1->s.rng, ran);
-
-		  lubrication_single(obj, pc1->s.ah, pc2->s.ah, pc1->s.v,
-				     pc2->s.v, r12, ran, f);
-
-		  pc1->force[X] += f[X];
-		  pc1->force[Y] += f[Y];
-		  pc1->force[Z] += f[Z];
-
-		  pc2->force[X] -= f[X];
-		  pc2->force[Y] -= f[Y];
-		  pc2->force[Z] -= f[Z];
-
-		}
-	      }
-	    }
-	  }
-	}
-      }
-    }
+
+  colloids_info_nlist(cinfo, &nlist);
+  colloid_nlist_npair(nlist, &npair);
+
+  for (n = 0; n < npair; n++) {
+
+    colloid_nlist_pair(nlist, n, &pc1, &pc2);
+
+    cs_minimum_distance(obj->cs, pc1->s.r, pc2->s.r, r12);
+    util_ranlcg_reap_gaussian(&pc1->s.rng, ran);
+
+    lubrication_single(obj, pc1->s.ah, pc2->s.ah, pc1->s.v,
+		       pc2->s.v, r12, ran, f);
+
+    pc1->force[X] += f[X];
+    pc1->force[Y] += f[Y];
+    pc1->force[Z] += f[Z];
+
+    pc2->force[X] -= f[X];
+    pc2->force[Y] -= f[Y];
+    pc2->force[Z] -= f[Z];
   }
 
   return 0;
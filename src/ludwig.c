@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2011-2018 The University of Edinburgh
+ *  (c) 2011-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -26,11 +26,14 @@
 #include "ran.h"
 #include "noise.h"
 #include "timer.h"
+#include "telemetry.h"
 #include "coords_rt.h"
 #include "coords.h"
 #include "leesedwards_rt.h"
 #include "control.h"
 #include "util.h"
+#include "memory.h"
+#include "kernel.h"
 
 #include "model.h"
 #include "model_le.h"
@@ -49,6 +52,7 @@
 #include "hydro_rt.h"
 
 #include "io_harness.h"
+#include "io_async.h"
 #include "phi_stats.h"
 #include "phi_force.h"
 #include "phi_force_colloid.h"
@@ -88,6 +92,7 @@
 #include "psi.h"
 #include "psi_rt.h"
 #include "psi_sor.h"
+#include "psi_mg.h"
 #include "psi_stats.h"
 #include "psi_force.h"
 #include "psi_colloid.h"
@@ -130,8 +135,10 @@ struct ludwig_s {
   field_grad_t * p_grad;    /* Gradients for p */
   field_grad_t * q_grad;    /* Gradients for q */
   psi_t * psi;              /* Electrokinetics */
+  psi_mg_t * psimg;         /* Multigrid Poisson solver (optional) */
   map_t * map;              /* Site map for fluid/solid status etc. */
   wall_t * wall;            /* Side walls / Porous media */
+  lb_sparse_t * sparse;     /* Fluid sites only LB (optional) */
   noise_t * noise_rho;      /* Lattice fluctuation generator (rho) */
   noise_t * noise_phi;      /* Binary fluid noise generation (fluxes) */
   f_vare_t epsilon;         /* Variable epsilon function for Poisson solver */
@@ -146,6 +153,7 @@ struct ludwig_s {
 
   colloids_info_t * collinfo;  /* Colloid information */
   colloid_io_t * cio;          /* Colloid I/O harness */
+  io_async_t * ioasync;        /* Asynchronous lattice output (optional) */
   ewald_t * ewald;             /* Ewald sum for dipoles */
   interact_t * interact;       /* Colloid-colloid interaction handler */
   bbl_t * bbl;                 /* Bounce-back on links boundary condition */
@@ -157,8 +165,13 @@ struct ludwig_s {
 };
 
 static int ludwig_rt(ludwig_t * ludwig);
+static int ludwig_placement_rt(ludwig_t * ludwig);
+static int ludwig_tiling_rt(ludwig_t * ludwig);
+static int ludwig_report_halo(ludwig_t * ludwig, int nstep);
 static int ludwig_report_momentum(ludwig_t * ludwig);
 static int ludwig_colloids_update(ludwig_t * ludwig);
+static int ludwig_io_write(ludwig_t * ludwig, int step, io_info_t * info,
+			   const char * filename, void * data);
 int free_energy_init_rt(ludwig_t * ludwig);
 int map_init_rt(pe_t * pe, cs_t * cs, rt_t * rt, map_t ** map);
 int io_replace_values(field_t * field, map_t * map, int map_id, double value);
@@ -181,6 +194,9 @@ static int ludwig_rt(ludwig_t * ludwig) {
   char value[BUFSIZ];
   int io_grid_default[3] = {1, 1, 1};
   int io_grid[3];
+  lb_propagation_enum_t nprop;
+  int noverlap;
+  int nbuffer;
 
   pe_t * pe = NULL;
   cs_t * cs = NULL;
@@ -195,6 +211,10 @@ static int ludwig_rt(ludwig_t * ludwig) {
   /* Prefer maximum L1 cache available on device */
   tdpDeviceSetCacheConfig(tdpFuncCachePreferL1);
 
+  /* Host memory placement must be set before any lattice allocation */
+  ludwig_placement_rt(ludwig);
+  ludwig_tiling_rt(ludwig);
+
   /* Initialise free-energy related objects, and the coordinate
    * system (the halo extent depends on choice of free energy). */
 
@@ -213,8 +233,27 @@ static int ludwig_rt(ludwig_t * ludwig) {
 
 #ifdef PETSC
   if (ludwig->psi) psi_petsc_init(ludwig->psi, ludwig->fe, ludwig->epsilon);
+#else
+  if (ludwig->psi) {
+    int solver = PSI_POISSON_SOR;
+    psi_solver(ludwig->psi, &solver);
+    if (solver == PSI_POISSON_MULTIGRID) {
+      psi_mg_create(ludwig->psi, &ludwig->psimg);
+      psi_mg_info(ludwig->psimg);
+    }
+  }
 #endif
 
+  /* Lees-Edwards boundary conditions intervene between collision
+   * and halo swap, so no overlap is possible. */
+
+  strcpy(value, "no");
+  rt_string_parameter(rt, "lb_halo_overlap", value, BUFSIZ);
+
+  if (strcmp(value, "yes") == 0 && lees_edw_nplane_total(ludwig->le) > 0) {
+    pe_fatal(pe, "lb_halo_overlap is not available with Lees Edwards\n");
+  }
+
   lb_run_time(pe, cs, rt, ludwig->lb);
   collision_run_time(pe, rt, ludwig->lb, ludwig->noise_rho);
   map_init_rt(pe, cs, rt, &ludwig->map);
@@ -238,6 +277,9 @@ static int ludwig_rt(ludwig_t * ludwig) {
   if (n != 0 && strcmp(value, "ASCII") == 0) {
     form = IO_FORMAT_ASCII;
   }
+  if (n != 0 && strcmp(value, "BINARY_MPIIO") == 0) {
+    form = IO_FORMAT_BINARY_MPIIO;
+  }
 
 
   /* All the same I/O grid  */
@@ -257,6 +299,20 @@ static int ludwig_rt(ludwig_t * ludwig) {
     advection_init_rt(pe, rt);
   }
 
+  /* Asynchronous (background) lattice output */
+
+  n = rt_string_parameter(rt, "io_async", value, BUFSIZ);
+  if (n != 0 && strcmp(value, "yes") == 0) {
+    nbuffer = 2;
+    rt_int_parameter(rt, "io_async_nbuffer", &nbuffer);
+    pe_info(pe, "\n");
+    pe_info(pe, "Asynchronous I/O\n");
+    pe_info(pe, "----------------\n");
+    pe_info(pe, "Lattice output:               background I/O thread\n");
+    pe_info(pe, "Staging buffers (time steps): %d\n", nbuffer);
+    io_async_create(pe, cs, nbuffer, &ludwig->ioasync);
+  }
+
   /* Can we move this down to t = 0 initialisation? */
 
   if (ludwig->fe_symm) {
@@ -280,11 +336,107 @@ static int ludwig_rt(ludwig_t * ludwig) {
   bbl_create(pe, ludwig->cs, ludwig->lb, &ludwig->bbl);
   bbl_active_set(ludwig->bbl, ludwig->collinfo);
 
+  /* The AA propagation cannot be combined with Lees-Edwards planes,
+   * and is meaningless without hydrodynamics. */
+
+  lb_propagation_scheme(ludwig->lb, &nprop);
+
+  if (nprop == LB_PROPAGATION_AA) {
+    if (lees_edw_nplane_total(ludwig->le) > 0) {
+      pe_fatal(pe, "AA propagation is not available with Lees Edwards\n");
+    }
+    if (ludwig->hydro == NULL) {
+      pe_fatal(pe, "AA propagation requires hydrodynamics\n");
+    }
+  }
+
+  lb_halo_overlap(ludwig->lb, &noverlap);
+
+  /* Sparse (fluid sites only) collision and propagation. Bounce-back
+   * is part of the propagation, so solids must be stationary, and
+   * the map must not change (no colloids). */
+
+  strcpy(value, "no");
+  rt_string_parameter(rt, "lb_sparse", value, BUFSIZ);
+
+  if (strcmp(value, "yes") == 0) {
+    int ia;
+    int ncolloid;
+    wall_param_t wp;
+
+    lb_ndist(ludwig->lb, &n);
+    wall_param(ludwig->wall, &wp);
+    colloids_info_ntotal(ludwig->collinfo, &ncolloid);
+
+    if (ludwig->hydro == NULL) {
+      pe_fatal(pe, "lb_sparse requires hydrodynamics\n");
+    }
+    if (n != 1) pe_fatal(pe, "lb_sparse requires ndist = 1\n");
+    if (nprop != LB_PROPAGATION_TWO_LATTICE) {
+      pe_fatal(pe, "lb_sparse requires two_lattice propagation\n");
+    }
+    if (noverlap) {
+      pe_fatal(pe, "lb_sparse is not available with lb_halo_overlap\n");
+    }
+    if (lees_edw_nplane_total(ludwig->le) > 0) {
+      pe_fatal(pe, "lb_sparse is not available with Lees Edwards\n");
+    }
+    if (ncolloid > 0) {
+      pe_fatal(pe, "lb_sparse is not available with colloids\n");
+    }
+    for (ia = 0; ia < 3; ia++) {
+      if (wp.utop[ia] != 0.0 || wp.ubot[ia] != 0.0) {
+	pe_fatal(pe, "lb_sparse requires stationary walls\n");
+      }
+    }
+
+    lb_sparse_create(pe, cs, ludwig->lb, &ludwig->sparse);
+    lb_sparse_build(ludwig->sparse, ludwig->map);
+    lb_sparse_info(ludwig->sparse);
+  }
+
+  /* Communication-avoiding halo swap: the collision and propagation
+   * are repeated in the halo between swaps, so nothing else may
+   * depend on (or change) the halo distributions. Walls are allowed
+   * (links from halo sites are included in the wall link list). */
+
+  lb_halo_depth(ludwig->lb, &n);
+
+  if (n > 1) {
+    int ncolloid;
+    int noise;
+
+    colloids_info_ntotal(ludwig->collinfo, &ncolloid);
+    noise_present(ludwig->noise_rho, NOISE_RHO, &noise);
+
+    if (ludwig->hydro == NULL) {
+      pe_fatal(pe, "lb_halo_depth requires hydrodynamics\n");
+    }
+    if (ludwig->fe) pe_fatal(pe, "lb_halo_depth requires free_energy none\n");
+    if (ludwig->sparse) {
+      pe_fatal(pe, "lb_halo_depth is not available with lb_sparse\n");
+    }
+    if (lees_edw_nplane_total(ludwig->le) > 0) {
+      pe_fatal(pe, "lb_halo_depth is not available with Lees Edwards\n");
+    }
+    if (ncolloid > 0) {
+      pe_fatal(pe, "lb_halo_depth is not available with colloids\n");
+    }
+    if (noise) {
+      pe_fatal(pe, "lb_halo_depth is not available with fluctuations\n");
+    }
+  }
+
   /* NOW INITIAL CONDITIONS */
 
   pe_subdirectory(pe, subdirectory);
   ntstep = physics_control_timestep(ludwig->phys);
 
+  /* Counter-based noise is keyed on the time step (no state to read) */
+
+  noise_step_set(ludwig->noise_rho, ntstep);
+  if (ludwig->noise_phi) noise_step_set(ludwig->noise_phi, ntstep);
+
   if (ntstep == 0) {
     n = 0;
     lb_rt_initial_conditions(pe, rt, ludwig->lb, ludwig->phys);
@@ -352,9 +504,33 @@ static int ludwig_rt(ludwig_t * ludwig) {
 		     ludwig->collinfo);
   }
 
+  /* Relaxational LC dynamics: if the gradients are not required by
+   * anything else, they can be computed in the Beris-Edwards update
+   * (the stored gradients are then only computed for statistics). */
+
+  if (ludwig->be && ludwig->hydro == NULL && ludwig->fe->id == FE_LC) {
+    fe_lc_param_t lc_param;
+    char value[BUFSIZ] = "";
+
+    fe_lc_param(ludwig->fe_lc, &lc_param);
+    rt_string_parameter(rt, "fd_gradient_calculation", value, BUFSIZ);
+    rt_string_parameter(rt, "fd_gradient_calculation_q", value, BUFSIZ);
+
+    if (strcmp(value, "3d_7pt_fluid") == 0 &&
+	lees_edw_nplane_total(ludwig->le) == 0 &&
+	lc_param.is_redshift_updated == 0 && lc_param.zeta2 == 0.0) {
+      pe_info(pe, "Beris-Edwards update with gradients (fused)\n");
+      beris_edw_fused_set(ludwig->be, 1);
+    }
+  }
+
   stats_rheology_create(pe, cs, &ludwig->stat_rheo);
   stats_turbulent_create(pe, cs, &ludwig->stat_turb);
 
+  /* Performance telemetry (if requested) */
+
+  telemetry_init_rt(pe, rt);
+
   /* Calibration statistics for ah required? */
 
   n = rt_string_parameter(rt, "calibration", filename, FILENAME_MAX);
@@ -415,6 +591,12 @@ void ludwig_run(const char * inputfile) {
   double  uzero[3] = {0.0, 0.0, 0.0};
   int     im, multisteps;
   int	  flag;
+  lb_aa_step_enum_t aastep;
+  int noverlap;
+  int ndepth;
+  int ndstep = 0;
+  int nextra = 0;
+  int nstep = 0;
 
   io_info_t * iohandler = NULL;
   ludwig_t * ludwig = NULL;
@@ -440,6 +622,22 @@ void ludwig_run(const char * inputfile) {
   pe_info(ludwig->pe, "Initial conditions.\n");
   wall_is_pm(ludwig->wall, &is_porous_media);
 
+  /* Move initialised data to target for time stepping loop (and the
+   * statistics, which are computed on the target) */
+
+  map_memcpy(ludwig->map, tdpMemcpyHostToDevice);
+  lb_memcpy(ludwig->lb, tdpMemcpyHostToDevice);
+
+  /* The target colloid map is subsequently updated only where it
+   * changes (see build_remove_replace()). */
+
+  colloids_info_ntotal(ludwig->collinfo, &ncolloid);
+  if (ncolloid > 0) colloids_memcpy(ludwig->collinfo, tdpMemcpyHostToDevice);
+
+  if (ludwig->phi) field_memcpy(ludwig->phi, tdpMemcpyHostToDevice);
+  if (ludwig->p)   field_memcpy(ludwig->p, tdpMemcpyHostToDevice);
+  if (ludwig->q)   field_memcpy(ludwig->q, tdpMemcpyHostToDevice);
+
   stats_distribution_print(ludwig->lb, ludwig->map);
 
   lb_ndist(ludwig->lb, &im);
@@ -458,20 +656,14 @@ void ludwig_run(const char * inputfile) {
   }
   ludwig_report_momentum(ludwig);
 
-  /* Move initilaised data to target for time stepping loop */
-
-  lb_memcpy(ludwig->lb, tdpMemcpyHostToDevice);
-  if (ludwig->phi) field_memcpy(ludwig->phi, tdpMemcpyHostToDevice);
-  if (ludwig->p)   field_memcpy(ludwig->p, tdpMemcpyHostToDevice);
-  if (ludwig->q)   field_memcpy(ludwig->q, tdpMemcpyHostToDevice);
-
-  
   /* Main time stepping loop */
 
   pe_info(ludwig->pe, "\n");
   pe_info(ludwig->pe, "Starting time step loop.\n");
   subgrid_on(&is_subgrid);
 
+  lb_halo_depth(ludwig->lb, &ndepth);
+
   /* sync tasks before main loop for timing purposes */
   MPI_Barrier(comm);
 
@@ -480,6 +672,7 @@ void ludwig_run(const char * inputfile) {
     TIMER_start(TIMER_STEPS);
 
     step = physics_control_timestep(ludwig->phys);
+    nstep += 1;
 
     if (ludwig->hydro) {
       hydro_f_zero(ludwig->hydro, fzero);
@@ -514,12 +707,18 @@ void ludwig_run(const char * inputfile) {
     }
 
     if (ludwig->q) {
+      int fused = 0;
+
       TIMER_start(TIMER_PHI_HALO);
       field_halo(ludwig->q);
       TIMER_stop(TIMER_PHI_HALO);
-      
-      field_grad_compute(ludwig->q_grad);
-      fe_lc_redshift_compute(ludwig->cs, ludwig->fe_lc);
+
+      beris_edw_fused(ludwig->be, &fused);
+
+      if (fused == 0 || is_statistics_step()) {
+	field_grad_compute(ludwig->q_grad);
+	fe_lc_redshift_compute(ludwig->cs, ludwig->fe_lc);
+      }
     }
     TIMER_stop(TIMER_PHI_GRADIENTS);
     if (ludwig->fe_lc) fe_lc_active_stress(ludwig->fe_lc);
@@ -538,7 +737,12 @@ void ludwig_run(const char * inputfile) {
 #ifdef PETSC
 	psi_petsc_solve(ludwig->psi, ludwig->fe, ludwig->epsilon);
 #else
-	psi_sor_solve(ludwig->psi, ludwig->fe, ludwig->epsilon);
+	if (ludwig->psimg) {
+	  psi_mg_solve(ludwig->psimg, ludwig->fe, ludwig->epsilon);
+	}
+	else {
+	  psi_sor_solve(ludwig->psi, ludwig->fe, ludwig->epsilon);
+	}
 #endif
 	TIMER_stop(TIMER_ELECTRO_POISSON);
       }
@@ -694,23 +898,88 @@ void ludwig_run(const char * inputfile) {
 
       /* Collision stage */
 
-      TIMER_start(TIMER_COLLIDE);
+      lb_halo_overlap(ludwig->lb, &noverlap);
 
-      lb_collide(ludwig->lb, ludwig->hydro, ludwig->map, ludwig->noise_rho,
-		 ludwig->fe);
+      if (ludwig->sparse) {
+	/* Fluid sites only */
 
-      TIMER_stop(TIMER_COLLIDE);
+	TIMER_start(TIMER_COLLIDE);
+	lb_collide_sparse(ludwig->lb, ludwig->hydro, ludwig->map,
+			  ludwig->noise_rho, ludwig->fe, ludwig->sparse);
+	TIMER_stop(TIMER_COLLIDE);
 
-      
-      /* Boundary conditions */
+	TIMER_start(TIMER_HALO_LATTICE);
+	lb_sparse_halo(ludwig->sparse);
+	TIMER_stop(TIMER_HALO_LATTICE);
+      }
+      else if (noverlap) {
+	/* Collide at the edges of the local domain first, so the halo
+	 * swap can proceed while the interior sites collide. */
 
-      lb_le_apply_boundary_conditions(ludwig->lb, ludwig->le);
+	TIMER_start(TIMER_COLLIDE);
+	lb_collide_boundary(ludwig->lb, ludwig->hydro, ludwig->map,
+			    ludwig->noise_rho, ludwig->fe);
+	TIMER_stop(TIMER_COLLIDE);
 
-      TIMER_start(TIMER_HALO_LATTICE);
+	TIMER_start(TIMER_HALO_LATTICE);
+	lb_halo_start(ludwig->lb);
+	TIMER_stop(TIMER_HALO_LATTICE);
 
-      lb_halo(ludwig->lb);
+	TIMER_start(TIMER_COLLIDE);
+	lb_collide_interior(ludwig->lb, ludwig->hydro, ludwig->map,
+			    ludwig->noise_rho, ludwig->fe);
+	TIMER_stop(TIMER_COLLIDE);
 
-      TIMER_stop(TIMER_HALO_LATTICE);
+	TIMER_start(TIMER_HALO_LATTICE);
+	lb_halo_wait(ludwig->lb);
+	TIMER_stop(TIMER_HALO_LATTICE);
+      }
+      else if (ndepth > 1) {
+	/* Communication-avoiding: the halo of width ndepth is swapped
+	 * every ndepth steps. In between, collision and propagation
+	 * extend into the part of the halo which is still valid. */
+
+	nextra = (ndstep == 0) ? 0 : ndepth - ndstep;
+
+	TIMER_start(TIMER_COLLIDE);
+	lb_collide_extended(ludwig->lb, ludwig->hydro, ludwig->map,
+			    ludwig->noise_rho, ludwig->fe, nextra);
+	TIMER_stop(TIMER_COLLIDE);
+
+	if (ndstep == 0) {
+	  TIMER_start(TIMER_HALO_LATTICE);
+	  lb_halo(ludwig->lb);
+	  TIMER_stop(TIMER_HALO_LATTICE);
+	}
+      }
+      else {
+
+	TIMER_start(TIMER_COLLIDE);
+
+	lb_collide(ludwig->lb, ludwig->hydro, ludwig->map, ludwig->noise_rho,
+		   ludwig->fe);
+
+	TIMER_stop(TIMER_COLLIDE);
+
+	/* Boundary conditions */
+
+	lb_le_apply_boundary_conditions(ludwig->lb, ludwig->le);
+
+	TIMER_start(TIMER_HALO_LATTICE);
+
+	/* The odd AA step has pushed distributions into the halo */
+
+	lb_aa_step(ludwig->lb, &aastep);
+
+	if (aastep == LB_AA_ODD) {
+	  lb_halo_reverse(ludwig->lb);
+	}
+	else {
+	  lb_halo(ludwig->lb);
+	}
+
+	TIMER_stop(TIMER_HALO_LATTICE);
+      }
 
       /* Colloid bounce-back applied between collision and
        * propagation steps. */
@@ -718,7 +987,8 @@ void ludwig_run(const char * inputfile) {
       if (is_subgrid) {
 	subgrid_update(ludwig->collinfo, ludwig->hydro);
       }
-      else {
+      else if (ludwig->sparse == NULL) {
+	/* The sparse propagation includes the bounce-back at walls */
 	TIMER_start(TIMER_BBL);
 	wall_set_wall_distributions(ludwig->wall);
 	bounce_back_on_links(ludwig->bbl, ludwig->lb, ludwig->wall,
@@ -742,7 +1012,16 @@ void ludwig_run(const char * inputfile) {
 
     if (ludwig->hydro) {
       TIMER_start(TIMER_PROPAGATE);
-      lb_propagation(ludwig->lb);
+      if (ludwig->sparse) {
+	lb_propagation_sparse(ludwig->lb, ludwig->sparse);
+      }
+      else if (ndepth > 1) {
+	lb_propagation_extended(ludwig->lb, ndepth - 1 - ndstep);
+	ndstep = (ndstep + 1) % ndepth;
+      }
+      else {
+	lb_propagation(ludwig->lb);
+      }
       TIMER_stop(TIMER_PROPAGATE);
     }
 
@@ -750,6 +1029,14 @@ void ludwig_run(const char * inputfile) {
 
     TIMER_start(TIMER_FREE1); /* Time diagnostics */
 
+    /* Distributions from the AA propagation must be in natural
+     * order if they are to be used for any output. */
+
+    if (is_config_step() || is_rho_output_step() || is_statistics_step() ||
+	is_shear_measurement_step()) {
+      lb_propagation_aa_complete(ludwig->lb);
+    }
+
     /* Configuration dump */
 
     if (is_config_step()) {
@@ -757,14 +1044,14 @@ void ludwig_run(const char * inputfile) {
       pe_info(ludwig->pe, "Writing distribution output at step %d!\n", step);
       sprintf(filename, "%sdist-%8.8d", subdirectory, step);
       lb_io_info(ludwig->lb, &iohandler);
-      io_write_data(iohandler, filename, ludwig->lb);
+      ludwig_io_write(ludwig, step, iohandler, filename, ludwig->lb);
     }
 
     if (is_rho_output_step()) {
       /* Potential device-host copy required */
       pe_info(ludwig->pe, "Writing density output at step %d!\n", step);
       sprintf(filename, "%srho-%8.8d", subdirectory, step);
-      io_write_data(ludwig->lb->io_rho, filename, ludwig->lb);
+      ludwig_io_write(ludwig, step, ludwig->lb->io_rho, filename, ludwig->lb);
     }
 
     /* is_measurement_step() is here to prevent 'breaking' old input
@@ -781,18 +1068,20 @@ void ludwig_run(const char * inputfile) {
     if (is_phi_output_step() || is_config_step()) {
 
       if (ludwig->phi) {
+	field_memcpy(ludwig->phi, tdpMemcpyDeviceToHost);
 	field_io_info(ludwig->phi, &iohandler);
 	pe_info(ludwig->pe, "Writing phi file at step %d!\n", step);
 	sprintf(filename,"%sphi-%8.8d", subdirectory, step);
-	io_write_data(iohandler, filename, ludwig->phi);
+	ludwig_io_write(ludwig, step, iohandler, filename, ludwig->phi);
       }
       if (ludwig->q) {
+	field_memcpy(ludwig->q, tdpMemcpyDeviceToHost);
 	field_io_info(ludwig->q, &iohandler);
 	/* replace q-tensor on former colloid sites */
 	io_replace_values(ludwig->q, ludwig->map, MAP_COLLOID, 0.00001);
 	pe_info(ludwig->pe, "Writing q file at step %d!\n", step);
 	sprintf(filename,"%sq-%8.8d", subdirectory, step);
-	io_write_data(iohandler, filename, ludwig->q);
+	ludwig_io_write(ludwig, step, iohandler, filename, ludwig->q);
       }
     }
 
@@ -801,7 +1090,7 @@ void ludwig_run(const char * inputfile) {
 	psi_io_info(ludwig->psi, &iohandler);
 	pe_info(ludwig->pe, "Writing psi file at step %d!\n", step);
 	sprintf(filename,"%spsi-%8.8d", subdirectory, step);
-	io_write_data(iohandler, filename, ludwig->psi);
+	ludwig_io_write(ludwig, step, iohandler, filename, ludwig->psi);
       }
     }
 
@@ -825,41 +1114,36 @@ void ludwig_run(const char * inputfile) {
     }
 
     if (is_vel_output_step() || is_config_step()) {
+      hydro_memcpy(ludwig->hydro, tdpMemcpyDeviceToHost);
       hydro_io_info(ludwig->hydro, &iohandler);
       pe_info(ludwig->pe, "Writing velocity output at step %d!\n", step);
       sprintf(filename, "%svel-%8.8d", subdirectory, step);
-      io_write_data(iohandler, filename, ludwig->hydro);
+      ludwig_io_write(ludwig, step, iohandler, filename, ludwig->hydro);
     }
 
     /* Print progress report */
 
     if (is_statistics_step()) {
-      lb_memcpy(ludwig->lb, tdpMemcpyDeviceToHost);
+      /* Reductions are on the target; only host code needs copies */
       stats_distribution_print(ludwig->lb, ludwig->map);
       lb_ndist(ludwig->lb, &im);
 
       if (ludwig->phi) {
-	field_grad_memcpy(ludwig->phi_grad, tdpMemcpyDeviceToHost);
 	if (im == 2) {
-	  /* Recompute phi (kernel) and copy back if required */
+	  /* Recompute phi (kernel) */
 	  phi_lb_to_field(ludwig->phi, ludwig->lb);
-	  field_memcpy(ludwig->phi, tdpMemcpyDeviceToHost);
 	  stats_field_info_bbl(ludwig->phi, ludwig->map, ludwig->bbl);
 	}
 	else {
-	  field_memcpy(ludwig->phi, tdpMemcpyDeviceToHost);
 	  stats_field_info(ludwig->phi, ludwig->map);
 	}
       }
 
       if (ludwig->p) {
-	field_memcpy(ludwig->p, tdpMemcpyDeviceToHost);
 	stats_field_info(ludwig->p, ludwig->map);
       }
 
       if (ludwig->q) {
-	field_memcpy(ludwig->q, tdpMemcpyDeviceToHost);
-	field_grad_memcpy(ludwig->q_grad, tdpMemcpyDeviceToHost);
 	stats_field_info(ludwig->q, ludwig->map);
       }
 
@@ -875,9 +1159,19 @@ void ludwig_run(const char * inputfile) {
       if (ludwig->fe) {
 	switch (ludwig->fe->id) {
 	case FE_LC:
+	  field_memcpy(ludwig->q, tdpMemcpyDeviceToHost);
+	  field_grad_memcpy(ludwig->q_grad, tdpMemcpyDeviceToHost);
 	  fe_lc_stats_info(ludwig->pe, ludwig->cs, ludwig->fe_lc,
 			   ludwig->wall, ludwig->map, ludwig->collinfo, step);
 	  break;
+	case FE_ELECTRO_SYMMETRIC:
+	  /* Host free energy density */
+	  field_memcpy(ludwig->phi, tdpMemcpyDeviceToHost);
+	  field_grad_memcpy(ludwig->phi_grad, tdpMemcpyDeviceToHost);
+	  stats_free_energy_density(ludwig->pe, ludwig->cs, ludwig->wall,
+				    ludwig->fe, ludwig->map,
+				    ludwig->collinfo);
+	  break;
 	default:
 	  stats_free_energy_density(ludwig->pe, ludwig->cs, ludwig->wall,
 				    ludwig->fe, ludwig->map,
@@ -888,7 +1182,6 @@ void ludwig_run(const char * inputfile) {
 
       if (ludwig->hydro) {
 	wall_is_pm(ludwig->wall, &is_pm);
-	hydro_memcpy(ludwig->hydro, tdpMemcpyDeviceToHost);
 	stats_velocity_minmax(ludwig->hydro, ludwig->map, is_pm);
       }
 
@@ -901,6 +1194,8 @@ void ludwig_run(const char * inputfile) {
 
     TIMER_stop(TIMER_FREE1);
 
+    telemetry_step(step);
+
     /* Next time step */
   }
 
@@ -908,14 +1203,16 @@ void ludwig_run(const char * inputfile) {
    * a final dump, there's a barrier here. */
 
   MPI_Barrier(comm); 
+  if (ludwig->ioasync) io_async_wait(ludwig->ioasync);
 
   /* Dump the final configuration if required. */
 
   if (is_config_at_end()) {
+    lb_propagation_aa_complete(ludwig->lb);
     lb_memcpy(ludwig->lb, tdpMemcpyDeviceToHost);
     sprintf(filename, "%sdist-%8.8d", subdirectory, step);
     lb_io_info(ludwig->lb, &iohandler);
-    io_write_data(iohandler, filename, ludwig->lb);
+    ludwig_io_write(ludwig, step, iohandler, filename, ludwig->lb);
     sprintf(filename, "%s%s%8.8d", subdirectory, "config.cds", step);
 
     if (ncolloid > 0) colloid_io_write(ludwig->cio, filename);
@@ -924,14 +1221,14 @@ void ludwig_run(const char * inputfile) {
       field_io_info(ludwig->phi, &iohandler);
       pe_info(ludwig->pe, "Writing phi file at step %d!\n", step);
       sprintf(filename,"%sphi-%8.8d", subdirectory, step);
-      io_write_data(iohandler, filename, ludwig->phi);
+      ludwig_io_write(ludwig, step, iohandler, filename, ludwig->phi);
     }
 
     if (ludwig->q) {
       field_io_info(ludwig->q, &iohandler);
       pe_info(ludwig->pe, "Writing q file at step %d!\n", step);
       sprintf(filename,"%sq-%8.8d", subdirectory, step);
-      io_write_data(iohandler, filename, ludwig->q);
+      ludwig_io_write(ludwig, step, iohandler, filename, ludwig->q);
     }
     /* Only strictly required if have order parameter dynamics */ 
     if (ludwig->hydro) {
@@ -940,20 +1237,27 @@ void ludwig_run(const char * inputfile) {
       hydro_io_info(ludwig->hydro, &iohandler);
       pe_info(ludwig->pe, "Writing velocity output at step %d!\n", step);
       sprintf(filename, "%svel-%8.8d", subdirectory, step);
-      io_write_data(iohandler, filename, ludwig->hydro);
+      ludwig_io_write(ludwig, step, iohandler, filename, ludwig->hydro);
     }
     if (ludwig->psi) {
       psi_io_info(ludwig->psi, &iohandler);
       pe_info(ludwig->pe, "Writing psi file at step %d!\n", step);
       sprintf(filename,"%spsi-%8.8d", subdirectory, step);
-      io_write_data(iohandler, filename, ludwig->psi);
+      ludwig_io_write(ludwig, step, iohandler, filename, ludwig->psi);
     }
   }
 
+  ludwig_report_halo(ludwig, nstep);
+
+  /* All output must be complete before shut down. */
+
+  if (ludwig->ioasync) io_async_free(ludwig->ioasync);
+
   /* Shut down cleanly. Give the timer statistics. Finalise PE. */
 #ifdef PETSC
   if (ludwig->psi) psi_petsc_finish();
 #endif
+  if (ludwig->psimg) psi_mg_free(ludwig->psimg);
 
   if (ludwig->stat_rheo) stats_rheology_free(ludwig->stat_rheo);
   if (ludwig->stat_turb) stats_turbulent_free(ludwig->stat_turb);
@@ -969,6 +1273,7 @@ void ludwig_run(const char * inputfile) {
   bbl_free(ludwig->bbl);
   colloids_info_free(ludwig->collinfo);
 
+  if (ludwig->sparse)    lb_sparse_free(ludwig->sparse);
   if (ludwig->wall)      wall_free(ludwig->wall);
   if (ludwig->noise_phi) noise_free(ludwig->noise_phi);
   if (ludwig->noise_rho) noise_free(ludwig->noise_rho);
@@ -977,9 +1282,11 @@ void ludwig_run(const char * inputfile) {
 
   if (ludwig->stat_sigma) stats_sigma_free(ludwig->stat_sigma);
   if (ludwig->fe) ludwig->fe->func->free(ludwig->fe);
+  kernel_ctxt_cache_clear();
 
   TIMER_stop(TIMER_TOTAL);
   TIMER_statistics();
+  telemetry_finish();
 
   lees_edw_free(ludwig->le);
   cs_free(ludwig->cs);
@@ -989,6 +1296,201 @@ void ludwig_run(const char * inputfile) {
   return;
 }
 
+/*****************************************************************************
+ *
+ *  ludwig_placement_rt
+ *
+ *  Page size for the large lattice arrays (which are placed by
+ *  parallel first touch), and a report of host thread affinity.
+ *
+ *****************************************************************************/
+
+static int ludwig_placement_rt(ludwig_t * ludwig) {
+
+  int n;
+  int ncpu;
+  int nthread = 1;
+  int nshared = 0;
+  int nshared_max = 0;
+  int * cpu = NULL;
+  char value[BUFSIZ] = "none";
+  mem_huge_page_enum_t page = MEM_HUGE_PAGE_NONE;
+  pe_t * pe = NULL;
+  MPI_Comm comm;
+
+  assert(ludwig);
+
+  pe = ludwig->pe;
+  pe_mpi_comm(pe, &comm);
+
+  rt_string_parameter(ludwig->rt, "lattice_huge_pages", value, BUFSIZ);
+
+  if (strcmp(value, "2MB") == 0) {
+    page = MEM_HUGE_PAGE_2MB;
+  }
+  else if (strcmp(value, "1GB") == 0) {
+    page = MEM_HUGE_PAGE_1GB;
+  }
+  else if (strcmp(value, "none") != 0) {
+    pe_fatal(pe, "lattice_huge_pages must be none, 2MB, or 1GB\n");
+  }
+
+  mem_huge_page_set(page);
+
+  ncpu = tdp_get_max_threads();
+  cpu = (int *) calloc(ncpu, sizeof(int));
+  if (cpu == NULL) pe_fatal(pe, "calloc(cpu) failed\n");
+
+  tdpHostThreadAffinity(&nthread, cpu);
+  nthread = (nthread < ncpu) ? nthread : ncpu;
+
+  /* Count threads found on the same cpu as a lower-numbered thread */
+
+  for (n = 1; n < nthread; n++) {
+    int m;
+    for (m = 0; m < n; m++) {
+      if (cpu[n] >= 0 && cpu[m] == cpu[n]) {
+	nshared += 1;
+	break;
+      }
+    }
+  }
+
+  MPI_Reduce(&nshared, &nshared_max, 1, MPI_INT, MPI_MAX, 0, comm);
+
+  /* Lines introduced by "Host" are not compared in regression tests */
+
+  pe_info(pe, "\n");
+  pe_info(pe, "Host threads per process:     %d\n", nthread);
+  pe_info(pe, "Host lattice data placement:  first touch (huge pages %s)\n",
+	  value);
+  pe_info(pe, "Host thread cpu (rank 0):    ");
+  for (n = 0; n < nthread; n++) {
+    pe_info(pe, " %d", cpu[n]);
+  }
+  pe_info(pe, "\n");
+
+  if (nshared_max > 0) {
+    pe_info(pe, "Host threads share a cpu (see OMP_PROC_BIND, OMP_PLACES)\n");
+  }
+
+  free(cpu);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ludwig_tiling_rt
+ *
+ *  Cache-blocked tiles for kernels which support them
+ *  (kernel_ctxt_create_tiled()). Default is no tiling.
+ *
+ *****************************************************************************/
+
+static int ludwig_tiling_rt(ludwig_t * ludwig) {
+
+  int tile[3] = {0, 0, 0};
+  char value[BUFSIZ] = "tile";
+  kernel_tile_order_enum_t order = KERNEL_TILE_ORDER_TILE;
+  pe_t * pe = NULL;
+
+  assert(ludwig);
+
+  pe = ludwig->pe;
+
+  rt_int_parameter_vector(ludwig->rt, "kernel_tile_size", tile);
+  rt_string_parameter(ludwig->rt, "kernel_tile_order", value, BUFSIZ);
+
+  if (tile[X] < 0 || tile[Y] < 0 || tile[Z] < 0) {
+    pe_fatal(pe, "kernel_tile_size must not be negative\n");
+  }
+
+  if (strcmp(value, "morton") == 0) {
+    order = KERNEL_TILE_ORDER_MORTON;
+  }
+  else if (strcmp(value, "tile") != 0) {
+    pe_fatal(pe, "kernel_tile_order must be tile or morton\n");
+  }
+
+  kernel_tile_set(tile, order);
+
+  if (tile[X] > 0 || tile[Y] > 0 || tile[Z] > 0) {
+    pe_info(pe, "Host kernel tiles:            %d %d %d (%s order)\n",
+	    tile[X], tile[Y], tile[Z], value);
+  }
+  else {
+    pe_info(pe, "Host kernel tiles:            none\n");
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ludwig_report_halo
+ *
+ *  Lattice halo swap messages per step (average per rank) for the
+ *  communication-avoiding halo swap. Only if lb_halo_depth is set
+ *  explicitly in the input. The time per step is in the timer
+ *  statistics ("Lattice halo", "Time step loop").
+ *
+ *****************************************************************************/
+
+static int ludwig_report_halo(ludwig_t * ludwig, int nstep) {
+
+  int ndepth;
+  long int nlocal;
+  long int nmessage = 0;
+  MPI_Comm comm;
+
+  assert(ludwig);
+
+  if (rt_int_parameter(ludwig->rt, "lb_halo_depth", &ndepth) == 0) return 0;
+
+  lb_halo_depth(ludwig->lb, &ndepth);
+  lb_halo_nmessage(ludwig->lb, &nlocal);
+
+  pe_mpi_comm(ludwig->pe, &comm);
+  MPI_Reduce(&nlocal, &nmessage, 1, MPI_LONG, MPI_SUM, 0, comm);
+
+  pe_info(ludwig->pe, "\n");
+  pe_info(ludwig->pe, "Lattice halo swap\n");
+  pe_info(ludwig->pe, "-----------------\n");
+  pe_info(ludwig->pe, "Halo depth:                   %d\n", ndepth);
+  pe_info(ludwig->pe, "Time steps:                   %d\n", nstep);
+  pe_info(ludwig->pe, "Messages sent (all ranks):    %ld\n", nmessage);
+  if (nstep > 0) {
+    pe_info(ludwig->pe, "Messages per step per rank:   %8.3f\n",
+	    (double) nmessage/(nstep*pe_mpi_size(ludwig->pe)));
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ludwig_io_write
+ *
+ *  Lattice output via the asynchronous writer, if present.
+ *
+ *****************************************************************************/
+
+static int ludwig_io_write(ludwig_t * ludwig, int step, io_info_t * info,
+			   const char * filename, void * data) {
+
+  assert(ludwig);
+
+  if (ludwig->ioasync) {
+    io_async_write(ludwig->ioasync, step, info, filename, data);
+  }
+  else {
+    io_write_data(info, filename, data);
+  }
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  ludwig_report_momentum
@@ -1029,6 +1531,11 @@ static int ludwig_report_momentum(ludwig_t * ludwig) {
   if (wall_present(ludwig->wall) || is_pm) {
     double gtmp[3];
     wall_momentum(ludwig->wall, gtmp);
+    if (ludwig->sparse) {
+      double gsparse[3];
+      lb_sparse_momentum(ludwig->sparse, gsparse);
+      for (n = 0; n < 3; n++) gtmp[n] += gsparse[n];
+    }
     MPI_Reduce(gtmp, gwall, 3, MPI_DOUBLE, MPI_SUM, 0, comm);
   }
 
@@ -1080,6 +1587,7 @@ int free_energy_init_rt(ludwig_t * ludwig) {
   int ngrad;
   int nhalo;
   int noise_on = 0;
+  int noise_mode = NOISE_MODE_STATEFUL;
   double value;
   char description[BUFSIZ];
 
@@ -1102,6 +1610,23 @@ int free_energy_init_rt(ludwig_t * ludwig) {
   lb_create(pe, cs, &ludwig->lb);
   noise_create(pe, cs, &ludwig->noise_rho);
 
+  /* Lattice noise generator (default is stateful KISS) */
+
+  n = rt_string_parameter(rt, "noise_generator", description, BUFSIZ);
+
+  if (n == 1) {
+    if (strcmp(description, "philox") == 0) {
+      noise_mode = NOISE_MODE_COUNTER;
+      pe_info(pe, "\n");
+      pe_info(pe, "Lattice noise generator: counter-based (Philox4x32-10)\n");
+    }
+    else if (strcmp(description, "kiss") != 0) {
+      pe_fatal(pe, "noise_generator must be kiss or philox\n");
+    }
+  }
+
+  noise_mode_set(ludwig->noise_rho, noise_mode);
+
   lees_edw_init_rt(rt, info);
 
   n = rt_string_parameter(rt, "free_energy", description, BUFSIZ);
@@ -1111,7 +1636,11 @@ int free_energy_init_rt(ludwig_t * ludwig) {
     pe_info(pe, "\n");
     pe_info(pe, "No free energy selected\n");
 
+    /* The communication-avoiding LB halo swap needs a deeper halo */
+
     nhalo = 1;
+    rt_int_parameter(rt, "lb_halo_depth", &nhalo);
+    nhalo = imax(1, nhalo);
     cs_nhalo_set(cs, nhalo);
     coords_init_rt(pe, rt, cs);
     lees_edw_create(pe, cs, info, &le);
@@ -1166,6 +1695,7 @@ int free_energy_init_rt(ludwig_t * ludwig) {
 
     if (noise_on) {
       noise_create(pe, cs, &ludwig->noise_phi);
+      noise_mode_set(ludwig->noise_phi, noise_mode);
       noise_init(ludwig->noise_phi, 0);
       noise_present_set(ludwig->noise_phi, NOISE_PHI, noise_on);
       if (nhalo != 3) pe_fatal(pe, "Fluctuations: use symmetric_noise\n");
@@ -1689,7 +2219,6 @@ int map_init_rt(pe_t * pe, cs_t * cs, rt_t * rt, map_t ** pmap) {
 int ludwig_colloids_update(ludwig_t * ludwig) {
 
   int ndist;
-  int ndevice;
   int ncolloid;
   int iconserve;         /* switch for finite-difference conservation */
   int is_subgrid = 0;    /* subgrid particle switch */
@@ -1699,10 +2228,10 @@ int ludwig_colloids_update(ludwig_t * ludwig) {
   colloids_info_ntotal(ludwig->collinfo, &ncolloid);
   if (ncolloid == 0) return 0;
 
-  tdpGetDeviceCount(&ndevice);
+  /* The rebuild requires distributions in natural order, so, with
+   * the AA propagation, each step will be an even step. */
 
-  /* __NVCC__ TODO: remove */
-  lb_memcpy(ludwig->lb, tdpMemcpyDeviceToHost);
+  lb_propagation_aa_complete(ludwig->lb);
 
   subgrid_on(&is_subgrid);
 
@@ -1725,18 +2254,11 @@ int ludwig_colloids_update(ludwig_t * ludwig) {
   }
   else {
 
-    /* Removal or replacement of fluid requires a lattice halo update */
+    /* Removal or replacement of fluid requires a lattice halo update
+     * (the distributions remain on the target throughout). */
 
     TIMER_start(TIMER_HALO_LATTICE);
-
-    /* __NVCC__ */
-    if (ndevice == 0) {
-      lb_halo(ludwig->lb);
-    }
-    else {
-      lb_halo_swap(ludwig->lb, LB_HALO_HOST);
-    }
-
+    lb_halo(ludwig->lb);
     TIMER_stop(TIMER_HALO_LATTICE);
 
     TIMER_start(TIMER_FREE1);
@@ -1750,7 +2272,6 @@ int ludwig_colloids_update(ludwig_t * ludwig) {
     build_remove_replace(ludwig->fe, ludwig->collinfo, ludwig->lb, ludwig->phi, ludwig->p,
 			 ludwig->q, ludwig->psi, ludwig->map);
     build_update_links(ludwig->cs, ludwig->collinfo, ludwig->wall, ludwig->map);
-    
 
     TIMER_stop(TIMER_REBUILD);
 
@@ -1769,12 +2290,6 @@ int ludwig_colloids_update(ludwig_t * ludwig) {
     TIMER_stop(TIMER_FORCES);
   }
 
-  /* __NVCC__ TODO: remove */
-
-  colloids_memcpy(ludwig->collinfo, tdpMemcpyHostToDevice);
-  map_memcpy(ludwig->map, tdpMemcpyHostToDevice);
-  lb_memcpy(ludwig->lb, tdpMemcpyHostToDevice);
-
   return 0;
 }
 
@@ -17,11 +17,13 @@
  *  EINVAL alignment not (2^n)*sizeof(void *)
  *  ENOMEM memory not available
  *
+ *  Large lattice arrays are allocated via mem_lattice_calloc(), which
+ *  places pages by parallel first touch (see tdpHostAllocFirstTouch()).
  *
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2016-2017 The University of Edinbrugh
+ *  (c) 2016-2019 The University of Edinbrugh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -35,6 +37,9 @@
 
 #include "memory.h"
 
+/* Page size for lattice data (process-wide, set at run time) */
+
+static mem_huge_page_enum_t huge_page_ = MEM_HUGE_PAGE_NONE;
 
 #ifndef NDEBUG
 
@@ -350,3 +355,83 @@ void * mem_aligned_realloc(void * ptr, size_t alignment, size_t oldsize,
 
   return p;
 }
+
+/*****************************************************************************
+ *
+ *  mem_huge_page_set
+ *
+ *  Page size requested for subsequent lattice allocations.
+ *
+ *****************************************************************************/
+
+int mem_huge_page_set(mem_huge_page_enum_t page) {
+
+  assert(page == MEM_HUGE_PAGE_NONE || page == MEM_HUGE_PAGE_2MB ||
+	 page == MEM_HUGE_PAGE_1GB);
+
+  huge_page_ = page;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  mem_huge_page
+ *
+ *****************************************************************************/
+
+mem_huge_page_enum_t mem_huge_page(void) {
+
+  return huge_page_;
+}
+
+/*****************************************************************************
+ *
+ *  mem_lattice_calloc
+ *
+ *  Zeroed lattice data of nsites x na elements of given size. The
+ *  memory is first touched with the same thread decomposition over
+ *  sites as the kernels, taking account of the data model: each of
+ *  the na components is a separate block for SOA.
+ *
+ *  Release via mem_lattice_free(). Returns NULL on failure.
+ *
+ *****************************************************************************/
+
+void * mem_lattice_calloc(int nsites, int na, size_t size) {
+
+  unsigned int flags = tdpHostAllocDefault;
+  size_t nblock = 1;
+  size_t sitesize = na*size;
+  void * p = NULL;
+  tdpError_t ifail;
+
+  assert(nsites > 0);
+  assert(na > 0);
+
+  if (DATA_MODEL == DATA_MODEL_SOA) {
+    nblock = na;
+    sitesize = size;
+  }
+
+  if (huge_page_ == MEM_HUGE_PAGE_2MB) flags = tdpHostAllocHugePage2MB;
+  if (huge_page_ == MEM_HUGE_PAGE_1GB) flags = tdpHostAllocHugePage1GB;
+
+  ifail = tdpHostAllocFirstTouch(&p, nblock, nsites, sitesize, flags);
+  if (ifail != tdpSuccess) p = NULL;
+
+  return p;
+}
+
+/*****************************************************************************
+ *
+ *  mem_lattice_free
+ *
+ *****************************************************************************/
+
+void mem_lattice_free(void * p) {
+
+  if (p) tdpFreeHost(p);
+
+  return;
+}
@@ -298,5 +298,16 @@ void * mem_aligned_calloc(size_t alignment, size_t count, size_t size);
 void * mem_aligned_realloc(void * ptr, size_t alignment, size_t oldsize,
 			   size_t newsize);
 
+/* Lattice data: first-touch placement with optional huge pages */
+
+typedef enum mem_huge_page_enum {MEM_HUGE_PAGE_NONE = 0,
+				 MEM_HUGE_PAGE_2MB,
+				 MEM_HUGE_PAGE_1GB} mem_huge_page_enum_t;
+
+int mem_huge_page_set(mem_huge_page_enum_t page);
+mem_huge_page_enum_t mem_huge_page(void);
+void * mem_lattice_calloc(int nsites, int na, size_t size);
+void mem_lattice_free(void * p);
+
 
 #endif
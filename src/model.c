@@ -12,7 +12,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2018 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -43,9 +43,11 @@ static int lb_f_read(FILE *, int index, void * self);
 static int lb_f_read_ascii(FILE *, int index, void * self);
 static int lb_f_write(FILE *, int index, void * self);
 static int lb_f_write_ascii(FILE *, int index, void * self);
+static int lb_f_pack(void * self, char * buf);
 static int lb_rho_write(FILE *, int index, void * self);
 static int lb_rho_write_ascii(FILE *, int index, void * self);
 static int lb_model_param_init(lb_t * lb);
+static int lb_halo_reverse_dim(lb_t * lb, int dim);
 
 static __constant__ lb_collide_param_t static_param;
 
@@ -78,6 +80,8 @@ __host__ int lb_create_ndist(pe_t * pe, cs_t * cs, int ndist, lb_t ** plb) {
   lb->ndist = ndist;
   lb->model = DATA_MODEL;
   lb->nrelax = LB_RELAXATION_M10;
+  lb->npropagation = LB_PROPAGATION_TWO_LATTICE;
+  lb->ndepth = 1;
 
   *plb = lb;
 
@@ -112,26 +116,27 @@ __host__ int lb_create(pe_t * pe, cs_t * cs, lb_t ** plb) {
 __host__ int lb_free(lb_t * lb) {
 
   int ndevice;
-  double * tmp;
+  lb_real_t * tmp;
 
   assert(lb);
 
   tdpGetDeviceCount(&ndevice);
 
   if (ndevice > 0) {
-    tdpMemcpy(&tmp, &lb->target->f, sizeof(double *), tdpMemcpyDeviceToHost); 
+    tdpMemcpy(&tmp, &lb->target->f, sizeof(lb_real_t *),
+	      tdpMemcpyDeviceToHost); 
     tdpFree(tmp);
 
-    tdpMemcpy(&tmp, &lb->target->fprime, sizeof(double *),
+    tdpMemcpy(&tmp, &lb->target->fprime, sizeof(lb_real_t *),
 	      tdpMemcpyDeviceToHost); 
-    tdpFree(tmp);
+    if (tmp) tdpFree(tmp);
     tdpFree(lb->target);
   }
 
   if (lb->halo) halo_swap_free(lb->halo);
   if (lb->io_info) io_info_free(lb->io_info);
-  if (lb->f) free(lb->f);
-  if (lb->fprime) free(lb->fprime);
+  mem_lattice_free(lb->f);
+  mem_lattice_free(lb->fprime);
 
   MPI_Type_free(&lb->plane_xy_full);
   MPI_Type_free(&lb->plane_xz_full);
@@ -166,7 +171,7 @@ __host__ int lb_free(lb_t * lb) {
 __host__ int lb_memcpy(lb_t * lb, tdpMemcpyKind flag) {
 
   int ndevice;
-  double * tmpf = NULL;
+  lb_real_t * tmpf = NULL;
 
   assert(lb);
 
@@ -180,17 +185,18 @@ __host__ int lb_memcpy(lb_t * lb, tdpMemcpyKind flag) {
 
     assert(lb->target);
 
-    tdpMemcpy(&tmpf, &lb->target->f, sizeof(double *), tdpMemcpyDeviceToHost);
+    tdpMemcpy(&tmpf, &lb->target->f, sizeof(lb_real_t *),
+	      tdpMemcpyDeviceToHost);
 
     switch (flag) {
     case tdpMemcpyHostToDevice:
       tdpMemcpy(&lb->target->ndist, &lb->ndist, sizeof(int), flag); 
       tdpMemcpy(&lb->target->nsite, &lb->nsite, sizeof(int), flag); 
       tdpMemcpy(&lb->target->model, &lb->model, sizeof(int), flag);
-      tdpMemcpy(tmpf, lb->f, NVEL*lb->nsite*lb->ndist*sizeof(double), flag);
+      tdpMemcpy(tmpf, lb->f, NVEL*lb->nsite*lb->ndist*sizeof(lb_real_t), flag);
       break;
     case tdpMemcpyDeviceToHost:
-      tdpMemcpy(lb->f, tmpf, NVEL*lb->nsite*lb->ndist*sizeof(double), flag);
+      tdpMemcpy(lb->f, tmpf, NVEL*lb->nsite*lb->ndist*sizeof(lb_real_t), flag);
       break;
     default:
       pe_fatal(lb->pe, "Bad flag in lb_memcpy\n");
@@ -218,7 +224,7 @@ __host__ int lb_init(lb_t * lb) {
   int ndata;
   int nhalo;
   int ndevice;
-  double * tmp;
+  lb_real_t * tmp;
 
   assert(lb);
 
@@ -234,16 +240,24 @@ __host__ int lb_init(lb_t * lb) {
 
   ndata = lb->nsite*lb->ndist*NVEL;
 #ifndef OLD_DATA
-  lb->f = (double  *) malloc(ndata*sizeof(double));
+  lb->f = (lb_real_t *) mem_lattice_calloc(lb->nsite, lb->ndist*NVEL,
+					    sizeof(lb_real_t));
   if (lb->f == NULL) pe_fatal(lb->pe, "malloc(distributions) failed\n");
 
-  lb->fprime = (double  *) malloc(ndata*sizeof(double));
-  if (lb->fprime == NULL) pe_fatal(lb->pe, "malloc(distributions) failed\n");
+  /* The AA propagation is in place, and does not require fprime */
+
+  if (lb->npropagation == LB_PROPAGATION_TWO_LATTICE) {
+    lb->fprime = (lb_real_t *) mem_lattice_calloc(lb->nsite, lb->ndist*NVEL,
+						   sizeof(lb_real_t));
+    if (lb->fprime == NULL) pe_fatal(lb->pe, "malloc(distributions) failed\n");
+  }
 #else
-  lb->f = (double  *) mem_aligned_malloc(MEM_PAGESIZE, ndata*sizeof(double));
+  lb->f = (lb_real_t *) mem_aligned_malloc(MEM_PAGESIZE,
+					    ndata*sizeof(lb_real_t));
   if (lb->f == NULL) pe_fatal(lb->pe, "malloc(distributions) failed\n");
 
-  lb->fprime = (double *) mem_aligned_malloc(MEM_PAGESIZE, ndata*sizeof(double));
+  lb->fprime = (lb_real_t *) mem_aligned_malloc(MEM_PAGESIZE,
+						 ndata*sizeof(lb_real_t));
   if (lb->fprime == NULL) pe_fatal(lb->pe, "malloc(distributions) failed\n");
 #endif
 
@@ -260,14 +274,17 @@ __host__ int lb_init(lb_t * lb) {
     tdpMalloc((void **) &lb->target, sizeof(lb_t));
     tdpMemset(lb->target, 0, sizeof(lb_t));
 
-    tdpMalloc((void **) &tmp, ndata*sizeof(double));
-    tdpMemset(tmp, 0, ndata*sizeof(double));
-    tdpMemcpy(&lb->target->f, &tmp, sizeof(double *), tdpMemcpyHostToDevice);
- 
-    tdpMalloc((void **) &tmp, ndata*sizeof(double));
-    tdpMemset(tmp, 0, ndata*sizeof(double));
-    tdpMemcpy(&lb->target->fprime, &tmp, sizeof(double *),
+    tdpMalloc((void **) &tmp, ndata*sizeof(lb_real_t));
+    tdpMemset(tmp, 0, ndata*sizeof(lb_real_t));
+    tdpMemcpy(&lb->target->f, &tmp, sizeof(lb_real_t *),
 	      tdpMemcpyHostToDevice);
+ 
+    if (lb->npropagation == LB_PROPAGATION_TWO_LATTICE) {
+      tdpMalloc((void **) &tmp, ndata*sizeof(lb_real_t));
+      tdpMemset(tmp, 0, ndata*sizeof(lb_real_t));
+      tdpMemcpy(&lb->target->fprime, &tmp, sizeof(lb_real_t *),
+		tdpMemcpyHostToDevice);
+    }
 
     tdpGetSymbolAddress((void **) &ptmp, tdpSymbol(static_param));
     tdpMemcpy(&lb->target->param, &ptmp, sizeof(lb_collide_param_t *),
@@ -281,19 +298,20 @@ __host__ int lb_init(lb_t * lb) {
    * in YZ plane one contiguous block of ny*nz sites. */
 
   MPI_Type_vector(nx*ny, lb->ndist*NVEL*nhalolocal, lb->ndist*NVEL*nz,
-		  MPI_DOUBLE, &lb->plane_xy_full);
+		  LB_MPI_REAL, &lb->plane_xy_full);
   MPI_Type_commit(&lb->plane_xy_full);
 
   MPI_Type_vector(nx, lb->ndist*NVEL*nz*nhalolocal, lb->ndist*NVEL*ny*nz,
-		  MPI_DOUBLE, &lb->plane_xz_full);
+		  LB_MPI_REAL, &lb->plane_xz_full);
   MPI_Type_commit(&lb->plane_xz_full);
 
-  MPI_Type_vector(1, lb->ndist*NVEL*ny*nz*nhalolocal, 1, MPI_DOUBLE,
+  MPI_Type_vector(1, lb->ndist*NVEL*ny*nz*nhalolocal, 1, LB_MPI_REAL,
 		  &lb->plane_yz_full);
   MPI_Type_commit(&lb->plane_yz_full);
 
   lb_mpi_init(lb);
   lb_model_param_init(lb);
+  lb_collide_param_commit(lb);
   lb_halo_set(lb, LB_HALO_FULL);
   lb_memcpy(lb, tdpMemcpyHostToDevice);
 
@@ -472,7 +490,7 @@ static int lb_mpi_init(lb_t * lb) {
   nz = nlocal[Z] + 2*nhalo;
 
   /* extent of single site (AOS) */
-  extent = NVEL*lb->ndist*sizeof(double);
+  extent = NVEL*lb->ndist*sizeof(lb_real_t);
 
   /* X direction */
 
@@ -585,8 +603,15 @@ static int lb_mpi_init(lb_t * lb) {
   free(disp_bwd);
   free(types);
 
-  halo_swap_create_r2(lb->pe, lb->cs, 1, lb->nsite, lb->ndist, NVEL,&lb->halo);
+  halo_swap_create_r2(lb->pe, lb->cs, lb->ndepth, lb->nsite, lb->ndist, NVEL,
+		      &lb->halo);
+#ifdef LB_FLOAT
+  halo_swap_datatype_set(lb->halo, MPI_FLOAT);
+  halo_swap_handlers_set(lb->halo, halo_swap_pack_rank1_float,
+			 halo_swap_unpack_rank1_float);
+#else
   halo_swap_handlers_set(lb->halo, halo_swap_pack_rank1, halo_swap_unpack_rank1);
+#endif
 
   return 0;
 }
@@ -606,7 +631,7 @@ static int lb_set_types(int ntype, MPI_Datatype * type) {
   assert(type);
 
   for (n = 0; n < ntype; n++) {
-    type[n] = MPI_DOUBLE;
+    type[n] = LB_MPI_REAL;
   }
 
   return 0;
@@ -686,9 +711,11 @@ __host__ int lb_io_info_set(lb_t * lb, io_info_t * io_info, int form_in, int for
   io_info_set_name(lb->io_info, string);
   io_info_read_set(lb->io_info, IO_FORMAT_BINARY, lb_f_read);
   io_info_write_set(lb->io_info, IO_FORMAT_BINARY, lb_f_write);
-  io_info_set_bytesize(lb->io_info, IO_FORMAT_BINARY, lb->ndist*NVEL*sizeof(double));
+  io_info_set_bytesize(lb->io_info, IO_FORMAT_BINARY,
+		       lb->ndist*NVEL*sizeof(double));
   io_info_read_set(lb->io_info, IO_FORMAT_ASCII, lb_f_read_ascii);
   io_info_write_set(lb->io_info, IO_FORMAT_ASCII, lb_f_write_ascii);
+  io_info_pack_set(lb->io_info, lb_f_pack);
   io_info_format_set(lb->io_info, form_in, form_out);
 
   return 0;
@@ -757,6 +784,49 @@ __host__ int lb_halo(lb_t * lb) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  lb_halo_start
+ *
+ *  Split-phase version of lb_halo(). Only sites within the width of
+ *  the halo swap of the edge of the local domain (and the halo) must
+ *  be up-to-date at this point. Other sites may be updated before
+ *  lb_halo_wait() completes the swap.
+ *
+ *****************************************************************************/
+
+__host__ int lb_halo_start(lb_t * lb) {
+
+  lb_real_t * data;
+
+  assert(lb);
+
+  tdpMemcpy(&data, &lb->target->f, sizeof(lb_real_t *),
+	    tdpMemcpyDeviceToHost);
+  halo_swap_start(lb->halo, data);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_halo_wait
+ *
+ *****************************************************************************/
+
+__host__ int lb_halo_wait(lb_t * lb) {
+
+  lb_real_t * data;
+
+  assert(lb);
+
+  tdpMemcpy(&data, &lb->target->f, sizeof(lb_real_t *),
+	    tdpMemcpyDeviceToHost);
+  halo_swap_wait(lb->halo, data);
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  lb_halo_swap
@@ -767,7 +837,7 @@ __host__ int lb_halo(lb_t * lb) {
 
 __host__ int lb_halo_swap(lb_t * lb, lb_halo_enum_t flag) {
 
-  double * data;
+  lb_real_t * data;
   const char * msg = "Attempting halo via struct with NSIMDVL > 1 or (AO)SOA";
 
   assert(lb);
@@ -777,7 +847,8 @@ __host__ int lb_halo_swap(lb_t * lb, lb_halo_enum_t flag) {
     lb_halo_via_copy(lb);
     break;
   case LB_HALO_TARGET:
-    tdpMemcpy(&data, &lb->target->f, sizeof(double *), tdpMemcpyDeviceToHost);
+    tdpMemcpy(&data, &lb->target->f, sizeof(lb_real_t *),
+	      tdpMemcpyDeviceToHost);
     halo_swap_packed(lb->halo, data);
     break;
   case LB_HALO_FULL:
@@ -848,11 +919,11 @@ __host__ int lb_halo_via_struct(lb_t * lb) {
 
 	  ihalo = lb->ndist*NVEL*cs_index(lb->cs, 0, jc, kc);
 	  ireal = lb->ndist*NVEL*cs_index(lb->cs, nlocal[X], jc, kc);
-	  memcpy(lb->f + ihalo, lb->f + ireal, lb->ndist*NVEL*sizeof(double));
+	  memcpy(lb->f + ihalo, lb->f + ireal, lb->ndist*NVEL*sizeof(lb_real_t));
 
 	  ihalo = lb->ndist*NVEL*cs_index(lb->cs, nlocal[X]+1, jc, kc);
 	  ireal = lb->ndist*NVEL*cs_index(lb->cs, 1, jc, kc);
-	  memcpy(lb->f + ihalo, lb->f + ireal, lb->ndist*NVEL*sizeof(double));
+	  memcpy(lb->f + ihalo, lb->f + ireal, lb->ndist*NVEL*sizeof(lb_real_t));
 	}
       }
     }
@@ -884,11 +955,11 @@ __host__ int lb_halo_via_struct(lb_t * lb) {
 
 	  ihalo = lb->ndist*NVEL*cs_index(lb->cs, ic, 0, kc);
 	  ireal = lb->ndist*NVEL*cs_index(lb->cs, ic, nlocal[Y], kc);
-	  memcpy(lb->f + ihalo, lb->f + ireal, lb->ndist*NVEL*sizeof(double));
+	  memcpy(lb->f + ihalo, lb->f + ireal, lb->ndist*NVEL*sizeof(lb_real_t));
 
 	  ihalo = lb->ndist*NVEL*cs_index(lb->cs, ic, nlocal[Y] + 1, kc);
 	  ireal = lb->ndist*NVEL*cs_index(lb->cs, ic, 1, kc);
-	  memcpy(lb->f + ihalo, lb->f + ireal, lb->ndist*NVEL*sizeof(double));
+	  memcpy(lb->f + ihalo, lb->f + ireal, lb->ndist*NVEL*sizeof(lb_real_t));
 	}
       }
     }
@@ -920,11 +991,11 @@ __host__ int lb_halo_via_struct(lb_t * lb) {
 
 	  ihalo = lb->ndist*NVEL*cs_index(lb->cs, ic, jc, 0);
 	  ireal = lb->ndist*NVEL*cs_index(lb->cs, ic, jc, nlocal[Z]);
-	  memcpy(lb->f + ihalo, lb->f + ireal, lb->ndist*NVEL*sizeof(double));
+	  memcpy(lb->f + ihalo, lb->f + ireal, lb->ndist*NVEL*sizeof(lb_real_t));
 
 	  ihalo = lb->ndist*NVEL*cs_index(lb->cs, ic, jc, nlocal[Z] + 1);
 	  ireal = lb->ndist*NVEL*cs_index(lb->cs, ic, jc, 1);
-	  memcpy(lb->f + ihalo, lb->f + ireal, lb->ndist*NVEL*sizeof(double));
+	  memcpy(lb->f + ihalo, lb->f + ireal, lb->ndist*NVEL*sizeof(lb_real_t));
 	}
       }
     }
@@ -963,6 +1034,7 @@ static int lb_f_read(FILE * fp, int index, void * self) {
 
   int iread, n, p;
   int nr = 0;
+  double fread1;
   lb_t * lb = (lb_t*) self;
 
   assert(fp);
@@ -971,7 +1043,8 @@ static int lb_f_read(FILE * fp, int index, void * self) {
   for (n = 0; n < lb->ndist; n++) {
     for (p = 0; p < NVEL; p++) {
       iread = LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p);
-      nr += fread(lb->f + iread, sizeof(double), 1, fp);
+      nr += fread(&fread1, sizeof(double), 1, fp);
+      lb->f[iread] = LB_F_STORE(fread1, wv[p], n);
     }
   }
 
@@ -993,6 +1066,7 @@ static int lb_f_read_ascii(FILE * fp, int index, void * self) {
 
   int n, p;
   int nr;
+  double fread1;
   pe_t * pe = NULL;
   lb_t * lb = (lb_t *) self;
 
@@ -1008,8 +1082,9 @@ static int lb_f_read_ascii(FILE * fp, int index, void * self) {
   nr = 0;
   for (n = 0; n < lb->ndist; n++) {
     for (p = 0; p < NVEL; p++) {
-      nr += fscanf(fp, "%le",
-		   &lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)]);
+      nr += fscanf(fp, "%le", &fread1);
+      lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)]
+	= LB_F_STORE(fread1, wv[p], n);
     }
   }
 
@@ -1031,6 +1106,7 @@ static int lb_f_write(FILE * fp, int index, void * self) {
 
   int iwrite, n, p;
   int nw = 0;
+  double fwrite1;
   lb_t * lb = (lb_t*) self;
 
   assert(fp);
@@ -1039,7 +1115,8 @@ static int lb_f_write(FILE * fp, int index, void * self) {
   for (n = 0; n < lb->ndist; n++) {
     for (p = 0; p < NVEL; p++) {
       iwrite = LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p);
-      nw += fwrite(lb->f + iwrite, sizeof(double), 1, fp);
+      fwrite1 = LB_F_LOAD(lb->f[iwrite], wv[p], n);
+      nw += fwrite(&fwrite1, sizeof(double), 1, fp);
     }
   }
 
@@ -1048,6 +1125,48 @@ static int lb_f_write(FILE * fp, int index, void * self) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  lb_f_pack
+ *
+ *  Binary distributions for all local sites to buf (as lb_f_write).
+ *
+ *****************************************************************************/
+
+static int lb_f_pack(void * self, char * buf) {
+
+  int ic, jc, kc, n, p;
+  int index0;
+  int nlocal[3];
+  int nrec;
+  double * out = (double *) buf;
+  lb_t * lb = (lb_t *) self;
+
+  assert(lb);
+  assert(buf);
+
+  cs_nlocal(lb->cs, nlocal);
+  nrec = lb->ndist*NVEL;
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      index0 = cs_index(lb->cs, ic, jc, 1);
+      for (n = 0; n < lb->ndist; n++) {
+	for (p = 0; p < NVEL; p++) {
+	  for (kc = 0; kc < nlocal[Z]; kc++) {
+	    out[kc*nrec + n*NVEL + p]
+	      = LB_F_LOAD(lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL,
+					index0 + kc, n, p)], wv[p], n);
+	  }
+	}
+      }
+      out += nrec*nlocal[Z];
+    }
+  }
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  lb_f_write_ascii
@@ -1081,7 +1200,9 @@ static int lb_f_write_ascii(FILE * fp, int index, void * self) {
 
   for (n = 0; n < lb->ndist; n++) {
     for (p = 0; p < NVEL; p++) {
-      fprintf(fp, "%le ", lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)]);
+      fprintf(fp, "%le ",
+	      LB_F_LOAD(lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)],
+			wv[p], n));
       nw++;
     }
   }
@@ -1172,6 +1293,168 @@ __host__ int lb_halo_set(lb_t * lb, lb_halo_enum_t type) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  lb_propagation_scheme_set
+ *
+ *  Must be called before lb_init(), as the AA scheme does not
+ *  allocate fprime.
+ *
+ *****************************************************************************/
+
+__host__ int lb_propagation_scheme_set(lb_t * lb, lb_propagation_enum_t s) {
+
+  assert(lb);
+  assert(lb->f == NULL);
+  assert(s == LB_PROPAGATION_TWO_LATTICE || s == LB_PROPAGATION_AA);
+
+  lb->npropagation = s;
+  lb->aaswapped = 0;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_propagation_scheme
+ *
+ *****************************************************************************/
+
+__host__ int lb_propagation_scheme(lb_t * lb, lb_propagation_enum_t * s) {
+
+  assert(lb);
+  assert(s);
+
+  *s = (lb_propagation_enum_t) lb->npropagation;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_halo_overlap_set
+ *
+ *  If set, the collision is split so that the lattice halo swap
+ *  overlaps with collision at interior sites (see ludwig.c).
+ *
+ *****************************************************************************/
+
+__host__ int lb_halo_overlap_set(lb_t * lb, int overlap) {
+
+  assert(lb);
+
+  lb->haloverlap = overlap;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_halo_overlap
+ *
+ *****************************************************************************/
+
+__host__ int lb_halo_overlap(lb_t * lb, int * overlap) {
+
+  assert(lb);
+  assert(overlap);
+
+  *overlap = lb->haloverlap;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_halo_depth_set
+ *
+ *  Communication-avoiding halo swap. A halo of width ndepth is
+ *  swapped once every ndepth steps; in between, the collision and
+ *  propagation are extended into the part of the halo which remains
+ *  valid (see lb_collide_extended() and lb_propagation_extended()).
+ *
+ *  Must be set before lb_init(), and requires cs_nhalo >= ndepth.
+ *
+ *****************************************************************************/
+
+__host__ int lb_halo_depth_set(lb_t * lb, int ndepth) {
+
+  int nhalo;
+
+  assert(lb);
+  assert(lb->halo == NULL);
+
+  cs_nhalo(lb->cs, &nhalo);
+
+  if (ndepth < 1 || ndepth > nhalo) {
+    pe_fatal(lb->pe, "lb_halo_depth %d must be in range 1 ... nhalo (%d)\n",
+	     ndepth, nhalo);
+  }
+
+  lb->ndepth = ndepth;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_halo_depth
+ *
+ *****************************************************************************/
+
+__host__ int lb_halo_depth(lb_t * lb, int * ndepth) {
+
+  assert(lb);
+  assert(ndepth);
+
+  *ndepth = lb->ndepth;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_halo_nmessage
+ *
+ *  Running total of messages sent by the (packed) lattice halo swap
+ *  on this rank.
+ *
+ *****************************************************************************/
+
+__host__ int lb_halo_nmessage(lb_t * lb, long int * nmessage) {
+
+  assert(lb);
+  assert(nmessage);
+
+  *nmessage = 0;
+  if (lb->halo) halo_swap_nmessage(lb->halo, nmessage);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_aa_step
+ *
+ *  Which AA step comes next (or is in progress between collision and
+ *  propagation). LB_AA_NONE for two-lattice propagation.
+ *
+ *****************************************************************************/
+
+__host__ int lb_aa_step(lb_t * lb, lb_aa_step_enum_t * step) {
+
+  assert(lb);
+  assert(step);
+
+  *step = LB_AA_NONE;
+
+  if (lb->npropagation == LB_PROPAGATION_AA) {
+    *step = (lb->aaswapped) ? LB_AA_ODD : LB_AA_EVEN;
+  }
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  lb_ndist
@@ -1226,7 +1509,8 @@ int lb_f(lb_t * lb, int index, int p, int n, double * f) {
   assert(p >= 0 && p < NVEL);
   assert(n >= 0 && n < lb->ndist);
 
-  *f = lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)];
+  *f = LB_F_LOAD(lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)],
+		 lb->param->wv[p], n);
 
   return 0;
 }
@@ -1247,7 +1531,83 @@ int lb_f_set(lb_t * lb, int index, int p, int n, double fvalue) {
   assert(p >= 0 && p < NVEL);
   assert(n >= 0 && n < lb->ndist);
 
-  lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)] = fvalue;
+  lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)]
+    = LB_F_STORE(fvalue, lb->param->wv[p], n);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_fpost_addr
+ *
+ *  Memory location of the post-collision distribution f*(index, p)
+ *  between collision and propagation. For two-lattice propagation
+ *  this is just the usual location. For the AA pattern, the even
+ *  step has stored f* in the opposite slot at the same site, while
+ *  the odd step has already moved it to the neighbour index + c_p.
+ *
+ *****************************************************************************/
+
+static __host__ __device__
+int lb_fpost_addr(lb_t * lb, int index, int n, int p) {
+
+  int indexp = index;
+  int pslot = p;
+
+  if (lb->npropagation == LB_PROPAGATION_AA) {
+    if (lb->aaswapped == 0) {
+      pslot = (NVEL - p) % NVEL;
+    }
+    else {
+      int xs, ys, zs;
+      cs_strides(lb->cs, &xs, &ys, &zs);
+      indexp = index + xs*lb->param->cv[p][X] + ys*lb->param->cv[p][Y]
+	+ zs*lb->param->cv[p][Z];
+    }
+  }
+
+  return LB_ADDR(lb->nsite, lb->ndist, NVEL, indexp, n, pslot);
+}
+
+/*****************************************************************************
+ *
+ *  lb_fpost
+ *
+ *  Post-collision distribution f*(index, p, n) for use in boundary
+ *  conditions applied between collision and propagation.
+ *
+ *****************************************************************************/
+
+__host__ __device__
+int lb_fpost(lb_t * lb, int index, int p, int n, double * f) {
+
+  assert(lb);
+  assert(index >= 0 && index < lb->nsite);
+  assert(p >= 0 && p < NVEL);
+  assert(n >= 0 && n < lb->ndist);
+
+  *f = LB_F_LOAD(lb->f[lb_fpost_addr(lb, index, n, p)], lb->param->wv[p], n);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_fpost_set
+ *
+ *****************************************************************************/
+
+__host__ __device__
+int lb_fpost_set(lb_t * lb, int index, int p, int n, double fvalue) {
+
+  assert(lb);
+  assert(index >= 0 && index < lb->nsite);
+  assert(p >= 0 && p < NVEL);
+  assert(n >= 0 && n < lb->ndist);
+
+  lb->f[lb_fpost_addr(lb, index, n, p)]
+    = LB_F_STORE(fvalue, lb->param->wv[p], n);
 
   return 0;
 }
@@ -1273,7 +1633,8 @@ int lb_0th_moment(lb_t * lb, int index, lb_dist_enum_t nd, double * rho) {
   *rho = 0.0;
 
   for (p = 0; p < NVEL; p++) {
-    *rho += lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, nd, p)];
+    *rho += LB_F_LOAD(lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, nd, p)],
+		      lb->param->wv[p], nd);
   }
 
   return 0;
@@ -1304,7 +1665,8 @@ int lb_1st_moment(lb_t * lb, int index, lb_dist_enum_t nd, double g[3]) {
 
   for (p = 0; p < NVEL; p++) {
     for (n = 0; n < NDIM; n++) {
-      g[n] += cv[p][n]*lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, nd, p)];
+      g[n] += cv[p][n]*LB_F_LOAD(lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL,
+						 index, nd, p)], wv[p], nd);
     }
   }
 
@@ -1337,7 +1699,8 @@ int lb_2nd_moment(lb_t * lb, int index, lb_dist_enum_t nd, double s[3][3]) {
   for (p = 0; p < NVEL; p++) {
     for (ia = 0; ia < NDIM; ia++) {
       for (ib = 0; ib < NDIM; ib++) {
-	s[ia][ib] += lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, nd, p)]
+	s[ia][ib] += LB_F_LOAD(lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL,
+					     index, nd, p)], wv[p], nd)
 	  *q_[p][ia][ib];
       }
     }
@@ -1366,7 +1729,8 @@ int lb_0th_moment_equilib_set(lb_t * lb, int index, int n, double rho) {
   assert(index >= 0 && index < lb->nsite);
 
   for (p = 0; p < NVEL; p++) {
-    lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)] = wv[p]*rho;
+    lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)]
+      = LB_F_STORE(wv[p]*rho, wv[p], n);
   }
 
   return 0;
@@ -1401,7 +1765,8 @@ int lb_1st_moment_equilib_set(lb_t * lb, int index, double rho, double u[3]) {
     }
 
     lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, LB_RHO, p)]
-      = rho*wv[p]*(1.0 + rcs2*udotc + 0.5*rcs2*rcs2*sdotq);
+      = LB_F_STORE(rho*wv[p]*(1.0 + rcs2*udotc + 0.5*rcs2*rcs2*sdotq),
+		   wv[p], LB_RHO);
   }
 
   return 0;
@@ -1425,7 +1790,8 @@ int lb_f_index(lb_t * lb, int index, int n, double f[NVEL]) {
   assert(index >= 0 && index < lb->nsite);
 
   for (p = 0; p < NVEL; p++) {
-    f[p] = lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)];
+    f[p] = LB_F_LOAD(lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)],
+		     lb->param->wv[p], n);
   }
 
   return 0;
@@ -1452,7 +1818,8 @@ int lb_f_multi_index(lb_t * lb, int index, int n, double fv[NVEL][NSIMDVL]) {
 
   for (p = 0; p < NVEL; p++) {
     for (iv = 0; iv < NSIMDVL; iv++) {
-      fv[p][iv] = lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index + iv, n, p)];
+      fv[p][iv] = LB_F_LOAD(lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL,
+					  index + iv, n, p)], lb->param->wv[p], n);
     }
   }
 
@@ -1481,7 +1848,8 @@ int lb_f_multi_index_part(lb_t * lb, int index, int n, double fv[NVEL][NSIMDVL],
 
   for (p = 0; p < NVEL; p++) {
     for (iv = 0; iv < nv; iv++) {
-      fv[p][iv] = lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index + iv, n, p)];
+      fv[p][iv] = LB_F_LOAD(lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL,
+					  index + iv, n, p)], lb->param->wv[p], n);
     }
   }
 
@@ -1507,7 +1875,8 @@ int lb_f_index_set(lb_t * lb, int index, int n, double f[NVEL]) {
   assert(index >= 0 && index < lb->nsite);
 
   for (p = 0; p < NVEL; p++) {
-    lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)] = f[p];
+    lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n, p)]
+      = LB_F_STORE(f[p], lb->param->wv[p], n);
   }
 
   return 0;
@@ -1534,7 +1903,8 @@ int lb_f_multi_index_set(lb_t * lb, int index, int n, double fv[NVEL][NSIMDVL]){
   assert(0);
   for (p = 0; p < NVEL; p++) {
     for (iv = 0; iv < NSIMDVL; iv++) {
-      lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index + iv, n, p)] = fv[p][iv];
+      lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index + iv, n, p)]
+	= LB_F_STORE(fv[p][iv], lb->param->wv[p], n);
     }
   }
 
@@ -1561,7 +1931,8 @@ int lb_f_multi_index_set_part(lb_t * lb, int index, int n,
   assert(0);
   for (p = 0; p < NVEL; p++) {
     for (iv = 0; iv < nv; iv++) {
-      lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index + iv, n, p)] = fv[p][iv];
+      lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL, index + iv, n, p)]
+	= LB_F_STORE(fv[p][iv], lb->param->wv[p], n);
     }
   }
 
@@ -1609,10 +1980,10 @@ __host__ int lb_halo_via_copy(lb_t * lb) {
   const int tagf = 900;
   const int tagb = 901;
 
-  double * sendforw;
-  double * sendback;
-  double * recvforw;
-  double * recvback;
+  lb_real_t * sendforw;
+  lb_real_t * sendback;
+  lb_real_t * recvforw;
+  lb_real_t * recvback;
 
   MPI_Request request[4];
   MPI_Status status[4];
@@ -1627,10 +1998,10 @@ __host__ int lb_halo_via_copy(lb_t * lb) {
   /* The x-direction (YZ plane) */
 
   nsend = NVEL*lb->ndist*nlocal[Y]*nlocal[Z];
-  sendforw = (double *) malloc(nsend*sizeof(double));
-  sendback = (double *) malloc(nsend*sizeof(double));
-  recvforw = (double *) malloc(nsend*sizeof(double));
-  recvback = (double *) malloc(nsend*sizeof(double));
+  sendforw = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
+  sendback = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
+  recvforw = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
+  recvback = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
   assert(sendback && sendforw);
   assert(recvforw && recvback);
   if (sendforw == NULL) pe_fatal(lb->pe, "malloc(sendforw) failed\n");
@@ -1659,19 +2030,19 @@ __host__ int lb_halo_via_copy(lb_t * lb) {
   assert(count == nsend);
 
   if (mpi_cartsz[X] == 1) {
-    memcpy(recvback, sendforw, nsend*sizeof(double));
-    memcpy(recvforw, sendback, nsend*sizeof(double));
+    memcpy(recvback, sendforw, nsend*sizeof(lb_real_t));
+    memcpy(recvforw, sendback, nsend*sizeof(lb_real_t));
   }
   else {
 
     pforw = cs_cart_neighb(lb->cs, CS_FORW, X);
     pback = cs_cart_neighb(lb->cs, CS_BACK, X);
 
-    MPI_Irecv(recvforw, nsend, MPI_DOUBLE, pforw, tagb, comm, request);
-    MPI_Irecv(recvback, nsend, MPI_DOUBLE, pback, tagf, comm, request + 1);
+    MPI_Irecv(recvforw, nsend, LB_MPI_REAL, pforw, tagb, comm, request);
+    MPI_Irecv(recvback, nsend, LB_MPI_REAL, pback, tagf, comm, request + 1);
 
-    MPI_Issend(sendback, nsend, MPI_DOUBLE, pback, tagb, comm, request + 2);
-    MPI_Issend(sendforw, nsend, MPI_DOUBLE, pforw, tagf, comm, request + 3);
+    MPI_Issend(sendback, nsend, LB_MPI_REAL, pback, tagb, comm, request + 2);
+    MPI_Issend(sendforw, nsend, LB_MPI_REAL, pforw, tagf, comm, request + 3);
 
     /* Wait for receives */
     MPI_Waitall(2, request, status);
@@ -1712,10 +2083,10 @@ __host__ int lb_halo_via_copy(lb_t * lb) {
   /* The y-direction (XZ plane) */
 
   nsend = NVEL*lb->ndist*(nlocal[X] + 2)*nlocal[Z];
-  sendforw = (double *) malloc(nsend*sizeof(double));
-  sendback = (double *) malloc(nsend*sizeof(double));
-  recvforw = (double *) malloc(nsend*sizeof(double));
-  recvback = (double *) malloc(nsend*sizeof(double));
+  sendforw = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
+  sendback = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
+  recvforw = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
+  recvback = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
   if (sendforw == NULL) pe_fatal(lb->pe, "malloc(sendforw) failed\n");
   if (sendback == NULL) pe_fatal(lb->pe, "malloc(sendback) failed\n");
   if (recvforw == NULL) pe_fatal(lb->pe, "malloc(recvforw) failed\n");
@@ -1743,19 +2114,19 @@ __host__ int lb_halo_via_copy(lb_t * lb) {
 
 
   if (mpi_cartsz[Y] == 1) {
-    memcpy(recvback, sendforw, nsend*sizeof(double));
-    memcpy(recvforw, sendback, nsend*sizeof(double));
+    memcpy(recvback, sendforw, nsend*sizeof(lb_real_t));
+    memcpy(recvforw, sendback, nsend*sizeof(lb_real_t));
   }
   else {
 
     pforw = cs_cart_neighb(lb->cs, CS_FORW, Y);
     pback = cs_cart_neighb(lb->cs, CS_BACK, Y);
 
-    MPI_Irecv(recvforw, nsend, MPI_DOUBLE, pforw, tagb, comm, request);
-    MPI_Irecv(recvback, nsend, MPI_DOUBLE, pback, tagf, comm, request + 1);
+    MPI_Irecv(recvforw, nsend, LB_MPI_REAL, pforw, tagb, comm, request);
+    MPI_Irecv(recvback, nsend, LB_MPI_REAL, pback, tagf, comm, request + 1);
 
-    MPI_Issend(sendback, nsend, MPI_DOUBLE, pback, tagb, comm, request + 2);
-    MPI_Issend(sendforw, nsend, MPI_DOUBLE, pforw, tagf, comm, request + 3);
+    MPI_Issend(sendback, nsend, LB_MPI_REAL, pback, tagb, comm, request + 2);
+    MPI_Issend(sendforw, nsend, LB_MPI_REAL, pforw, tagf, comm, request + 3);
 
     /* Wait of receives */
     MPI_Waitall(2, request, status);
@@ -1794,10 +2165,10 @@ __host__ int lb_halo_via_copy(lb_t * lb) {
   /* Finally, z-direction (XY plane) */
 
   nsend = NVEL*lb->ndist*(nlocal[X] + 2)*(nlocal[Y] + 2);
-  sendforw = (double *) malloc(nsend*sizeof(double));
-  sendback = (double *) malloc(nsend*sizeof(double));
-  recvforw = (double *) malloc(nsend*sizeof(double));
-  recvback = (double *) malloc(nsend*sizeof(double));
+  sendforw = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
+  sendback = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
+  recvforw = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
+  recvback = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
   if (sendforw == NULL) pe_fatal(lb->pe, "malloc(sendforw) failed\n");
   if (sendback == NULL) pe_fatal(lb->pe, "malloc(sendback) failed\n");
   if (recvforw == NULL) pe_fatal(lb->pe, "malloc(recvforw) failed\n");
@@ -1824,19 +2195,19 @@ __host__ int lb_halo_via_copy(lb_t * lb) {
   assert(count == nsend);
 
   if (mpi_cartsz[Z] == 1) {
-    memcpy(recvback, sendforw, nsend*sizeof(double));
-    memcpy(recvforw, sendback, nsend*sizeof(double));
+    memcpy(recvback, sendforw, nsend*sizeof(lb_real_t));
+    memcpy(recvforw, sendback, nsend*sizeof(lb_real_t));
   }
   else {
 
     pforw = cs_cart_neighb(lb->cs, CS_FORW, Z);
     pback = cs_cart_neighb(lb->cs, CS_BACK, Z);
 
-    MPI_Irecv(recvforw, nsend, MPI_DOUBLE, pforw, tagb, comm, request);
-    MPI_Irecv(recvback, nsend, MPI_DOUBLE, pback, tagf, comm, request + 1);
+    MPI_Irecv(recvforw, nsend, LB_MPI_REAL, pforw, tagb, comm, request);
+    MPI_Irecv(recvback, nsend, LB_MPI_REAL, pback, tagf, comm, request + 1);
 
-    MPI_Issend(sendback, nsend, MPI_DOUBLE, pback, tagb, comm, request + 2);
-    MPI_Issend(sendforw, nsend, MPI_DOUBLE, pforw, tagf, comm, request + 3);
+    MPI_Issend(sendback, nsend, LB_MPI_REAL, pback, tagb, comm, request + 2);
+    MPI_Issend(sendforw, nsend, LB_MPI_REAL, pforw, tagf, comm, request + 3);
 
     /* Wait for receives */
     MPI_Waitall(2, request, status);
@@ -1874,3 +2245,205 @@ __host__ int lb_halo_via_copy(lb_t * lb) {
  
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  lb_halo_reverse
+ *
+ *  The odd step of the AA propagation pushes post-collision
+ *  distributions from the boundary sites out into the halo region.
+ *  This returns them to the boundary sites of the neighbouring
+ *  process (which is this process for a single process in a
+ *  periodic direction). Only velocities pointing out of the local
+ *  domain in the relevant direction are sent.
+ *
+ *  The directions are taken in the reverse of the usual order
+ *  (Z, then Y, then X) with the full halo extent in directions still
+ *  to come, so that edge and corner values are relayed correctly.
+ *
+ *  Nothing is received across a non-periodic global boundary; such
+ *  values are set by the wall bounce-back.
+ *
+ *****************************************************************************/
+
+__host__ int lb_halo_reverse(lb_t * lb) {
+
+  assert(lb);
+
+  lb_halo_reverse_dim(lb, Z);
+  lb_halo_reverse_dim(lb, Y);
+  lb_halo_reverse_dim(lb, X);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_halo_reverse_dim
+ *
+ *****************************************************************************/
+
+static int lb_halo_reverse_dim(lb_t * lb, int dim) {
+
+  int ic, jc, kc;
+  int ia, n, p;
+  int index, indexhalo, indexreal;
+  int pforw, pback;
+  int nsend, count;
+  int nout;
+  int pout[2][NVEL];         /* Outgoing velocities [BACKWARD/FORWARD] */
+  int nlocal[3];
+  int imin[3], imax[3];
+  int mpi_cartsz[3];
+  int mpi_coords[3];
+  int period[3];
+  int unpackback, unpackforw;
+
+  const int tagf = 902;
+  const int tagb = 903;
+
+  lb_real_t * sendforw;
+  lb_real_t * sendback;
+  lb_real_t * recvforw;
+  lb_real_t * recvback;
+
+  MPI_Request request[4];
+  MPI_Status status[4];
+  MPI_Comm comm;
+
+  assert(lb);
+  assert(dim == X || dim == Y || dim == Z);
+
+  cs_nlocal(lb->cs, nlocal);
+  cs_cart_comm(lb->cs, &comm);
+  cs_cartsz(lb->cs, mpi_cartsz);
+  cs_cart_coords(lb->cs, mpi_coords);
+  cs_periodic(lb->cs, period);
+
+  nout = 0;
+  for (p = 0; p < NVEL; p++) {
+    if (lb->param->cv[p][dim] == -1) pout[BACKWARD][nout++] = p;
+  }
+  nout = 0;
+  for (p = 0; p < NVEL; p++) {
+    if (lb->param->cv[p][dim] == +1) pout[FORWARD][nout++] = p;
+  }
+
+  /* Full halo extent in directions yet to be swapped */
+
+  for (ia = 0; ia < 3; ia++) {
+    imin[ia] = (ia < dim) ? 0 : 1;
+    imax[ia] = (ia < dim) ? nlocal[ia] + 1 : nlocal[ia];
+  }
+  imin[dim] = 0;
+  imax[dim] = 0;
+
+  unpackback = (period[dim] || mpi_coords[dim] > 0);
+  unpackforw = (period[dim] || mpi_coords[dim] < mpi_cartsz[dim] - 1);
+
+  nsend = nout*lb->ndist*(imax[X] - imin[X] + 1)*(imax[Y] - imin[Y] + 1)
+    *(imax[Z] - imin[Z] + 1);
+
+  sendforw = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
+  sendback = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
+  recvforw = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
+  recvback = (lb_real_t *) malloc(nsend*sizeof(lb_real_t));
+  if (sendforw == NULL) pe_fatal(lb->pe, "malloc(sendforw) failed\n");
+  if (sendback == NULL) pe_fatal(lb->pe, "malloc(sendback) failed\n");
+  if (recvforw == NULL) pe_fatal(lb->pe, "malloc(recvforw) failed\n");
+  if (recvback == NULL) pe_fatal(lb->pe, "malloc(recvback) failed\n");
+
+  /* Pack from the halo planes */
+
+  count = 0;
+  for (n = 0; n < lb->ndist; n++) {
+    for (p = 0; p < nout; p++) {
+      for (ic = imin[X]; ic <= imax[X]; ic++) {
+	for (jc = imin[Y]; jc <= imax[Y]; jc++) {
+	  for (kc = imin[Z]; kc <= imax[Z]; kc++) {
+	    int ijk[3] = {ic, jc, kc};
+
+	    ijk[dim] = 0;
+	    index = cs_index(lb->cs, ijk[X], ijk[Y], ijk[Z]);
+	    indexhalo = LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n,
+				pout[BACKWARD][p]);
+	    sendback[count] = lb->f[indexhalo];
+
+	    ijk[dim] = nlocal[dim] + 1;
+	    index = cs_index(lb->cs, ijk[X], ijk[Y], ijk[Z]);
+	    indexhalo = LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n,
+				pout[FORWARD][p]);
+	    sendforw[count] = lb->f[indexhalo];
+	    ++count;
+	  }
+	}
+      }
+    }
+  }
+  assert(count == nsend);
+
+  if (mpi_cartsz[dim] == 1) {
+    memcpy(recvback, sendforw, nsend*sizeof(lb_real_t));
+    memcpy(recvforw, sendback, nsend*sizeof(lb_real_t));
+  }
+  else {
+
+    pforw = cs_cart_neighb(lb->cs, CS_FORW, dim);
+    pback = cs_cart_neighb(lb->cs, CS_BACK, dim);
+
+    MPI_Irecv(recvforw, nsend, LB_MPI_REAL, pforw, tagb, comm, request);
+    MPI_Irecv(recvback, nsend, LB_MPI_REAL, pback, tagf, comm, request + 1);
+
+    MPI_Issend(sendback, nsend, LB_MPI_REAL, pback, tagb, comm, request + 2);
+    MPI_Issend(sendforw, nsend, LB_MPI_REAL, pforw, tagf, comm, request + 3);
+
+    /* Wait for receives */
+    MPI_Waitall(2, request, status);
+  }
+
+  /* Unpack into the boundary planes */
+
+  count = 0;
+  for (n = 0; n < lb->ndist; n++) {
+    for (p = 0; p < nout; p++) {
+      for (ic = imin[X]; ic <= imax[X]; ic++) {
+	for (jc = imin[Y]; jc <= imax[Y]; jc++) {
+	  for (kc = imin[Z]; kc <= imax[Z]; kc++) {
+	    int ijk[3] = {ic, jc, kc};
+
+	    if (unpackback) {
+	      ijk[dim] = 1;
+	      index = cs_index(lb->cs, ijk[X], ijk[Y], ijk[Z]);
+	      indexreal = LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n,
+				  pout[FORWARD][p]);
+	      lb->f[indexreal] = recvback[count];
+	    }
+
+	    if (unpackforw) {
+	      ijk[dim] = nlocal[dim];
+	      index = cs_index(lb->cs, ijk[X], ijk[Y], ijk[Z]);
+	      indexreal = LB_ADDR(lb->nsite, lb->ndist, NVEL, index, n,
+				  pout[BACKWARD][p]);
+	      lb->f[indexreal] = recvforw[count];
+	    }
+	    ++count;
+	  }
+	}
+      }
+    }
+  }
+  assert(count == nsend);
+
+  free(recvback);
+  free(recvforw);
+
+  if (mpi_cartsz[dim] > 1) {
+    /* Wait for sends */
+    MPI_Waitall(2, request + 2, status);
+  }
+
+  free(sendback);
+  free(sendforw);
+
+  return 0;
+}
@@ -61,6 +61,17 @@ typedef enum lb_halo_enum_type {LB_HALO_FULL,
 typedef enum {LB_RELAXATION_M10, LB_RELAXATION_BGK, LB_RELAXATION_TRT}
   lb_relaxation_enum_t;
 
+/* Propagation: standard two-lattice (f, fprime) pull, or the in-place
+ * "AA" pattern in which collision and streaming are fused. */
+
+typedef enum {LB_PROPAGATION_TWO_LATTICE, LB_PROPAGATION_AA}
+  lb_propagation_enum_t;
+
+/* Current AA step: EVEN starts from distributions in natural order
+ * and leaves them swapped; ODD restores the natural order. */
+
+typedef enum {LB_AA_NONE, LB_AA_EVEN, LB_AA_ODD} lb_aa_step_enum_t;
+
 __host__ int lb_create_ndist(pe_t * pe, cs_t * cs, int ndist, lb_t ** lb);
 __host__ int lb_create(pe_t * pe, cs_t * cs, lb_t ** lb);
 __host__ int lb_init(lb_t * lb);
@@ -72,6 +83,17 @@ __host__ int lb_halo_swap(lb_t * lb, lb_halo_enum_t flag);
 __host__ int lb_halo_via_copy(lb_t * lb);
 __host__ int lb_halo_via_struct(lb_t * lb);
 __host__ int lb_halo_set(lb_t * lb, lb_halo_enum_t halo);
+__host__ int lb_halo_reverse(lb_t * lb);
+__host__ int lb_halo_start(lb_t * lb);
+__host__ int lb_halo_wait(lb_t * lb);
+__host__ int lb_halo_overlap_set(lb_t * lb, int overlap);
+__host__ int lb_halo_overlap(lb_t * lb, int * overlap);
+__host__ int lb_halo_depth_set(lb_t * lb, int ndepth);
+__host__ int lb_halo_depth(lb_t * lb, int * ndepth);
+__host__ int lb_halo_nmessage(lb_t * lb, long int * nmessage);
+__host__ int lb_propagation_scheme_set(lb_t * lb, lb_propagation_enum_t s);
+__host__ int lb_propagation_scheme(lb_t * lb, lb_propagation_enum_t * s);
+__host__ int lb_aa_step(lb_t * lb, lb_aa_step_enum_t * step);
 __host__ int lb_io_info(lb_t * lb, io_info_t ** io_info);
 __host__ int lb_io_info_set(lb_t * lb, io_info_t * io_info, int fin, int fout);
 __host__ int lb_io_rho_set(lb_t *lb, io_info_t * io_rho, int fin, int fout);
@@ -81,6 +103,9 @@ __host__ __device__ int lb_ndim(lb_t * lb, int * ndim);
 __host__ __device__ int lb_ndist(lb_t * lb, int * ndist);
 __host__ __device__ int lb_f(lb_t * lb, int index, int p, int n, double * f);
 __host__ __device__ int lb_f_set(lb_t * lb, int index, int p, int n, double f);
+__host__ __device__ int lb_fpost(lb_t * lb, int index, int p, int n, double * f);
+__host__ __device__ int lb_fpost_set(lb_t * lb, int index, int p, int n,
+				     double f);
 __host__ __device__ int lb_0th_moment(lb_t * lb, int index, lb_dist_enum_t nd,
 				      double * rho);
 __host__ __device__ int lb_f_index(lb_t * lb, int index, int n, double f[NVEL]);
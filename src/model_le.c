@@ -13,7 +13,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2018 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -231,6 +231,7 @@ static int le_reproject_all(lb_t * lb, lees_edw_t * le) {
 
   double mode[NVEL];
   double rho;
+  double fp;
   double g[3], du[3];
   double t;
   physics_t * phys = NULL;
@@ -277,7 +278,8 @@ static int le_reproject_all(lb_t * lb, lees_edw_t * le) {
 	  for (m = 0; m < NVEL; m++) {
 	    mode[m] = 0.0;
 	    for (p = 0; p < NVEL; p++) {
-	      mode[m] += lb->f[ndist*NVEL*index + 0 + p]*ma_[m][p];
+	      mode[m] += LB_F_LOAD(lb->f[ndist*NVEL*index + 0 + p], wv[p], LB_RHO)
+		*ma_[m][p];
 	    }
 	  }
 
@@ -299,10 +301,11 @@ static int le_reproject_all(lb_t * lb, lees_edw_t * le) {
 
 	  for (np = 0; np < xblocklen_cv[0]; np++) {
 	    p = poffset + np;
-	    lb->f[ndist*NVEL*index + 0 + p] = 0.0;
+	    fp = 0.0;
 	    for (m = 0; m < NVEL; m++) {
-	      lb->f[ndist*NVEL*index + 0 + p] += mode[m]*mi_[p][m];
+	      fp += mode[m]*mi_[p][m];
 	    }
+	    lb->f[ndist*NVEL*index + 0 + p] = LB_F_STORE(fp, wv[p], LB_RHO);
 	  }
 
 	  /* next site */
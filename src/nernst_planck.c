@@ -61,7 +61,7 @@
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
  *  Oliver Henrich (ohenrich@epcc.ed.ac.uk)
  *
- *  (c) 2012-2017 The University of Edinbrugh
+ *  (c) 2012-2019 The University of Edinbrugh
  *
  *****************************************************************************/
 
@@ -71,7 +71,10 @@
 
 #include "pe.h"
 #include "coords.h"
+#include "kernel.h"
 #include "psi_s.h"
+#include "map_s.h"
+#include "hydro_s.h"
 #include "advection.h"
 #include "advection_bcs.h"
 #include "physics.h"
@@ -80,19 +83,60 @@
 
 /* This needs an input switch to make it active. */
 int nernst_planck_fluxes_force_d3qx(psi_t * psi, fe_t * fe, hydro_t * hydro, 
-		map_t * map, colloids_info_t * cinfo, double ** flx);
+		map_t * map, colloids_info_t * cinfo, double * flx);
 
 static int nernst_planck_fluxes(psi_t * psi, fe_t * fel, double * fe,
 				double * fy,
 				double * fz);
 static int nernst_planck_update(psi_t * psi, double * fe, double * fy,
 				double * fz);
-static int nernst_planck_fluxes_d3qx(psi_t * psi, fe_t * fe, hydro_t * hydro, 
-		map_t * map, colloids_info_t * cinfo, double ** flx);
-static int nernst_planck_update_d3qx(psi_t * psi, 
-				map_t * map, double ** flx);
 static double max_acc; 
 
+/* Parameters for the d3qx kernels */
+
+typedef struct np_param_s np_param_t;
+
+struct np_param_s {
+  int nk;                           /* Number of species */
+  int nsites;                       /* Number of lattice sites */
+  double dt;                        /* Multistep time step */
+  double reunit;                    /* 1/(unit charge) */
+  double diffusivity[PSI_NKMAX];    /* Diffusivity per species */
+  int valency[PSI_NKMAX];           /* Valency per species */
+  int cv[PSI_NGRAD][3];             /* Stencil */
+  double rnorm[PSI_NGRAD];          /* Stencil normalisation */
+};
+
+static __constant__ np_param_t static_param;
+static __device__ double static_maxacc;
+
+/* Arguments for the flux/update kernel sequence */
+
+typedef struct np_sequence_s np_sequence_t;
+
+struct np_sequence_s {
+  dim3 nblk;
+  dim3 ntpb;
+  kernel_ctxt_t * ctxt;
+  psi_t * psi;
+  hydro_t * hydro;
+  map_t * map;
+  int fused;
+  double * maxacc;
+};
+
+static void nernst_planck_sequence(void * arg);
+
+static __host__ int nernst_planck_param_commit(psi_t * psi);
+static __host__ int nernst_planck_mu_solv(psi_t * psi, fe_t * fe);
+
+__global__ void nernst_planck_flux_kernel_v(kernel_ctxt_t * ktx, psi_t * psi,
+					    hydro_t * hydro, map_t * map,
+					    int fused);
+__global__ void nernst_planck_update_kernel_v(kernel_ctxt_t * ktx,
+					      psi_t * psi, map_t * map,
+					      int fused, double * maxacc);
+
 /*****************************************************************************
  *
  *  nernst_planck_driver
@@ -332,147 +376,404 @@ static int nernst_planck_update(psi_t * psi, double * fe, double * fy,
  *  The hydro object is allowed to be NULL, in which case there is
  *  no advection.
  *
- *  The map object is allowed to be NULL, in which case no boundary
- *  condition corrections are attempted.
+ *  The map is required: fluxes at sites which are not fluid (including
+ *  colloid sites), and on links to sites which are not fluid, are zero.
+ *  The colloid information is not used.
+ *
+ *  The fluxes are held in persistent storage in psi_t. If the fused
+ *  option is selected, the flux kernel accumulates the divergence
+ *  directly, and the individual link fluxes are not stored.
  *
  *****************************************************************************/
 
 int nernst_planck_driver_d3qx(psi_t * psi, fe_t * fe, hydro_t * hydro, 
 			      map_t * map, colloids_info_t * cinfo) {
 
-  int nk;              /* Number of electrolyte species */
-  int ia;
+  int nlocal[3];
+  int fused = 0;
+  double maxacc = 0.0;
+  double * maxaccd = NULL;
 
-  double ** flx = NULL;
+  dim3 nblk, ntpb;
+  kernel_info_t limits;
+  kernel_ctxt_t * ctxt = NULL;
+  np_sequence_t seq;
 
-  psi_nk(psi, &nk);
+  assert(psi);
+  assert(fe);
+  assert(map);
 
-  /* Allocate fluxes and initialise to zero */
-  flx = (double **) calloc(psi->nsites*nk, sizeof(double *));
-  assert(flx);
-  if (flx == NULL) pe_fatal(psi->pe, "calloc(flx) failed\n");
+  cs_nlocal(psi->cs, nlocal);
+  psi_np_fused(psi, &fused);
 
-  for (ia = 0; ia < psi->nsites*nk; ia++) {
-    flx[ia] = (double *) calloc(PSI_NGRAD-1, sizeof(double));
-    assert(flx[ia]);
-    if (flx[ia] == NULL) pe_fatal(psi->pe, "calloc(flx[]) failed\n");
-  }
+  nernst_planck_param_commit(psi);
+  nernst_planck_mu_solv(psi, fe);
+  psi_memcpy(psi, tdpMemcpyHostToDevice);
 
-  /* Add advective fluxes */
-  if (hydro) advective_fluxes_d3qx(hydro, nk, psi->rho, flx);
+  limits.imin = 1; limits.imax = nlocal[X];
+  limits.jmin = 1; limits.jmax = nlocal[Y];
+  limits.kmin = 1; limits.kmax = nlocal[Z];
 
-  /* Add diffusive fluxes */
-  nernst_planck_fluxes_d3qx(psi, fe, hydro, map, cinfo, flx);
-  
-  /* Apply no-flux BC */
-  if (map) advective_bcs_no_flux_d3qx(nk, flx, map);
+  kernel_ctxt_create(psi->cs, NSIMDVL, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
 
-  /* Update charges */
-  nernst_planck_update_d3qx(psi, map, flx);
+  tdpGetSymbolAddress((void **) &maxaccd, tdpSymbol(static_maxacc));
+  tdpAssert(tdpMemcpy(maxaccd, &maxacc, sizeof(double),
+		      tdpMemcpyHostToDevice));
 
-  for (ia = 0; ia < psi->nsites*nk; ia++) {
-    free(flx[ia]);
-  }
-  free(flx);
+  /* Fluxes and update run as one sequence (no host work between) */
+
+  seq.nblk = nblk;
+  seq.ntpb = ntpb;
+  seq.ctxt = ctxt->target;
+  seq.psi = psi->target;
+  seq.hydro = (hydro) ? hydro->target : NULL;
+  seq.map = map->target;
+  seq.fused = fused;
+  seq.maxacc = maxaccd;
+
+  tdpLaunchSequence(nernst_planck_sequence, &seq);
+
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  tdpAssert(tdpMemcpy(&maxacc, maxaccd, sizeof(double),
+		      tdpMemcpyDeviceToHost));
+
+  psi_memcpy(psi, tdpMemcpyDeviceToHost);
+  nernst_planck_maxacc_set(maxacc);
+
+  kernel_ctxt_free(ctxt);
 
   return 0;
 }
 
 /*****************************************************************************
  *
- *  nernst_planck_fluxes_d3qx
+ *  nernst_planck_sequence
  *
- *  Compute diffusive fluxes.
+ *  Advective and diffusive fluxes, subject to no-flux conditions,
+ *  followed by the update of the charge densities.
  *
- *  We assume we can accumulate the diffusive and advective fluxes separately.
+ *****************************************************************************/
+
+static void nernst_planck_sequence(void * arg) {
+
+  np_sequence_t * seq = (np_sequence_t *) arg;
+
+  assert(seq);
+
+  tdpLaunchKernel(nernst_planck_flux_kernel_v, seq->nblk, seq->ntpb, 0, 0,
+		  seq->ctxt, seq->psi, seq->hydro, seq->map, seq->fused);
+
+  tdpLaunchKernel(nernst_planck_update_kernel_v, seq->nblk, seq->ntpb, 0, 0,
+		  seq->ctxt, seq->psi, seq->map, seq->fused, seq->maxacc);
+
+  return;
+}
+
+/*****************************************************************************
  *
- *  As we compute rho(n+1) = rho(n) - div.flux in the update routine,
- *  there is an extra minus sign in the fluxes here. This conincides
- *  with the sign of the advective fluxes, if present.
+ *  nernst_planck_param_commit
+ *
+ *  Parameters (including the stencil) to target constant memory.
  *
  *****************************************************************************/
 
-static int nernst_planck_fluxes_d3qx(psi_t * psi, fe_t * fe, hydro_t * hydro, 
-				     map_t * map, colloids_info_t * cinfo,
-				     double ** flx) {
+static __host__ int nernst_planck_param_commit(psi_t * psi) {
 
-  int ic, jc, kc; 
-  int index0, index1;
-  int nlocal[3];
-  int n, nk; /* Number of charged species */
-  int c;
-  int status1;
+  int n, c;
+  double eunit;
+  np_param_t param;
 
-  double b0, b1;
-  double mu0, mu1;
-  double rho0, rho1;
-  double mu_s0, mu_s1;   /* Solvation chemical potential, from free energy */
-  
-  double eunit, reunit;
-  double beta;
-  double dt;
+  assert(psi);
+  assert(psi->nk <= PSI_NKMAX);
 
-  colloid_t * pc = NULL;
+  psi_unit_charge(psi, &eunit);
+
+  param.nk = psi->nk;
+  param.nsites = psi->nsites;
+  param.reunit = 1.0/eunit;
+  psi_multistep_timestep(psi, &param.dt);
+
+  for (n = 0; n < psi->nk; n++) {
+    param.diffusivity[n] = psi->diffusivity[n];
+    param.valency[n] = psi->valency[n];
+  }
+
+  for (c = 0; c < PSI_NGRAD; c++) {
+    param.cv[c][X] = psi_gr_cv[c][X];
+    param.cv[c][Y] = psi_gr_cv[c][Y];
+    param.cv[c][Z] = psi_gr_cv[c][Z];
+    param.rnorm[c] = psi_gr_rnorm[c];
+  }
+
+  tdpMemcpyToSymbol(tdpSymbol(static_param), &param, sizeof(np_param_t), 0,
+		    tdpMemcpyHostToDevice);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  nernst_planck_mu_solv
+ *
+ *  Gather the solvation chemical potential for each species at all
+ *  sites (including halo sites). The free energy interface provides
+ *  this on the host only.
+ *
+ *****************************************************************************/
+
+static __host__ int nernst_planck_mu_solv(psi_t * psi, fe_t * fe) {
+
+  int index;
+  int n, nk;
+  double mu_s;
 
   assert(psi);
   assert(fe);
   assert(fe->func->mu_solv);
-  assert(flx);
 
-  cs_nlocal(psi->cs, nlocal);
+  nk = psi->nk;
 
-  psi_unit_charge(psi, &eunit);
-  reunit = 1.0/eunit;
+  for (index = 0; index < psi->nsites; index++) {
+    for (n = 0; n < nk; n++) {
+      fe->func->mu_solv(fe, index, n, &mu_s);
+      psi->musolv[addr_rank1(psi->nsites, nk, index, n)] = mu_s;
+    }
+  }
 
-  psi_beta(psi, &beta);
-  psi_nk(psi, &nk);
-  psi_multistep_timestep(psi, &dt);
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  nernst_planck_flux_kernel_v
+ *
+ *  Compute the advective (if hydro is present) and diffusive fluxes
+ *  on each link. The flux at a site which is not fluid, or on a link
+ *  to a site which is not fluid, is zero (no normal flux).
+ *
+ *  As we compute rho(n+1) = rho(n) - div.flux in the update, the
+ *  diffusive flux carries an extra minus sign. This conincides with
+ *  the sign of the advective fluxes.
+ *
+ *  If fused, the sum of flux*dt, and the sum of |flux*dt| over links,
+ *  are stored in the first two flux slots for each species.
+ *
+ *****************************************************************************/
 
+__global__ void nernst_planck_flux_kernel_v(kernel_ctxt_t * ktx, psi_t * psi,
+					    hydro_t * hydro, map_t * map,
+					    int fused) {
+  int kindex;
+  __shared__ int kiter;
 
-  for (ic = 1; ic <= nlocal[X]; ic++) {
-    for (jc = 1; jc <= nlocal[Y]; jc++) {
-      for (kc = 1; kc <= nlocal[Z]; kc++) {
+  assert(ktx);
+  assert(psi);
+  assert(map);
 
-	index0 = cs_index(psi->cs, ic, jc, kc);
-        colloids_info_map(cinfo, index0, &pc);
+  kiter = kernel_vector_iterations(ktx);
 
-	if (pc) {
-	  continue;
+  for_simt_parallel(kindex, kiter, NSIMDVL) {
+
+    int n, c, iv;
+    int index0;
+    int nk, nsites;
+    int ic[NSIMDVL], jc[NSIMDVL], kc[NSIMDVL];
+    int ix[NSIMDVL], jx[NSIMDVL], kx[NSIMDVL];
+    int index[NSIMDVL];
+    int maskv[NSIMDVL];
+
+    double mask0[NSIMDVL];           /* Site is fluid */
+    double mask[NSIMDVL];            /* Link is fluid-fluid */
+    double u0[3][NSIMDVL];           /* Velocity at site */
+    double u[NSIMDVL];               /* Velocity normal to link face */
+    double dsum[PSI_NKMAX][NSIMDVL]; /* Fused: sum flux*dt */
+    double asum[PSI_NKMAX][NSIMDVL]; /* Fused: sum |flux*dt| */
+
+    nk = static_param.nk;
+    nsites = static_param.nsites;
+
+    kernel_coords_v(ktx, kindex, ic, jc, kc);
+    kernel_mask_v(ktx, ic, jc, kc, maskv);
+
+    index0 = kernel_baseindex(ktx, kindex);
+
+    for_simd_v(iv, NSIMDVL) {
+      mask0[iv] = (map->status[index0 + iv] == MAP_FLUID);
+    }
+
+    if (hydro) {
+      for_simd_v(iv, NSIMDVL) {
+	u0[X][iv] = hydro->u[addr_rank1(hydro->nsite, NHDIM, index0 + iv, X)];
+	u0[Y][iv] = hydro->u[addr_rank1(hydro->nsite, NHDIM, index0 + iv, Y)];
+	u0[Z][iv] = hydro->u[addr_rank1(hydro->nsite, NHDIM, index0 + iv, Z)];
+      }
+    }
+
+    for (n = 0; n < nk; n++) {
+      for_simd_v(iv, NSIMDVL) dsum[n][iv] = 0.0;
+      for_simd_v(iv, NSIMDVL) asum[n][iv] = 0.0;
+    }
+
+    for (c = 1; c < PSI_NGRAD; c++) {
+
+      /* Entries outside the kernel limits use their own index */
+      for_simd_v(iv, NSIMDVL) ix[iv] = ic[iv] + maskv[iv]*static_param.cv[c][X];
+      for_simd_v(iv, NSIMDVL) jx[iv] = jc[iv] + maskv[iv]*static_param.cv[c][Y];
+      for_simd_v(iv, NSIMDVL) kx[iv] = kc[iv] + maskv[iv]*static_param.cv[c][Z];
+      kernel_coords_index_v(ktx, ix, jx, kx, index);
+
+      for_simd_v(iv, NSIMDVL) {
+	mask[iv] = mask0[iv]*(map->status[index[iv]] == MAP_FLUID);
+      }
+
+      for_simd_v(iv, NSIMDVL) u[iv] = 0.0;
+
+      if (hydro) {
+	for_simd_v(iv, NSIMDVL) {
+	  int i1 = index[iv];
+	  double u1[3];
+	  u1[X] = hydro->u[addr_rank1(hydro->nsite, NHDIM, i1, X)];
+	  u1[Y] = hydro->u[addr_rank1(hydro->nsite, NHDIM, i1, Y)];
+	  u1[Z] = hydro->u[addr_rank1(hydro->nsite, NHDIM, i1, Z)];
+	  u[iv] = 0.5*((u0[X][iv] + u1[X])*static_param.cv[c][X]
+		       + (u0[Y][iv] + u1[Y])*static_param.cv[c][Y]
+		       + (u0[Z][iv] + u1[Z])*static_param.cv[c][Z]);
 	}
-	else {
+      }
 
-	  for (c = 1; c < PSI_NGRAD; c++) {
+      for (n = 0; n < nk; n++) {
+	for_simd_v(iv, NSIMDVL) {
 
-	    index1 = cs_index(psi->cs, ic + psi_gr_cv[c][X], jc + psi_gr_cv[c][Y], kc + psi_gr_cv[c][Z]);
-	    map_status(map, index1, &status1);
+	  int i0 = index0 + iv;
+	  int i1 = index[iv];
+	  double b0, b1;
+	  double mu0, mu1;
+	  double rho0, rho1;
+	  double flx = 0.0;
 
-	    if (status1 == MAP_FLUID) {
+	  rho0 = psi->rho[addr_rank1(nsites, nk, i0, n)];
+	  rho1 = psi->rho[addr_rank1(nsites, nk, i1, n)];
 
-	      for (n = 0; n < nk; n++) {
+	  if (hydro) flx = u[iv]*0.5*(rho1 + rho0);
 
-		fe->func->mu_solv(fe, index0, n, &mu_s0);
-		mu0 = reunit*mu_s0
-		  + psi->valency[n]*psi->psi[addr_rank0(psi->nsites, index0)];
-		rho0 = psi->rho[addr_rank1(psi->nsites, nk, index0, n)];
+	  if (mask[iv] > 0.0) {
+	    mu0 = static_param.reunit*psi->musolv[addr_rank1(nsites, nk, i0, n)]
+	      + static_param.valency[n]*psi->psi[addr_rank0(nsites, i0)];
+	    mu1 = static_param.reunit*psi->musolv[addr_rank1(nsites, nk, i1, n)]
+	      + static_param.valency[n]*psi->psi[addr_rank0(nsites, i1)];
+	    b0 = exp(mu0 - mu1);
+	    b1 = exp(mu1 - mu0);
+	    rho1 = rho1*b1;
 
-		fe->func->mu_solv(fe, index1, n, &mu_s1);
-		mu1 = reunit*mu_s1
-		  + psi->valency[n]* psi->psi[addr_rank0(psi->nsites, index1)];
-		b0 = exp(mu0 - mu1);
-		b1 = exp(mu1 - mu0);
-		rho1 = psi->rho[addr_rank1(psi->nsites, nk, index1, n)]*b1;
-
-		flx[addr_rank1(psi->nsites, nk, index0, n)][c - 1]
-		  -= psi->diffusivity[n]*0.5*(1.0 + b0)*(rho1 - rho0)*psi_gr_rnorm[c];
-	      }
-	    }
+	    flx -= static_param.diffusivity[n]*0.5*(1.0 + b0)*(rho1 - rho0)
+	      *static_param.rnorm[c];
 	  }
-        }
+
+	  flx *= mask[iv];
+
+	  if (fused) {
+	    dsum[n][iv] += flx*static_param.dt;
+	    asum[n][iv] += fabs(flx*static_param.dt);
+	  }
+	  else {
+	    psi->flx[addr_rank2(nsites, nk, PSI_NGRAD-1, i0, n, c-1)] = flx;
+	  }
+	}
+      }
+    }
+
+    if (fused) {
+      for (n = 0; n < nk; n++) {
+	for_simd_v(iv, NSIMDVL) {
+	  psi->flx[addr_rank2(nsites, nk, PSI_NGRAD-1, index0+iv, n, 0)]
+	    = dsum[n][iv];
+	  psi->flx[addr_rank2(nsites, nk, PSI_NGRAD-1, index0+iv, n, 1)]
+	    = asum[n][iv];
+	}
       }
     }
   }
 
-  return 0;
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  nernst_planck_update_kernel_v
+ *
+ *  Update the rho_k from the fluxes (D3QX stencil). Euler forward step.
+ *  The maximum relative change at fluid sites is accumulated in maxacc.
+ *
+ *****************************************************************************/
+
+__global__ void nernst_planck_update_kernel_v(kernel_ctxt_t * ktx,
+					      psi_t * psi, map_t * map,
+					      int fused, double * maxacc) {
+  int kindex;
+  int tid;
+  __shared__ int kiter;
+  __shared__ double accb[TARGET_MAX_THREADS_PER_BLOCK];
+
+  assert(ktx);
+  assert(psi);
+  assert(map);
+  assert(maxacc);
+
+  tid = threadIdx.x;
+  accb[tid] = 0.0;
+
+  kiter = kernel_vector_iterations(ktx);
+
+  for_simt_parallel(kindex, kiter, NSIMDVL) {
+
+    int n, c, iv;
+    int index0;
+    int nk, nsites;
+    int ic[NSIMDVL], jc[NSIMDVL], kc[NSIMDVL];
+    int maskv[NSIMDVL];
+
+    nk = static_param.nk;
+    nsites = static_param.nsites;
+
+    kernel_coords_v(ktx, kindex, ic, jc, kc);
+    kernel_mask_v(ktx, ic, jc, kc, maskv);
+
+    index0 = kernel_baseindex(ktx, kindex);
+
+    for (n = 0; n < nk; n++) {
+      for_simd_v(iv, NSIMDVL) {
+
+	int i0 = index0 + iv;
+	int ir = addr_rank1(nsites, nk, i0, n);
+	double acc = 0.0;
+
+	if (maskv[iv] == 0 || map->status[i0] != MAP_FLUID) continue;
+
+	if (fused) {
+	  psi->rho[ir] -= psi->flx[addr_rank2(nsites, nk, PSI_NGRAD-1, i0, n, 0)];
+	  acc = psi->flx[addr_rank2(nsites, nk, PSI_NGRAD-1, i0, n, 1)];
+	}
+	else {
+	  for (c = 1; c < PSI_NGRAD; c++) {
+	    double fdt = psi->flx[addr_rank2(nsites, nk, PSI_NGRAD-1, i0, n, c-1)]
+	      *static_param.dt;
+	    psi->rho[ir] -= fdt;
+	    acc += fabs(fdt);
+	  }
+	}
+
+	acc /= fabs(psi->rho[ir]);
+	if (accb[tid] < acc) accb[tid] = acc;
+      }
+    }
+  }
+
+  tdpAtomicMaxDouble(maxacc, accb[tid]);
+
+  return;
 }
 
 /*****************************************************************************
@@ -480,6 +781,7 @@ static int nernst_planck_fluxes_d3qx(psi_t * psi, fe_t * fe, hydro_t * hydro,
  *  nernst_planck_fluxes_force_d3qx
  *
  *  Compute diffusive fluxes and link-flux force on fluid.
+ *  The fluxes flx[] have the same layout as psi->flx.
  *
  *  We assume we can accumulate the diffusive and advective fluxes separately.
  *
@@ -491,7 +793,7 @@ static int nernst_planck_fluxes_d3qx(psi_t * psi, fe_t * fe, hydro_t * hydro,
 
 int nernst_planck_fluxes_force_d3qx(psi_t * psi, fe_t * fe, hydro_t * hydro, 
 				    map_t * map, colloids_info_t * cinfo,
-				    double ** flx) {
+				    double * flx) {
 
   int ic, jc, kc; 
   int index0, index1;
@@ -590,7 +892,8 @@ int nernst_planck_fluxes_force_d3qx(psi_t * psi, fe_t * fe, hydro_t * hydro,
 		  * psi_gr_rnorm[c];
 
 		/* Link flux */
-		flx[addr_rank1(nsites, nk, index0, n)][c - 1] += psi->diffusivity[n]*flxtmp[0];
+		flx[addr_rank2(nsites, nk, PSI_NGRAD-1, index0, n, c-1)]
+		  += psi->diffusivity[n]*flxtmp[0];
 
 		/* Force on fluid including ideal gas part in chemical potential */
 		aux = psi_gr_rcs2 * psi_gr_wv[c] * flxtmp[0] * rbeta;	
@@ -662,65 +965,6 @@ int nernst_planck_fluxes_force_d3qx(psi_t * psi, fe_t * fe, hydro_t * hydro,
   return 0;
 }
 
-/*****************************************************************************
- *
- *  nernst_planck_update_d3qx
- *
- *  Update the rho_k from the fluxes (D3QX stencil). Euler forward step.
- *
- *****************************************************************************/
-
-static int nernst_planck_update_d3qx(psi_t * psi, map_t * map, double ** flx) {
-
-  int ic, jc, kc, index;
-  int nsites;
-  int nlocal[3];
-  int n, nk;
-  int c;
-  int status;
-  double acc, maxacc=0.0;
-  double dt;
-
-  assert(psi);
-  assert(flx);
-
-  cs_nsites(psi->cs, &nsites);
-  cs_nlocal(psi->cs, nlocal);
-
-  psi_nk(psi, &nk);
-  psi_multistep_timestep(psi, &dt);
-
-  for (ic = 1; ic <= nlocal[X]; ic++) {
-    for (jc = 1; jc <= nlocal[Y]; jc++) {
-      for (kc = 1; kc <= nlocal[Z]; kc++) {
-
-	index = cs_index(psi->cs, ic, jc, kc);
-        map_status(map, index, &status);
-
-        if (status == MAP_FLUID) {
-	  for (n = 0; n < nk; n++) {
-
-	    acc = 0.0;
-	    for (c = 1; c < PSI_NGRAD; c++) {
-	      psi->rho[addr_rank1(nsites, nk, index, n)]
-		-= flx[addr_rank1(nsites, nk, index, n)][c - 1] * dt;
-	      acc += fabs(flx[addr_rank1(nsites, nk, index, n)][c - 1] * dt);
-	    }
-
-	    acc /= fabs(psi->rho[addr_rank1(nsites, nk, index, n)]);
-	    if (maxacc < acc) maxacc = acc; 
-	  }
-	}
-
-      }
-    }
-  }
-
-  nernst_planck_maxacc_set(maxacc);
-
-  return 0;
-}
-
 /*****************************************************************************
  *
  *  nernst_planck_maxacc_set
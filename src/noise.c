@@ -17,10 +17,23 @@
  *  L'Ecuyer and Simard in ACM TOMS 33 Article 22 (2007). The state is
  *  4 --- 4-byte --- unsigned integers.
  *
+ *  Alternatively, in counter mode (NOISE_MODE_COUNTER), there is no
+ *  per-site state. Each uniform integer is one word of the output of
+ *  the Philox4x32-10 generator of Salmon et al., SC11 (2011), with a
+ *  counter formed from the global site index, the current step for
+ *  the stream (one of noise_enum_t), the stream itself, and the draw
+ *  number; the key is formed from the master seed. The results are
+ *  then independent of decomposition by construction, and there is
+ *  no state to checkpoint: the step for each stream is advanced by
+ *  the consumer via noise_advance() once per time step, so that it
+ *  tracks the time step. On restart, noise_step_set() is used to
+ *  start all streams from the restart time step, and the sequence
+ *  is then that of the uninterrupted run.
+ *
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2013-2018 The University of Edinburgh
+ *  (c) 2013-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -40,6 +53,9 @@
 
 static int noise_write(FILE * fp, int index, void * self);
 static int noise_read(FILE * fp, int index, void * self);
+static __host__ __device__
+unsigned int noise_counter_uniform(noise_t * obj, int stream, int index,
+				   int idraw);
 
 /*****************************************************************************
  *
@@ -105,10 +121,13 @@ __host__ int noise_free(noise_t * obj) {
 
   assert(obj);
 
-  if (obj->target != obj && obj->state) {
-    unsigned int * tmp = NULL;
-    tdpMemcpy(&tmp, &obj->target->state, sizeof(unsigned int *),
-	      tdpMemcpyDeviceToHost);
+  if (obj->target != obj) {
+    if (obj->state) {
+      unsigned int * tmp = NULL;
+      tdpMemcpy(&tmp, &obj->target->state, sizeof(unsigned int *),
+		tdpMemcpyDeviceToHost);
+      tdpFree(tmp);
+    }
     tdpFree(obj->target);
   }
 
@@ -130,6 +149,8 @@ __host__ int noise_free(noise_t * obj) {
  *  The halo extends 1 point into the halo to allow mid-point
  *  random numbers to be computed. The halo points must have
  *  the appropriate initialisation based on global (ig, jg, kg).
+ *
+ *  In counter mode, only the geometry is recorded.
  * 
  *****************************************************************************/
 
@@ -161,6 +182,15 @@ __host__ int noise_init(noise_t * obj, int master_seed) {
   nstat = NNOISE_STATE*obj->nsites;
   assert(obj->nsites > 0);
 
+  if (obj->mode == NOISE_MODE_COUNTER) {
+    cs_nhalo(obj->cs, &obj->nhalo);
+    cs_nlocal(obj->cs, obj->nlocal);
+    cs_nlocal_offset(obj->cs, obj->noffset);
+    cs_ntotal(obj->cs, obj->ntotal);
+    noise_memcpy(obj, tdpMemcpyHostToDevice);
+    return 0;
+  }
+
   obj->state = (unsigned int *) calloc(nstat, sizeof(unsigned int));
   if (obj->state == NULL) pe_fatal(obj->pe, "calloc(obj->state) failed\n");
 
@@ -267,12 +297,25 @@ __host__ int noise_memcpy(noise_t * obj, tdpMemcpyKind flag) {
 
     switch (flag) {
     case tdpMemcpyHostToDevice:
+      tdpMemcpy(&obj->target->master_seed, &obj->master_seed, sizeof(int),
+		flag);
       tdpMemcpy(&obj->target->nsites, &obj->nsites, sizeof(int), flag);
       tdpMemcpy(&obj->target->on, &obj->on, NOISE_END*sizeof(int), flag);
-      tdpMemcpy(tmp, obj->state, nstat*sizeof(unsigned int), flag);
+      tdpMemcpy(&obj->target->mode, &obj->mode, sizeof(int), flag);
+      tdpMemcpy(&obj->target->step, &obj->step,
+		NOISE_END*sizeof(unsigned int), flag);
+      tdpMemcpy(&obj->target->nhalo, &obj->nhalo, sizeof(int), flag);
+      tdpMemcpy(&obj->target->nlocal, &obj->nlocal, 3*sizeof(int), flag);
+      tdpMemcpy(&obj->target->noffset, &obj->noffset, 3*sizeof(int), flag);
+      tdpMemcpy(&obj->target->ntotal, &obj->ntotal, 3*sizeof(int), flag);
+      if (obj->state) {
+	tdpMemcpy(tmp, obj->state, nstat*sizeof(unsigned int), flag);
+      }
       break;
     case tdpMemcpyDeviceToHost:
-      tdpMemcpy(obj->state, tmp, nstat*sizeof(unsigned int), flag);
+      if (obj->state) {
+	tdpMemcpy(obj->state, tmp, nstat*sizeof(unsigned int), flag);
+      }
       break;
     default:
       pe_fatal(obj->pe, "Bad flag in noise_memcpy\n");
@@ -321,6 +364,87 @@ __host__ int noise_init_io_info(noise_t * obj, int grid[3], int form_in,
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  noise_mode_set
+ *
+ *  Must be called before noise_init().
+ *
+ *****************************************************************************/
+
+__host__ int noise_mode_set(noise_t * obj, noise_mode_enum_t mode) {
+
+  assert(obj);
+  assert(obj->state == NULL);
+
+  obj->mode = mode;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  noise_advance
+ *
+ *  Counter mode: move to the next step for the given stream. To be
+ *  called once per time step by the consumer of the stream after all
+ *  the draws for the step have been made. A no-op for stateful mode.
+ *
+ *****************************************************************************/
+
+__host__ int noise_advance(noise_t * obj, noise_enum_t stream) {
+
+  int ndevice;
+
+  assert(obj);
+  assert(stream < NOISE_END);
+
+  if (obj->mode == NOISE_MODE_STATEFUL) return 0;
+
+  obj->step[stream] += 1;
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice > 0) {
+    tdpMemcpy(&obj->target->step[stream], &obj->step[stream],
+	      sizeof(unsigned int), tdpMemcpyHostToDevice);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  noise_step_set
+ *
+ *  Counter mode: set the current step for all streams, e.g., to the
+ *  time step at restart. A no-op for stateful mode.
+ *
+ *****************************************************************************/
+
+__host__ int noise_step_set(noise_t * obj, unsigned int step) {
+
+  int ndevice;
+  int stream;
+
+  assert(obj);
+
+  if (obj->mode == NOISE_MODE_STATEFUL) return 0;
+
+  for (stream = 0; stream < NOISE_END; stream++) {
+    obj->step[stream] = step;
+  }
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice > 0) {
+    tdpMemcpy(obj->target->step, obj->step, NOISE_END*sizeof(unsigned int),
+	      tdpMemcpyHostToDevice);
+  }
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  noise_state_set
@@ -450,6 +574,195 @@ int noise_uniform_double_reap(noise_t * obj, int index, double * reap) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  noise_reap_stream_n
+ *
+ *  Return nmax (at most NNOISE_MAX) discrete random numbers for site
+ *  index for the given stream. Different draws at the same site and
+ *  step must have distinct idraw = 0, 1, ...
+ *
+ *  In stateful mode, this is noise_reap_n() (stream and idraw are
+ *  not relevant).
+ *
+ *****************************************************************************/
+
+__host__ __device__
+int noise_reap_stream_n(noise_t * obj, noise_enum_t stream, int index,
+			int idraw, int nmax, double * reap) {
+
+  unsigned int iuniform;
+  int ia;
+
+  assert(obj);
+  assert(stream < NOISE_END);
+  assert(index >= 0);
+  assert(index < obj->nsites);
+  assert(nmax <= NNOISE_MAX);
+
+  if (obj->mode == NOISE_MODE_STATEFUL) {
+    return noise_reap_n(obj, index, nmax, reap);
+  }
+
+  iuniform = noise_counter_uniform(obj, stream, index, idraw);
+
+  /* As noise_reap_n() */
+
+  iuniform >>= 2;
+
+  for (ia = 0; ia < nmax; ia++) {
+    reap[ia] = obj->rtable[iuniform & 7];
+    iuniform >>= 3;
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  noise_reap_stream_nv
+ *
+ *  As noise_reap_stream_n() for NSIMDVL consecutive sites starting
+ *  at index0. The results are reap[ia*NSIMDVL + iv].
+ *
+ *  In counter mode, there is no dependency between sites and the
+ *  draws may be vectorised.
+ *
+ *****************************************************************************/
+
+__host__ __device__
+int noise_reap_stream_nv(noise_t * obj, noise_enum_t stream, int index0,
+			 int idraw, int nmax, double * reap) {
+
+  int ia, iv;
+  unsigned int iuniform[NSIMDVL];
+
+  assert(obj);
+  assert(stream < NOISE_END);
+  assert(nmax <= NNOISE_MAX);
+
+  if (obj->mode == NOISE_MODE_STATEFUL) {
+    double reap1[NNOISE_MAX];
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      noise_reap_n(obj, index0 + iv, nmax, reap1);
+      for (ia = 0; ia < nmax; ia++) {
+	reap[ia*NSIMDVL + iv] = reap1[ia];
+      }
+    }
+    return 0;
+  }
+
+  for_simd_v(iv, NSIMDVL) {
+    iuniform[iv] = noise_counter_uniform(obj, stream, index0 + iv, idraw);
+    iuniform[iv] >>= 2;
+  }
+
+  for (ia = 0; ia < nmax; ia++) {
+    for_simd_v(iv, NSIMDVL) {
+      reap[ia*NSIMDVL + iv] = obj->rtable[iuniform[iv] & 7];
+      iuniform[iv] >>= 3;
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  noise_counter_uniform
+ *
+ *  Counter mode: return a uniformly distributed integer (0 - 2^32 - 1)
+ *  for the local site index. This is word (idraw % 4) of the Philox
+ *  output for draw block (idraw / 4); the site is identified by its
+ *  global position, with halo sites taken periodically.
+ *
+ *****************************************************************************/
+
+static __host__ __device__
+unsigned int noise_counter_uniform(noise_t * obj, int stream, int index,
+				   int idraw) {
+
+  int ig, jg, kg;
+  int xs, ys;
+  unsigned int ctr[4];
+  unsigned int key[2];
+  unsigned int r[4];
+
+  assert(obj);
+  assert(idraw >= 0);
+
+  ys = obj->nlocal[Z] + 2*obj->nhalo;
+  xs = ys*(obj->nlocal[Y] + 2*obj->nhalo);
+
+  /* Global position (from zero) with periodic wrapping of the halo */
+
+  ig = obj->noffset[X] - obj->nhalo + index/xs;
+  jg = obj->noffset[Y] - obj->nhalo + (index % xs)/ys;
+  kg = obj->noffset[Z] - obj->nhalo + index % ys;
+
+  ig = (ig + obj->ntotal[X]) % obj->ntotal[X];
+  jg = (jg + obj->ntotal[Y]) % obj->ntotal[Y];
+  kg = (kg + obj->ntotal[Z]) % obj->ntotal[Z];
+
+  ctr[0] = ((unsigned int) ig*obj->ntotal[Y] + jg)*obj->ntotal[Z] + kg;
+  ctr[1] = obj->step[stream];
+  ctr[2] = stream;
+  ctr[3] = idraw/4;
+
+  key[0] = obj->master_seed;
+  key[1] = 0;
+
+  noise_philox4x32(ctr, key, r);
+
+  return r[idraw % 4];
+}
+
+/*****************************************************************************
+ *
+ *  noise_philox4x32
+ *
+ *  The Philox4x32-10 counter-based generator (Salmon et al. 2011):
+ *  ten rounds applied to the counter ctr with key key. The results
+ *  r are four uniformly distributed 32-bit integers.
+ *
+ *  Unsigned int is assumed to be 32 bits.
+ *
+ *****************************************************************************/
+
+__host__ __device__ void noise_philox4x32(const unsigned int ctr[4],
+					  const unsigned int key[2],
+					  unsigned int r[4]) {
+  int n;
+  unsigned int k0, k1;
+  unsigned int x0, x1, x2, x3;
+  unsigned long long p0, p1;
+
+  const unsigned int m0 = 0xd2511f53;
+  const unsigned int m1 = 0xcd9e8d57;
+  const unsigned int w0 = 0x9e3779b9;
+  const unsigned int w1 = 0xbb67ae85;
+
+  assert(sizeof(unsigned int) == 4);
+
+  x0 = ctr[0]; x1 = ctr[1]; x2 = ctr[2]; x3 = ctr[3];
+  k0 = key[0]; k1 = key[1];
+
+  for (n = 0; n < 10; n++) {
+    p0 = (unsigned long long) m0*x0;
+    p1 = (unsigned long long) m1*x2;
+    x0 = ((unsigned int) (p1 >> 32)) ^ x1 ^ k0;
+    x1 = (unsigned int) p1;
+    x2 = ((unsigned int) (p0 >> 32)) ^ x3 ^ k1;
+    x3 = (unsigned int) p0;
+    k0 += w0;
+    k1 += w1;
+  }
+
+  r[0] = x0; r[1] = x1; r[2] = x2; r[3] = x3;
+
+  return;
+}
+
 /*****************************************************************************
  *
  *  noise_uniform
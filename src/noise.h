@@ -5,7 +5,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2013-2016 The University of Edinburgh
+ *  (c) 2013-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -28,12 +28,20 @@ typedef enum {NOISE_RHO = 0,
 	      NOISE_END}
   noise_enum_t;
 
+typedef enum {NOISE_MODE_STATEFUL = 0,
+	      NOISE_MODE_COUNTER}
+  noise_mode_enum_t;
+
 typedef struct noise_s noise_t;
 
 /* The implementation is based on the following opaque object, which
  * holds the uniform random number generator state for all sites
  * (here 4*4 byte integer). It also holds a table of the discrete
- * values. */
+ * values.
+ *
+ * In counter mode, there is no per-site state: the generator is a
+ * function of (seed, global site index, step, stream), and only the
+ * step for each stream and the geometry are held. */
 
 struct noise_s {
   pe_t * pe;                /* Parallel environment */
@@ -43,6 +51,12 @@ struct noise_s {
   int on[NOISE_END];        /* Noise on or off for different noise_enum_t */
   unsigned int * state;     /* Local state */
   double rtable[8];         /* Look up table following Ladd (2009). */
+  int mode;                 /* noise_mode_enum_t */
+  unsigned int step[NOISE_END]; /* Counter mode: current step per stream */
+  int nhalo;                /* Counter mode: local geometry */
+  int nlocal[3];
+  int noffset[3];
+  int ntotal[3];
   io_info_t * info;
   noise_t * target;
 };
@@ -54,14 +68,27 @@ __host__ int noise_memcpy(noise_t * obj, tdpMemcpyKind flag);
 __host__ int noise_target(noise_t * nosie, noise_t ** target);
 __host__ int noise_present_set(noise_t * obj, noise_enum_t type, int present);
 __host__ int noise_init_io_info(noise_t * obj, int grid[3], int form_in, int form_out);
+__host__ int noise_mode_set(noise_t * obj, noise_mode_enum_t mode);
+__host__ int noise_advance(noise_t * obj, noise_enum_t stream);
+__host__ int noise_step_set(noise_t * obj, unsigned int step);
 
 __host__ __device__ int noise_state_set(noise_t * obj, int index, unsigned int s[NNOISE_STATE]);
 __host__ __device__ int noise_state(noise_t * obj, int index, unsigned int s[NNOISE_STATE]);
 __host__ __device__ int noise_reap(noise_t * obj, int index, double * reap);
 __host__ __device__ int noise_reap_n(noise_t *obj, int index, int nmax, double * reap);
 __host__ __device__ int noise_uniform_double_reap(noise_t * obj, int index, double * reap);
+__host__ __device__ int noise_reap_stream_n(noise_t * obj, noise_enum_t stream,
+					    int index, int idraw, int nmax,
+					    double * reap);
+__host__ __device__ int noise_reap_stream_nv(noise_t * obj,
+					     noise_enum_t stream, int index0,
+					     int idraw, int nmax,
+					     double * reap);
 
 __host__ __device__ int noise_present(noise_t * obj, noise_enum_t type, int * present);
 __host__ __device__ unsigned int noise_uniform(unsigned int state[NNOISE_STATE]);
+__host__ __device__ void noise_philox4x32(const unsigned int ctr[4],
+					  const unsigned int key[2],
+					  unsigned int r[4]);
 
 #endif
@@ -16,7 +16,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2014-2018 The University of Edinburgh
+ *  (c) 2014-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *    Juho Lintuvuori (jlintuvu@ph.ed.ac.uk)
@@ -32,6 +32,7 @@
 #include "util.h"
 #include "coords.h"
 #include "colloids.h"
+#include "colloid_nlist.h"
 #include "pair_lj_cut.h"
 
 struct pair_lj_cut_s {
@@ -149,9 +150,7 @@ int pair_lj_cut_compute(colloids_info_t * cinfo, void * self) {
 
   pair_lj_cut_t * obj = (pair_lj_cut_t *) self;
 
-  int ic1, jc1, kc1, ic2, jc2, kc2;
-  int di[2], dj[2], dk[2];
-  int ncell[3];
+  int n, npair;
 
   double r2;
   double r;
@@ -165,12 +164,12 @@ int pair_lj_cut_compute(colloids_info_t * cinfo, void * self) {
 
   colloid_t * pc1;
   colloid_t * pc2;
+  colloid_nlist_t * nlist = NULL;
 
   assert(cinfo);
   assert(self);
 
   cs_ltot(obj->cs, ltot);
-  colloids_info_ncell(cinfo, ncell);
 
   obj->vlocal = 0.0;
   obj->rminlocal = dmax(ltot[X], dmax(ltot[Y], ltot[Z]));
@@ -182,60 +181,40 @@ int pair_lj_cut_compute(colloids_info_t * cinfo, void * self) {
   vcut = 4.0*obj->epsilon*(rs*rs - rs);
   dvcut = -24.0*rr*obj->epsilon*(2.0*rs*rs - rs);
 
-  for (ic1 = 1; ic1 <= ncell[X]; ic1++) {
-    colloids_info_climits(cinfo, X, ic1, di); 
-    for (jc1 = 1; jc1 <= ncell[Y]; jc1++) {
-      colloids_info_climits(cinfo, Y, jc1, dj);
-      for (kc1 = 1; kc1 <= ncell[Z]; kc1++) {
-        colloids_info_climits(cinfo, Z, kc1, dk);
+  colloids_info_nlist(cinfo, &nlist);
+  colloid_nlist_npair(nlist, &npair);
 
-        colloids_info_cell_list_head(cinfo, ic1, jc1, kc1, &pc1);
-        for (; pc1; pc1 = pc1->next) {
+  for (n = 0; n < npair; n++) {
 
-          for (ic2 = di[0]; ic2 <= di[1]; ic2++) {
-            for (jc2 = dj[0]; jc2 <= dj[1]; jc2++) {
-              for (kc2 = dk[0]; kc2 <= dk[1]; kc2++) {
-   
-                colloids_info_cell_list_head(cinfo, ic2, jc2, kc2, &pc2);
-                for (; pc2; pc2 = pc2->next) {
+    colloid_nlist_pair(nlist, n, &pc1, &pc2);
 
-		  if (pc1->s.index >= pc2->s.index) continue;
+    cs_minimum_distance(obj->cs, pc1->s.r, pc2->s.r, r12);
+    r2 = r12[X]*r12[X] + r12[Y]*r12[Y] + r12[Z]*r12[Z];
 
-		  cs_minimum_distance(obj->cs, pc1->s.r, pc2->s.r, r12);
-		  r2 = r12[X]*r12[X] + r12[Y]*r12[Y] + r12[Z]*r12[Z];
+    r = sqrt(r2);
 
-		  r = sqrt(r2);
+    /* Record both rmin and hmin */
+    if (r < obj->rminlocal) obj->rminlocal = r;
+    h = r - pc1->s.ah -pc2->s.ah;
+    if (h < obj->hminlocal) obj->hminlocal = h;
 
-		  /* Record both rmin and hmin */
-		  if (r < obj->rminlocal) obj->rminlocal = r;
-		  h = r - pc1->s.ah -pc2->s.ah;
-		  if (h < obj->hminlocal) obj->hminlocal = h;
+    if (r > obj->rc) continue;
 
-		  if (r > obj->rc) continue;
+    rr = 1.0/r;
+    rs = pow(obj->sigma*rr, 6);
 
-		  rr = 1.0/r;
-		  rs = pow(obj->sigma*rr, 6);
+    /* Potential, force */
 
-		  /* Potential, force */
+    obj->vlocal += 4.0*obj->epsilon*(rs*rs - rs) - vcut
+      - (r - obj->rc)*dvcut;
+    f = -(-24.0*rr*obj->epsilon*(2.0*rs*rs - rs) - dvcut);
 
-		  obj->vlocal += 4.0*obj->epsilon*(rs*rs - rs) - vcut
-		    - (r - obj->rc)*dvcut;
-		  f = -(-24.0*rr*obj->epsilon*(2.0*rs*rs - rs) - dvcut);
-
-		  pc1->force[X] -= f*r12[X]*rr;
-		  pc1->force[Y] -= f*r12[Y]*rr;
-		  pc1->force[Z] -= f*r12[Z]*rr;
-		  pc2->force[X] += f*r12[X]*rr;
-		  pc2->force[Y] += f*r12[Y]*rr;
-		  pc2->force[Z] += f*r12[Z]*rr;
-
-		}
-	      }
-	    }
-	  }
-	}
-      }
-    }
+    pc1->force[X] -= f*r12[X]*rr;
+    pc1->force[Y] -= f*r12[Y]*rr;
+    pc1->force[Z] -= f*r12[Z]*rr;
+    pc2->force[X] += f*r12[X]*rr;
+    pc2->force[Y] += f*r12[Y]*rr;
+    pc2->force[Z] += f*r12[Z]*rr;
   }
 
   return 0;
@@ -23,7 +23,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2017 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -39,6 +39,7 @@
 #include "coords.h"
 #include "physics.h"
 #include "colloids.h"
+#include "colloid_nlist.h"
 #include "pair_ss_cut.h"
 
 struct pair_ss_cut_s {
@@ -166,9 +167,7 @@ int pair_ss_cut_compute(colloids_info_t * cinfo, void * obj) {
 
   pair_ss_cut_t * self = (pair_ss_cut_t *) obj;
 
-  int ic1, jc1, kc1, ic2, jc2, kc2;
-  int di[2], dj[2], dk[2];
-  int ncell[3];
+  int n, npair;
 
   double r;                             /* centre-centre sepration */
   double h;                             /* surface-surface separation */
@@ -182,6 +181,7 @@ int pair_ss_cut_compute(colloids_info_t * cinfo, void * obj) {
 
   colloid_t * pc1;
   colloid_t * pc2;
+  colloid_nlist_t * nlist = NULL;
 
   assert(cinfo);
   assert(self);
@@ -196,58 +196,37 @@ int pair_ss_cut_compute(colloids_info_t * cinfo, void * obj) {
   vcut = self->epsilon*pow(self->sigma/self->hc, self->nu);
   dvcut = -self->epsilon*self->nu*rsigma*pow(self->sigma/self->hc, self->nu+1);
 
-  colloids_info_ncell(cinfo, ncell);
-
-  for (ic1 = 1; ic1 <= ncell[X]; ic1++) {
-    colloids_info_climits(cinfo, X, ic1, di); 
-    for (jc1 = 1; jc1 <= ncell[Y]; jc1++) {
-      colloids_info_climits(cinfo, Y, jc1, dj);
-      for (kc1 = 1; kc1 <= ncell[Z]; kc1++) {
-        colloids_info_climits(cinfo, Z, kc1, dk);
-
-        colloids_info_cell_list_head(cinfo, ic1, jc1, kc1, &pc1);
-        for (; pc1; pc1 = pc1->next) {
-
-          for (ic2 = di[0]; ic2 <= di[1]; ic2++) {
-            for (jc2 = dj[0]; jc2 <= dj[1]; jc2++) {
-              for (kc2 = dk[0]; kc2 <= dk[1]; kc2++) {
-   
-		colloids_info_cell_list_head(cinfo, ic2, jc2, kc2, &pc2);
-                for (; pc2; pc2 = pc2->next) {
-
-                  if (pc1->s.index >= pc2->s.index) continue;
-
-		  cs_minimum_distance(self->cs, pc1->s.r, pc2->s.r, r12);
-		  r = sqrt(r12[X]*r12[X] + r12[Y]*r12[Y] + r12[Z]*r12[Z]);
-		  if (r < self->rminlocal) self->rminlocal = r;
-
-		  h = r - pc1->s.ah - pc2->s.ah;
-		  if (h < self->hminlocal) self->hminlocal = h;
-
-		  if (h > self->hc) continue;
-		  assert(h > 0.0);
-
-		  rh = 1.0/h;
-
-		  self->vlocal += self->epsilon*pow(rh*self->sigma, self->nu)
-		    - vcut - (h - self->hc)*dvcut;
-		  f = -(-self->epsilon*self->nu*rsigma
-			*pow(rh*self->sigma, self->nu+1) - dvcut);
-
-		  rh = 1.0/r;
-		  pc1->force[X] -= f*r12[X]*rh;
-		  pc1->force[Y] -= f*r12[Y]*rh;
-		  pc1->force[Z] -= f*r12[Z]*rh;
-		  pc2->force[X] += f*r12[X]*rh;
-		  pc2->force[Y] += f*r12[Y]*rh;
-		  pc2->force[Z] += f*r12[Z]*rh;
-		}
-	      }
-	    }
-	  }
-	}
-      }
-    }
+  colloids_info_nlist(cinfo, &nlist);
+  colloid_nlist_npair(nlist, &npair);
+
+  for (n = 0; n < npair; n++) {
+
+    colloid_nlist_pair(nlist, n, &pc1, &pc2);
+
+    cs_minimum_distance(self->cs, pc1->s.r, pc2->s.r, r12);
+    r = sqrt(r12[X]*r12[X] + r12[Y]*r12[Y] + r12[Z]*r12[Z]);
+    if (r < self->rminlocal) self->rminlocal = r;
+
+    h = r - pc1->s.ah - pc2->s.ah;
+    if (h < self->hminlocal) self->hminlocal = h;
+
+    if (h > self->hc) continue;
+    assert(h > 0.0);
+
+    rh = 1.0/h;
+
+    self->vlocal += self->epsilon*pow(rh*self->sigma, self->nu)
+      - vcut - (h - self->hc)*dvcut;
+    f = -(-self->epsilon*self->nu*rsigma
+	  *pow(rh*self->sigma, self->nu+1) - dvcut);
+
+    rh = 1.0/r;
+    pc1->force[X] -= f*r12[X]*rh;
+    pc1->force[Y] -= f*r12[Y]*rh;
+    pc1->force[Z] -= f*r12[Z]*rh;
+    pc2->force[X] += f*r12[X]*rh;
+    pc2->force[Y] += f*r12[Y]*rh;
+    pc2->force[Z] += f*r12[Z]*rh;
   }
 
   return 0;
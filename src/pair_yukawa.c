@@ -14,7 +14,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2014-2018 The University of Edinburgh
+ *  (c) 2014-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -29,6 +29,7 @@
 #include "coords.h"
 #include "physics.h"
 #include "colloids.h"
+#include "colloid_nlist.h"
 #include "pair_yukawa.h"
 
 struct pair_yukawa_s {
@@ -156,9 +157,7 @@ int pair_yukawa_compute(colloids_info_t * cinfo, void * self) {
 
   pair_yukawa_t * obj = (pair_yukawa_t *) self;
 
-  int ic1, jc1, kc1, ic2, jc2, kc2;
-  int di[2], dj[2], dk[2];
-  int ncell[3];
+  int n, npair;
 
   double r12[3];
   double f;
@@ -169,12 +168,12 @@ int pair_yukawa_compute(colloids_info_t * cinfo, void * self) {
 
   colloid_t * pc1;
   colloid_t * pc2;
+  colloid_nlist_t * nlist = NULL;
 
   assert(cinfo);
   assert(obj);
 
   cs_ltot(obj->cs, ltot);
-  colloids_info_ncell(cinfo, ncell);
 
   vcut = obj->epsilon*exp(-obj->kappa*obj->rc)/obj->rc;
   dvcut = -vcut*(1.0/obj->rc + obj->kappa);
@@ -183,53 +182,34 @@ int pair_yukawa_compute(colloids_info_t * cinfo, void * self) {
   obj->rminlocal = ltot[X];
   obj->hminlocal = ltot[X];
 
-  for (ic1 = 1; ic1 <= ncell[X]; ic1++) {
-    colloids_info_climits(cinfo, X, ic1, di); 
-    for (jc1 = 1; jc1 <= ncell[Y]; jc1++) {
-      colloids_info_climits(cinfo, Y, jc1, dj);
-      for (kc1 = 1; kc1 <= ncell[Z]; kc1++) {
-        colloids_info_climits(cinfo, Z, kc1, dk);
-
-        colloids_info_cell_list_head(cinfo, ic1, jc1, kc1, &pc1);
-        for (; pc1; pc1 = pc1->next) {
-
-          for (ic2 = di[0]; ic2 <= di[1]; ic2++) {
-            for (jc2 = dj[0]; jc2 <= dj[1]; jc2++) {
-              for (kc2 = dk[0]; kc2 <= dk[1]; kc2++) {
-   
-                colloids_info_cell_list_head(cinfo, ic2, jc2, kc2, &pc2);
-                for (; pc2; pc2 = pc2->next) {
-
-                  if (pc1->s.index >= pc2->s.index) continue;
-
-                  cs_minimum_distance(obj->cs, pc1->s.r, pc2->s.r, r12);
-		  r = sqrt(r12[X]*r12[X] + r12[Y]*r12[Y] + r12[Z]*r12[Z]);
-
-		  if (r < obj->rminlocal) obj->rminlocal = r;
-		  h = r - pc1->s.ah - pc2->s.ah;
-		  if (h < obj->hminlocal) obj->hminlocal = h;
-		  if (r >= obj->rc) continue;
-
-		  rr = 1.0/r;
-		  f = -(-obj->epsilon*exp(-obj->kappa*r)*rr*(rr + obj->kappa)
-			- dvcut);
-
-		  pc1->force[X] -= f*r12[X]*rr;
-		  pc1->force[Y] -= f*r12[Y]*rr;
-		  pc1->force[Z] -= f*r12[Z]*rr;
-		  pc2->force[X] += f*r12[X]*rr;
-		  pc2->force[Y] += f*r12[Y]*rr;
-		  pc2->force[Z] += f*r12[Z]*rr;
-
-		  obj->vlocal += obj->epsilon*exp(-obj->kappa*r)/r
-		    - vcut - (r - obj->rc)*dvcut;
-		}
-	      }
-	    }
-	  }
-	}
-      }
-    }
+  colloids_info_nlist(cinfo, &nlist);
+  colloid_nlist_npair(nlist, &npair);
+
+  for (n = 0; n < npair; n++) {
+
+    colloid_nlist_pair(nlist, n, &pc1, &pc2);
+
+    cs_minimum_distance(obj->cs, pc1->s.r, pc2->s.r, r12);
+    r = sqrt(r12[X]*r12[X] + r12[Y]*r12[Y] + r12[Z]*r12[Z]);
+
+    if (r < obj->rminlocal) obj->rminlocal = r;
+    h = r - pc1->s.ah - pc2->s.ah;
+    if (h < obj->hminlocal) obj->hminlocal = h;
+    if (r >= obj->rc) continue;
+
+    rr = 1.0/r;
+    f = -(-obj->epsilon*exp(-obj->kappa*r)*rr*(rr + obj->kappa)
+	  - dvcut);
+
+    pc1->force[X] -= f*r12[X]*rr;
+    pc1->force[Y] -= f*r12[Y]*rr;
+    pc1->force[Z] -= f*r12[Z]*rr;
+    pc2->force[X] += f*r12[X]*rr;
+    pc2->force[Y] += f*r12[Y]*rr;
+    pc2->force[Z] += f*r12[Z]*rr;
+
+    obj->vlocal += obj->epsilon*exp(-obj->kappa*r)/r
+      - vcut - (r - obj->rc)*dvcut;
   }
 
   return 0;
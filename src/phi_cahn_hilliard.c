@@ -28,7 +28,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2018 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributions:
  *  Thanks to Markus Gross, who helped to validate the noise implementation.
@@ -459,7 +459,7 @@ static int phi_ch_random_flux(phi_ch_t * pch, noise_t * noise) {
       for (kc = 1 - nextra; kc <= nlocal[Z] + nextra; kc++) {
 
         index0 = lees_edw_index(pch->le, ic, jc, kc);
-        noise_reap_n(noise, index0, 3, reap);
+        noise_reap_stream_n(noise, NOISE_PHI, index0, 0, 3, reap);
 
         for (ia = 0; ia < 3; ia++) {
           rflux[addr_rank1(nsites, 3, index0, ia)] = var*reap[ia];
@@ -508,6 +508,8 @@ static int phi_ch_random_flux(phi_ch_t * pch, noise_t * noise) {
 
   free(rflux);
 
+  noise_advance(noise, NOISE_PHI);
+
   return 0;
 }
 
@@ -78,6 +78,7 @@ __host__ int phi_force_calculation(cs_t * cs, lees_edw_t * le, wall_t * wall,
 				   field_t * phi, hydro_t * hydro) {
 
   int is_pm;
+  int ndevice;
 
   if (pth == NULL) return 0;
   if (pth->method == PTH_METHOD_NO_FORCE) return 0;
@@ -93,13 +94,20 @@ __host__ int phi_force_calculation(cs_t * cs, lees_edw_t * le, wall_t * wall,
   else {
     switch (pth->method) {
     case PTH_METHOD_DIVERGENCE:
-      pth_stress_compute(pth, fe);
+      /* The fused force (stress not stored) is one kernel per plane,
+       * which is too little work per launch for a GPU. */
+      tdpGetDeviceCount(&ndevice);
       if (wall_present(wall) || is_pm) {
+	pth_stress_compute(pth, fe);
 	pth_force_fluid_wall_driver(pth, hydro, map, wall);
       }
-      else {
+      else if (ndevice > 0) {
+	pth_stress_compute(pth, fe);
 	pth_force_fluid_driver(pth, hydro);
       }
+      else {
+	pth_force_fluid_fused_driver(pth, fe, hydro);
+      }
       break;
     case PTH_METHOD_GRADMU:
       phi_force_fluid_phi_gradmu(le, pth, fe, phi, hydro);
@@ -46,7 +46,7 @@
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
  *  Alan Gray (alang@epcc.ed.ac.uk) provided device implementations.
  *
- *  (c) 2010-2017 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *****************************************************************************/
 
@@ -64,6 +64,29 @@
 #include "pth_s.h"
 #include "phi_force_colloid.h"
 #include "timer.h"
+#include "util.h"
+
+/* Fused stress divergence (fluid only). The domain is swept in x
+ * one y-z plane at a time, and the stress is held for three planes
+ * (including a one site ghost layer in y and z) in pth->plane, so
+ * it is never stored in full. The rows in z are rounded up to whole
+ * SIMD vectors. */
+
+#define PTH_PLANE_NVZ(nz) (((nz) + 2 + NSIMDVL - 1)/NSIMDVL)
+#define PTH_PLANE_NSITE(ny, nz) (((ny) + 2)*NSIMDVL*PTH_PLANE_NVZ(nz))
+
+typedef struct pth_fused_s pth_fused_t;
+
+struct pth_fused_s {
+  dim3 nblk;                 /* Launch parameters (one plane) */
+  dim3 ntpb;
+  int nx;                    /* Number of planes */
+  int anti;                  /* Antisymmetric stress only */
+  cs_t * cs;
+  fe_t * fe;
+  hydro_t * hydro;
+  double * plane;
+};
 
 int pth_force_driver(pth_t * pth, colloids_info_t * cinfo,
 		     hydro_t * hydro, map_t * map, wall_t * wall);
@@ -75,6 +98,12 @@ __global__ void pth_force_wall_kernel(kernel_ctxt_t * ktx, pth_t * pth,
 				      double fw[3]);
 __global__ void pth_force_fluid_kernel_v(kernel_ctxt_t * ktx, pth_t * pth,
 					 hydro_t * hydro);
+__global__ void pth_force_fluid_fused_kernel(cs_t * cs, fe_t * fe,
+					     hydro_t * hydro, double * plane,
+					     int anti, int ic);
+
+static __host__ int pth_force_plane_alloc(pth_t * pth);
+static void pth_force_fluid_fused_seq(void * arg);
 
 /*****************************************************************************
  *
@@ -306,6 +335,236 @@ __host__ int pth_force_fluid_driver(pth_t * pth,  hydro_t * hydro) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  pth_force_fluid_fused_driver
+ *
+ *  Kernel driver. Fluid only. As pth_stress_compute() followed by
+ *  pth_force_fluid_driver(), but the stress is computed on the fly
+ *  and the divergence accumulated directly in hydro->f, so there is
+ *  no stored stress.
+ *
+ *  The domain is swept in x one y-z plane at a time: one kernel per
+ *  plane, run as a single sequence (see pth_force_fluid_fused_seq()).
+ *
+ *  If stress relaxation is in use, only the antisymmetric part of
+ *  the stress is required (and there is nothing to do if there is
+ *  no antisymmetric part).
+ *
+ *****************************************************************************/
+
+__host__ int pth_force_fluid_fused_driver(pth_t * pth, fe_t * fe,
+					  hydro_t * hydro) {
+  int nhalo;
+  int nlocal[3];
+  pth_fused_t seq;
+
+  assert(pth);
+  assert(fe);
+  assert(fe->func->target);
+  assert(hydro);
+
+  seq.anti = fe->use_stress_relaxation;
+  if (seq.anti && fe->func->str_anti == NULL) return 0;
+
+  cs_nhalo(pth->cs, &nhalo);
+  cs_nlocal(pth->cs, nlocal);
+
+  /* One halo point is required for the stress; the last SIMD vector
+   * in z may read beyond this, but not beyond the allocated sites. */
+  assert(nhalo >= 2);
+
+  pth_force_plane_alloc(pth);
+
+  seq.nx = nlocal[X];
+  seq.plane = pth->plane;
+  seq.hydro = hydro->target;
+  cs_target(pth->cs, &seq.cs);
+  fe->func->target(fe, &seq.fe);
+
+  kernel_launch_param((nlocal[Y] + 2)*PTH_PLANE_NVZ(nlocal[Z]),
+		      &seq.nblk, &seq.ntpb);
+
+  TIMER_start(TIMER_PHI_FORCE_CALC);
+
+  tdpLaunchSequence(pth_force_fluid_fused_seq, &seq);
+
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  TIMER_stop(TIMER_PHI_FORCE_CALC);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  pth_force_plane_alloc
+ *
+ *  Target memory for three y-z planes of stress (the plane buffer
+ *  for the fused force), if not already present.
+ *
+ *****************************************************************************/
+
+static __host__ int pth_force_plane_alloc(pth_t * pth) {
+
+  int nlocal[3];
+  size_t sz;
+
+  assert(pth);
+
+  if (pth->plane) return 0;
+
+  cs_nlocal(pth->cs, nlocal);
+
+  sz = 3*9*PTH_PLANE_NSITE(nlocal[Y], nlocal[Z])*sizeof(double);
+  tdpMalloc((void **) &pth->plane, sz);
+  if (pth->plane == NULL) pe_fatal(pth->pe, "tdpMalloc(pth->plane) failed\n");
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  pth_force_fluid_fused_seq
+ *
+ *  Planes ic = 0 and ic = 1 are computed first; each kernel then
+ *  computes the stress in plane ic + 1 and the force in plane ic.
+ *  Each kernel must be complete before the next starts.
+ *
+ *****************************************************************************/
+
+static void pth_force_fluid_fused_seq(void * arg) {
+
+  int ic;
+  pth_fused_t * seq = (pth_fused_t *) arg;
+
+  assert(seq);
+
+  for (ic = -1; ic <= seq->nx; ic++) {
+    tdpLaunchKernel(pth_force_fluid_fused_kernel, seq->nblk, seq->ntpb, 0, 0,
+		    seq->cs, seq->fe, seq->hydro, seq->plane, seq->anti, ic);
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  pth_force_fluid_fused_kernel
+ *
+ *  Compute force at each lattice site F_a = d_b Pth_ab with the
+ *  same discretisation as pth_force_fluid_kernel_v().
+ *
+ *  One iteration is one SIMD vector of sites in the y-z plane,
+ *  including the ghost layer. The stress at plane ic + 1 is stored
+ *  in the plane buffer, and the force is computed at plane ic if
+ *  ic >= 1. The neighbours in y and z for plane ic were stored by
+ *  the previous kernel, so threads share only complete planes.
+ *
+ *****************************************************************************/
+
+__global__ void pth_force_fluid_fused_kernel(cs_t * cs, fe_t * fe,
+					     hydro_t * hydro, double * plane,
+					     int anti, int ic) {
+  int kindex;
+  int kiterations;
+  int nvz;
+  int nzv;
+  int nsite;
+  int pm, p0, pp;                /* Planes ic - 1, ic, ic + 1 in buffer */
+  int nlocal[3];
+
+  assert(cs);
+  assert(fe);
+  assert(hydro);
+  assert(plane);
+  assert(ic >= -1);
+
+  cs_nlocal(cs, nlocal);
+
+  nvz = PTH_PLANE_NVZ(nlocal[Z]);
+  nzv = NSIMDVL*nvz;
+  nsite = PTH_PLANE_NSITE(nlocal[Y], nlocal[Z]);
+  kiterations = (nlocal[Y] + 2)*nvz;
+
+  pm = (ic + 2) % 3;
+  p0 = (ic + 3) % 3;
+  pp = (ic + 1) % 3;
+
+  for_simt_parallel(kindex, kiterations, 1) {
+
+    int ia, ib, iv;
+    int jc, kc;                  /* Row and first site in row */
+    int index;                   /* Site at (ic, jc, kc) */
+    int ip;                      /* Offset in plane */
+    int maskv[NSIMDVL];
+    double s[3][3][NSIMDVL];
+    double force[NSIMDVL];
+
+    jc = kindex/nvz;
+    kc = NSIMDVL*(kindex % nvz);
+    ip = jc*nzv + kc;
+
+    /* Stress at plane ic + 1 */
+
+    index = cs_index(cs, ic + 1, jc, kc);
+
+    if (anti) {
+      fe->func->str_anti_v(fe, index, s);
+    }
+    else {
+      fe->func->stress_v(fe, index, s);
+    }
+
+    for (ia = 0; ia < 3; ia++) {
+      for (ib = 0; ib < 3; ib++) {
+	for_simd_v(iv, NSIMDVL) {
+	  plane[(9*pp + 3*ia + ib)*nsite + ip + iv] = s[ia][ib][iv];
+	}
+      }
+    }
+
+    /* Force at plane ic (rows 1 ... nlocal[Y], sites 1 ... nlocal[Z]) */
+
+    if (ic >= 1 && jc >= 1 && jc <= nlocal[Y]) {
+
+      index = cs_index(cs, ic, jc, kc);
+
+      for_simd_v(iv, NSIMDVL) {
+	maskv[iv] = (kc + iv >= 1 && kc + iv <= nlocal[Z]);
+      }
+
+      for (ia = 0; ia < 3; ia++) {
+	for_simd_v(iv, NSIMDVL) {
+	  double * p = plane + ip + iv;
+	  force[iv]  = -0.5*(p[(9*pp + 3*ia + X)*nsite]
+			     + p[(9*p0 + 3*ia + X)*nsite]);
+	  force[iv] +=  0.5*(p[(9*pm + 3*ia + X)*nsite]
+			     + p[(9*p0 + 3*ia + X)*nsite]);
+	  force[iv] -= 0.5*(p[(9*p0 + 3*ia + Y)*nsite + nzv]
+			    + p[(9*p0 + 3*ia + Y)*nsite]);
+	  force[iv] += 0.5*(p[(9*p0 + 3*ia + Y)*nsite - nzv]
+			    + p[(9*p0 + 3*ia + Y)*nsite]);
+	  force[iv] -= 0.5*(p[(9*p0 + 3*ia + Z)*nsite + 1]
+			    + p[(9*p0 + 3*ia + Z)*nsite]);
+	  force[iv] += 0.5*(p[(9*p0 + 3*ia + Z)*nsite - 1]
+			    + p[(9*p0 + 3*ia + Z)*nsite]);
+	}
+	/* Padded sites beyond the row may alias the next row: no store */
+	for_simd_v(iv, NSIMDVL) {
+	  if (maskv[iv] == 0) continue;
+	  hydro->f[addr_rank1(hydro->nsite, NHDIM, index + iv, ia)]
+	    += force[iv];
+	}
+      }
+    }
+    /* Next vector */
+  }
+
+  return;
+}
+
 /*****************************************************************************
  *
  *  pth_force_fluid_kernel_v
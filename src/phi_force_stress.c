@@ -9,7 +9,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2012-2018 The University of Edinburgh
+ *  (c) 2012-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -30,19 +30,21 @@ __global__ void pth_kernel(kernel_ctxt_t * ktx, pth_t * pth, fe_t * fe);
 __global__ void pth_kernel_v(kernel_ctxt_t * ktx, pth_t * pth, fe_t * fe);
 __global__ void pth_kernel_a_v(kernel_ctxt_t * ktx, pth_t * pth, fe_t * fe);
 
+static __host__ int pth_stress_alloc(pth_t * pth);
+
 /*****************************************************************************
  *
  *  pth_create
  *
  *  The stress is always 3x3 tensor (to allow an anti-symmetric
- *  contribution), if it is required.
+ *  contribution), if it is required. Storage is only allocated
+ *  when the stress is first computed (see pth_stress_alloc()).
  *
  *****************************************************************************/
 
 __host__ int pth_create(pe_t * pe, cs_t * cs, int method, pth_t ** pobj) {
 
   int ndevice;
-  double * tmp;
   pth_t * obj = NULL;
 
   assert(pobj);
@@ -56,13 +58,6 @@ __host__ int pth_create(pe_t * pe, cs_t * cs, int method, pth_t ** pobj) {
   obj->method = method;
   cs_nsites(cs, &obj->nsites);
 
-  /* If memory required */
-
-  if (method == PTH_METHOD_DIVERGENCE) {
-    obj->str = (double *) calloc(3*3*obj->nsites, sizeof(double));
-    if (obj->str == NULL) pe_fatal(pe, "calloc(pth->str) failed\n");
-  }
-
   /* Allocate target memory, or alias */
 
   tdpGetDeviceCount(&ndevice);
@@ -76,12 +71,6 @@ __host__ int pth_create(pe_t * pe, cs_t * cs, int method, pth_t ** pobj) {
     tdpMemset(obj->target, 0, sizeof(pth_t));
     tdpMemcpy(&obj->target->nsites, &obj->nsites, sizeof(int),
 	      tdpMemcpyHostToDevice);
-
-    if (method == PTH_METHOD_DIVERGENCE) {
-      tdpMalloc((void **) &tmp, 3*3*obj->nsites*sizeof(double));
-      tdpMemcpy(&obj->target->str, &tmp, sizeof(double *),
-		tdpMemcpyHostToDevice);
-    }
   }
 
   *pobj = obj;
@@ -89,6 +78,39 @@ __host__ int pth_create(pe_t * pe, cs_t * cs, int method, pth_t ** pobj) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  pth_stress_alloc
+ *
+ *  Allocate the stress on host and target, if not already present.
+ *  This is only required if the stress is stored; the fluid-only
+ *  force (pth_force_fluid_fused_driver()) does not need it.
+ *
+ *****************************************************************************/
+
+static __host__ int pth_stress_alloc(pth_t * pth) {
+
+  int ndevice;
+  double * tmp = NULL;
+
+  assert(pth);
+
+  if (pth->str) return 0;
+
+  pth->str = (double *) calloc(3*3*pth->nsites, sizeof(double));
+  if (pth->str == NULL) pe_fatal(pth->pe, "calloc(pth->str) failed\n");
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice > 0) {
+    tdpMalloc((void **) &tmp, 3*3*pth->nsites*sizeof(double));
+    tdpMemcpy(&pth->target->str, &tmp, sizeof(double *),
+	      tdpMemcpyHostToDevice);
+  }
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  pth_free
@@ -111,6 +133,7 @@ __host__ int pth_free(pth_t * pth) {
     tdpFree(pth->target);
   }
 
+  if (pth->plane) tdpFree(pth->plane);
   if (pth->str) free(pth->str);
   free(pth);
 
@@ -136,7 +159,7 @@ __host__ int pth_memcpy(pth_t * pth, tdpMemcpyKind flag) {
     /* Ensure we alias */
     assert(pth->target == pth);
   }
-  else {
+  else if (pth->str) {
     double * tmp = NULL;
 
     nsz = 9*pth->nsites*sizeof(double);
@@ -191,6 +214,7 @@ __host__ int pth_stress_compute(pth_t * pth, fe_t * fe) {
   kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
 
   fe->func->target(fe, &fe_target);
+  pth_stress_alloc(pth);
 
   if (fe->use_stress_relaxation) {
     /* Antisymmetric part only required; if no antisymmetric part,
@@ -10,7 +10,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2008-2017 The University of Edinburgh
+ *  (c) 2008-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -25,9 +25,15 @@
 #include "pe.h"
 #include "coords.h"
 #include "field_s.h"
+#include "kernel.h"
+#include "kernel_reduce.h"
+#include "map_s.h"
 #include "util.h"
 #include "phi_stats.h"
 
+__global__ void stats_field_local_kernel(kernel_ctxt_t * ktx, field_t * obj,
+					 map_t * map, kernel_reduce_t * red);
+
 /*****************************************************************************
  *
  *  stats_field_info
@@ -181,17 +187,21 @@ int stats_field_reduce(field_t * obj, map_t * map, double * fmin,
  *   Each of the arrays must be large enough to hold the value for
  *   a field with nf elements.
  *
+ *   The reduction is performed on the target (the field data is
+ *   not copied to the host).
+ *
  *****************************************************************************/
 
 int stats_field_local(field_t * obj, map_t * map, double * fmin, double * fmax,
 		      double * fsum, double * fvar, double * fvol) {
 
-  int ic, jc, kc, index;
-  int nlocal[3];
   int n, nf;
-  int status;
+  int nlocal[3];
 
-  double f0[NQAB];
+  dim3 nblk, ntpb;
+  kernel_info_t limits;
+  kernel_ctxt_t * ctxt = NULL;
+  kernel_reduce_t * red = NULL;
 
   assert(obj);
   assert(fmin);
@@ -203,38 +213,135 @@ int stats_field_local(field_t * obj, map_t * map, double * fmin, double * fmax,
   field_nf(obj, &nf);
   assert(nf <= NQAB);
 
-  *fvol = 0.0;
+  /* Sums are fsum[0:nf), fvar[nf:2nf) and the volume at 2nf */
+
+  kernel_reduce_create(obj->pe, 2*nf + 1, &red);
+
+  limits.imin = 1; limits.imax = nlocal[X];
+  limits.jmin = 1; limits.jmax = nlocal[Y];
+  limits.kmin = 1; limits.kmax = nlocal[Z];
+
+  kernel_ctxt_create(obj->cs, NSIMDVL, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+  tdpLaunchKernel(stats_field_local_kernel, nblk, ntpb, 0, 0,
+		  ctxt->target, obj->target, map->target, red->target);
+
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  kernel_ctxt_free(ctxt);
+
+  kernel_reduce_local(red);
+
+  for (n = 0; n < nf; n++) {
+    fmin[n] = red->min[n];
+    fmax[n] = red->max[n];
+    fsum[n] = red->sum[n];
+    fvar[n] = red->sum[nf + n];
+  }
+  *fvol = red->sum[2*nf];
+
+  kernel_reduce_free(red);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  stats_field_local_kernel
+ *
+ *****************************************************************************/
+
+__global__ void stats_field_local_kernel(kernel_ctxt_t * ktx, field_t * obj,
+					 map_t * map, kernel_reduce_t * red) {
+  int kindex;
+  int kiterations;
+  int tid;
+  int n, nf;
+
+  double fmin[NQAB];
+  double fmax[NQAB];
+
+  __shared__ double fvol[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double fsum[NQAB][TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double fvar[NQAB][TARGET_MAX_THREADS_PER_BLOCK];
+
+  assert(ktx);
+  assert(obj);
+  assert(map);
+  assert(red);
+
+  nf = obj->nf;
+  tid = threadIdx.x;
 
+  fvol[tid] = 0.0;
   for (n = 0; n < nf; n++) {
     fmin[n] = +DBL_MAX;
     fmax[n] = -DBL_MAX;
-    fsum[n] = 0.0;
-    fvar[n] = 0.0;
+    fsum[n][tid] = 0.0;
+    fvar[n][tid] = 0.0;
   }
 
-  /* Local sum */
+  kiterations = kernel_vector_iterations(ktx);
 
-  for (ic = 1; ic <= nlocal[X]; ic++) {
-    for (jc = 1; jc <= nlocal[Y]; jc++) {
-      for (kc = 1; kc <= nlocal[Z]; kc++) {
+  for_simt_parallel(kindex, kiterations, NSIMDVL) {
 
-        index = cs_index(obj->cs, ic, jc, kc);
-	map_status(map, index, &status);
-	if (status != MAP_FLUID) continue;
+    int index, iv, status;
+    int ic[NSIMDVL], jc[NSIMDVL], kc[NSIMDVL];
+    int maskv[NSIMDVL];
+    double f0[NQAB][NSIMDVL];
+    double vtmp = 0.0;
 
-	*fvol += 1.0;
-	field_scalar_array(obj, index, f0);
+    index = kernel_baseindex(ktx, kindex);
+    kernel_coords_v(ktx, kindex, ic, jc, kc);
+    kernel_mask_v(ktx, ic, jc, kc, maskv);
 
-	for (n = 0; n < nf; n++) {
-	  fmin[n] = dmin(fmin[n], f0[n]);
-	  fmax[n] = dmax(fmax[n], f0[n]);
-	  fsum[n] += f0[n];
-	  fvar[n] += f0[n]*f0[n];
-	}
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      double f1[NQAB];
+      for (n = 0; n < nf; n++) {
+	f0[n][iv] = 0.0;
+      }
+      if (maskv[iv] == 0) continue;
+      map_status(map, index + iv, &status);
+      if (status != MAP_FLUID) {
+	maskv[iv] = 0;
+	continue;
+      }
+      field_scalar_array(obj, index + iv, f1);
+      for (n = 0; n < nf; n++) {
+	f0[n][iv] = f1[n];
+	fmin[n] = dmin(fmin[n], f1[n]);
+	fmax[n] = dmax(fmax[n], f1[n]);
+      }
+    }
+
+    for_simd_v_reduction(iv, NSIMDVL, +: vtmp) {
+      vtmp += 1.0*maskv[iv];
+    }
+    fvol[tid] += vtmp;
 
+    for (n = 0; n < nf; n++) {
+      double stmp = 0.0;
+      double s2tmp = 0.0;
+      for_simd_v_reduction(iv, NSIMDVL, +: stmp) {
+	stmp += f0[n][iv];
       }
+      for_simd_v_reduction(iv, NSIMDVL, +: s2tmp) {
+	s2tmp += f0[n][iv]*f0[n][iv];
+      }
+      fsum[n][tid] += stmp;
+      fvar[n][tid] += s2tmp;
     }
   }
 
-  return 0;
+  for (n = 0; n < nf; n++) {
+    kernel_reduce_sum(red, n, fsum[n]);
+    kernel_reduce_sum(red, nf + n, fvar[n]);
+    kernel_reduce_min(red, n, fmin[n]);
+    kernel_reduce_max(red, n, fmax[n]);
+  }
+  kernel_reduce_sum(red, 2*nf, fvol);
+
+  return;
 }
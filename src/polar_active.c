@@ -34,7 +34,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2011-2018 The University of Edinburgh
+ *  (c) 2011-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -438,3 +438,47 @@ int fe_polar_mol_field(fe_polar_t * fe, int index, double h[3]) {
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  fe_polar_mol_field_v
+ *
+ *  Vectorised version of the above for NSIMDVL sites from index.
+ *
+ *****************************************************************************/
+
+__host__ __device__
+void fe_polar_mol_field_v(fe_polar_t * fe, int index, double h[3][NSIMDVL]) {
+
+  int ia, iv;
+
+  double p2[NSIMDVL];
+  double p[3][NSIMDVL];
+  double dsqp[3][NSIMDVL];
+
+  assert(fe);
+
+  for (ia = 0; ia < 3; ia++) {
+    for_simd_v(iv, NSIMDVL) {
+      p[ia][iv] = fe->p->data[addr_rank1(fe->p->nsites, NVECTOR, index+iv, ia)];
+    }
+    for_simd_v(iv, NSIMDVL) {
+      dsqp[ia][iv] = fe->dp->delsq[addr_rank1(fe->dp->nsite, NVECTOR, index+iv, ia)];
+    }
+  }
+
+  for_simd_v(iv, NSIMDVL) p2[iv] = 0.0;
+
+  for (ia = 0; ia < 3; ia++) {
+    for_simd_v(iv, NSIMDVL) p2[iv] += p[ia][iv]*p[ia][iv];
+  }
+
+  for (ia = 0; ia < 3; ia++) {
+    for_simd_v(iv, NSIMDVL) {
+      h[ia][iv] = -fe->param->a*p[ia][iv] + -fe->param->b*p2[iv]*p[ia][iv]
+	+ fe->param->kappa1*dsqp[ia][iv];
+    }
+  }
+
+  return;
+}
@@ -5,7 +5,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2018 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -48,6 +48,8 @@ __host__ int fe_polar_target(fe_polar_t * fe, fe_t ** target);
 
 __host__ __device__ int fe_polar_fed(fe_polar_t * fe, int index, double * fed);
 __host__ __device__ int fe_polar_mol_field(fe_polar_t * fe, int index, double h[3]);
+__host__ __device__ void fe_polar_mol_field_v(fe_polar_t * fe, int index,
+					      double h[3][NSIMDVL]);
 __host__ __device__ int fe_polar_stress(fe_polar_t * fe, int index, double s[3][3]);
 __host__ __device__ void fe_polar_stress_v(fe_polar_t * fe, int index, double s[3][3][NSIMDVL]);
 
@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2017 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -25,11 +25,14 @@
 #include "lb_model_s.h"
 #include "timer.h"
 
-__host__ int lb_propagation_driver(lb_t * lb);
+__host__ int lb_propagation_driver(lb_t * lb, int nextra);
 __host__ int lb_model_swapf(lb_t * lb);
+static __host__ void lb_propagation_work(lb_t * lb, double nsite);
 
 __global__ void lb_propagation_kernel(kernel_ctxt_t * ktx, lb_t * lb);
 __global__ void lb_propagation_kernel_novector(kernel_ctxt_t * ktx, lb_t * lb);
+__global__ void lb_propagation_aa_kernel(kernel_ctxt_t * ktx, lb_t * lb);
+__global__ void lb_propagation_sparse_kernel(lb_t * lb, lb_sparse_t * sparse);
 
 static __constant__ cs_param_t coords;
 static __constant__ lb_collide_param_t lbp;
@@ -46,18 +49,58 @@ __host__ int lb_propagation(lb_t * lb) {
 
   assert(lb);
 
-  lb_propagation_driver(lb);
+  if (lb->npropagation == LB_PROPAGATION_AA) {
+    /* Streaming has taken place in the fused collision; just
+     * record that the distributions have changed order. */
+    lb->aaswapped = 1 - lb->aaswapped;
+  }
+  else {
+    lb_propagation_driver(lb, 0);
+  }
 
   return 0;
 }
 
 /*****************************************************************************
  *
- *  lb_propagation_driver
+ *  lb_propagation_extended
+ *
+ *  Two-lattice propagation at the local sites and at sites up to
+ *  nextra into the halo. Used with the communication-avoiding halo
+ *  swap (lb_halo_depth_set()), where sites up to nextra + 1 into the
+ *  halo must hold valid post-collision distributions.
+ *
+ *****************************************************************************/
+
+__host__ int lb_propagation_extended(lb_t * lb, int nextra) {
+
+  int nhalo;
+
+  assert(lb);
+  assert(lb->npropagation == LB_PROPAGATION_TWO_LATTICE);
+
+  cs_nhalo(lb->cs, &nhalo);
+  assert(0 <= nextra && nextra < nhalo);
+
+  lb_propagation_driver(lb, nextra);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_propagation_aa_complete
+ *
+ *  If the AA distributions are currently in swapped order (after an
+ *  even step), complete the streaming in place so that lb->f holds
+ *  the natural post-propagation order expected by output, statistics,
+ *  and so on. The next step is then an even step.
+ *
+ *  No operation for two-lattice propagation.
  *
  *****************************************************************************/
 
-__host__ int lb_propagation_driver(lb_t * lb) {
+__host__ int lb_propagation_aa_complete(lb_t * lb) {
 
   int nlocal[3];
   dim3 nblk, ntpb;
@@ -66,14 +109,64 @@ __host__ int lb_propagation_driver(lb_t * lb) {
 
   assert(lb);
 
-  cs_nlocal(lb->cs, nlocal);
+  if (lb->npropagation != LB_PROPAGATION_AA) return 0;
+  if (lb->aaswapped == 0) return 0;
 
-  /* The kernel is local domain only */
+  cs_nlocal(lb->cs, nlocal);
 
   limits.imin = 1; limits.imax = nlocal[X];
   limits.jmin = 1; limits.jmax = nlocal[Y];
   limits.kmin = 1; limits.kmax = nlocal[Z];
 
+  tdpMemcpyToSymbol(tdpSymbol(coords), lb->cs->param,
+		    sizeof(cs_param_t), 0, tdpMemcpyHostToDevice);
+  tdpMemcpyToSymbol(tdpSymbol(lbp), lb->param,
+		    sizeof(lb_collide_param_t), 0,
+		    tdpMemcpyHostToDevice);
+
+  kernel_ctxt_create(lb->cs, 1, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+  TIMER_start(TIMER_PROP_KERNEL);
+
+  tdpLaunchKernel(lb_propagation_aa_kernel, nblk, ntpb, 0, 0,
+		  ctxt->target, lb->target);
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  TIMER_stop(TIMER_PROP_KERNEL);
+  lb_propagation_work(lb, 1.0*nlocal[X]*nlocal[Y]*nlocal[Z]);
+
+  kernel_ctxt_free(ctxt);
+
+  lb->aaswapped = 0;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_propagation_driver
+ *
+ *****************************************************************************/
+
+__host__ int lb_propagation_driver(lb_t * lb, int nextra) {
+
+  int nlocal[3];
+  dim3 nblk, ntpb;
+  kernel_info_t limits;
+  kernel_ctxt_t * ctxt = NULL;
+
+  assert(lb);
+
+  cs_nlocal(lb->cs, nlocal);
+
+  /* The kernel is local domain only (plus nextra into the halo) */
+
+  limits.imin = 1 - nextra; limits.imax = nlocal[X] + nextra;
+  limits.jmin = 1 - nextra; limits.jmax = nlocal[Y] + nextra;
+  limits.kmin = 1 - nextra; limits.kmax = nlocal[Z] + nextra;
+
   tdpMemcpyToSymbol(tdpSymbol(coords), lb->cs->param,
 		    sizeof(cs_param_t), 0, tdpMemcpyHostToDevice);
   tdpMemcpyToSymbol(tdpSymbol(lbp), lb->param,
@@ -91,6 +184,9 @@ __host__ int lb_propagation_driver(lb_t * lb) {
   tdpAssert(tdpDeviceSynchronize());
 
   TIMER_stop(TIMER_PROP_KERNEL);
+  lb_propagation_work(lb, 1.0*(limits.imax - limits.imin + 1)
+		      *(limits.jmax - limits.jmin + 1)
+		      *(limits.kmax - limits.kmin + 1));
 
   kernel_ctxt_free(ctxt);
 
@@ -99,6 +195,129 @@ __host__ int lb_propagation_driver(lb_t * lb) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  lb_propagation_sparse
+ *
+ *  Two-lattice propagation at the fluid sites in the sparse table
+ *  only. Bounce-back at (stationary) solid sites is included, so
+ *  there is no separate wall_bbl() step.
+ *
+ *****************************************************************************/
+
+__host__ int lb_propagation_sparse(lb_t * lb, lb_sparse_t * sparse) {
+
+  dim3 nblk, ntpb;
+
+  assert(lb);
+  assert(sparse);
+  assert(lb->npropagation == LB_PROPAGATION_TWO_LATTICE);
+
+  if (sparse->nfluid > 0) {
+
+    tdpMemcpyToSymbol(tdpSymbol(lbp), lb->param,
+		      sizeof(lb_collide_param_t), 0,
+		      tdpMemcpyHostToDevice);
+
+    kernel_launch_param(sparse->nfluid, &nblk, &ntpb);
+
+    TIMER_start(TIMER_PROP_KERNEL);
+
+    tdpLaunchKernel(lb_propagation_sparse_kernel, nblk, ntpb, 0, 0,
+		    lb->target, sparse->target);
+    tdpAssert(tdpPeekAtLastError());
+    tdpAssert(tdpDeviceSynchronize());
+
+    TIMER_stop(TIMER_PROP_KERNEL);
+    lb_propagation_work(lb, 1.0*sparse->nfluid);
+  }
+
+  lb_model_swapf(lb);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lb_propagation_sparse_kernel
+ *
+ *  Pull from the source site in the table. If the source is the site
+ *  itself (p > 0), the upstream site is solid, and the link is
+ *  bounced back: f'(x, p) = f*(x, -p). The momentum transferred to
+ *  the solid is accumulated as in wall_bbl_kernel().
+ *
+ *****************************************************************************/
+
+__global__ void lb_propagation_sparse_kernel(lb_t * lb, lb_sparse_t * sparse) {
+
+  int n;
+  int tid;
+  double fxb, fyb, fzb;
+
+  __shared__ double fx[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double fy[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double fz[TARGET_MAX_THREADS_PER_BLOCK];
+
+  assert(lb);
+  assert(sparse);
+
+  tid = threadIdx.x;
+
+  fx[tid] = 0.0;
+  fy[tid] = 0.0;
+  fz[tid] = 0.0;
+
+  for_simt_parallel(n, sparse->nfluid, 1) {
+
+    int nd, p, pbar;
+    int index, indexp;
+    double fp;
+
+    index = sparse->fluid[n];
+
+    for (nd = 0; nd < lbp.ndist; nd++) {
+      for (p = 0; p < NVEL; p++) {
+
+	indexp = sparse->source[addr_rank1(sparse->nfluid, NVEL, n, p)];
+
+	if (indexp == index && p > 0) {
+	  /* Bounce-back. As w_p = w_-p, no conversion of stored value. */
+	  pbar = NVEL - p;
+	  lb->fprime[LB_ADDR(lbp.nsite, lbp.ndist, NVEL, index, nd, p)]
+	    = lb->f[LB_ADDR(lbp.nsite, lbp.ndist, NVEL, index, nd, pbar)];
+
+	  if (nd == LB_RHO) {
+	    fp = LB_F_LOAD(lb->f[LB_ADDR(lbp.nsite, lbp.ndist, NVEL, index,
+					 nd, pbar)], lbp.wv[pbar], LB_RHO);
+	    fx[tid] += (2.0*fp - 2.0*lbp.wv[pbar])*lbp.cv[pbar][X];
+	    fy[tid] += (2.0*fp - 2.0*lbp.wv[pbar])*lbp.cv[pbar][Y];
+	    fz[tid] += (2.0*fp - 2.0*lbp.wv[pbar])*lbp.cv[pbar][Z];
+	  }
+	}
+	else {
+	  lb->fprime[LB_ADDR(lbp.nsite, lbp.ndist, NVEL, index, nd, p)]
+	    = lb->f[LB_ADDR(lbp.nsite, lbp.ndist, NVEL, indexp, nd, p)];
+	}
+      }
+    }
+    /* Next fluid site */
+  }
+
+  /* Reduction for momentum transfer */
+
+  fxb = tdpAtomicBlockAddDouble(fx);
+  fyb = tdpAtomicBlockAddDouble(fy);
+  fzb = tdpAtomicBlockAddDouble(fz);
+
+  if (tid == 0) {
+    tdpAtomicAddDouble(&sparse->fnet[X], fxb);
+    tdpAtomicAddDouble(&sparse->fnet[Y], fyb);
+    tdpAtomicAddDouble(&sparse->fnet[Z], fzb);
+  }
+
+  return;
+}
+
 /*****************************************************************************
  *
  *  lb_propagation_kernel_novector
@@ -165,8 +384,8 @@ __global__ void lb_propagation_kernel(kernel_ctxt_t * ktx, lb_t * lb) {
 
   int kindex;
   int kiter;
-  double * __restrict__ f;
-  double * __restrict__ fprime;
+  lb_real_t * __restrict__ f;
+  lb_real_t * __restrict__ fprime;
 
   assert(lb);
 
@@ -213,6 +432,74 @@ __global__ void lb_propagation_kernel(kernel_ctxt_t * ktx, lb_t * lb) {
   return;
 }
 
+/*****************************************************************************
+ *
+ *  lb_propagation_aa_kernel
+ *
+ *  In the swapped order, f(x, p) is stored at x - c_p in slot -p.
+ *  If x - c_p is also a local site, the two locations are exchanged
+ *  (once, for p < -p); otherwise x - c_p is a halo site and we just
+ *  copy. Each memory location is touched by one site only.
+ *
+ *****************************************************************************/
+
+__global__ void lb_propagation_aa_kernel(kernel_ctxt_t * ktx, lb_t * lb) {
+
+  int kindex;
+  int kiter;
+
+  assert(ktx);
+  assert(lb);
+
+  kiter = kernel_iterations(ktx);
+
+  for_simt_parallel(kindex, kiter, 1) {
+
+    int n, p, pbar;
+    int ic, jc, kc;
+    int icp, jcp, kcp;
+    int index, indexp;
+    int iaddr, iaddrp;
+    int islocal;
+    lb_real_t ftmp;
+
+    ic = kernel_coords_ic(ktx, kindex);
+    jc = kernel_coords_jc(ktx, kindex);
+    kc = kernel_coords_kc(ktx, kindex);
+    index = kernel_coords_index(ktx, ic, jc, kc);
+
+    for (n = 0; n < lbp.ndist; n++) {
+      for (p = 1; p < NVEL; p++) {
+
+	pbar = NVEL - p;
+	icp = ic - lbp.cv[p][X];
+	jcp = jc - lbp.cv[p][Y];
+	kcp = kc - lbp.cv[p][Z];
+	indexp = kernel_coords_index(ktx, icp, jcp, kcp);
+
+	islocal = (icp >= 1 && icp <= coords.nlocal[X] &&
+		   jcp >= 1 && jcp <= coords.nlocal[Y] &&
+		   kcp >= 1 && kcp <= coords.nlocal[Z]);
+
+	iaddr  = LB_ADDR(lbp.nsite, lbp.ndist, NVEL, index, n, p);
+	iaddrp = LB_ADDR(lbp.nsite, lbp.ndist, NVEL, indexp, n, pbar);
+
+	if (islocal == 0) {
+	  lb->f[iaddr] = lb->f[iaddrp];
+	}
+	else if (p < pbar) {
+	  ftmp = lb->f[iaddr];
+	  lb->f[iaddr] = lb->f[iaddrp];
+	  lb->f[iaddrp] = ftmp;
+	}
+      }
+    }
+    /* Next site */
+  }
+
+  return;
+}
+
 /*****************************************************************************
  *
  *  lb_model_swapf
@@ -225,8 +512,8 @@ __global__ void lb_propagation_kernel(kernel_ctxt_t * ktx, lb_t * lb) {
 __host__ int lb_model_swapf(lb_t * lb) {
 
   int ndevice;
-  double * tmp1;
-  double * tmp2;
+  lb_real_t * tmp1;
+  lb_real_t * tmp2;
 
   assert(lb);
   assert(lb->target);
@@ -239,16 +526,34 @@ __host__ int lb_model_swapf(lb_t * lb) {
     lb->fprime = tmp1;
   }
   else {
-    tdpAssert(tdpMemcpy(&tmp1, &lb->target->f, sizeof(double *),
+    tdpAssert(tdpMemcpy(&tmp1, &lb->target->f, sizeof(lb_real_t *),
 			tdpMemcpyDeviceToHost));
-    tdpAssert(tdpMemcpy(&tmp2, &lb->target->fprime, sizeof(double *),
+    tdpAssert(tdpMemcpy(&tmp2, &lb->target->fprime, sizeof(lb_real_t *),
 			tdpMemcpyDeviceToHost)); 
 
-    tdpAssert(tdpMemcpy(&lb->target->f, &tmp2, sizeof(double *),
+    tdpAssert(tdpMemcpy(&lb->target->f, &tmp2, sizeof(lb_real_t *),
 			tdpMemcpyHostToDevice));
-    tdpAssert(tdpMemcpy(&lb->target->fprime, &tmp1, sizeof(double *),
+    tdpAssert(tdpMemcpy(&lb->target->fprime, &tmp1, sizeof(lb_real_t *),
 			tdpMemcpyHostToDevice));
   }
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  lb_propagation_work
+ *
+ *  Telemetry: each site update reads and writes every distribution.
+ *
+ *****************************************************************************/
+
+static __host__ void lb_propagation_work(lb_t * lb, double nsite) {
+
+  assert(lb);
+
+  TIMER_work(TIMER_PROP_KERNEL, nsite,
+	     2.0*nsite*NVEL*lb->ndist*sizeof(lb_real_t));
+
+  return;
+}
@@ -5,7 +5,7 @@
  *  Edinburgh Solft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2005-2017 The University of Edinburgh
+ *  (c) 2005-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *    Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -17,7 +17,11 @@
 #define LUDWIG_LB_PROPAGATION_H
 
 #include "model.h"
+#include "lb_sparse.h"
 
 __host__ int lb_propagation(lb_t * lb);
+__host__ int lb_propagation_aa_complete(lb_t * lb);
+__host__ int lb_propagation_extended(lb_t * lb, int nextra);
+__host__ int lb_propagation_sparse(lb_t * lb, lb_sparse_t * sparse);
 
 #endif
@@ -9,7 +9,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2012-2017 The University of Edinburgh
+ *  (c) 2012-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -42,7 +42,11 @@ static const int     maxits_default = 10000;            /* Default number of ite
 static const int multisteps_default = 1;                /* Default number of multisteps in NPE */
 static const int  skipsteps_default = 1;                /* Default number of skipped timesteps in Poisson solver */
 static const double diffacc_default = 0;                /* Default diffusive accuracy in NPE for constant no. of multisteps */ 
+static const int   mg_gamma_default = 1;                /* Multigrid V-cycle */
+static const int mg_nsmooth_default = 2;                /* Multigrid smoothing sweeps */
 
+static int psi_target_create(psi_t * psi);
+static int psi_target_free(psi_t * psi);
 static int psi_read(FILE * fp, int index, void * self);
 static int psi_write(FILE * fp, int index, void * self);
 static int psi_read_ascii(FILE * fp, int index, void * self);
@@ -84,11 +88,15 @@ int psi_create(pe_t * pe, cs_t * cs, int nk, psi_t ** pobj) {
   psi->rho = (double *) calloc(nk*nsites, sizeof(double));
   psi->diffusivity = (double *) calloc(nk, sizeof(double));
   psi->valency = (int *) calloc(nk, sizeof(int));
+  psi->flx = (double *) calloc(nk*(PSI_NGRAD-1)*nsites, sizeof(double));
+  psi->musolv = (double *) calloc(nk*nsites, sizeof(double));
 
   if (psi->psi == NULL) pe_fatal(pe, "Allocation of psi->psi failed\n");
   if (psi->rho == NULL) pe_fatal(pe, "Allocation of psi->rho failed\n");
   if (psi->diffusivity == NULL) pe_fatal(pe, "psi->diffusivity failed\n");
   if (psi->valency == NULL) pe_fatal(pe, "calloc(psi->valency) failed\n");
+  if (psi->flx == NULL) pe_fatal(pe, "calloc(psi->flx) failed\n");
+  if (psi->musolv == NULL) pe_fatal(pe, "calloc(psi->musolv) failed\n");
 
   psi->e = e_unit_default;
   psi->reltol = reltol_default;
@@ -97,6 +105,9 @@ int psi_create(pe_t * pe, cs_t * cs, int nk, psi_t ** pobj) {
   psi->multisteps = multisteps_default;
   psi->skipsteps = skipsteps_default;
   psi->diffacc = diffacc_default;
+  psi->solver = PSI_POISSON_SOR;
+  psi->mg_gamma = mg_gamma_default;
+  psi->mg_nsmooth = mg_nsmooth_default;
 
   psi->nfreq_io = INT_MAX;
   psi->nfreq = INT_MAX;
@@ -104,11 +115,130 @@ int psi_create(pe_t * pe, cs_t * cs, int nk, psi_t ** pobj) {
   coords_field_init_mpi_indexed(cs, nhalo, 1, MPI_DOUBLE, psi->psihalo);
   coords_field_init_mpi_indexed(cs, nhalo, psi->nk, MPI_DOUBLE, psi->rhohalo);
 
+  psi_target_create(psi);
+
   *pobj = psi; 
 
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  psi_target_create
+ *
+ *  Only the lattice quantities required by target kernels (potential,
+ *  charge densities, fluxes, solvation potential) have a target copy.
+ *
+ *****************************************************************************/
+
+static int psi_target_create(psi_t * psi) {
+
+  int ndevice;
+  int nsites;
+  int nk;
+  psi_t tmp;
+
+  assert(psi);
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice == 0) {
+    psi->target = psi;
+  }
+  else {
+    nsites = psi->nsites;
+    nk = psi->nk;
+
+    tdpAssert(tdpMalloc((void **) &psi->target, sizeof(psi_t)));
+    tdpAssert(tdpMemset(psi->target, 0, sizeof(psi_t)));
+
+    tmp = *psi;
+    tmp.target = NULL;
+    tmp.info = NULL;
+
+    tdpAssert(tdpMalloc((void **) &tmp.psi, nsites*sizeof(double)));
+    tdpAssert(tdpMalloc((void **) &tmp.rho, nk*nsites*sizeof(double)));
+    tdpAssert(tdpMalloc((void **) &tmp.flx,
+			nk*(PSI_NGRAD-1)*nsites*sizeof(double)));
+    tdpAssert(tdpMalloc((void **) &tmp.musolv, nk*nsites*sizeof(double)));
+    tmp.diffusivity = NULL;
+    tmp.valency = NULL;
+
+    tdpAssert(tdpMemcpy(psi->target, &tmp, sizeof(psi_t),
+			tdpMemcpyHostToDevice));
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_target_free
+ *
+ *****************************************************************************/
+
+static int psi_target_free(psi_t * psi) {
+
+  psi_t tmp;
+
+  assert(psi);
+  assert(psi->target != psi);
+
+  tdpAssert(tdpMemcpy(&tmp, psi->target, sizeof(psi_t),
+		      tdpMemcpyDeviceToHost));
+  tdpFree(tmp.musolv);
+  tdpFree(tmp.flx);
+  tdpFree(tmp.rho);
+  tdpFree(tmp.psi);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_memcpy
+ *
+ *  Host to target copies the potential, the charge densities, and
+ *  the solvation potential; target to host returns the densities.
+ *
+ *****************************************************************************/
+
+__host__ int psi_memcpy(psi_t * psi, tdpMemcpyKind flag) {
+
+  int ndevice;
+
+  assert(psi);
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice == 0) {
+    assert(psi->target == psi);
+  }
+  else {
+    int nsites = psi->nsites;
+    int nk = psi->nk;
+    psi_t tmp;
+
+    tdpAssert(tdpMemcpy(&tmp, psi->target, sizeof(psi_t),
+			tdpMemcpyDeviceToHost));
+
+    switch (flag) {
+    case tdpMemcpyHostToDevice:
+      tdpMemcpy(tmp.psi, psi->psi, nsites*sizeof(double), flag);
+      tdpMemcpy(tmp.rho, psi->rho, nk*nsites*sizeof(double), flag);
+      tdpMemcpy(tmp.musolv, psi->musolv, nk*nsites*sizeof(double), flag);
+      break;
+    case tdpMemcpyDeviceToHost:
+      tdpMemcpy(psi->rho, tmp.rho, nk*nsites*sizeof(double), flag);
+      break;
+    default:
+      pe_fatal(psi->pe, "Bad flag in psi_memcpy\n");
+    }
+  }
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  psi_io_info
@@ -303,6 +433,13 @@ void psi_free(psi_t * obj) {
 
   if (obj->info) io_info_free(obj->info);
 
+  if (obj->target != obj) {
+    psi_target_free(obj);
+    tdpFree(obj->target);
+  }
+
+  free(obj->musolv);
+  free(obj->flx);
   free(obj->valency);
   free(obj->diffusivity);
   free(obj->rho);
@@ -988,6 +1125,39 @@ int psi_diffacc_set(psi_t * obj, double diffacc) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  psi_np_fused_set
+ *
+ *  Select the fused Nernst-Planck flux and update (flag = 1).
+ *
+ *****************************************************************************/
+
+int psi_np_fused_set(psi_t * obj, int flag) {
+
+  assert(obj);
+
+  obj->npfused = flag;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_np_fused
+ *
+ *****************************************************************************/
+
+int psi_np_fused(psi_t * obj, int * flag) {
+
+  assert(obj);
+  assert(flag);
+
+  *flag = obj->npfused;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  psi_diffacc
@@ -1317,6 +1487,77 @@ int psi_nfreq_set(psi_t * psi, int nfreq) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  psi_solver_set
+ *
+ *****************************************************************************/
+
+int psi_solver_set(psi_t * obj, int solver) {
+
+  assert(obj);
+  assert(solver == PSI_POISSON_SOR || solver == PSI_POISSON_MULTIGRID);
+
+  obj->solver = solver;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_solver
+ *
+ *****************************************************************************/
+
+int psi_solver(psi_t * obj, int * solver) {
+
+  assert(obj);
+  assert(solver);
+
+  *solver = obj->solver;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_multigrid_set
+ *
+ *  gamma is 1 for V-cycles, 2 for W-cycles; nsmooth is the number of
+ *  pre- and post-smoothing sweeps.
+ *
+ *****************************************************************************/
+
+int psi_multigrid_set(psi_t * obj, int gamma, int nsmooth) {
+
+  assert(obj);
+  assert(gamma == 1 || gamma == 2);
+  assert(nsmooth > 0);
+
+  obj->mg_gamma = gamma;
+  obj->mg_nsmooth = nsmooth;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_multigrid
+ *
+ *****************************************************************************/
+
+int psi_multigrid(psi_t * obj, int * gamma, int * nsmooth) {
+
+  assert(obj);
+  assert(gamma);
+  assert(nsmooth);
+
+  *gamma = obj->mg_gamma;
+  *nsmooth = obj->mg_nsmooth;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  psi_output_step
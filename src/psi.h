@@ -8,7 +8,7 @@
  *  Edinburgh Parallel Computing Centre
  *
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
- *  (c) 2012 The University of Edinburgh
+ *  (c) 2012-2019 The University of Edinburgh
  *
  *****************************************************************************/
 
@@ -34,6 +34,12 @@ enum psi_force_method {PSI_FORCE_NONE = 0,
 		       PSI_FORCE_NTYPES
 };
 
+/* Poisson solver */
+
+enum psi_solver_type {PSI_POISSON_SOR = 0,
+		      PSI_POISSON_MULTIGRID
+};
+
 typedef struct psi_s psi_t;
 
 /* f_vare_t describes the signature of the function expected
@@ -41,6 +47,7 @@ typedef struct psi_s psi_t;
 typedef int (* f_vare_t)(void * fe, int index, double * epsilon);
 
 int psi_create(pe_t * pe, cs_t * cs, int nk, psi_t ** pobj);
+__host__ int psi_memcpy(psi_t * psi, tdpMemcpyKind flag);
 void psi_free(psi_t * obj);
 int psi_init_io_info(psi_t * obj, int grid[3], int form_in, int form_out);
 int psi_io_info(psi_t * obj, io_info_t ** info);
@@ -81,6 +88,10 @@ int psi_reltol_set(psi_t * obj, double reltol);
 int psi_abstol_set(psi_t * obj, double abstol);
 int psi_maxits_set(psi_t * obj, int maxits);
 int psi_nfreq_set(psi_t * psi, int nfreq);
+int psi_solver(psi_t * obj, int * solver);
+int psi_solver_set(psi_t * obj, int solver);
+int psi_multigrid(psi_t * obj, int * gamma, int * nsmooth);
+int psi_multigrid_set(psi_t * obj, int gamma, int nsmooth);
 int psi_output_step(psi_t * psi);
 
 int psi_multisteps(psi_t * obj, int * multisteps);
@@ -88,6 +99,8 @@ int psi_multisteps_set(psi_t * obj, int multisteps);
 int psi_multistep_timestep(psi_t * obj, double * dt);
 int psi_diffacc(psi_t * obj, double * diffacc);
 int psi_diffacc_set(psi_t * obj, double diffacc);
+int psi_np_fused(psi_t * obj, int * flag);
+int psi_np_fused_set(psi_t * obj, int flag);
 int psi_skipsteps(psi_t * obj);
 int psi_skipsteps_set(psi_t * obj, double skipsteps);
 int psi_zero_mean(psi_t * obj);
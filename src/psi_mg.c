@@ -0,0 +1,1453 @@
+/*****************************************************************************
+ *
+ *  psi_mg.c
+ *
+ *  Geometric multigrid solution of the Poisson equation for the
+ *  potential (an alternative to psi_sor.c). Both the uniform
+ *
+ *    epsilon nabla^2 \psi = - rho_elec
+ *
+ *  and the variable permittivity case
+ *
+ *    div [epsilon(r) grad psi(r) ] = -rho(r)
+ *
+ *  are treated using exactly the same seven-point discretisation as
+ *  the SOR solver, and the same residual norm and tolerances decide
+ *  termination. The iteration is a sequence of V-cycles (or W-cycles)
+ *  with a red-black Gauss-Seidel smoother.
+ *
+ *  The hierarchy of grids is formed by coarsening by a factor of two
+ *  in each direction where the local domain allows it. Each grid has
+ *  its own coordinate system, with a halo of width one, so that the
+ *  usual halo swap and kernel context infrastructure may be used at
+ *  all levels. Directions which cannot be coarsened further are left
+ *  alone (semi-coarsening), and the operator takes account of the
+ *  different grid spacing in each direction. See psi_mg_coarsen().
+ *
+ *  When the local domains can no longer be coarsened in parallel, the
+ *  coarse problem is agglomerated: the whole grid is gathered to all
+ *  ranks and the remaining (coarser) levels are treated redundantly
+ *  by each rank without further communication.
+ *
+ *  Restriction is by averaging over the fine cells which make up a
+ *  coarse cell; prolongation is by linear interpolation. The coarse
+ *  operator is re-discretised, with the permittivity (if required)
+ *  restricted in the same way as the residual.
+ *
+ *  Boundary conditions follow psi_halo_psijump(): at the finest level
+ *  the potential includes the jump associated with any external field
+ *  in periodic directions; in non-periodic directions the halo takes
+ *  the adjacent value. The coarse grid corrections have the same
+ *  (homogeneous) conditions.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pe.h"
+#include "coords.h"
+#include "kernel.h"
+#include "halo_swap.h"
+#include "physics.h"
+#include "util.h"
+#include "psi_s.h"
+#include "psi_mg.h"
+
+#define PSI_MG_LEVEL_MAX 32   /* Maximum depth of hierarchy */
+#define PSI_MG_NCOARSE   50   /* Minimum sweeps at the coarsest level */
+
+typedef struct psi_mg_level_s psi_mg_level_t;
+
+struct psi_mg_level_s {
+  pe_t * pe;                  /* Parallel environment for this level */
+  cs_t * cs;                  /* Coordinate system for this level */
+  halo_swap_t * halo;         /* Halo swap (width one) */
+  int nsites;                 /* Sites including halo */
+  int nhalo;                  /* Halo width of the coordinate system */
+  int nlocal[3];
+  int noffset[3];
+  int ntotal[3];
+  int str[3];                 /* Memory strides */
+  int coarsen[3];             /* Direction coarsened for next level */
+  int gather;                 /* Next level is agglomerated copy of this */
+  int replicated;             /* Level is held in full by all ranks */
+  int hasjump;                /* u is the potential (not a correction) */
+  double rh2[3];              /* 1/h^2 for each direction */
+  double epsilon;             /* Uniform permittivity (if eps is NULL) */
+  double * u;                 /* Solution or correction */
+  double * f;                 /* Right hand side */
+  double * r;                 /* Residual */
+  double * eps;               /* Permittivity (variable case) */
+  psi_mg_level_t * target;    /* Target copy */
+};
+
+struct psi_mg_s {
+  pe_t * pe;
+  psi_t * psi;
+  int nlevel;                 /* Number of levels */
+  int gamma;                  /* 1 for V-cycle, 2 for W-cycle */
+  int nsmooth;                /* Pre- and post-smoothing sweeps */
+  int ncoarse;                /* Sweeps at the coarsest level */
+  int nrank;                  /* Number of ranks for agglomeration */
+  int nmaxblock;              /* Maximum local sites (agglomeration) */
+  int * rankoffset;           /* Offsets of all ranks [nrank][3] */
+  int * ranknlocal;           /* Local extents of all ranks [nrank][3] */
+  double * sbuf;              /* Agglomeration send buffer */
+  double * rbuf;              /* Agglomeration receive buffer */
+  double * hbuf[2];           /* Host copies of level arrays */
+  psi_mg_level_t level[PSI_MG_LEVEL_MAX];
+};
+
+static __device__ double rnorm_d;
+
+static __host__ int psi_mg_level_create(psi_mg_t * mg, pe_t * pe,
+					const int ntotal[3], int replicated,
+					psi_mg_level_t * lev);
+static __host__ int psi_mg_level_arrays(psi_mg_level_t * lev, int haseps);
+static __host__ int psi_mg_level_commit(psi_mg_level_t * lev);
+static __host__ int psi_mg_level_free(psi_mg_level_t * lev, int ownscs);
+static __host__ int psi_mg_coarsen(psi_mg_level_t * lev,
+				   const int cartsz[3], int coarsen[3]);
+static __host__ int psi_mg_cycle(psi_mg_t * mg, int l);
+static __host__ int psi_mg_smooth(psi_mg_t * mg, int l, int nsweep);
+static __host__ int psi_mg_residual(psi_mg_t * mg, int l, double * rnorm);
+static __host__ int psi_mg_restrict(psi_mg_t * mg, int l, double * fine,
+				    double * coarse);
+static __host__ int psi_mg_prolong(psi_mg_t * mg, int l);
+static __host__ int psi_mg_halo(psi_mg_t * mg, int l, double * data,
+				int jump);
+static __host__ int psi_mg_gather(psi_mg_t * mg, int l, double * src,
+				  double * dst);
+static __host__ int psi_mg_scatter(psi_mg_t * mg, int l, double * src,
+				   double * dst);
+static __host__ int psi_mg_launch_limits(psi_mg_level_t * lev,
+					 kernel_info_t * limits);
+
+__global__ void psi_mg_smooth_kernel(kernel_ctxt_t * ktx,
+				     psi_mg_level_t * lev, int colour);
+__global__ void psi_mg_residual_kernel(kernel_ctxt_t * ktx,
+				       psi_mg_level_t * lev, double * rnorm);
+__global__ void psi_mg_restrict_kernel(kernel_ctxt_t * ktx,
+				       psi_mg_level_t * fine,
+				       psi_mg_level_t * coarse,
+				       double * src, double * dst);
+__global__ void psi_mg_prolong_kernel(kernel_ctxt_t * ktx,
+				      psi_mg_level_t * fine,
+				      psi_mg_level_t * coarse);
+__global__ void psi_mg_bc_kernel(kernel_ctxt_t * ktx, psi_mg_level_t * lev,
+				 double * data, int dim, int side,
+				 double jump);
+
+/*****************************************************************************
+ *
+ *  psi_mg_index
+ *
+ *****************************************************************************/
+
+static __host__ __device__ int psi_mg_index(const psi_mg_level_t * lev,
+					    int ic, int jc, int kc) {
+  assert(lev);
+
+  return lev->str[X]*(lev->nhalo + ic - 1) + lev->str[Y]*(lev->nhalo + jc - 1)
+    + lev->str[Z]*(lev->nhalo + kc - 1);
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_operator
+ *
+ *  Seven-point stencil at site index: returns the operator applied
+ *  to u and the diagonal element of the operator. With unit grid
+ *  spacing this is exactly the stencil of psi_sor.c.
+ *
+ *****************************************************************************/
+
+static __host__ __device__ void psi_mg_operator(const psi_mg_level_t * lev,
+						int index, double * au,
+						double * diag) {
+  int ia;
+  double eps0, deps, du;
+  double lap = 0.0;
+  double grad = 0.0;
+  double rsum = 0.0;
+
+  for (ia = 0; ia < 3; ia++) {
+    int up = index + lev->str[ia];
+    int dn = index - lev->str[ia];
+    lap += lev->rh2[ia]*(lev->u[addr_rank0(lev->nsites, up)]
+			 + lev->u[addr_rank0(lev->nsites, dn)]
+			 - 2.0*lev->u[addr_rank0(lev->nsites, index)]);
+    rsum += lev->rh2[ia];
+    if (lev->eps) {
+      deps = lev->eps[addr_rank0(lev->nsites, up)]
+	   - lev->eps[addr_rank0(lev->nsites, dn)];
+      du   = lev->u[addr_rank0(lev->nsites, up)]
+	   - lev->u[addr_rank0(lev->nsites, dn)];
+      grad += 0.25*lev->rh2[ia]*deps*du;
+    }
+  }
+
+  eps0 = lev->epsilon;
+  if (lev->eps) eps0 = lev->eps[addr_rank0(lev->nsites, index)];
+
+  *au = eps0*lap + grad;
+  *diag = -2.0*eps0*rsum;
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_create
+ *
+ *  Set up the hierarchy for the psi_t coordinate system. The finest
+ *  level shares the psi_t coordinate system (and so the indexing of
+ *  psi and rho).
+ *
+ *****************************************************************************/
+
+__host__ int psi_mg_create(psi_t * psi, psi_mg_t ** pobj) {
+
+  int l;
+  int ia;
+  int coarsen[3];
+  int nmaxblock;
+  int nmaxsites;
+  int cartsz[3];
+  int ntotal[3];
+  MPI_Comm comm;
+  pe_t * pe = NULL;
+  psi_mg_t * mg = NULL;
+
+  assert(psi);
+  assert(pobj);
+
+  mg = (psi_mg_t *) calloc(1, sizeof(psi_mg_t));
+  assert(mg);
+  if (mg == NULL) pe_fatal(psi->pe, "calloc(psi_mg_t) failed\n");
+
+  mg->pe = psi->pe;
+  mg->psi = psi;
+  mg->gamma = psi->mg_gamma;
+  mg->nsmooth = psi->mg_nsmooth;
+
+  cs_cartsz(psi->cs, cartsz);
+  cs_cart_comm(psi->cs, &comm);
+  MPI_Comm_size(comm, &mg->nrank);
+
+  /* Finest level */
+
+  mg->level[0].pe = psi->pe;
+  mg->level[0].cs = psi->cs;
+  cs_ntotal(psi->cs, ntotal);
+  psi_mg_level_create(mg, psi->pe, ntotal, 0, &mg->level[0]);
+  mg->level[0].hasjump = 1;
+  mg->level[0].rh2[X] = 1.0;
+  mg->level[0].rh2[Y] = 1.0;
+  mg->level[0].rh2[Z] = 1.0;
+
+  /* Coarse levels distributed over the same Cartesian decomposition.
+   * A separate pe_t (without reordering) retains the rank layout. */
+
+  pe_create(comm, PE_QUIET, &pe);
+
+  for (l = 0; l < PSI_MG_LEVEL_MAX - 1; l++) {
+
+    psi_mg_level_t * lev = mg->level + l;
+    int replicated = lev->replicated;
+
+    if (replicated) {
+      int one[3] = {1, 1, 1};
+      psi_mg_coarsen(lev, one, coarsen);
+    }
+    else {
+      psi_mg_coarsen(lev, cartsz, coarsen);
+    }
+
+    if (coarsen[X] + coarsen[Y] + coarsen[Z] == 0) {
+
+      /* Agglomerate (if it is worth it), or stop */
+      int one[3] = {1, 1, 1};
+      if (replicated || mg->nrank == 1) break;
+      psi_mg_coarsen(lev, one, coarsen);
+      if (coarsen[X] + coarsen[Y] + coarsen[Z] == 0) break;
+
+      lev->gather = 1;
+      lev->coarsen[X] = 0; lev->coarsen[Y] = 0; lev->coarsen[Z] = 0;
+      {
+	pe_t * pself = NULL;
+	pe_create(MPI_COMM_SELF, PE_QUIET, &pself);
+	psi_mg_level_create(mg, pself, lev->ntotal, 1, mg->level + l + 1);
+	pe_free(pself);
+      }
+      mg->level[l+1].hasjump = lev->hasjump;
+      for (ia = 0; ia < 3; ia++) mg->level[l+1].rh2[ia] = lev->rh2[ia];
+    }
+    else {
+      for (ia = 0; ia < 3; ia++) {
+	lev->coarsen[ia] = coarsen[ia];
+	ntotal[ia] = lev->ntotal[ia] / (1 + coarsen[ia]);
+      }
+      psi_mg_level_create(mg, (replicated) ? lev->pe : pe, ntotal,
+			  replicated, mg->level + l + 1);
+      for (ia = 0; ia < 3; ia++) {
+	/* A direction coarsened to one point drops out of the stencil */
+	mg->level[l+1].rh2[ia] = lev->rh2[ia]/(1 + 3*coarsen[ia]);
+	if (coarsen[ia] && ntotal[ia] == 1) mg->level[l+1].rh2[ia] = 0.0;
+      }
+    }
+  }
+
+  mg->nlevel = l + 1;
+  pe_free(pe);
+
+  /* The coarsest level is not necessarily small; the number of sweeps
+   * there must reflect its extent. */
+
+  {
+    psi_mg_level_t * last = mg->level + mg->nlevel - 1;
+    int nmax = imax(last->ntotal[X], imax(last->ntotal[Y], last->ntotal[Z]));
+    mg->ncoarse = imax(PSI_MG_NCOARSE, nmax*nmax);
+  }
+
+  nmaxsites = 0;
+
+  for (l = 0; l < mg->nlevel; l++) {
+    psi_mg_level_arrays(mg->level + l, 0);
+    psi_mg_level_commit(mg->level + l);
+    if (mg->level[l].nsites > nmaxsites) nmaxsites = mg->level[l].nsites;
+  }
+
+  /* Agglomeration information */
+
+  mg->rankoffset = (int *) calloc(3*mg->nrank, sizeof(int));
+  mg->ranknlocal = (int *) calloc(3*mg->nrank, sizeof(int));
+  assert(mg->rankoffset);
+  assert(mg->ranknlocal);
+  if (mg->rankoffset == NULL) pe_fatal(psi->pe, "calloc(rankoffset)\n");
+  if (mg->ranknlocal == NULL) pe_fatal(psi->pe, "calloc(ranknlocal)\n");
+
+  nmaxblock = 0;
+
+  for (l = 0; l < mg->nlevel; l++) {
+    psi_mg_level_t * lev = mg->level + l;
+    if (lev->gather) {
+      int nblock = lev->nlocal[X]*lev->nlocal[Y]*lev->nlocal[Z];
+      MPI_Allreduce(&nblock, &nmaxblock, 1, MPI_INT, MPI_MAX, comm);
+      MPI_Allgather(lev->noffset, 3, MPI_INT, mg->rankoffset, 3, MPI_INT,
+		    comm);
+      MPI_Allgather(lev->nlocal, 3, MPI_INT, mg->ranknlocal, 3, MPI_INT,
+		    comm);
+    }
+  }
+
+  mg->nmaxblock = nmaxblock;
+
+  if (nmaxblock > 0) {
+    mg->sbuf = (double *) malloc(nmaxblock*sizeof(double));
+    mg->rbuf = (double *) malloc(mg->nrank*nmaxblock*sizeof(double));
+    assert(mg->sbuf);
+    assert(mg->rbuf);
+    if (mg->sbuf == NULL) pe_fatal(psi->pe, "malloc(mg->sbuf) failed\n");
+    if (mg->rbuf == NULL) pe_fatal(psi->pe, "malloc(mg->rbuf) failed\n");
+  }
+
+  mg->hbuf[0] = (double *) malloc(nmaxsites*sizeof(double));
+  mg->hbuf[1] = (double *) malloc(nmaxsites*sizeof(double));
+  assert(mg->hbuf[0]);
+  assert(mg->hbuf[1]);
+  if (mg->hbuf[0] == NULL) pe_fatal(psi->pe, "malloc(mg->hbuf) failed\n");
+  if (mg->hbuf[1] == NULL) pe_fatal(psi->pe, "malloc(mg->hbuf) failed\n");
+
+  *pobj = mg;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_free
+ *
+ *****************************************************************************/
+
+__host__ int psi_mg_free(psi_mg_t * mg) {
+
+  int l;
+
+  assert(mg);
+
+  for (l = 0; l < mg->nlevel; l++) {
+    psi_mg_level_free(mg->level + l, (l > 0));
+  }
+
+  free(mg->hbuf[1]);
+  free(mg->hbuf[0]);
+  free(mg->rbuf);
+  free(mg->sbuf);
+  free(mg->ranknlocal);
+  free(mg->rankoffset);
+  free(mg);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_info
+ *
+ *****************************************************************************/
+
+__host__ int psi_mg_info(psi_mg_t * mg) {
+
+  int l;
+
+  assert(mg);
+
+  pe_info(mg->pe, "Multigrid cycle:           %s-cycle\n",
+	  (mg->gamma == 1) ? "V" : "W");
+  pe_info(mg->pe, "Multigrid smoothing:       %d (pre) %d (post)\n",
+	  mg->nsmooth, mg->nsmooth);
+  pe_info(mg->pe, "Multigrid levels:          %d\n", mg->nlevel);
+
+  for (l = 0; l < mg->nlevel; l++) {
+    psi_mg_level_t * lev = mg->level + l;
+    pe_info(mg->pe, "Level %2d: %4d %4d %4d %s\n", l, lev->ntotal[X],
+	    lev->ntotal[Y], lev->ntotal[Z],
+	    (lev->replicated) ? "(agglomerated)" : "");
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_nlevel
+ *
+ *****************************************************************************/
+
+__host__ int psi_mg_nlevel(psi_mg_t * mg, int * nlevel) {
+
+  assert(mg);
+  assert(nlevel);
+
+  *nlevel = mg->nlevel;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_solve
+ *
+ *  If fepsilon is NULL, the uniform permittivity problem is solved;
+ *  if it is present, the variable permittivity problem is solved.
+ *
+ *  The residual is checked after each cycle against the absolute
+ *  and relative tolerances (as for SOR); the number of cycles is
+ *  limited by the maximum number of iterations.
+ *
+ *****************************************************************************/
+
+__host__ int psi_mg_solve(psi_mg_t * mg, fe_t * fe, f_vare_t fepsilon) {
+
+  int ic, jc, kc, index;
+  int l, n;
+  int niteration;
+  double rho_elec;
+  double eunit, beta;
+  double tol_rel, tol_abs;
+  double rnorm[2];
+  double ltot[3];
+  physics_t * phys = NULL;
+  psi_t * psi = NULL;
+  psi_mg_level_t * lev0 = NULL;
+  MPI_Comm comm;
+
+  assert(mg);
+
+  psi = mg->psi;
+  lev0 = mg->level;
+
+  physics_ref(&phys);
+  cs_ltot(psi->cs, ltot);
+  cs_cart_comm(psi->cs, &comm);
+
+  psi_reltol(psi, &tol_rel);
+  psi_abstol(psi, &tol_abs);
+  psi_maxits(psi, &niteration);
+  psi_beta(psi, &beta);
+  psi_unit_charge(psi, &eunit);
+
+  /* Permittivity at all levels */
+
+  for (l = 0; l < mg->nlevel; l++) {
+    psi_epsilon(psi, &mg->level[l].epsilon);
+    if (fepsilon && mg->level[l].eps == NULL) {
+      psi_mg_level_arrays(mg->level + l, 1);
+    }
+    if (fepsilon == NULL && mg->level[l].eps) {
+      tdpFree(mg->level[l].eps);
+      mg->level[l].eps = NULL;
+    }
+    psi_mg_level_commit(mg->level + l);
+  }
+
+  if (fepsilon) {
+
+    for (ic = 0; ic <= lev0->nlocal[X] + 1; ic++) {
+      for (jc = 0; jc <= lev0->nlocal[Y] + 1; jc++) {
+	for (kc = 0; kc <= lev0->nlocal[Z] + 1; kc++) {
+	  index = cs_index(psi->cs, ic, jc, kc);
+	  fepsilon(fe, index, mg->hbuf[0] + addr_rank0(lev0->nsites, index));
+	}
+      }
+    }
+    tdpMemcpy(lev0->eps, mg->hbuf[0], lev0->nsites*sizeof(double),
+	      tdpMemcpyHostToDevice);
+
+    for (l = 0; l < mg->nlevel - 1; l++) {
+      if (mg->level[l].gather) {
+	psi_mg_gather(mg, l, mg->level[l].eps, mg->level[l+1].eps);
+      }
+      else {
+	psi_mg_restrict(mg, l, mg->level[l].eps, mg->level[l+1].eps);
+      }
+      psi_mg_halo(mg, l + 1, mg->level[l+1].eps, 0);
+    }
+  }
+
+  /* Right hand side and initial guess at the finest level */
+
+  for (ic = 1; ic <= lev0->nlocal[X]; ic++) {
+    for (jc = 1; jc <= lev0->nlocal[Y]; jc++) {
+      for (kc = 1; kc <= lev0->nlocal[Z]; kc++) {
+	index = cs_index(psi->cs, ic, jc, kc);
+	psi_rho_elec(psi, index, &rho_elec);
+	/* Non-dimensional potential in Poisson eqn requires e/kT */
+	mg->hbuf[0][addr_rank0(lev0->nsites, index)] = -eunit*beta*rho_elec;
+      }
+    }
+  }
+
+  tdpMemcpy(lev0->f, mg->hbuf[0], lev0->nsites*sizeof(double),
+	    tdpMemcpyHostToDevice);
+  tdpMemcpy(lev0->u, psi->psi, lev0->nsites*sizeof(double),
+	    tdpMemcpyHostToDevice);
+  psi_mg_halo(mg, 0, lev0->u, 1);
+
+  psi_mg_residual(mg, 0, rnorm);
+  MPI_Allreduce(MPI_IN_PLACE, rnorm, 1, MPI_DOUBLE, MPI_SUM, comm);
+
+  for (n = 0; n < niteration; n++) {
+
+    psi_mg_cycle(mg, 0);
+
+    psi_mg_residual(mg, 0, rnorm + 1);
+    MPI_Allreduce(MPI_IN_PLACE, rnorm + 1, 1, MPI_DOUBLE, MPI_SUM, comm);
+
+    if (rnorm[1] < tol_abs) {
+
+      if (physics_control_timestep(phys) % psi->nfreq == 0) {
+	pe_info(psi->pe, "\n");
+	pe_info(psi->pe, "Multigrid solver converged to absolute tolerance\n");
+	pe_info(psi->pe, "Multigrid residual per site %14.7e at %d cycles\n",
+		rnorm[1]/(ltot[X]*ltot[Y]*ltot[Z]), n);
+      }
+      break;
+    }
+
+    if (rnorm[1] < tol_rel*rnorm[0]) {
+
+      if (physics_control_timestep(phys) % psi->nfreq == 0) {
+	pe_info(psi->pe, "\n");
+	pe_info(psi->pe, "Multigrid solver converged to relative tolerance\n");
+	pe_info(psi->pe, "Multigrid residual per site %14.7e at %d cycles\n",
+		rnorm[1]/(ltot[X]*ltot[Y]*ltot[Z]), n);
+      }
+      break;
+    }
+
+    if (n == niteration-1) {
+      pe_info(psi->pe, "\n");
+      pe_info(psi->pe, "Multigrid solver exceeded %d cycles\n", n+1);
+      pe_info(psi->pe, "Multigrid residual %le (initial) %le (final)\n\n",
+	      rnorm[0], rnorm[1]);
+    }
+  }
+
+  /* Solution back to psi (with full halo) */
+
+  tdpMemcpy(psi->psi, lev0->u, lev0->nsites*sizeof(double),
+	    tdpMemcpyDeviceToHost);
+  psi_halo_psi(psi);
+  psi_halo_psijump(psi);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_cycle
+ *
+ *  One cycle starting at level l, where u holds the current estimate
+ *  (halo up-to-date) and f the right hand side.
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_cycle(psi_mg_t * mg, int l) {
+
+  int ig;
+  psi_mg_level_t * lev = NULL;
+  psi_mg_level_t * next = NULL;
+
+  assert(mg);
+  assert(0 <= l && l < mg->nlevel);
+
+  lev = mg->level + l;
+
+  if (l == mg->nlevel - 1) {
+    psi_mg_smooth(mg, l, mg->ncoarse);
+    return 0;
+  }
+
+  next = mg->level + l + 1;
+
+  if (lev->gather) {
+    /* Agglomerate; the next level is the same problem */
+    psi_mg_gather(mg, l, lev->f, next->f);
+    psi_mg_gather(mg, l, lev->u, next->u);
+    psi_mg_halo(mg, l + 1, next->u, next->hasjump);
+    psi_mg_cycle(mg, l + 1);
+    psi_mg_scatter(mg, l, next->u, lev->u);
+    psi_mg_halo(mg, l, lev->u, lev->hasjump);
+    return 0;
+  }
+
+  psi_mg_smooth(mg, l, mg->nsmooth);
+  psi_mg_residual(mg, l, NULL);
+  psi_mg_restrict(mg, l, lev->r, next->f);
+  tdpMemset(next->u, 0, next->nsites*sizeof(double));
+
+  for (ig = 0; ig < mg->gamma; ig++) {
+    psi_mg_cycle(mg, l + 1);
+  }
+
+  psi_mg_prolong(mg, l);
+  psi_mg_halo(mg, l, lev->u, lev->hasjump);
+  psi_mg_smooth(mg, l, mg->nsmooth);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_smooth
+ *
+ *  Red-black Gauss-Seidel; the colour is that of the global position
+ *  so is independent of decomposition. The halo is swapped after
+ *  each colour.
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_smooth(psi_mg_t * mg, int l, int nsweep) {
+
+  int n, colour;
+  dim3 nblk, ntpb;
+  kernel_info_t limits;
+  kernel_ctxt_t * ctxt = NULL;
+  psi_mg_level_t * lev = NULL;
+
+  assert(mg);
+
+  lev = mg->level + l;
+
+  psi_mg_launch_limits(lev, &limits);
+  kernel_ctxt_create(lev->cs, 1, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+  for (n = 0; n < nsweep; n++) {
+    for (colour = 0; colour < 2; colour++) {
+
+      tdpLaunchKernel(psi_mg_smooth_kernel, nblk, ntpb, 0, 0,
+		      ctxt->target, lev->target, colour);
+
+      tdpAssert(tdpPeekAtLastError());
+      tdpAssert(tdpDeviceSynchronize());
+
+      psi_mg_halo(mg, l, lev->u, lev->hasjump);
+    }
+  }
+
+  kernel_ctxt_free(ctxt);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_residual
+ *
+ *  Compute r = f - Au at level l. If rnorm is not NULL, the local
+ *  sum of |r| is returned.
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_residual(psi_mg_t * mg, int l, double * rnorm) {
+
+  double rlocal = 0.0;
+  double * rnormd = NULL;
+
+  dim3 nblk, ntpb;
+  kernel_info_t limits;
+  kernel_ctxt_t * ctxt = NULL;
+  psi_mg_level_t * lev = NULL;
+
+  assert(mg);
+
+  lev = mg->level + l;
+
+  psi_mg_launch_limits(lev, &limits);
+  kernel_ctxt_create(lev->cs, 1, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+  tdpGetSymbolAddress((void **) &rnormd, tdpSymbol(rnorm_d));
+  tdpAssert(tdpMemcpy(rnormd, &rlocal, sizeof(double),
+		      tdpMemcpyHostToDevice));
+
+  tdpLaunchKernel(psi_mg_residual_kernel, nblk, ntpb, 0, 0,
+		  ctxt->target, lev->target, rnormd);
+
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  tdpAssert(tdpMemcpy(&rlocal, rnormd, sizeof(double),
+		      tdpMemcpyDeviceToHost));
+
+  if (rnorm) *rnorm = rlocal;
+
+  kernel_ctxt_free(ctxt);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_restrict
+ *
+ *  Average the fine array over the cells forming each coarse cell.
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_restrict(psi_mg_t * mg, int l, double * fine,
+				    double * coarse) {
+  dim3 nblk, ntpb;
+  kernel_info_t limits;
+  kernel_ctxt_t * ctxt = NULL;
+  psi_mg_level_t * next = NULL;
+
+  assert(mg);
+  assert(l < mg->nlevel - 1);
+
+  next = mg->level + l + 1;
+
+  psi_mg_launch_limits(next, &limits);
+  kernel_ctxt_create(next->cs, 1, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+  tdpLaunchKernel(psi_mg_restrict_kernel, nblk, ntpb, 0, 0,
+		  ctxt->target, mg->level[l].target, next->target,
+		  fine, coarse);
+
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  kernel_ctxt_free(ctxt);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_prolong
+ *
+ *  Add the interpolated correction from level l + 1 to level l.
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_prolong(psi_mg_t * mg, int l) {
+
+  dim3 nblk, ntpb;
+  kernel_info_t limits;
+  kernel_ctxt_t * ctxt = NULL;
+  psi_mg_level_t * lev = NULL;
+
+  assert(mg);
+  assert(l < mg->nlevel - 1);
+
+  lev = mg->level + l;
+
+  /* Correction requires coarse halo */
+  psi_mg_halo(mg, l + 1, mg->level[l+1].u, 0);
+
+  psi_mg_launch_limits(lev, &limits);
+  kernel_ctxt_create(lev->cs, 1, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+  tdpLaunchKernel(psi_mg_prolong_kernel, nblk, ntpb, 0, 0,
+		  ctxt->target, lev->target, mg->level[l+1].target);
+
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  kernel_ctxt_free(ctxt);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_halo
+ *
+ *  Halo swap for array data at level l, followed by the boundary
+ *  conditions at the edge of the global domain. If jump is set, the
+ *  potential jump for the external field is included (finest level
+ *  potential only).
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_halo(psi_mg_t * mg, int l, double * data,
+				int jump) {
+  int ia, side;
+  int cartsz[3];
+  int cartcoords[3];
+  int periodic[3];
+  double e0[3] = {0.0, 0.0, 0.0};
+  physics_t * phys = NULL;
+  psi_mg_level_t * lev = NULL;
+
+  assert(mg);
+
+  lev = mg->level + l;
+
+  halo_swap_packed(lev->halo, data);
+
+  cs_periodic(mg->psi->cs, periodic);
+  cs_cartsz(lev->cs, cartsz);
+  cs_cart_coords(lev->cs, cartcoords);
+
+  if (jump) {
+    physics_ref(&phys);
+    physics_e0(phys, e0);
+  }
+
+  for (ia = 0; ia < 3; ia++) {
+    for (side = 0; side < 2; side++) {
+
+      dim3 nblk, ntpb;
+      kernel_info_t limits;
+      kernel_ctxt_t * ctxt = NULL;
+      double value = 0.0;
+
+      if (side == 0 && cartcoords[ia] != 0) continue;
+      if (side == 1 && cartcoords[ia] != cartsz[ia] - 1) continue;
+      if (periodic[ia]) {
+	if (e0[ia] == 0.0) continue;
+	value = (side == 0) ? +e0[ia]*lev->ntotal[ia] : -e0[ia]*lev->ntotal[ia];
+      }
+
+      /* The plane of halo points, including the halo in other directions */
+
+      limits.imin = 0; limits.imax = lev->nlocal[X] + 1;
+      limits.jmin = 0; limits.jmax = lev->nlocal[Y] + 1;
+      limits.kmin = 0; limits.kmax = lev->nlocal[Z] + 1;
+
+      if (ia == X) limits.imin = limits.imax = (side == 0) ? 0 : limits.imax;
+      if (ia == Y) limits.jmin = limits.jmax = (side == 0) ? 0 : limits.jmax;
+      if (ia == Z) limits.kmin = limits.kmax = (side == 0) ? 0 : limits.kmax;
+
+      kernel_ctxt_create(lev->cs, 1, limits, &ctxt);
+      kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+      tdpLaunchKernel(psi_mg_bc_kernel, nblk, ntpb, 0, 0,
+		      ctxt->target, lev->target, data, ia, side, value);
+
+      tdpAssert(tdpPeekAtLastError());
+      tdpAssert(tdpDeviceSynchronize());
+
+      kernel_ctxt_free(ctxt);
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_gather
+ *
+ *  From distributed level l to the agglomerated level l + 1. Each
+ *  rank contributes its block; all ranks receive all blocks.
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_gather(psi_mg_t * mg, int l, double * src,
+				  double * dst) {
+  int ic, jc, kc, n, nr;
+  int * noff = NULL;
+  int * nloc = NULL;
+  MPI_Comm comm;
+  psi_mg_level_t * lev = NULL;
+  psi_mg_level_t * next = NULL;
+
+  assert(mg);
+  assert(mg->level[l].gather);
+
+  lev = mg->level + l;
+  next = mg->level + l + 1;
+  cs_cart_comm(lev->cs, &comm);
+
+  tdpMemcpy(mg->hbuf[0], src, lev->nsites*sizeof(double),
+	    tdpMemcpyDeviceToHost);
+
+  n = 0;
+  for (ic = 1; ic <= lev->nlocal[X]; ic++) {
+    for (jc = 1; jc <= lev->nlocal[Y]; jc++) {
+      for (kc = 1; kc <= lev->nlocal[Z]; kc++) {
+	mg->sbuf[n++] = mg->hbuf[0][psi_mg_index(lev, ic, jc, kc)];
+      }
+    }
+  }
+
+  MPI_Allgather(mg->sbuf, mg->nmaxblock, MPI_DOUBLE,
+		mg->rbuf, mg->nmaxblock, MPI_DOUBLE, comm);
+
+  for (nr = 0; nr < mg->nrank; nr++) {
+    noff = mg->rankoffset + 3*nr;
+    nloc = mg->ranknlocal + 3*nr;
+    n = nr*mg->nmaxblock;
+    for (ic = 1; ic <= nloc[X]; ic++) {
+      for (jc = 1; jc <= nloc[Y]; jc++) {
+	for (kc = 1; kc <= nloc[Z]; kc++) {
+	  int index = psi_mg_index(next, noff[X] + ic, noff[Y] + jc,
+				   noff[Z] + kc);
+	  mg->hbuf[1][index] = mg->rbuf[n++];
+	}
+      }
+    }
+  }
+
+  tdpMemcpy(dst, mg->hbuf[1], next->nsites*sizeof(double),
+	    tdpMemcpyHostToDevice);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_scatter
+ *
+ *  From agglomerated level l + 1 back to distributed level l. No
+ *  communication is required.
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_scatter(psi_mg_t * mg, int l, double * src,
+				   double * dst) {
+  int ic, jc, kc;
+  psi_mg_level_t * lev = NULL;
+  psi_mg_level_t * next = NULL;
+
+  assert(mg);
+  assert(mg->level[l].gather);
+
+  lev = mg->level + l;
+  next = mg->level + l + 1;
+
+  tdpMemcpy(mg->hbuf[1], src, next->nsites*sizeof(double),
+	    tdpMemcpyDeviceToHost);
+  tdpMemcpy(mg->hbuf[0], dst, lev->nsites*sizeof(double),
+	    tdpMemcpyDeviceToHost);
+
+  for (ic = 1; ic <= lev->nlocal[X]; ic++) {
+    for (jc = 1; jc <= lev->nlocal[Y]; jc++) {
+      for (kc = 1; kc <= lev->nlocal[Z]; kc++) {
+	int index = psi_mg_index(next, lev->noffset[X] + ic,
+				 lev->noffset[Y] + jc, lev->noffset[Z] + kc);
+	mg->hbuf[0][psi_mg_index(lev, ic, jc, kc)] = mg->hbuf[1][index];
+      }
+    }
+  }
+
+  tdpMemcpy(dst, mg->hbuf[0], lev->nsites*sizeof(double),
+	    tdpMemcpyHostToDevice);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_coarsen
+ *
+ *  A direction may be coarsened if the local extent is uniform over
+ *  the decomposition cartsz and is even.
+ *
+ *  To avoid strong anisotropy in the coarse operator (which the point
+ *  smoother treats badly), only those directions with the smallest
+ *  grid spacing are coarsened. A direction with only one point makes
+ *  no contribution, and is ignored. A single point coarse grid is not
+ *  allowed.
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_coarsen(psi_mg_level_t * lev,
+				   const int cartsz[3], int coarsen[3]) {
+  int ia;
+  int ncoarse = 1;
+  double rh2max = 0.0;
+
+  assert(lev);
+
+  for (ia = 0; ia < 3; ia++) {
+    if (lev->ntotal[ia] > 1) rh2max = dmax(rh2max, lev->rh2[ia]);
+  }
+
+  for (ia = 0; ia < 3; ia++) {
+    int n = lev->ntotal[ia]/cartsz[ia];
+    coarsen[ia] = 1;
+    if (lev->ntotal[ia] % cartsz[ia] != 0) coarsen[ia] = 0;
+    if (n % 2 != 0) coarsen[ia] = 0;
+    if (2.0*lev->rh2[ia] < rh2max) coarsen[ia] = 0;
+    ncoarse *= lev->ntotal[ia]/(1 + coarsen[ia]);
+  }
+
+  if (ncoarse == 1) {
+    coarsen[X] = 0;
+    coarsen[Y] = 0;
+    coarsen[Z] = 0;
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_level_create
+ *
+ *  If lev->cs is already set (the finest level), it is used;
+ *  otherwise a coordinate system with halo one and the same
+ *  decomposition as the finest level is created (or a single
+ *  rank system for replicated levels).
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_level_create(psi_mg_t * mg, pe_t * pe,
+					const int ntotal[3], int replicated,
+					psi_mg_level_t * lev) {
+  int cartsz[3];
+
+  assert(mg);
+  assert(pe);
+  assert(lev);
+
+  if (lev->cs == NULL) {
+    lev->pe = pe;
+    cs_create(pe, &lev->cs);
+    cs_ntotal_set(lev->cs, ntotal);
+    cs_nhalo_set(lev->cs, 1);
+    if (!replicated) {
+      cs_cartsz(mg->level[0].cs, cartsz);
+      cs_decomposition_set(lev->cs, cartsz);
+      cs_reorder_set(lev->cs, 0);
+    }
+    cs_init(lev->cs);
+  }
+
+  lev->replicated = replicated;
+
+  cs_nsites(lev->cs, &lev->nsites);
+  cs_nhalo(lev->cs, &lev->nhalo);
+  cs_nlocal(lev->cs, lev->nlocal);
+  cs_nlocal_offset(lev->cs, lev->noffset);
+  cs_ntotal(lev->cs, lev->ntotal);
+  cs_strides(lev->cs, lev->str + X, lev->str + Y, lev->str + Z);
+
+  halo_swap_create_r1(lev->pe, lev->cs, 1, lev->nsites, 1, &lev->halo);
+  assert(lev->halo);
+  halo_swap_handlers_set(lev->halo, halo_swap_pack_rank1,
+			 halo_swap_unpack_rank1);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_level_arrays
+ *
+ *  Allocate (zeroed) u, f, r; or the permittivity if haseps.
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_level_arrays(psi_mg_level_t * lev, int haseps) {
+
+  size_t sz;
+
+  assert(lev);
+
+  sz = lev->nsites*sizeof(double);
+
+  if (haseps) {
+    tdpAssert(tdpMalloc((void **) &lev->eps, sz));
+    tdpAssert(tdpMemset(lev->eps, 0, sz));
+  }
+  else {
+    tdpAssert(tdpMalloc((void **) &lev->u, sz));
+    tdpAssert(tdpMalloc((void **) &lev->f, sz));
+    tdpAssert(tdpMalloc((void **) &lev->r, sz));
+    tdpAssert(tdpMemset(lev->u, 0, sz));
+    tdpAssert(tdpMemset(lev->f, 0, sz));
+    tdpAssert(tdpMemset(lev->r, 0, sz));
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_level_commit
+ *
+ *  Copy the level description to the target.
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_level_commit(psi_mg_level_t * lev) {
+
+  int ndevice;
+
+  assert(lev);
+
+  tdpGetDeviceCount(&ndevice);
+
+  if (ndevice == 0) {
+    lev->target = lev;
+  }
+  else {
+    if (lev->target == NULL) {
+      tdpAssert(tdpMalloc((void **) &lev->target, sizeof(psi_mg_level_t)));
+    }
+    tdpAssert(tdpMemcpy(lev->target, lev, sizeof(psi_mg_level_t),
+			tdpMemcpyHostToDevice));
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_level_free
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_level_free(psi_mg_level_t * lev, int ownscs) {
+
+  assert(lev);
+
+  if (lev->target != lev) tdpFree(lev->target);
+  if (lev->eps) tdpFree(lev->eps);
+  tdpFree(lev->r);
+  tdpFree(lev->f);
+  tdpFree(lev->u);
+
+  halo_swap_free(lev->halo);
+
+  if (ownscs) cs_free(lev->cs);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_launch_limits
+ *
+ *****************************************************************************/
+
+static __host__ int psi_mg_launch_limits(psi_mg_level_t * lev,
+					 kernel_info_t * limits) {
+  assert(lev);
+  assert(limits);
+
+  limits->imin = 1; limits->imax = lev->nlocal[X];
+  limits->jmin = 1; limits->jmax = lev->nlocal[Y];
+  limits->kmin = 1; limits->kmax = lev->nlocal[Z];
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_smooth_kernel
+ *
+ *  Gauss-Seidel update of sites of the given colour.
+ *
+ *****************************************************************************/
+
+__global__ void psi_mg_smooth_kernel(kernel_ctxt_t * ktx,
+				     psi_mg_level_t * lev, int colour) {
+  int kindex;
+  __shared__ int kiterations;
+
+  assert(ktx);
+  assert(lev);
+
+  kiterations = kernel_iterations(ktx);
+
+  for_simt_parallel(kindex, kiterations, 1) {
+
+    int ic, jc, kc, index;
+    int parity;
+    double au, diag;
+
+    ic = kernel_coords_ic(ktx, kindex);
+    jc = kernel_coords_jc(ktx, kindex);
+    kc = kernel_coords_kc(ktx, kindex);
+
+    parity = (lev->noffset[X] + ic + lev->noffset[Y] + jc
+	      + lev->noffset[Z] + kc) % 2;
+
+    if (parity == colour) {
+      index = kernel_coords_index(ktx, ic, jc, kc);
+      psi_mg_operator(lev, index, &au, &diag);
+      lev->u[addr_rank0(lev->nsites, index)]
+	+= (lev->f[addr_rank0(lev->nsites, index)] - au)/diag;
+    }
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_residual_kernel
+ *
+ *****************************************************************************/
+
+__global__ void psi_mg_residual_kernel(kernel_ctxt_t * ktx,
+				       psi_mg_level_t * lev, double * rnorm) {
+  int kindex;
+  int kiterations;
+  int tid;
+  double rb;
+  __shared__ double rs[TARGET_MAX_THREADS_PER_BLOCK];
+
+  assert(ktx);
+  assert(lev);
+
+  tid = threadIdx.x;
+  rs[tid] = 0.0;
+
+  kiterations = kernel_iterations(ktx);
+
+  for_simt_parallel(kindex, kiterations, 1) {
+
+    int ic, jc, kc, index;
+    double au, diag, r;
+
+    ic = kernel_coords_ic(ktx, kindex);
+    jc = kernel_coords_jc(ktx, kindex);
+    kc = kernel_coords_kc(ktx, kindex);
+    index = kernel_coords_index(ktx, ic, jc, kc);
+
+    psi_mg_operator(lev, index, &au, &diag);
+    r = lev->f[addr_rank0(lev->nsites, index)] - au;
+    lev->r[addr_rank0(lev->nsites, index)] = r;
+    rs[tid] += fabs(r);
+  }
+
+  /* Reduction */
+  rb = tdpAtomicBlockAddDouble(rs);
+
+  if (tid == 0) tdpAtomicAddDouble(rnorm, rb);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_restrict_kernel
+ *
+ *  Kernel context is the coarse level.
+ *
+ *****************************************************************************/
+
+__global__ void psi_mg_restrict_kernel(kernel_ctxt_t * ktx,
+				       psi_mg_level_t * fine,
+				       psi_mg_level_t * coarse,
+				       double * src, double * dst) {
+  int kindex;
+  __shared__ int kiterations;
+
+  assert(ktx);
+  assert(fine);
+  assert(coarse);
+
+  kiterations = kernel_iterations(ktx);
+
+  for_simt_parallel(kindex, kiterations, 1) {
+
+    int ic, jc, kc, index;
+    int ia, ja, ka;
+    int nx, ny, nz;
+    double sum = 0.0;
+
+    ic = kernel_coords_ic(ktx, kindex);
+    jc = kernel_coords_jc(ktx, kindex);
+    kc = kernel_coords_kc(ktx, kindex);
+    index = kernel_coords_index(ktx, ic, jc, kc);
+
+    nx = 1 + fine->coarsen[X];
+    ny = 1 + fine->coarsen[Y];
+    nz = 1 + fine->coarsen[Z];
+
+    for (ia = 0; ia < nx; ia++) {
+      for (ja = 0; ja < ny; ja++) {
+	for (ka = 0; ka < nz; ka++) {
+	  int indexf = psi_mg_index(fine, nx*(ic - 1) + 1 + ia,
+				    ny*(jc - 1) + 1 + ja,
+				    nz*(kc - 1) + 1 + ka);
+	  sum += src[addr_rank0(fine->nsites, indexf)];
+	}
+      }
+    }
+
+    dst[addr_rank0(coarse->nsites, index)] = sum/(nx*ny*nz);
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_prolong_kernel
+ *
+ *  Kernel context is the fine level. Linear interpolation in each
+ *  coarsened direction: weight 3/4 from the parent coarse cell and
+ *  1/4 from the nearer neighbour.
+ *
+ *****************************************************************************/
+
+__global__ void psi_mg_prolong_kernel(kernel_ctxt_t * ktx,
+				      psi_mg_level_t * fine,
+				      psi_mg_level_t * coarse) {
+  int kindex;
+  __shared__ int kiterations;
+
+  assert(ktx);
+  assert(fine);
+  assert(coarse);
+
+  kiterations = kernel_iterations(ktx);
+
+  for_simt_parallel(kindex, kiterations, 1) {
+
+    int ia, ja, ka, ib;
+    int ijk[3];
+    int pc[3][2];
+    double w[3][2];
+    int index;
+    double du = 0.0;
+
+    ijk[X] = kernel_coords_ic(ktx, kindex);
+    ijk[Y] = kernel_coords_jc(ktx, kindex);
+    ijk[Z] = kernel_coords_kc(ktx, kindex);
+    index = kernel_coords_index(ktx, ijk[X], ijk[Y], ijk[Z]);
+
+    for (ib = 0; ib < 3; ib++) {
+      if (fine->coarsen[ib]) {
+	pc[ib][0] = (ijk[ib] + 1)/2;
+	pc[ib][1] = (ijk[ib] % 2) ? pc[ib][0] - 1 : pc[ib][0] + 1;
+	w[ib][0] = 0.75;
+	w[ib][1] = 0.25;
+      }
+      else {
+	pc[ib][0] = ijk[ib];
+	pc[ib][1] = ijk[ib];
+	w[ib][0] = 1.0;
+	w[ib][1] = 0.0;
+      }
+    }
+
+    for (ia = 0; ia < 2; ia++) {
+      for (ja = 0; ja < 2; ja++) {
+	for (ka = 0; ka < 2; ka++) {
+	  double wt = w[X][ia]*w[Y][ja]*w[Z][ka];
+	  if (wt > 0.0) {
+	    int indexc = psi_mg_index(coarse, pc[X][ia], pc[Y][ja], pc[Z][ka]);
+	    du += wt*coarse->u[addr_rank0(coarse->nsites, indexc)];
+	  }
+	}
+      }
+    }
+
+    fine->u[addr_rank0(fine->nsites, index)] += du;
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  psi_mg_bc_kernel
+ *
+ *  Kernel context is the halo plane at the given side (0 low, 1 high)
+ *  in direction dim. In a periodic direction, the jump is added;
+ *  otherwise the halo takes the adjacent value.
+ *
+ *****************************************************************************/
+
+__global__ void psi_mg_bc_kernel(kernel_ctxt_t * ktx, psi_mg_level_t * lev,
+				 double * data, int dim, int side,
+				 double jump) {
+  int kindex;
+  __shared__ int kiterations;
+  int periodic;
+
+  assert(ktx);
+  assert(lev);
+  assert(data);
+
+  periodic = (jump != 0.0);
+  kiterations = kernel_iterations(ktx);
+
+  for_simt_parallel(kindex, kiterations, 1) {
+
+    int ijk[3];
+    int index, index1;
+
+    ijk[X] = kernel_coords_ic(ktx, kindex);
+    ijk[Y] = kernel_coords_jc(ktx, kindex);
+    ijk[Z] = kernel_coords_kc(ktx, kindex);
+    index = psi_mg_index(lev, ijk[X], ijk[Y], ijk[Z]);
+
+    if (periodic) {
+      data[addr_rank0(lev->nsites, index)] += jump;
+    }
+    else {
+      ijk[dim] = (side == 0) ? 1 : lev->nlocal[dim];
+      index1 = psi_mg_index(lev, ijk[X], ijk[Y], ijk[Z]);
+      data[addr_rank0(lev->nsites, index)]
+	= data[addr_rank0(lev->nsites, index1)];
+    }
+  }
+
+  return;
+}
@@ -0,0 +1,29 @@
+/*****************************************************************************
+ *
+ *  psi_mg.h
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#ifndef LUDWIG_PSI_MG_H
+#define LUDWIG_PSI_MG_H
+
+#include "psi.h"
+#include "fe_electro_symmetric.h"
+
+typedef struct psi_mg_s psi_mg_t;
+
+__host__ int psi_mg_create(psi_t * psi, psi_mg_t ** pobj);
+__host__ int psi_mg_free(psi_mg_t * obj);
+__host__ int psi_mg_info(psi_mg_t * obj);
+__host__ int psi_mg_nlevel(psi_mg_t * obj, int * nlevel);
+__host__ int psi_mg_solve(psi_mg_t * obj, fe_t * fe, f_vare_t fepsilon);
+
+#endif
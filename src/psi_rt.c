@@ -10,7 +10,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2012-2018 The University of Edinburgh
+ *  (c) 2012-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -54,10 +54,12 @@ int psi_rt_init_param(pe_t * pe, rt_t * rt, psi_t * obj) {
   int io_format_in = IO_FORMAT_DEFAULT;
   int io_format_out = IO_FORMAT_DEFAULT;
   char value[BUFSIZ] = "BINARY";
+  char solver[BUFSIZ] = "sor";
 
   int multisteps;             /* Number of substeps in NPE */
   int skipsteps;              /* Poisson equation solved every skipstep timesteps */ 
   double diffacc;             /* Relative accuracy of diffusion in NPE */
+  int npfused;                /* Fused flux and update in NPE */
 
   assert(pe);
   assert(rt);
@@ -119,6 +121,11 @@ int psi_rt_init_param(pe_t * pe, rt_t * rt, psi_t * obj) {
   psi_diffacc(obj, &diffacc);
   pe_info(pe, "Diffusive accuracy in NPE: %14.7e\n", diffacc);
 
+  n = rt_int_parameter(rt, "electrokinetics_np_fused", &npfused);
+  if (n == 1) psi_np_fused_set(obj, npfused);
+  psi_np_fused(obj, &npfused);
+  if (npfused) pe_info(pe, "Fused flux and update in NPE: yes\n");
+
   /* Tolerances and Iterations */
 
   n = rt_double_parameter(rt, "electrokinetics_rel_tol", &tolerance);
@@ -135,6 +142,29 @@ int psi_rt_init_param(pe_t * pe, rt_t * rt, psi_t * obj) {
   psi_maxits(obj, &niteration);
   pe_info(pe, "Max. no. of iterations:  %16d\n", niteration);
 
+  /* Poisson solver (default SOR) */
+
+  n = rt_string_parameter(rt, "electrokinetics_solver", solver, BUFSIZ);
+
+  if (n == 1 && strcmp(solver, "multigrid") == 0) {
+    int gamma = 1;
+    int nsmooth = 2;
+    psi_solver_set(obj, PSI_POISSON_MULTIGRID);
+    psi_multigrid(obj, &gamma, &nsmooth);
+    n = rt_string_parameter(rt, "electrokinetics_mg_cycle", solver, BUFSIZ);
+    if (n == 1 && strcmp(solver, "w") == 0) gamma = 2;
+    if (n == 1 && strcmp(solver, "w") != 0 && strcmp(solver, "v") != 0) {
+      pe_fatal(pe, "electrokinetics_mg_cycle must be v or w\n");
+    }
+    rt_int_parameter(rt, "electrokinetics_mg_nsmooth", &nsmooth);
+    if (nsmooth < 1) pe_fatal(pe, "electrokinetics_mg_nsmooth must be > 0\n");
+    psi_multigrid_set(obj, gamma, nsmooth);
+    pe_info(pe, "Poisson solver:           %17s\n", "multigrid");
+  }
+  else if (n == 1 && strcmp(solver, "sor") != 0) {
+    pe_fatal(pe, "electrokinetics_solver must be sor or multigrid\n");
+  }
+
   /* Output */
 
   n = 0;
@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2012-2016 The University of Edinburgh
+ *  (c) 2012-2019 The University of Edinburgh
  *
  *  Contributinf authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -54,14 +54,21 @@ struct psi_s {
   double abstol;            /* Absolute tolerance for Poisson solver */
   int method;               /* Force computation method */
   int maxits;               /* Maximum number of iterations */
+  int solver;               /* Poisson solver (SOR or multigrid) */
+  int mg_gamma;             /* Multigrid cycle (1 = V, 2 = W) */
+  int mg_nsmooth;           /* Multigrid smoothing sweeps */
   int multisteps;           /* Number of substeps in charge dynamics */
   int skipsteps;            /* Poisson equation solved every skipsteps timesteps */
   int nfreq_io;             /* Field output */
   int nfreq;                /* Residual statisics output */
   double diffacc;           /* Number of substeps in charge dynamics */
+  int npfused;              /* Fused Nernst-Planck flux and update */
+  double * flx;             /* Nernst-Planck link fluxes (persistent) */
+  double * musolv;          /* Solvation chemical potential (per species) */
   MPI_Datatype psihalo[3];  /* psi field halo */
   MPI_Datatype rhohalo[3];  /* charge densities halo */
   io_info_t * info;         /* I/O informtation */
+  psi_t * target;           /* Target copy */
 };
 
 int psi_halo(int nf, double * f, MPI_Datatype halo[3]);
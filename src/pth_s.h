@@ -13,6 +13,7 @@ struct pth_s {
   int method;           /* Method for force computation */
   int nsites;           /* Number of sites allocated */
   double * str;         /* Stress may be antisymmetric */
+  double * plane;       /* Fused force: three planes of stress (target) */
   pth_t * target;       /* Target memory */
 };
 
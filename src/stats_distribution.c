@@ -11,7 +11,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2017 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
  *
@@ -23,10 +23,20 @@
 
 #include "pe.h"
 #include "coords.h"
+#include "kernel.h"
+#include "kernel_reduce.h"
 #include "lb_model_s.h"
+#include "map_s.h"
 #include "util.h"
 #include "stats_distribution.h"
 
+__global__ void stats_distribution_rho_kernel(kernel_ctxt_t * ktx, lb_t * lb,
+					      map_t * map,
+					      kernel_reduce_t * red);
+__global__ void stats_distribution_g_kernel(kernel_ctxt_t * ktx, lb_t * lb,
+					    map_t * map,
+					    kernel_reduce_t * red);
+
 /*****************************************************************************
  *
  *  stats_distribution_print
@@ -34,20 +44,23 @@
  *  This routine prints some statistics related to the first distribution
  *  (always assumed to be the density).
  *
+ *  The reduction is performed on the target; the distribution itself
+ *  is not copied to the host.
+ *
  *****************************************************************************/
 
 int stats_distribution_print(lb_t * lb, map_t * map) {
 
-  int ic, jc, kc, index;
   int nlocal[3];
-  int status;
 
-  double stat_local[5];
-  double stat_total[5];
-  double rho;
   double rhomean;
   double rhovar;
 
+  dim3 nblk, ntpb;
+  kernel_info_t limits;
+  kernel_ctxt_t * ctxt = NULL;
+  kernel_reduce_t * red = NULL;
+
   MPI_Comm comm;
 
   assert(lb);
@@ -56,50 +69,132 @@ int stats_distribution_print(lb_t * lb, map_t * map) {
   cs_nlocal(lb->cs, nlocal);
   pe_mpi_comm(lb->pe, &comm);
 
-  stat_local[0] = 0.0;       /* Volume */
-  stat_local[1] = 0.0;       /* total mass (or density) */
-  stat_local[2] = 0.0;       /* variance rho^2 */
-  stat_local[3] = +DBL_MAX;  /* min local density */
-  stat_local[4] = -DBL_MAX;  /* max local density */
-
-  for (ic = 1;  ic <= nlocal[X]; ic++) {
-    for (jc = 1; jc <= nlocal[Y]; jc++) {
-      for (kc = 1; kc <= nlocal[Z]; kc++) {
-
-        index = cs_index(lb->cs, ic, jc, kc);
-	map_status(map, index, &status);
-	if (status != MAP_FLUID) continue;
-
-	lb_0th_moment(lb, index, LB_RHO, &rho);
-	stat_local[0] += 1.0;
-	stat_local[1] += rho;
-	stat_local[2] += rho*rho;
-	stat_local[3] = dmin(rho, stat_local[3]);
-	stat_local[4] = dmax(rho, stat_local[4]);
-      }
-    }
-  }
+  /* sum[0] volume, sum[1] total mass, sum[2] rho^2 (for variance)
+   * min[0] min local density, max[0] max local density. */
+
+  kernel_reduce_create(lb->pe, 3, &red);
+
+  limits.imin = 1; limits.imax = nlocal[X];
+  limits.jmin = 1; limits.jmax = nlocal[Y];
+  limits.kmin = 1; limits.kmax = nlocal[Z];
+
+  kernel_ctxt_create(lb->cs, NSIMDVL, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+  tdpLaunchKernel(stats_distribution_rho_kernel, nblk, ntpb, 0, 0,
+		  ctxt->target, lb->target, map->target, red->target);
 
-  MPI_Reduce(stat_local, stat_total, 3, MPI_DOUBLE, MPI_SUM, 0, comm);
-  MPI_Reduce(stat_local + 3, stat_total + 3, 1, MPI_DOUBLE, MPI_MIN, 0, comm);
-  MPI_Reduce(stat_local + 4, stat_total + 4, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  kernel_ctxt_free(ctxt);
+
+  kernel_reduce_local(red);
+  kernel_reduce_mpi(red, 0, comm);
 
   /* Compute mean density, and the variance, and print. We
-   * assume the fluid volume (stat_total[0]) is not zero... */ 
+   * assume the fluid volume (red->sum[0]) is not zero... */ 
 
   /* In a uniform state the variance can be a truncation error
    * below zero, hence fabs(rhovar) */
 
-  rhomean = stat_total[1]/stat_total[0];
-  rhovar  = (stat_total[2]/stat_total[0]) - rhomean*rhomean;
+  rhomean = red->sum[1]/red->sum[0];
+  rhovar  = (red->sum[2]/red->sum[0]) - rhomean*rhomean;
 
   pe_info(lb->pe, "\nScalars - total mean variance min max\n");
   pe_info(lb->pe, "[rho] %14.2f %14.11f %14.7e %14.11f %14.11f\n",
-       stat_total[1], rhomean, fabs(rhovar), stat_total[3], stat_total[4]); 
+	  red->sum[1], rhomean, fabs(rhovar), red->min[0], red->max[0]);
+
+  kernel_reduce_free(red);
 
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  stats_distribution_rho_kernel
+ *
+ *  Fluid volume, total density, sum of rho^2, and min/max density.
+ *
+ *****************************************************************************/
+
+__global__ void stats_distribution_rho_kernel(kernel_ctxt_t * ktx, lb_t * lb,
+					      map_t * map,
+					      kernel_reduce_t * red) {
+  int kindex;
+  int kiterations;
+  int tid;
+
+  double rhomin = +DBL_MAX;
+  double rhomax = -DBL_MAX;
+
+  __shared__ double vol[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double rsum[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double rvar[TARGET_MAX_THREADS_PER_BLOCK];
+
+  assert(ktx);
+  assert(lb);
+  assert(map);
+  assert(red);
+
+  tid = threadIdx.x;
+  vol[tid] = 0.0;
+  rsum[tid] = 0.0;
+  rvar[tid] = 0.0;
+
+  kiterations = kernel_vector_iterations(ktx);
+
+  for_simt_parallel(kindex, kiterations, NSIMDVL) {
+
+    int index, iv, status;
+    int ic[NSIMDVL], jc[NSIMDVL], kc[NSIMDVL];
+    int maskv[NSIMDVL];
+    double rho[NSIMDVL];
+    double vtmp = 0.0;
+    double stmp = 0.0;
+    double s2tmp = 0.0;
+
+    index = kernel_baseindex(ktx, kindex);
+    kernel_coords_v(ktx, kindex, ic, jc, kc);
+    kernel_mask_v(ktx, ic, jc, kc, maskv);
+
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      rho[iv] = 0.0;
+      if (maskv[iv] == 0) continue;
+      map_status(map, index + iv, &status);
+      if (status != MAP_FLUID) {
+	maskv[iv] = 0;
+	continue;
+      }
+      lb_0th_moment(lb, index + iv, LB_RHO, rho + iv);
+      rhomin = dmin(rho[iv], rhomin);
+      rhomax = dmax(rho[iv], rhomax);
+    }
+
+    for_simd_v_reduction(iv, NSIMDVL, +: vtmp) {
+      vtmp += 1.0*maskv[iv];
+    }
+    for_simd_v_reduction(iv, NSIMDVL, +: stmp) {
+      stmp += rho[iv];
+    }
+    for_simd_v_reduction(iv, NSIMDVL, +: s2tmp) {
+      s2tmp += rho[iv]*rho[iv];
+    }
+
+    vol[tid] += vtmp;
+    rsum[tid] += stmp;
+    rvar[tid] += s2tmp;
+  }
+
+  kernel_reduce_sum(red, 0, vol);
+  kernel_reduce_sum(red, 1, rsum);
+  kernel_reduce_sum(red, 2, rvar);
+  kernel_reduce_min(red, 0, rhomin);
+  kernel_reduce_max(red, 0, rhomax);
+
+  return;
+}
+
 /*****************************************************************************
  *
  *  stats_distribution_momentum
@@ -110,12 +205,13 @@ int stats_distribution_print(lb_t * lb, map_t * map) {
 
 int stats_distribution_momentum(lb_t * lb, map_t * map, double g[3]) {
 
-  int ic, jc, kc, index;
   int nlocal[3];
-  int status;
 
-  double g_local[3];
-  double g_site[3];
+  dim3 nblk, ntpb;
+  kernel_info_t limits;
+  kernel_ctxt_t * ctxt = NULL;
+  kernel_reduce_t * red = NULL;
+
   MPI_Comm comm;
 
   assert(lb);
@@ -125,27 +221,111 @@ int stats_distribution_momentum(lb_t * lb, map_t * map, double g[3]) {
   pe_mpi_comm(lb->pe, &comm);
   cs_nlocal(lb->cs, nlocal);
 
-  g_local[X] = 0.0;
-  g_local[Y] = 0.0;
-  g_local[Z] = 0.0;
+  kernel_reduce_create(lb->pe, 3, &red);
+
+  limits.imin = 1; limits.imax = nlocal[X];
+  limits.jmin = 1; limits.jmax = nlocal[Y];
+  limits.kmin = 1; limits.kmax = nlocal[Z];
+
+  kernel_ctxt_create(lb->cs, NSIMDVL, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+  tdpLaunchKernel(stats_distribution_g_kernel, nblk, ntpb, 0, 0,
+		  ctxt->target, lb->target, map->target, red->target);
+
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  kernel_ctxt_free(ctxt);
+
+  kernel_reduce_local(red);
+  kernel_reduce_mpi(red, 0, comm);
+
+  g[X] = red->sum[X];
+  g[Y] = red->sum[Y];
+  g[Z] = red->sum[Z];
+
+  kernel_reduce_free(red);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  stats_distribution_g_kernel
+ *
+ *  Total fluid momentum.
+ *
+ *****************************************************************************/
+
+__global__ void stats_distribution_g_kernel(kernel_ctxt_t * ktx, lb_t * lb,
+					    map_t * map,
+					    kernel_reduce_t * red) {
+  int kindex;
+  int kiterations;
+  int tid;
+
+  __shared__ double gx[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double gy[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double gz[TARGET_MAX_THREADS_PER_BLOCK];
+
+  assert(ktx);
+  assert(lb);
+  assert(map);
+  assert(red);
+
+  tid = threadIdx.x;
+  gx[tid] = 0.0;
+  gy[tid] = 0.0;
+  gz[tid] = 0.0;
+
+  kiterations = kernel_vector_iterations(ktx);
 
-  for (ic = 1;  ic <= nlocal[X]; ic++) {
-    for (jc = 1; jc <= nlocal[Y]; jc++) {
-      for (kc = 1; kc <= nlocal[Z]; kc++) {
+  for_simt_parallel(kindex, kiterations, NSIMDVL) {
 
-        index = cs_index(lb->cs, ic, jc, kc);
-	map_status(map, index, &status);
-	if (status != MAP_FLUID) continue;
+    int index, iv, ia, p, status;
+    int ic[NSIMDVL], jc[NSIMDVL], kc[NSIMDVL];
+    int maskv[NSIMDVL];
+    double gsite[3][NSIMDVL];
+    double gtmp[3];
 
-	lb_1st_moment(lb, index, LB_RHO, g_site);
-	g_local[X] += g_site[X];
-	g_local[Y] += g_site[Y];
-	g_local[Z] += g_site[Z];
+    index = kernel_baseindex(ktx, kindex);
+    kernel_coords_v(ktx, kindex, ic, jc, kc);
+    kernel_mask_v(ktx, ic, jc, kc, maskv);
+
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      gsite[X][iv] = 0.0;
+      gsite[Y][iv] = 0.0;
+      gsite[Z][iv] = 0.0;
+      if (maskv[iv] == 0) continue;
+      map_status(map, index + iv, &status);
+      if (status != MAP_FLUID) continue;
+      for (p = 0; p < NVEL; p++) {
+	double f = LB_F_LOAD(lb->f[LB_ADDR(lb->nsite, lb->ndist, NVEL,
+					   index + iv, LB_RHO, p)],
+			     lb->param->wv[p], LB_RHO);
+	for (ia = 0; ia < NDIM; ia++) {
+	  gsite[ia][iv] += lb->param->cv[p][ia]*f;
+	}
       }
     }
+
+    for (ia = 0; ia < 3; ia++) {
+      double gv = 0.0;
+      for_simd_v_reduction(iv, NSIMDVL, +: gv) {
+	gv += gsite[ia][iv];
+      }
+      gtmp[ia] = gv;
+    }
+
+    gx[tid] += gtmp[X];
+    gy[tid] += gtmp[Y];
+    gz[tid] += gtmp[Z];
   }
 
-  MPI_Reduce(g_local, g, 3, MPI_DOUBLE, MPI_SUM, 0, comm);
+  kernel_reduce_sum(red, X, gx);
+  kernel_reduce_sum(red, Y, gy);
+  kernel_reduce_sum(red, Z, gz);
 
-  return 0;
+  return;
 }
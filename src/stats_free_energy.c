@@ -9,7 +9,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2011-2018 The University of Edinburgh
+ *  (c) 2011-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -19,9 +19,19 @@
 #include <assert.h>
 
 #include "control.h"
+#include "kernel.h"
+#include "kernel_reduce.h"
+#include "map_s.h"
 #include "util.h"
 #include "stats_free_energy.h"
 
+static int stats_fed_local_host(cs_t * cs, fe_t * fe, map_t * map,
+				double * fe_local);
+static int stats_fed_local_target(pe_t * pe, cs_t * cs, fe_t * fe,
+				  map_t * map, double * fe_local);
+__global__ void stats_fed_kernel(kernel_ctxt_t * ktx, fe_t * fe, map_t * map,
+				 kernel_reduce_t * red);
+
 /****************************************************************************
  *
  *  stats_free_energy_density
@@ -33,6 +43,10 @@
  *  The mechanism to compute surface free energy contributions requires
  *  much reworking and generalisation; it only really covers LC at present.
  *
+ *  The fluid totals are computed on the target, except for the
+ *  electrokinetic free energies, which have no target implementation
+ *  of the free energy density (the potential is host only).
+ *
  ****************************************************************************/
 
 int stats_free_energy_density(pe_t * pe, cs_t * cs, wall_t * wall, fe_t * fe,
@@ -41,13 +55,9 @@ int stats_free_energy_density(pe_t * pe, cs_t * cs, wall_t * wall, fe_t * fe,
 
 #define NSTAT 5
 
-  int ic, jc, kc, index;
   int ntstep;
-  int nlocal[3];
-  int status;
   int ncolloid;
 
-  double fed;
   double fe_local[NSTAT];
   double fe_total[NSTAT];
   double rv;
@@ -64,7 +74,6 @@ int stats_free_energy_density(pe_t * pe, cs_t * cs, wall_t * wall, fe_t * fe,
   pe_mpi_comm(pe, &comm);
 
   cs_ltot(cs, ltot);
-  cs_nlocal(cs, nlocal);
   colloids_info_ntotal(cinfo, &ncolloid);
 
   fe_local[0] = 0.0; /* Total free energy (fluid all sites) */
@@ -73,22 +82,13 @@ int stats_free_energy_density(pe_t * pe, cs_t * cs, wall_t * wall, fe_t * fe,
   fe_local[3] = 0.0; /* surface free energy */
   fe_local[4] = 0.0; /* other wall free energy (walls only) */
 
-  for (ic = 1; ic <= nlocal[X]; ic++) {
-    for (jc = 1; jc <= nlocal[Y]; jc++) {
-      for (kc = 1; kc <= nlocal[Z]; kc++) {
-
-	index = cs_index(cs, ic, jc, kc);
-	map_status(map, index, &status);
-
-	fe->func->fed(fe, index, &fed);
-	fe_local[0] += fed;
-
-	if (status == MAP_FLUID) {
-	    fe_local[1] += fed;
-	    fe_local[2] += 1.0;
-	}
-      }
-    }
+  switch (fe->id) {
+  case FE_ELECTRO:
+  case FE_ELECTRO_SYMMETRIC:
+    stats_fed_local_host(cs, fe, map, fe_local);
+    break;
+  default:
+    stats_fed_local_target(pe, cs, fe, map, fe_local);
   }
 
   /* A robust mechanism is required to get the surface free energy */
@@ -136,3 +136,179 @@ int stats_free_energy_density(pe_t * pe, cs_t * cs, wall_t * wall, fe_t * fe,
 
   return 0;
 }
+
+/****************************************************************************
+ *
+ *  stats_fed_local_host
+ *
+ *  Local totals fe_local[0] (all sites), fe_local[1] (fluid), and
+ *  fe_local[2] (fluid volume) computed on the host.
+ *
+ ****************************************************************************/
+
+static int stats_fed_local_host(cs_t * cs, fe_t * fe, map_t * map,
+				double * fe_local) {
+  int ic, jc, kc, index;
+  int nlocal[3];
+  int status;
+  double fed;
+
+  assert(cs);
+  assert(fe);
+  assert(map);
+  assert(fe_local);
+
+  cs_nlocal(cs, nlocal);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+
+	index = cs_index(cs, ic, jc, kc);
+	map_status(map, index, &status);
+
+	fe->func->fed(fe, index, &fed);
+	fe_local[0] += fed;
+
+	if (status == MAP_FLUID) {
+	    fe_local[1] += fed;
+	    fe_local[2] += 1.0;
+	}
+      }
+    }
+  }
+
+  return 0;
+}
+
+/****************************************************************************
+ *
+ *  stats_fed_local_target
+ *
+ *  As above, but via a kernel reduction.
+ *
+ ****************************************************************************/
+
+static int stats_fed_local_target(pe_t * pe, cs_t * cs, fe_t * fe,
+				  map_t * map, double * fe_local) {
+  int nlocal[3];
+
+  dim3 nblk, ntpb;
+  kernel_info_t limits;
+  kernel_ctxt_t * ctxt = NULL;
+  kernel_reduce_t * red = NULL;
+  fe_t * fetarget = NULL;
+
+  assert(pe);
+  assert(cs);
+  assert(fe);
+  assert(map);
+  assert(fe_local);
+
+  cs_nlocal(cs, nlocal);
+  fe->func->target(fe, &fetarget);
+
+  kernel_reduce_create(pe, 3, &red);
+
+  limits.imin = 1; limits.imax = nlocal[X];
+  limits.jmin = 1; limits.jmax = nlocal[Y];
+  limits.kmin = 1; limits.kmax = nlocal[Z];
+
+  kernel_ctxt_create(cs, NSIMDVL, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+  tdpLaunchKernel(stats_fed_kernel, nblk, ntpb, 0, 0,
+		  ctxt->target, fetarget, map->target, red->target);
+
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  kernel_ctxt_free(ctxt);
+
+  kernel_reduce_local(red);
+
+  fe_local[0] += red->sum[0];
+  fe_local[1] += red->sum[1];
+  fe_local[2] += red->sum[2];
+
+  kernel_reduce_free(red);
+
+  return 0;
+}
+
+/****************************************************************************
+ *
+ *  stats_fed_kernel
+ *
+ *  sum[0] free energy (all sites), sum[1] free energy (fluid sites),
+ *  sum[2] fluid volume.
+ *
+ ****************************************************************************/
+
+__global__ void stats_fed_kernel(kernel_ctxt_t * ktx, fe_t * fe, map_t * map,
+				 kernel_reduce_t * red) {
+  int kindex;
+  int kiterations;
+  int tid;
+
+  __shared__ double ftot[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double ffluid[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double vol[TARGET_MAX_THREADS_PER_BLOCK];
+
+  assert(ktx);
+  assert(fe);
+  assert(map);
+  assert(red);
+
+  tid = threadIdx.x;
+  ftot[tid] = 0.0;
+  ffluid[tid] = 0.0;
+  vol[tid] = 0.0;
+
+  kiterations = kernel_vector_iterations(ktx);
+
+  for_simt_parallel(kindex, kiterations, NSIMDVL) {
+
+    int index, iv, status;
+    int ic[NSIMDVL], jc[NSIMDVL], kc[NSIMDVL];
+    int maskv[NSIMDVL];
+    int fluid[NSIMDVL];
+    double fed[NSIMDVL];
+    double ftmp = 0.0;
+    double fftmp = 0.0;
+    double vtmp = 0.0;
+
+    index = kernel_baseindex(ktx, kindex);
+    kernel_coords_v(ktx, kindex, ic, jc, kc);
+    kernel_mask_v(ktx, ic, jc, kc, maskv);
+
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      fed[iv] = 0.0;
+      fluid[iv] = 0;
+      if (maskv[iv] == 0) continue;
+      map_status(map, index + iv, &status);
+      fe->func->fed(fe, index + iv, fed + iv);
+      fluid[iv] = (status == MAP_FLUID);
+    }
+
+    for_simd_v_reduction(iv, NSIMDVL, +: ftmp) {
+      ftmp += fed[iv];
+    }
+    for_simd_v_reduction(iv, NSIMDVL, +: fftmp) {
+      fftmp += (fluid[iv]) ? fed[iv] : 0.0;
+    }
+    for_simd_v_reduction(iv, NSIMDVL, +: vtmp) {
+      vtmp += 1.0*fluid[iv];
+    }
+
+    ftot[tid] += ftmp;
+    ffluid[tid] += fftmp;
+    vol[tid] += vtmp;
+  }
+
+  kernel_reduce_sum(red, 0, ftot);
+  kernel_reduce_sum(red, 1, ffluid);
+  kernel_reduce_sum(red, 2, vol);
+
+  return;
+}
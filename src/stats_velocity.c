@@ -9,7 +9,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2011-2017 The University of Edinburgh
+ *  (c) 2011-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -21,10 +21,16 @@
 
 #include "pe.h"
 #include "coords.h"
+#include "kernel.h"
+#include "kernel_reduce.h"
+#include "map_s.h"
 #include "util.h"
 #include "hydro_s.h"
 #include "stats_velocity.h"
 
+__global__ void stats_velocity_kernel(kernel_ctxt_t * ktx, hydro_t * hydro,
+				      map_t * map, kernel_reduce_t * red);
+
 /****************************************************************************
  *
  *  stats_velocity_minmax
@@ -36,18 +42,25 @@
  *  can actually look quite wrong (e.g., have the opposite sign to
  *  the flow).
  *
+ *  The reduction is performed on the target. The initial values of
+ *  the minimum (FLT_MAX) and maximum (FLT_MIN) are applied to the
+ *  result.
+ *
  ****************************************************************************/
 
 int stats_velocity_minmax(hydro_t * hydro, map_t * map, int print_vol_flux) {
 
-  int ic, jc, kc, ia, index;
+  int ia;
   int nlocal[3];
-  int status;
 
   double umin[3];
   double umax[3];
-  double utmp[3];
-  double usum_local[3], usum[3];
+  double usum[3];
+
+  dim3 nblk, ntpb;
+  kernel_info_t limits;
+  kernel_ctxt_t * ctxt = NULL;
+  kernel_reduce_t * red = NULL;
 
   MPI_Comm comm;
 
@@ -57,46 +70,33 @@ int stats_velocity_minmax(hydro_t * hydro, map_t * map, int print_vol_flux) {
   cs_nlocal(hydro->cs, nlocal);
   pe_mpi_comm(hydro->pe, &comm);
 
-  for (ia = 0; ia < 3; ia++) {
-    umin[ia] = FLT_MAX;
-    umax[ia] = FLT_MIN;
-    usum_local[ia] = 0.0;
-  }
+  kernel_reduce_create(hydro->pe, 3, &red);
 
-  for (ic = 1; ic <= nlocal[X]; ic++) {
-    for (jc = 1; jc <= nlocal[Y]; jc++) {
-      for (kc = 1; kc <= nlocal[Z]; kc++) {
+  limits.imin = 1; limits.imax = nlocal[X];
+  limits.jmin = 1; limits.jmax = nlocal[Y];
+  limits.kmin = 1; limits.kmax = nlocal[Z];
 
-        index = cs_index(hydro->cs, ic, jc, kc);
-	map_status(map, index, &status);
+  kernel_ctxt_create(hydro->cs, NSIMDVL, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
 
-	if (status == MAP_FLUID) {
+  tdpLaunchKernel(stats_velocity_kernel, nblk, ntpb, 0, 0,
+		  ctxt->target, hydro->target, map->target, red->target);
 
-	  hydro_u(hydro, index, utmp);
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
 
-	  for (ia = 0; ia < 3; ia++) {
-	    umin[ia] = dmin(umin[ia], utmp[ia]);
-	    umax[ia] = dmax(umax[ia], utmp[ia]);
-	    usum_local[ia] += utmp[ia];
-	  }
-	}
-      }
-    }
-  }
-
-  MPI_Reduce(umin, utmp, 3, MPI_DOUBLE, MPI_MIN, 0, comm);
-
-  for (ia = 0; ia < 3; ia++) {
-    umin[ia] = utmp[ia];
-  }
+  kernel_ctxt_free(ctxt);
 
-  MPI_Reduce(umax, utmp, 3, MPI_DOUBLE, MPI_MAX, 0, comm);
+  kernel_reduce_local(red);
+  kernel_reduce_mpi(red, 0, comm);
 
   for (ia = 0; ia < 3; ia++) {
-    umax[ia] = utmp[ia];
+    umin[ia] = dmin(FLT_MAX, red->min[ia]);
+    umax[ia] = dmax(FLT_MIN, red->max[ia]);
+    usum[ia] = red->sum[ia];
   }
 
-  MPI_Reduce(usum_local, usum, 3, MPI_DOUBLE, MPI_SUM, 0, comm);
+  kernel_reduce_free(red);
 
   pe_info(hydro->pe, "\n");
   pe_info(hydro->pe, "Velocity - x y z\n");
@@ -109,3 +109,88 @@ int stats_velocity_minmax(hydro_t * hydro, map_t * map, int print_vol_flux) {
 
   return 0;
 }
+
+/****************************************************************************
+ *
+ *  stats_velocity_kernel
+ *
+ *  Sum, minimum and maximum of each velocity component at fluid sites.
+ *
+ ****************************************************************************/
+
+__global__ void stats_velocity_kernel(kernel_ctxt_t * ktx, hydro_t * hydro,
+				      map_t * map, kernel_reduce_t * red) {
+  int kindex;
+  int kiterations;
+  int tid;
+  int ia;
+
+  double umin[3] = {+DBL_MAX, +DBL_MAX, +DBL_MAX};
+  double umax[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+
+  __shared__ double ux[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double uy[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double uz[TARGET_MAX_THREADS_PER_BLOCK];
+
+  assert(ktx);
+  assert(hydro);
+  assert(map);
+  assert(red);
+
+  tid = threadIdx.x;
+  ux[tid] = 0.0;
+  uy[tid] = 0.0;
+  uz[tid] = 0.0;
+
+  kiterations = kernel_vector_iterations(ktx);
+
+  for_simt_parallel(kindex, kiterations, NSIMDVL) {
+
+    int index, iv, status;
+    int ic[NSIMDVL], jc[NSIMDVL], kc[NSIMDVL];
+    int maskv[NSIMDVL];
+    double u[3][NSIMDVL];
+    double utmp[3];
+
+    index = kernel_baseindex(ktx, kindex);
+    kernel_coords_v(ktx, kindex, ic, jc, kc);
+    kernel_mask_v(ktx, ic, jc, kc, maskv);
+
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      for (ia = 0; ia < 3; ia++) {
+	u[ia][iv] = 0.0;
+      }
+      if (maskv[iv] == 0) continue;
+      map_status(map, index + iv, &status);
+      if (status != MAP_FLUID) continue;
+      for (ia = 0; ia < 3; ia++) {
+	u[ia][iv] = hydro->u[addr_rank1(hydro->nsite, NHDIM, index + iv, ia)];
+	umin[ia] = dmin(umin[ia], u[ia][iv]);
+	umax[ia] = dmax(umax[ia], u[ia][iv]);
+      }
+    }
+
+    for (ia = 0; ia < 3; ia++) {
+      double us = 0.0;
+      for_simd_v_reduction(iv, NSIMDVL, +: us) {
+	us += u[ia][iv];
+      }
+      utmp[ia] = us;
+    }
+
+    ux[tid] += utmp[X];
+    uy[tid] += utmp[Y];
+    uz[tid] += utmp[Z];
+  }
+
+  kernel_reduce_sum(red, X, ux);
+  kernel_reduce_sum(red, Y, uy);
+  kernel_reduce_sum(red, Z, uz);
+
+  for (ia = 0; ia < 3; ia++) {
+    kernel_reduce_min(red, ia, umin[ia]);
+    kernel_reduce_max(red, ia, umax[ia]);
+  }
+
+  return;
+}
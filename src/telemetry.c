@@ -0,0 +1,301 @@
+/*****************************************************************************
+ *
+ *  telemetry.c
+ *
+ *  Machine-readable performance telemetry.
+ *
+ *  Every nfreq time steps, the interval totals of each timer (see
+ *  timer.c) are reduced over ranks and written by rank 0 as one
+ *  record per active timer, either as JSON (one object per line)
+ *  or CSV. Each record has
+ *
+ *    step       time step at the end of the interval
+ *    timer      timer name
+ *    calls      completed calls in the interval (maximum over ranks)
+ *    t_mean     elapsed time in the interval (mean over ranks)
+ *    t_min      minimum over ranks
+ *    t_max      maximum over ranks
+ *    rank_max   the rank with the maximum time (the straggler)
+ *    imbalance  t_max/t_mean (unity if perfectly balanced)
+ *    fraction   t_mean as a fraction of the time step loop t_mean
+ *    mlups      lattice site updates (all ranks) per t_max (millions/s)
+ *    gbytes_s   estimated bytes moved (all ranks) per t_max (GB/s)
+ *
+ *  The last two are zero where no work has been declared with
+ *  TIMER_work(). The halo swap is split into "Halo pack/unpack" and
+ *  "Halo MPI wait".
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "timer.h"
+#include "telemetry.h"
+
+typedef struct telemetry_s telemetry_t;
+
+struct telemetry_s {
+  pe_t * pe;
+  int nfreq;                          /* Report interval (0 is off) */
+  telemetry_format_enum_t format;
+  FILE * fp;                          /* Output stream (root only) */
+};
+
+static telemetry_t tm_ = {NULL, 0, TELEMETRY_JSON, NULL};
+
+static void telemetry_name(const char * name, char * trim, int len);
+
+/*****************************************************************************
+ *
+ *  telemetry_init_rt
+ *
+ *  Keys: telemetry_freq (default 0, off), telemetry_format json|csv.
+ *  The output is telemetry.json (or telemetry.csv) in the output
+ *  subdirectory.
+ *
+ *****************************************************************************/
+
+__host__ int telemetry_init_rt(pe_t * pe, rt_t * rt) {
+
+  int n;
+  int nfreq = 0;
+  char value[BUFSIZ] = "json";
+  char subdirectory[FILENAME_MAX];
+  char filename[FILENAME_MAX];
+  telemetry_format_enum_t format = TELEMETRY_JSON;
+
+  assert(pe);
+  assert(rt);
+
+  rt_int_parameter(rt, "telemetry_freq", &nfreq);
+  if (nfreq <= 0) return 0;
+
+  rt_string_parameter(rt, "telemetry_format", value, BUFSIZ);
+
+  if (strcmp(value, "json") == 0) {
+    format = TELEMETRY_JSON;
+  }
+  else if (strcmp(value, "csv") == 0) {
+    format = TELEMETRY_CSV;
+  }
+  else {
+    pe_fatal(pe, "telemetry_format must be json or csv (not %s)\n", value);
+  }
+
+  pe_subdirectory(pe, subdirectory);
+  n = snprintf(filename, sizeof(filename), "%stelemetry.%s",
+	       subdirectory, value);
+  if (n < 0 || n >= (int) sizeof(filename)) {
+    pe_fatal(pe, "Truncated telemetry file name\n");
+  }
+
+  pe_info(pe, "\n");
+  pe_info(pe, "Performance telemetry\n");
+  pe_info(pe, "---------------------\n");
+  pe_info(pe, "Report interval:            %14d steps\n", nfreq);
+  pe_info(pe, "Output:                     %14s\n", filename);
+
+  telemetry_init(pe, nfreq, format, filename);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  telemetry_init
+ *
+ *  Open the output at root (and write the header for CSV). The
+ *  interval starts now.
+ *
+ *****************************************************************************/
+
+__host__ int telemetry_init(pe_t * pe, int nfreq,
+			    telemetry_format_enum_t format,
+			    const char * filename) {
+  assert(pe);
+  assert(filename);
+  assert(tm_.fp == NULL);
+
+  tm_.pe = pe;
+  tm_.nfreq = nfreq;
+  tm_.format = format;
+
+  if (pe_mpi_rank(pe) == 0) {
+    tm_.fp = fopen(filename, "w");
+    if (tm_.fp == NULL) pe_fatal(pe, "fopen(%s) failed\n", filename);
+
+    if (format == TELEMETRY_CSV) {
+      fprintf(tm_.fp, "step,timer,calls,t_mean,t_min,t_max,rank_max,"
+	      "imbalance,fraction,mlups,gbytes_s\n");
+    }
+  }
+
+  TIMER_interval_reset();
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  telemetry_step
+ *
+ *  Report if step is at the end of an interval. Collective.
+ *
+ *****************************************************************************/
+
+__host__ int telemetry_step(int step) {
+
+  if (tm_.nfreq <= 0) return 0;
+  if (step % tm_.nfreq != 0) return 0;
+
+  telemetry_report(step);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  telemetry_report
+ *
+ *  Reduce the interval totals and write one record per timer which
+ *  has completed any calls on any rank. Collective.
+ *
+ *****************************************************************************/
+
+__host__ int telemetry_report(int step) {
+
+  int n, nrank, rank;
+  int ncall[TIMER_NTIMERS];
+  int ncall_max[TIMER_NTIMERS];
+  double tlocal[TIMER_NTIMERS];
+  double tmin[TIMER_NTIMERS];
+  double tsum[TIMER_NTIMERS];
+  double work[2*TIMER_NTIMERS];
+  double work_sum[2*TIMER_NTIMERS];
+  double tmax[TIMER_NTIMERS];
+  int rlocal[TIMER_NTIMERS];
+  int rmax[TIMER_NTIMERS];
+  MPI_Comm comm;
+
+  assert(tm_.pe);
+
+  pe_mpi_comm(tm_.pe, &comm);
+  nrank = pe_mpi_size(tm_.pe);
+  rank = pe_mpi_rank(tm_.pe);
+
+  for (n = 0; n < TIMER_NTIMERS; n++) {
+    TIMER_interval(n, tlocal + n, ncall + n, work + 2*n, work + 2*n + 1);
+  }
+
+  /* The straggler is the lowest rank holding the maximum time. */
+
+  MPI_Allreduce(tlocal, tmax, TIMER_NTIMERS, MPI_DOUBLE, MPI_MAX, comm);
+
+  for (n = 0; n < TIMER_NTIMERS; n++) {
+    rlocal[n] = (tlocal[n] == tmax[n]) ? rank : nrank;
+  }
+
+  MPI_Reduce(ncall, ncall_max, TIMER_NTIMERS, MPI_INT, MPI_MAX, 0, comm);
+  MPI_Reduce(tlocal, tmin, TIMER_NTIMERS, MPI_DOUBLE, MPI_MIN, 0, comm);
+  MPI_Reduce(tlocal, tsum, TIMER_NTIMERS, MPI_DOUBLE, MPI_SUM, 0, comm);
+  MPI_Reduce(rlocal, rmax, TIMER_NTIMERS, MPI_INT, MPI_MIN, 0, comm);
+  MPI_Reduce(work, work_sum, 2*TIMER_NTIMERS, MPI_DOUBLE, MPI_SUM, 0, comm);
+
+  TIMER_interval_reset();
+
+  if (tm_.fp) {
+
+    double tstep = tsum[TIMER_STEPS]/nrank;
+
+    for (n = 0; n < TIMER_NTIMERS; n++) {
+
+      char name[BUFSIZ];
+      double tmean = tsum[n]/nrank;
+      double imbalance = 1.0;
+      double fraction = 0.0;
+      double mlups = 0.0;
+      double gbytes = 0.0;
+
+      if (ncall_max[n] == 0) continue;
+
+      telemetry_name(TIMER_name(n), name, BUFSIZ);
+      if (tmean > 0.0) imbalance = tmax[n]/tmean;
+      if (tstep > 0.0) fraction = tmean/tstep;
+      if (tmax[n] > 0.0) {
+	mlups  = 1.0e-06*work_sum[2*n]/tmax[n];
+	gbytes = 1.0e-09*work_sum[2*n + 1]/tmax[n];
+      }
+
+      if (tm_.format == TELEMETRY_CSV) {
+	fprintf(tm_.fp, "%d,\"%s\",%d,%.6e,%.6e,%.6e,%d,%.4f,%.4f,%.4e,%.4e\n",
+		step, name, ncall_max[n], tmean, tmin[n], tmax[n],
+		rmax[n], imbalance, fraction, mlups, gbytes);
+      }
+      else {
+	fprintf(tm_.fp, "{\"step\": %d, \"timer\": \"%s\", \"calls\": %d, "
+		"\"t_mean\": %.6e, \"t_min\": %.6e, \"t_max\": %.6e, "
+		"\"rank_max\": %d, \"imbalance\": %.4f, \"fraction\": %.4f, "
+		"\"mlups\": %.4e, \"gbytes_s\": %.4e}\n",
+		step, name, ncall_max[n], tmean, tmin[n], tmax[n],
+		rmax[n], imbalance, fraction, mlups, gbytes);
+      }
+    }
+
+    fflush(tm_.fp);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  telemetry_finish
+ *
+ *****************************************************************************/
+
+__host__ int telemetry_finish(void) {
+
+  if (tm_.fp) fclose(tm_.fp);
+
+  tm_.pe = NULL;
+  tm_.nfreq = 0;
+  tm_.fp = NULL;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  telemetry_name
+ *
+ *  Timer names may have trailing spaces for the benefit of the
+ *  timer statistics; remove them.
+ *
+ *****************************************************************************/
+
+static void telemetry_name(const char * name, char * trim, int len) {
+
+  int n;
+
+  assert(name);
+  assert(trim);
+
+  strncpy(trim, name, len - 1);
+  trim[len - 1] = '\0';
+
+  for (n = strlen(trim) - 1; n >= 0 && trim[n] == ' '; n--) {
+    trim[n] = '\0';
+  }
+
+  return;
+}
@@ -0,0 +1,31 @@
+/*****************************************************************************
+ *
+ *  telemetry.h
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#ifndef LUDWIG_TELEMETRY_H
+#define LUDWIG_TELEMETRY_H
+
+#include "pe.h"
+#include "runtime.h"
+
+typedef enum {TELEMETRY_JSON, TELEMETRY_CSV} telemetry_format_enum_t;
+
+__host__ int telemetry_init_rt(pe_t * pe, rt_t * rt);
+__host__ int telemetry_init(pe_t * pe, int nfreq,
+			    telemetry_format_enum_t format,
+			    const char * filename);
+__host__ int telemetry_step(int step);
+__host__ int telemetry_report(int step);
+__host__ int telemetry_finish(void);
+
+#endif
@@ -7,12 +7,17 @@
  *  There are a number of separate 'timers', each of which can
  *  be started, and stopped, independently.
  *
+ *  Each timer also keeps a total for the current interval (time,
+ *  completed calls, and any work in lattice site updates and bytes
+ *  declared via TIMER_work()). The interval is reset by the
+ *  telemetry at each report.
+ *
  *  $Id: timer.c,v 1.5 2010-10-15 12:40:03 kevin Exp $
  *
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2017 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -34,6 +39,10 @@ struct timer_struct {
   double          t_min;
   unsigned int    active;
   unsigned int    nsteps;
+  double          i_sum;      /* Interval: elapsed time */
+  int             i_ncall;    /* Interval: number of completed calls */
+  double          i_nsite;    /* Interval: lattice site updates */
+  double          i_nbyte;    /* Interval: estimated bytes moved */
 };
 
 static pe_t * pe_stat = NULL;
@@ -45,6 +54,7 @@ static const char * timer_name[] = {"Total",
 				    "Propagtn (krnl) ",
 				    "Collision",
 				    "Collision (krnl) ",
+				    "AA coll/prop (krnl) ",
 				    "Lattice halos",
 				    "phi gradients",
 				    "phi grad (krnl) ",
@@ -56,6 +66,7 @@ static const char * timer_name[] = {"Total",
 				    "BBL",
 				    "Particle updates",
 				    "Particle halos",
+				    "Verlet list build",
 				    "Fluctuations",
 				    "Ewald Sum total",
 				    "Ewald Real",
@@ -65,7 +76,6 @@ static const char * timer_name[] = {"Total",
 				    "Phi force (krnl) ",
 				    "phi update",
 				    "Velocity Halo ",
-				    "BE mol field (krnl) ",
 				    "BP BE update (krnl) ",
 				    "Advectn (krnl) ",
 				    "Advectn BCS (krnl) ",
@@ -73,6 +83,8 @@ static const char * timer_name[] = {"Total",
 				    "Electrokinetics",
 				    "Poisson equation",
 				    "Nernst Planck",
+				    "Halo pack/unpack",
+				    "Halo MPI wait",
 				    "Free1",
 				    "Free2",
                                     "Free3"
@@ -101,6 +113,8 @@ int TIMER_init(pe_t * pe) {
     timer[n].nsteps = 0;
   }
 
+  TIMER_interval_reset();
+
   return 0;
 }
 
@@ -143,6 +157,8 @@ void TIMER_stop(const int t_id) {
     timer[t_id].t_max  = dmax(timer[t_id].t_max, t_elapse);
     timer[t_id].t_min  = dmin(timer[t_id].t_min, t_elapse);
     timer[t_id].active = 0;
+    timer[t_id].i_sum   += t_elapse;
+    timer[t_id].i_ncall += 1;
   }
 
   return;
@@ -196,3 +212,80 @@ void TIMER_statistics() {
 
   return;
 }
+
+/*****************************************************************************
+ *
+ *  TIMER_work
+ *
+ *  Declare the work done by one call of timer t_id: lattice site
+ *  updates nsite, and an estimate of the bytes moved nbyte.
+ *
+ *****************************************************************************/
+
+void TIMER_work(const int t_id, double nsite, double nbyte) {
+
+  assert(t_id >= 0 && t_id < TIMER_NTIMERS);
+
+  timer[t_id].i_nsite += nsite;
+  timer[t_id].i_nbyte += nbyte;
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  TIMER_interval
+ *
+ *  Local totals since the last TIMER_interval_reset().
+ *
+ *****************************************************************************/
+
+int TIMER_interval(const int t_id, double * t, int * ncall, double * nsite,
+		   double * nbyte) {
+
+  assert(t_id >= 0 && t_id < TIMER_NTIMERS);
+  assert(t);
+  assert(ncall);
+  assert(nsite);
+  assert(nbyte);
+
+  *t     = timer[t_id].i_sum;
+  *ncall = timer[t_id].i_ncall;
+  *nsite = timer[t_id].i_nsite;
+  *nbyte = timer[t_id].i_nbyte;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  TIMER_interval_reset
+ *
+ *****************************************************************************/
+
+void TIMER_interval_reset(void) {
+
+  int n;
+
+  for (n = 0; n < TIMER_NTIMERS; n++) {
+    timer[n].i_sum   = 0.0;
+    timer[n].i_ncall = 0;
+    timer[n].i_nsite = 0.0;
+    timer[n].i_nbyte = 0.0;
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  TIMER_name
+ *
+ *****************************************************************************/
+
+const char * TIMER_name(const int t_id) {
+
+  assert(t_id >= 0 && t_id < TIMER_NTIMERS);
+
+  return timer_name[t_id];
+}
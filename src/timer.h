@@ -10,7 +10,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2017 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -27,12 +27,21 @@ __host__ void TIMER_start(const int);
 __host__ void TIMER_stop(const int);
 __host__ void TIMER_statistics(void);
 
+/* Accumulated over an interval for telemetry (see telemetry.c) */
+
+__host__ void TIMER_work(const int t_id, double nsite, double nbyte);
+__host__ int TIMER_interval(const int t_id, double * t, int * ncall,
+			    double * nsite, double * nbyte);
+__host__ void TIMER_interval_reset(void);
+__host__ const char * TIMER_name(const int t_id);
+
 enum timer_id {TIMER_TOTAL = 0,
 	       TIMER_STEPS,
 	       TIMER_PROPAGATE,
 	       TIMER_PROP_KERNEL,
 	       TIMER_COLLIDE,
 	       TIMER_COLLIDE_KERNEL,
+	       TIMER_COLLIDE_AA_KERNEL,
 	       TIMER_HALO_LATTICE,
 	       TIMER_PHI_GRADIENTS,
 	       TIMER_PHI_GRAD_KERNEL,
@@ -44,6 +53,7 @@ enum timer_id {TIMER_TOTAL = 0,
 	       TIMER_BBL,
 	       TIMER_PARTICLE_UPDATE,
 	       TIMER_PARTICLE_HALO,
+	       TIMER_PARTICLE_NLIST,
 	       TIMER_FLUCTUATIONS,
                TIMER_EWALD_TOTAL,
                TIMER_EWALD_REAL_SPACE,
@@ -53,7 +63,6 @@ enum timer_id {TIMER_TOTAL = 0,
 	       TIMER_PHI_FORCE_CALC,
 	       TIMER_ORDER_PARAMETER_UPDATE,
 	       TIMER_U_HALO, 
-	       TIMER_BE_MOL_FIELD,
 	       BP_BE_UPDATE_KERNEL, 
 	       ADVECTION_X_KERNEL, 
 	       ADVECTION_BCS_KERNEL, 
@@ -61,6 +70,8 @@ enum timer_id {TIMER_TOTAL = 0,
 	       TIMER_ELECTRO_TOTAL,
 	       TIMER_ELECTRO_POISSON,
 	       TIMER_ELECTRO_NPEQ,
+	       TIMER_HALO_PACK,
+	       TIMER_HALO_WAIT,
 	       TIMER_FREE1,
 	       TIMER_FREE2,
                TIMER_FREE3,
@@ -9,7 +9,7 @@
  *  Edinburgh Soft Matter and Statistical Physics and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2011-2018 The University of Edinburgh
+ *  (c) 2011-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -44,7 +44,8 @@ struct wall_s {
   wall_t * target;       /* Device memory */
 
   wall_param_t * param;  /* parameters */
-  int   nlink;           /* Number of links */
+  int   nlink;           /* Number of links (local fluid sites) */
+  int   nlinkx;          /* Number of links including those from halo */
   int * linki;           /* outside (fluid) site indices */
   int * linkj;           /* inside (solid) site indices */
   int * linkp;           /* LB basis vectors for links */
@@ -291,16 +292,18 @@ __host__ int wall_init_boundaries(wall_t * wall, wall_init_enum_t init) {
   int indexi, indexj;
   int p;
   int nlink;
+  int nextra;
   int nlocal[3];
   int status;
   int ndevice;
+  int ishalo, isweep;
 
   assert(wall);
 
   tdpGetDeviceCount(&ndevice);
 
   if (init == WALL_INIT_ALLOCATE) {
-    nlink = imax(1, wall->nlink); /* Avoid zero-sized allocations */
+    nlink = imax(1, wall->nlinkx); /* Avoid zero-sized allocations */
     assert(nlink > 0);
     wall->linki = (int *) calloc(nlink, sizeof(int));
     wall->linkj = (int *) calloc(nlink, sizeof(int));
@@ -316,63 +319,83 @@ __host__ int wall_init_boundaries(wall_t * wall, wall_init_enum_t init) {
     if (wall->linku == NULL) pe_fatal(wall->pe,"calloc(wall->linku) failed\n");
     if (ndevice > 0) {
       int tmp;
-      tdpMalloc((void **) &tmp, wall->nlink*sizeof(int));
+      tdpMalloc((void **) &tmp, wall->nlinkx*sizeof(int));
       tdpMemcpy(&wall->target->linki, &tmp, sizeof(int *),
 		tdpMemcpyHostToDevice);
-      tdpMalloc((void **) &tmp, wall->nlink*sizeof(int));
+      tdpMalloc((void **) &tmp, wall->nlinkx*sizeof(int));
       tdpMemcpy(&wall->target->linkj, &tmp, sizeof(int *),
 		tdpMemcpyHostToDevice);
-      tdpMalloc((void **) &tmp, wall->nlink*sizeof(int));
+      tdpMalloc((void **) &tmp, wall->nlinkx*sizeof(int));
       tdpMemcpy(&wall->target->linkp, &tmp, sizeof(int *),
 		tdpMemcpyHostToDevice);
-      tdpMalloc((void **) &tmp, wall->nlink*sizeof(int));
+      tdpMalloc((void **) &tmp, wall->nlinkx*sizeof(int));
       tdpMemcpy(&wall->target->linku, &tmp, sizeof(int *),
 		tdpMemcpyHostToDevice);
     }
   }
 
+  /* With the communication-avoiding lattice halo swap, links from
+   * fluid sites up to (depth - 1) into the halo are also required.
+   * These follow the links from local sites, which are the first
+   * wall->nlink entries (the only ones used in momentum accounting). */
+
+  nextra = 0;
+  if (wall->lb) {
+    lb_halo_depth(wall->lb, &nextra);
+    nextra -= 1;
+  }
+
   nlink = 0;
   cs_nlocal(wall->cs, nlocal);
 
-  for (ic = 1; ic <= nlocal[X]; ic++) {
-    for (jc = 1; jc <= nlocal[Y]; jc++) {
-      for (kc = 1; kc <= nlocal[Z]; kc++) {
+  for (isweep = 0; isweep < 2; isweep++) {
 
-	indexi = cs_index(wall->cs, ic, jc, kc);
-	map_status(wall->map, indexi, &status);
-	if (status != MAP_FLUID) continue;
+    if (isweep == 1) wall->nlink = nlink;
 
-	/* Look for non-solid -> solid links */
+    for (ic = 1 - nextra; ic <= nlocal[X] + nextra; ic++) {
+      for (jc = 1 - nextra; jc <= nlocal[Y] + nextra; jc++) {
+	for (kc = 1 - nextra; kc <= nlocal[Z] + nextra; kc++) {
 
-	for (p = 1; p < NVEL; p++) {
+	  ishalo = (ic < 1 || jc < 1 || kc < 1 || ic > nlocal[X] ||
+		    jc > nlocal[Y] || kc > nlocal[Z]);
+	  if (ishalo != isweep) continue;
 
-	  ic1 = ic + cv[p][X];
-	  jc1 = jc + cv[p][Y];
-	  kc1 = kc + cv[p][Z];
-	  indexj = cs_index(wall->cs, ic1, jc1, kc1);
-	  map_status(wall->map, indexj, &status);
+	  indexi = cs_index(wall->cs, ic, jc, kc);
+	  map_status(wall->map, indexi, &status);
+	  if (status != MAP_FLUID) continue;
 
-	  if (status == MAP_BOUNDARY) {
-	    if (init == WALL_INIT_ALLOCATE) {
-	      wall->linki[nlink] = indexi;
-	      wall->linkj[nlink] = indexj;
-	      wall->linkp[nlink] = p;
-	      wall->linku[nlink] = WALL_UZERO;
+	  /* Look for non-solid -> solid links */
+
+	  for (p = 1; p < NVEL; p++) {
+
+	    ic1 = ic + cv[p][X];
+	    jc1 = jc + cv[p][Y];
+	    kc1 = kc + cv[p][Z];
+	    indexj = cs_index(wall->cs, ic1, jc1, kc1);
+	    map_status(wall->map, indexj, &status);
+
+	    if (status == MAP_BOUNDARY) {
+	      if (init == WALL_INIT_ALLOCATE) {
+		wall->linki[nlink] = indexi;
+		wall->linkj[nlink] = indexj;
+		wall->linkp[nlink] = p;
+		wall->linku[nlink] = WALL_UZERO;
+	      }
+	      nlink += 1;
 	    }
-	    nlink += 1;
 	  }
-	}
 
-	/* Next site */
+	  /* Next site */
+	}
       }
     }
   }
 
   if (init == WALL_INIT_ALLOCATE) {
-    assert(nlink == wall->nlink);
+    assert(nlink == wall->nlinkx);
     wall_memcpy(wall, tdpMemcpyHostToDevice);
   }
-  wall->nlink = nlink;
+  wall->nlinkx = nlink;
 
   return 0;
 }
@@ -399,11 +422,12 @@ __host__ int wall_memcpy(wall_t * wall, tdpMemcpyKind flag) {
     int * tmp = NULL;
     int nlink;
 
-    nlink = wall->nlink;
+    nlink = wall->nlinkx;
 
     switch (flag) {
     case tdpMemcpyHostToDevice:
       tdpMemcpy(&wall->target->nlink, &wall->nlink, sizeof(int), flag);
+      tdpMemcpy(&wall->target->nlinkx, &wall->nlinkx, sizeof(int), flag);
       tdpMemcpy(wall->target->fnet, wall->fnet, 3*sizeof(double), flag);
 
       /* In turn, linki, linkj, linkp, linku */
@@ -461,7 +485,7 @@ __host__ int wall_init_uw(wall_t * wall) {
     if (wall->param->isboundary[Z]) iw = Z;
     assert(iw == X || iw == Y || iw == Z);
 
-    for (n = 0; n < wall->nlink; n++) {
+    for (n = 0; n < wall->nlinkx; n++) {
       if (cv[wall->linkp[n]][iw] == -1) wall->linku[n] = WALL_UWBOT;
       if (cv[wall->linkp[n]][iw] == +1) wall->linku[n] = WALL_UWTOP;
     }
@@ -485,9 +509,9 @@ __host__ int wall_set_wall_distributions(wall_t * wall) {
   assert(wall);
   assert(wall->target);
 
-  if (wall->nlink == 0) return 0;
+  if (wall->nlinkx == 0) return 0;
 
-  kernel_launch_param(wall->nlink, &nblk, &ntpb);
+  kernel_launch_param(wall->nlinkx, &nblk, &ntpb);
 
   tdpLaunchKernel(wall_setu_kernel, nblk, ntpb, 0, 0,
 		  wall->target, wall->lb->target);
@@ -518,11 +542,11 @@ __global__ void wall_setu_kernel(wall_t * wall, lb_t * lb) {
   assert(wall);
   assert(lb);
 
-  for_simt_parallel(n, wall->nlink, 1) {
+  for_simt_parallel(n, wall->nlinkx, 1) {
 
     p = NVEL - wall->linkp[n];
     fp = lb->param->wv[p]*(lb->param->rho0 + rcs2*ux*lb->param->cv[p][X]);
-    lb_f_set(lb, wall->linkj[n], p, LB_RHO, fp);
+    lb_fpost_set(lb, wall->linkj[n], p, LB_RHO, fp);
 
   }
 
@@ -544,13 +568,13 @@ __host__ int wall_bbl(wall_t * wall) {
   assert(wall);
   assert(wall->target);
 
-  if (wall->nlink == 0) return 0;
+  if (wall->nlinkx == 0) return 0;
 
   /* Update kernel constants */
   tdpMemcpyToSymbol(tdpSymbol(static_param), wall->param,
 		    sizeof(wall_param_t), 0, tdpMemcpyHostToDevice);
 
-  kernel_launch_param(wall->nlink, &nblk, &ntpb);
+  kernel_launch_param(wall->nlinkx, &nblk, &ntpb);
 
   tdpLaunchKernel(wall_bbl_kernel, nblk, ntpb, 0, 0,
 		  wall->target, wall->lb->target, wall->map->target);
@@ -602,11 +626,12 @@ __global__ void wall_bbl_kernel(wall_t * wall, lb_t * lb, map_t * map) {
   fy[tid] = 0.0;
   fz[tid] = 0.0;
 
-  for_simt_parallel(n, wall->nlink, 1) {
+  for_simt_parallel(n, wall->nlinkx, 1) {
 
     int i, j, ij, ji, ia;
     int status;
     double rho, cdotu;
+    double wlocal;
     double fp, fp0, fp1;
     double force;
 
@@ -616,6 +641,9 @@ __global__ void wall_bbl_kernel(wall_t * wall, lb_t * lb, map_t * map) {
     ji = NVEL - ij;        /* Opposite direction index */
     ia = wall->linku[n];   /* Wall velocity lookup */
 
+    /* Links from halo sites are not counted in the momentum */
+    wlocal = (n < wall->nlink);
+
     cdotu = lb->param->cv[ij][X]*uw[ia][X] +
             lb->param->cv[ij][Y]*uw[ia][Y] +
             lb->param->cv[ij][Z]*uw[ia][Z]; 
@@ -627,13 +655,13 @@ __global__ void wall_bbl_kernel(wall_t * wall, lb_t * lb, map_t * map) {
       /* This matches the momentum exchange in colloid BBL. */
       /* This only affects the accounting (via anomaly, as below) */
 
-      lb_f(lb, i, ij, LB_RHO, &fp0);
-      lb_f(lb, j, ji, LB_RHO, &fp1);
+      lb_fpost(lb, i, ij, LB_RHO, &fp0);
+      lb_fpost(lb, j, ji, LB_RHO, &fp1);
       fp = fp0 + fp1;
 
-      fx[tid] += (fp - 2.0*lb->param->wv[ij])*lb->param->cv[ij][X];
-      fy[tid] += (fp - 2.0*lb->param->wv[ij])*lb->param->cv[ij][Y];
-      fz[tid] += (fp - 2.0*lb->param->wv[ij])*lb->param->cv[ij][Z];
+      fx[tid] += wlocal*(fp - 2.0*lb->param->wv[ij])*lb->param->cv[ij][X];
+      fy[tid] += wlocal*(fp - 2.0*lb->param->wv[ij])*lb->param->cv[ij][Y];
+      fz[tid] += wlocal*(fp - 2.0*lb->param->wv[ij])*lb->param->cv[ij][Z];
     }
     else {
 
@@ -642,25 +670,25 @@ __global__ void wall_bbl_kernel(wall_t * wall, lb_t * lb, map_t * map) {
        * wv[ij]. This is ok for walls where there are exactly
        * equal and opposite links at each side of the system. */
 
-      lb_f(lb, i, ij, LB_RHO, &fp);
+      lb_fpost(lb, i, ij, LB_RHO, &fp);
       lb_0th_moment(lb, i, LB_RHO, &rho);
 
       force = 2.0*fp - 2.0*rcs2*lb->param->wv[ij]*lb->param->rho0*cdotu;
 
-      fx[tid] += (force - 2.0*lb->param->wv[ij])*lb->param->cv[ij][X];
-      fy[tid] += (force - 2.0*lb->param->wv[ij])*lb->param->cv[ij][Y];
-      fz[tid] += (force - 2.0*lb->param->wv[ij])*lb->param->cv[ij][Z];
+      fx[tid] += wlocal*(force - 2.0*lb->param->wv[ij])*lb->param->cv[ij][X];
+      fy[tid] += wlocal*(force - 2.0*lb->param->wv[ij])*lb->param->cv[ij][Y];
+      fz[tid] += wlocal*(force - 2.0*lb->param->wv[ij])*lb->param->cv[ij][Z];
 
       fp = fp - 2.0*rcs2*lb->param->wv[ij]*lb->param->rho0*cdotu;
-      lb_f_set(lb, j, ji, LB_RHO, fp);
+      lb_fpost_set(lb, j, ji, LB_RHO, fp);
 
       if (lb->param->ndist > 1) {
 	/* Order parameter */
-	lb_f(lb, i, ij, LB_PHI, &fp);
+	lb_fpost(lb, i, ij, LB_PHI, &fp);
 	lb_0th_moment(lb, i, LB_PHI, &rho);
 
 	fp = fp - 2.0*rcs2*lb->param->wv[ij]*lb->param->rho0*cdotu;
-	lb_f_set(lb, j, ji, LB_PHI, fp);
+	lb_fpost_set(lb, j, ji, LB_PHI, fp);
       }
     }
     /* Next link */
@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2018 The University of Edinburgh
+ *  (c) 2018-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Alan Gray (alang@epcc.ed.ac.uk)
@@ -61,6 +61,15 @@ __host__ tdpError_t tdpStreamSynchronize(tdpStream_t stream);
 
 /* tdpLaunchKernel() is implementation-dependant */
 
+/* A sequence of kernel launches made by fn(arg) which are to execute
+ * one after another without intervening host work. For OpenMP, the
+ * sequence runs in a single parallel region with a barrier after each
+ * kernel; fn() must not contain other host code. */
+
+typedef void (* tdpHostFn_t)(void * arg);
+
+__host__ tdpError_t tdpLaunchSequence(tdpHostFn_t fn, void * arg);
+
 /* Memory management */
 
 __host__ tdpError_t tdpFreeHost(void * phost);
@@ -109,6 +118,16 @@ __device__ double tdpAtomicMinDouble(double * minval, double val);
 __device__ int tdpAtomicBlockAddInt(int * partsum);
 __device__ double tdpAtomicBlockAddDouble(double * partsum);
 
+/* Host memory placed by parallel first touch; release via tdpFreeHost() */
+
+__host__ tdpError_t tdpHostAllocFirstTouch(void ** phost, size_t nblock,
+					   size_t nsite, size_t sitesize,
+					   unsigned int flags);
+
+/* Host thread placement (cpu[] has at least tdp_get_max_threads() entries) */
+
+__host__ tdpError_t tdpHostThreadAffinity(int * nthread, int * cpu);
+
 /* Help for error checking */
 
 __host__ __device__ void tdpErrorHandler(tdpError_t ifail, const char * file,
@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2018 The University of Edinburgh
+ *  (c) 2018-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Alan Gray (alang@epcc.ed.ac.uk)
@@ -83,7 +83,28 @@ __device__ double tdpAtomicMinDouble(double * minval, double val) {
   do {
     assumed = old;
     old = atomicCAS(address_as_ull, assumed, __double_as_longlong
-		    (fminf(val, __longlong_as_double(assumed))));
+		    (fmin(val, __longlong_as_double(assumed))));
+  } while (assumed != old);
+
+  return __longlong_as_double(old);
+}
+
+/*****************************************************************************
+ *
+ *  tdpAtomicMaxDouble
+ *
+ *****************************************************************************/
+
+__device__ double tdpAtomicMaxDouble(double * maxval, double val) {
+
+  unsigned long long int * address_as_ull = (unsigned long long int *) maxval;
+  unsigned long long int old = *address_as_ull;
+  unsigned long long int assumed;
+
+  do {
+    assumed = old;
+    old = atomicCAS(address_as_ull, assumed, __double_as_longlong
+		    (fmax(val, __longlong_as_double(assumed))));
   } while (assumed != old);
 
   return __longlong_as_double(old);
@@ -259,6 +280,17 @@ __host__ tdpError_t tdpStreamSynchronize(tdpStream_t stream) {
   return cudaStreamSynchronize(stream);
 }
 
+/* Execution control */
+
+__host__ tdpError_t tdpLaunchSequence(tdpHostFn_t fn, void * arg) {
+
+  /* Kernels are ordered in the default stream */
+
+  fn(arg);
+
+  return cudaSuccess;
+}
+
 /* Memory management */
 
 __host__ tdpError_t tdpFreeHost(void * phost) {
@@ -304,3 +336,26 @@ __host__ tdpError_t tdpHostAlloc(void ** phost, size_t size,
 
   return cudaHostAlloc(phost, size, flags);
 }
+
+__host__ tdpError_t tdpHostAllocFirstTouch(void ** phost, size_t nblock,
+					   size_t nsite, size_t sitesize,
+					   unsigned int flags) {
+
+  /* Placement is not relevant to the host copy: page-locked memory
+   * (consistent with tdpFreeHost()), zeroed. */
+
+  size_t size = nblock*nsite*sitesize;
+  cudaError_t ifail = cudaHostAlloc(phost, size, cudaHostAllocDefault);
+
+  if (ifail == cudaSuccess) memset(*phost, 0, size);
+
+  return ifail;
+}
+
+__host__ tdpError_t tdpHostThreadAffinity(int * nthread, int * cpu) {
+
+  *nthread = 1;
+  cpu[0] = -1;
+
+  return cudaSuccess;
+}
@@ -5,7 +5,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- * (c) 2018 The University of Edinburgh
+ * (c) 2018-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Alan Gray (alang@epcc.ed.ac.uk)
@@ -43,6 +43,11 @@ typedef cudaDeviceAttr tdpDeviceAttr;
 
 #define tdpHostAllocDefault cudaHostAllocDefault
 
+/* Placement hints for tdpHostAllocFirstTouch() are ignored */
+
+#define tdpHostAllocHugePage2MB 0x10
+#define tdpHostAllocHugePage1GB 0x20
+
 typedef cudaStream_t tdpStream_t;
 typedef cudaError_t tdpError_t;
 
@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2018 The University of Edinburgh
+ *  (c) 2018-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Alan Gray (Late of this parish)
@@ -15,6 +15,12 @@
  *
  *****************************************************************************/
 
+#ifdef __linux__
+#define _GNU_SOURCE          /* sched_getcpu(), MAP_HUGETLB */
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
@@ -34,6 +40,17 @@ static tdpError_t lastError = tdpSuccess;
 static char lastErrorString[BUFSIZ] = "";
 static int staticStream;
 
+/* Explicit (hugetlbfs) mappings must be released via munmap() */
+
+#define TDP_HOST_MMAP_MAX 64
+
+typedef struct tdp_host_mmap_s {
+  void * ptr;
+  size_t size;
+} tdp_host_mmap_t;
+
+static tdp_host_mmap_t hostMmap[TDP_HOST_MMAP_MAX];
+
 /* Utilities */
 
 static void error_boke(int line, tdpError_t error) {
@@ -97,6 +114,29 @@ void tdp_x86_postlaunch(void) {
   return;
 }
 
+/*****************************************************************************
+ *
+ *  tdpLaunchSequence
+ *
+ *  One parallel region (a persistent team) for the kernels launched
+ *  by fn(arg): each tdpLaunchKernel() then has only a barrier.
+ *
+ *****************************************************************************/
+
+tdpError_t tdpLaunchSequence(tdpHostFn_t fn, void * arg) {
+
+  error_return_if(fn == NULL, tdpErrorInvalidValue);
+
+#ifdef _OPENMP
+  #pragma omp parallel
+#endif
+  {
+    fn(arg);
+  }
+
+  return tdpSuccess;
+}
+
 /*****************************************************************************
  *
  *  tdpDeviceGetCacheConfig
@@ -160,6 +200,19 @@ tdpError_t tdpFree(void * devPtr) {
 
 tdpError_t tdpFreeHost(void * ptr) {
 
+  int n;
+
+  for (n = 0; n < TDP_HOST_MMAP_MAX; n++) {
+    if (ptr && hostMmap[n].ptr == ptr) {
+#ifdef __linux__
+      munmap(ptr, hostMmap[n].size);
+#endif
+      hostMmap[n].ptr = NULL;
+      hostMmap[n].size = 0;
+      return tdpSuccess;
+    }
+  }
+
   free(ptr);
 
   return tdpSuccess;
@@ -359,6 +412,117 @@ tdpError_t tdpHostAlloc(void ** phost, size_t size, unsigned int flags) {
   return tdpSuccess;
 }
 
+/*****************************************************************************
+ *
+ *  tdpHostAllocFirstTouch
+ *
+ *  Host allocation of nblock contiguous blocks each of nsite sites of
+ *  sitesize bytes. The memory is zeroed by the same static worksharing
+ *  over sites as for_simt_parallel in the kernels, so that pages are
+ *  first touched by (and so are local to) the thread that will own them.
+ *
+ *  Flags tdpHostAllocHugePage2MB uses 2 MB alignment and requests
+ *  transparent huge pages; tdpHostAllocHugePage1GB attempts an explicit
+ *  1 GB hugetlbfs mapping, falling back to 2 MB if none is available.
+ *
+ *  Release via tdpFreeHost().
+ *
+ *****************************************************************************/
+
+tdpError_t tdpHostAllocFirstTouch(void ** phost, size_t nblock, size_t nsite,
+				  size_t sitesize, unsigned int flags) {
+
+  size_t size = nblock*nsite*sitesize;
+  size_t align = 4096;
+  char * ptr = NULL;
+
+  error_return_if(phost == NULL, tdpErrorInvalidValue);
+  error_return_if(size < 1, tdpErrorInvalidValue);
+
+#if defined __linux__ && defined MAP_HUGETLB && defined MAP_HUGE_SHIFT
+  if (flags & tdpHostAllocHugePage1GB) {
+    size_t sz = ((size + (1UL << 30) - 1) >> 30) << 30;
+    int n;
+
+    for (n = 0; n < TDP_HOST_MMAP_MAX; n++) {
+      if (hostMmap[n].ptr == NULL) break;
+    }
+
+    if (n < TDP_HOST_MMAP_MAX) {
+      void * p = mmap(NULL, sz, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB
+		      | (30 << MAP_HUGE_SHIFT), -1, 0);
+      if (p != MAP_FAILED) {
+	hostMmap[n].ptr = p;
+	hostMmap[n].size = sz;
+	ptr = (char *) p;
+      }
+    }
+  }
+#endif
+
+  if (ptr == NULL) {
+    void * p = NULL;
+    if (flags & (tdpHostAllocHugePage2MB | tdpHostAllocHugePage1GB)) {
+      align = (2UL << 20);
+    }
+    if (posix_memalign(&p, align, size)) p = NULL;
+    error_return_if(p == NULL, tdpErrorMemoryAllocation);
+#if defined __linux__ && defined MADV_HUGEPAGE
+    if (align > 4096) madvise(p, size, MADV_HUGEPAGE);
+#endif
+    ptr = (char *) p;
+  }
+
+#ifdef _OPENMP
+  #pragma omp parallel
+#endif
+  {
+    size_t ib;
+    size_t is;
+    for (ib = 0; ib < nblock; ib++) {
+      char * block = ptr + ib*nsite*sitesize;
+      for_simt_parallel(is, nsite, 1) {
+	memset(block + is*sitesize, 0, sitesize);
+      }
+    }
+  }
+
+  *phost = ptr;
+
+  return tdpSuccess;
+}
+
+/*****************************************************************************
+ *
+ *  tdpHostThreadAffinity
+ *
+ *  Logical cpu currently running each host thread (-1 if unknown).
+ *
+ *****************************************************************************/
+
+tdpError_t tdpHostThreadAffinity(int * nthread, int * cpu) {
+
+  error_return_if(nthread == NULL, tdpErrorInvalidValue);
+  error_return_if(cpu == NULL, tdpErrorInvalidValue);
+
+  *nthread = omp_get_max_threads();
+
+#ifdef _OPENMP
+  #pragma omp parallel
+#endif
+  {
+    int id = omp_get_thread_num();
+#ifdef __linux__
+    cpu[id] = sched_getcpu();
+#else
+    cpu[id] = -1;
+#endif
+  }
+
+  return tdpSuccess;
+}
+
 /*****************************************************************************
  *
  *  tdpMalloc
@@ -5,7 +5,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2018 The University of Edinbugh
+ *  (c) 2018-2019 The University of Edinbugh
  *
  *  Contributing authors:
  *  Alan Gray (alang@epcc.ed.ac.uk)
@@ -82,6 +82,11 @@ enum tdpError {
 #define tdpHostAllocPortable      0x01
 #define tdpHostAllocWriteCombined 0x04
 
+/* Placement hints for tdpHostAllocFirstTouch() (host only) */
+
+#define tdpHostAllocHugePage2MB   0x10
+#define tdpHostAllocHugePage1GB   0x20
+
 #define tdpMemAttachGlobal        0x01
 #define tdpMemAttachHost          0x02
 #define tdpMemAttachSingle        0x04
@@ -157,12 +162,21 @@ void  tdp_x86_postlaunch(void);
 #define __syncthreads() _Pragma("omp barrier")
 
 /* Kernel launch is a __VA_ARGS__ macro, thus: */
+/* Within an existing parallel region (tdpLaunchSequence()) the current
+ * team executes the kernel, followed by a barrier. */
 #define tdpLaunchKernel(kernel, nblocks, nthreads, shmem, stream, ...) \
+  if (omp_in_parallel()) {					       \
+    tdp_x86_prelaunch(nblocks, nthreads);			       \
+    kernel(__VA_ARGS__);					       \
+    _Pragma("omp barrier")					       \
+  }								       \
+  else {							       \
   _Pragma("omp parallel")					       \
   {								       \
     tdp_x86_prelaunch(nblocks, nthreads);			       \
     kernel(__VA_ARGS__);					       \
     tdp_x86_postlaunch();					       \
+  }								       \
   }
 
   /* OpenMP work sharing */
@@ -0,0 +1,69 @@
+#!/usr/bin/awk -f
+
+##############################################################################
+#
+#  benchmark-compare.sh [-v threshold=0.9] reference.csv current.csv
+#
+#  Compare two sets of kernel benchmark results (see benchmark.c).
+#  Records are matched on kernel, data model, NSIMDVL, local size,
+#  ranks and threads; for each match the ratio of the current to the
+#  reference MLUPS is reported. A ratio below the threshold (default
+#  0.9) is flagged as a "SLOWER" regression.
+#
+#  Exit status is the number of regressions.
+#
+#  Edinburgh Soft Matter and Statistical Physics Group and
+#  Edinburgh Parallel Computing Centre
+#
+#  Kevin Stratford (kevin@epcc.ed.ac.uk)
+#  (c) 2019 The University of Edinburgh
+#
+##############################################################################
+
+BEGIN {
+
+  FS = ","
+
+  if (ARGC != 3) {
+    print "usage: benchmark-compare.sh [-v threshold=0.9] ref.csv new.csv"
+    nslower = -1
+    exit
+  }
+
+  if (threshold == "") threshold = 0.9
+}
+
+# Skip the header line in each file; column 9 is mlups
+
+FNR == 1 {
+  next
+}
+
+{
+  key = $1 " " $2 " " $3 " " $4 " " $5 " " $6
+}
+
+NR == FNR {
+  reference[key] = $9
+  next
+}
+
+key in reference {
+
+  ratio = 0.0
+  if (reference[key] > 0.0) ratio = $9/reference[key]
+
+  status = "ok"
+  if (ratio < threshold) {
+    status = "SLOWER"
+    nslower += 1
+  }
+  if (ratio > 1.0/threshold) status = "faster"
+
+  printf "%-28s %-6s vvl %2d n %4d ranks %4d threads %4d  %10.3f %10.3f %7.3f %s\n", \
+    $1, $2, $3, $4, $5, $6, reference[key], $9, ratio, status
+}
+
+END {
+  exit nslower
+}
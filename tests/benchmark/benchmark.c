@@ -0,0 +1,770 @@
+/*****************************************************************************
+ *
+ *  benchmark.c
+ *
+ *  Kernel micro-benchmarks.
+ *
+ *  Each hot kernel is run in isolation on synthetic data for a range of
+ *  local (per rank) subdomain sizes n^3. The data model (AOS, SOA,
+ *  AOSOA) and NSIMDVL are fixed at compile time (see memory.h), so
+ *  the comparison between data models is made by rebuilding (see
+ *  "make benchmark-all" in the tests directory).
+ *
+ *  Usage: ./Benchmark.exe [-r nrepeat] [-m mbytes] [-o file.csv] [n ...]
+ *
+ *    -r   timed repeats of each kernel (default 10)
+ *    -m   size of each STREAM triad array in MB (default 64)
+ *    -o   output file (default benchmark-<model>-vvl<NSIMDVL>.csv)
+ *    n    local subdomain sizes (default 16 24 32 48 64)
+ *
+ *  For each kernel the report gives million lattice site updates per
+ *  second (all ranks), an estimate of the bandwidth from the minimum
+ *  traffic per site (each array element read or written once), and
+ *  that bandwidth as a fraction of the STREAM triad bandwidth measured
+ *  on the same ranks at start up. The times are the maximum over ranks.
+ *
+ *  The output is CSV with one record per kernel per size, suitable
+ *  for comparison with a previous run via benchmark-compare.sh.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pe.h"
+#include "coords.h"
+#include "kernel.h"
+#include "memory.h"
+#include "timer.h"
+#include "physics.h"
+#include "leesedwards.h"
+#include "lb_model_s.h"
+#include "collision.h"
+#include "propagation.h"
+#include "hydro.h"
+#include "map.h"
+#include "noise.h"
+#include "field.h"
+#include "field_grad.h"
+#include "gradient_3d_7pt_fluid.h"
+#include "gradient_3d_27pt_fluid.h"
+#include "symmetric.h"
+#include "blue_phase.h"
+#include "blue_phase_beris_edwards.h"
+#include "phi_force_colloid.h"
+#include "phi_cahn_hilliard.h"
+#include "advection.h"
+#include "util.h"
+
+typedef struct benchmark_s benchmark_t;
+
+struct benchmark_s {
+  pe_t * pe;
+  int nrepeat;          /* Timed repeats of each kernel */
+  double stream;        /* STREAM triad bandwidth (GB/s, all ranks) */
+  FILE * fp;            /* CSV output (root only) */
+};
+
+static const char * data_model_name[] = {"AOS", "SOA", "AOSOA"};
+
+static int benchmark_stream(benchmark_t * bm, int mbytes);
+static int benchmark_lb(benchmark_t * bm, cs_t * cs, lees_edw_t * le,
+			int ndist);
+static int benchmark_field(benchmark_t * bm, cs_t * cs, lees_edw_t * le);
+static int benchmark_lc(benchmark_t * bm, cs_t * cs, lees_edw_t * le);
+static double benchmark_start(benchmark_t * bm);
+static int benchmark_report(benchmark_t * bm, cs_t * cs, const char * kernel,
+			    double t0, double nbyte);
+static int benchmark_phi_init(cs_t * cs, field_t * phi);
+
+__global__ void benchmark_triad_kernel(int n, double s, double * a,
+				       const double * b, const double * c);
+
+/*****************************************************************************
+ *
+ *  main
+ *
+ *****************************************************************************/
+
+int main(int argc, char ** argv) {
+
+  int n, na;
+  int nsize = 0;
+  int size[BUFSIZ];
+  int mbytes = 64;
+  int nhalo = 2;        /* Sufficient for all the kernels here */
+  char filename[FILENAME_MAX];
+
+  benchmark_t bm = {NULL, 10, 0.0, NULL};
+
+  MPI_Init(&argc, &argv);
+
+  pe_create(MPI_COMM_WORLD, PE_QUIET, &bm.pe);
+  TIMER_init(bm.pe);
+
+  sprintf(filename, "benchmark-%s-vvl%d.csv", data_model_name[DATA_MODEL],
+	  NSIMDVL);
+
+  for (na = 1; na < argc; na++) {
+    if (strcmp(argv[na], "-r") == 0 && na + 1 < argc) {
+      bm.nrepeat = atoi(argv[++na]);
+    }
+    else if (strcmp(argv[na], "-m") == 0 && na + 1 < argc) {
+      mbytes = atoi(argv[++na]);
+    }
+    else if (strcmp(argv[na], "-o") == 0 && na + 1 < argc) {
+      sprintf(filename, "%s", argv[++na]);
+    }
+    else if (atoi(argv[na]) > 0 && nsize < BUFSIZ) {
+      size[nsize++] = atoi(argv[na]);
+    }
+    else {
+      pe_fatal(bm.pe, "Usage: %s [-r nrepeat] [-m mbytes] [-o file] [n ...]\n",
+	       argv[0]);
+    }
+  }
+
+  if (bm.nrepeat < 1) pe_fatal(bm.pe, "nrepeat must be at least 1\n");
+
+  if (nsize == 0) {
+    size[nsize++] = 16;
+    size[nsize++] = 24;
+    size[nsize++] = 32;
+    size[nsize++] = 48;
+    size[nsize++] = 64;
+  }
+
+  if (pe_mpi_rank(bm.pe) == 0) {
+    bm.fp = fopen(filename, "w");
+    if (bm.fp == NULL) pe_fatal(bm.pe, "fopen(%s) failed\n", filename);
+    fprintf(bm.fp, "kernel,data_model,nsimdvl,nlocal,nrank,nthread,nrepeat,"
+	    "time,mlups,gbytes_s,stream_gbytes_s,stream_fraction\n");
+  }
+
+  pe_info(bm.pe, "Kernel benchmarks\n");
+  pe_info(bm.pe, "-----------------\n");
+  pe_info(bm.pe, "Data model:                 %14s\n",
+	  data_model_name[DATA_MODEL]);
+  pe_info(bm.pe, "NSIMDVL:                    %14d\n", NSIMDVL);
+  pe_info(bm.pe, "MPI ranks:                  %14d\n", pe_mpi_size(bm.pe));
+  pe_info(bm.pe, "Threads per rank:           %14d\n",
+	  tdp_get_max_threads());
+  pe_info(bm.pe, "Repeats:                    %14d\n", bm.nrepeat);
+  pe_info(bm.pe, "Output:                     %14s\n", filename);
+
+  benchmark_stream(&bm, mbytes);
+
+  pe_info(bm.pe, "STREAM triad (GB/s):        %14.3f\n", bm.stream);
+  pe_info(bm.pe, "\n");
+  pe_info(bm.pe, "%-28s %6s %12s %12s %12s %8s\n", "kernel", "nlocal",
+	  "time (s)", "MLUPS", "GB/s", "STREAM");
+
+  for (n = 0; n < nsize; n++) {
+
+    int ntotal[3];
+    int decomp[3] = {0, 0, 0};
+    cs_t * cs = NULL;
+    lees_edw_t * le = NULL;
+    physics_t * phys = NULL;
+
+    /* Global size is the local size times the decomposition */
+
+    MPI_Dims_create(pe_mpi_size(bm.pe), 3, decomp);
+    ntotal[X] = size[n]*decomp[X];
+    ntotal[Y] = size[n]*decomp[Y];
+    ntotal[Z] = size[n]*decomp[Z];
+
+    cs_create(bm.pe, &cs);
+    cs_ntotal_set(cs, ntotal);
+    cs_decomposition_set(cs, decomp);
+    cs_nhalo_set(cs, nhalo);
+    cs_init(cs);
+
+    physics_create(bm.pe, &phys);
+    physics_eta_shear_set(phys, 0.1);
+    physics_eta_bulk_set(phys, 0.1);
+    physics_mobility_set(phys, 0.1);
+
+    lees_edw_create(bm.pe, cs, NULL, &le);
+
+    benchmark_lb(&bm, cs, le, 1);
+    benchmark_lb(&bm, cs, le, 2);
+    benchmark_field(&bm, cs, le);
+    benchmark_lc(&bm, cs, le);
+
+    lees_edw_free(le);
+    physics_free(phys);
+    cs_free(cs);
+  }
+
+  if (bm.fp) fclose(bm.fp);
+
+  pe_free(bm.pe);
+  MPI_Finalize();
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  benchmark_stream
+ *
+ *  STREAM triad a = b + s*c on the target, as the reference bandwidth.
+ *  By the STREAM convention, three arrays are counted. The best of
+ *  nrepeat is taken (all ranks run concurrently).
+ *
+ *****************************************************************************/
+
+static int benchmark_stream(benchmark_t * bm, int mbytes) {
+
+  int n;
+  int nlen;
+  double t0, t, tmax;
+  double tbest = 0.0;
+  double * a = NULL;
+  double * b = NULL;
+  double * c = NULL;
+  double * tmp = NULL;
+  dim3 nblk, ntpb;
+  MPI_Comm comm;
+
+  assert(bm);
+
+  nlen = imax(1, mbytes)*(1024*1024/sizeof(double));
+  pe_mpi_comm(bm->pe, &comm);
+
+  tmp = (double *) malloc(nlen*sizeof(double));
+  if (tmp == NULL) pe_fatal(bm->pe, "malloc(stream) failed\n");
+  for (n = 0; n < nlen; n++) {
+    tmp[n] = 1.0;
+  }
+
+  tdpAssert(tdpMalloc((void **) &a, nlen*sizeof(double)));
+  tdpAssert(tdpMalloc((void **) &b, nlen*sizeof(double)));
+  tdpAssert(tdpMalloc((void **) &c, nlen*sizeof(double)));
+  tdpAssert(tdpMemcpy(a, tmp, nlen*sizeof(double), tdpMemcpyHostToDevice));
+  tdpAssert(tdpMemcpy(b, tmp, nlen*sizeof(double), tdpMemcpyHostToDevice));
+  tdpAssert(tdpMemcpy(c, tmp, nlen*sizeof(double), tdpMemcpyHostToDevice));
+
+  kernel_launch_param(nlen, &nblk, &ntpb);
+
+  /* One untimed pass, then nrepeat timed */
+
+  for (n = 0; n <= bm->nrepeat; n++) {
+    MPI_Barrier(comm);
+    t0 = MPI_Wtime();
+    tdpLaunchKernel(benchmark_triad_kernel, nblk, ntpb, 0, 0,
+		    nlen, 3.0, a, b, c);
+    tdpAssert(tdpPeekAtLastError());
+    tdpAssert(tdpDeviceSynchronize());
+    t = MPI_Wtime() - t0;
+    MPI_Allreduce(&t, &tmax, 1, MPI_DOUBLE, MPI_MAX, comm);
+    if (n == 1 || (n > 1 && tmax < tbest)) tbest = tmax;
+  }
+
+  bm->stream = 0.0;
+  if (tbest > 0.0) {
+    bm->stream = 1.0e-09*3.0*sizeof(double)*nlen*pe_mpi_size(bm->pe)/tbest;
+  }
+
+  tdpFree(c);
+  tdpFree(b);
+  tdpFree(a);
+  free(tmp);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  benchmark_triad_kernel
+ *
+ *****************************************************************************/
+
+__global__ void benchmark_triad_kernel(int n, double s, double * a,
+				       const double * b, const double * c) {
+  int i;
+
+  for_simt_parallel(i, n, 1) {
+    a[i] = b[i] + s*c[i];
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  benchmark_lb
+ *
+ *  Propagation, halo swap, and collision (single fluid mrt1 for
+ *  ndist = 1, binary fluid mrt2 for ndist = 2).
+ *
+ *****************************************************************************/
+
+static int benchmark_lb(benchmark_t * bm, cs_t * cs, lees_edw_t * le,
+			int ndist) {
+
+  int n;
+  int nlocal[3];
+  int nhalosite;
+  double t0;
+  double nbyte;
+  double nsite;
+  lb_t * lb = NULL;
+  hydro_t * hydro = NULL;
+  map_t * map = NULL;
+  noise_t * noise = NULL;
+  field_t * phi = NULL;
+  field_grad_t * dphi = NULL;
+  fe_symm_t * fe = NULL;
+
+  assert(bm);
+  assert(cs);
+
+  cs_nlocal(cs, nlocal);
+  nsite = 1.0*nlocal[X]*nlocal[Y]*nlocal[Z];
+
+  hydro_create(bm->pe, cs, NULL, 1, &hydro);
+  map_create(bm->pe, cs, 0, &map);
+  noise_create(bm->pe, cs, &noise);
+
+  lb_create_ndist(bm->pe, cs, ndist, &lb);
+  lb_init(lb);
+  lb_init_rest_f(lb, 1.0);
+  lb_memcpy(lb, tdpMemcpyHostToDevice);
+
+  if (ndist == 2) {
+    fe_symm_param_t param = {-0.0625, +0.0625, 0.04};
+    field_create(bm->pe, cs, 1, "phi", &phi);
+    field_init(phi, 2, le);
+    field_grad_create(bm->pe, phi, 2, &dphi);
+    fe_symm_create(bm->pe, cs, phi, dphi, &fe);
+    fe_symm_param_set(fe, param);
+    benchmark_phi_init(cs, phi);
+    field_memcpy(phi, tdpMemcpyHostToDevice);
+    grad_3d_7pt_fluid_d2(dphi);
+  }
+
+  /* Collision: read and write distributions; read force, write u.
+   * The binary collision also reads phi and its gradients. */
+
+  nbyte = 2.0*NVEL*ndist*sizeof(lb_real_t) + 2.0*NDIM*sizeof(double);
+  if (ndist == 2) nbyte += (1.0 + NVECTOR + 1.0)*sizeof(double);
+
+  lb_collide(lb, hydro, map, noise, (fe_t *) fe);
+  t0 = benchmark_start(bm);
+  for (n = 0; n < bm->nrepeat; n++) {
+    lb_collide(lb, hydro, map, noise, (fe_t *) fe);
+  }
+  benchmark_report(bm, cs, (ndist == 1) ? "lb_collision_mrt1" :
+		   "lb_collision_mrt2", t0, nsite*nbyte);
+
+  if (ndist == 1) {
+
+    /* Propagation: read and write each distribution */
+
+    nbyte = 2.0*NVEL*ndist*sizeof(lb_real_t);
+
+    lb_propagation(lb);
+    t0 = benchmark_start(bm);
+    for (n = 0; n < bm->nrepeat; n++) {
+      lb_propagation(lb);
+    }
+    benchmark_report(bm, cs, "lb_propagation_kernel", t0, nsite*nbyte);
+
+    /* Halo swap: each halo value is packed (read, write) and unpacked
+     * (read, write) */
+
+    nhalosite = (nlocal[X] + 2)*(nlocal[Y] + 2)*(nlocal[Z] + 2) - nsite;
+    nbyte = 4.0*nhalosite*NVEL*ndist*sizeof(lb_real_t);
+
+    lb_halo_swap(lb, LB_HALO_TARGET);
+    t0 = benchmark_start(bm);
+    for (n = 0; n < bm->nrepeat; n++) {
+      lb_halo_swap(lb, LB_HALO_TARGET);
+    }
+    benchmark_report(bm, cs, "halo_swap_packed", t0, nbyte);
+  }
+
+  if (fe) fe_symm_free(fe);
+  if (dphi) field_grad_free(dphi);
+  if (phi) field_free(phi);
+  lb_free(lb);
+  noise_free(noise);
+  map_free(map);
+  hydro_free(hydro);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  benchmark_field
+ *
+ *  Gradients, Cahn-Hilliard diffusive flux and update, and advective
+ *  fluxes for a scalar order parameter.
+ *
+ *****************************************************************************/
+
+static int benchmark_field(benchmark_t * bm, cs_t * cs, lees_edw_t * le) {
+
+  int n, order;
+  int nsites;
+  int nlocal[3];
+  double t0;
+  double nbyte;
+  double nsite;
+  double u0[3] = {0.01, -0.01, 0.01};
+  field_t * phi = NULL;
+  field_grad_t * dphi = NULL;
+  fe_symm_t * fe = NULL;
+  fe_symm_param_t param = {-0.0625, +0.0625, 0.04};
+  hydro_t * hydro = NULL;
+  phi_ch_t * pch = NULL;
+  advflux_t * flux = NULL;
+
+  const char * advname[] = {"advection_le_1st_kernel",
+			    "advection_2nd_kernel_v",
+			    "advection_3rd_kernel_v"};
+
+  assert(bm);
+  assert(cs);
+
+  cs_nlocal(cs, nlocal);
+  nsite = 1.0*nlocal[X]*nlocal[Y]*nlocal[Z];
+
+  field_create(bm->pe, cs, 1, "phi", &phi);
+  field_init(phi, 2, le);
+  field_grad_create(bm->pe, phi, 2, &dphi);
+  fe_symm_create(bm->pe, cs, phi, dphi, &fe);
+  fe_symm_param_set(fe, param);
+
+  benchmark_phi_init(cs, phi);
+  field_memcpy(phi, tdpMemcpyHostToDevice);
+
+  /* Gradients: read phi; write grad and delsq */
+
+  nbyte = (1.0 + NVECTOR + 1.0)*sizeof(double);
+
+  grad_3d_7pt_fluid_d2(dphi);
+  t0 = benchmark_start(bm);
+  for (n = 0; n < bm->nrepeat; n++) {
+    grad_3d_7pt_fluid_d2(dphi);
+  }
+  benchmark_report(bm, cs, "grad_3d_7pt_fluid_kernel_v", t0, nsite*nbyte);
+
+  grad_3d_27pt_fluid_d2(dphi);
+  t0 = benchmark_start(bm);
+  for (n = 0; n < bm->nrepeat; n++) {
+    grad_3d_27pt_fluid_d2(dphi);
+  }
+  benchmark_report(bm, cs, "grad_3d_27pt_fluid", t0, nsite*nbyte);
+
+  /* Cahn-Hilliard (no advection): the flux kernel reads phi, delsq phi
+   * and writes four face fluxes; the update reads the fluxes and
+   * reads and writes phi. The phi values are restored afterwards. */
+
+  phi_ch_create(bm->pe, cs, le, NULL, &pch);
+
+  nbyte = (2.0 + 4.0 + 4.0 + 2.0)*sizeof(double);
+
+  phi_cahn_hilliard(pch, (fe_t *) fe, phi, NULL, NULL, NULL);
+  t0 = benchmark_start(bm);
+  for (n = 0; n < bm->nrepeat; n++) {
+    phi_cahn_hilliard(pch, (fe_t *) fe, phi, NULL, NULL, NULL);
+  }
+  benchmark_report(bm, cs, "phi_ch_flux_mu1_kernel", t0, nsite*nbyte);
+
+  phi_ch_free(pch);
+  benchmark_phi_init(cs, phi);
+  field_memcpy(phi, tdpMemcpyHostToDevice);
+
+  /* Advective fluxes: read phi and u; write four face fluxes */
+
+  hydro_create(bm->pe, cs, le, 1, &hydro);
+  cs_nsites(cs, &nsites);
+  for (n = 0; n < nsites; n++) {
+    hydro_u_set(hydro, n, u0);
+  }
+  hydro_memcpy(hydro, tdpMemcpyHostToDevice);
+  advflux_le_create(bm->pe, cs, le, 1, &flux);
+
+  nbyte = (1.0 + 3.0 + 4.0)*sizeof(double);
+
+  for (order = 1; order <= 3; order++) {
+    advection_order_set(order);
+    advection_x(flux, hydro, phi);
+    t0 = benchmark_start(bm);
+    for (n = 0; n < bm->nrepeat; n++) {
+      advection_x(flux, hydro, phi);
+    }
+    benchmark_report(bm, cs, advname[order-1], t0, nsite*nbyte);
+  }
+
+  advflux_free(flux);
+  hydro_free(hydro);
+  fe_symm_free(fe);
+  field_grad_free(dphi);
+  field_free(phi);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  benchmark_lc
+ *
+ *  Beris-Edwards update (no hydrodynamics) for a liquid crystal Q_ab,
+ *  and the force on the fluid from the divergence of the stress.
+ *
+ *****************************************************************************/
+
+static int benchmark_lc(benchmark_t * bm, cs_t * cs, lees_edw_t * le) {
+
+  int n;
+  int ic, jc, kc, index;
+  int nlocal[3];
+  int noffset[3];
+  double t0;
+  double nbyte;
+  double nsite;
+  double q[3][3];
+  field_t * fq = NULL;
+  field_grad_t * dq = NULL;
+  fe_lc_t * fe = NULL;
+  fe_lc_param_t param = {0};
+  beris_edw_t * be = NULL;
+  beris_edw_param_t beparam = {0};
+  map_t * map = NULL;
+  hydro_t * hydro = NULL;
+  pth_t * pth = NULL;
+
+  assert(bm);
+  assert(cs);
+
+  cs_nlocal(cs, nlocal);
+  cs_nlocal_offset(cs, noffset);
+  nsite = 1.0*nlocal[X]*nlocal[Y]*nlocal[Z];
+
+  field_create(bm->pe, cs, NQAB, "q", &fq);
+  field_init(fq, 2, le);
+  field_grad_create(bm->pe, fq, 2, &dq);
+  map_create(bm->pe, cs, 0, &map);
+
+  param.a0 = 0.01;
+  param.q0 = 0.19635;
+  param.gamma = 3.0;
+  param.kappa0 = 0.01;
+  param.kappa1 = 0.01;
+  param.xi = 0.7;
+  param.redshift = 1.0;
+  param.rredshift = 1.0;
+
+  fe_lc_create(bm->pe, cs, le, fq, dq, &fe);
+  fe_lc_param_set(fe, param);
+
+  beparam.xi = param.xi;
+  beparam.gamma = 0.3;
+  beris_edw_create(bm->pe, cs, le, &be);
+  beris_edw_param_set(be, beparam);
+
+  /* A modulated uniaxial order (not a solution; any smooth data will do) */
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	double theta = param.q0*(noffset[Z] + kc);
+	index = cs_index(cs, ic, jc, kc);
+	q[X][X] = 0.3*(cos(theta)*cos(theta) - 1.0/3.0);
+	q[X][Y] = 0.3*cos(theta)*sin(theta);
+	q[X][Z] = 0.0;
+	q[Y][X] = q[X][Y];
+	q[Y][Y] = 0.3*(sin(theta)*sin(theta) - 1.0/3.0);
+	q[Y][Z] = 0.0;
+	q[Z][X] = 0.0;
+	q[Z][Y] = 0.0;
+	q[Z][Z] = -q[X][X] - q[Y][Y];
+	field_tensor_set(fq, index, q);
+      }
+    }
+  }
+
+  field_memcpy(fq, tdpMemcpyHostToDevice);
+  map_memcpy(map, tdpMemcpyHostToDevice);
+  grad_3d_7pt_fluid_d2(dq);
+
+  /* Update (molecular field computed on the fly): read q, grad q,
+   * delsq q; write q. */
+
+  nbyte = (NQAB*(1.0 + NVECTOR + 1.0) + NQAB)*sizeof(double);
+
+  beris_edw_update(be, (fe_t *) fe, fq, dq, NULL, NULL, map, NULL);
+  t0 = benchmark_start(bm);
+  for (n = 0; n < bm->nrepeat; n++) {
+    beris_edw_update(be, (fe_t *) fe, fq, dq, NULL, NULL, map, NULL);
+  }
+  benchmark_report(bm, cs, "beris_edw_kernel_v", t0, nsite*nbyte);
+
+  /* Fused relaxational update (gradients computed in the kernel):
+   * read q; write new q, and read it back and write q. */
+
+  nbyte = (NQAB + 2.0*NQAB + NQAB)*sizeof(double);
+
+  beris_edw_fused_set(be, 1);
+  t0 = benchmark_start(bm);
+  for (n = 0; n < bm->nrepeat; n++) {
+    beris_edw_update(be, (fe_t *) fe, fq, dq, NULL, NULL, map, NULL);
+  }
+  benchmark_report(bm, cs, "beris_edw_fused_kernel_v", t0, nsite*nbyte);
+  beris_edw_fused_set(be, 0);
+
+  /* Force from the divergence of the stress. Stored: read q, grad q,
+   * delsq q; write and read back the stress; update f. Fused: as
+   * stored without the stress. */
+
+  hydro_create(bm->pe, cs, le, 1, &hydro);
+  pth_create(bm->pe, cs, PTH_METHOD_DIVERGENCE, &pth);
+
+  nbyte = (NQAB*(1.0 + NVECTOR + 1.0) + 2.0*9.0 + 2.0*3.0)*sizeof(double);
+
+  t0 = benchmark_start(bm);
+  for (n = 0; n < bm->nrepeat; n++) {
+    pth_stress_compute(pth, (fe_t *) fe);
+    pth_force_fluid_driver(pth, hydro);
+  }
+  benchmark_report(bm, cs, "pth_force_fluid_kernel_v", t0, nsite*nbyte);
+
+  nbyte = (NQAB*(1.0 + NVECTOR + 1.0) + 2.0*3.0)*sizeof(double);
+
+  t0 = benchmark_start(bm);
+  for (n = 0; n < bm->nrepeat; n++) {
+    pth_force_fluid_fused_driver(pth, (fe_t *) fe, hydro);
+  }
+  benchmark_report(bm, cs, "pth_force_fluid_fused_kernel", t0, nsite*nbyte);
+
+  pth_free(pth);
+  hydro_free(hydro);
+  beris_edw_free(be);
+  fe_lc_free(fe);
+  map_free(map);
+  field_grad_free(dq);
+  field_free(fq);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  benchmark_phi_init
+ *
+ *  Small deterministic spatial variation about zero at all sites.
+ *
+ *****************************************************************************/
+
+static int benchmark_phi_init(cs_t * cs, field_t * phi) {
+
+  int ic, jc, kc, index;
+  int nhalo;
+  int nlocal[3];
+
+  assert(cs);
+  assert(phi);
+
+  cs_nhalo(cs, &nhalo);
+  cs_nlocal(cs, nlocal);
+
+  for (ic = 1 - nhalo; ic <= nlocal[X] + nhalo; ic++) {
+    for (jc = 1 - nhalo; jc <= nlocal[Y] + nhalo; jc++) {
+      for (kc = 1 - nhalo; kc <= nlocal[Z] + nhalo; kc++) {
+	int m = (ic + 2*jc + 3*kc + 3*nhalo) % 7;
+	index = cs_index(cs, ic, jc, kc);
+	field_scalar_set(phi, index, 0.1*(m - 3));
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  benchmark_start
+ *
+ *  All ranks start together.
+ *
+ *****************************************************************************/
+
+static double benchmark_start(benchmark_t * bm) {
+
+  MPI_Comm comm;
+
+  assert(bm);
+
+  pe_mpi_comm(bm->pe, &comm);
+  MPI_Barrier(comm);
+
+  return MPI_Wtime();
+}
+
+/*****************************************************************************
+ *
+ *  benchmark_report
+ *
+ *  nbyte is the estimated local traffic per call. Collective.
+ *
+ *****************************************************************************/
+
+static int benchmark_report(benchmark_t * bm, cs_t * cs, const char * kernel,
+			    double t0, double nbyte) {
+  int nlocal[3];
+  int nrank;
+  double t, tmax;
+  double nsite;
+  double mlups = 0.0;
+  double gbytes = 0.0;
+  double fraction = 0.0;
+  MPI_Comm comm;
+
+  assert(bm);
+  assert(cs);
+  assert(kernel);
+
+  t = MPI_Wtime() - t0;
+
+  pe_mpi_comm(bm->pe, &comm);
+  MPI_Reduce(&t, &tmax, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+
+  if (bm->fp == NULL) return 0;
+
+  cs_nlocal(cs, nlocal);
+  nrank = pe_mpi_size(bm->pe);
+  nsite = 1.0*nlocal[X]*nlocal[Y]*nlocal[Z]*nrank;
+
+  if (tmax > 0.0) {
+    mlups = 1.0e-06*nsite*bm->nrepeat/tmax;
+    gbytes = 1.0e-09*nbyte*nrank*bm->nrepeat/tmax;
+  }
+  if (bm->stream > 0.0) fraction = gbytes/bm->stream;
+
+  pe_info(bm->pe, "%-28s %6d %12.6f %12.3f %12.3f %8.3f\n", kernel, nlocal[X],
+	  tmax, mlups, gbytes, fraction);
+
+  fprintf(bm->fp, "%s,%s,%d,%d,%d,%d,%d,%.6e,%.4e,%.4e,%.4e,%.4f\n",
+	  kernel, data_model_name[DATA_MODEL], NSIMDVL, nlocal[X], nrank,
+	  tdp_get_max_threads(), bm->nrepeat, tmax, mlups, gbytes,
+	  bm->stream, fraction);
+  fflush(bm->fp);
+
+  return 0;
+}
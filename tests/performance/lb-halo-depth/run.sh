@@ -0,0 +1,28 @@
+#!/bin/bash
+#
+#  Run the benchmark for each halo depth and report the messages per
+#  step per rank, and the time per step (lattice halo, time step loop)
+#  from the timer statistics.
+#
+#  Usage: ./run.sh [ludwig executable] [number of MPI ranks]
+#  Set MPIRUN for the launcher (default "mpirun -np").
+#
+
+EXE=${1:-../../../src/Ludwig.exe}
+NP=${2:-4}
+MPIRUN=${MPIRUN:-"mpirun -np"}
+
+printf "%8s %14s %14s %14s\n" "depth" "messages/step" "halo (s)" "step (s)"
+
+for k in 1 2 4 8
+do
+  sed "s/^N_cycles.*/&\nlb_halo_depth $k/" input > input-k$k
+  $MPIRUN $NP $EXE input-k$k > stdout-k$k
+
+  nstep=$(awk '/^Time steps:/ {print $NF}' stdout-k$k)
+  nmsg=$(awk '/Messages per step per rank/ {print $NF}' stdout-k$k)
+  thalo=$(awk -v n=$nstep '/Lattice halos:/ {printf "%.6f", $5/n}' stdout-k$k)
+  tstep=$(awk '/Time step loop:/ {print $7}' stdout-k$k)
+
+  printf "%8d %14s %14s %14s\n" $k "$nmsg" "$thalo" "$tstep"
+done
@@ -77,6 +77,7 @@ fi
 #   - blank lines
 #   - "Timer resolution"
 #   - exact location of the input file via "user parameters"  
+#   - host thread and memory placement via "Host"
 
 sed '/call)/d' $1 > test-diff-tmp.ref
 sed -i~ '/calls)/d' test-diff-tmp.ref
@@ -90,6 +91,7 @@ sed -i~ 's/d3q15\ R/d3q15/' test-diff-tmp.ref
 sed -i~ 's/d3q19\ R/d3q19/' test-diff-tmp.ref
 sed -i~ '/GPU\ INFO/d' test-diff-tmp.ref
 sed -i~ '/SIMD\ vector/d' test-diff-tmp.ref
+sed -i~ '/^Host\ /d' test-diff-tmp.ref
 
 sed '/call)/d' $2 > test-diff-tmp.log
 sed -i~ '/calls)/d' test-diff-tmp.log
@@ -103,6 +105,7 @@ sed -i~ 's/d3q15\ R/d3q15/' test-diff-tmp.log
 sed -i~ 's/d3q19\ R/d3q19/' test-diff-tmp.log
 sed -i~ '/GPU\ INFO/d' test-diff-tmp.log
 sed -i~ '/SIMD\ vector/d' test-diff-tmp.log
+sed -i~ '/^Host\ /d' test-diff-tmp.log
 
 # Here we use the floating point diff to measure "success"
 
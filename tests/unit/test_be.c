@@ -10,7 +10,7 @@
  *  Contributing authors:
  *    Kevin Stratford (kevin@epcc.ed.ac.uk)
  *
- *  (c) 2013-2017 The University of Edinburgh
+ *  (c) 2013-2019 The University of Edinburgh
  *
  *****************************************************************************/
 
@@ -20,14 +20,18 @@
 
 #include "pe.h"
 #include "coords.h"
+#include "physics.h"
 #include "leesedwards.h"
 #include "field.h"
 #include "field_grad.h"
+#include "gradient_3d_7pt_fluid.h"
+#include "blue_phase.h"
 #include "blue_phase_beris_edwards.h"
 #include "tests.h"
 
 static int do_test_be_tmatrix(void);
 static int do_test_be1(void);
+static int do_test_be_fused(void);
 
 /*****************************************************************************
  *
@@ -41,6 +45,7 @@ int test_be_suite(void) {
 
   do_test_be1();
   do_test_be_tmatrix();
+  do_test_be_fused();
 
   return 0;
 }
@@ -108,3 +113,158 @@ static int do_test_be_tmatrix(void) {
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  do_test_be_fused
+ *
+ *  The fused relaxational update (gradients computed in the update
+ *  kernel) must agree with the update from the stored 3d_7pt_fluid
+ *  gradients, including the noise.
+ *
+ *****************************************************************************/
+
+static int do_test_be_fused(void) {
+
+  int ic, jc, kc, index;
+  int ia, ib;
+  int nlocal[3];
+  int noffset[3];
+  int ntotal[3] = {16, 16, 16};
+  double theta;
+  double q[3][3], qfused[3][3];
+
+  pe_t * pe = NULL;
+  cs_t * cs = NULL;
+  lees_edw_t * le = NULL;
+  physics_t * phys = NULL;
+  field_t * fq = NULL;
+  field_t * fqfused = NULL;
+  field_grad_t * dq = NULL;
+  field_grad_t * dqfused = NULL;
+  map_t * map = NULL;
+  noise_t * noise = NULL;
+  fe_lc_t * fe = NULL;
+  fe_lc_param_t param = {0};
+  beris_edw_t * be = NULL;
+  beris_edw_t * befused = NULL;
+  beris_edw_param_t beparam = {0};
+
+  pe_create(MPI_COMM_WORLD, PE_QUIET, &pe);
+  cs_create(pe, &cs);
+  cs_nhalo_set(cs, 2);
+  cs_ntotal_set(cs, ntotal);
+  cs_init(cs);
+  cs_nlocal(cs, nlocal);
+  cs_nlocal_offset(cs, noffset);
+  lees_edw_create(pe, cs, NULL, &le);
+
+  physics_create(pe, &phys);
+  physics_kt_set(phys, 1.0e-05);
+
+  field_create(pe, cs, NQAB, "q", &fq);
+  field_init(fq, 2, le);
+  field_grad_create(pe, fq, 2, &dq);
+  field_grad_set(dq, grad_3d_7pt_fluid_d2, NULL);
+
+  field_create(pe, cs, NQAB, "q", &fqfused);
+  field_init(fqfused, 2, le);
+  field_grad_create(pe, fqfused, 2, &dqfused);
+
+  map_create(pe, cs, 0, &map);
+
+  noise_create(pe, cs, &noise);
+  noise_mode_set(noise, NOISE_MODE_COUNTER);
+  noise_init(noise, 0);
+  noise_present_set(noise, NOISE_QAB, 1);
+
+  param.a0 = 0.01;
+  param.q0 = 0.19635;
+  param.gamma = 3.0;
+  param.kappa0 = 0.01;
+  param.kappa1 = 0.01;
+  param.xi = 0.7;
+  param.redshift = 1.0;
+  param.rredshift = 1.0;
+
+  fe_lc_create(pe, cs, le, fq, dq, &fe);
+  fe_lc_param_set(fe, param);
+  fe_lc_param_commit(fe);
+
+  beparam.xi = param.xi;
+  beparam.gamma = 0.3;
+  beris_edw_create(pe, cs, le, &be);
+  beris_edw_param_set(be, beparam);
+  beris_edw_create(pe, cs, le, &befused);
+  beris_edw_param_set(befused, beparam);
+  beris_edw_fused_set(befused, 1);
+
+  /* A helical q with a modulation in x */
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	theta = param.q0*(noffset[Z] + kc) + 0.1*(noffset[X] + ic);
+	index = cs_index(cs, ic, jc, kc);
+	q[X][X] = 0.3*(cos(theta)*cos(theta) - 1.0/3.0);
+	q[X][Y] = 0.3*cos(theta)*sin(theta);
+	q[X][Z] = 0.01*sin(theta);
+	q[Y][X] = q[X][Y];
+	q[Y][Y] = 0.3*(sin(theta)*sin(theta) - 1.0/3.0);
+	q[Y][Z] = 0.0;
+	q[Z][X] = q[X][Z];
+	q[Z][Y] = 0.0;
+	q[Z][Z] = -q[X][X] - q[Y][Y];
+	field_tensor_set(fq, index, q);
+	field_tensor_set(fqfused, index, q);
+      }
+    }
+  }
+
+  field_memcpy(fq, tdpMemcpyHostToDevice);
+  field_memcpy(fqfused, tdpMemcpyHostToDevice);
+  map_memcpy(map, tdpMemcpyHostToDevice);
+
+  field_halo(fq);
+  field_halo(fqfused);
+  field_grad_compute(dq);
+
+  beris_edw_update(be, (fe_t *) fe, fq, dq, NULL, NULL, map, noise);
+  noise_step_set(noise, 0);
+  beris_edw_update(befused, (fe_t *) fe, fqfused, dqfused, NULL, NULL, map,
+		   noise);
+
+  field_memcpy(fq, tdpMemcpyDeviceToHost);
+  field_memcpy(fqfused, tdpMemcpyDeviceToHost);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	index = cs_index(cs, ic, jc, kc);
+	field_tensor(fq, index, q);
+	field_tensor(fqfused, index, qfused);
+	for (ia = 0; ia < 3; ia++) {
+	  for (ib = 0; ib < 3; ib++) {
+	    assert(fabs(q[ia][ib] - qfused[ia][ib]) <= DBL_EPSILON);
+	  }
+	}
+      }
+    }
+  }
+
+  beris_edw_free(befused);
+  beris_edw_free(be);
+  fe_lc_free(fe);
+  noise_free(noise);
+  map_free(map);
+  field_grad_free(dqfused);
+  field_free(fqfused);
+  field_grad_free(dq);
+  field_free(fq);
+  physics_free(phys);
+  lees_edw_free(le);
+  cs_free(cs);
+  pe_free(pe);
+
+  return 0;
+}
@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2013-2017 The University of Edinburgh
+ *  (c) 2013-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -21,6 +21,7 @@
 
 #include "pe.h"
 #include "coords.h"
+#include "physics.h"
 #include "colloids_halo.h"
 #include "colloid_sums.h"
 #include "build.h"
@@ -29,6 +30,9 @@
 static int test_build_links_model_c1(pe_t * pe, cs_t * cs, double a0, double r0[3]);
 static int test_build_links_model_c2(pe_t * pe, cs_t * cs, double a0, double r0[3]);
 static int test_build_rebuild_c1(pe_t * pe, cs_t * cs, double a0, double r0[3]);
+static int test_build_link_table(pe_t * pe, cs_t * cs, double a0, double r0[3]);
+static int test_build_remove_replace(pe_t * pe, cs_t * cs, double a0,
+				     double r0[3]);
 
 /*****************************************************************************
  *
@@ -59,18 +63,24 @@ int test_build_suite(void) {
   test_build_links_model_c1(pe, cs, a0, r0);
   test_build_links_model_c2(pe, cs, a0, r0);
   test_build_rebuild_c1(pe, cs, a0, r0);
+  test_build_link_table(pe, cs, a0, r0);
+  test_build_remove_replace(pe, cs, a0, r0);
 
   a0 = 4.77;
   r0[X] = lmin[X] + delta; r0[Y] = 0.5*ltot[Y]; r0[Z] = 0.5*ltot[Z];
   test_build_links_model_c1(pe, cs, a0, r0);
   test_build_links_model_c2(pe, cs, a0, r0);
   test_build_rebuild_c1(pe, cs, a0, r0);
+  test_build_link_table(pe, cs, a0, r0);
+  test_build_remove_replace(pe, cs, a0, r0);
 
   a0 = 3.84;
   r0[X] = ltot[X]; r0[Y] = ltot[Y]; r0[Z] = ltot[Z];
   test_build_links_model_c1(pe, cs, a0, r0);
   test_build_links_model_c2(pe, cs, a0, r0);
   test_build_rebuild_c1(pe, cs, a0, r0);
+  test_build_link_table(pe, cs, a0, r0);
+  test_build_remove_replace(pe, cs, a0, r0);
 
   /* Some known cases: place the colloid in the centre and test only
    * in serial, as there is no quick way to compute in parallel. */
@@ -302,3 +312,257 @@ static int test_build_rebuild_c1(pe_t * pe, cs_t * cs, double a0, double r0[3])
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  test_build_link_table
+ *
+ *  The flat link table must agree with the link lists.
+ *
+ *****************************************************************************/
+
+static int test_build_link_table(pe_t * pe, cs_t * cs, double a0,
+				 double r0[3]) {
+
+  int ic, jc, kc;
+  int nlink = 0;
+  int ncolloid = 0;
+  int ncell[3] = {4, 4, 4};
+
+  map_t * map = NULL;
+  colloid_t * pc = NULL;
+  colloid_link_t * p_link = NULL;
+  colloids_info_t * cinfo = NULL;
+  colloid_link_table_t * table = NULL;
+
+  assert(pe);
+  assert(cs);
+
+  colloids_info_create(pe, cs, ncell, &cinfo);
+  colloids_info_map_init(cinfo);
+  map_create(pe, cs, 0, &map);
+
+  colloids_info_add_local(cinfo, 1, r0, &pc);
+  if (pc) pc->s.a0 = a0;
+  colloids_info_ntotal_set(cinfo);
+
+  colloids_halo_state(cinfo);
+  build_update_map(cs, cinfo, map);
+  build_update_links(cs, cinfo, NULL, map);
+
+  colloids_info_link_table(cinfo, &table);
+  assert(table);
+
+  /* Colloids (including halo copies) and their links appear in order */
+
+  for (ic = 0; ic <= ncell[X] + 1; ic++) {
+    for (jc = 0; jc <= ncell[Y] + 1; jc++) {
+      for (kc = 0; kc <= ncell[Z] + 1; kc++) {
+
+	colloids_info_cell_list_head(cinfo, ic, jc, kc, &pc);
+
+	for ( ; pc; pc = pc->next) {
+	  assert(table->colloid[ncolloid] == pc);
+	  for (p_link = pc->lnk; p_link; p_link = p_link->next) {
+	    if (p_link->status == LINK_UNUSED) continue;
+	    assert(table->ic[nlink] == ncolloid);
+	    assert(table->i[nlink] == p_link->i);
+	    assert(table->j[nlink] == p_link->j);
+	    assert(table->p[nlink] == p_link->p);
+	    assert(table->status[nlink] == p_link->status);
+	    nlink += 1;
+	  }
+	  ncolloid += 1;
+	}
+      }
+    }
+  }
+
+  assert(table->ncolloid == ncolloid);
+  assert(table->nlink == nlink);
+  assert(table->nlinkmax >= nlink);
+
+  map_free(map);
+  colloids_info_free(cinfo);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_build_remove_replace
+ *
+ *  Move a colloid half a lattice spacing in a fluid at rest. The site
+ *  table must contain (at least) the sites at which the map changed,
+ *  in order; the removed and replaced fluid must leave the colloid
+ *  without any correction.
+ *
+ *****************************************************************************/
+
+static int test_build_remove_replace(pe_t * pe, cs_t * cs, double a0,
+				     double r0[3]) {
+
+  int ic, jc, kc, index;
+  int p;
+  int nhalo;
+  int status;
+  int nlocal[3];
+  int ncell[3] = {2, 2, 2};
+  int n = 0;
+  int nlocal_sum[2] = {0, 0};
+  int nsum[2] = {0, 0};
+  double rho0;
+  double f;
+  MPI_Comm comm;
+
+  lb_t * lb = NULL;
+  map_t * map = NULL;
+  physics_t * phys = NULL;
+  colloid_t * pc = NULL;
+  colloid_t * pcold = NULL;
+  colloid_t * pcnew = NULL;
+  colloids_info_t * cinfo = NULL;
+  colloid_site_table_t * table = NULL;
+
+  assert(pe);
+  assert(cs);
+
+  physics_create(pe, &phys);
+  physics_rho0(phys, &rho0);
+
+  cs_nlocal(cs, nlocal);
+  cs_nhalo(cs, &nhalo);
+  cs_cart_comm(cs, &comm);
+
+  lb_create(pe, cs, &lb);
+  lb_init(lb);
+
+  for (ic = 1 - nhalo; ic <= nlocal[X] + nhalo; ic++) {
+    for (jc = 1 - nhalo; jc <= nlocal[Y] + nhalo; jc++) {
+      for (kc = 1 - nhalo; kc <= nlocal[Z] + nhalo; kc++) {
+	index = cs_index(cs, ic, jc, kc);
+	for (p = 0; p < NVEL; p++) {
+	  lb_f_set(lb, index, p, LB_RHO, wv[p]*rho0);
+	}
+      }
+    }
+  }
+
+  lb_memcpy(lb, tdpMemcpyHostToDevice);
+
+  colloids_info_create(pe, cs, ncell, &cinfo);
+  colloids_info_map_init(cinfo);
+  map_create(pe, cs, 0, &map);
+
+  colloids_info_add_local(cinfo, 1, r0, &pc);
+  if (pc) {
+    pc->s.a0 = a0;
+    pc->s.dr[X] = 0.5;
+  }
+  colloids_info_ntotal_set(cinfo);
+
+  colloids_halo_state(cinfo);
+  build_update_map(cs, cinfo, map);
+  build_update_links(cs, cinfo, NULL, map);
+
+  /* Move and remove/replace */
+
+  colloids_info_position_update(cinfo);
+  colloids_info_update_cell_list(cinfo);
+  colloids_halo_state(cinfo);
+
+  build_update_map(cs, cinfo, map);
+  build_remove_replace(NULL, cinfo, lb, NULL, NULL, NULL, NULL, map);
+
+  lb_memcpy(lb, tdpMemcpyDeviceToHost);
+
+  colloids_info_site_table(cinfo, &table);
+  assert(table);
+
+  for (ic = 1 - nhalo; ic <= nlocal[X] + nhalo; ic++) {
+    for (jc = 1 - nhalo; jc <= nlocal[Y] + nhalo; jc++) {
+      for (kc = 1 - nhalo; kc <= nlocal[Z] + nhalo; kc++) {
+
+	int is_halo = (ic < 1 || jc < 1 || kc < 1 || ic > nlocal[X] ||
+		       jc > nlocal[Y] || kc > nlocal[Z]);
+
+	index = cs_index(cs, ic, jc, kc);
+	colloids_info_map_old(cinfo, index, &pcold);
+	colloids_info_map(cinfo, index, &pcnew);
+	if (pcold == pcnew) continue;
+
+	/* Changed sites must appear, in lattice order */
+
+	while (n < table->nsite && table->index[n] < index) n += 1;
+	assert(n < table->nsite);
+	assert(table->index[n] == index);
+	assert(table->map_new[n] == pcnew);
+
+	if (pcold == NULL && !is_halo) {
+	  assert(table->type[n] == COLLOID_SITE_REMOVE);
+	  assert(table->colloid[n] == pcnew);
+	  nlocal_sum[0] += 1;
+	}
+	else if (pcnew == NULL && !is_halo) {
+	  assert(table->type[n] == COLLOID_SITE_REPLACE ||
+		 table->type[n] == COLLOID_SITE_REPLACE_LOCAL);
+	  assert(table->colloid[n] == pcold);
+	  nlocal_sum[1] += 1;
+
+	  /* Replaced fluid is at rest */
+	  for (p = 0; p < NVEL; p++) {
+	    lb_f(lb, index, p, LB_RHO, &f);
+	    assert(fabs(f - wv[p]*rho0) < DBL_EPSILON);
+	  }
+	}
+	else {
+	  assert(table->type[n] == COLLOID_SITE_MAP);
+	}
+      }
+    }
+  }
+
+  for (n = 1; n < table->nsite; n++) {
+    assert(table->index[n] > table->index[n-1]);
+  }
+
+  /* Only the sites set in the old map were reset: check the result
+   * agrees with the new map everywhere. */
+
+  for (ic = 1 - nhalo; ic <= nlocal[X] + nhalo; ic++) {
+    for (jc = 1 - nhalo; jc <= nlocal[Y] + nhalo; jc++) {
+      for (kc = 1 - nhalo; kc <= nlocal[Z] + nhalo; kc++) {
+	index = cs_index(cs, ic, jc, kc);
+	map_status(map, index, &status);
+	colloids_info_map(cinfo, index, &pcnew);
+	assert((status == MAP_COLLOID) == (pcnew != NULL));
+      }
+    }
+  }
+
+  /* Some fluid must have been both removed and replaced */
+
+  MPI_Allreduce(nlocal_sum, nsum, 2, MPI_INT, MPI_SUM, comm);
+  assert(nsum[0] > 0);
+  assert(nsum[1] > 0);
+
+  colloids_info_local_head(cinfo, &pc);
+
+  if (pc) {
+    assert(pc->s.rebuild == 1);
+    assert(fabs(pc->deltam) < FLT_EPSILON);
+    assert(fabs(pc->f0[X]) < FLT_EPSILON);
+    assert(fabs(pc->f0[Y]) < FLT_EPSILON);
+    assert(fabs(pc->f0[Z]) < FLT_EPSILON);
+    assert(fabs(pc->t0[X]) < FLT_EPSILON);
+    assert(fabs(pc->t0[Y]) < FLT_EPSILON);
+    assert(fabs(pc->t0[Z]) < FLT_EPSILON);
+  }
+
+  map_free(map);
+  colloids_info_free(cinfo);
+  lb_free(lb);
+  physics_free(phys);
+
+  return 0;
+}
@@ -0,0 +1,213 @@
+/*****************************************************************************
+ *
+ *  test_colloid_nlist.c
+ *
+ *  Colloid neighbour (Verlet) list.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "pe.h"
+#include "coords.h"
+#include "colloids_s.h"
+#include "colloids_halo.h"
+#include "colloid_nlist.h"
+#include "tests.h"
+
+int test_colloid_nlist_create(pe_t * pe, cs_t * cs);
+int test_colloid_nlist_update(pe_t * pe, cs_t * cs);
+static int test_colloid_nlist_npair(colloid_nlist_t * nlist, MPI_Comm comm);
+
+/*****************************************************************************
+ *
+ *  test_colloid_nlist_suite
+ *
+ *****************************************************************************/
+
+int test_colloid_nlist_suite(void) {
+
+  pe_t * pe = NULL;
+  cs_t * cs = NULL;
+
+  pe_create(MPI_COMM_WORLD, PE_QUIET, &pe);
+  cs_create(pe, &cs);
+  cs_init(cs);
+
+  test_colloid_nlist_create(pe, cs);
+  test_colloid_nlist_update(pe, cs);
+
+  cs_free(cs);
+  pe_info(pe, "PASS     ./unit/test_colloid_nlist\n");
+  pe_free(pe);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_colloid_nlist_create
+ *
+ *****************************************************************************/
+
+int test_colloid_nlist_create(pe_t * pe, cs_t * cs) {
+
+  int nbuild = -1;
+  int nupdate = -1;
+  double skin = -1.0;
+  double range = -1.0;
+  colloid_nlist_t * nlist = NULL;
+
+  assert(pe);
+  assert(cs);
+
+  colloid_nlist_create(pe, cs, &nlist);
+  assert(nlist);
+
+  colloid_nlist_skin(nlist, &skin);
+  colloid_nlist_range(nlist, &range);
+  assert(fabs(skin - 0.0) < DBL_EPSILON);
+  assert(fabs(range - 0.0) < DBL_EPSILON);
+
+  colloid_nlist_skin_set(nlist, 0.5);
+  colloid_nlist_range_set(nlist, 2.5);
+  colloid_nlist_skin(nlist, &skin);
+  colloid_nlist_range(nlist, &range);
+  assert(fabs(skin - 0.5) < DBL_EPSILON);
+  assert(fabs(range - 2.5) < DBL_EPSILON);
+
+  colloid_nlist_stats(nlist, &nbuild, &nupdate);
+  assert(nbuild == 0);
+  assert(nupdate == 0);
+
+  colloid_nlist_free(nlist);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_colloid_nlist_update
+ *
+ *  Three colloids: one pair inside range + skin, one colloid beyond.
+ *  Small displacements must re-use the list; a displacement of more
+ *  than half the skin must trigger a rebuild.
+ *
+ *****************************************************************************/
+
+int test_colloid_nlist_update(pe_t * pe, cs_t * cs) {
+
+  int nc;
+  int nbuild, nupdate;
+  int ncell[3] = {2, 2, 2};
+  double r1[3] = {8.0, 8.0, 8.0};
+  double r2[3] = {11.0, 8.0, 8.0};
+  double r3[3] = {8.0, 14.0, 8.0};
+  double ltot[3];
+
+  colloids_info_t * cinfo = NULL;
+  colloid_nlist_t * nlist = NULL;
+  colloid_t * pc1 = NULL;
+  colloid_t * pc2 = NULL;
+  colloid_t * pc3 = NULL;
+  MPI_Comm comm;
+
+  assert(pe);
+  assert(cs);
+
+  cs_ltot(cs, ltot);
+  cs_cart_comm(cs, &comm);
+
+  /* Cell width must exceed range + skin */
+  if (ltot[X] < 32.0 || ltot[Y] < 32.0 || ltot[Z] < 32.0) return 0;
+
+  colloids_info_create(pe, cs, ncell, &cinfo);
+  assert(cinfo);
+
+  colloids_info_add_local(cinfo, 1, r1, &pc1);
+  colloids_info_add_local(cinfo, 2, r2, &pc2);
+  colloids_info_add_local(cinfo, 3, r3, &pc3);
+  colloids_info_ntotal_set(cinfo);
+  colloids_info_ntotal(cinfo, &nc);
+  assert(nc == 3);
+
+  colloids_info_nlist(cinfo, &nlist);
+  assert(nlist);
+
+  /* Zero skin: all pairs in neighbouring cells are candidates */
+
+  colloids_halo_state(cinfo);
+  colloid_nlist_update(nlist, cinfo);
+  assert(test_colloid_nlist_npair(nlist, comm) == 3);
+
+  /* Separation 3.0 < range + skin = 4.0; separation 6.0 is not */
+
+  colloid_nlist_skin_set(nlist, 1.0);
+  colloid_nlist_range_set(nlist, 3.0);
+
+  colloids_halo_state(cinfo);
+  colloid_nlist_update(nlist, cinfo);
+  assert(test_colloid_nlist_npair(nlist, comm) == 1);
+
+  colloid_nlist_stats(nlist, &nbuild, &nupdate);
+  assert(nbuild == 2);
+  assert(nupdate == 2);
+
+  /* Displacement of 0.25 < skin/2 re-uses the list */
+
+  if (pc2) pc2->s.r[X] += 0.25;
+  colloids_halo_state(cinfo);
+  colloid_nlist_update(nlist, cinfo);
+  assert(test_colloid_nlist_npair(nlist, comm) == 1);
+
+  colloid_nlist_stats(nlist, &nbuild, &nupdate);
+  assert(nbuild == 2);
+  assert(nupdate == 3);
+
+  /* A further 0.5 (0.75 in total) > skin/2 requires a rebuild */
+
+  if (pc2) pc2->s.r[X] += 0.5;
+  colloids_halo_state(cinfo);
+  colloid_nlist_update(nlist, cinfo);
+  assert(test_colloid_nlist_npair(nlist, comm) == 1);
+
+  colloid_nlist_stats(nlist, &nbuild, &nupdate);
+  assert(nbuild == 3);
+  assert(nupdate == 4);
+
+  colloids_info_free(cinfo);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_colloid_nlist_npair
+ *
+ *  Global number of pairs.
+ *
+ *****************************************************************************/
+
+static int test_colloid_nlist_npair(colloid_nlist_t * nlist, MPI_Comm comm) {
+
+  int npair_local = 0;
+  int npair = 0;
+
+  assert(nlist);
+
+  colloid_nlist_npair(nlist, &npair_local);
+  MPI_Allreduce(&npair_local, &npair, 1, MPI_INT, MPI_SUM, comm);
+
+  return npair;
+}
@@ -0,0 +1,230 @@
+/*****************************************************************************
+ *
+ *  test_ewald_pme.c
+ *
+ *  Particle-mesh Ewald against the direct Fourier space sum.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "pe.h"
+#include "coords.h"
+#include "colloids.h"
+#include "ewald.h"
+#include "util.h"
+#include "tests.h"
+
+#define NPARTICLE 6
+
+static int test_ewald_pme_fourier(pe_t * pe, cs_t * cs,
+				  colloids_info_t * cinfo, ewald_t * ewald,
+				  double ft[NPARTICLE][6], double * ef);
+static int test_ewald_pme_compare(pe_t * pe, double ftref[NPARTICLE][6],
+				  double ft[NPARTICLE][6], double * err);
+
+/*****************************************************************************
+ *
+ *  test_ewald_pme_suite
+ *
+ *****************************************************************************/
+
+int test_ewald_pme_suite(void) {
+
+  int n;
+  int ncell[3] = {2, 2, 2};
+  int ngrid[3] = {32, 32, 32};
+
+  double mu = 0.285;
+  double rc = 16.0;
+  double eref, ef;
+  double err;
+  double ftref[NPARTICLE][6];
+  double ft[NPARTICLE][6];
+
+  /* Positions and (unit) orientations */
+  const double r[NPARTICLE][3] = {{ 3.0,  3.0,  3.0}, { 3.0,  3.0, 13.0},
+				  {20.5, 40.2,  7.7}, {33.3, 12.1, 50.6},
+				  {60.0, 61.5, 30.1}, {45.2, 25.9, 44.4}};
+  const double s[NPARTICLE][3] = {{ 0.0,  0.0,  1.0}, { 1.0,  0.0,  0.0},
+				  { 0.6,  0.8,  0.0}, { 0.0, -0.6,  0.8},
+				  {-0.48, 0.6,  0.64}, { 0.0,  1.0,  0.0}};
+
+  pe_t * pe = NULL;
+  cs_t * cs = NULL;
+  colloids_info_t * cinfo = NULL;
+  ewald_t * ewald = NULL;
+
+  pe_create(MPI_COMM_WORLD, PE_QUIET, &pe);
+  cs_create(pe, &cs);
+  cs_init(cs);
+
+  colloids_info_create(pe, cs, ncell, &cinfo);
+
+  for (n = 0; n < NPARTICLE; n++) {
+    colloid_t * pc = NULL;
+    colloids_info_add_local(cinfo, n + 1, r[n], &pc);
+    if (pc) {
+      pc->s.a0 = 2.3;
+      pc->s.ah = 2.3;
+      pc->s.s[X] = s[n][X];
+      pc->s.s[Y] = s[n][Y];
+      pc->s.s[Z] = s[n][Z];
+    }
+  }
+  colloids_info_ntotal_set(cinfo);
+
+  ewald_create(pe, cs, mu, rc, cinfo, &ewald);
+  assert(ewald);
+
+  /* Reference */
+
+  test_ewald_pme_fourier(pe, cs, cinfo, ewald, ftref, &ef);
+  ewald_fourier_space_energy(ewald, &eref);
+  test_assert(eref > 0.0);
+
+  /* A fine mesh and high order is converged with respect to the mesh,
+   * so the difference is the truncation of the direct sum at the
+   * default kappa (exp(-kappa^2 rc^2) ~ 0.002 at the cut off) */
+
+  ewald_method_pme(ewald, ngrid, 8);
+  test_ewald_pme_fourier(pe, cs, cinfo, ewald, ft, &ef);
+  test_ewald_pme_compare(pe, ftref, ft, &err);
+
+  test_assert(fabs(ef - eref) < 1.0e-02*eref);
+  test_assert(err < 2.0e-02);
+
+  /* Momentum is conserved to the accuracy of the interpolation */
+
+  {
+    double fsum_local[3] = {0.0, 0.0, 0.0};
+    double fsum[3];
+    MPI_Comm comm;
+
+    for (n = 0; n < NPARTICLE; n++) {
+      fsum_local[X] += ft[n][X];
+      fsum_local[Y] += ft[n][Y];
+      fsum_local[Z] += ft[n][Z];
+    }
+    cs_cart_comm(cs, &comm);
+    MPI_Allreduce(fsum_local, fsum, 3, MPI_DOUBLE, MPI_SUM, comm);
+    test_assert(fabs(fsum[X]) + fabs(fsum[Y]) + fabs(fsum[Z]) < 1.0e-06);
+  }
+
+  /* The tuner increases kappa so that the direct sum (with the usual
+   * cut off) is more accurate; the tuned mesh should then agree with
+   * the direct energy, and with the converged mesh forces to within
+   * the target. */
+
+  ewald_tune(ewald, 1.0e-04);
+  test_ewald_pme_fourier(pe, cs, cinfo, ewald, ft, &ef);
+  ewald_fourier_space_energy(ewald, &eref);
+  test_assert(fabs(ef - eref) < 1.0e-03*eref);
+
+  ngrid[X] = 128; ngrid[Y] = 128; ngrid[Z] = 128;
+  ewald_method_pme(ewald, ngrid, 8);
+  test_ewald_pme_fourier(pe, cs, cinfo, ewald, ftref, &eref);
+  test_ewald_pme_compare(pe, ftref, ft, &err);
+  test_assert(err < 1.0e-04);
+
+  ewald_free(ewald);
+  colloids_info_free(cinfo);
+  cs_free(cs);
+
+  pe_info(pe, "PASS     ./unit/test_ewald_pme\n");
+  pe_free(pe);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_ewald_pme_fourier
+ *
+ *  Fourier space force and torque on each particle (zero if not local),
+ *  and energy, via the current method. (The direct sum energy is only
+ *  available from ewald_fourier_space_energy() on all ranks.)
+ *
+ *****************************************************************************/
+
+static int test_ewald_pme_fourier(pe_t * pe, cs_t * cs,
+				  colloids_info_t * cinfo, ewald_t * ewald,
+				  double ft[NPARTICLE][6], double * ef) {
+  int n, ia;
+  double ereal, eself;
+  colloid_t * pc = NULL;
+
+  assert(pe);
+  assert(cs);
+
+  colloids_info_list_local_build(cinfo);
+
+  for (n = 0; n < NPARTICLE; n++) {
+    for (ia = 0; ia < 6; ia++) ft[n][ia] = 0.0;
+  }
+
+  colloids_info_local_head(cinfo, &pc);
+  for ( ; pc; pc = pc->nextlocal) {
+    for (ia = 0; ia < 3; ia++) {
+      pc->force[ia] = 0.0;
+      pc->torque[ia] = 0.0;
+    }
+  }
+
+  ewald_fourier_space_sum(ewald);
+
+  colloids_info_local_head(cinfo, &pc);
+  for ( ; pc; pc = pc->nextlocal) {
+    n = pc->s.index - 1;
+    for (ia = 0; ia < 3; ia++) {
+      ft[n][ia] = pc->force[ia];
+      ft[n][3 + ia] = pc->torque[ia];
+    }
+  }
+
+  ewald_total_energy(ewald, &ereal, ef, &eself);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_ewald_pme_compare
+ *
+ *  Largest of the rms relative force and torque differences.
+ *
+ *****************************************************************************/
+
+static int test_ewald_pme_compare(pe_t * pe, double ftref[NPARTICLE][6],
+				  double ft[NPARTICLE][6], double * err) {
+  int n, ia;
+  double sum_local[4] = {0.0, 0.0, 0.0, 0.0};
+  double sum[4];
+
+  assert(pe);
+
+  for (n = 0; n < NPARTICLE; n++) {
+    for (ia = 0; ia < 6; ia++) {
+      double d = ft[n][ia] - ftref[n][ia];
+      sum_local[2*(ia/3)    ] += d*d;
+      sum_local[2*(ia/3) + 1] += ftref[n][ia]*ftref[n][ia];
+    }
+  }
+
+  MPI_Allreduce(sum_local, sum, 4, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+  *err = dmax(sqrt(sum[0]/sum[1]), sqrt(sum[2]/sum[3]));
+
+  return 0;
+}
@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2012-2017 The University of Edinburgh
+ *  (c) 2012-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -61,6 +61,8 @@ int test_field_suite(void) {
   do_test_io(pe, 1, IO_FORMAT_BINARY);
   do_test_io(pe, 5, IO_FORMAT_ASCII);
   do_test_io(pe, 5, IO_FORMAT_BINARY);
+  do_test_io(pe, 1, IO_FORMAT_BINARY_MPIIO);
+  do_test_io(pe, 5, IO_FORMAT_BINARY_MPIIO);
 
   pe_info(pe, "PASS     ./unit/test_field\n");
   pe_free(pe);
@@ -401,7 +403,9 @@ static int do_test_io(pe_t * pe, int nf, int io_format) {
   cs_nhalo(cs, &nhalo);
   cs_cart_comm(cs, &comm);
 
-  if (pe_mpi_size(pe) == 8) {
+  /* MPI-IO output is always a single I/O group */
+
+  if (pe_mpi_size(pe) == 8 && io_format != IO_FORMAT_BINARY_MPIIO) {
     grid[X] = 2;
     grid[Y] = 2;
     grid[Z] = 2;
@@ -23,7 +23,7 @@
 
 #include "pe.h"
 #include "coords.h"
-#include "model.h"
+#include "lb_model_s.h"
 #include "control.h"
 #include "tests.h"
 
@@ -114,7 +114,7 @@ int do_test_halo_null(pe_t * pe, cs_t * cs, lb_halo_enum_t halo) {
   int rank;
   int nhalo;
   int nextra;
-  double f_actual;
+  double f_expect, f_actual;
 
   MPI_Comm comm = MPI_COMM_WORLD;
   lb_t * lb = NULL;
@@ -186,8 +186,10 @@ int do_test_halo_null(pe_t * pe, cs_t * cs, lb_halo_enum_t halo) {
 	  for (p = 0; p < NVEL; p++) {
 	    lb_f(lb, index, p, nd, &f_actual);
 
-	    /* everything should still be zero inside the lattice */
-	    assert(fabs(f_actual - 0.0) < DBL_EPSILON);
+	    /* everything should still be zero inside the lattice
+	     * (as recovered from storage) */
+	    f_expect = LB_F_ROUND(0.0, lb->param->wv[p], nd);
+	    assert(fabs(f_actual - f_expect) < DBL_EPSILON);
 	  }
 	}
 
@@ -316,7 +318,8 @@ int do_test_halo(pe_t * pe, cs_t * cs, int dim, lb_halo_enum_t halo) {
 
 	      for (p = 0; p < NVEL; p++) {
 		lb_f(lb, index, p, nd, &f_actual);
-		assert(fabs(f_actual-f_expect) < DBL_EPSILON);
+		assert(fabs(f_actual - LB_F_ROUND(f_expect, lb->param->wv[p], nd))
+		       < DBL_EPSILON);
 	      }
 	    }
 
@@ -328,7 +331,8 @@ int do_test_halo(pe_t * pe, cs_t * cs, int dim, lb_halo_enum_t halo) {
 
 	      for (p = 0; p < NVEL; p++) {
 		lb_f(lb, index, p, nd, &f_actual);
-		assert(fabs(f_actual-f_expect) < DBL_EPSILON);
+		assert(fabs(f_actual - LB_F_ROUND(f_expect, lb->param->wv[p], nd))
+		       < DBL_EPSILON);
 	      }
 	    }
 	  }
@@ -0,0 +1,130 @@
+/*****************************************************************************
+ *
+ *  test_io_async.c
+ *
+ *  Asynchronous lattice output.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "pe.h"
+#include "coords.h"
+#include "io_async.h"
+#include "field_s.h"
+
+#include "test_coords_field.h"
+#include "tests.h"
+
+static int do_test_io_async(pe_t * pe, int nbuffer, int io_format);
+
+/*****************************************************************************
+ *
+ *  test_io_async_suite
+ *
+ *****************************************************************************/
+
+int test_io_async_suite(void) {
+
+  pe_t * pe = NULL;
+
+  pe_create(MPI_COMM_WORLD, PE_QUIET, &pe);
+
+  do_test_io_async(pe, 1, IO_FORMAT_BINARY);
+  do_test_io_async(pe, 2, IO_FORMAT_BINARY);
+  do_test_io_async(pe, 2, IO_FORMAT_ASCII);
+
+  pe_info(pe, "PASS     ./unit/test_io_async\n");
+  pe_free(pe);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  do_test_io_async
+ *
+ *  Write the same field at a number of steps (which may be outstanding
+ *  together); after the wait, each file must read back correctly.
+ *
+ *****************************************************************************/
+
+static int do_test_io_async(pe_t * pe, int nbuffer, int io_format) {
+
+  int nf = 3;
+  int nhalo;
+  int step;
+  int npending;
+  int grid[3] = {1, 1, 1};
+  char filename[FILENAME_MAX];
+
+  const int nstep = 3;
+
+  cs_t * cs = NULL;
+  field_t * phi = NULL;
+  io_info_t * iohandler = NULL;
+  io_async_t * async = NULL;
+
+  assert(pe);
+
+  cs_create(pe, &cs);
+  cs_init(cs);
+  cs_nhalo(cs, &nhalo);
+
+  field_create(pe, cs, nf, "phi-async", &phi);
+  field_init(phi, nhalo, NULL);
+  field_init_io_info(phi, grid, io_format, io_format);
+  field_io_info(phi, &iohandler);
+
+  io_async_create(pe, cs, nbuffer, &async);
+  assert(async);
+
+  test_coords_field_set(cs, nf, phi->data, MPI_DOUBLE, test_ref_double1);
+
+  for (step = 1; step <= nstep; step++) {
+    sprintf(filename, "phi-async-%8.8d", step);
+    io_async_write(async, step, iohandler, filename, phi);
+    io_async_pending(async, &npending);
+    assert(npending <= nbuffer);
+  }
+
+  io_async_wait(async);
+  io_async_pending(async, &npending);
+  assert(npending == 0);
+
+  io_async_free(async);
+  field_free(phi);
+
+  /* Read back with the usual reader */
+
+  for (step = 1; step <= nstep; step++) {
+    field_create(pe, cs, nf, "phi-async", &phi);
+    field_init(phi, nhalo, NULL);
+    field_init_io_info(phi, grid, io_format, io_format);
+    field_io_info(phi, &iohandler);
+
+    sprintf(filename, "phi-async-%8.8d", step);
+    io_read_data(iohandler, filename, phi);
+    field_halo(phi);
+    test_coords_field_check(cs, 0, nf, phi->data, MPI_DOUBLE,
+			    test_ref_double1);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    io_remove(filename, iohandler);
+    io_remove_metadata(iohandler, "phi-async");
+    field_free(phi);
+  }
+
+  cs_free(cs);
+
+  return 0;
+}
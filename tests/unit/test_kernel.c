@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2016-2018 The University of Edinburgh
+ *  (c) 2016-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -15,6 +15,8 @@
  *****************************************************************************/
 
 #include <assert.h>
+#include <float.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -22,6 +24,7 @@
 #include "pe.h"
 #include "coords.h"
 #include "kernel.h"
+#include "kernel_reduce.h"
 #include "memory.h"
 
 typedef struct data_s data_t;
@@ -37,10 +40,22 @@ __host__ int do_test_kernel(cs_t * cs, kernel_info_t limits, data_t * data);
 __host__ int do_host_kernel(cs_t * cs, kernel_info_t limits, int * mask, int * isum);
 __host__ int do_check(cs_t * cs, int * iref, int * itarget);
 __host__ int do_test_attributes(pe_t * pe);
+__host__ int do_test_kernel_cache(cs_t * cs);
+__host__ int do_test_kernel_sequence(cs_t * cs, kernel_info_t limits,
+				     data_t * data);
+__host__ int do_test_kernel_tiled(cs_t * cs, kernel_info_t limits,
+				  data_t * data);
+__host__ int do_test_kernel_reduce(pe_t * pe, cs_t * cs, kernel_info_t limits);
+__host__ int do_test_kernel_shell(cs_t * cs, kernel_info_t limits, int nw,
+				  data_t * data);
 
 __global__ void do_target_kernel1(kernel_ctxt_t * ktx, data_t * data);
 __global__ void do_target_kernel2(kernel_ctxt_t * ktx, data_t * data);
 __global__ void do_target_kernel1r(kernel_ctxt_t * ktx, data_t * data);
+__global__ void do_target_kernel3(kernel_ctxt_t * ktx, data_t * data);
+__global__ void do_target_kernel2r(kernel_ctxt_t * ktx, data_t * data);
+__global__ void do_target_kernel_reduce(kernel_ctxt_t * ktx,
+					kernel_reduce_t * red);
 
 __host__ int data_create(int nsites, data_t * data);
 __host__ int data_free(data_t * data);
@@ -79,15 +94,25 @@ __host__ int test_kernel_suite(void) {
   lim.jmin = 1; lim.jmax = nlocal[Y];
   lim.kmin = 1; lim.kmax = nlocal[Z];
   do_test_kernel(cs, lim, data);
+  do_test_kernel_sequence(cs, lim, data);
+  do_test_kernel_tiled(cs, lim, data);
+  do_test_kernel_reduce(pe, cs, lim);
+  do_test_kernel_shell(cs, lim, 1, data);
+  do_test_kernel_shell(cs, lim, 2, data);
 
   lim.imin = 0; lim.imax = nlocal[X] + 1;
   lim.jmin = 0; lim.jmax = nlocal[Y] + 1;
   lim.kmin = 0; lim.kmax = nlocal[Z] + 1;
 
   do_test_kernel(cs, lim, data);
+  do_test_kernel_sequence(cs, lim, data);
+  do_test_kernel_tiled(cs, lim, data);
+  do_test_kernel_reduce(pe, cs, lim);
 
   data_free(data);
 
+  do_test_kernel_cache(cs);
+
   cs_free(cs);
   pe_info(pe, "PASS     ./unit/test_kernel\n");
   pe_free(pe);
@@ -195,6 +220,445 @@ __host__ int do_test_kernel(cs_t * cs, kernel_info_t limits, data_t * data) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  do_test_kernel_cache
+ *
+ *  Contexts with the same limits are shared; others are distinct.
+ *
+ *****************************************************************************/
+
+__host__ int do_test_kernel_cache(cs_t * cs) {
+
+  int nlocal[3];
+  kernel_info_t lim1;
+  kernel_info_t lim2;
+  kernel_ctxt_t * ctxt1 = NULL;
+  kernel_ctxt_t * ctxt2 = NULL;
+  kernel_ctxt_t * ctxt3 = NULL;
+
+  assert(cs);
+
+  cs_nlocal(cs, nlocal);
+
+  lim1.imin = 1; lim1.imax = nlocal[X];
+  lim1.jmin = 1; lim1.jmax = nlocal[Y];
+  lim1.kmin = 1; lim1.kmax = nlocal[Z];
+  lim2 = lim1;
+  lim2.imin = 0;
+
+  kernel_ctxt_create(cs, 1, lim1, &ctxt1);
+  kernel_ctxt_create(cs, 1, lim1, &ctxt2);
+  kernel_ctxt_create(cs, 1, lim2, &ctxt3);
+
+  assert(ctxt1 == ctxt2);
+  assert(ctxt1->nref == 2);
+  assert(ctxt3 != ctxt1);
+  assert(kernel_iterations(ctxt3) > kernel_iterations(ctxt1));
+
+  kernel_ctxt_free(ctxt2);
+  kernel_ctxt_free(ctxt1);
+  assert(ctxt1->nref == 0);
+
+  /* Re-use after free */
+
+  kernel_ctxt_create(cs, 1, lim1, &ctxt2);
+  assert(ctxt2 == ctxt1);
+  assert(ctxt2->nref == 1);
+
+  kernel_ctxt_free(ctxt2);
+  kernel_ctxt_free(ctxt3);
+  kernel_ctxt_cache_clear();
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  do_sequence
+ *
+ *  The second kernel counts the sites set by the first, which must
+ *  therefore be complete.
+ *
+ *****************************************************************************/
+
+typedef struct sequence_s sequence_t;
+
+struct sequence_s {
+  dim3 nblk;
+  dim3 ntpb;
+  kernel_ctxt_t * ctxt;
+  data_t * data;
+};
+
+static void do_sequence(void * arg) {
+
+  sequence_t * seq = (sequence_t *) arg;
+
+  tdpLaunchKernel(do_target_kernel1, seq->nblk, seq->ntpb, 0, 0,
+		  seq->ctxt, seq->data);
+  tdpLaunchKernel(do_target_kernel3, seq->nblk, seq->ntpb, 0, 0,
+		  seq->ctxt, seq->data);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  do_test_kernel_sequence
+ *
+ *****************************************************************************/
+
+__host__ int do_test_kernel_sequence(cs_t * cs, kernel_info_t limits,
+				     data_t * data) {
+
+  int nexpect;
+  sequence_t seq;
+  kernel_ctxt_t * ctxt = NULL;
+
+  assert(cs);
+  assert(data);
+
+  kernel_ctxt_create(cs, 1, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &seq.nblk, &seq.ntpb);
+
+  data_zero(data);
+
+  seq.ctxt = ctxt->target;
+  seq.data = data->target;
+
+  tdpLaunchSequence(do_sequence, &seq);
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  data_copy(data, tdpMemcpyDeviceToHost);
+
+  nexpect = (limits.imax - limits.imin + 1)*
+            (limits.jmax - limits.jmin + 1)*
+            (limits.kmax - limits.kmin + 1);
+  assert(data->isum == nexpect);
+
+  kernel_ctxt_free(ctxt);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  do_test_kernel_tiled
+ *
+ *  Each site within the limits must be visited exactly once for
+ *  both tile orders, and no more chunks than the untiled case.
+ *
+ *****************************************************************************/
+
+__host__ int do_test_kernel_tiled(cs_t * cs, kernel_info_t limits,
+				  data_t * data) {
+  int n;
+  int nsites;
+  int nexpect;
+  int isum;
+  int tile0[3];
+  int tile[3] = {2, 3, 4};
+  int * iref = NULL;
+  dim3 nblk, ntpb;
+  kernel_tile_order_enum_t order0;
+  kernel_tile_order_enum_t order[2] = {KERNEL_TILE_ORDER_TILE,
+				       KERNEL_TILE_ORDER_MORTON};
+  kernel_ctxt_t * ctxt = NULL;
+  kernel_ctxt_t * ctxt0 = NULL;
+
+  assert(cs);
+  assert(data);
+
+  cs_nsites(cs, &nsites);
+  iref = (int *) calloc(nsites, sizeof(int));
+  assert(iref);
+
+  do_host_kernel(cs, limits, iref, &isum);
+  nexpect = (limits.imax - limits.imin + 1)*
+            (limits.jmax - limits.jmin + 1)*
+            (limits.kmax - limits.kmin + 1);
+  assert(isum == nexpect);
+
+  kernel_tile(tile0, &order0);
+  kernel_ctxt_create(cs, NSIMDVL, limits, &ctxt0);
+
+  for (n = 0; n < 2; n++) {
+
+    kernel_tile_set(tile, order[n]);
+    kernel_ctxt_create_tiled(cs, NSIMDVL, limits, &ctxt);
+    assert(ctxt != ctxt0);
+    assert(kernel_vector_iterations(ctxt) <= kernel_vector_iterations(ctxt0));
+    kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+    data_zero(data);
+    tdpLaunchKernel(do_target_kernel2, nblk, ntpb, 0, 0,
+		    ctxt->target, data->target);
+    tdpAssert(tdpPeekAtLastError());
+    tdpAssert(tdpDeviceSynchronize());
+
+    data_copy(data, tdpMemcpyDeviceToHost);
+    do_check(cs, iref, data->idata);
+
+    data_zero(data);
+    tdpLaunchKernel(do_target_kernel2r, nblk, ntpb, 0, 0,
+		    ctxt->target, data->target);
+    tdpAssert(tdpPeekAtLastError());
+    tdpAssert(tdpDeviceSynchronize());
+
+    data_copy(data, tdpMemcpyDeviceToHost);
+    assert(data->isum == nexpect);
+
+    kernel_ctxt_free(ctxt);
+  }
+
+  /* No tiling is the standard context */
+
+  tile[X] = 0; tile[Y] = 0; tile[Z] = 0;
+  kernel_tile_set(tile, KERNEL_TILE_ORDER_TILE);
+  kernel_ctxt_create_tiled(cs, NSIMDVL, limits, &ctxt);
+  assert(ctxt == ctxt0);
+
+  kernel_ctxt_free(ctxt);
+  kernel_ctxt_free(ctxt0);
+  kernel_tile_set(tile0, order0);
+
+  free(iref);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  do_test_kernel_shell
+ *
+ *  Each site within the limits and within nw of a face of the limits
+ *  must be visited exactly once; no other site may be visited.
+ *
+ *****************************************************************************/
+
+__host__ int do_test_kernel_shell(cs_t * cs, kernel_info_t limits, int nw,
+				  data_t * data) {
+  int ic, jc, kc;
+  int nsites;
+  int nexpect;
+  int isum;
+  int * iref = NULL;
+  dim3 nblk, ntpb;
+  kernel_ctxt_t * ctxt = NULL;
+  kernel_ctxt_t * ctxt0 = NULL;
+
+  assert(cs);
+  assert(data);
+
+  cs_nsites(cs, &nsites);
+  iref = (int *) calloc(nsites, sizeof(int));
+  assert(iref);
+
+  do_host_kernel(cs, limits, iref, &isum);
+
+  /* Remove the inner block from the reference */
+
+  nexpect = isum;
+
+  for (ic = limits.imin + nw; ic <= limits.imax - nw; ic++) {
+    for (jc = limits.jmin + nw; jc <= limits.jmax - nw; jc++) {
+      for (kc = limits.kmin + nw; kc <= limits.kmax - nw; kc++) {
+	iref[mem_addr_rank0(nsites, cs_index(cs, ic, jc, kc))] = 0;
+	nexpect -= 1;
+      }
+    }
+  }
+
+  kernel_ctxt_create(cs, NSIMDVL, limits, &ctxt0);
+  kernel_ctxt_create_shell(cs, NSIMDVL, limits, nw, &ctxt);
+  assert(ctxt != ctxt0);
+  assert(kernel_vector_iterations(ctxt) < kernel_vector_iterations(ctxt0));
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+  data_zero(data);
+  tdpLaunchKernel(do_target_kernel2, nblk, ntpb, 0, 0,
+		  ctxt->target, data->target);
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  data_copy(data, tdpMemcpyDeviceToHost);
+  do_check(cs, iref, data->idata);
+
+  data_zero(data);
+  tdpLaunchKernel(do_target_kernel2r, nblk, ntpb, 0, 0,
+		  ctxt->target, data->target);
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  data_copy(data, tdpMemcpyDeviceToHost);
+  assert(data->isum == nexpect);
+
+  kernel_ctxt_free(ctxt);
+  kernel_ctxt_free(ctxt0);
+
+  free(iref);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  do_test_kernel_reduce
+ *
+ *  Sum, minimum and maximum of an integer-valued function of local
+ *  position (so the sums are exact) against the host, both locally
+ *  and after the global reduction.
+ *
+ *****************************************************************************/
+
+__host__ int do_test_kernel_reduce(pe_t * pe, cs_t * cs, kernel_info_t limits) {
+
+  int ic, jc, kc;
+  double v;
+  double vlocal[4] = {0.0, 0.0, +DBL_MAX, -DBL_MAX};
+  double vtotal[4];
+
+  dim3 nblk, ntpb;
+  kernel_ctxt_t * ctxt = NULL;
+  kernel_reduce_t * red = NULL;
+  MPI_Comm comm;
+
+  assert(pe);
+  assert(cs);
+
+  cs_cart_comm(cs, &comm);
+
+  for (ic = limits.imin; ic <= limits.imax; ic++) {
+    for (jc = limits.jmin; jc <= limits.jmax; jc++) {
+      for (kc = limits.kmin; kc <= limits.kmax; kc++) {
+	v = 1.0*ic - 2.0*jc + 3.0*kc;
+	vlocal[0] += 1.0;
+	vlocal[1] += v;
+	vlocal[2] = (v < vlocal[2]) ? v : vlocal[2];
+	vlocal[3] = (v > vlocal[3]) ? v : vlocal[3];
+      }
+    }
+  }
+
+  kernel_reduce_create(pe, 2, &red);
+
+  kernel_ctxt_create(cs, NSIMDVL, limits, &ctxt);
+  kernel_ctxt_launch_param(ctxt, &nblk, &ntpb);
+
+  /* Twice, to check kernel_reduce_zero() */
+
+  tdpLaunchKernel(do_target_kernel_reduce, nblk, ntpb, 0, 0,
+		  ctxt->target, red->target);
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  kernel_reduce_zero(red);
+
+  tdpLaunchKernel(do_target_kernel_reduce, nblk, ntpb, 0, 0,
+		  ctxt->target, red->target);
+  tdpAssert(tdpPeekAtLastError());
+  tdpAssert(tdpDeviceSynchronize());
+
+  kernel_ctxt_free(ctxt);
+
+  kernel_reduce_local(red);
+
+  assert(fabs(red->sum[0] - vlocal[0]) < DBL_EPSILON);
+  assert(fabs(red->sum[1] - vlocal[1]) < DBL_EPSILON);
+  assert(fabs(red->min[1] - vlocal[2]) < DBL_EPSILON);
+  assert(fabs(red->max[1] - vlocal[3]) < DBL_EPSILON);
+
+  /* Unused entries retain their initial values */
+  assert(red->min[0] == +DBL_MAX);
+  assert(red->max[0] == -DBL_MAX);
+
+  kernel_reduce_mpi(red, 0, comm);
+
+  MPI_Reduce(vlocal, vtotal, 2, MPI_DOUBLE, MPI_SUM, 0, comm);
+  MPI_Reduce(vlocal + 2, vtotal + 2, 1, MPI_DOUBLE, MPI_MIN, 0, comm);
+  MPI_Reduce(vlocal + 3, vtotal + 3, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+
+  if (pe_mpi_rank(pe) == 0) {
+    assert(fabs(red->sum[0] - vtotal[0]) < DBL_EPSILON);
+    assert(fabs(red->sum[1] - vtotal[1]) < DBL_EPSILON);
+    assert(fabs(red->min[1] - vtotal[2]) < DBL_EPSILON);
+    assert(fabs(red->max[1] - vtotal[3]) < DBL_EPSILON);
+  }
+
+  kernel_reduce_free(red);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  do_target_kernel_reduce
+ *
+ *  sum[0] is the volume; sum[1], min[1], max[1] refer to the value.
+ *
+ *****************************************************************************/
+
+__global__ void do_target_kernel_reduce(kernel_ctxt_t * ktx,
+					kernel_reduce_t * red) {
+  int kindex;
+  int kiter;
+  int tid;
+
+  double vmin = +DBL_MAX;
+  double vmax = -DBL_MAX;
+
+  __shared__ double vol[TARGET_MAX_THREADS_PER_BLOCK];
+  __shared__ double vsum[TARGET_MAX_THREADS_PER_BLOCK];
+
+  tid = threadIdx.x;
+  vol[tid] = 0.0;
+  vsum[tid] = 0.0;
+
+  kiter = kernel_vector_iterations(ktx);
+
+  for_simt_parallel(kindex, kiter, NSIMDVL) {
+
+    int iv;
+    int ic[NSIMDVL], jc[NSIMDVL], kc[NSIMDVL];
+    int maskv[NSIMDVL];
+    double v[NSIMDVL];
+    double vtmp = 0.0;
+    double stmp = 0.0;
+
+    kernel_coords_v(ktx, kindex, ic, jc, kc);
+    kernel_mask_v(ktx, ic, jc, kc, maskv);
+
+    for_simd_v(iv, NSIMDVL) {
+      v[iv] = 1.0*ic[iv] - 2.0*jc[iv] + 3.0*kc[iv];
+    }
+
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      if (maskv[iv] == 0) continue;
+      vmin = (v[iv] < vmin) ? v[iv] : vmin;
+      vmax = (v[iv] > vmax) ? v[iv] : vmax;
+    }
+
+    for_simd_v_reduction(iv, NSIMDVL, +: vtmp) {
+      vtmp += 1.0*maskv[iv];
+    }
+    for_simd_v_reduction(iv, NSIMDVL, +: stmp) {
+      stmp += maskv[iv]*v[iv];
+    }
+
+    vol[tid] += vtmp;
+    vsum[tid] += stmp;
+  }
+
+  kernel_reduce_sum(red, 0, vol);
+  kernel_reduce_sum(red, 1, vsum);
+  kernel_reduce_min(red, 1, vmin);
+  kernel_reduce_max(red, 1, vmax);
+
+  return;
+}
+
 /*****************************************************************************
  *
  *  do_host_kernel
@@ -316,6 +780,48 @@ __global__ void do_target_kernel1r(kernel_ctxt_t * ktx, data_t * data) {
   return;
 }
 
+/*****************************************************************************
+ *
+ *  do_target_kernel3
+ *
+ *  Count the sites which have been set by do_target_kernel1().
+ *
+ *****************************************************************************/
+
+__global__ void do_target_kernel3(kernel_ctxt_t * ktx, data_t * data) {
+
+  int kiter;
+  int kindex;
+  int block_sum;
+  __shared__ int psum[TARGET_MAX_THREADS_PER_BLOCK];
+
+  psum[threadIdx.x] = 0;
+  kiter = kernel_iterations(ktx);
+
+  for_simt_parallel(kindex, kiter, 1) {
+
+    int ic, jc, kc;
+    int index;
+
+    ic = kernel_coords_ic(ktx, kindex);
+    jc = kernel_coords_jc(ktx, kindex);
+    kc = kernel_coords_kc(ktx, kindex);
+    index = kernel_coords_index(ktx, ic, jc, kc);
+
+    if (data->idata[mem_addr_rank0(data->nsites, index)] == index) {
+      psum[threadIdx.x] += 1;
+    }
+  }
+
+  block_sum = tdpAtomicBlockAddInt(psum);
+
+  if (threadIdx.x == 0) {
+    tdpAtomicAddInt(&data->isum, block_sum);
+  }
+
+  return;
+}
+
 /*****************************************************************************
  *
  *  do_target_kernel2
@@ -354,6 +860,51 @@ __global__ void do_target_kernel2(kernel_ctxt_t * ktx, data_t * data) {
   return;
 }
 
+/*****************************************************************************
+ *
+ *  do_target_kernel2r
+ *
+ *  Vectorised count of the sites within the kernel limits.
+ *
+ *****************************************************************************/
+
+__global__ void do_target_kernel2r(kernel_ctxt_t * ktx, data_t * data) {
+
+  int kindex;
+  int kiter;
+  int block_sum;
+  __shared__ int psum[TARGET_MAX_THREADS_PER_BLOCK];
+
+  assert(ktx);
+
+  psum[threadIdx.x] = 0;
+  kiter = kernel_vector_iterations(ktx);
+
+  for_simt_parallel(kindex, kiter, NSIMDVL) {
+
+    int iv;
+    int ic[NSIMDVL];
+    int jc[NSIMDVL];
+    int kc[NSIMDVL];
+    int kmask[NSIMDVL];
+
+    kernel_coords_v(ktx, kindex, ic, jc, kc);
+    kernel_mask_v(ktx, ic, jc, kc, kmask);
+
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      psum[threadIdx.x] += kmask[iv];
+    }
+  }
+
+  block_sum = tdpAtomicBlockAddInt(psum);
+
+  if (threadIdx.x == 0) {
+    tdpAtomicAddInt(&data->isum, block_sum);
+  }
+
+  return;
+}
+
 /*****************************************************************************
  *
  *  do_check
@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2017 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -17,12 +17,15 @@
 #include <assert.h>
 #include <float.h>
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "pe.h"
 #include "coords.h"
 #include "util.h"
+#include "memory.h"
 #include "lb_model_s.h"
+#include "collision_simd.h"
 #include "tests.h"
 
 static void test_model_constants(void);
@@ -33,6 +36,8 @@ int do_test_model_halo_swap(pe_t * pe, cs_t * cs);
 int do_test_model_reduced_halo_swap(pe_t * pe, cs_t * cs);
 int do_test_lb_model_io(pe_t * pe, cs_t * cs);
 int do_test_d3q19_ghosts(void);
+int do_test_d3q19_simd(void);
+int do_test_model_huge_page(pe_t * pe, cs_t * cs);
 static  int test_model_is_domain(cs_t * cs, int ic, int jc, int kc);
 
 /*****************************************************************************
@@ -64,6 +69,8 @@ int test_model_suite(void) {
   }
   do_test_lb_model_io(pe, cs);
   do_test_d3q19_ghosts();
+  do_test_d3q19_simd();
+  do_test_model_huge_page(pe, cs);
 
   pe_info(pe, "PASS     ./unit/test_model\n");
   cs_free(cs);
@@ -356,8 +363,8 @@ int do_test_model_distributions(pe_t * pe, cs_t * cs) {
 
   for (n = 0; n < ndist; n++) {
     for (p = 0; p < NVEL; p++) {
-      fvalue_expected = 0.01*n + wv[p];
-      lb_f_set(lb, index, p, n, fvalue_expected);
+      fvalue_expected = LB_F_ROUND(0.01*n + wv[p], wv[p], n);
+      lb_f_set(lb, index, p, n, 0.01*n + wv[p]);
       lb_f(lb, index, p, n, &fvalue);
       assert(fabs(fvalue - fvalue_expected) < DBL_EPSILON);
     }
@@ -366,7 +373,7 @@ int do_test_model_distributions(pe_t * pe, cs_t * cs) {
 
     fvalue_expected = 0.01*n*NVEL + 1.0;
     lb_0th_moment(lb, index, (lb_dist_enum_t) n, &fvalue);
-    assert(fabs(fvalue - fvalue_expected) <= DBL_EPSILON);
+    assert(fabs(fvalue - fvalue_expected) <= LB_F_EPSILON);
 
     /* info("Check first moment... ");*/
 
@@ -382,6 +389,52 @@ int do_test_model_distributions(pe_t * pe, cs_t * cs) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  do_test_model_huge_page
+ *
+ *  Distributions allocated under each page size policy are zero
+ *  (having been first touched), and can be released. Zero storage
+ *  is not f = 0 if LB_FLOAT is defined.
+ *
+ *****************************************************************************/
+
+int do_test_model_huge_page(pe_t * pe, cs_t * cs) {
+
+  int n, p, index, nsites;
+  double f;
+  mem_huge_page_enum_t page[3] = {MEM_HUGE_PAGE_NONE, MEM_HUGE_PAGE_2MB,
+				  MEM_HUGE_PAGE_1GB};
+  lb_t * lb = NULL;
+
+  assert(pe);
+  assert(cs);
+
+  cs_nsites(cs, &nsites);
+
+  for (n = 0; n < 3; n++) {
+
+    mem_huge_page_set(page[n]);
+    assert(mem_huge_page() == page[n]);
+
+    lb_create(pe, cs, &lb);
+    lb_init(lb);
+
+    for (index = 0; index < nsites; index++) {
+      for (p = 0; p < NVEL; p++) {
+	lb_f(lb, index, p, LB_RHO, &f);
+	assert(fabs(f - LB_F_LOAD(0.0, wv[p], LB_RHO)) < DBL_EPSILON);
+      }
+    }
+
+    lb_free(lb);
+  }
+
+  mem_huge_page_set(MEM_HUGE_PAGE_NONE);
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  do_test_model_halo_swap
@@ -454,21 +507,21 @@ int do_test_model_halo_swap(pe_t * pe, cs_t * cs) {
 
 	for (n = 0; n < ndist; n++) {
 
-	  f_expect = 1.0*abs(i - nlocal[X]);
+	  f_expect = LB_F_ROUND(1.0*abs(i - nlocal[X]), wv[X], n);
 	  lb_f(lb, index, X, n, &f_actual);
 	  assert(fabs(f_actual - f_expect) < DBL_EPSILON);
 
-	  f_expect = 1.0*abs(j - nlocal[Y]);
+	  f_expect = LB_F_ROUND(1.0*abs(j - nlocal[Y]), wv[Y], n);
 	  lb_f(lb, index, Y, n, &f_actual);
 	  assert(fabs(f_actual - f_expect) < DBL_EPSILON);
 
-	  f_expect = 1.0*abs(k - nlocal[Z]);
+	  f_expect = LB_F_ROUND(1.0*abs(k - nlocal[Z]), wv[Z], n);
 	  lb_f(lb, index, Z, n, &f_actual);
 	  assert(fabs(f_actual - f_expect) < DBL_EPSILON);
 
 	  for (p = 3; p < NVEL; p++) {
 	    lb_f(lb, index, p, n, &f_actual);
-	    f_expect = (double) p;
+	    f_expect = LB_F_ROUND((double) p, wv[p], n);
 	    assert(fabs(f_actual - f_expect) < DBL_EPSILON);
 	  }
 	}
@@ -538,7 +591,7 @@ int do_test_model_reduced_halo_swap(pe_t * pe, cs_t * cs) {
 	for (n = 0; n < ndist; n++) {
 	  for (p = 0; p < NVEL; p++) {
 	    lb_f(lb, index, p, n, &f_actual);
-	    f_expect = 1.0*(n*NVEL +  p);
+	    f_expect = LB_F_ROUND(1.0*(n*NVEL +  p), wv[p], n);
 	    assert(fabs(f_expect - f_actual) < DBL_EPSILON);
 	  }
 	}
@@ -563,7 +616,7 @@ int do_test_model_reduced_halo_swap(pe_t * pe, cs_t * cs) {
 	  for (p = 0; p < NVEL; p++) {
 
 	    lb_f(lb, index, p, n, &f_actual);
-	    f_expect = 1.0*(n*NVEL + p);
+	    f_expect = LB_F_ROUND(1.0*(n*NVEL + p), wv[p], n);
 
 	    icdt = i + cv[p][X];
 	    jcdt = j + cv[p][Y];
@@ -616,31 +669,108 @@ static int test_model_is_domain(cs_t * cs, int ic, int jc, int kc) {
  *
  *  do_test_lb_model_io
  *
+ *  Binary write and read. The file holds f in double precision
+ *  whatever the storage (see LB_FLOAT), so the record for the first
+ *  site is checked directly in serial.
+ *
  *****************************************************************************/
 
 int do_test_lb_model_io(pe_t * pe, cs_t * cs) {
 
   int ndist = 2;
+  int ic, jc, kc, index;
+  int n, p, nr;
+  int nlocal[3];
+  double f, fref;
+  double frec[2*NVEL];
+  const char * filename = "lb-model-io-test";
+  char filename_io[BUFSIZ];
+  io_info_arg_t param = {{1, 1, 1}};
+  io_info_t * iowr = NULL;
+  io_info_t * iord = NULL;
   lb_t * lbrd = NULL;
   lb_t * lbwr = NULL;
+  FILE * fp = NULL;
+  MPI_Comm comm;
 
   assert(pe);
   assert(cs);
 
+  cs_nlocal(cs, nlocal);
+  cs_cart_comm(cs, &comm);
+
   lb_create_ndist(pe, cs, ndist, &lbrd);
   lb_create_ndist(pe, cs, ndist, &lbwr);
 
   lb_init(lbwr);
   lb_init(lbrd);
-  /* lb_io_info_set(lbwr, info);*/
+
+  io_info_create(pe, cs, &param, &iowr);
+  io_info_create(pe, cs, &param, &iord);
+  lb_io_info_set(lbwr, iowr, IO_FORMAT_BINARY, IO_FORMAT_BINARY);
+  lb_io_info_set(lbrd, iord, IO_FORMAT_BINARY, IO_FORMAT_BINARY);
 
   /* Write */
 
-  /* test_lb_model_write1(lbwr);*/
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	index = cs_index(cs, ic, jc, kc);
+	for (n = 0; n < ndist; n++) {
+	  for (p = 0; p < NVEL; p++) {
+	    fref = wv[p]*(1.0 + 0.01*n) + 1.0e-04*(ic + jc + kc);
+	    lb_f_set(lbwr, index, p, n, fref);
+	  }
+	}
+      }
+    }
+  }
+
+  io_write_data(iowr, filename, lbwr);
+  MPI_Barrier(comm);
+
+  /* Read and compare */
+
+  io_read_data(iord, filename, lbrd);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	index = cs_index(cs, ic, jc, kc);
+	for (n = 0; n < ndist; n++) {
+	  for (p = 0; p < NVEL; p++) {
+	    lb_f(lbwr, index, p, n, &fref);
+	    lb_f(lbrd, index, p, n, &f);
+	    test_assert(fabs(f - fref) < DBL_EPSILON);
+	  }
+	}
+      }
+    }
+  }
+
+  /* File format */
+
+  if (pe_mpi_size(pe) == 1) {
+
+    sprintf(filename_io, "%s.%3.3d-%3.3d", filename, 1, 1);
+    fp = fopen(filename_io, "rb");
+    test_assert(fp != NULL);
+
+    nr = fread(frec, sizeof(double), ndist*NVEL, fp);
+    test_assert(nr == ndist*NVEL);
+    fclose(fp);
 
-  /* Read */
+    index = cs_index(cs, 1, 1, 1);
+    for (n = 0; n < ndist; n++) {
+      for (p = 0; p < NVEL; p++) {
+	lb_f(lbwr, index, p, n, &fref);
+	test_assert(fabs(frec[n*NVEL + p] - fref) < DBL_EPSILON);
+      }
+    }
+  }
 
-  /* Compare */
+  MPI_Barrier(comm);
+  io_remove(filename, iowr);
 
   lb_free(lbwr);
   lb_free(lbrd);
@@ -713,3 +843,86 @@ int do_test_d3q19_ghosts(void) {
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  do_test_d3q19_simd
+ *
+ *  The explicit SIMD mode transforms and ghost relaxation must agree
+ *  exactly with the scalar reference for each instruction set which
+ *  is available on this host.
+ *
+ *****************************************************************************/
+
+int do_test_d3q19_simd(void) {
+
+#ifdef LB_SIMD_X86
+
+  int isa, iv, m, p;
+  double f[NVEL*NSIMDVL];
+  double fref[NVEL*NSIMDVL];
+  double fout[NVEL*NSIMDVL];
+  double mode[NVEL*NSIMDVL];
+  double moderef[NVEL*NSIMDVL];
+  double ghat[NVEL*NSIMDVL];
+  double rtau[NVEL];
+  lb_simd_isa_enum_t isa0 = collision_simd_isa();
+
+  for (p = 0; p < NVEL; p++) {
+    rtau[p] = 1.0/(0.5 + 0.1*(p + 1));
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      f[p*NSIMDVL + iv] = wv[p]*(1.0 + 0.01*(p + 1) - 0.003*iv);
+      ghat[p*NSIMDVL + iv] = 0.001*(p - 9);
+    }
+  }
+
+  /* Reference */
+
+  for (iv = 0; iv < NSIMDVL; iv++) {
+    for (m = 0; m < NVEL; m++) {
+      moderef[m*NSIMDVL + iv] = 0.0;
+      for (p = 0; p < NVEL; p++) {
+	moderef[m*NSIMDVL + iv] += f[p*NSIMDVL + iv]*ma_[m][p];
+      }
+    }
+    for (m = NHYDRO; m < NVEL; m++) {
+      moderef[m*NSIMDVL + iv] = moderef[m*NSIMDVL + iv]
+	- rtau[m]*(moderef[m*NSIMDVL + iv] - 0.0) + ghat[m*NSIMDVL + iv];
+    }
+    for (p = 0; p < NVEL; p++) {
+      fref[p*NSIMDVL + iv] = 0.0;
+      for (m = 0; m < NVEL; m++) {
+	fref[p*NSIMDVL + iv] += mi_[p][m]*moderef[m*NSIMDVL + iv];
+      }
+    }
+  }
+
+  for (isa = LB_SIMD_ISA_NONE; isa <= LB_SIMD_ISA_AVX512; isa++) {
+
+    if (collision_simd_isa_available(isa) == 0) {
+      test_assert(collision_simd_isa_set(isa) == -1);
+      continue;
+    }
+
+    test_assert(collision_simd_isa_set(isa) == 0);
+    test_assert(collision_simd_isa() == isa);
+
+    d3q19_f2mode_simd(mode, f);
+    d3q19_relax_ghost_simd(mode, rtau, ghat);
+    for (p = 0; p < NVEL*NSIMDVL; p++) {
+      test_assert(mode[p] == moderef[p]);
+    }
+
+    d3q19_mode2f_simd(mode, fout);
+    for (p = 0; p < NVEL*NSIMDVL; p++) {
+      test_assert(fout[p] == fref[p]);
+    }
+  }
+
+  collision_simd_isa_set(isa0);
+
+#endif
+
+  return 0;
+}
+
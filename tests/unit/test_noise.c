@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2013-2016 The University of Edinburgh
+ *  (c) 2013-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -21,12 +21,16 @@
 
 #include "pe.h"
 #include "coords.h"
+#include "memory.h"
 #include "noise.h"
 #include "tests.h"
 
 static int do_test_noise1(pe_t * pe);
 static int do_test_noise2(pe_t * pe);
 static int do_test_noise3(pe_t * pe);
+static int do_test_noise_philox(void);
+static int do_test_noise_counter(pe_t * pe);
+static int do_test_noise_restart(pe_t * pe);
 
 /*****************************************************************************
  *
@@ -45,6 +49,9 @@ int test_noise_suite(void) {
   do_test_noise1(pe);
   do_test_noise2(pe);
   do_test_noise3(pe);
+  do_test_noise_philox();
+  do_test_noise_counter(pe);
+  do_test_noise_restart(pe);
 
   pe_info(pe, "PASS     ./unit/test_noise\n");
   pe_free(pe);
@@ -307,3 +314,263 @@ static int do_test_noise3(pe_t * pe) {
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  do_test_noise_philox
+ *
+ *  Known answers for Philox4x32-10 (from the Random123 distribution).
+ *
+ *****************************************************************************/
+
+static int do_test_noise_philox(void) {
+
+  unsigned int r[4];
+
+  {
+    unsigned int ctr[4] = {0, 0, 0, 0};
+    unsigned int key[2] = {0, 0};
+
+    noise_philox4x32(ctr, key, r);
+    assert(r[0] == 0x6627e8d5);
+    assert(r[1] == 0xe169c58d);
+    assert(r[2] == 0xbc57ac4c);
+    assert(r[3] == 0x9b00dbd8);
+  }
+
+  {
+    unsigned int ctr[4] = {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff};
+    unsigned int key[2] = {0xffffffff, 0xffffffff};
+
+    noise_philox4x32(ctr, key, r);
+    assert(r[0] == 0x408f276d);
+    assert(r[1] == 0x41c83b0e);
+    assert(r[2] == 0xa20bc7c6);
+    assert(r[3] == 0x6d5451fd);
+  }
+
+  {
+    unsigned int ctr[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+    unsigned int key[2] = {0xa4093822, 0x299f31d0};
+
+    noise_philox4x32(ctr, key, r);
+    assert(r[0] == 0xd16cfe09);
+    assert(r[1] == 0x94fdcceb);
+    assert(r[2] == 0x5001e420);
+    assert(r[3] == 0x24126ea1);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  do_test_noise_counter
+ *
+ *  Counter mode. Each draw must be that for the global position
+ *  (halo sites are periodic images), the vector draw must agree
+ *  with the site-by-site draw, and a step must change the values.
+ *  Check the first two moments in the spatial average.
+ *
+ *****************************************************************************/
+
+static int do_test_noise_counter(pe_t * pe) {
+
+  int nlocal[3];
+  int noffset[3];
+  int ntotal[3];
+  int ic, jc, kc, index;
+  int ig, jg, kg;
+  int ia, iv, idraw;
+  int nsites;
+  int ndiff = 0;
+
+  unsigned int ctr[4];
+  unsigned int key[2] = {0, 0};
+  unsigned int r[4];
+  unsigned int iuniform;
+
+  double rv[NNOISE_MAX*NSIMDVL];
+  double reap[NNOISE_MAX];
+  double reap0[NNOISE_MAX];
+  double rstat[2], rstat_local[2] = {0.0, 0.0};
+  double ltot[3];
+  MPI_Comm comm;
+
+  cs_t * cs = NULL;
+  noise_t * noise = NULL;
+
+  assert(pe);
+
+  cs_create(pe, &cs);
+  cs_init(cs);
+  cs_nlocal(cs, nlocal);
+  cs_nlocal_offset(cs, noffset);
+  cs_ntotal(cs, ntotal);
+  cs_nsites(cs, &nsites);
+  cs_ltot(cs, ltot);
+  cs_cart_comm(cs, &comm);
+
+  noise_create(pe, cs, &noise);
+  noise_mode_set(noise, NOISE_MODE_COUNTER);
+  noise_init(noise, 0);
+  assert(noise->state == NULL);
+
+  /* Include one point in the halo */
+
+  for (ic = 0; ic <= nlocal[X] + 1; ic++) {
+    ig = (noffset[X] + ic - 1 + ntotal[X]) % ntotal[X];
+    for (jc = 0; jc <= nlocal[Y] + 1; jc++) {
+      jg = (noffset[Y] + jc - 1 + ntotal[Y]) % ntotal[Y];
+      for (kc = 0; kc <= nlocal[Z] + 1; kc++) {
+	kg = (noffset[Z] + kc - 1 + ntotal[Z]) % ntotal[Z];
+
+	index = cs_index(cs, ic, jc, kc);
+
+	for (idraw = 0; idraw < 5; idraw++) {
+	  noise_reap_stream_n(noise, NOISE_PHI, index, idraw, NNOISE_MAX,
+			      reap);
+
+	  ctr[0] = (ig*ntotal[Y] + jg)*ntotal[Z] + kg;
+	  ctr[1] = 0;
+	  ctr[2] = NOISE_PHI;
+	  ctr[3] = idraw/4;
+	  noise_philox4x32(ctr, key, r);
+	  iuniform = r[idraw % 4] >> 2;
+
+	  for (ia = 0; ia < NNOISE_MAX; ia++) {
+	    assert(fabs(reap[ia] - noise->rtable[iuniform & 7]) < DBL_EPSILON);
+	    iuniform >>= 3;
+	  }
+	}
+      }
+    }
+  }
+
+  /* Vector version */
+
+  for (index = 0; index + NSIMDVL <= nsites; index += NSIMDVL) {
+    noise_reap_stream_nv(noise, NOISE_QAB, index, 1, NNOISE_MAX, rv);
+    for (iv = 0; iv < NSIMDVL; iv++) {
+      noise_reap_stream_n(noise, NOISE_QAB, index + iv, 1, NNOISE_MAX, reap);
+      for (ia = 0; ia < NNOISE_MAX; ia++) {
+	assert(fabs(rv[ia*NSIMDVL + iv] - reap[ia]) < DBL_EPSILON);
+      }
+    }
+  }
+
+  /* Advance the stream: new values, and statistics */
+
+  index = cs_index(cs, 1, 1, 1);
+  noise_reap_stream_n(noise, NOISE_RHO, index, 0, NNOISE_MAX, reap0);
+
+  noise_advance(noise, NOISE_RHO);
+  assert(noise->step[NOISE_RHO] == 1);
+  assert(noise->step[NOISE_PHI] == 0);
+
+  noise_reap_stream_n(noise, NOISE_RHO, index, 0, NNOISE_MAX, reap);
+  for (ia = 0; ia < NNOISE_MAX; ia++) {
+    if (fabs(reap[ia] - reap0[ia]) > DBL_EPSILON) ndiff += 1;
+  }
+  assert(ndiff > 0);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	index = cs_index(cs, ic, jc, kc);
+	noise_reap_stream_n(noise, NOISE_RHO, index, 0, NNOISE_MAX, reap);
+	for (ia = 0; ia < NNOISE_MAX; ia++) {
+	  rstat_local[0] += reap[ia];
+	  rstat_local[1] += reap[ia]*reap[ia];
+	}
+      }
+    }
+  }
+
+  MPI_Allreduce(rstat_local, rstat, 2, MPI_DOUBLE, MPI_SUM, comm);
+
+  rstat[0] = rstat[0]/(NNOISE_MAX*ltot[X]*ltot[Y]*ltot[Z]);
+  rstat[1] = rstat[1]/(NNOISE_MAX*ltot[X]*ltot[Y]*ltot[Z]) - rstat[0]*rstat[0];
+
+  assert(fabs(rstat[0] - 0.0) < 0.01);
+  assert(fabs(rstat[1] - 1.0) < 0.01);
+
+  noise_free(noise);
+  cs_free(cs);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  do_test_noise_restart
+ *
+ *  Counter mode. A generator started at step nrestart (as at a
+ *  restart) must reproduce the draws of an uninterrupted sequence
+ *  advanced once per step from step zero.
+ *
+ *****************************************************************************/
+
+static int do_test_noise_restart(pe_t * pe) {
+
+  const int nstep = 5;
+  const int nrestart = 3;
+
+  int nlocal[3];
+  int ic, jc, kc, index;
+  int ia, n;
+  double reap[NNOISE_MAX];
+  double reap_restart[NNOISE_MAX];
+
+  cs_t * cs = NULL;
+  noise_t * noise = NULL;
+  noise_t * restart = NULL;
+
+  assert(pe);
+
+  cs_create(pe, &cs);
+  cs_init(cs);
+  cs_nlocal(cs, nlocal);
+
+  noise_create(pe, cs, &noise);
+  noise_mode_set(noise, NOISE_MODE_COUNTER);
+  noise_init(noise, 0);
+
+  noise_create(pe, cs, &restart);
+  noise_mode_set(restart, NOISE_MODE_COUNTER);
+  noise_init(restart, 0);
+  noise_step_set(restart, nrestart);
+
+  assert(restart->step[NOISE_RHO] == (unsigned int) nrestart);
+  assert(restart->step[NOISE_QAB] == (unsigned int) nrestart);
+
+  for (n = 0; n < nstep; n++) {
+
+    if (n >= nrestart) {
+      for (ic = 1; ic <= nlocal[X]; ic++) {
+	for (jc = 1; jc <= nlocal[Y]; jc++) {
+	  for (kc = 1; kc <= nlocal[Z]; kc++) {
+	    index = cs_index(cs, ic, jc, kc);
+	    noise_reap_stream_n(noise, NOISE_RHO, index, 0, NNOISE_MAX, reap);
+	    noise_reap_stream_n(restart, NOISE_RHO, index, 0, NNOISE_MAX,
+				reap_restart);
+	    for (ia = 0; ia < NNOISE_MAX; ia++) {
+	      assert(fabs(reap[ia] - reap_restart[ia]) < DBL_EPSILON);
+	    }
+	  }
+	}
+      }
+      noise_advance(restart, NOISE_RHO);
+    }
+
+    noise_advance(noise, NOISE_RHO);
+  }
+
+  assert(noise->step[NOISE_RHO] == restart->step[NOISE_RHO]);
+
+  noise_free(restart);
+  noise_free(noise);
+  cs_free(cs);
+
+  return 0;
+}
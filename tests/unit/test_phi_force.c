@@ -0,0 +1,186 @@
+/*****************************************************************************
+ *
+ *  test_phi_force.c
+ *
+ *  Force on the fluid from the divergence of the chemical stress:
+ *  the fused (stress computed on the fly) kernel must agree with
+ *  the stored stress version.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+
+#include "pe.h"
+#include "coords.h"
+#include "leesedwards.h"
+#include "physics.h"
+#include "hydro.h"
+#include "field.h"
+#include "field_grad.h"
+#include "gradient_3d_7pt_fluid.h"
+#include "blue_phase.h"
+#include "blue_phase_init.h"
+#include "pth_s.h"
+#include "phi_force_colloid.h"
+#include "tests.h"
+
+static int test_phi_force_fused(pe_t * pe, cs_t * cs, lees_edw_t * le,
+				fe_lc_t * fe);
+
+/*****************************************************************************
+ *
+ *  test_phi_force_suite
+ *
+ *****************************************************************************/
+
+int test_phi_force_suite(void) {
+
+  int nhalo = 2;
+  int ntotal[3] = {20, 20, 20};    /* Not a whole number of tiles */
+  double a0 = 0.014384711;
+  double gamma = 3.1764706;
+  double q0;
+  double kappa = 0.01;
+  double xi = 0.7;
+  double amplitude = -0.2;
+  double ltot[3];
+
+  pe_t * pe = NULL;
+  cs_t * cs = NULL;
+  lees_edw_t * le = NULL;
+  physics_t * phys = NULL;
+  field_t * fq = NULL;
+  field_grad_t * fqgrad = NULL;
+  fe_lc_t * fe = NULL;
+  fe_lc_param_t param = {0};
+
+  pe_create(MPI_COMM_WORLD, PE_QUIET, &pe);
+  cs_create(pe, &cs);
+  cs_nhalo_set(cs, nhalo);
+  cs_ntotal_set(cs, ntotal);
+  cs_init(cs);
+  lees_edw_create(pe, cs, NULL, &le);
+  physics_create(pe, &phys);
+
+  field_create(pe, cs, NQAB, "q", &fq);
+  field_init(fq, nhalo, le);
+  field_grad_create(pe, fq, 2, &fqgrad);
+  field_grad_set(fqgrad, grad_3d_7pt_fluid_d2, NULL);
+
+  fe_lc_create(pe, cs, le, fq, fqgrad, &fe);
+
+  cs_ltot(cs, ltot);
+  q0 = sqrt(2.0)*4.0*atan(1.0)/ltot[Y];
+
+  param.a0 = a0;
+  param.gamma = gamma;
+  param.kappa0 = kappa;
+  param.kappa1 = kappa;
+  param.q0 = q0;
+  param.xi = xi;
+  param.amplitude0 = amplitude;
+  param.redshift = 1.0;
+  param.rredshift = 1.0;
+  fe_lc_param_set(fe, param);
+
+  blue_phase_O8M_init(cs, &param, fq);
+  field_halo(fq);
+  field_memcpy(fq, tdpMemcpyHostToDevice);
+  field_grad_compute(fqgrad);
+
+  test_phi_force_fused(pe, cs, le, fe);
+
+  fe_lc_free(fe);
+  field_grad_free(fqgrad);
+  field_free(fq);
+  physics_free(phys);
+  lees_edw_free(le);
+  cs_free(cs);
+
+  pe_info(pe, "PASS     ./unit/test_phi_force\n");
+  pe_free(pe);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_phi_force_fused
+ *
+ *  Full stress, then antisymmetric part only (stress relaxation).
+ *
+ *****************************************************************************/
+
+static int test_phi_force_fused(pe_t * pe, cs_t * cs, lees_edw_t * le,
+				fe_lc_t * fe) {
+
+  int ic, jc, kc, index;
+  int ia, n;
+  int nlocal[3];
+  double f0[3], f1[3];
+  double fzero[3] = {0.0, 0.0, 0.0};
+
+  pth_t * pth = NULL;
+  hydro_t * href = NULL;
+  hydro_t * hydro = NULL;
+
+  assert(pe);
+  assert(cs);
+  assert(fe);
+
+  cs_nlocal(cs, nlocal);
+
+  pth_create(pe, cs, PTH_METHOD_DIVERGENCE, &pth);
+  hydro_create(pe, cs, le, 1, &href);
+  hydro_create(pe, cs, le, 1, &hydro);
+
+  for (n = 0; n < 2; n++) {
+
+    fe->super.use_stress_relaxation = n;
+
+    hydro_f_zero(href, fzero);
+    hydro_f_zero(hydro, fzero);
+
+    /* The fused version does not require the stored stress */
+
+    pth_force_fluid_fused_driver(pth, (fe_t *) fe, hydro);
+    if (n == 0) test_assert(pth->str == NULL);
+
+    pth_stress_compute(pth, (fe_t *) fe);
+    pth_force_fluid_driver(pth, href);
+
+    hydro_memcpy(href, tdpMemcpyDeviceToHost);
+    hydro_memcpy(hydro, tdpMemcpyDeviceToHost);
+
+    for (ic = 1; ic <= nlocal[X]; ic++) {
+      for (jc = 1; jc <= nlocal[Y]; jc++) {
+	for (kc = 1; kc <= nlocal[Z]; kc++) {
+	  index = cs_index(cs, ic, jc, kc);
+	  hydro_f_local(href, index, f0);
+	  hydro_f_local(hydro, index, f1);
+	  for (ia = 0; ia < 3; ia++) {
+	    test_assert(fabs(f1[ia] - f0[ia]) < DBL_EPSILON);
+	  }
+	}
+      }
+    }
+  }
+
+  fe->super.use_stress_relaxation = 0;
+
+  hydro_free(hydro);
+  hydro_free(href);
+  pth_free(pth);
+
+  return 0;
+}
@@ -7,7 +7,7 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2017 Ths University of Edinburgh
+ *  (c) 2010-2019 Ths University of Edinburgh
  *
  *  Contributing authors: 
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
@@ -24,10 +24,21 @@
 #include "memory.h"
 #include "lb_model_s.h"
 #include "propagation.h"
+#include "physics.h"
+#include "hydro.h"
+#include "map.h"
+#include "noise.h"
+#include "collision.h"
+#include "wall.h"
+#include "lb_sparse.h"
 #include "tests.h"
 
 __host__ int do_test_velocity(pe_t * pe, cs_t * cs, lb_halo_enum_t halo);
 __host__ int do_test_source_destination(pe_t * pe, cs_t * cs, lb_halo_enum_t halo);
+__host__ int do_test_aa(pe_t * pe, cs_t * cs, int nstep);
+__host__ int do_test_halo_overlap(pe_t * pe, cs_t * cs, int nstep);
+__host__ int do_test_sparse(pe_t * pe, cs_t * cs, int nstep);
+__host__ int do_test_halo_depth(pe_t * pe, int ndepth, int nstep);
 
 /*****************************************************************************
  *
@@ -37,6 +48,7 @@ __host__ int do_test_source_destination(pe_t * pe, cs_t * cs, lb_halo_enum_t hal
 
 int test_lb_prop_suite(void) {
 
+  int ndevice;
   pe_t * pe = NULL;
   cs_t * cs = NULL;
 
@@ -58,6 +70,19 @@ int test_lb_prop_suite(void) {
   do_test_velocity(pe, cs, LB_HALO_TARGET);
   do_test_source_destination(pe, cs, LB_HALO_TARGET);
 
+  tdpGetDeviceCount(&ndevice);
+  if (ndevice == 0) {
+    do_test_aa(pe, cs, 1);
+    do_test_aa(pe, cs, 2);
+    do_test_aa(pe, cs, 3);
+  }
+
+  do_test_halo_overlap(pe, cs, 2);
+  do_test_sparse(pe, cs, 2);
+
+  do_test_halo_depth(pe, 2, 5);
+  do_test_halo_depth(pe, 3, 6);
+
   pe_info(pe, "PASS     ./unit/test_prop\n");
   cs_free(cs);
   pe_free(pe);
@@ -82,7 +107,7 @@ int do_test_velocity(pe_t * pe, cs_t * cs, lb_halo_enum_t halo) {
   int nd;
   int nvel;
   int ndist = 2;
-  double f_actual;
+  double f_expect, f_actual;
 
   lb_t * lb = NULL;
 
@@ -140,7 +165,8 @@ int do_test_velocity(pe_t * pe, cs_t * cs, lb_halo_enum_t halo) {
 	for (nd = 0; nd < ndist; nd++) {
 	  for (p = 0; p < nvel; p++) {
 	    lb_f(lb, index, p, nd, &f_actual);
-	    assert(fabs(f_actual - 1.0*(p + nd*NVEL)) < DBL_EPSILON);
+	    f_expect = LB_F_ROUND(1.0*(p + nd*NVEL), wv[p], nd);
+	    assert(fabs(f_actual - f_expect) < DBL_EPSILON);
 	  }
 	}
       }
@@ -246,6 +272,7 @@ int do_test_source_destination(pe_t * pe, cs_t * cs, lb_halo_enum_t halo) {
 	    if (ksource == ntotal[Z] + 1) ksource = 1;
 
 	    f_expect = ltot[Y]*ltot[Z]*isource + ltot[Z]*jsource + ksource;
+	    f_expect = LB_F_ROUND(f_expect, wv[p], nd);
 	    lb_f(lb, index, p, nd, &f_actual);
 
 	    /* In case of d2q9, propagation is only for kc = 1 */
@@ -264,3 +291,487 @@ int do_test_source_destination(pe_t * pe, cs_t * cs, lb_halo_enum_t halo) {
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  do_test_aa
+ *
+ *  Compare nstep steps of collision and AA propagation with the same
+ *  using the standard two-lattice propagation. The results should
+ *  agree to machine precision at all local sites.
+ *
+ *****************************************************************************/
+
+int do_test_aa(pe_t * pe, cs_t * cs, int nstep) {
+
+  int nlocal[3], offset[3];
+  int ic, jc, kc, index, p;
+  int n;
+  double f0, f1;
+
+  lb_t * lb0 = NULL;
+  lb_t * lb1 = NULL;
+  physics_t * phys = NULL;
+  hydro_t * hydro = NULL;
+  map_t * map = NULL;
+  noise_t * noise = NULL;
+  lb_aa_step_enum_t aastep;
+
+  assert(pe);
+  assert(cs);
+
+  physics_create(pe, &phys);
+  physics_eta_shear_set(phys, 0.1);
+  physics_eta_bulk_set(phys, 0.2);
+
+  hydro_create(pe, cs, NULL, 1, &hydro);
+  map_create(pe, cs, 0, &map);
+  noise_create(pe, cs, &noise);
+
+  lb_create(pe, cs, &lb0);
+  lb_init(lb0);
+
+  lb_create(pe, cs, &lb1);
+  lb_propagation_scheme_set(lb1, LB_PROPAGATION_AA);
+  lb_init(lb1);
+  assert(lb1->fprime == NULL);
+
+  cs_nlocal(cs, nlocal);
+  cs_nlocal_offset(cs, offset);
+
+  /* Some non-equilibrium distribution depending on global position */
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	int m = (offset[X] + ic) + 2*(offset[Y] + jc) + 3*(offset[Z] + kc);
+	index = cs_index(cs, ic, jc, kc);
+	for (p = 0; p < NVEL; p++) {
+	  f0 = wv[p]*(1.0 + 0.01*((m + p) % 7));
+	  lb_f_set(lb0, index, p, LB_RHO, f0);
+	  lb_f_set(lb1, index, p, LB_RHO, f0);
+	}
+      }
+    }
+  }
+
+  lb_memcpy(lb0, tdpMemcpyHostToDevice);
+  lb_memcpy(lb1, tdpMemcpyHostToDevice);
+
+  for (n = 0; n < nstep; n++) {
+
+    lb_collide(lb0, hydro, map, noise, NULL);
+    lb_halo(lb0);
+    lb_propagation(lb0);
+
+    lb_collide(lb1, hydro, map, noise, NULL);
+    lb_aa_step(lb1, &aastep);
+    if (aastep == LB_AA_ODD) {
+      lb_halo_reverse(lb1);
+    }
+    else {
+      lb_halo(lb1);
+    }
+    lb_propagation(lb1);
+  }
+
+  lb_propagation_aa_complete(lb1);
+  lb_aa_step(lb1, &aastep);
+  assert(aastep == LB_AA_EVEN);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	index = cs_index(cs, ic, jc, kc);
+	for (p = 0; p < NVEL; p++) {
+	  lb_f(lb0, index, p, LB_RHO, &f0);
+	  lb_f(lb1, index, p, LB_RHO, &f1);
+	  assert(fabs(f1 - f0) < DBL_EPSILON);
+	}
+      }
+    }
+  }
+
+  lb_free(lb1);
+  lb_free(lb0);
+  noise_free(noise);
+  map_free(map);
+  hydro_free(hydro);
+  physics_free(phys);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  do_test_halo_overlap
+ *
+ *  The split collision (boundary, halo start, interior, halo wait)
+ *  must agree exactly with collision followed by the halo swap.
+ *
+ *****************************************************************************/
+
+int do_test_halo_overlap(pe_t * pe, cs_t * cs, int nstep) {
+
+  int nlocal[3], offset[3];
+  int ic, jc, kc, index, p;
+  int n;
+  double f0, f1;
+
+  lb_t * lb0 = NULL;
+  lb_t * lb1 = NULL;
+  physics_t * phys = NULL;
+  hydro_t * hydro = NULL;
+  map_t * map = NULL;
+  noise_t * noise = NULL;
+
+  assert(pe);
+  assert(cs);
+
+  physics_create(pe, &phys);
+  physics_eta_shear_set(phys, 0.1);
+  physics_eta_bulk_set(phys, 0.2);
+
+  hydro_create(pe, cs, NULL, 1, &hydro);
+  map_create(pe, cs, 0, &map);
+  noise_create(pe, cs, &noise);
+
+  lb_create(pe, cs, &lb0);
+  lb_init(lb0);
+
+  lb_create(pe, cs, &lb1);
+  lb_init(lb1);
+  lb_halo_overlap_set(lb1, 1);
+
+  cs_nlocal(cs, nlocal);
+  cs_nlocal_offset(cs, offset);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	int m = (offset[X] + ic) + 2*(offset[Y] + jc) + 3*(offset[Z] + kc);
+	index = cs_index(cs, ic, jc, kc);
+	for (p = 0; p < NVEL; p++) {
+	  f0 = wv[p]*(1.0 + 0.01*((m + p) % 7));
+	  lb_f_set(lb0, index, p, LB_RHO, f0);
+	  lb_f_set(lb1, index, p, LB_RHO, f0);
+	}
+      }
+    }
+  }
+
+  lb_memcpy(lb0, tdpMemcpyHostToDevice);
+  lb_memcpy(lb1, tdpMemcpyHostToDevice);
+
+  for (n = 0; n < nstep; n++) {
+
+    lb_collide(lb0, hydro, map, noise, NULL);
+    lb_halo(lb0);
+    lb_propagation(lb0);
+
+    lb_collide_boundary(lb1, hydro, map, noise, NULL);
+    lb_halo_start(lb1);
+    lb_collide_interior(lb1, hydro, map, noise, NULL);
+    lb_halo_wait(lb1);
+    lb_propagation(lb1);
+  }
+
+  lb_memcpy(lb0, tdpMemcpyDeviceToHost);
+  lb_memcpy(lb1, tdpMemcpyDeviceToHost);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	index = cs_index(cs, ic, jc, kc);
+	for (p = 0; p < NVEL; p++) {
+	  lb_f(lb0, index, p, LB_RHO, &f0);
+	  lb_f(lb1, index, p, LB_RHO, &f1);
+	  test_assert(fabs(f1 - f0) < DBL_EPSILON);
+	}
+      }
+    }
+  }
+
+  lb_free(lb1);
+  lb_free(lb0);
+  noise_free(noise);
+  map_free(map);
+  hydro_free(hydro);
+  physics_free(phys);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  do_test_sparse
+ *
+ *  Compare nstep steps of the sparse collision, halo swap, and
+ *  propagation with the standard dense version with bounce-back at
+ *  solid sites (wall_bbl()). The distributions at fluid sites, and
+ *  the momentum transferred to the solid, should agree.
+ *
+ *****************************************************************************/
+
+int do_test_sparse(pe_t * pe, cs_t * cs, int nstep) {
+
+  int nlocal[3], offset[3];
+  int ic, jc, kc, index, p;
+  int n, nfluid;
+  int status;
+  double f0, f1;
+  double g0[3], g1[3];
+
+  lb_t * lb0 = NULL;
+  lb_t * lb1 = NULL;
+  physics_t * phys = NULL;
+  hydro_t * hydro = NULL;
+  map_t * map = NULL;
+  noise_t * noise = NULL;
+  wall_t * wall = NULL;
+  lb_sparse_t * sparse = NULL;
+  wall_param_t wp = {0};
+
+  assert(pe);
+  assert(cs);
+
+  physics_create(pe, &phys);
+  physics_eta_shear_set(phys, 0.1);
+  physics_eta_bulk_set(phys, 0.2);
+
+  hydro_create(pe, cs, NULL, 1, &hydro);
+  map_create(pe, cs, 0, &map);
+  noise_create(pe, cs, &noise);
+
+  lb_create(pe, cs, &lb0);
+  lb_init(lb0);
+  lb_create(pe, cs, &lb1);
+  lb_init(lb1);
+
+  cs_nlocal(cs, nlocal);
+  cs_nlocal_offset(cs, offset);
+
+  /* Solid sites in a regular pattern; distributions as before */
+
+  nfluid = 0;
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	int m = (offset[X] + ic) + 2*(offset[Y] + jc) + 3*(offset[Z] + kc);
+	index = cs_index(cs, ic, jc, kc);
+	status = (m % 5 == 0) ? MAP_BOUNDARY : MAP_FLUID;
+	map_status_set(map, index, status);
+	if (status == MAP_FLUID) nfluid += 1;
+	for (p = 0; p < NVEL; p++) {
+	  f0 = wv[p]*(1.0 + 0.01*((m + p) % 7));
+	  lb_f_set(lb0, index, p, LB_RHO, f0);
+	  lb_f_set(lb1, index, p, LB_RHO, f0);
+	}
+      }
+    }
+  }
+
+  map_halo(map);
+
+  wall_create(pe, cs, map, lb0, &wall);
+  wp.isporousmedia = 1;
+  wall_commit(wall, wp);
+
+  lb_sparse_create(pe, cs, lb1, &sparse);
+  lb_sparse_build(sparse, map);
+  test_assert(sparse->nfluid == nfluid);
+
+  lb_memcpy(lb0, tdpMemcpyHostToDevice);
+  lb_memcpy(lb1, tdpMemcpyHostToDevice);
+
+  for (n = 0; n < nstep; n++) {
+
+    lb_collide(lb0, hydro, map, noise, NULL);
+    lb_halo(lb0);
+    wall_bbl(wall);
+    lb_propagation(lb0);
+
+    lb_collide_sparse(lb1, hydro, map, noise, NULL, sparse);
+    lb_sparse_halo(sparse);
+    lb_propagation_sparse(lb1, sparse);
+  }
+
+  lb_memcpy(lb0, tdpMemcpyDeviceToHost);
+  lb_memcpy(lb1, tdpMemcpyDeviceToHost);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	index = cs_index(cs, ic, jc, kc);
+	map_status(map, index, &status);
+	if (status != MAP_FLUID) continue;
+	for (p = 0; p < NVEL; p++) {
+	  lb_f(lb0, index, p, LB_RHO, &f0);
+	  lb_f(lb1, index, p, LB_RHO, &f1);
+	  test_assert(fabs(f1 - f0) < DBL_EPSILON);
+	}
+      }
+    }
+  }
+
+  /* Momentum accounting (local; order of summation differs) */
+
+  wall_momentum(wall, g0);
+  lb_sparse_momentum(sparse, g1);
+
+  for (n = 0; n < 3; n++) {
+    test_assert(fabs(g1[n] - g0[n]) < FLT_EPSILON);
+  }
+
+  lb_sparse_free(sparse);
+  wall_free(wall);
+  lb_free(lb1);
+  lb_free(lb0);
+  noise_free(noise);
+  map_free(map);
+  hydro_free(hydro);
+  physics_free(phys);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  do_test_halo_depth
+ *
+ *  Compare nstep steps of the standard collision, halo swap,
+ *  bounce-back and propagation with the communication-avoiding
+ *  version, which swaps a halo of width ndepth every ndepth steps
+ *  and extends the collision and propagation into the halo between.
+ *  The distributions at local sites, and the momentum transferred
+ *  to the solid, should agree.
+ *
+ *****************************************************************************/
+
+int do_test_halo_depth(pe_t * pe, int ndepth, int nstep) {
+
+  int nlocal[3], offset[3];
+  int ic, jc, kc, index, p;
+  int n, nextra;
+  int status;
+  double f0, f1;
+  double g0[3], g1[3];
+
+  cs_t * cs = NULL;
+  lb_t * lb0 = NULL;
+  lb_t * lb1 = NULL;
+  physics_t * phys = NULL;
+  hydro_t * hydro = NULL;
+  map_t * map = NULL;
+  noise_t * noise = NULL;
+  wall_t * wall0 = NULL;
+  wall_t * wall1 = NULL;
+  wall_param_t wp = {0};
+
+  assert(pe);
+  assert(ndepth > 1);
+
+  cs_create(pe, &cs);
+  cs_nhalo_set(cs, ndepth);
+  cs_init(cs);
+
+  physics_create(pe, &phys);
+  physics_eta_shear_set(phys, 0.1);
+  physics_eta_bulk_set(phys, 0.2);
+
+  hydro_create(pe, cs, NULL, 1, &hydro);
+  map_create(pe, cs, 0, &map);
+  noise_create(pe, cs, &noise);
+
+  lb_create(pe, cs, &lb0);
+  lb_init(lb0);
+  lb_create(pe, cs, &lb1);
+  lb_halo_depth_set(lb1, ndepth);
+  lb_init(lb1);
+
+  cs_nlocal(cs, nlocal);
+  cs_nlocal_offset(cs, offset);
+
+  /* Solid sites in a regular pattern; distributions as before */
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	int m = (offset[X] + ic) + 2*(offset[Y] + jc) + 3*(offset[Z] + kc);
+	index = cs_index(cs, ic, jc, kc);
+	status = (m % 5 == 0) ? MAP_BOUNDARY : MAP_FLUID;
+	map_status_set(map, index, status);
+	for (p = 0; p < NVEL; p++) {
+	  f0 = wv[p]*(1.0 + 0.01*((m + p) % 7));
+	  lb_f_set(lb0, index, p, LB_RHO, f0);
+	  lb_f_set(lb1, index, p, LB_RHO, f0);
+	}
+      }
+    }
+  }
+
+  map_halo(map);
+
+  wp.isporousmedia = 1;
+  wall_create(pe, cs, map, lb0, &wall0);
+  wall_commit(wall0, wp);
+  wall_create(pe, cs, map, lb1, &wall1);
+  wall_commit(wall1, wp);
+
+  lb_memcpy(lb0, tdpMemcpyHostToDevice);
+  lb_memcpy(lb1, tdpMemcpyHostToDevice);
+
+  for (n = 0; n < nstep; n++) {
+
+    lb_collide(lb0, hydro, map, noise, NULL);
+    lb_halo(lb0);
+    wall_bbl(wall0);
+    lb_propagation(lb0);
+
+    nextra = (n % ndepth == 0) ? 0 : ndepth - (n % ndepth);
+    lb_collide_extended(lb1, hydro, map, noise, NULL, nextra);
+    if (n % ndepth == 0) lb_halo(lb1);
+    wall_bbl(wall1);
+    lb_propagation_extended(lb1, ndepth - 1 - (n % ndepth));
+  }
+
+  lb_memcpy(lb0, tdpMemcpyDeviceToHost);
+  lb_memcpy(lb1, tdpMemcpyDeviceToHost);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	index = cs_index(cs, ic, jc, kc);
+	map_status(map, index, &status);
+	if (status != MAP_FLUID) continue;
+	for (p = 0; p < NVEL; p++) {
+	  lb_f(lb0, index, p, LB_RHO, &f0);
+	  lb_f(lb1, index, p, LB_RHO, &f1);
+	  test_assert(fabs(f1 - f0) < DBL_EPSILON);
+	}
+      }
+    }
+  }
+
+  /* Momentum accounting is for links from local sites only */
+
+  wall_momentum(wall0, g0);
+  wall_momentum(wall1, g1);
+
+  for (n = 0; n < 3; n++) {
+    test_assert(fabs(g1[n] - g0[n]) < FLT_EPSILON);
+  }
+
+  wall_free(wall1);
+  wall_free(wall0);
+  lb_free(lb1);
+  lb_free(lb0);
+  noise_free(noise);
+  map_free(map);
+  hydro_free(hydro);
+  physics_free(phys);
+  cs_free(cs);
+
+  return 0;
+}
@@ -0,0 +1,452 @@
+/*****************************************************************************
+ *
+ *  test_psi_mg.c
+ *
+ *  Multigrid Poisson solver.
+ *
+ *  Edinburgh Soft Matter and Statistical Physics Group and
+ *  Edinburgh Parallel Computing Centre
+ *
+ *  (c) 2019 The University of Edinburgh
+ *
+ *  Contributing authors:
+ *  Kevin Stratford (kevin@epcc.ed.ac.uk)
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pe.h"
+#include "coords.h"
+#include "physics.h"
+#include "util.h"
+#include "psi_s.h"
+#include "psi_mg.h"
+#include "tests.h"
+
+#define REF_PERMEATIVITY 1.0
+
+static cs_t * cs_eps = NULL;  /* Coordinate system for fepsilon_sinz */
+
+static int do_test_psi_mg1(pe_t * pe, int gamma, f_vare_t fepsilon);
+static int test_mg_charge_set(psi_t * psi);
+static int test_mg_vare_set(psi_t * psi, f_vare_t fepsilon);
+static int test_mg_vare_check(psi_t * psi);
+static double test_mg_vare_psi(int z, int ntotal);
+static int test_mg_exact(psi_t * psi);
+static int test_mg_residual(psi_t * psi, f_vare_t fepsilon, double * rnorm);
+static int fepsilon_sinz(void * fe, int index, double * epsilon);
+
+/*****************************************************************************
+ *
+ *  test_psi_mg_suite
+ *
+ *****************************************************************************/
+
+int test_psi_mg_suite(void) {
+
+  pe_t * pe = NULL;
+  physics_t * phys = NULL;
+
+  pe_create(MPI_COMM_WORLD, PE_QUIET, &pe);
+  physics_create(pe, &phys);
+
+  do_test_psi_mg1(pe, 1, NULL);
+  do_test_psi_mg1(pe, 2, NULL);
+  do_test_psi_mg1(pe, 1, fepsilon_sinz);
+
+  pe_info(pe, "PASS     ./unit/test_psi_mg\n");
+
+  physics_free(phys);
+  pe_free(pe);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  do_test_psi_mg1
+ *
+ *  Periodic system with the charge distribution varying in z only.
+ *  The residual at convergence must satisfy the tolerance, and the
+ *  solution is checked against the exact solution of the discrete
+ *  one-dimensional problem.
+ *
+ *****************************************************************************/
+
+static int do_test_psi_mg1(pe_t * pe, int gamma, f_vare_t fepsilon) {
+
+  int nlevel;
+  int cartsz[3];
+  int ntotal[3] = {32, 32, 32};
+  double tol_rel, tol_abs;
+  double rnorm[2];
+  cs_t * cs = NULL;
+  psi_t * psi = NULL;
+  psi_mg_t * mg = NULL;
+
+  assert(pe);
+
+  cs_create(pe, &cs);
+  cs_ntotal_set(cs, ntotal);
+  cs_nhalo_set(cs, 1);
+  cs_init(cs);
+  cs_cartsz(cs, cartsz);
+  cs_eps = cs;
+
+  psi_create(pe, cs, 2, &psi);
+  psi_valency_set(psi, 0, +1.0);
+  psi_valency_set(psi, 1, -1.0);
+  psi_epsilon_set(psi, REF_PERMEATIVITY);
+  psi_beta_set(psi, 1.0);
+  psi_reltol_set(psi, 1.0e-10);
+  psi_maxits_set(psi, 100);
+  psi_multigrid_set(psi, gamma, 2);
+
+  psi_mg_create(psi, &mg);
+  assert(mg);
+
+  psi_mg_nlevel(mg, &nlevel);
+  assert(nlevel > 1);
+
+  if (fepsilon == NULL) test_mg_charge_set(psi);
+  if (fepsilon != NULL) test_mg_vare_set(psi, fepsilon);
+  psi_halo_psi(psi);
+  psi_halo_rho(psi);
+
+  test_mg_residual(psi, fepsilon, rnorm);
+  psi_mg_solve(mg, NULL, fepsilon);
+  test_mg_residual(psi, fepsilon, rnorm + 1);
+
+  psi_reltol(psi, &tol_rel);
+  psi_abstol(psi, &tol_abs);
+  assert(rnorm[1] < tol_abs || rnorm[1] < tol_rel*rnorm[0]);
+
+  if (fepsilon == NULL && cartsz[Z] == 1) test_mg_exact(psi);
+  if (fepsilon != NULL) test_mg_vare_check(psi);
+
+  psi_mg_free(mg);
+  psi_free(psi);
+  cs_free(cs);
+  cs_eps = NULL;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_mg_charge_set
+ *
+ *  Positive charge at z = 1 and z = L_z balanced by a uniform negative
+ *  charge elsewhere (as for test_psi_sor.c).
+ *
+ *****************************************************************************/
+
+static int test_mg_charge_set(psi_t * psi) {
+
+  int ic, jc, kc, index;
+  int nlocal[3];
+  int noffset[3];
+  int ntotal[3];
+  double ltot[3];
+  double rho0, rho1;
+
+  assert(psi);
+
+  cs_ltot(psi->cs, ltot);
+  cs_nlocal(psi->cs, nlocal);
+  cs_nlocal_offset(psi->cs, noffset);
+  cs_ntotal(psi->cs, ntotal);
+
+  rho0 = 1.0 / (2.0*ltot[X]*ltot[Y]);
+  rho1 = 1.0 / (ltot[X]*ltot[Y]*(ltot[Z] - 2.0));
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+
+	int z = noffset[Z] + kc;
+	index = cs_index(psi->cs, ic, jc, kc);
+
+	psi_psi_set(psi, index, 0.0);
+	if (z == 1 || z == ntotal[Z]) {
+	  psi_rho_set(psi, index, 0, rho0);
+	  psi_rho_set(psi, index, 1, 0.0);
+	}
+	else {
+	  psi_rho_set(psi, index, 0, 0.0);
+	  psi_rho_set(psi, index, 1, rho1);
+	}
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_mg_vare_set
+ *
+ *  For variable permittivity the discrete operator is not symmetric,
+ *  so an arbitrary neutral charge distribution need not have a
+ *  solution. Instead, take a known potential psi(z) and set the
+ *  charge from the discrete operator.
+ *
+ *****************************************************************************/
+
+static int test_mg_vare_set(psi_t * psi, f_vare_t fepsilon) {
+
+  int ic, jc, kc, index;
+  int xs, ys, zs;
+  int z;
+  int nlocal[3];
+  int noffset[3];
+  int ntotal[3];
+  double u0, up, um;
+  double e0, ep, em;
+  double rho_elec;
+
+  assert(psi);
+  assert(fepsilon);
+
+  cs_nlocal(psi->cs, nlocal);
+  cs_nlocal_offset(psi->cs, noffset);
+  cs_ntotal(psi->cs, ntotal);
+  cs_strides(psi->cs, &xs, &ys, &zs);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+
+	index = cs_index(psi->cs, ic, jc, kc);
+	z = noffset[Z] + kc;
+
+	u0 = test_mg_vare_psi(z, ntotal[Z]);
+	up = test_mg_vare_psi(z + 1, ntotal[Z]);
+	um = test_mg_vare_psi(z - 1, ntotal[Z]);
+	fepsilon(NULL, index, &e0);
+	fepsilon(NULL, index + zs, &ep);
+	fepsilon(NULL, index - zs, &em);
+
+	rho_elec = -(e0*(up + um - 2.0*u0) + 0.25*(ep - em)*(up - um));
+
+	psi_psi_set(psi, index, 0.0);
+	psi_rho_set(psi, index, 0, (rho_elec > 0.0) ? +rho_elec : 0.0);
+	psi_rho_set(psi, index, 1, (rho_elec < 0.0) ? -rho_elec : 0.0);
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_mg_vare_check
+ *
+ *  The solution should agree with test_mg_vare_psi() to within a
+ *  constant (here fixed by the first local site).
+ *
+ *****************************************************************************/
+
+static int test_mg_vare_check(psi_t * psi) {
+
+  int ic, jc, kc, index;
+  int z;
+  int nlocal[3];
+  int noffset[3];
+  int ntotal[3];
+  double psi0, psi1, u0, u1;
+
+  assert(psi);
+
+  cs_nlocal(psi->cs, nlocal);
+  cs_nlocal_offset(psi->cs, noffset);
+  cs_ntotal(psi->cs, ntotal);
+
+  psi_psi(psi, cs_index(psi->cs, 1, 1, 1), &psi0);
+  u0 = test_mg_vare_psi(noffset[Z] + 1, ntotal[Z]);
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+	index = cs_index(psi->cs, ic, jc, kc);
+	z = noffset[Z] + kc;
+	psi_psi(psi, index, &psi1);
+	u1 = test_mg_vare_psi(z, ntotal[Z]);
+	assert(fabs((psi1 - psi0) - (u1 - u0)) < FLT_EPSILON);
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_mg_vare_psi
+ *
+ *  Reference potential psi(z) = 0.01 cos(2 pi z / Lz)
+ *
+ *****************************************************************************/
+
+static double test_mg_vare_psi(int z, int ntotal) {
+
+  PI_DOUBLE(pi);
+
+  return 0.01*cos(2.0*pi*z/ntotal);
+}
+
+/*****************************************************************************
+ *
+ *  test_mg_residual
+ *
+ *  Global L1 norm of the residual of the discrete problem for the
+ *  current potential (the same discretisation as psi_sor.c).
+ *
+ *****************************************************************************/
+
+static int test_mg_residual(psi_t * psi, f_vare_t fepsilon, double * rnorm) {
+
+  int ic, jc, kc, index;
+  int xs, ys, zs;
+  int str[3];
+  int ia;
+  int nlocal[3];
+  double eps0, epsp, epsm;
+  double rho_elec;
+  double rlocal = 0.0;
+  MPI_Comm comm;
+
+  assert(psi);
+  assert(rnorm);
+
+  cs_nlocal(psi->cs, nlocal);
+  cs_strides(psi->cs, &xs, &ys, &zs);
+  cs_cart_comm(psi->cs, &comm);
+  str[X] = xs; str[Y] = ys; str[Z] = zs;
+
+  for (ic = 1; ic <= nlocal[X]; ic++) {
+    for (jc = 1; jc <= nlocal[Y]; jc++) {
+      for (kc = 1; kc <= nlocal[Z]; kc++) {
+
+	double au = 0.0;
+
+	index = cs_index(psi->cs, ic, jc, kc);
+	eps0 = REF_PERMEATIVITY;
+	if (fepsilon) fepsilon(NULL, index, &eps0);
+
+	for (ia = 0; ia < 3; ia++) {
+	  au += eps0*(psi->psi[index + str[ia]] + psi->psi[index - str[ia]]
+		      - 2.0*psi->psi[index]);
+	  if (fepsilon) {
+	    fepsilon(NULL, index + str[ia], &epsp);
+	    fepsilon(NULL, index - str[ia], &epsm);
+	    au += 0.25*(epsp - epsm)
+	      *(psi->psi[index + str[ia]] - psi->psi[index - str[ia]]);
+	  }
+	}
+
+	psi_rho_elec(psi, index, &rho_elec);
+	rlocal += fabs(au + psi->e*psi->beta*rho_elec);
+      }
+    }
+  }
+
+  MPI_Allreduce(&rlocal, rnorm, 1, MPI_DOUBLE, MPI_SUM, comm);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_mg_exact
+ *
+ *  Compare with the solution of the tri-diagonal system for the
+ *  three-point stencil in z (to within a constant); see test_psi_sor.c.
+ *
+ *****************************************************************************/
+
+static int test_mg_exact(psi_t * psi) {
+
+  int k, kp1, km1, index;
+  int n;
+  int nlocal[3];
+  int ifail;
+  double psi0, psik;
+  double * a = NULL;
+  double * b = NULL;
+
+  assert(psi);
+
+  cs_nlocal(psi->cs, nlocal);
+  n = nlocal[Z];
+
+  a = (double *) calloc(n*n, sizeof(double));
+  b = (double *) calloc(n, sizeof(double));
+  assert(a && b);
+
+  for (k = 0; k < n; k++) {
+    kp1 = k + 1;
+    km1 = k - 1;
+    if (k == 0) km1 = kp1;
+    if (k == n-1) kp1 = km1;
+
+    a[k*n + kp1] = REF_PERMEATIVITY;
+    a[k*n + km1] = REF_PERMEATIVITY;
+    a[k*n + k] = -2.0*REF_PERMEATIVITY;
+
+    index = cs_index(psi->cs, 1, 1, k + 1);
+    psi_rho_elec(psi, index, b + k);
+    b[k] *= -1.0;
+  }
+
+  ifail = util_gauss_jordan(n, a, b);
+  assert(ifail == 0);
+
+  psi0 = 0.0;
+  for (k = 0; k < n; k++) {
+    index = cs_index(psi->cs, 1, 1, 1 + k);
+    psi_psi(psi, index, &psik);
+    if (k == 0) psi0 = psik;
+    assert(fabs(b[k] + psi0 - psik) < FLT_EPSILON);
+  }
+
+  free(b);
+  free(a);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  fepsilon_sinz
+ *
+ *  Periodic in z: e = e0 (1 + 0.5 sin(2 pi z / Lz))
+ *
+ *****************************************************************************/
+
+static int fepsilon_sinz(void * fe, int index, double * epsilon) {
+
+  int coords[3];
+  int noffset[3];
+  double ltot[3];
+  PI_DOUBLE(pi);
+
+  assert(cs_eps);
+  assert(epsilon);
+
+  cs_index_to_ijk(cs_eps, index, coords);
+  cs_nlocal_offset(cs_eps, noffset);
+  cs_ltot(cs_eps, ltot);
+
+  *epsilon = REF_PERMEATIVITY
+    *(1.0 + 0.5*sin(2.0*pi*(noffset[Z] + coords[Z])/ltot[Z]));
+
+  return 0;
+}
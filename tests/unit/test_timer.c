@@ -7,20 +7,27 @@
  *  Edinburgh Soft Matter and Statistical Physics Group and
  *  Edinburgh Parallel Computing Centre
  *
- *  (c) 2010-2017 The University of Edinburgh
+ *  (c) 2010-2019 The University of Edinburgh
  *
  *  Contributing authors:
  *  Kevin Stratford (kevin@epcc.ed.ac.uk)
  *
  *****************************************************************************/
 
+#include <assert.h>
 #include <time.h>
 #include <limits.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "pe.h"
 #include "timer.h"
+#include "telemetry.h"
 #include "tests.h"
 
+int do_test_timer_interval(pe_t * pe);
+int do_test_telemetry(pe_t * pe);
+
 /*****************************************************************************
  *
  *  test_timer_suite
@@ -37,8 +44,108 @@ int test_timer_suite(void) {
   TIMER_start(TIMER_TOTAL);
   TIMER_stop(TIMER_TOTAL);
 
+  do_test_timer_interval(pe);
+  do_test_telemetry(pe);
+
   pe_info(pe, "PASS     ./unit/test_timer\n");
   pe_free(pe);
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  do_test_timer_interval
+ *
+ *****************************************************************************/
+
+int do_test_timer_interval(pe_t * pe) {
+
+  int ncall;
+  double t, nsite, nbyte;
+
+  assert(pe);
+
+  TIMER_interval_reset();
+
+  TIMER_start(TIMER_FREE2);
+  TIMER_stop(TIMER_FREE2);
+  TIMER_work(TIMER_FREE2, 10.0, 80.0);
+  TIMER_start(TIMER_FREE2);
+  TIMER_stop(TIMER_FREE2);
+  TIMER_work(TIMER_FREE2, 10.0, 80.0);
+
+  /* A timer which is not stopped has no completed calls */
+  TIMER_start(TIMER_FREE3);
+
+  TIMER_interval(TIMER_FREE2, &t, &ncall, &nsite, &nbyte);
+  assert(t >= 0.0);
+  assert(ncall == 2);
+  assert(nsite == 20.0);
+  assert(nbyte == 160.0);
+
+  TIMER_interval(TIMER_FREE3, &t, &ncall, &nsite, &nbyte);
+  assert(ncall == 0);
+  TIMER_stop(TIMER_FREE3);
+
+  TIMER_interval_reset();
+  TIMER_interval(TIMER_FREE2, &t, &ncall, &nsite, &nbyte);
+  assert(t == 0.0);
+  assert(ncall == 0);
+  assert(nsite == 0.0);
+  assert(nbyte == 0.0);
+
+  assert(strcmp(TIMER_name(TIMER_TOTAL), "Total") == 0);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  do_test_telemetry
+ *
+ *  CSV has a header, and then one record per active timer per report.
+ *
+ *****************************************************************************/
+
+int do_test_telemetry(pe_t * pe) {
+
+  int nline = 0;
+  char line[BUFSIZ];
+  const char * filename = "test-telemetry.csv";
+  FILE * fp = NULL;
+
+  assert(pe);
+
+  telemetry_init(pe, 2, TELEMETRY_CSV, filename);
+
+  TIMER_start(TIMER_STEPS);
+  TIMER_stop(TIMER_STEPS);
+  TIMER_start(TIMER_FREE2);
+  TIMER_stop(TIMER_FREE2);
+  TIMER_work(TIMER_FREE2, 1.0, 8.0);
+
+  telemetry_step(1);      /* Not a report step */
+  telemetry_step(2);      /* Two records */
+  telemetry_step(4);      /* No active timers, so no records */
+
+  telemetry_finish();
+
+  if (pe_mpi_rank(pe) == 0) {
+    fp = fopen(filename, "r");
+    assert(fp);
+
+    while (fgets(line, BUFSIZ, fp)) {
+      if (nline == 0) assert(strncmp(line, "step,timer,calls", 16) == 0);
+      if (nline == 1) assert(strncmp(line, "2,\"Time step loop\",1,", 21) == 0);
+      if (nline == 2) assert(strncmp(line, "2,\"Free2\",1,", 12) == 0);
+      nline += 1;
+    }
+    assert(nline == 3);
+
+    fclose(fp);
+    remove(filename);
+  }
+
+  return 0;
+}
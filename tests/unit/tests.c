@@ -57,10 +57,12 @@ int tests_create() {
   test_bp_suite();
   test_build_suite();
   test_colloid_suite();
+  test_colloid_nlist_suite();
   test_colloid_sums_suite();
   test_colloids_info_suite();
   test_colloids_halo_suite();
   test_ewald_suite();
+  test_ewald_pme_suite();
   test_fe_electro_suite();
   test_fe_electro_symm_suite();
   test_field_suite();
@@ -68,6 +70,7 @@ int tests_create() {
   test_halo_suite();
   test_hydro_suite();
   test_io_suite();
+  test_io_async_suite();
   test_le_suite();
   test_lubrication_suite();
   test_map_suite();
@@ -76,8 +79,10 @@ int tests_create() {
   test_pair_lj_cut_suite();
   test_pair_ss_cut_suite();
   test_pair_yukawa_suite();
+  test_phi_force_suite();
   test_polar_active_suite();
   test_psi_suite();
+  test_psi_mg_suite();
   test_lb_prop_suite();
   test_random_suite();
   test_rt_suite();
@@ -30,11 +30,13 @@ int test_bond_fene_suite(void);
 int test_bonds_suite(void);
 int test_build_suite(void);
 int test_colloid_sums_suite(void);
+int test_colloid_nlist_suite(void);
 int test_colloid_suite(void);
 int test_colloids_info_suite(void);
 int test_colloids_halo_suite(void);
 int test_coords_suite(void);
 int test_ewald_suite(void);
+int test_ewald_pme_suite(void);
 int test_fe_electro_suite(void);
 int test_fe_electro_symm_suite(void);
 int test_field_suite(void);
@@ -42,6 +44,7 @@ int test_field_grad_suite(void);
 int test_halo_suite(void);
 int test_hydro_suite(void);
 int test_io_suite(void);
+int test_io_async_suite(void);
 int test_le_suite(void);
 int test_kernel_suite(void);
 int test_lubrication_suite(void);
@@ -54,9 +57,11 @@ int test_pair_ss_cut_suite(void);
 int test_pair_yukawa_suite(void);
 int test_pe_suite(void);
 int test_phi_ch_suite(void);
+int test_phi_force_suite(void);
 int test_polar_active_suite(void);
 int test_lb_prop_suite(void);
 int test_psi_suite(void);
+int test_psi_mg_suite(void);
 int test_psi_sor_suite(void);
 int test_random_suite(void);
 int test_rt_suite(void);